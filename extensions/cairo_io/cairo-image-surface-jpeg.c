@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <math.h>
 #include <setjmp.h>
 #include <jpeglib.h>
 #if HAVE_LCMS2
@@ -140,6 +141,368 @@ YCbCr_tables_init (void)
 }
 
 
+#if HAVE_JPEG_CROP_SCANLINE
+
+
+/* GthImageJpeg (private class) */
+
+
+/* Images with more pixels than this are not loaded at full resolution:
+ * the image viewer decodes the visible region when zooming in. */
+#define REGION_LOAD_MIN_PIXELS (32 * 1024 * 1024)
+
+
+#define GTH_IMAGE_JPEG(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), gth_image_jpeg_get_type(), GthImageJpeg))
+
+
+typedef struct {
+	GthImage __parent;
+	void         *buffer;
+	gsize         buffer_size;
+	int           width;
+	int           height;
+	GthTransform  orientation;
+} GthImageJpeg;
+
+
+typedef GthImageClass GthImageJpegClass;
+
+static gpointer gth_image_jpeg_parent_class;
+
+GType gth_image_jpeg_get_type (void);
+
+G_DEFINE_TYPE (GthImageJpeg, gth_image_jpeg, GTH_TYPE_IMAGE)
+
+
+static void
+gth_image_jpeg_finalize (GObject *object)
+{
+	GthImageJpeg *self;
+
+	self = GTH_IMAGE_JPEG (object);
+	g_free (self->buffer);
+
+	G_OBJECT_CLASS (gth_image_jpeg_parent_class)->finalize (object);
+}
+
+
+static void
+gth_image_jpeg_init (GthImageJpeg *self)
+{
+	self->buffer = NULL;
+	self->buffer_size = 0;
+	self->width = 0;
+	self->height = 0;
+	self->orientation = GTH_TRANSFORM_NONE;
+}
+
+
+static gboolean
+gth_image_jpeg_get_can_load_region (GthImage *base)
+{
+	return (((GthImageJpeg *) base)->buffer != NULL);
+}
+
+
+/* Transforms @src into @dest, @width and @height are the size of the
+ * destination space. */
+static void
+_cairo_rectangle_transform (cairo_rectangle_int_t *src,
+			    GthTransform           transform,
+			    int                    width,
+			    int                    height,
+			    cairo_rectangle_int_t *dest)
+{
+	switch (transform) {
+	case GTH_TRANSFORM_NONE:
+	default:
+		dest->x = src->x;
+		dest->y = src->y;
+		break;
+	case GTH_TRANSFORM_FLIP_H:
+		dest->x = width - src->x - src->width;
+		dest->y = src->y;
+		break;
+	case GTH_TRANSFORM_ROTATE_180:
+		dest->x = width - src->x - src->width;
+		dest->y = height - src->y - src->height;
+		break;
+	case GTH_TRANSFORM_FLIP_V:
+		dest->x = src->x;
+		dest->y = height - src->y - src->height;
+		break;
+	case GTH_TRANSFORM_TRANSPOSE:
+		dest->x = src->y;
+		dest->y = src->x;
+		break;
+	case GTH_TRANSFORM_ROTATE_90:
+		dest->x = src->y;
+		dest->y = height - src->x - src->width;
+		break;
+	case GTH_TRANSFORM_TRANSVERSE:
+		dest->x = width - src->y - src->height;
+		dest->y = height - src->x - src->width;
+		break;
+	case GTH_TRANSFORM_ROTATE_270:
+		dest->x = width - src->y - src->height;
+		dest->y = src->x;
+		break;
+	}
+
+	switch (transform) {
+	case GTH_TRANSFORM_TRANSPOSE:
+	case GTH_TRANSFORM_ROTATE_90:
+	case GTH_TRANSFORM_TRANSVERSE:
+	case GTH_TRANSFORM_ROTATE_270:
+		dest->width = src->height;
+		dest->height = src->width;
+		break;
+	default:
+		dest->width = src->width;
+		dest->height = src->height;
+		break;
+	}
+}
+
+
+static GthTransform
+_gth_transform_get_inverse (GthTransform transform)
+{
+	switch (transform) {
+	case GTH_TRANSFORM_ROTATE_90:
+		return GTH_TRANSFORM_ROTATE_270;
+	case GTH_TRANSFORM_ROTATE_270:
+		return GTH_TRANSFORM_ROTATE_90;
+	default:
+		return transform;
+	}
+}
+
+
+static cairo_surface_t *
+gth_image_jpeg_load_region (GthImage               *base,
+			    cairo_rectangle_int_t  *region,
+			    double                  zoom,
+			    cairo_rectangle_int_t  *loaded_region,
+			    GCancellable           *cancellable,
+			    GError                **error)
+{
+	GthImageJpeg                   *self;
+	gboolean                        rotated;
+	int                             oriented_width;
+	int                             oriented_height;
+	cairo_rectangle_int_t           oriented_region;
+	cairo_rectangle_int_t           raw_region;
+	struct error_handler_data       jsrcerr;
+	struct jpeg_decompress_struct   srcinfo;
+	GError                         *local_error = NULL;
+	cairo_surface_t * volatile      surface = NULL;
+	int                             x1, y1, x2, y2;
+	JDIMENSION                      x_offset;
+	JDIMENSION                      crop_width;
+	int                             n_rows;
+	unsigned char                  *surface_data;
+	int                             stride;
+	int                             row;
+
+	self = GTH_IMAGE_JPEG (base);
+	if (self->buffer == NULL) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "");
+		return NULL;
+	}
+
+	rotated = ((self->orientation == GTH_TRANSFORM_ROTATE_90)
+		   || (self->orientation == GTH_TRANSFORM_ROTATE_270)
+		   || (self->orientation == GTH_TRANSFORM_TRANSPOSE)
+		   || (self->orientation == GTH_TRANSFORM_TRANSVERSE));
+	oriented_width = rotated ? self->height : self->width;
+	oriented_height = rotated ? self->width : self->height;
+
+	oriented_region.x = CLAMP (region->x, 0, oriented_width);
+	oriented_region.y = CLAMP (region->y, 0, oriented_height);
+	oriented_region.width = CLAMP (region->x + region->width, 0, oriented_width) - oriented_region.x;
+	oriented_region.height = CLAMP (region->y + region->height, 0, oriented_height) - oriented_region.y;
+	if ((oriented_region.width <= 0) || (oriented_region.height <= 0)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "");
+		return NULL;
+	}
+
+	_cairo_rectangle_transform (&oriented_region,
+				    self->orientation,
+				    self->width,
+				    self->height,
+				    &raw_region);
+
+	srcinfo.err = jpeg_std_error (&(jsrcerr.pub));
+	jsrcerr.pub.error_exit = fatal_error_handler;
+	jsrcerr.pub.output_message = output_message_handler;
+	jsrcerr.error = &local_error;
+
+	jpeg_create_decompress (&srcinfo);
+
+	if (sigsetjmp (jsrcerr.setjmp_buffer, 1)) {
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+		jpeg_destroy_decompress (&srcinfo);
+		g_propagate_error (error, local_error);
+		return NULL;
+	}
+
+	_jpeg_memory_src (&srcinfo, self->buffer, self->buffer_size);
+	jpeg_read_header (&srcinfo, TRUE);
+
+	/* decode at the smallest scale not lower than the zoom level, the
+	 * conversion to the cairo pixel format is done by libjpeg. */
+
+	srcinfo.scale_num = CLAMP ((int) ceil (zoom * 8.0), 1, 8);
+	srcinfo.scale_denom = 8;
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	srcinfo.out_color_space = JCS_EXT_BGRA;
+#else
+	srcinfo.out_color_space = JCS_EXT_ARGB;
+#endif
+	jpeg_start_decompress (&srcinfo);
+
+	x1 = floor ((double) raw_region.x * srcinfo.output_width / srcinfo.image_width);
+	y1 = floor ((double) raw_region.y * srcinfo.output_height / srcinfo.image_height);
+	x2 = ceil ((double) (raw_region.x + raw_region.width) * srcinfo.output_width / srcinfo.image_width);
+	y2 = ceil ((double) (raw_region.y + raw_region.height) * srcinfo.output_height / srcinfo.image_height);
+	x2 = MIN (MAX (x2, x1 + 1), srcinfo.output_width);
+	y2 = MIN (MAX (y2, y1 + 1), srcinfo.output_height);
+
+	/* the horizontal offset is aligned to the iMCU boundary */
+
+	x_offset = x1;
+	crop_width = x2 - x1;
+	jpeg_crop_scanline (&srcinfo, &x_offset, &crop_width);
+	n_rows = y2 - y1;
+
+	surface = _cairo_image_surface_create (CAIRO_FORMAT_ARGB32, crop_width, n_rows);
+	if (surface == NULL) {
+		jpeg_abort_decompress (&srcinfo);
+		jpeg_destroy_decompress (&srcinfo);
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "");
+		return NULL;
+	}
+	_cairo_metadata_set_has_alpha (_cairo_image_surface_get_metadata (surface), FALSE);
+	surface_data = _cairo_image_surface_flush_and_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+
+	if (y1 > 0)
+		jpeg_skip_scanlines (&srcinfo, y1);
+
+	for (row = 0; row < n_rows; row++) {
+		JSAMPROW row_pointer;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			break;
+
+		row_pointer = surface_data + (row * stride);
+		jpeg_read_scanlines (&srcinfo, &row_pointer, 1);
+	}
+	cairo_surface_mark_dirty (surface);
+
+	/* the covered area, in original image coordinates */
+
+	raw_region.x = floor ((double) x_offset * srcinfo.image_width / srcinfo.output_width);
+	raw_region.y = floor ((double) y1 * srcinfo.image_height / srcinfo.output_height);
+	raw_region.width = MIN (ceil ((double) (x_offset + crop_width) * srcinfo.image_width / srcinfo.output_width), srcinfo.image_width) - raw_region.x;
+	raw_region.height = MIN (ceil ((double) y2 * srcinfo.image_height / srcinfo.output_height), srcinfo.image_height) - raw_region.y;
+
+	jpeg_abort_decompress (&srcinfo);
+	jpeg_destroy_decompress (&srcinfo);
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		cairo_surface_destroy (surface);
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "");
+		return NULL;
+	}
+
+	_cairo_rectangle_transform (&raw_region,
+				    _gth_transform_get_inverse (self->orientation),
+				    oriented_width,
+				    oriented_height,
+				    loaded_region);
+
+	if (self->orientation != GTH_TRANSFORM_NONE) {
+		cairo_surface_t *rotated_surface;
+
+		rotated_surface = _cairo_image_surface_transform (surface, self->orientation);
+		cairo_surface_destroy (surface);
+		surface = rotated_surface;
+	}
+
+	return surface;
+}
+
+
+static void
+gth_image_jpeg_class_init (GthImageJpegClass *klass)
+{
+	GObjectClass  *object_class;
+	GthImageClass *image_class;
+
+	object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gth_image_jpeg_finalize;
+
+	image_class = GTH_IMAGE_CLASS (klass);
+	image_class->get_can_load_region = gth_image_jpeg_get_can_load_region;
+	image_class->load_region = gth_image_jpeg_load_region;
+}
+
+
+/* Takes ownership of @buffer. */
+static GthImage *
+gth_image_jpeg_new (GthImage     *image,
+		    void         *buffer,
+		    gsize         buffer_size,
+		    int           width,
+		    int           height,
+		    GthTransform  orientation)
+{
+	GthImageJpeg    *self;
+	cairo_surface_t *surface;
+
+	self = g_object_new (gth_image_jpeg_get_type (), NULL);
+	self->buffer = buffer;
+	self->buffer_size = buffer_size;
+	self->width = width;
+	self->height = height;
+	self->orientation = orientation;
+
+	surface = gth_image_get_cairo_surface (image);
+	gth_image_set_cairo_surface (GTH_IMAGE (self), surface);
+	gth_image_set_icc_profile (GTH_IMAGE (self), gth_image_get_icc_profile (image));
+	cairo_surface_destroy (surface);
+
+	return (GthImage *) self;
+}
+
+
+static gboolean
+_jpeg_can_load_region (struct jpeg_decompress_struct *srcinfo,
+		       gboolean                       load_scaled)
+{
+	if (! load_scaled)
+		return FALSE;
+
+	if ((gsize) srcinfo->image_width * srcinfo->image_height < REGION_LOAD_MIN_PIXELS)
+		return FALSE;
+
+	switch (srcinfo->jpeg_color_space) {
+	case JCS_GRAYSCALE:
+	case JCS_RGB:
+	case JCS_YCbCr:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+
+#endif /* HAVE_JPEG_CROP_SCANLINE */
+
+
 GthImage *
 _cairo_image_surface_create_from_jpeg (GInputStream  *istream,
 				       GthFileData   *file_data,
@@ -184,6 +547,11 @@ _cairo_image_surface_create_from_jpeg (GInputStream  *istream,
 	int                            x;
 	volatile gboolean              read_all_scanlines = FALSE;
 	volatile gboolean              finished = FALSE;
+#if HAVE_JPEG_CROP_SCANLINE
+	volatile gboolean              can_load_region = FALSE;
+	volatile int                   raw_width = 0;
+	volatile int                   raw_height = 0;
+#endif
 
 	image = gth_image_new ();
 	surface = NULL;
@@ -598,6 +966,12 @@ _cairo_image_surface_create_from_jpeg (GInputStream  *istream,
 				if (loaded_original_p != NULL)
 					*loaded_original_p = ! load_scaled;
 
+#if HAVE_JPEG_CROP_SCANLINE
+				can_load_region = _jpeg_can_load_region (&srcinfo, load_scaled);
+				raw_width = srcinfo.image_width;
+				raw_height = srcinfo.image_height;
+#endif
+
 				/*_cairo_image_surface_set_attribute_int (surface, "Image::Rotation", rotation); FIXME*/
 				/* FIXME _cairo_image_surface_set_attribute (surface, "Jpeg::ColorSpace", jpeg_color_space_name (srcinfo.jpeg_color_space)); */
 
@@ -617,6 +991,22 @@ _cairo_image_surface_create_from_jpeg (GInputStream  *istream,
 		jpeg_destroy_decompress (&srcinfo);
 	}
 
+#if HAVE_JPEG_CROP_SCANLINE
+	if (can_load_region && ! gth_image_get_is_null (image)) {
+		GthImage *jpeg_image;
+
+		jpeg_image = gth_image_jpeg_new (image,
+						 in_buffer,
+						 in_buffer_size,
+						 raw_width,
+						 raw_height,
+						 orientation);
+		g_object_unref (image);
+
+		return jpeg_image;
+	}
+#endif
+
 	g_free (in_buffer);
 
 	return image;
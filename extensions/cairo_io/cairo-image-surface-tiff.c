@@ -20,6 +20,7 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <tiff.h>
 #include <tiffio.h>
 #include "cairo-image-surface-tiff.h"
@@ -97,6 +98,618 @@ tiff_error_handler (const char *module, const char *fmt, va_list ap)
 }
 
 
+/* -- levels -- */
+
+
+/* A version of the image at a given resolution, saved in a directory or in
+ * a SubIFD of the file. */
+typedef struct {
+	tdir_t  directory;
+	toff_t  subifd;
+	uint32  width;
+	uint32  height;
+} Level;
+
+
+static gboolean
+read_level (TIFF   *tif,
+	    tdir_t  directory,
+	    toff_t  subifd,
+	    Level  *level)
+{
+	char emsg[1024];
+
+	if (TIFFGetField (tif, TIFFTAG_IMAGEWIDTH, &level->width) != 1)
+		return FALSE;
+	if (TIFFGetField (tif, TIFFTAG_IMAGELENGTH, &level->height) != 1)
+		return FALSE;
+	if ((level->width == 0) || (level->height == 0))
+		return FALSE;
+	if (! TIFFRGBAImageOK (tif, emsg))
+		return FALSE;
+
+	level->directory = directory;
+	level->subifd = subifd;
+
+	return TRUE;
+}
+
+
+static gboolean
+level_is_reduction_of (Level *level,
+		       Level *image)
+{
+	gint64 diff;
+
+	if ((level->width >= image->width) || (level->height >= image->height))
+		return FALSE;
+
+	/* same proportions, with a rounding error of a pixel for each side,
+	 * to exclude the label and the macro images of the slide scanners */
+
+	diff = (gint64) level->width * image->height - (gint64) level->height * image->width;
+
+	return ABS (diff) <= (gint64) image->width + image->height;
+}
+
+
+/* Returns the levels of the first image of the file: the image itself,
+ * followed by the reduced-resolution versions saved in the next
+ * directories or in its SubIFDs.  The other pages are ignored. */
+static GArray *
+get_image_levels (TIFF *tif)
+{
+	GArray *levels;
+	Level   image;
+	toff_t *subifds = NULL;
+	uint16  n_subifds = 0;
+	int     i;
+
+	levels = g_array_new (FALSE, FALSE, sizeof (Level));
+	do {
+		Level  level;
+		uint32 subfiletype;
+
+		if (TIFFGetField (tif, TIFFTAG_SUBFILETYPE, &subfiletype) != 1)
+			subfiletype = 0;
+
+		if (levels->len == 0) {
+			uint16  n_offsets;
+			toff_t *offsets;
+
+			if (subfiletype & FILETYPE_REDUCEDIMAGE)
+				continue;
+			if (! read_level (tif, TIFFCurrentDirectory (tif), 0, &image))
+				continue;
+			g_array_append_val (levels, image);
+
+			if ((TIFFGetField (tif, TIFFTAG_SUBIFD, &n_offsets, &offsets) == 1) && (n_offsets > 0)) {
+				n_subifds = n_offsets;
+				subifds = g_new (toff_t, n_subifds);
+				memcpy (subifds, offsets, sizeof (toff_t) * n_subifds);
+			}
+		}
+		else {
+			if (! (subfiletype & FILETYPE_REDUCEDIMAGE))
+				break;
+			if (read_level (tif, TIFFCurrentDirectory (tif), 0, &level) && level_is_reduction_of (&level, &image))
+				g_array_append_val (levels, level);
+		}
+	}
+	while (TIFFReadDirectory (tif));
+
+	for (i = 0; i < n_subifds; i++) {
+		Level level;
+
+		if (TIFFSetSubDirectory (tif, subifds[i])
+		    && read_level (tif, image.directory, subifds[i], &level)
+		    && level_is_reduction_of (&level, &image))
+		{
+			g_array_append_val (levels, level);
+		}
+	}
+
+	g_free (subifds);
+
+	return levels;
+}
+
+
+/* The smallest level not smaller than the requested size, the image itself
+ * when the original size is requested. */
+static Level *
+choose_level (GArray *levels,
+	      int     requested_size)
+{
+	Level *best;
+	int    i;
+
+	best = &g_array_index (levels, Level, 0);
+	if (requested_size <= 0)
+		return best;
+
+	for (i = 1; i < levels->len; i++) {
+		Level *level = &g_array_index (levels, Level, i);
+
+		if ((MAX (level->width, level->height) >= requested_size) && (level->width < best->width))
+			best = level;
+	}
+
+	return best;
+}
+
+
+/* -- decoder -- */
+
+
+#define ROWS_PER_BAND 64
+#define MAX_STRIP_SIZE (16 * 1024 * 1024)
+#define MIN_PIXELS_FOR_THREADS (1024 * 1024)
+
+
+/* A file opened for reading, each thread uses its own decoder because a
+ * TIFF handle cannot be shared. */
+typedef struct {
+	Handle         handle;
+	TIFF          *tif;
+	TIFFRGBAImage  rgba;
+	gboolean       rgba_ok;
+	guchar        *buffer;
+} Decoder;
+
+
+typedef struct {
+	GFile         *file;
+	goffset        file_size;
+	GCancellable  *cancellable;
+	Level         *level;
+	uint32         width;
+	uint32         height;
+	uint16         orientation;
+	gboolean       tiled;
+	uint32         block_width;
+	uint32         block_height;
+	int            band_size;
+	gboolean       jpeg_rgb;
+	gboolean       direct;
+	gboolean       scanlines;
+	uint16         photometric;
+	uint16         samples_per_pixel;
+	gboolean       has_alpha;
+	gboolean       premultiplied;
+	tmsize_t       row_size;
+	guchar        *surface_data;
+	int            surface_stride;
+	GAsyncQueue   *decoders;
+	int            n_decoders;
+	int            max_decoders;
+} DecodeData;
+
+
+static Decoder *
+decoder_new (GInputStream *istream,
+	     goffset       size,
+	     GCancellable *cancellable)
+{
+	Decoder *decoder;
+
+	decoder = g_new0 (Decoder, 1);
+	decoder->handle.istream = istream;
+	decoder->handle.cancellable = cancellable;
+	decoder->handle.size = size;
+	decoder->tif = TIFFClientOpen ("gth-tiff-reader", "r",
+				       &decoder->handle,
+				       tiff_read,
+				       tiff_write,
+				       tiff_seek,
+				       tiff_close,
+				       tiff_size,
+				       NULL,
+				       NULL);
+
+	if (decoder->tif == NULL) {
+		g_object_unref (decoder->handle.istream);
+		g_free (decoder);
+		return NULL;
+	}
+
+	return decoder;
+}
+
+
+static void
+decoder_free (Decoder *decoder)
+{
+	if (decoder->rgba_ok)
+		TIFFRGBAImageEnd (&decoder->rgba);
+	g_free (decoder->buffer);
+	TIFFClose (decoder->tif);
+	g_object_unref (decoder->handle.istream);
+	g_free (decoder);
+}
+
+
+static gboolean
+decoder_set_level (Decoder    *decoder,
+		   DecodeData *data)
+{
+	TIFF *tif = decoder->tif;
+
+	if (! TIFFSetDirectory (tif, data->level->directory))
+		return FALSE;
+	if ((data->level->subifd != 0) && ! TIFFSetSubDirectory (tif, data->level->subifd))
+		return FALSE;
+
+	if (data->jpeg_rgb)
+		TIFFSetField (tif, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+
+	if (data->direct) {
+		tmsize_t size;
+
+		if (data->scanlines)
+			size = TIFFScanlineSize (tif);
+		else if (data->tiled)
+			size = TIFFTileSize (tif);
+		else
+			size = TIFFStripSize (tif);
+		if (size <= 0)
+			return FALSE;
+		decoder->buffer = g_try_malloc (size);
+	}
+	else {
+		char emsg[1024];
+
+		if (! TIFFRGBAImageBegin (&decoder->rgba, tif, 0, emsg))
+			return FALSE;
+		decoder->rgba_ok = TRUE;
+
+		/* read the pixels in the order they are saved, the orientation
+		 * is applied when copying them to the surface */
+		decoder->rgba.req_orientation = decoder->rgba.orientation;
+
+		decoder->buffer = g_try_malloc ((gsize) data->width * data->band_size * sizeof (uint32));
+	}
+
+	return decoder->buffer != NULL;
+}
+
+
+/* Returns a free decoder, a new one is opened if all of them are in use and
+ * the maximum number is not reached. */
+static Decoder *
+decode_data_get_decoder (DecodeData *data)
+{
+	Decoder *decoder;
+
+	decoder = g_async_queue_try_pop (data->decoders);
+	if (decoder != NULL)
+		return decoder;
+
+	if (g_atomic_int_add (&data->n_decoders, 1) < data->max_decoders) {
+		GInputStream *istream;
+
+		istream = (GInputStream *) g_file_read (data->file, data->cancellable, NULL);
+		if (istream != NULL) {
+			decoder = decoder_new (g_buffered_input_stream_new (istream), data->file_size, data->cancellable);
+			g_object_unref (istream);
+		}
+
+		if ((decoder != NULL) && ! decoder_set_level (decoder, data)) {
+			decoder_free (decoder);
+			decoder = NULL;
+		}
+
+		if (decoder != NULL)
+			return decoder;
+	}
+
+	return g_async_queue_pop (data->decoders);
+}
+
+
+/* Returns the position in the surface of the pixel saved at (x, y), and in
+ * @step the distance to the position of the pixel saved at (x + 1, y). */
+static guchar *
+get_surface_pixel (DecodeData *data,
+		   uint32      x,
+		   uint32      y,
+		   gssize     *step)
+{
+	gssize stride = data->surface_stride;
+	uint32 dest_x;
+	uint32 dest_y;
+
+	switch (data->orientation) {
+	case ORIENTATION_TOPRIGHT:
+		dest_x = data->width - 1 - x;
+		dest_y = y;
+		*step = -4;
+		break;
+	case ORIENTATION_BOTRIGHT:
+		dest_x = data->width - 1 - x;
+		dest_y = data->height - 1 - y;
+		*step = -4;
+		break;
+	case ORIENTATION_BOTLEFT:
+		dest_x = x;
+		dest_y = data->height - 1 - y;
+		*step = 4;
+		break;
+	case ORIENTATION_LEFTTOP:
+		dest_x = y;
+		dest_y = x;
+		*step = stride;
+		break;
+	case ORIENTATION_RIGHTTOP:
+		dest_x = data->height - 1 - y;
+		dest_y = x;
+		*step = stride;
+		break;
+	case ORIENTATION_RIGHTBOT:
+		dest_x = data->height - 1 - y;
+		dest_y = data->width - 1 - x;
+		*step = -stride;
+		break;
+	case ORIENTATION_LEFTBOT:
+		dest_x = y;
+		dest_y = data->width - 1 - x;
+		*step = -stride;
+		break;
+	default:
+		dest_x = x;
+		dest_y = y;
+		*step = 4;
+		break;
+	}
+
+	return data->surface_data + ((gsize) dest_y * stride) + ((gsize) dest_x * 4);
+}
+
+
+static void
+copy_samples (DecodeData *data,
+	      guchar     *src,
+	      uint32      x,
+	      uint32      y,
+	      uint32      n_pixels)
+{
+	guchar *dest;
+	gssize  step;
+	guchar  r, g, b, a;
+	uint32  i;
+
+	dest = get_surface_pixel (data, x, y, &step);
+	for (i = 0; i < n_pixels; i++) {
+		if (data->photometric == PHOTOMETRIC_RGB) {
+			r = src[0];
+			g = src[1];
+			b = src[2];
+			a = data->has_alpha ? src[3] : 0xff;
+		}
+		else {
+			r = g = b = (data->photometric == PHOTOMETRIC_MINISWHITE) ? 0xff - src[0] : src[0];
+			a = data->has_alpha ? src[1] : 0xff;
+		}
+
+		if (data->premultiplied) {
+			dest[CAIRO_RED] = MIN (r, a);
+			dest[CAIRO_GREEN] = MIN (g, a);
+			dest[CAIRO_BLUE] = MIN (b, a);
+			dest[CAIRO_ALPHA] = a;
+		}
+		else
+			CAIRO_SET_RGBA (dest, r, g, b, a);
+
+		src += data->samples_per_pixel;
+		dest += step;
+	}
+}
+
+
+static void
+decode_strips (DecodeData *data,
+	       Decoder    *decoder,
+	       uint32      first,
+	       uint32      last)
+{
+	uint32 row;
+	uint32 y;
+
+	for (row = first; row < last; row += data->block_height) {
+		uint32 n_rows = MIN (data->block_height, data->height - row);
+
+		if (TIFFReadEncodedStrip (decoder->tif, TIFFComputeStrip (decoder->tif, row, 0), decoder->buffer, -1) < 0)
+			continue;
+
+		for (y = 0; y < n_rows; y++)
+			copy_samples (data, decoder->buffer + (y * data->row_size), 0, row + y, data->width);
+	}
+}
+
+
+static void
+decode_scanlines (DecodeData *data,
+		  Decoder    *decoder,
+		  uint32      first,
+		  uint32      last)
+{
+	uint32 row;
+
+	for (row = first; row < last; row++) {
+		if (TIFFReadScanline (decoder->tif, decoder->buffer, row, 0) < 0)
+			break;
+		copy_samples (data, decoder->buffer, 0, row, data->width);
+	}
+}
+
+
+static void
+decode_tiles (DecodeData *data,
+	      Decoder    *decoder,
+	      uint32      first,
+	      uint32      last)
+{
+	uint32 row;
+	uint32 col;
+	uint32 y;
+
+	for (row = first; row < last; row += data->block_height) {
+		uint32 n_rows = MIN (data->block_height, data->height - row);
+
+		for (col = 0; col < data->width; col += data->block_width) {
+			uint32 n_cols = MIN (data->block_width, data->width - col);
+
+			if (TIFFReadEncodedTile (decoder->tif, TIFFComputeTile (decoder->tif, col, row, 0, 0), decoder->buffer, -1) < 0)
+				continue;
+
+			for (y = 0; y < n_rows; y++)
+				copy_samples (data, decoder->buffer + (y * data->row_size), col, row + y, n_cols);
+		}
+	}
+}
+
+
+/* Formats without a direct conversion are read with the RGBA interface of
+ * libtiff, a band at a time.  The samples are premultiplied already. */
+static void
+decode_rgba (DecodeData *data,
+	     Decoder    *decoder,
+	     uint32      first,
+	     uint32      last)
+{
+	uint32 *src;
+	uint32  x, y;
+
+	decoder->rgba.row_offset = first;
+	decoder->rgba.col_offset = 0;
+	if (! TIFFRGBAImageGet (&decoder->rgba, (uint32 *) decoder->buffer, data->width, last - first))
+		return;
+
+	src = (uint32 *) decoder->buffer;
+	for (y = first; y < last; y++) {
+		guchar *dest;
+		gssize  step;
+
+		dest = get_surface_pixel (data, 0, y, &step);
+		for (x = 0; x < data->width; x++) {
+			dest[CAIRO_RED] = TIFFGetR (*src);
+			dest[CAIRO_GREEN] = TIFFGetG (*src);
+			dest[CAIRO_BLUE] = TIFFGetB (*src);
+			dest[CAIRO_ALPHA] = TIFFGetA (*src);
+
+			src += 1;
+			dest += step;
+		}
+	}
+}
+
+
+static void
+decode_rows_cb (int      first,
+		int      last,
+		gpointer user_data)
+{
+	DecodeData *data = user_data;
+	Decoder    *decoder;
+
+	if (g_cancellable_is_cancelled (data->cancellable))
+		return;
+
+	decoder = decode_data_get_decoder (data);
+	if (! data->direct)
+		decode_rgba (data, decoder, first, last);
+	else if (data->scanlines)
+		decode_scanlines (data, decoder, first, last);
+	else if (data->tiled)
+		decode_tiles (data, decoder, first, last);
+	else
+		decode_strips (data, decoder, first, last);
+	g_async_queue_push (data->decoders, decoder);
+}
+
+
+static void
+decode_data_init (DecodeData *data,
+		  TIFF       *tif)
+{
+	uint16  compression;
+	uint16  bits_per_sample;
+	uint16  sample_format;
+	uint16  planar_config;
+	uint16  extra_samples;
+	uint16 *sample_info;
+	uint32  rows_per_strip;
+	int     n_colors;
+
+	data->width = data->level->width;
+	data->height = data->level->height;
+	if (TIFFGetFieldDefaulted (tif, TIFFTAG_ORIENTATION, &data->orientation) != 1)
+		data->orientation = ORIENTATION_TOPLEFT;
+
+	TIFFGetFieldDefaulted (tif, TIFFTAG_COMPRESSION, &compression);
+	TIFFGetFieldDefaulted (tif, TIFFTAG_PHOTOMETRIC, &data->photometric);
+	TIFFGetFieldDefaulted (tif, TIFFTAG_SAMPLESPERPIXEL, &data->samples_per_pixel);
+	TIFFGetFieldDefaulted (tif, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+	TIFFGetFieldDefaulted (tif, TIFFTAG_SAMPLEFORMAT, &sample_format);
+	TIFFGetFieldDefaulted (tif, TIFFTAG_PLANARCONFIG, &planar_config);
+	TIFFGetFieldDefaulted (tif, TIFFTAG_EXTRASAMPLES, &extra_samples, &sample_info);
+
+	/* let libjpeg convert the colors of the JPEG compressed images */
+
+	data->jpeg_rgb = (compression == COMPRESSION_JPEG) && (data->photometric == PHOTOMETRIC_YCBCR);
+	if (data->jpeg_rgb)
+		data->photometric = PHOTOMETRIC_RGB;
+
+	n_colors = (data->photometric == PHOTOMETRIC_RGB) ? 3 : 1;
+	data->has_alpha = (extra_samples > 0)
+			  && (data->samples_per_pixel > n_colors)
+			  && ((sample_info[0] != EXTRASAMPLE_UNSPECIFIED) || (n_colors == 3));
+	data->premultiplied = data->has_alpha && (sample_info[0] != EXTRASAMPLE_UNASSALPHA);
+	data->direct = (bits_per_sample == 8)
+		       && (sample_format == SAMPLEFORMAT_UINT)
+		       && ((planar_config == PLANARCONFIG_CONTIG) || (data->samples_per_pixel == 1))
+		       && (data->samples_per_pixel >= n_colors)
+		       && ((data->photometric == PHOTOMETRIC_RGB)
+			   || (data->photometric == PHOTOMETRIC_MINISBLACK)
+			   || (data->photometric == PHOTOMETRIC_MINISWHITE));
+
+	data->tiled = TIFFIsTiled (tif);
+	if (data->tiled) {
+		TIFFGetField (tif, TIFFTAG_TILEWIDTH, &data->block_width);
+		TIFFGetField (tif, TIFFTAG_TILELENGTH, &data->block_height);
+	}
+	else {
+		TIFFGetFieldDefaulted (tif, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+		data->block_width = data->width;
+		data->block_height = rows_per_strip;
+	}
+	data->block_width = CLAMP (data->block_width, 1, data->width);
+	data->block_height = CLAMP (data->block_height, 1, data->height);
+
+	/* a strip too big to be kept in memory is read a row at a time */
+
+	data->scanlines = data->direct && ! data->tiled && (TIFFStripSize (tif) > MAX_STRIP_SIZE);
+	if (data->scanlines)
+		data->band_size = ROWS_PER_BAND;
+	else
+		data->band_size = data->block_height * MAX (1, ROWS_PER_BAND / data->block_height);
+
+	/* the blocks are compressed independently of each other, so the
+	 * bands can be decoded in parallel, opening the file once for each
+	 * thread. */
+
+	data->max_decoders = 1;
+	if ((data->file != NULL)
+	    && ! data->scanlines
+	    && (compression != COMPRESSION_OJPEG)
+	    && (data->height > data->band_size)
+	    && ((gint64) data->width * data->height >= MIN_PIXELS_FOR_THREADS))
+	{
+		data->max_decoders = _g_get_n_worker_threads ();
+	}
+}
+
+
 GthImage *
 _cairo_image_surface_create_from_tiff (GInputStream  *istream,
 				       GthFileData   *file_data,
@@ -109,58 +722,46 @@ _cairo_image_surface_create_from_tiff (GInputStream  *istream,
 				       GError       **error)
 {
 	GthImage		*image;
-	Handle			 handle;
-	TIFF			*tif;
-	gboolean		 first_directory;
-	int			 best_directory;
-	int        		 max_width, max_height, min_diff;
-	uint32			 image_width;
-	uint32			 image_height;
-	uint32			 spp;
-	uint16			 extrasamples;
-	uint16			*sampleinfo;
-	uint16			 orientation;
-	char			 emsg[1024];
+	GInputStream		*stream;
+	goffset			 size;
+	Decoder			*decoder;
+	GArray			*levels;
+	Level			*image_level;
+	DecodeData		 data;
+	gboolean		 transposed;
+	int			 original_width;
+	int			 original_height;
 	cairo_surface_t		*surface;
 	cairo_surface_metadata_t*metadata;
-	uint32			*raster;
+	uint32			 first;
 
 	image = gth_image_new ();
-	handle.cancellable = cancellable;
-	handle.size = 0;
+	memset (&data, 0, sizeof (data));
+	data.cancellable = cancellable;
 
 	if ((file_data != NULL) && (file_data->info != NULL)) {
-		handle.istream = g_buffered_input_stream_new (istream);
-		handle.size = g_file_info_get_size (file_data->info);
+		stream = g_buffered_input_stream_new (istream);
+		size = g_file_info_get_size (file_data->info);
+		data.file = file_data->file;
+		data.file_size = size;
 	}
 	else {
-		void  *data;
-		gsize  size;
+		void  *buffer;
+		gsize  buffer_size;
 
 		/* read the whole stream to get the file size */
 
-		if (! _g_input_stream_read_all (istream, &data, &size, cancellable, error))
+		if (! _g_input_stream_read_all (istream, &buffer, &buffer_size, cancellable, error))
 			return image;
-		handle.istream = g_memory_input_stream_new_from_data (data, size, g_free);
-		handle.size = size;
+		stream = g_memory_input_stream_new_from_data (buffer, buffer_size, g_free);
+		size = buffer_size;
 	}
 
-
 	TIFFSetErrorHandler (tiff_error_handler);
 	TIFFSetWarningHandler (tiff_error_handler);
 
-	tif = TIFFClientOpen ("gth-tiff-reader", "r",
-			      &handle,
-	                      tiff_read,
-	                      tiff_write,
-	                      tiff_seek,
-	                      tiff_close,
-	                      tiff_size,
-	                      NULL,
-	                      NULL);
-
-	if (tif == NULL) {
-		g_object_unref (handle.istream);
+	decoder = decoder_new (stream, size, cancellable);
+	if (decoder == NULL) {
 		g_set_error_literal (error,
 				     GDK_PIXBUF_ERROR,
 				     GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
@@ -170,50 +771,25 @@ _cairo_image_surface_create_from_tiff (GInputStream  *istream,
 
 	/* find the best image to load */
 
-	first_directory = TRUE;
-	best_directory = -1;
-	max_width = -1;
-	max_height = -1;
-	min_diff = 0;
-	do {
-		int width;
-		int height;
-
-		if (TIFFGetField (tif, TIFFTAG_IMAGEWIDTH, &width) != 1)
-			continue;
-		if (TIFFGetField (tif, TIFFTAG_IMAGELENGTH, &height) != 1)
-			continue;
-
-		if (! TIFFRGBAImageOK (tif, emsg))
-			continue;
-
-		if (width > max_width) {
-			max_width = width;
-			max_height = height;
-			if (requested_size <= 0)
-				best_directory = TIFFCurrentDirectory (tif);
-		}
-
-		if (requested_size > 0) {
-			int diff = abs (requested_size - width);
-
-			if (first_directory) {
-				min_diff = diff;
-				best_directory = TIFFCurrentDirectory (tif);
-			}
-			else if (diff < min_diff) {
-				min_diff = diff;
-				best_directory = TIFFCurrentDirectory (tif);
-			}
-		}
-
-		first_directory = FALSE;
+	levels = get_image_levels (decoder->tif);
+	if (levels->len == 0) {
+		g_array_free (levels, TRUE);
+		decoder_free (decoder);
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_INVALID_DATA,
+				     "Invalid TIFF format");
+		return image;
 	}
-	while (TIFFReadDirectory (tif));
 
-	if (best_directory == -1) {
-		TIFFClose (tif);
-		g_object_unref (handle.istream);
+	image_level = &g_array_index (levels, Level, 0);
+	data.level = choose_level (levels, requested_size);
+
+	if (! TIFFSetDirectory (decoder->tif, data.level->directory)
+	    || ((data.level->subifd != 0) && ! TIFFSetSubDirectory (decoder->tif, data.level->subifd)))
+	{
+		g_array_free (levels, TRUE);
+		decoder_free (decoder);
 		g_set_error_literal (error,
 				     G_IO_ERROR,
 				     G_IO_ERROR_INVALID_DATA,
@@ -221,27 +797,27 @@ _cairo_image_surface_create_from_tiff (GInputStream  *istream,
 		return image;
 	}
 
-	/* read the image */
+	decode_data_init (&data, decoder->tif);
 
-	TIFFSetDirectory (tif, best_directory);
-	TIFFGetField (tif, TIFFTAG_IMAGEWIDTH, &image_width);
-	TIFFGetField (tif, TIFFTAG_IMAGELENGTH, &image_height);
-	TIFFGetField (tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
-	TIFFGetFieldDefaulted (tif, TIFFTAG_EXTRASAMPLES, &extrasamples, &sampleinfo);
-	if (TIFFGetFieldDefaulted (tif, TIFFTAG_ORIENTATION, &orientation) != 1)
-		orientation = ORIENTATION_TOPLEFT;
+	transposed = (data.orientation >= ORIENTATION_LEFTTOP) && (data.orientation <= ORIENTATION_LEFTBOT);
+	original_width = transposed ? image_level->height : image_level->width;
+	original_height = transposed ? image_level->width : image_level->height;
 
 	if (original_width_p)
-		*original_width_p = max_width;
+		*original_width_p = original_width;
 	if (original_height_p)
-		*original_height_p = max_height;
+		*original_height_p = original_height;
 	if (loaded_original_p)
-		*loaded_original_p = (max_width == image_width);
-
-	surface = _cairo_image_surface_create (CAIRO_FORMAT_ARGB32, image_width, image_height);
-	if (surface == NULL) {
-		TIFFClose (tif);
-		g_object_unref (handle.istream);
+		*loaded_original_p = (data.level == image_level);
+
+	surface = _cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+					       transposed ? data.height : data.width,
+					       transposed ? data.width : data.height);
+	if ((surface == NULL) || ! decoder_set_level (decoder, &data)) {
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+		g_array_free (levels, TRUE);
+		decoder_free (decoder);
 		g_set_error_literal (error,
 				     GDK_PIXBUF_ERROR,
 				     GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
@@ -250,62 +826,35 @@ _cairo_image_surface_create_from_tiff (GInputStream  *istream,
 	}
 
 	metadata = _cairo_image_surface_get_metadata (surface);
-	_cairo_metadata_set_has_alpha (metadata, (extrasamples == 1) || (spp == 4));
-	_cairo_metadata_set_original_size (metadata, max_width, max_height);
-
-	raster = (uint32*) _TIFFmalloc (image_width * image_height * sizeof (uint32));
-	if (raster == NULL) {
-		cairo_surface_destroy (surface);
-		TIFFClose (tif);
-		g_object_unref (handle.istream);
-		g_set_error_literal (error,
-				     GDK_PIXBUF_ERROR,
-				     GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
-				     "Couldn't allocate memory for writing TIFF file");
-		return image;
-	}
+	_cairo_metadata_set_has_alpha (metadata, data.has_alpha || (data.samples_per_pixel == 4));
+	_cairo_metadata_set_original_size (metadata, original_width, original_height);
 
-	if (TIFFReadRGBAImageOriented (tif, image_width, image_height, raster, orientation, 0)) {
-		guchar *surface_row;
-		int     line_step;
-		int     x, y, temp;
-		guchar  r, g, b, a;
-		uint32 *src_pixel;
-
-		surface_row = _cairo_image_surface_flush_and_get_data (surface);
-		line_step = cairo_image_surface_get_stride (surface);
-		src_pixel = raster;
-		for (y = 0; y < image_height; y++) {
-			guchar *dest_pixel = surface_row;
-
-			if (g_cancellable_is_cancelled (cancellable))
-				goto stop_loading;
-
-			for (x = 0; x < image_width; x++) {
-				r = TIFFGetR (*src_pixel);
-				g = TIFFGetG (*src_pixel);
-				b = TIFFGetB (*src_pixel);
-				a = TIFFGetA (*src_pixel);
-				CAIRO_SET_RGBA (dest_pixel, r, g, b, a);
-
-				dest_pixel += 4;
-				src_pixel += 1;
-			}
+	/* read the image */
 
-			surface_row += line_step;
-		}
-	}
+	data.row_size = data.tiled ? TIFFTileRowSize (decoder->tif) : TIFFScanlineSize (decoder->tif);
+	data.surface_data = _cairo_image_surface_flush_and_get_data (surface);
+	data.surface_stride = cairo_image_surface_get_stride (surface);
+	data.decoders = g_async_queue_new ();
+	data.n_decoders = 1;
+	g_async_queue_push (data.decoders, decoder);
 
-stop_loading:
+	if (data.max_decoders > 1) {
+		_g_parallel_for_bands (data.height, data.band_size, decode_rows_cb, &data);
+	}
+	else {
+		for (first = 0; first < data.height; first += data.band_size)
+			decode_rows_cb (first, MIN (first + data.band_size, data.height), &data);
+	}
 
 	cairo_surface_mark_dirty (surface);
 	if (! g_cancellable_is_cancelled (cancellable))
 		gth_image_set_cairo_surface (image, surface);
 
-	_TIFFfree (raster);
+	while ((decoder = g_async_queue_try_pop (data.decoders)) != NULL)
+		decoder_free (decoder);
+	g_async_queue_unref (data.decoders);
 	cairo_surface_destroy (surface);
-	TIFFClose (tif);
-	g_object_unref (handle.istream);
+	g_array_free (levels, TRUE);
 
 	return image;
 }
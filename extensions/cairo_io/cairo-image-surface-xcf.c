@@ -20,6 +20,7 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <glib.h>
 #include <gio/gio.h>
 #include <pix.h>
@@ -29,6 +30,7 @@
 #define TILE_WIDTH	64
 #define MAX_TILE_SIZE	(TILE_WIDTH * TILE_WIDTH * 4 * 1.5)
 #define DISSOLVE_SEED	737893334
+#define SCALED_SIZE(size, scale) (((size) + (scale) - 1) / (scale))
 
 
 typedef enum {
@@ -269,202 +271,120 @@ gimp_layer_free (GimpLayer *layer)
 /* -- _cairo_image_surface_create_from_xcf -- */
 
 
-static void
-_cairo_image_surface_paint_layer (cairo_surface_t *image,
-				  GimpLayer       *layer)
-{
-	int     image_width;
-	int     image_height;
-	int     image_row_stride;
-	guchar *image_row;
-	int     layer_width;
-	int     layer_height;
-	int     layer_row_stride;
-	guchar *layer_row;
-	guchar *mask_row;
-	int     x, y, width, height;
-	guchar *image_pixel;
-	guchar *layer_pixel;
-	guchar *mask_pixel;
-	GRand  *rand_gen;
-	int     i, j;
-	guchar  r, g, b, a;
-	int     temp, temp2;
-	guchar  image_hue, image_sat, image_val, image_lum;
-	guchar  layer_hue, layer_sat, layer_val, layer_lum;
-
-	if ((image == NULL) || (layer->pixels == NULL))
-		return;
-
-	image_width = cairo_image_surface_get_width (image);
-	image_height = cairo_image_surface_get_height (image);
-	image_row_stride = cairo_image_surface_get_stride (image);
+#define PAINT_BAND_ROWS 32
 
-	layer_width = layer->width;
-	layer_height = layer->height;
-	layer_row_stride = layer->width * 4;
-
-	/* compute the layer <-> image intersection */
-
-	{
-		cairo_region_t        *region;
-		cairo_rectangle_int_t  rect;
-
-		rect.x = 0;
-		rect.y = 0;
-		rect.width = image_width;
-		rect.height = image_height;
-		region = cairo_region_create_rectangle (&rect);
 
-		rect.x = layer->h_offset;
-		rect.y = layer->v_offset;
-		rect.width = layer_width;
-		rect.height = layer_height;
-		cairo_region_intersect_rectangle (region, &rect);
-		cairo_region_get_extents (region, &rect);
-		cairo_region_destroy (region);
+typedef struct {
+	GimpLayer *layer;
+	guchar    *image_row;
+	int        image_row_stride;
+	guchar    *layer_row;
+	int        layer_row_stride;
+	guchar    *mask_row;
+	int        mask_row_stride;
+	int        width;
+} PaintData;
+
+
+static int
+scale_offset (int offset,
+	      int scale)
+{
+	return (offset >= 0) ? offset / scale : - ((- offset + scale - 1) / scale);
+}
 
-		if ((rect.width == 0) || (rect.height == 0))
-			return;
 
-		x = rect.x;
-		y = rect.y;
-		width = rect.width;
-		height = rect.height;
+#define BLEND_ROW(op)										\
+	for (j = 0; j < width; j++) {								\
+		if (alpha_row[j] != 0) {							\
+			color_pixel[CAIRO_RED] = op (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);		\
+			color_pixel[CAIRO_GREEN] = op (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);	\
+			color_pixel[CAIRO_BLUE] = op (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);	\
+		}										\
+		color_pixel += 4;								\
+		layer_pixel += 4;								\
+		image_pixel += 4;								\
 	}
 
-	image_row = _cairo_image_surface_flush_and_get_data (image) + (y * image_row_stride) + (x * 4);
-
-	x = (layer->h_offset < 0) ? -layer->h_offset : 0;
-	y = (layer->v_offset < 0) ? -layer->v_offset : 0;
-	layer_row = layer->pixels + (y * layer_row_stride) + (x * 4);
-
-	mask_row = layer->alpha_mask + (y * layer_width) + x;
-
-	rand_gen = NULL;
-	if (layer->mode == GIMP_LAYER_MODE_DISSOLVE)
-		rand_gen = g_rand_new_with_seed (DISSOLVE_SEED);
-
-	for (i = 0; i < height; i++) {
-		image_pixel = image_row;
-		layer_pixel = layer_row;
-		mask_pixel = mask_row;
 
+/* Computes the color of the layer pixels blended with the image pixels,
+ * the mode is checked once for the whole row. */
+static void
+blend_row (GimpLayerMode  mode,
+	   guchar        *color_pixel,
+	   guchar        *layer_pixel,
+	   guchar        *image_pixel,
+	   guchar        *alpha_row,
+	   int            width)
+{
+	int    j;
+	int    temp, temp2;
+	guchar image_hue, image_sat, image_val, image_lum;
+	guchar layer_hue, layer_sat, layer_val, layer_lum;
+
+	switch (mode) {
+	case GIMP_LAYER_MODE_LIGHTEN_ONLY:
+		BLEND_ROW (GIMP_OP_LIGHTEN_ONLY);
+		break;
+
+	case GIMP_LAYER_MODE_SCREEN:
+		BLEND_ROW (GIMP_OP_SCREEN);
+		break;
+
+	case GIMP_LAYER_MODE_DODGE:
+		BLEND_ROW (GIMP_OP_DODGE);
+		break;
+
+	case GIMP_LAYER_MODE_ADDITION:
+		BLEND_ROW (GIMP_OP_ADDITION);
+		break;
+
+	case GIMP_LAYER_MODE_DARKEN_ONLY:
+		BLEND_ROW (GIMP_OP_DARKEN_ONLY);
+		break;
+
+	case GIMP_LAYER_MODE_MULTIPLY:
+		BLEND_ROW (GIMP_OP_MULTIPLY);
+		break;
+
+	case GIMP_LAYER_MODE_BURN:
+		BLEND_ROW (GIMP_OP_BURN);
+		break;
+
+	case GIMP_LAYER_MODE_OVERLAY:
+	case GIMP_LAYER_MODE_SOFT_LIGHT:
+		BLEND_ROW (GIMP_OP_SOFT_LIGHT);
+		break;
+
+	case GIMP_LAYER_MODE_HARD_LIGHT:
+		BLEND_ROW (GIMP_OP_HARD_LIGHT);
+		break;
+
+	case GIMP_LAYER_MODE_DIFFERENCE:
+		BLEND_ROW (GIMP_OP_DIFFERENCE);
+		break;
+
+	case GIMP_LAYER_MODE_SUBTRACT:
+		BLEND_ROW (GIMP_OP_SUBTRACT);
+		break;
+
+	case GIMP_LAYER_MODE_GRAIN_EXTRACT:
+		BLEND_ROW (GIMP_OP_GRAIN_EXTRACT);
+		break;
+
+	case GIMP_LAYER_MODE_GRAIN_MERGE:
+		BLEND_ROW (GIMP_OP_GRAIN_MERGE);
+		break;
+
+	case GIMP_LAYER_MODE_DIVIDE:
+		BLEND_ROW (GIMP_OP_DIVIDE);
+		break;
+
+	case GIMP_LAYER_MODE_HUE:
+	case GIMP_LAYER_MODE_SATURATION:
+	case GIMP_LAYER_MODE_VALUE:
 		for (j = 0; j < width; j++) {
-			a = ((layer->bpp == 2) || (layer->bpp == 4)) ? layer_pixel[CAIRO_ALPHA] : 255;
-
-			a = ADD_ALPHA (a, layer->opacity);
-			if (layer->alpha_mask && (layer->alpha_mask != NULL))
-				a = ADD_ALPHA (a, mask_pixel[0]);
-
-			if (a == 0)
-				goto next_pixel;
-
-			switch (layer->mode) {
-			case GIMP_LAYER_MODE_NORMAL:
-			default:
-				r = layer_pixel[CAIRO_RED];
-				g = layer_pixel[CAIRO_GREEN];
-				b = layer_pixel[CAIRO_BLUE];
-				break;
-
-			case GIMP_LAYER_MODE_DISSOLVE:
-				if (g_rand_int_range (rand_gen, 0, 256) > a)
-					goto next_pixel;
-				r = layer_pixel[CAIRO_RED];
-				g = layer_pixel[CAIRO_GREEN];
-				b = layer_pixel[CAIRO_BLUE];
-				a = 255;
-				break;
-
-			case GIMP_LAYER_MODE_LIGHTEN_ONLY:
-				r = GIMP_OP_LIGHTEN_ONLY (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_LIGHTEN_ONLY (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_LIGHTEN_ONLY (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_SCREEN:
-				r = GIMP_OP_SCREEN (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_SCREEN (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_SCREEN (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_DODGE:
-				r = GIMP_OP_DODGE (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_DODGE (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_DODGE (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_ADDITION:
-				r = GIMP_OP_ADDITION (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_ADDITION (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_ADDITION (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_DARKEN_ONLY:
-				r = GIMP_OP_DARKEN_ONLY (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_DARKEN_ONLY (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_DARKEN_ONLY (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_MULTIPLY:
-				r = GIMP_OP_MULTIPLY (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_MULTIPLY (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_MULTIPLY (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_BURN:
-				r = GIMP_OP_BURN (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_BURN (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_BURN (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_OVERLAY:
-			case GIMP_LAYER_MODE_SOFT_LIGHT:
-				r = GIMP_OP_SOFT_LIGHT (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_SOFT_LIGHT (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_SOFT_LIGHT (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_HARD_LIGHT:
-				r = GIMP_OP_HARD_LIGHT (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_HARD_LIGHT (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_HARD_LIGHT (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_DIFFERENCE:
-				r = GIMP_OP_DIFFERENCE (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_DIFFERENCE (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_DIFFERENCE (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_SUBTRACT:
-				r = GIMP_OP_SUBTRACT (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_SUBTRACT (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_SUBTRACT (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_GRAIN_EXTRACT:
-				r = GIMP_OP_GRAIN_EXTRACT (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_GRAIN_EXTRACT (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_GRAIN_EXTRACT (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_GRAIN_MERGE:
-				r = GIMP_OP_GRAIN_MERGE (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_GRAIN_MERGE (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_GRAIN_MERGE (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_DIVIDE:
-				r = GIMP_OP_DIVIDE (layer_pixel[CAIRO_RED], image_pixel[CAIRO_RED]);
-				g = GIMP_OP_DIVIDE (layer_pixel[CAIRO_GREEN], image_pixel[CAIRO_GREEN]);
-				b = GIMP_OP_DIVIDE (layer_pixel[CAIRO_BLUE], image_pixel[CAIRO_BLUE]);
-				break;
-
-			case GIMP_LAYER_MODE_HUE:
-			case GIMP_LAYER_MODE_SATURATION:
-			case GIMP_LAYER_MODE_VALUE:
+			if (alpha_row[j] != 0) {
 				gimp_rgb_to_hsv (image_pixel[CAIRO_RED],
 						 image_pixel[CAIRO_GREEN],
 						 image_pixel[CAIRO_BLUE],
@@ -478,38 +398,29 @@ _cairo_image_surface_paint_layer (cairo_surface_t *image,
 						 &layer_sat,
 						 &layer_val);
 
-				switch (layer->mode) {
-				case GIMP_LAYER_MODE_HUE:
-					gimp_hsv_to_rgb (layer_hue,
-							 image_sat,
-							 image_val,
-							 &r,
-							 &g,
-							 &b);
-					break;
-				case GIMP_LAYER_MODE_SATURATION:
-					gimp_hsv_to_rgb (image_hue,
-							 layer_sat,
-							 image_val,
-							 &r,
-							 &g,
-							 &b);
-					break;
-				case GIMP_LAYER_MODE_VALUE:
-					gimp_hsv_to_rgb (image_hue,
-							 image_sat,
-							 layer_val,
-							 &r,
-							 &g,
-							 &b);
-					break;
-				default:
-					g_assert_not_reached ();
-					break;
-				}
-				break;
+				if (mode == GIMP_LAYER_MODE_HUE)
+					image_hue = layer_hue;
+				else if (mode == GIMP_LAYER_MODE_SATURATION)
+					image_sat = layer_sat;
+				else
+					image_val = layer_val;
+
+				gimp_hsv_to_rgb (image_hue,
+						 image_sat,
+						 image_val,
+						 &color_pixel[CAIRO_RED],
+						 &color_pixel[CAIRO_GREEN],
+						 &color_pixel[CAIRO_BLUE]);
+			}
+			color_pixel += 4;
+			layer_pixel += 4;
+			image_pixel += 4;
+		}
+		break;
 
-			case GIMP_LAYER_MODE_COLOR:
+	case GIMP_LAYER_MODE_COLOR:
+		for (j = 0; j < width; j++) {
+			if (alpha_row[j] != 0) {
 				gimp_rgb_to_hsl (image_pixel[CAIRO_RED],
 						 image_pixel[CAIRO_GREEN],
 						 image_pixel[CAIRO_BLUE],
@@ -525,31 +436,168 @@ _cairo_image_surface_paint_layer (cairo_surface_t *image,
 				gimp_hsl_to_rgb (layer_hue,
 						 layer_sat,
 						 image_lum,
-						 &r,
-						 &g,
-						 &b);
-				break;
+						 &color_pixel[CAIRO_RED],
+						 &color_pixel[CAIRO_GREEN],
+						 &color_pixel[CAIRO_BLUE]);
 			}
+			color_pixel += 4;
+			layer_pixel += 4;
+			image_pixel += 4;
+		}
+		break;
+
+	default:
+		memcpy (color_pixel, layer_pixel, width * 4);
+		break;
+	}
+}
 
-			image_pixel[CAIRO_RED] = GIMP_OP_NORMAL (r, image_pixel[CAIRO_RED], a);
-			image_pixel[CAIRO_GREEN] = GIMP_OP_NORMAL (g, image_pixel[CAIRO_GREEN], a);
-			image_pixel[CAIRO_BLUE] = GIMP_OP_NORMAL (b, image_pixel[CAIRO_BLUE], a);
-			image_pixel[CAIRO_ALPHA] = GIMP_OP_NORMAL (255, image_pixel[CAIRO_ALPHA], a);
 
-next_pixel:
+#undef BLEND_ROW
 
-			image_pixel += 4;
-			layer_pixel += 4;
-			mask_pixel += 1;
+
+static void
+paint_rows_cb (int      first,
+	       int      last,
+	       gpointer user_data)
+{
+	PaintData *data = user_data;
+	GimpLayer *layer = data->layer;
+	gboolean   layer_has_alpha;
+	guchar    *alpha_row;
+	guchar    *color_row;
+	GRand     *rand_gen;
+	int        i, j;
+
+	layer_has_alpha = (layer->bpp == 2) || (layer->bpp == 4);
+	alpha_row = g_new (guchar, data->width);
+	color_row = NULL;
+	if ((layer->mode != GIMP_LAYER_MODE_NORMAL) && (layer->mode != GIMP_LAYER_MODE_DISSOLVE))
+		color_row = g_new0 (guchar, data->width * 4);
+	rand_gen = NULL;
+	if (layer->mode == GIMP_LAYER_MODE_DISSOLVE)
+		rand_gen = g_rand_new ();
+
+	for (i = first; i < last; i++) {
+		guchar *image_pixel = data->image_row + (i * data->image_row_stride);
+		guchar *layer_pixel = data->layer_row + (i * data->layer_row_stride);
+		guchar *mask_pixel = NULL;
+		guchar  a;
+
+		if (layer->alpha_mask != NULL)
+			mask_pixel = data->mask_row + (i * data->mask_row_stride);
+
+		/* the opacity of each pixel of the layer */
+
+		for (j = 0; j < data->width; j++) {
+			a = layer_has_alpha ? layer_pixel[(j * 4) + CAIRO_ALPHA] : 255;
+			a = ADD_ALPHA (a, layer->opacity);
+			if (mask_pixel != NULL)
+				a = ADD_ALPHA (a, mask_pixel[j]);
+			alpha_row[j] = a;
+		}
+
+		if (rand_gen != NULL) {
+			/* a sequence for each row, this way the result doesn't
+			 * depend on how the rows are divided among the threads */
+
+			g_rand_set_seed (rand_gen, DISSOLVE_SEED + i);
+			for (j = 0; j < data->width; j++) {
+				if (alpha_row[j] != 0)
+					alpha_row[j] = (g_rand_int_range (rand_gen, 0, 256) > alpha_row[j]) ? 0 : 255;
+			}
 		}
 
-		image_row += image_row_stride;
-		layer_row += layer_row_stride;
-		mask_row += layer_width;
+		if (color_row != NULL) {
+			blend_row (layer->mode, color_row, layer_pixel, image_pixel, alpha_row, data->width);
+			gimp_op_normal_row (image_pixel, color_row, alpha_row, data->width);
+		}
+		else
+			gimp_op_normal_row (image_pixel, layer_pixel, alpha_row, data->width);
 	}
 
-	if (layer->mode == GIMP_LAYER_MODE_DISSOLVE)
+	if (rand_gen != NULL)
 		g_rand_free (rand_gen);
+	g_free (color_row);
+	g_free (alpha_row);
+}
+
+
+static void
+_cairo_image_surface_paint_layer (cairo_surface_t *image,
+				  GimpLayer       *layer,
+				  int              scale)
+{
+	int        image_width;
+	int        image_height;
+	int        image_row_stride;
+	int        layer_width;
+	int        layer_height;
+	int        h_offset;
+	int        v_offset;
+	int        x, y, width, height;
+	PaintData  data;
+
+	if ((image == NULL) || (layer->pixels == NULL))
+		return;
+
+	image_width = cairo_image_surface_get_width (image);
+	image_height = cairo_image_surface_get_height (image);
+	image_row_stride = cairo_image_surface_get_stride (image);
+
+	/* the layer pixels are reduced by the same factor of the image */
+
+	layer_width = SCALED_SIZE (layer->width, scale);
+	layer_height = SCALED_SIZE (layer->height, scale);
+	h_offset = scale_offset (layer->h_offset, scale);
+	v_offset = scale_offset (layer->v_offset, scale);
+
+	/* compute the layer <-> image intersection */
+
+	{
+		cairo_region_t        *region;
+		cairo_rectangle_int_t  rect;
+
+		rect.x = 0;
+		rect.y = 0;
+		rect.width = image_width;
+		rect.height = image_height;
+		region = cairo_region_create_rectangle (&rect);
+
+		rect.x = h_offset;
+		rect.y = v_offset;
+		rect.width = layer_width;
+		rect.height = layer_height;
+		cairo_region_intersect_rectangle (region, &rect);
+		cairo_region_get_extents (region, &rect);
+		cairo_region_destroy (region);
+
+		if ((rect.width == 0) || (rect.height == 0))
+			return;
+
+		x = rect.x;
+		y = rect.y;
+		width = rect.width;
+		height = rect.height;
+	}
+
+	data.layer = layer;
+	data.width = width;
+	data.image_row = _cairo_image_surface_flush_and_get_data (image) + (y * image_row_stride) + (x * 4);
+	data.image_row_stride = image_row_stride;
+
+	x = (h_offset < 0) ? -h_offset : 0;
+	y = (v_offset < 0) ? -v_offset : 0;
+	data.layer_row_stride = layer_width * 4;
+	data.layer_row = layer->pixels + (y * data.layer_row_stride) + (x * 4);
+	data.mask_row_stride = layer_width;
+	data.mask_row = NULL;
+	if (layer->alpha_mask != NULL)
+		data.mask_row = layer->alpha_mask + (y * data.mask_row_stride) + x;
+
+	/* the rows are independent of each other */
+
+	_g_parallel_for_bands (height, PAINT_BAND_ROWS, paint_rows_cb, &data);
 
 	cairo_surface_mark_dirty (image);
 }
@@ -559,7 +607,8 @@ static cairo_surface_t *
 _cairo_image_surface_create_from_layers (int                canvas_width,
 					 int                canvas_height,
 					 GimpImageBaseType  base_type,
-					 GList             *layers)
+					 GList             *layers,
+					 int                scale)
 {
 	cairo_surface_t *image;
 	GList           *scan;
@@ -599,7 +648,7 @@ _cairo_image_surface_create_from_layers (int                canvas_width,
 			}
 		}
 
-		_cairo_image_surface_paint_layer (image, layer);
+		_cairo_image_surface_paint_layer (image, layer, scale);
 
 		performance (DEBUG_INFO, "end paint layer %d, mode %d", layer->n, layer->mode);
 	}
@@ -608,6 +657,293 @@ _cairo_image_surface_create_from_layers (int                canvas_width,
 }
 
 
+/* -- read_pixels_from_hierarchy -- */
+
+
+#define TILES_PER_BAND	16
+#define MAX_BATCH_SIZE	(16 * 1024 * 1024)
+
+
+typedef struct {
+	GimpLayer         *layer;
+	GimpColormap      *colormap;
+	GimpImageBaseType  base_type;
+	gboolean           is_gimp_channel;
+	int                in_bpp;
+	int                out_bpp;
+	int                scale;
+	guchar            *pixels;
+	int                row_stride;
+	guint32           *tile_offsets;
+	int                first_tile;
+	guchar            *tile_data;
+	gint64             tile_data_size;
+} ReadTilesData;
+
+
+static gboolean
+decode_rle_tile (ReadTilesData *data,
+		 guchar        *tile_data,
+		 gsize          tile_data_size,
+		 guchar        *tile_pixels,
+		 int            tile_width,
+		 int            tile_height)
+{
+	GimpColormap      *colormap = data->colormap;
+	GimpImageBaseType  base_type = data->base_type;
+	gboolean           is_gimp_channel = data->is_gimp_channel;
+	int                in_bpp = data->in_bpp;
+	int                out_bpp = data->out_bpp;
+	int                row_stride = tile_width * out_bpp;
+	guchar            *tile_data_p;
+	guchar            *tile_data_limit;
+	int                c;
+
+	tile_data_p = tile_data;
+	tile_data_limit = tile_data + tile_data_size - 1;
+
+	for (c = 0; c < in_bpp; c++) {
+		int     channel_offset;
+		guchar *pixels_row;
+		guchar *pixel;
+		int     size;
+		int     n, p, q, v;
+		int     tile_column;
+
+		if (is_gimp_channel)
+			channel_offset = 0;
+		else if (base_type == GIMP_INDEXED)
+			channel_offset = cairo_indexed[c];
+		else if (in_bpp >= 3)
+			channel_offset = cairo_rgba[c];
+		else if (in_bpp <= 2)
+			channel_offset = cairo_graya[c];
+		else
+			channel_offset = 0;
+		pixels_row = tile_pixels + channel_offset;
+		pixel = pixels_row;
+
+		size = tile_width * tile_height;
+		tile_column = 0;
+
+#define SET_PIXEL(v) {							\
+        tile_column++;							\
+        if (tile_column > tile_width) {					\
+                pixels_row += row_stride;				\
+                pixel = pixels_row;					\
+                tile_column = 1;					\
+        }								\
+	if ((base_type == GIMP_INDEXED) && (c == 0)) {			\
+		guchar *color = (guchar *) (colormap + (v));		\
+		pixel[CAIRO_RED] = color[0];				\
+		pixel[CAIRO_GREEN] = color[1];				\
+		pixel[CAIRO_BLUE] = color[2];				\
+	}								\
+	else if (! is_gimp_channel && (in_bpp <= 2) && (c == 0)) {	\
+		pixel[CAIRO_RED] = (v);					\
+		pixel[CAIRO_GREEN] = (v);				\
+		pixel[CAIRO_BLUE] = (v);				\
+	}								\
+	else								\
+		*pixel = (v);						\
+	pixel += out_bpp;						\
+}
+
+		while (size > 0) {
+			if (tile_data_p > tile_data_limit)
+				return FALSE;
+
+			n = *tile_data_p++;
+
+			if ((n >= 0) && (n <= 127)) {
+				/* byte          n     For 0 <= n <= 126: a short run of identical bytes
+				 * byte          v     Repeat this value n+1 times
+				 */
+
+				/* byte          127   A long run of identical bytes
+				 * byte          p
+				 * byte          q
+				 * byte          v     Repeat this value p*256 + q times
+				 */
+
+				if (n == 127) {
+					if (tile_data_p + 2 > tile_data_limit)
+						return FALSE;
+					p = *tile_data_p++;
+					q = *tile_data_p++;
+					v = *tile_data_p++;
+					n = (p * 256) + q;
+				}
+				else {
+					if (tile_data_p > tile_data_limit)
+						return FALSE;
+					v = *tile_data_p++;
+					n++;
+				}
+
+				size -= n;
+				if (size < 0)
+					return FALSE;
+
+				while (n-- > 0)
+					SET_PIXEL (v);
+			}
+			else if ((n >= 128) && (n <= 255)) {
+				/* byte          128   A long run of different bytes
+				 * byte          p
+				 * byte          q
+				 * byte[p*256+q] data  Copy these verbatim to the output stream */
+
+				/* byte          n     For 129 <= n <= 255: a short run of different bytes
+				 * byte[256-n]   data  Copy these verbatim to the output stream */
+
+				if (n == 128) {
+					if (tile_data_p + 1 > tile_data_limit)
+						return FALSE;
+					p = *tile_data_p++;
+					q = *tile_data_p++;
+					n = (p * 256) + q;
+				}
+				else
+					n = 256 - n;
+
+				if (tile_data_p + n - 1 > tile_data_limit)
+					return FALSE;
+
+				size -= n;
+				if (size < 0)
+					return FALSE;
+
+				while (n-- > 0) {
+					v = *tile_data_p++;
+					SET_PIXEL (v);
+				}
+			}
+		}
+
+#undef SET_PIXEL
+
+	}
+
+	return TRUE;
+}
+
+
+/* Copies the tile pixels to the layer reducing them by the scale factor,
+ * each destination pixel is the average of a scale x scale box, the colors
+ * are weighted by the alpha value. */
+static void
+reduce_tile (ReadTilesData *data,
+	     guchar        *tile_pixels,
+	     int            tile_width,
+	     int            tile_height,
+	     guchar        *dest_row)
+{
+	int      scale = data->scale;
+	int      out_bpp = data->out_bpp;
+	int      src_stride = tile_width * out_bpp;
+	gboolean has_alpha;
+	int      x, y, bx, by;
+
+	has_alpha = ! data->is_gimp_channel && ((data->in_bpp == 2) || (data->in_bpp == 4));
+
+	for (y = 0; y < tile_height; y += scale) {
+		guchar *dest_pixel = dest_row;
+		int     box_height = MIN (scale, tile_height - y);
+
+		for (x = 0; x < tile_width; x += scale) {
+			int   box_width = MIN (scale, tile_width - x);
+			guint n = box_width * box_height;
+			guint sum_r = 0, sum_g = 0, sum_b = 0, sum_a = 0;
+
+			for (by = 0; by < box_height; by++) {
+				guchar *src_pixel = tile_pixels + ((y + by) * src_stride) + (x * out_bpp);
+
+				for (bx = 0; bx < box_width; bx++) {
+					if (out_bpp == 1) {
+						sum_a += src_pixel[0];
+					}
+					else {
+						guint a = has_alpha ? src_pixel[CAIRO_ALPHA] : 255;
+
+						sum_r += src_pixel[CAIRO_RED] * a;
+						sum_g += src_pixel[CAIRO_GREEN] * a;
+						sum_b += src_pixel[CAIRO_BLUE] * a;
+						sum_a += a;
+					}
+					src_pixel += out_bpp;
+				}
+			}
+
+			if (out_bpp == 1) {
+				dest_pixel[0] = sum_a / n;
+			}
+			else {
+				dest_pixel[CAIRO_RED] = (sum_a > 0) ? sum_r / sum_a : 0;
+				dest_pixel[CAIRO_GREEN] = (sum_a > 0) ? sum_g / sum_a : 0;
+				dest_pixel[CAIRO_BLUE] = (sum_a > 0) ? sum_b / sum_a : 0;
+				dest_pixel[CAIRO_ALPHA] = sum_a / n;
+			}
+			dest_pixel += out_bpp;
+		}
+
+		dest_row += data->row_stride;
+	}
+}
+
+
+static void
+decode_tiles_cb (int      first,
+		 int      last,
+		 gpointer user_data)
+{
+	ReadTilesData *data = user_data;
+	guchar         tile_pixels[TILE_WIDTH * TILE_WIDTH * 4];
+	int            i;
+
+	for (i = first; i < last; i++) {
+		int     t = data->first_tile + i;
+		gint64  start;
+		gint64  size;
+		goffset offset;
+		int     tile_width;
+		int     tile_height;
+		int     tile_column;
+		int     tile_row;
+		guchar *dest_row;
+		int     y;
+
+		start = (gint64) data->tile_offsets[t] - data->tile_offsets[data->first_tile];
+		size = (gint64) data->tile_offsets[t + 1] - data->tile_offsets[t];
+		if ((start < 0) || (size <= 0) || (start >= data->tile_data_size))
+			continue;
+		size = MIN (size, data->tile_data_size - start);
+
+		if (! gimp_layer_get_tile_size (data->layer, t, data->out_bpp, &offset, &tile_width, &tile_height))
+			continue;
+
+		memset (tile_pixels, 0, tile_width * tile_height * data->out_bpp);
+		if (! decode_rle_tile (data, data->tile_data + start, size, tile_pixels, tile_width, tile_height))
+			continue;
+
+		tile_column = t % data->layer->tiles.columns;
+		tile_row = t / data->layer->tiles.columns;
+		dest_row = data->pixels
+			   + ((tile_row * TILE_WIDTH / data->scale) * data->row_stride)
+			   + ((tile_column * TILE_WIDTH / data->scale) * data->out_bpp);
+
+		if (data->scale == 1) {
+			for (y = 0; y < tile_height; y++)
+				memcpy (dest_row + (y * data->row_stride),
+					tile_pixels + (y * tile_width * data->out_bpp),
+					tile_width * data->out_bpp);
+		}
+		else
+			reduce_tile (data, tile_pixels, tile_width, tile_height, dest_row);
+	}
+}
+
+
 static guchar *
 read_pixels_from_hierarchy (GDataInputStream  *data_stream,
 			    guint32            hierarchy_offset,
@@ -616,21 +952,25 @@ read_pixels_from_hierarchy (GDataInputStream  *data_stream,
 			    GimpImageBaseType  base_type,
 			    GimpCompression    compression,
 			    gboolean           is_gimp_channel,
+			    int                scale,
 			    GCancellable      *cancellable,
 			    GError           **error)
 {
-	guchar   *image_pixels = NULL;
-	guint32   width;
-	guint32   height;
-	guint32   in_bpp;
-	guint32   out_bpp;
-	int       row_stride;
-	guint32   level_offset;
-	GArray   *tile_offsets = NULL;
-	guint32   tile_offset;
-	guint32   last_tile_offset;
-	int       n_tiles;
-	int       t;
+	guchar        *image_pixels = NULL;
+	guint32        width;
+	guint32        height;
+	guint32        in_bpp;
+	guint32        out_bpp;
+	int            row_stride;
+	guint32        level_offset;
+	GArray        *tile_offsets = NULL;
+	guint32        tile_offset;
+	guint32        last_tile_offset;
+	int            n_tiles;
+	guchar        *tile_data = NULL;
+	goffset        offset;
+	int            tile_width;
+	int            tile_height;
 
 	/* read the hierarchy structure */
 
@@ -691,8 +1031,12 @@ read_pixels_from_hierarchy (GDataInputStream  *data_stream,
 	/* tiles */
 
 	out_bpp = is_gimp_channel ? 1 : 4;
-	row_stride = width * out_bpp;
-	image_pixels = g_new (guchar, row_stride * height);
+	row_stride = SCALED_SIZE (width, scale) * out_bpp;
+	image_pixels = g_new0 (guchar, row_stride * SCALED_SIZE (height, scale));
+
+	/* compute the tile layout now, the tiles are decoded by several
+	 * threads */
+	gimp_layer_get_tile_size (layer, 0, out_bpp, &offset, &tile_width, &tile_height);
 
 	tile_offsets = g_array_new (FALSE, FALSE, sizeof (guint32));;
 	n_tiles = 0;
@@ -709,192 +1053,71 @@ read_pixels_from_hierarchy (GDataInputStream  *data_stream,
 		goto read_error;
 
 	if (compression == GIMP_COMPRESSION_RLE) {
-		guchar *tile_data = NULL;
-
-		/* go to the first tile */
-
-		tile_offset = g_array_index (tile_offsets, guint32, 0);
-		if (! g_seekable_seek (G_SEEKABLE (data_stream),
-				       tile_offset,
-				       G_SEEK_SET,
-				       cancellable,
-				       error))
-		{
-			goto read_error;
-		}
-
-		/* decompress the tile data */
-
-		tile_data = g_malloc (MAX_TILE_SIZE);
-
-		for (t = 0; t < n_tiles; t++) {
-			goffset  tile_data_size;
-			guchar  *tile_data_p;
-			guchar  *tile_data_limit;
-			gsize    data_read;
-			goffset  tile_pixels_offset;
-			gsize    tile_pixels_size;
-			int      tile_width;
-			int      tile_height;
-			int      c;
-
-			/* read the tile data */
-
-			tile_data_size = g_array_index (tile_offsets, guint32, t + 1) - g_array_index (tile_offsets, guint32, t);
-			if (tile_data_size <= 0)
-				continue;
-
-			if (! g_input_stream_read_all (G_INPUT_STREAM (data_stream),
-						       tile_data,
-						       tile_data_size,
-						       &data_read,
-						       cancellable,
-						       error))
-			{
-				goto rle_error;
-			}
-
-			/* decompress the channel streams */
-
-			if (! gimp_layer_get_tile_size (layer,
-							t,
-							out_bpp,
-							&tile_pixels_offset,
-							&tile_width,
-							&tile_height))
+		ReadTilesData  data;
+		guint32       *offsets;
+		int            first_tile;
+
+		data.layer = layer;
+		data.colormap = colormap;
+		data.base_type = base_type;
+		data.is_gimp_channel = is_gimp_channel;
+		data.in_bpp = in_bpp;
+		data.out_bpp = out_bpp;
+		data.scale = scale;
+		data.pixels = image_pixels;
+		data.row_stride = row_stride;
+		data.tile_offsets = offsets = (guint32 *) tile_offsets->data;
+
+		/* the tile data is read in batches of consecutive tiles, each
+		 * batch is decompressed in parallel */
+
+		first_tile = 0;
+		while (first_tile < n_tiles) {
+			int   last_tile;
+			gsize batch_size;
+			gsize data_read;
+
+			if (g_cancellable_set_error_if_cancelled (cancellable, error))
+				goto read_error;
+
+			last_tile = first_tile + 1;
+			while ((last_tile < n_tiles)
+			       && (offsets[last_tile + 1] > offsets[first_tile])
+			       && (offsets[last_tile + 1] - offsets[first_tile] <= MAX_BATCH_SIZE))
 			{
-				goto rle_error;
+				last_tile++;
 			}
 
-			tile_pixels_size = tile_width * tile_height;
-			tile_data_p = tile_data;
-			tile_data_limit = tile_data + data_read - 1;
-
-			for (c = 0; c < in_bpp; c++) {
-				int     channel_offset;
-				guchar *pixels_row;
-				guchar *pixel;
-				int     size;
-				int     n, p, q, v;
-				int     tile_column;
-
-				if (is_gimp_channel)
-					channel_offset = 0;
-				else if (base_type == GIMP_INDEXED)
-					channel_offset = cairo_indexed[c];
-				else if (in_bpp >= 3)
-					channel_offset = cairo_rgba[c];
-				else if (in_bpp <= 2)
-					channel_offset = cairo_graya[c];
-				else
-					channel_offset = 0;
-				pixels_row = image_pixels + tile_pixels_offset + channel_offset;
-				pixel = pixels_row;
-
-				size = tile_pixels_size;
-				tile_column = 0;
-
-#define SET_PIXEL(v) {							\
-        tile_column++;							\
-        if (tile_column > tile_width) {					\
-                pixels_row += row_stride;				\
-                pixel = pixels_row;					\
-                tile_column = 1;					\
-        }								\
-	if ((base_type == GIMP_INDEXED) && (c == 0)) {			\
-		guchar *color = (guchar *) (colormap + (v));		\
-		pixel[CAIRO_RED] = color[0];				\
-		pixel[CAIRO_GREEN] = color[1];				\
-		pixel[CAIRO_BLUE] = color[2];				\
-	}								\
-	else if (! is_gimp_channel && (in_bpp <= 2) && (c == 0)) {	\
-		pixel[CAIRO_RED] = (v);					\
-		pixel[CAIRO_GREEN] = (v);				\
-		pixel[CAIRO_BLUE] = (v);				\
-	}								\
-	else								\
-		*pixel = (v);						\
-	pixel += out_bpp;						\
-}
+			batch_size = (offsets[last_tile] > offsets[first_tile]) ? offsets[last_tile] - offsets[first_tile] : 0;
+			if (batch_size > 0) {
+				if (! g_seekable_seek (G_SEEKABLE (data_stream),
+						       offsets[first_tile],
+						       G_SEEK_SET,
+						       cancellable,
+						       error))
+				{
+					goto read_error;
+				}
 
-				while (size > 0) {
-					if (tile_data_p > tile_data_limit)
-						goto rle_error;
-
-					n = *tile_data_p++;
-
-					if ((n >= 0) && (n <= 127)) {
-						/* byte          n     For 0 <= n <= 126: a short run of identical bytes
-  	  	  	  	  	  	 * byte          v     Repeat this value n+1 times
-						 */
-
-						/* byte          127   A long run of identical bytes
-						 * byte          p
-						 * byte          q
-						 * byte          v     Repeat this value p*256 + q times
-						 */
-
-						if (n == 127) {
-							if (tile_data_p + 2 > tile_data_limit)
-								goto rle_error;
-							p = *tile_data_p++;
-							q = *tile_data_p++;
-							v = *tile_data_p++;
-							n = (p * 256) + q;
-						}
-						else {
-							if (tile_data_p > tile_data_limit)
-								goto rle_error;
-							v = *tile_data_p++;
-							n++;
-						}
-
-						size -= n;
-						if (size < 0)
-							goto rle_error;
-
-						while (n-- > 0)
-							SET_PIXEL (v);
-					}
-					else if ((n >= 128) && (n <= 255)) {
-						/* byte          128   A long run of different bytes
-						 * byte          p
-						 * byte          q
-						 * byte[p*256+q] data  Copy these verbatim to the output stream */
-
-						/* byte          n     For 129 <= n <= 255: a short run of different bytes
-						 * byte[256-n]   data  Copy these verbatim to the output stream */
-
-						if (n == 128) {
-							if (tile_data_p + 1 > tile_data_limit)
-								goto rle_error;
-							p = *tile_data_p++;
-							q = *tile_data_p++;
-							n = (p * 256) + q;
-						}
-						else
-							n = 256 - n;
-
-						if (tile_data_p + n - 1 > tile_data_limit)
-							goto rle_error;
-
-						size -= n;
-						if (size < 0)
-							goto rle_error;
-
-						while (n-- > 0) {
-							v = *tile_data_p++;
-							SET_PIXEL (v);
-						}
-					}
+				tile_data = g_realloc (tile_data, batch_size);
+				if (! g_input_stream_read_all (G_INPUT_STREAM (data_stream),
+							       tile_data,
+							       batch_size,
+							       &data_read,
+							       cancellable,
+							       error))
+				{
+					goto read_error;
 				}
+
+				data.first_tile = first_tile;
+				data.tile_data = tile_data;
+				data.tile_data_size = data_read;
+				_g_parallel_for_bands (last_tile - first_tile, TILES_PER_BAND, decode_tiles_cb, &data);
 			}
 
+			first_tile = last_tile;
 		}
-
-rle_error:
-
-		g_free (tile_data);
 	}
 	else if (compression == GIMP_COMPRESSION_NONE) {
 
@@ -904,22 +1127,22 @@ rle_error:
 
 	performance (DEBUG_INFO, "end read hierarchy");
 
+	g_free (tile_data);
 	g_array_free (tile_offsets, TRUE);
 
 	return image_pixels;
 
 read_error:
 
+	g_free (tile_data);
 	g_free (image_pixels);
-	g_array_free (tile_offsets, TRUE);
+	if (tile_offsets != NULL)
+		g_array_free (tile_offsets, TRUE);
 
 	return NULL;
 }
 
 
-#undef SET_PIXEL
-
-
 GthImage *
 _cairo_image_surface_create_from_xcf (GInputStream  *istream,
 				      GthFileData   *file_data,
@@ -952,6 +1175,7 @@ _cairo_image_surface_create_from_xcf (GInputStream  *istream,
 	guint              n_layers;
 	guint32            channel_offset;
 	guint              n_channels;
+	int                scale;
 	int                i;
 
 	performance (DEBUG_INFO, "start loading");
@@ -1003,6 +1227,17 @@ _cairo_image_surface_create_from_xcf (GInputStream  *istream,
 	if (*error != NULL)
 		goto out;
 
+	/* for a thumbnail the layers are reduced while reading the tiles
+	 * and composited at the reduced size, the factor is a power of two
+	 * that divides the tile size, this way each tile is reduced
+	 * independently. */
+
+	scale = 1;
+	if (requested_size > 0) {
+		while ((scale < TILE_WIDTH) && (MAX (canvas_width, canvas_height) / (scale * 2) >= requested_size))
+			scale *= 2;
+	}
+
 	/* properties */
 
 	read_properties = TRUE;
@@ -1210,7 +1445,7 @@ _cairo_image_surface_create_from_xcf (GInputStream  *istream,
 		if (layer->floating_selection || ! layer->visible || (layer->opacity == 0))
 			continue;
 
-		layer->pixels = read_pixels_from_hierarchy (data_stream, hierarchy_offset, layer, colormap, base_type, compression, FALSE, cancellable, error);
+		layer->pixels = read_pixels_from_hierarchy (data_stream, hierarchy_offset, layer, colormap, base_type, compression, FALSE, scale, cancellable, error);
 		if (*error != NULL)
 			goto out;
 
@@ -1278,7 +1513,7 @@ _cairo_image_surface_create_from_xcf (GInputStream  *istream,
 		if (*error != NULL)
 			goto out;
 
-		layer->alpha_mask = read_pixels_from_hierarchy (data_stream, hierarchy_offset, layer, colormap, base_type, compression, TRUE, cancellable, error);
+		layer->alpha_mask = read_pixels_from_hierarchy (data_stream, hierarchy_offset, layer, colormap, base_type, compression, TRUE, scale, cancellable, error);
 		if (*error != NULL)
 			goto out;
 	}
@@ -1286,13 +1521,25 @@ _cairo_image_surface_create_from_xcf (GInputStream  *istream,
 	performance (DEBUG_INFO, "end read layers");
 
     image = gth_image_new ();
-	surface = _cairo_image_surface_create_from_layers (canvas_width, canvas_height, base_type, layers);
+	surface = _cairo_image_surface_create_from_layers (SCALED_SIZE (canvas_width, scale),
+							   SCALED_SIZE (canvas_height, scale),
+							   base_type,
+							   layers,
+							   scale);
 
 	if (surface != NULL) {
+		_cairo_metadata_set_original_size (_cairo_image_surface_get_metadata (surface), canvas_width, canvas_height);
 		gth_image_set_cairo_surface (image, surface);
 		cairo_surface_destroy (surface);
 	}
 
+	if (original_width != NULL)
+		*original_width = canvas_width;
+	if (original_height != NULL)
+		*original_height = canvas_height;
+	if (loaded_original != NULL)
+		*loaded_original = (scale == 1);
+
 	performance (DEBUG_INFO, "end rendering");
 
 out:
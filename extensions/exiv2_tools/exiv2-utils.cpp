@@ -1046,7 +1046,6 @@ exiv2_read_sidecar (GFile     *file,
 			set_file_info_from_hash (info, table);
 			g_hash_table_unref (table);
 		}
-		Exiv2::XmpParser::terminate();
 
 		set_attributes_from_tagsets (info, update_general_attributes);
 	}
@@ -1608,6 +1607,34 @@ exiv2_clear_metadata (void   **buffer,
 #define MAX_RATIO_ERROR_TOLERANCE 0.01
 
 
+/* Heuristic to find out-of-date previews: the preview and image aspect
+ * ratios must be equal, the tolerance is used because the reduced image can
+ * have a slightly different ratio due to rounding errors.  The preview is
+ * not valid if the image size is not known. */
+static gboolean
+preview_ratio_is_valid (long preview_width,
+			long preview_height,
+			long image_width,
+			long image_height)
+{
+	double image_ratio;
+	double preview_ratio;
+	double ratio_delta;
+
+	if ((image_width <= 0) || (image_height <= 0))
+		return FALSE;
+
+	image_ratio = ((double) image_width) / image_height;
+	preview_ratio = ((double) preview_width) / preview_height;
+	ratio_delta = (image_ratio > preview_ratio) ? (image_ratio - preview_ratio) : (preview_ratio - image_ratio);
+
+	return ratio_delta <= MAX_RATIO_ERROR_TOLERANCE;
+}
+
+
+/* Uses the smallest embedded preview (the Exif thumbnail, or one of the
+ * previews saved by the camera in the makernote or in the RAW file) not
+ * smaller than the requested size, to avoid decoding the whole image. */
 GdkPixbuf *
 exiv2_generate_thumbnail (const char *uri,
 			  const char *mime_type,
@@ -1616,7 +1643,8 @@ exiv2_generate_thumbnail (const char *uri,
 	GdkPixbuf *pixbuf = NULL;
 
 	if (! _g_content_type_is_a (mime_type, "image/jpeg")
-	    && ! _g_content_type_is_a (mime_type, "image/tiff"))
+	    && ! _g_content_type_is_a (mime_type, "image/tiff")
+	    && ! _g_mime_type_is_raw (mime_type))
 	{
 		return NULL;
 	}
@@ -1634,18 +1662,9 @@ exiv2_generate_thumbnail (const char *uri,
 		Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open (path);
 #endif
 		image->readMetadata ();
-		Exiv2::ExifThumbC exifThumb (image->exifData ());
-		Exiv2::DataBuf thumb = exifThumb.copy ();
 
 		g_free (path);
 
-#if EXIV2_TEST_VERSION(0,28,0)
-		if (thumb.data() == NULL)
-#else
-		if (thumb.pData_ == NULL)
-#endif
-			return NULL;
-
 		Exiv2::ExifData &ed = image->exifData();
 
 #if EXIV2_TEST_VERSION(0,28,0)
@@ -1658,66 +1677,82 @@ exiv2_generate_thumbnail (const char *uri,
 		long image_height = (ed["Exif.Photo.PixelYDimension"].count() > 0) ? ed["Exif.Photo.PixelYDimension"].toLong() : -1;
 #endif
 
-		if ((orientation != 1) || (image_width <= 0) || (image_height <= 0))
-			return NULL;
+		if ((orientation < 1) || (orientation > 8))
+			orientation = 1;
 
-#if EXIV2_TEST_VERSION(0,28,0)
-		GInputStream *stream = g_memory_input_stream_new_from_data (thumb.data(), thumb.size(), NULL);
-#else
-		GInputStream *stream = g_memory_input_stream_new_from_data (thumb.pData_, thumb.size_, NULL);
-#endif
-		pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, NULL);
-		g_object_unref (stream);
+		if ((image_width <= 0) || (image_height <= 0)) {
+			image_width = image->pixelWidth ();
+			image_height = image->pixelHeight ();
+		}
 
-		if (pixbuf == NULL)
-			return NULL;
+		/* the previews are sorted by size, the smallest first */
 
-		/* Heuristic to find out-of-date thumbnails: the thumbnail and image aspect ratios must be equal */
+		Exiv2::PreviewManager manager (*image);
+		Exiv2::PreviewPropertiesList previews = manager.getPreviewProperties ();
 
-		int    pixbuf_width = gdk_pixbuf_get_width (pixbuf);
-		int    pixbuf_height = gdk_pixbuf_get_height (pixbuf);
-		double image_ratio = (((double) image_width) / image_height);
-		double thumbnail_ratio = (((double) pixbuf_width) / pixbuf_height);
-		double ratio_delta = (image_ratio > thumbnail_ratio) ? (image_ratio - thumbnail_ratio) : (thumbnail_ratio - image_ratio);
+		for (Exiv2::PreviewPropertiesList::iterator iter = previews.begin(); (pixbuf == NULL) && (iter != previews.end()); ++iter) {
+			long preview_width = iter->width_;
+			long preview_height = iter->height_;
 
-		if ((ratio_delta > MAX_RATIO_ERROR_TOLERANCE) /* the tolerance is used because the reduced image can have a slightly different ratio due to rounding errors */
-		    || (MAX (pixbuf_width, pixbuf_height) < requested_size)) /* ignore the embedded image if it's too small compared to the requested size */
-		{
-			g_object_unref (pixbuf);
-			return NULL;
-		}
+			/* ignore the embedded image if it's too small compared
+			 * to the requested size */
 
-		/* Scale the pixbuf to perfectly fit the requested size */
+			if ((preview_width <= 0)
+			    || (preview_height <= 0)
+			    || (MAX (preview_width, preview_height) < requested_size)
+			    || ! preview_ratio_is_valid (preview_width, preview_height, image_width, image_height))
+			{
+				continue;
+			}
 
-		if (scale_keeping_ratio (&pixbuf_width,
-					 &pixbuf_height,
-					 requested_size,
-					 requested_size,
-					 TRUE))
-		{
-			GdkPixbuf *tmp = pixbuf;
-			pixbuf = _gdk_pixbuf_scale_simple_safe (tmp, pixbuf_width, pixbuf_height, GDK_INTERP_BILINEAR);
-			g_object_unref (tmp);
+			Exiv2::PreviewImage preview = manager.getPreviewImage (*iter);
+
+			/* decode the preview scaled to fit the requested size,
+			 * the jpeg loader scales while decoding. */
+
+			GInputStream *stream = g_memory_input_stream_new_from_data (preview.pData(), preview.size(), NULL);
+			pixbuf = gdk_pixbuf_new_from_stream_at_scale (stream,
+								      requested_size,
+								      requested_size,
+								      TRUE,
+								      NULL,
+								      NULL);
+			g_object_unref (stream);
 		}
 
-		/* Save the original image size in the pixbuf options */
+		if (pixbuf == NULL)
+			return NULL;
 
-		char *s = g_strdup_printf ("%ld", image_width);
-		gdk_pixbuf_set_option (pixbuf, "tEXt::Thumb::Image::Width", s);
-		g_object_set_data (G_OBJECT (pixbuf), "gnome-original-width", GINT_TO_POINTER ((int) image_width));
-		g_free (s);
+		/* Save the original image size in the pixbuf options, as seen
+		 * after applying the orientation */
 
-		s = g_strdup_printf ("%ld", image_height);
-		gdk_pixbuf_set_option (pixbuf, "tEXt::Thumb::Image::Height", s);
-		g_object_set_data (G_OBJECT (pixbuf), "gnome-original-height", GINT_TO_POINTER ((int) image_height));
-		g_free (s);
+		if ((image_width > 0) && (image_height > 0)) {
+			if (orientation >= 5) {
+				long tmp = image_width;
+				image_width = image_height;
+				image_height = tmp;
+			}
+
+			char *s = g_strdup_printf ("%ld", image_width);
+			gdk_pixbuf_set_option (pixbuf, "tEXt::Thumb::Image::Width", s);
+			g_object_set_data (G_OBJECT (pixbuf), "gnome-original-width", GINT_TO_POINTER ((int) image_width));
+			g_free (s);
+
+			s = g_strdup_printf ("%ld", image_height);
+			gdk_pixbuf_set_option (pixbuf, "tEXt::Thumb::Image::Height", s);
+			g_object_set_data (G_OBJECT (pixbuf), "gnome-original-height", GINT_TO_POINTER ((int) image_height));
+			g_free (s);
+		}
 
 		/* Set the orientation option to correctly rotate the thumbnail
-		 * in gnome_desktop_thumbnail_factory_generate_thumbnail() */
+		 * in gnome_desktop_thumbnail_factory_generate_no_script(), the
+		 * previews are saved without rotation. */
 
-		char *orientation_s = g_strdup_printf ("%ld", orientation);
-		gdk_pixbuf_set_option (pixbuf, "orientation", orientation_s);
-		g_free (orientation_s);
+		if (gdk_pixbuf_get_option (pixbuf, "orientation") == NULL) {
+			char *orientation_s = g_strdup_printf ("%ld", orientation);
+			gdk_pixbuf_set_option (pixbuf, "orientation", orientation_s);
+			g_free (orientation_s);
+		}
 	}
 #if EXIV2_TEST_VERSION(0,28,0)
 	catch (Exiv2::Error& e) {
@@ -1728,3 +1763,30 @@ exiv2_generate_thumbnail (const char *uri,
 
 	return pixbuf;
 }
+
+
+/* -- exiv2_initialize -- */
+
+
+static GRecMutex xmp_mutex;
+
+
+static void
+xmp_lock_func (void *lock_data,
+	       bool  lock)
+{
+	if (lock)
+		g_rec_mutex_lock ((GRecMutex *) lock_data);
+	else
+		g_rec_mutex_unlock ((GRecMutex *) lock_data);
+}
+
+
+/* The XMP toolkit is not thread safe: it must be initialized once, before
+ * the metadata is read from more than one thread at a time. */
+extern "C"
+void
+exiv2_initialize (void)
+{
+	Exiv2::XmpParser::initialize (xmp_lock_func, &xmp_mutex);
+}
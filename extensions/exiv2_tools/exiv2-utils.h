@@ -36,6 +36,7 @@ extern const char *_LOCATION_TAG_NAMES[];
 extern const char *_KEYWORDS_TAG_NAMES[];
 extern const char *_RATING_TAG_NAMES[];
 
+void       exiv2_initialize                 (void);
 gboolean   exiv2_read_metadata_from_file    (GFile             *file,
 					     GFileInfo         *info,
 					     gboolean           update_general_attributes,
@@ -268,10 +268,29 @@ gth_file_data_cmp_date_time_original (GthFileData *a,
 }
 
 
+static void
+gth_file_data_key_date_time_original (GthFileData *file_data,
+				      GthSortKey  *key)
+{
+	GTimeVal *pt;
+	GTimeVal  t;
+
+	pt = NULL;
+	if (gth_file_data_get_digitalization_time (file_data, &t))
+		pt = &t;
+	if (pt == NULL)
+		pt = gth_file_data_get_modification_time (file_data);
+
+	key->number = ((gint64) pt->tv_sec * G_USEC_PER_SEC) + pt->tv_usec;
+	key->name = gth_file_data_get_filename_sort_key (file_data);
+}
+
+
 GthFileDataSort exiv2_sort_types[] = {
 	{ "exif::photo::datetimeoriginal", N_("date photo was taken"),
 	  "Exif::Photo::DateTimeOriginal,Exif::Photo::DateTimeDigitized",
-	  gth_file_data_cmp_date_time_original }
+	  gth_file_data_cmp_date_time_original,
+	  gth_file_data_key_date_time_original }
 };
 
 
@@ -288,6 +307,7 @@ pix_extension_activate (void)
 {
 	int i;
 
+	exiv2_initialize ();
 	gth_main_register_metadata_category (exiv2_metadata_category);
 	gth_main_register_metadata_info_v (exiv2_metadata_info);
 	gth_main_register_metadata_provider (GTH_TYPE_METADATA_PROVIDER_EXIV2);
@@ -23,6 +23,7 @@
 #include <math.h>
 #include "cairo-effects.h"
 #include "gth-curve.h"
+#include "gth-point-ops.h"
 
 
 gboolean
@@ -30,61 +31,15 @@ cairo_image_surface_apply_curves (cairo_surface_t  *source,
 				  GthCurve        **curve,
 				  GthAsyncTask     *task)
 {
-	long		*value_map[GTH_HISTOGRAM_N_CHANNELS];
-	int		 c, v;
-	int              width;
-	int              height;
-	int              source_stride;
-	unsigned char   *p_source_line;
-	int              x, y, temp;
-	gboolean         cancelled = FALSE;
-	double           progress;
-	unsigned char   *p_source;
-	unsigned char    image_red, image_green, image_blue, image_alpha;
-
-	for (c = GTH_HISTOGRAM_CHANNEL_VALUE; c <= GTH_HISTOGRAM_CHANNEL_BLUE; c++) {
-		value_map[c] = g_new (long, 256);
-		for (v = 0; v <= 255; v++) {
-			double u = gth_curve_eval (curve[c], v);
-			if (c > GTH_HISTOGRAM_CHANNEL_VALUE)
-				u = value_map[GTH_HISTOGRAM_CHANNEL_VALUE][(int)u];
-			value_map[c][v] = u;
-		}
-	}
-
-	width = cairo_image_surface_get_width (source);
-	height = cairo_image_surface_get_height (source);
-	source_stride = cairo_image_surface_get_stride (source);
-
-	p_source_line = _cairo_image_surface_flush_and_get_data (source);
-	for (y = 0; y < height; y++) {
-		gth_async_task_get_data (task, NULL, &cancelled, NULL);
-		if (cancelled)
-			break;
-
-		progress = (double) y / height;
-		gth_async_task_set_data (task, NULL, NULL, &progress);
-
-		p_source = p_source_line;
-		for (x = 0; x < width; x++) {
-			CAIRO_GET_RGBA (p_source, image_red, image_green, image_blue, image_alpha);
+	GthPointOps *ops;
+	gboolean     completed;
 
-			image_red   = value_map[GTH_HISTOGRAM_CHANNEL_RED][image_red];
-			image_green = value_map[GTH_HISTOGRAM_CHANNEL_GREEN][image_green];
-			image_blue  = value_map[GTH_HISTOGRAM_CHANNEL_BLUE][image_blue];
+	ops = gth_point_ops_new ();
+	gth_point_ops_add_curves (ops, curve);
+	completed = gth_point_ops_apply (ops, source, source, task);
+	gth_point_ops_free (ops);
 
-			CAIRO_SET_RGBA (p_source, image_red, image_green, image_blue, image_alpha);
-
-			p_source += 4;
-		}
-		p_source_line += source_stride;
-	}
-	cairo_surface_mark_dirty (source);
-
-	for (c = GTH_HISTOGRAM_CHANNEL_VALUE; c <= GTH_HISTOGRAM_CHANNEL_BLUE; c++)
-		g_free (value_map[c]);
-
-	return ! cancelled;
+	return completed;
 }
 
 
@@ -224,100 +179,17 @@ cairo_image_surface_apply_bcs (cairo_surface_t  *source,
 			       double            saturation,
 			       GthAsyncTask     *task)
 {
-	PixbufCache     *cache;
-	int              width;
-	int              height;
-	int              source_stride;
-	unsigned char   *p_source_line;
-	int              x, y;
-	gboolean         cancelled = FALSE;
-	double           progress;
-	unsigned char   *p_source;
-	unsigned char    values[4];
-	int              temp, value;
-
-	gimp_op_init ();
-	cache = pixbuf_cache_new ();
-
-	if (saturation < 0)
-		saturation = tan (saturation * G_PI_2);
-
-	width = cairo_image_surface_get_width (source);
-	height = cairo_image_surface_get_height (source);
-	source_stride = cairo_image_surface_get_stride (source);
-	p_source_line = _cairo_image_surface_flush_and_get_data (source);
-
-	for (y = 0; y < height; y++) {
-		gth_async_task_get_data (task, NULL, &cancelled, NULL);
-		if (cancelled)
-			break;
-
-		progress = (double) y / height;
-		gth_async_task_set_data (task, NULL, NULL, &progress);
-
-		p_source = p_source_line;
-		for (x = 0; x < width; x++) {
-			int channel;
+	GthPointOps *ops;
+	gboolean     completed;
 
-			CAIRO_GET_RGBA (p_source, values[0], values[1], values[2], values[3]);
+	ops = gth_point_ops_new ();
+	gth_point_ops_add_brightness (ops, brightness);
+	gth_point_ops_add_contrast (ops, contrast);
+	gth_point_ops_set_saturation (ops, saturation);
+	completed = gth_point_ops_apply (ops, source, source, task);
+	gth_point_ops_free (ops);
 
-			/* brightness / contrast */
-
-			for (channel = 0; channel < 3; channel++) {
-				value = values[channel];
-
-				if (! pixbuf_cache_get (cache, channel + 1, &value)) {
-					int tmp = value;
-
-					if (brightness > 0)
-						tmp = interpolate_value (value, 0, brightness);
-					else if (brightness < 0)
-						tmp = interpolate_value (value, 255, - brightness);
-					value = CLAMP (tmp, 0, 255);
-
-					if (contrast < 0)
-						tmp = interpolate_value (value, 127, tan (contrast * G_PI_2));
-					else if (contrast > 0)
-						tmp = interpolate_value (value, 127, contrast);
-					value = CLAMP (tmp, 0, 255);
-
-					pixbuf_cache_set (cache, channel + 1, values[channel], value);
-				}
-
-				values[channel] = value;
-			}
-
-			/* saturation */
-
-			if (saturation != 0.0) {
-				guchar min, max, lightness;
-				int    tmp;
-
-				max = MAX (MAX (values[0], values[1]), values[2]);
-				min = MIN (MIN (values[0], values[1]), values[2]);
-				lightness = (max + min) / 2;
-
-				tmp = interpolate_value (values[0], lightness, saturation);
-				values[0] = CLAMP (tmp, 0, 255);
-
-				tmp = interpolate_value (values[1], lightness, saturation);
-				values[1] = CLAMP (tmp, 0, 255);
-
-				tmp = interpolate_value (values[2], lightness, saturation);
-				values[2] = CLAMP (tmp, 0, 255);
-			}
-
-			CAIRO_SET_RGBA (p_source, values[0], values[1], values[2], values[3]);
-
-			p_source += 4;
-		}
-		p_source_line += source_stride;
-	}
-	cairo_surface_mark_dirty (source);
-
-	pixbuf_cache_free (cache);
-
-	return ! cancelled;
+	return completed;
 }
 
 
@@ -22,6 +22,7 @@
 #include <config.h>
 #include <math.h>
 #include "gth-file-tool-adjust-colors.h"
+#include "gth-point-ops.h"
 #include "gth-preview-tool.h"
 
 
@@ -65,159 +66,40 @@ typedef struct {
 	double                   contrast;
 	double                   saturation;
 	double                   color_level[3];
-	PixbufCache             *cache;
-	double                   midtone_distance[256];
 } AdjustData;
 
 
-static void
-adjust_colors_before (GthAsyncTask *task,
-		      gpointer      user_data)
-{
-	AdjustData *adjust_data = user_data;
-	int         i;
-
-	adjust_data->cache = pixbuf_cache_new ();
-	for (i = 0; i < 256; i++)
-		adjust_data->midtone_distance[i] = 0.667 * (1 - SQR (((double) i - 127.0) / 127.0));
-}
-
-
-static guchar
-gamma_correction (int    original,
-		  double gamma)
-{
-	double inten;
-
-	inten = (double) original / 255.0;
-
-	if (gamma != 0.0) {
-		if (inten >= 0.0)
-			inten =  pow ( inten, (1.0 / gamma));
-		else
-			inten = -pow (-inten, (1.0 / gamma));
-	}
-
-	return CLAMP (inten * 255.0, 0, 255);
-}
-
-
 static gpointer
 adjust_colors_exec (GthAsyncTask *task,
 		    gpointer      user_data)
 {
 	AdjustData      *adjust_data = user_data;
 	cairo_surface_t *source;
-	cairo_format_t   format;
-	int              width;
-	int              height;
-	int              source_stride;
-	int              destination_stride;
-	unsigned char   *p_source_line;
-	unsigned char   *p_destination_line;
-	unsigned char   *p_source;
-	unsigned char   *p_destination;
-	gboolean         cancelled;
-	double           progress;
-	int              x, y, temp;
-	int              values[4];
-	int              channel;
-	int              value;
-	double           saturation;
 	cairo_surface_t *destination;
-
-	if (adjust_data->saturation < 0)
-		saturation = tan (adjust_data->saturation * G_PI_2);
-	else
-		saturation = adjust_data->saturation;
+	GthPointOps     *ops;
 
 	source = gth_image_task_get_source_surface (GTH_IMAGE_TASK (task));
-	format = cairo_image_surface_get_format (source);
-	width = cairo_image_surface_get_width (source);
-	height = cairo_image_surface_get_height (source);
-	source_stride = cairo_image_surface_get_stride (source);
-
-	destination = cairo_image_surface_create (format, width, height);
-	destination_stride = cairo_image_surface_get_stride (destination);
-	p_source_line = _cairo_image_surface_flush_and_get_data (source);
-	p_destination_line = _cairo_image_surface_flush_and_get_data (destination);
-	for (y = 0; y < height; y++) {
-		gth_async_task_get_data (task, NULL, &cancelled, NULL);
-		if (cancelled)
-			return NULL;
-
-		progress = (double) y / height;
-		gth_async_task_set_data (task, NULL, NULL, &progress);
-
-		p_source = p_source_line;
-		p_destination = p_destination_line;
-		for (x = 0; x < width; x++) {
-			CAIRO_GET_RGBA (p_source, values[0], values[1], values[2], values[3]);
-
-			/* gamma correction / brightness / contrast */
-
-			for (channel = 0; channel < 3; channel++) {
-				value = values[channel];
-
-				if (! pixbuf_cache_get (adjust_data->cache, channel + 1, &value)) {
-					int tmp;
-
-					if (adjust_data->gamma != 0.0)
-						value = gamma_correction (value, adjust_data->gamma);
-
-					if (adjust_data->brightness > 0)
-						tmp = interpolate_value (value, 0, adjust_data->brightness);
-					else
-						tmp = interpolate_value (value, 255, - adjust_data->brightness);
-					value = CLAMP (tmp, 0, 255);
-
-					if (adjust_data->contrast < 0)
-						tmp = interpolate_value (value, 127, tan (adjust_data->contrast * G_PI_2));
-					else
-						tmp = interpolate_value (value, 127, adjust_data->contrast);
-					value = CLAMP (tmp, 0, 255);
-
-					tmp = value + adjust_data->color_level[channel] * adjust_data->midtone_distance[value];
-					value = CLAMP (tmp, 0, 255);
-
-					pixbuf_cache_set (adjust_data->cache, channel + 1, values[channel], value);
-				}
-
-				values[channel] = value;
-			}
-
-			/* saturation */
-
-			if (adjust_data->saturation != 0.0) {
-				guchar min, max, lightness;
-				int    tmp;
-
-				max = MAX (MAX (values[0], values[1]), values[2]);
-				min = MIN (MIN (values[0], values[1]), values[2]);
-				lightness = (max + min) / 2;
-
-				tmp = interpolate_value (values[0], lightness, saturation);
-				values[0] = CLAMP (tmp, 0, 255);
-
-				tmp = interpolate_value (values[1], lightness, saturation);
-				values[1] = CLAMP (tmp, 0, 255);
-
-				tmp = interpolate_value (values[2], lightness, saturation);
-				values[2] = CLAMP (tmp, 0, 255);
-			}
-
-			CAIRO_SET_RGBA (p_destination, values[0], values[1], values[2], values[3]);
-
-			p_source += 4;
-			p_destination += 4;
-		}
-		p_source_line += source_stride;
-		p_destination_line += destination_stride;
-	}
-
-	cairo_surface_mark_dirty (destination);
-	gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), destination);
-
+	destination = cairo_image_surface_create (cairo_image_surface_get_format (source),
+						  cairo_image_surface_get_width (source),
+						  cairo_image_surface_get_height (source));
+
+	/* the whole chain is compiled in a lookup table per channel and
+	 * applied with a single pass. */
+
+	ops = gth_point_ops_new ();
+	gth_point_ops_add_gamma (ops, adjust_data->gamma);
+	gth_point_ops_add_brightness (ops, adjust_data->brightness);
+	gth_point_ops_add_contrast (ops, adjust_data->contrast);
+	gth_point_ops_add_color_levels (ops,
+					adjust_data->color_level[0],
+					adjust_data->color_level[1],
+					adjust_data->color_level[2]);
+	gth_point_ops_set_saturation (ops, adjust_data->saturation);
+
+	if (gth_point_ops_apply (ops, source, destination, task))
+		gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), destination);
+
+	gth_point_ops_free (ops);
 	cairo_surface_destroy (destination);
 	cairo_surface_destroy (source);
 
@@ -230,7 +112,6 @@ adjust_data_free (gpointer user_data)
 {
 	AdjustData *adjust_data = user_data;
 
-	pixbuf_cache_free (adjust_data->cache);
 	g_object_unref (adjust_data->viewer_page);
 	g_free (adjust_data);
 }
@@ -300,7 +181,7 @@ image_task_completed_cb (GthTask  *task,
 	else {
 		if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (GET_WIDGET ("preview_checkbutton"))))
 			gth_preview_tool_set_image (GTH_PREVIEW_TOOL (self->priv->preview_tool), self->priv->destination);
-		gth_histogram_calculate_for_image (self->priv->histogram, self->priv->destination);
+		gth_histogram_calculate_for_image_preview (self->priv->histogram, self->priv->destination);
 	}
 
 	g_object_unref (task);
@@ -338,7 +219,7 @@ apply_cb (gpointer user_data)
 	adjust_data->color_level[2] = gtk_adjustment_get_value (self->priv->yellow_blue_adj);
 
 	self->priv->image_task = gth_image_task_new (_("Applying changes"),
-						     adjust_colors_before,
+						     NULL,
 						     adjust_colors_exec,
 						     NULL,
 						     adjust_data,
@@ -500,7 +381,7 @@ gth_file_tool_adjust_colors_get_options (GthFileTool *base)
 	self->priv->preview_tool = gth_preview_tool_new ();
 	gth_preview_tool_set_image (GTH_PREVIEW_TOOL (self->priv->preview_tool), self->priv->preview);
 	gth_image_viewer_set_tool (GTH_IMAGE_VIEWER (viewer), self->priv->preview_tool);
-	gth_histogram_calculate_for_image (self->priv->histogram, self->priv->preview);
+	gth_histogram_calculate_for_image_preview (self->priv->histogram, self->priv->preview);
 
 	return options;
 }
@@ -27,6 +27,7 @@
 #include "gth-file-tool-curves.h"
 #include "gth-curve.h"
 #include "gth-points.h"
+#include "gth-point-ops.h"
 #include "gth-preview-tool.h"
 
 
@@ -69,114 +70,41 @@ G_DEFINE_TYPE_WITH_CODE (GthFileToolCurves,
 
 
 typedef struct {
-	long     *value_map[GTH_HISTOGRAM_N_CHANNELS];
 	GthCurve *curve[GTH_HISTOGRAM_N_CHANNELS];
 	int       current_curve;
 	gboolean  apply_current_curve;
 } TaskData;
 
 
-static void
-curves_setup (TaskData        *task_data,
-	      cairo_surface_t *source)
-{
-	int c, v;
-
-	for (c = GTH_HISTOGRAM_CHANNEL_VALUE; c <= GTH_HISTOGRAM_CHANNEL_BLUE; c++) {
-		task_data->value_map[c] = g_new (long, 256);
-		for (v = 0; v <= 255; v++) {
-			double u;
-
-			if ((c != task_data->current_curve) || task_data->apply_current_curve)
-				u = gth_curve_eval (task_data->curve[c], v);
-			else
-				u = v;
-
-			if (c > GTH_HISTOGRAM_CHANNEL_VALUE)
-				u = task_data->value_map[GTH_HISTOGRAM_CHANNEL_VALUE][(int)u];
-
-			task_data->value_map[c][v] = u;
-		}
-	}
-}
-
-
-static inline guchar
-value_func (TaskData *task_data,
-	    int       n_channel,
-	    guchar    value)
-{
-	return (guchar) task_data->value_map[n_channel][value];
-}
-
-
 static gpointer
 curves_exec (GthAsyncTask *task,
 	     gpointer      user_data)
 {
 	TaskData        *task_data = user_data;
 	cairo_surface_t *source;
-	cairo_format_t   format;
-	int              width;
-	int              height;
-	int              source_stride;
 	cairo_surface_t *destination;
-	int              destination_stride;
-	unsigned char   *p_source_line;
-	unsigned char   *p_destination_line;
-	unsigned char   *p_source;
-	unsigned char   *p_destination;
-	gboolean         cancelled;
-	double           progress;
-	int              x, y, temp;
-	unsigned char    red, green, blue, alpha;
-
-	/* initialize the extra data */
+	GthCurve        *curve[GTH_HISTOGRAM_N_CHANNELS];
+	GthPointOps     *ops;
+	int              c;
 
 	source = gth_image_task_get_source_surface (GTH_IMAGE_TASK (task));
-	curves_setup (task_data, source);
-
-	/* convert the image */
-
-	format = cairo_image_surface_get_format (source);
-	width = cairo_image_surface_get_width (source);
-	height = cairo_image_surface_get_height (source);
-	source_stride = cairo_image_surface_get_stride (source);
-
-	destination = cairo_image_surface_create (format, width, height);
-	destination_stride = cairo_image_surface_get_stride (destination);
-	p_source_line = _cairo_image_surface_flush_and_get_data (source);
-	p_destination_line = _cairo_image_surface_flush_and_get_data (destination);
-	for (y = 0; y < height; y++) {
-		gth_async_task_get_data (task, NULL, &cancelled, NULL);
-		if (cancelled) {
-			cairo_surface_destroy (destination);
-			cairo_surface_destroy (source);
-			return NULL;
-		}
-
-		progress = (double) y / height;
-		gth_async_task_set_data (task, NULL, NULL, &progress);
+	destination = cairo_image_surface_create (cairo_image_surface_get_format (source),
+						  cairo_image_surface_get_width (source),
+						  cairo_image_surface_get_height (source));
 
-		p_source = p_source_line;
-		p_destination = p_destination_line;
-		for (x = 0; x < width; x++) {
-			CAIRO_GET_RGBA (p_source, red, green, blue, alpha);
-			red   = value_func (task_data, GTH_HISTOGRAM_CHANNEL_RED, red);
-			green = value_func (task_data, GTH_HISTOGRAM_CHANNEL_GREEN, green);
-			blue  = value_func (task_data, GTH_HISTOGRAM_CHANNEL_BLUE, blue);
-			CAIRO_SET_RGBA (p_destination, red, green, blue, alpha);
-
-			p_source += 4;
-			p_destination += 4;
-		}
-		p_source_line += source_stride;
-		p_destination_line += destination_stride;
+	for (c = GTH_HISTOGRAM_CHANNEL_VALUE; c <= GTH_HISTOGRAM_CHANNEL_BLUE; c++) {
+		if ((c != task_data->current_curve) || task_data->apply_current_curve)
+			curve[c] = task_data->curve[c];
+		else
+			curve[c] = NULL;
 	}
 
-	cairo_surface_mark_dirty (destination);
-	gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), destination);
+	ops = gth_point_ops_new ();
+	gth_point_ops_add_curves (ops, curve);
+	if (gth_point_ops_apply (ops, source, destination, task))
+		gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), destination);
 
+	gth_point_ops_free (ops);
 	cairo_surface_destroy (destination);
 	cairo_surface_destroy (source);
 
@@ -247,10 +175,8 @@ task_data_new (GthPoints *points)
 	int       c;
 
 	task_data = g_new (TaskData, 1);
-	for (c = 0; c < GTH_HISTOGRAM_N_CHANNELS; c++) {
-		task_data->value_map[c] = NULL;
+	for (c = 0; c < GTH_HISTOGRAM_N_CHANNELS; c++)
 		task_data->curve[c] = gth_curve_new (GTH_TYPE_BEZIER, points + c);
-	}
 
 	return task_data;
 }
@@ -267,8 +193,6 @@ task_data_destroy (gpointer user_data)
 
 	for (c = 0; c < GTH_HISTOGRAM_N_CHANNELS; c++)
 		g_object_unref (task_data->curve[c]);
-	for (c = 0; c < GTH_HISTOGRAM_N_CHANNELS; c++)
-		g_free (task_data->value_map[c]);
 	g_free (task_data);
 }
 
@@ -748,7 +672,7 @@ gth_file_tool_curves_get_options (GthFileTool *base)
 	self->priv->preview_tool = gth_preview_tool_new ();
 	gth_preview_tool_set_image (GTH_PREVIEW_TOOL (self->priv->preview_tool), self->priv->preview);
 	gth_image_viewer_set_tool (GTH_IMAGE_VIEWER (viewer), self->priv->preview_tool);
-	gth_histogram_calculate_for_image (self->priv->histogram, self->priv->preview);
+	gth_histogram_calculate_for_image_preview (self->priv->histogram, self->priv->preview);
 	apply_changes (self);
 
 	return container;
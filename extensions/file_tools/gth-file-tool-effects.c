@@ -27,6 +27,7 @@
 #include "cairo-effects.h"
 #include "gth-curve.h"
 #include "gth-file-tool-effects.h"
+#include "gth-point-ops.h"
 #include "gth-preview-tool.h"
 
 
@@ -507,6 +508,7 @@ desert_exec (GthAsyncTask *task,
 	cairo_surface_t *original;
 	cairo_surface_t *source;
 	GthCurve	*curve[GTH_HISTOGRAM_N_CHANNELS];
+	GthPointOps     *ops;
 
 	original = gth_image_task_get_source_surface (GTH_IMAGE_TASK (task));
 	source = _cairo_image_surface_copy (original);
@@ -516,13 +518,19 @@ desert_exec (GthAsyncTask *task,
 	curve[GTH_HISTOGRAM_CHANNEL_GREEN] = gth_curve_new_for_points (GTH_TYPE_BEZIER, 4, 0,0, 71,55, 200,206, 255,255);
 	curve[GTH_HISTOGRAM_CHANNEL_BLUE] = gth_curve_new_for_points (GTH_TYPE_BEZIER, 3, 0,0, 232,185, 255,248);
 
-	if (cairo_image_surface_apply_curves (source, curve, task)
-	    && cairo_image_surface_apply_bcs (source, 0, 0, 20.0 / 100, task)
+	/* curves and saturation in a single pass */
+
+	ops = gth_point_ops_new ();
+	gth_point_ops_add_curves (ops, curve);
+	gth_point_ops_set_saturation (ops, 20.0 / 100);
+
+	if (gth_point_ops_apply (ops, source, source, task)
 	    && cairo_image_surface_apply_vignette (source, NULL, 127, task))
 	{
 			gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), source);
 	}
 
+	gth_point_ops_free (ops);
 	g_object_unref (curve[GTH_HISTOGRAM_CHANNEL_BLUE]);
 	g_object_unref (curve[GTH_HISTOGRAM_CHANNEL_GREEN]);
 	g_object_unref (curve[GTH_HISTOGRAM_CHANNEL_RED]);
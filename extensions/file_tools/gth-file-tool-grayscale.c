@@ -23,6 +23,7 @@
 #include <pix.h>
 #include <extensions/image_viewer/image-viewer.h>
 #include "gth-file-tool-grayscale.h"
+#include "gth-point-ops.h"
 #include "gth-preview-tool.h"
 
 
@@ -78,83 +79,36 @@ grayscale_exec (GthAsyncTask *task,
 {
 	GrayscaleData   *grayscale_data = user_data;
 	cairo_surface_t *source;
-	cairo_format_t   format;
-	int              width;
-	int              height;
-	int              source_stride;
 	cairo_surface_t *destination;
-	int              destination_stride;
-	unsigned char   *p_source_line;
-	unsigned char   *p_destination_line;
-	unsigned char   *p_source;
-	unsigned char   *p_destination;
-	gboolean         cancelled;
-	double           progress;
-	int              x, y, temp;
-	unsigned char    red, green, blue, alpha;
-	unsigned char    min, max, value;
+	GthPointOps     *ops;
 
 	source = gth_image_task_get_source_surface (GTH_IMAGE_TASK (task));
-	format = cairo_image_surface_get_format (source);
-	width = cairo_image_surface_get_width (source);
-	height = cairo_image_surface_get_height (source);
-	source_stride = cairo_image_surface_get_stride (source);
-
-	destination = cairo_image_surface_create (format, width, height);
-	destination_stride = cairo_image_surface_get_stride (destination);
-	p_source_line = _cairo_image_surface_flush_and_get_data (source);
-	p_destination_line = _cairo_image_surface_flush_and_get_data (destination);
-	for (y = 0; y < height; y++) {
-		gth_async_task_get_data (task, NULL, &cancelled, NULL);
-		if (cancelled) {
-			cairo_surface_destroy (destination);
-			cairo_surface_destroy (source);
-			return NULL;
-		}
-
-		progress = (double) y / height;
-		gth_async_task_set_data (task, NULL, NULL, &progress);
-
-		p_source = p_source_line;
-		p_destination = p_destination_line;
-		for (x = 0; x < width; x++) {
-			CAIRO_GET_RGBA (p_source, red, green, blue, alpha);
-
-			switch (grayscale_data->method) {
-			case METHOD_BRIGHTNESS:
-				value = (0.2125 * red + 0.7154 * green + 0.072 * blue);
-				break;
-
-			case METHOD_SATURATION:
-				max = MAX (MAX (red, green), blue);
-				min = MIN (MIN (red, green), blue);
-				value = (max + min) / 2;
-				break;
-
-			case METHOD_AVARAGE:
-				value = (0.3333 * red + 0.3333 * green + 0.3333 * blue);
-				break;
-
-			default:
-				g_assert_not_reached ();
-			}
-
-			CAIRO_SET_RGBA (p_destination,
-					value,
-					value,
-					value,
-					alpha);
-
-			p_source += 4;
-			p_destination += 4;
-		}
-		p_source_line += source_stride;
-		p_destination_line += destination_stride;
+	destination = cairo_image_surface_create (cairo_image_surface_get_format (source),
+						  cairo_image_surface_get_width (source),
+						  cairo_image_surface_get_height (source));
+
+	ops = gth_point_ops_new ();
+	switch (grayscale_data->method) {
+	case METHOD_BRIGHTNESS:
+		gth_point_ops_set_grayscale (ops, GTH_GRAYSCALE_METHOD_BRIGHTNESS);
+		break;
+
+	case METHOD_SATURATION:
+		gth_point_ops_set_grayscale (ops, GTH_GRAYSCALE_METHOD_SATURATION);
+		break;
+
+	case METHOD_AVARAGE:
+		gth_point_ops_set_grayscale (ops, GTH_GRAYSCALE_METHOD_AVERAGE);
+		break;
+
+	default:
+		g_assert_not_reached ();
 	}
 
-	cairo_surface_mark_dirty (destination);
-	gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), destination);
+	if (gth_point_ops_apply (ops, source, destination, task))
+		gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), destination);
 
+	gth_point_ops_free (ops);
 	cairo_surface_destroy (destination);
 	cairo_surface_destroy (source);
 
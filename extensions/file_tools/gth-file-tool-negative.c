@@ -22,6 +22,7 @@
 #include <config.h>
 #include <pix.h>
 #include "gth-file-tool-negative.h"
+#include "gth-point-ops.h"
 
 
 static gpointer
@@ -29,62 +30,20 @@ negative_exec (GthAsyncTask *task,
 	       gpointer      user_data)
 {
 	cairo_surface_t *source;
-	cairo_format_t   format;
-	int              width;
-	int              height;
-	int              source_stride;
 	cairo_surface_t *destination;
-	int              destination_stride;
-	unsigned char   *p_source_line;
-	unsigned char   *p_destination_line;
-	unsigned char   *p_source;
-	unsigned char   *p_destination;
-	gboolean         cancelled;
-	double           progress;
-	int              x, y, temp;
-	unsigned char    red, green, blue, alpha;
+	GthPointOps     *ops;
 
 	source = gth_image_task_get_source_surface (GTH_IMAGE_TASK (task));
-	format = cairo_image_surface_get_format (source);
-	width = cairo_image_surface_get_width (source);
-	height = cairo_image_surface_get_height (source);
-	source_stride = cairo_image_surface_get_stride (source);
+	destination = cairo_image_surface_create (cairo_image_surface_get_format (source),
+						  cairo_image_surface_get_width (source),
+						  cairo_image_surface_get_height (source));
 
-	destination = cairo_image_surface_create (format, width, height);
-	destination_stride = cairo_image_surface_get_stride (destination);
-	p_source_line = _cairo_image_surface_flush_and_get_data (source);
-	p_destination_line = _cairo_image_surface_flush_and_get_data (destination);
-	for (y = 0; y < height; y++) {
-		gth_async_task_get_data (task, NULL, &cancelled, NULL);
-		if (cancelled) {
-			cairo_surface_destroy (destination);
-			cairo_surface_destroy (source);
-			return NULL;
-		}
-
-		progress = (double) y / height;
-		gth_async_task_set_data (task, NULL, NULL, &progress);
-
-		p_source = p_source_line;
-		p_destination = p_destination_line;
-		for (x = 0; x < width; x++) {
-			CAIRO_GET_RGBA (p_source, red, green, blue, alpha);
-			CAIRO_SET_RGBA (p_destination,
-					255 - red,
-					255 - green,
-					255 - blue,
-					alpha);
-
-			p_source += 4;
-			p_destination += 4;
-		}
-		p_source_line += source_stride;
-		p_destination_line += destination_stride;
-	}
-
-	cairo_surface_mark_dirty (destination);
-	gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), destination);
+	ops = gth_point_ops_new ();
+	gth_point_ops_add_negative (ops);
+	if (gth_point_ops_apply (ops, source, destination, task))
+		gth_image_task_set_destination_surface (GTH_IMAGE_TASK (task), destination);
 
+	gth_point_ops_free (ops);
 	cairo_surface_destroy (destination);
 	cairo_surface_destroy (source);
 
@@ -0,0 +1,526 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 The Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <math.h>
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__GNUC__)
+#define USE_X86_KERNELS
+#include <immintrin.h>
+#endif
+#include "gth-point-ops.h"
+
+
+#define BAND_LINES 32
+
+
+struct _GthPointOps {
+	guchar             lut[3][256];
+	double             saturation;
+	GthGrayscaleMethod grayscale;
+};
+
+
+GthPointOps *
+gth_point_ops_new (void)
+{
+	GthPointOps *ops;
+	int          c, v;
+
+	ops = g_new0 (GthPointOps, 1);
+	for (c = 0; c < 3; c++)
+		for (v = 0; v < 256; v++)
+			ops->lut[c][v] = v;
+	ops->saturation = 0.0;
+	ops->grayscale = GTH_GRAYSCALE_METHOD_NONE;
+
+	return ops;
+}
+
+
+void
+gth_point_ops_free (GthPointOps *ops)
+{
+	g_free (ops);
+}
+
+
+/* Appends the map to the table of the given channel: the map is applied to
+ * the result of the operations added before. */
+static void
+_gth_point_ops_compose (GthPointOps  *ops,
+			int           channel,
+			const guchar *map)
+{
+	int v;
+
+	for (v = 0; v < 256; v++)
+		ops->lut[channel][v] = map[ops->lut[channel][v]];
+}
+
+
+static void
+_gth_point_ops_compose_all (GthPointOps  *ops,
+			    const guchar *map)
+{
+	int c;
+
+	for (c = 0; c < 3; c++)
+		_gth_point_ops_compose (ops, c, map);
+}
+
+
+void
+gth_point_ops_add_gamma (GthPointOps *ops,
+			 double       gamma)
+{
+	guchar map[256];
+	int    v;
+
+	if (gamma == 0.0)
+		return;
+
+	for (v = 0; v < 256; v++) {
+		double inten;
+
+		inten = pow ((double) v / 255.0, 1.0 / gamma);
+		map[v] = CLAMP (inten * 255.0, 0, 255);
+	}
+	_gth_point_ops_compose_all (ops, map);
+}
+
+
+void
+gth_point_ops_add_brightness (GthPointOps *ops,
+			      double       brightness)
+{
+	guchar map[256];
+	int    v;
+
+	if (brightness == 0.0)
+		return;
+
+	for (v = 0; v < 256; v++) {
+		int tmp;
+
+		if (brightness > 0)
+			tmp = interpolate_value (v, 0, brightness);
+		else
+			tmp = interpolate_value (v, 255, - brightness);
+		map[v] = CLAMP (tmp, 0, 255);
+	}
+	_gth_point_ops_compose_all (ops, map);
+}
+
+
+void
+gth_point_ops_add_contrast (GthPointOps *ops,
+			    double       contrast)
+{
+	guchar map[256];
+	int    v;
+
+	if (contrast == 0.0)
+		return;
+
+	if (contrast < 0)
+		contrast = tan (contrast * G_PI_2);
+
+	for (v = 0; v < 256; v++) {
+		int tmp;
+
+		tmp = interpolate_value (v, 127, contrast);
+		map[v] = CLAMP (tmp, 0, 255);
+	}
+	_gth_point_ops_compose_all (ops, map);
+}
+
+
+/* Moves the midtones of each channel by the given amount, the shadows and
+ * the highlights are left almost unchanged. */
+void
+gth_point_ops_add_color_levels (GthPointOps *ops,
+				double       red,
+				double       green,
+				double       blue)
+{
+	double level[3] = { red, green, blue };
+	int    c, v;
+
+	for (c = 0; c < 3; c++) {
+		guchar map[256];
+
+		if (level[c] == 0.0)
+			continue;
+
+		for (v = 0; v < 256; v++) {
+			double midtone_distance;
+			int    tmp;
+
+			midtone_distance = 0.667 * (1 - SQR (((double) v - 127.0) / 127.0));
+			tmp = v + level[c] * midtone_distance;
+			map[v] = CLAMP (tmp, 0, 255);
+		}
+		_gth_point_ops_compose (ops, c, map);
+	}
+}
+
+
+static guchar
+_curve_eval (GthCurve *curve,
+	     int       v)
+{
+	if (curve == NULL)
+		return v;
+	return CLAMP (gth_curve_eval (curve, v), 0, 255);
+}
+
+
+/* curve is an array of GTH_HISTOGRAM_N_CHANNELS curves, the value curve is
+ * applied after the curve of each channel.  A NULL curve leaves the channel
+ * unchanged. */
+void
+gth_point_ops_add_curves (GthPointOps  *ops,
+			  GthCurve    **curve)
+{
+	guchar value_map[256];
+	int    c, v;
+
+	for (v = 0; v < 256; v++)
+		value_map[v] = _curve_eval (curve[GTH_HISTOGRAM_CHANNEL_VALUE], v);
+
+	for (c = 0; c < 3; c++) {
+		guchar map[256];
+
+		for (v = 0; v < 256; v++)
+			map[v] = value_map[_curve_eval (curve[GTH_HISTOGRAM_CHANNEL_RED + c], v)];
+		_gth_point_ops_compose (ops, c, map);
+	}
+}
+
+
+void
+gth_point_ops_add_negative (GthPointOps *ops)
+{
+	guchar map[256];
+	int    v;
+
+	for (v = 0; v < 256; v++)
+		map[v] = 255 - v;
+	_gth_point_ops_compose_all (ops, map);
+}
+
+
+/* saturation is in the [-1, 1] range, negative values reduce the
+ * saturation. */
+void
+gth_point_ops_set_saturation (GthPointOps *ops,
+			      double       saturation)
+{
+	if (saturation < 0)
+		saturation = tan (saturation * G_PI_2);
+	ops->saturation = saturation;
+}
+
+
+void
+gth_point_ops_set_grayscale (GthPointOps        *ops,
+			     GthGrayscaleMethod  method)
+{
+	ops->grayscale = method;
+}
+
+
+/* -- gth_point_ops_apply -- */
+
+
+typedef struct _ApplyData ApplyData;
+
+
+typedef void (*apply_line_func_t) (const ApplyData *data,
+				   const guint32   *p_source,
+				   guint32         *p_destination,
+				   int              width);
+
+
+struct _ApplyData {
+	GthPointOps       *ops;
+	guint32            red[256];
+	guint32            green[256];
+	guint32            blue[256];
+	apply_line_func_t  apply_line;
+	cairo_surface_t   *source;
+	cairo_surface_t   *destination;
+	GthAsyncTask      *task;
+	gint               total_lines;
+	gint               processed_lines;
+	gint               cancelled;
+};
+
+
+/* The pixel is un-premultiplied, transformed and premultiplied again. */
+static void
+apply_pixel (const ApplyData *data,
+	     const guchar    *p_source,
+	     guchar          *p_destination)
+{
+	GthPointOps *ops = data->ops;
+	guchar       red, green, blue, alpha;
+	int          temp;
+
+	if (p_source[CAIRO_ALPHA] == 0) {
+		*((guint32 *) p_destination) = 0;
+		return;
+	}
+
+	CAIRO_GET_RGBA (p_source, red, green, blue, alpha);
+
+	red = ops->lut[0][red];
+	green = ops->lut[1][green];
+	blue = ops->lut[2][blue];
+
+	if (ops->saturation != 0.0) {
+		guchar min, max, lightness;
+		int    tmp;
+
+		max = MAX (MAX (red, green), blue);
+		min = MIN (MIN (red, green), blue);
+		lightness = (max + min) / 2;
+
+		tmp = interpolate_value (red, lightness, ops->saturation);
+		red = CLAMP (tmp, 0, 255);
+
+		tmp = interpolate_value (green, lightness, ops->saturation);
+		green = CLAMP (tmp, 0, 255);
+
+		tmp = interpolate_value (blue, lightness, ops->saturation);
+		blue = CLAMP (tmp, 0, 255);
+	}
+
+	if (ops->grayscale != GTH_GRAYSCALE_METHOD_NONE) {
+		guchar min, max, value;
+
+		switch (ops->grayscale) {
+		case GTH_GRAYSCALE_METHOD_BRIGHTNESS:
+			value = (0.2125 * red + 0.7154 * green + 0.072 * blue);
+			break;
+
+		case GTH_GRAYSCALE_METHOD_SATURATION:
+			max = MAX (MAX (red, green), blue);
+			min = MIN (MIN (red, green), blue);
+			value = (max + min) / 2;
+			break;
+
+		default:
+			value = (0.3333 * red + 0.3333 * green + 0.3333 * blue);
+			break;
+		}
+		red = green = blue = value;
+	}
+
+	CAIRO_SET_RGBA (p_destination, red, green, blue, alpha);
+}
+
+
+static void
+apply_line_generic (const ApplyData *data,
+		    const guint32   *p_source,
+		    guint32         *p_destination,
+		    int              width)
+{
+	int x;
+
+	for (x = 0; x < width; x++) {
+		guint32 pixel = p_source[x];
+
+		if ((pixel & 0xff000000) == 0xff000000)
+			p_destination[x] = 0xff000000
+					   | data->red[(pixel >> 16) & 0xff]
+					   | data->green[(pixel >> 8) & 0xff]
+					   | data->blue[pixel & 0xff];
+		else
+			apply_pixel (data, (const guchar *) (p_source + x), (guchar *) (p_destination + x));
+	}
+}
+
+
+static void
+apply_line_full (const ApplyData *data,
+		 const guint32   *p_source,
+		 guint32         *p_destination,
+		 int              width)
+{
+	int x;
+
+	for (x = 0; x < width; x++)
+		apply_pixel (data, (const guchar *) (p_source + x), (guchar *) (p_destination + x));
+}
+
+
+#ifdef USE_X86_KERNELS
+
+
+/* Eight opaque pixels are transformed with three gathers from the
+ * pre-shifted tables, the other pixels use the generic code. */
+__attribute__ ((target ("avx2")))
+static void
+apply_line_avx2 (const ApplyData *data,
+		 const guint32   *p_source,
+		 guint32         *p_destination,
+		 int              width)
+{
+	const __m256i mask = _mm256_set1_epi32 (0xff);
+	const __m256i alpha = _mm256_set1_epi32 ((int) 0xff000000);
+	int           x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m256i pixels;
+		__m256i red;
+		__m256i green;
+		__m256i blue;
+
+		pixels = _mm256_loadu_si256 ((const __m256i *) (p_source + x));
+		if (_mm256_movemask_epi8 (_mm256_cmpeq_epi32 (_mm256_and_si256 (pixels, alpha), alpha)) != -1) {
+			apply_line_generic (data, p_source + x, p_destination + x, 8);
+			continue;
+		}
+
+		red = _mm256_i32gather_epi32 ((const int *) data->red, _mm256_and_si256 (_mm256_srli_epi32 (pixels, 16), mask), 4);
+		green = _mm256_i32gather_epi32 ((const int *) data->green, _mm256_and_si256 (_mm256_srli_epi32 (pixels, 8), mask), 4);
+		blue = _mm256_i32gather_epi32 ((const int *) data->blue, _mm256_and_si256 (pixels, mask), 4);
+		_mm256_storeu_si256 ((__m256i *) (p_destination + x),
+				     _mm256_or_si256 (_mm256_or_si256 (red, green), _mm256_or_si256 (blue, alpha)));
+	}
+
+	if (x < width)
+		apply_line_generic (data, p_source + x, p_destination + x, width - x);
+}
+
+
+#endif /* USE_X86_KERNELS */
+
+
+static apply_line_func_t
+get_apply_line_func (void)
+{
+	static gsize              initialization = 0;
+	static apply_line_func_t  apply_line = apply_line_generic;
+
+	if (g_once_init_enter (&initialization)) {
+#if defined (USE_X86_KERNELS)
+		__builtin_cpu_init ();
+		if (__builtin_cpu_supports ("avx2"))
+			apply_line = apply_line_avx2;
+#endif
+		g_once_init_leave (&initialization, 1);
+	}
+
+	return apply_line;
+}
+
+
+static void
+apply_band (int      first_line,
+	    int      last_line,
+	    gpointer user_data)
+{
+	ApplyData *data = user_data;
+	guchar    *p_source_line;
+	guchar    *p_destination_line;
+	int        source_stride;
+	int        destination_stride;
+	int        width;
+	int        y;
+
+	if (g_atomic_int_get (&data->cancelled))
+		return;
+
+	if (data->task != NULL) {
+		gboolean cancelled;
+		double   progress;
+
+		gth_async_task_get_data (data->task, NULL, &cancelled, NULL);
+		if (cancelled) {
+			g_atomic_int_set (&data->cancelled, TRUE);
+			return;
+		}
+
+		progress = (double) g_atomic_int_add (&data->processed_lines, last_line - first_line) / data->total_lines;
+		gth_async_task_set_data (data->task, NULL, NULL, &progress);
+	}
+
+	width = cairo_image_surface_get_width (data->source);
+	source_stride = cairo_image_surface_get_stride (data->source);
+	destination_stride = cairo_image_surface_get_stride (data->destination);
+	p_source_line = cairo_image_surface_get_data (data->source) + ((gsize) first_line * source_stride);
+	p_destination_line = cairo_image_surface_get_data (data->destination) + ((gsize) first_line * destination_stride);
+
+	for (y = first_line; y < last_line; y++) {
+		data->apply_line (data,
+				  (const guint32 *) p_source_line,
+				  (guint32 *) p_destination_line,
+				  width);
+		p_source_line += source_stride;
+		p_destination_line += destination_stride;
+	}
+}
+
+
+/* Applies the operations to source and saves the result in destination,
+ * the two surfaces must have the same size and can be the same surface.
+ * Returns FALSE if the task was cancelled. */
+gboolean
+gth_point_ops_apply (GthPointOps     *ops,
+		     cairo_surface_t *source,
+		     cairo_surface_t *destination,
+		     GthAsyncTask    *task)
+{
+	ApplyData data;
+	int       v;
+
+	g_return_val_if_fail (cairo_image_surface_get_width (source) == cairo_image_surface_get_width (destination), FALSE);
+	g_return_val_if_fail (cairo_image_surface_get_height (source) == cairo_image_surface_get_height (destination), FALSE);
+
+	data.ops = ops;
+	for (v = 0; v < 256; v++) {
+		data.red[v] = (guint32) ops->lut[0][v] << 16;
+		data.green[v] = (guint32) ops->lut[1][v] << 8;
+		data.blue[v] = (guint32) ops->lut[2][v];
+	}
+	if ((ops->saturation == 0.0) && (ops->grayscale == GTH_GRAYSCALE_METHOD_NONE))
+		data.apply_line = get_apply_line_func ();
+	else
+		data.apply_line = apply_line_full;
+	data.source = source;
+	data.destination = destination;
+	data.task = task;
+	data.total_lines = cairo_image_surface_get_height (source);
+	data.processed_lines = 0;
+	data.cancelled = FALSE;
+
+	_cairo_image_surface_flush_and_get_data (source);
+	if (destination != source)
+		_cairo_image_surface_flush_and_get_data (destination);
+	_g_parallel_for_bands (data.total_lines, BAND_LINES, apply_band, &data);
+	cairo_surface_mark_dirty (destination);
+
+	return ! data.cancelled;
+}
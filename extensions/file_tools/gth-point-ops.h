@@ -0,0 +1,74 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 The Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GTH_POINT_OPS_H
+#define GTH_POINT_OPS_H
+
+#include <glib.h>
+#include <cairo.h>
+#include <pix.h>
+#include "gth-curve.h"
+
+G_BEGIN_DECLS
+
+/* A chain of point operations (gamma, brightness, contrast, curves, levels,
+ * negative...) compiled into one lookup table per channel, and applied to
+ * the whole image with a single multithreaded pass.  The operations are
+ * applied in the order they are added; saturation and grayscale depend on
+ * all the channels and are applied after the tables. */
+
+typedef enum {
+	GTH_GRAYSCALE_METHOD_NONE,
+	GTH_GRAYSCALE_METHOD_BRIGHTNESS,
+	GTH_GRAYSCALE_METHOD_SATURATION,
+	GTH_GRAYSCALE_METHOD_AVERAGE
+} GthGrayscaleMethod;
+
+typedef struct _GthPointOps GthPointOps;
+
+GthPointOps *	gth_point_ops_new		(void);
+void		gth_point_ops_free		(GthPointOps		 *ops);
+void		gth_point_ops_add_gamma		(GthPointOps		 *ops,
+						 double			  gamma);
+void		gth_point_ops_add_brightness	(GthPointOps		 *ops,
+						 double			  brightness);
+void		gth_point_ops_add_contrast	(GthPointOps		 *ops,
+						 double			  contrast);
+void		gth_point_ops_add_color_levels	(GthPointOps		 *ops,
+						 double			  red,
+						 double			  green,
+						 double			  blue);
+void		gth_point_ops_add_curves	(GthPointOps		 *ops,
+						 GthCurve		**curve);
+void		gth_point_ops_add_negative	(GthPointOps		 *ops);
+void		gth_point_ops_set_saturation	(GthPointOps		 *ops,
+						 double			  saturation);
+void		gth_point_ops_set_grayscale	(GthPointOps		 *ops,
+						 GthGrayscaleMethod	  method);
+gboolean	gth_point_ops_apply		(GthPointOps		 *ops,
+						 cairo_surface_t	 *source,
+						 cairo_surface_t	 *destination,
+						 GthAsyncTask		 *task);
+
+G_END_DECLS
+
+#endif /* GTH_POINT_OPS_H */
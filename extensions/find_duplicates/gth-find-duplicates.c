@@ -30,7 +30,9 @@
 
 
 #define GET_WIDGET(x) (_gtk_builder_get_widget (self->priv->builder, (x)))
-#define BUFFER_SIZE 4096
+#define BUFFER_SIZE (1024 * 1024)
+#define PARTIAL_CHECKSUM_SIZE (64 * 1024)
+#define MAX_CONCURRENT_CHECKSUMS 4
 #define SELECT_COMMAND_ID_DATA "delete-command-id"
 #define PULSE_DELAY 50
 
@@ -61,6 +63,12 @@ typedef struct {
 } SelectCommand;
 
 
+typedef enum {
+	CHECKSUM_STAGE_PARTIAL,	/* checksum of the first and last PARTIAL_CHECKSUM_SIZE bytes */
+	CHECKSUM_STAGE_FULL	/* checksum of the whole file */
+} ChecksumStage;
+
+
 SelectCommand select_commands[] = {
 	{ N_("leave the newest duplicates"), SELECT_LEAVE_NEWEST },
 	{ N_("leave the oldest duplicates"), SELECT_LEAVE_OLDEST },
@@ -92,10 +100,9 @@ struct _GthFindDuplicatesPrivate {
 	GList         *files;
 	GList         *directories;
 	GFile         *current_directory;
-	GthFileData   *current_file;
-	guchar         buffer[BUFFER_SIZE];
-	GChecksum     *checksum;
-	GInputStream  *file_stream;
+	ChecksumStage  stage;
+	int            n_running;
+	GHashTable    *partial_checksums;
 	GHashTable    *duplicated;
 	gulong         folder_changed_id;
 	guint          pulse_event_id;
@@ -131,6 +138,18 @@ duplicated_data_new (void)
 }
 
 
+static gint64 *
+size_key_new (gint64 size)
+{
+	gint64 *key;
+
+	key = g_new (gint64, 1);
+	*key = size;
+
+	return key;
+}
+
+
 static void
 duplicated_data_free (DuplicatedData *d_data)
 {
@@ -161,11 +180,8 @@ gth_find_duplicates_finalize (GObject *object)
 	_g_object_unref (self->priv->file_source);
 	_g_object_list_unref (self->priv->files);
 	_g_object_list_unref (self->priv->directories);
-	_g_object_unref (self->priv->current_file);
 	_g_object_unref (self->priv->current_directory);
-	if (self->priv->checksum != NULL)
-		g_checksum_free (self->priv->checksum);
-	_g_object_unref (self->priv->file_stream);
+	g_hash_table_unref (self->priv->partial_checksums);
 	g_hash_table_unref (self->priv->duplicated);
 
 	G_OBJECT_CLASS (gth_find_duplicates_parent_class)->finalize (object);
@@ -196,9 +212,12 @@ gth_find_duplicates_init (GthFindDuplicates *self)
 	self->priv->files = NULL;
 	self->priv->directories = NULL;
 	self->priv->current_directory = NULL;
-	self->priv->current_file = NULL;
-	self->priv->checksum = NULL;
-	self->priv->file_stream = NULL;
+	self->priv->stage = CHECKSUM_STAGE_PARTIAL;
+	self->priv->n_running = 0;
+	self->priv->partial_checksums = g_hash_table_new_full (g_str_hash,
+							       g_str_equal,
+							       g_free,
+							       (GDestroyNotify) _g_object_list_unref);
 	self->priv->duplicated = g_hash_table_new_full (g_str_hash,
 							g_str_equal,
 							g_free,
@@ -562,9 +581,6 @@ after_checksums (GthFindDuplicates *self)
 }
 
 
-static void start_next_checksum (GthFindDuplicates *self);
-
-
 static void
 _file_list_add_file (GthFindDuplicates *self,
 		     GthFileData       *file_data)
@@ -599,166 +615,351 @@ _file_list_add_file (GthFindDuplicates *self,
 
 
 static void
-file_input_stream_read_ready_cb (GObject      *source,
-		    	    	 GAsyncResult *result,
-		    	    	 gpointer      user_data)
+add_duplicated_file (GthFindDuplicates *self,
+		     GthFileData       *file_data,
+		     const char        *checksum)
 {
-	GthFindDuplicates *self = user_data;
-	GError            *error = NULL;
-	gssize             buffer_size;
+	DuplicatedData *d_data;
 
-	self->priv->io_operation = FALSE;
-	if (self->priv->closing) {
-		gtk_widget_destroy (self->priv->dialog);
-		return;
+	g_file_info_set_attribute_string (file_data->info,
+					  "find-duplicates::checksum",
+					  checksum);
+
+	d_data = g_hash_table_lookup (self->priv->duplicated, checksum);
+	if (d_data == NULL) {
+		d_data = duplicated_data_new ();
+		g_hash_table_insert (self->priv->duplicated, g_strdup (checksum), d_data);
+	}
+	if (d_data->file_data == NULL)
+		d_data->file_data = g_object_ref (file_data);
+	d_data->files = g_list_prepend (d_data->files, g_object_ref (file_data));
+	d_data->n_files += 1;
+	d_data->total_size += g_file_info_get_size (file_data->info);
+	if (d_data->n_files > 1) {
+		char  *text;
+		GList *singleton;
+
+		text = g_strdup_printf (g_dngettext (NULL, "%d duplicate", "%d duplicates", d_data->n_files - 1), d_data->n_files - 1);
+		g_file_info_set_attribute_string (d_data->file_data->info,
+						  "find-duplicates::n-duplicates",
+						  text);
+		g_free (text);
+
+		singleton = g_list_append (NULL, d_data->file_data);
+		if (d_data->n_files == 2) {
+			gth_file_list_add_files (GTH_FILE_LIST (self->priv->duplicates_list), singleton, -1);
+			_file_list_add_file (self, d_data->file_data); /* add the first one as well */
+		}
+		else
+			gth_file_list_update_files (GTH_FILE_LIST (self->priv->duplicates_list), singleton);
+		_file_list_add_file (self, file_data);
+		g_list_free (singleton);
+
+		self->priv->n_duplicates += 1;
+		self->priv->duplicates_size += g_file_info_get_size (d_data->file_data->info);
+		update_total_duplicates_label (self);
 	}
+}
 
-	buffer_size = g_input_stream_read_finish (G_INPUT_STREAM (source), result, &error);
 
-	if (buffer_size < 0) {
-		start_next_checksum (self);
-		return;
-	}
-	else if (buffer_size == 0) {
-		const char     *checksum;
-		DuplicatedData *d_data;
+/* -- compute_checksum_async -- */
 
-		self->priv->n_file += 1;
 
-		g_object_unref (self->priv->file_stream);
-		self->priv->file_stream = NULL;
+static inline gboolean
+checksum_covers_whole_file (GthFileData *file_data)
+{
+	return g_file_info_get_size (file_data->info) <= 2 * PARTIAL_CHECKSUM_SIZE;
+}
 
-		checksum = g_checksum_get_string (self->priv->checksum);
-		g_file_info_set_attribute_string (self->priv->current_file->info,
-						  "find-duplicates::checksum",
-						  checksum);
 
-		d_data = g_hash_table_lookup (self->priv->duplicated, checksum);
-		if (d_data == NULL) {
-			d_data = duplicated_data_new ();
-			g_hash_table_insert (self->priv->duplicated, g_strdup (checksum), d_data);
+static gboolean
+checksum_update_from_stream (GChecksum     *checksum,
+			     GInputStream  *stream,
+			     guchar        *buffer,
+			     gsize          max_size,
+			     GCancellable  *cancellable,
+			     GError       **error)
+{
+	for (;;) {
+		gsize bytes_read;
+
+		if (! g_input_stream_read_all (stream,
+					       buffer,
+					       MIN (max_size, BUFFER_SIZE),
+					       &bytes_read,
+					       cancellable,
+					       error))
+		{
+			return FALSE;
 		}
-		if (d_data->file_data == NULL)
-			d_data->file_data = g_object_ref (self->priv->current_file);
-		d_data->files = g_list_prepend (d_data->files, g_object_ref (self->priv->current_file));
-		d_data->n_files += 1;
-		d_data->total_size += g_file_info_get_size (self->priv->current_file->info);
-		if (d_data->n_files > 1) {
-			char  *text;
-			GList *singleton;
 
-			text = g_strdup_printf (g_dngettext (NULL, "%d duplicate", "%d duplicates", d_data->n_files - 1), d_data->n_files - 1);
-			g_file_info_set_attribute_string (d_data->file_data->info,
-							  "find-duplicates::n-duplicates",
-							  text);
-			g_free (text);
+		if (bytes_read == 0)
+			break;
 
-			singleton = g_list_append (NULL, d_data->file_data);
-			if (d_data->n_files == 2) {
-				gth_file_list_add_files (GTH_FILE_LIST (self->priv->duplicates_list), singleton, -1);
-				_file_list_add_file (self, d_data->file_data); /* add the first one as well */
-			}
-			else
-				gth_file_list_update_files (GTH_FILE_LIST (self->priv->duplicates_list), singleton);
-			_file_list_add_file (self, self->priv->current_file);
-			g_list_free (singleton);
+		g_checksum_update (checksum, buffer, bytes_read);
+		max_size -= bytes_read;
+		if (max_size == 0)
+			break;
+	}
 
-			self->priv->n_duplicates += 1;
-			self->priv->duplicates_size += g_file_info_get_size (d_data->file_data->info);
-			update_total_duplicates_label (self);
-		}
+	return TRUE;
+}
 
-		duplicates_list_view_selection_changed_cb (NULL, self);
-		start_next_checksum (self);
 
+static void
+compute_checksum_thread (GTask        *task,
+			 gpointer      source_object,
+			 gpointer      task_data,
+			 GCancellable *cancellable)
+{
+	GthFileData      *file_data = source_object;
+	ChecksumStage     stage = GPOINTER_TO_INT (task_data);
+	GFileInputStream *stream;
+	GChecksum        *checksum;
+	guchar           *buffer;
+	gboolean          success;
+	GError           *error = NULL;
+
+	stream = g_file_read (file_data->file, cancellable, &error);
+	if (stream == NULL) {
+		g_task_return_error (task, error);
 		return;
 	}
 
-	self->priv->io_operation = TRUE;
+	checksum = g_checksum_new (G_CHECKSUM_MD5);
+	buffer = g_malloc (BUFFER_SIZE);
+
+	if ((stage == CHECKSUM_STAGE_FULL) || checksum_covers_whole_file (file_data)) {
+		success = checksum_update_from_stream (checksum, G_INPUT_STREAM (stream), buffer, G_MAXSIZE, cancellable, &error);
+	}
+	else {
+		success = checksum_update_from_stream (checksum, G_INPUT_STREAM (stream), buffer, PARTIAL_CHECKSUM_SIZE, cancellable, &error)
+			  && g_seekable_seek (G_SEEKABLE (stream), - PARTIAL_CHECKSUM_SIZE, G_SEEK_END, cancellable, &error)
+			  && checksum_update_from_stream (checksum, G_INPUT_STREAM (stream), buffer, PARTIAL_CHECKSUM_SIZE, cancellable, &error);
+	}
+
+	if (success)
+		g_task_return_pointer (task, g_strdup (g_checksum_get_string (checksum)), g_free);
+	else
+		g_task_return_error (task, error);
+
+	g_free (buffer);
+	g_checksum_free (checksum);
+	g_object_unref (stream);
+}
+
+
+static void
+compute_checksum_async (GthFileData         *file_data,
+			ChecksumStage        stage,
+			GCancellable        *cancellable,
+			GAsyncReadyCallback  callback,
+			gpointer             user_data)
+{
+	GTask *task;
+
+	task = g_task_new (file_data, cancellable, callback, user_data);
+	g_task_set_task_data (task, GINT_TO_POINTER (stage), NULL);
+	g_task_run_in_thread (task, compute_checksum_thread);
+
+	g_object_unref (task);
+}
+
+
+static char *
+compute_checksum_finish (GthFileData   *file_data,
+			 GAsyncResult  *result,
+			 GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, file_data), NULL);
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+
+/* -- checksum stages --
+ *
+ * Files with a unique size are ignored (see done_func), then a checksum of
+ * the first and last bytes is computed for every file, and finally the
+ * whole file checksum is computed only for the files that have the same
+ * partial checksum.
+ *
+ * */
+
+
+static void start_checksums (GthFindDuplicates *self);
+
+
+static void
+update_checksum_progress (GthFindDuplicates *self)
+{
+	char *text;
+	int   n_remaining;
 
-	g_checksum_update (self->priv->checksum, self->priv->buffer, buffer_size);
-	g_input_stream_read_async (self->priv->file_stream,
-				   self->priv->buffer,
-				   BUFFER_SIZE,
-				   G_PRIORITY_DEFAULT,
-				   self->priv->cancellable,
-				   file_input_stream_read_ready_cb,
-				   self);
+	switch (self->priv->stage) {
+	case CHECKSUM_STAGE_PARTIAL:
+		gtk_label_set_text (GTK_LABEL (GET_WIDGET ("progress_label")), _("Comparing the beginning and the end of the files"));
+		break;
+	case CHECKSUM_STAGE_FULL:
+		gtk_label_set_text (GTK_LABEL (GET_WIDGET ("progress_label")), _("Comparing the content of the files"));
+		break;
+	}
+
+	n_remaining = self->priv->n_files - self->priv->n_file;
+	text = g_strdup_printf (g_dngettext (NULL, "%d file remaining", "%d files remaining", n_remaining), n_remaining);
+	gtk_label_set_text (GTK_LABEL (GET_WIDGET ("search_details_label")), text);
+	g_free (text);
+
+	gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (GET_WIDGET ("search_progressbar")),
+				       (double) (self->priv->n_file + 1) / (self->priv->n_files + 1));
 }
 
 
 static void
-read_current_file_ready_cb (GObject      *source,
-			    GAsyncResult *result,
-			    gpointer      user_data)
+start_stage (GthFindDuplicates *self,
+	     ChecksumStage      stage,
+	     GList             *files)
+{
+	_g_object_list_unref (self->priv->files);
+	self->priv->files = files;
+	self->priv->stage = stage;
+	self->priv->n_files = g_list_length (self->priv->files);
+	self->priv->n_file = 0;
+	start_checksums (self);
+}
+
+
+static void
+partial_stage_completed (GthFindDuplicates *self)
+{
+	GHashTableIter  iter;
+	GList          *files;
+	GList          *group;
+
+	/* the full checksum is needed only when the partial checksums are
+	 * equal and they don't already cover the whole content. */
+
+	files = NULL;
+	g_hash_table_iter_init (&iter, self->priv->partial_checksums);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &group)) {
+		GList *scan;
+
+		if (group->next == NULL)
+			continue;
+
+		for (scan = group; scan; scan = scan->next) {
+			GthFileData *file_data = scan->data;
+
+			if (checksum_covers_whole_file (file_data))
+				add_duplicated_file (self,
+						     file_data,
+						     g_file_info_get_attribute_string (file_data->info, "find-duplicates::partial-checksum"));
+			else
+				files = g_list_prepend (files, g_object_ref (file_data));
+		}
+	}
+	g_hash_table_remove_all (self->priv->partial_checksums);
+
+	duplicates_list_view_selection_changed_cb (NULL, self);
+	start_stage (self, CHECKSUM_STAGE_FULL, files);
+}
+
+
+static void
+compute_checksum_ready_cb (GObject      *source_object,
+			   GAsyncResult *result,
+			   gpointer      user_data)
 {
 	GthFindDuplicates *self = user_data;
+	GthFileData       *file_data = GTH_FILE_DATA (source_object);
+	char              *checksum;
 	GError            *error = NULL;
 
-	self->priv->io_operation = FALSE;
+	self->priv->n_running -= 1;
+	self->priv->io_operation = (self->priv->n_running > 0);
+
 	if (self->priv->closing) {
-		gtk_widget_destroy (self->priv->dialog);
+		if (self->priv->n_running == 0)
+			gtk_widget_destroy (self->priv->dialog);
+		g_object_unref (self);
 		return;
 	}
 
-	if (self->priv->file_stream != NULL)
-		g_object_unref (self->priv->file_stream);
-	self->priv->file_stream = (GInputStream *) g_file_read_finish (G_FILE (source), result, &error);
-	if (self->priv->file_stream == NULL) {
-		start_next_checksum (self);
-		return;
+	checksum = compute_checksum_finish (file_data, result, &error);
+	self->priv->n_file += 1;
+
+	if (checksum != NULL) {
+		if (self->priv->stage == CHECKSUM_STAGE_PARTIAL) {
+			char  *key;
+			GList *group;
+
+			/* the size is part of the key because the partial
+			 * checksum doesn't consider the whole content. */
+
+			g_file_info_set_attribute_string (file_data->info,
+							  "find-duplicates::partial-checksum",
+							  checksum);
+			key = g_strdup_printf ("%" G_GOFFSET_FORMAT ":%s", g_file_info_get_size (file_data->info), checksum);
+			group = g_hash_table_lookup (self->priv->partial_checksums, key);
+			if (group == NULL)
+				g_hash_table_insert (self->priv->partial_checksums, g_strdup (key), g_list_prepend (NULL, g_object_ref (file_data)));
+			else
+				group = g_list_append (group, g_object_ref (file_data)); /* the list head doesn't change */
+			g_free (key);
+		}
+		else {
+			add_duplicated_file (self, file_data, checksum);
+			duplicates_list_view_selection_changed_cb (NULL, self);
+		}
+	}
+	else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* stop the search */
+		_g_object_list_unref (self->priv->files);
+		self->priv->files = NULL;
 	}
 
-	self->priv->io_operation = TRUE;
-	g_input_stream_read_async (self->priv->file_stream,
-				   self->priv->buffer,
-				   BUFFER_SIZE,
-				   G_PRIORITY_DEFAULT,
-				   self->priv->cancellable,
-				   file_input_stream_read_ready_cb,
-				   self);
+	g_free (checksum);
+	_g_error_free (error);
+
+	start_checksums (self);
+	g_object_unref (self);
 }
 
 
 static void
-start_next_checksum (GthFindDuplicates *self)
+start_checksums (GthFindDuplicates *self)
 {
-	GList *link;
-	char  *text;
-	int    n_remaining;
+	if (self->priv->closing)
+		return;
 
-	link = self->priv->files;
-	if (link == NULL) {
-		after_checksums (self);
+	if ((self->priv->files == NULL) && (self->priv->n_running == 0)) {
+		if ((self->priv->stage == CHECKSUM_STAGE_PARTIAL) && ! g_cancellable_is_cancelled (self->priv->cancellable))
+			partial_stage_completed (self);
+		else
+			after_checksums (self);
 		return;
 	}
 
-	self->priv->files = g_list_remove_link (self->priv->files, link);
-	_g_object_unref (self->priv->current_file);
-	self->priv->current_file = (GthFileData *) link->data;
-	g_list_free (link);
+	update_checksum_progress (self);
 
-	gtk_label_set_text (GTK_LABEL (GET_WIDGET ("progress_label")), _("Searching for duplicates"));
-
-	n_remaining = self->priv->n_files - self->priv->n_file;
-	text = g_strdup_printf (g_dngettext (NULL, "%d file remaining", "%d files remaining", n_remaining), n_remaining);
-	gtk_label_set_text (GTK_LABEL (GET_WIDGET ("search_details_label")), text);
-	g_free (text);
+	while ((self->priv->files != NULL) && (self->priv->n_running < MAX_CONCURRENT_CHECKSUMS)) {
+		GList       *link;
+		GthFileData *file_data;
 
-	gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (GET_WIDGET ("search_progressbar")),
-				       (double) (self->priv->n_file + 1) / (self->priv->n_files + 1));
+		link = self->priv->files;
+		self->priv->files = g_list_remove_link (self->priv->files, link);
+		file_data = (GthFileData *) link->data;
+		g_list_free (link);
 
-	if (self->priv->checksum == NULL)
-		self->priv->checksum = g_checksum_new (G_CHECKSUM_MD5);
-	else
-		g_checksum_reset (self->priv->checksum);
+		self->priv->n_running += 1;
+		self->priv->io_operation = TRUE;
+		compute_checksum_async (file_data,
+					self->priv->stage,
+					self->priv->cancellable,
+					compute_checksum_ready_cb,
+					g_object_ref (self));
 
-	self->priv->io_operation = TRUE;
-	g_file_read_async (self->priv->current_file->file,
-			   G_PRIORITY_DEFAULT,
-			   self->priv->cancellable,
-			   read_current_file_ready_cb,
-			   self);
+		g_object_unref (file_data);
+	}
 }
 
 
@@ -792,7 +993,7 @@ done_func (GObject  *object,
 
 	/* ignore files with an unique size */
 
-	file_sizes = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, NULL);
+	file_sizes = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
 	for (scan = self->priv->files; scan; scan = scan->next) {
 		GthFileData *file_data = scan->data;
 		gpointer     value;
@@ -803,7 +1004,7 @@ done_func (GObject  *object,
 		value = g_hash_table_lookup (file_sizes, &size);
 		n_files = (value == NULL) ? 0 : GPOINTER_TO_INT (value);
 		n_files += 1;
-		g_hash_table_insert (file_sizes, &size, GINT_TO_POINTER (n_files));
+		g_hash_table_insert (file_sizes, size_key_new (size), GINT_TO_POINTER (n_files));
 	}
 
 	possible_duplicates = NULL;
@@ -827,11 +1028,7 @@ done_func (GObject  *object,
 
 	/* start computing checksums */
 
-	_g_object_list_unref (self->priv->files);
-	self->priv->files = possible_duplicates;
-	self->priv->n_files = g_list_length (self->priv->files);
-	self->priv->n_file = 0;
-	start_next_checksum (self);
+	start_stage (self, CHECKSUM_STAGE_PARTIAL, possible_duplicates);
 }
 
 
@@ -405,6 +405,36 @@ different_quality_ready_cb (GObject		*source_object,
 		gtk_widget_queue_draw (self->priv->viewer);
 	}
 
+	/* a RAW image is shown with the embedded preview first, then
+	 * developed at half size and at last developed completely, to allow
+	 * to zoom in.  Each step is requested when the previous one is
+	 * ready. */
+
+	if (! self->priv->image_changed
+	    && (requested_size != GTH_ORIGINAL_SIZE)
+	    && _g_mime_type_is_raw (gth_file_data_get_mime_type (self->priv->file_data))
+	    && ((cairo_image_surface_get_width (s1) < original_width) || (cairo_image_surface_get_height (s1) < original_height)))
+	{
+		int half_size;
+		int next_size;
+
+		half_size = MAX (original_width, original_height) / 2;
+		if ((requested_size < half_size)
+		    && (MAX (cairo_image_surface_get_width (s1), cairo_image_surface_get_height (s1)) < half_size))
+		{
+			next_size = half_size;
+		}
+		else
+			next_size = GTH_ORIGINAL_SIZE;
+
+		_gth_image_viewer_page_load_with_preloader (self,
+							    self->priv->file_data,
+							    next_size,
+							    NULL,
+							    different_quality_ready_cb,
+							    self);
+	}
+
 clear_data:
 
 	if (s1 != NULL)
@@ -510,6 +540,10 @@ update_image_quality_if_required (GthImageViewerPage *self)
 	if ((image != NULL) && (gth_image_get_is_zoomable (image) || gth_image_get_is_animation (image)))
 		return;
 
+	/* the viewer loads the visible region when required */
+	if ((image != NULL) && gth_image_get_can_load_region (image))
+		return;
+
 	if (self->priv->update_quality_id != 0) {
 		g_source_remove (self->priv->update_quality_id);
 		self->priv->update_quality_id = 0;
@@ -0,0 +1,329 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <zlib.h>
+#include "gth-raw-cache.h"
+
+
+#define CACHE_DIR "raw"
+#define MAX_CACHE_SIZE (1024 * 1024 * 1024)
+#define MAX_IMAGE_SIZE 65535
+#define CACHE_MAGIC "PIXRAW01"
+
+
+/* The file contains the header and the ARGB32 pixels of the image,
+ * compressed with the fastest zlib level. */
+typedef struct {
+	char    magic[8];
+	guint32 width;
+	guint32 height;
+	guint32 original_width;
+	guint32 original_height;
+	guint64 data_length;
+} CacheHeader;
+
+
+G_LOCK_DEFINE_STATIC (raw_cache);
+
+
+static char *
+get_cache_filename (GthFileData *file_data,
+		    const char  *params)
+{
+	char   *uri;
+	char   *key;
+	char   *name;
+	GFile  *file;
+	char   *filename;
+
+	if ((file_data == NULL) || (file_data->info == NULL))
+		return NULL;
+
+	uri = g_file_get_uri (file_data->file);
+	key = g_strdup_printf ("%s\n%" G_GUINT64_FORMAT ".%u\n%" G_GOFFSET_FORMAT "\n%s",
+			       uri,
+			       g_file_info_get_attribute_uint64 (file_data->info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+			       g_file_info_get_attribute_uint32 (file_data->info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC),
+			       g_file_info_get_size (file_data->info),
+			       params);
+	name = g_compute_checksum_for_string (G_CHECKSUM_MD5, key, -1);
+	file = gth_user_dir_get_file_for_write (GTH_DIR_CACHE, PIX_DIR, CACHE_DIR, name, NULL);
+	filename = g_file_get_path (file);
+
+	g_object_unref (file);
+	g_free (name);
+	g_free (key);
+	g_free (uri);
+
+	return filename;
+}
+
+
+cairo_surface_t *
+gth_raw_cache_lookup (GthFileData *file_data,
+		      const char  *params,
+		      int         *original_width,
+		      int         *original_height)
+{
+	char            *filename;
+	GMappedFile     *mapped_file;
+	const char      *contents;
+	gsize            length;
+	CacheHeader      header;
+	cairo_surface_t *image = NULL;
+
+	filename = get_cache_filename (file_data, params);
+	if (filename == NULL)
+		return NULL;
+
+	mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+	if (mapped_file == NULL) {
+		g_free (filename);
+		return NULL;
+	}
+
+	contents = g_mapped_file_get_contents (mapped_file);
+	length = g_mapped_file_get_length (mapped_file);
+	if (length >= sizeof (CacheHeader))
+		memcpy (&header, contents, sizeof (CacheHeader));
+
+	if ((length >= sizeof (CacheHeader))
+	    && (memcmp (header.magic, CACHE_MAGIC, sizeof (header.magic)) == 0)
+	    && (header.data_length == length - sizeof (CacheHeader))
+	    && (header.width > 0) && (header.width <= MAX_IMAGE_SIZE)
+	    && (header.height > 0) && (header.height <= MAX_IMAGE_SIZE))
+	{
+		image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, header.width, header.height);
+		if ((cairo_surface_status (image) == CAIRO_STATUS_SUCCESS)
+		    && (cairo_image_surface_get_stride (image) == (int) header.width * 4))
+		{
+			uLongf size;
+
+			size = (uLongf) header.width * header.height * 4;
+			if ((uncompress (cairo_image_surface_get_data (image), &size, (const Bytef *) contents + sizeof (CacheHeader), header.data_length) == Z_OK)
+			    && (size == (uLongf) header.width * header.height * 4))
+			{
+				cairo_surface_mark_dirty (image);
+			}
+			else
+				g_clear_pointer (&image, cairo_surface_destroy);
+		}
+		else
+			g_clear_pointer (&image, cairo_surface_destroy);
+	}
+
+	if (image != NULL) {
+		if (original_width != NULL)
+			*original_width = header.original_width;
+		if (original_height != NULL)
+			*original_height = header.original_height;
+
+		/* used by the cache eviction */
+		g_utime (filename, NULL);
+	}
+
+	g_mapped_file_unref (mapped_file);
+	g_free (filename);
+
+	return image;
+}
+
+
+/* -- gth_raw_cache_store -- */
+
+
+typedef struct {
+	char            *filename;
+	cairo_surface_t *image;
+	int              original_width;
+	int              original_height;
+} StoreData;
+
+
+static void
+store_data_free (StoreData *store_data)
+{
+	cairo_surface_destroy (store_data->image);
+	g_free (store_data->filename);
+	g_free (store_data);
+}
+
+
+typedef struct {
+	char    *filename;
+	goffset  size;
+	time_t   mtime;
+} CacheFile;
+
+
+static int
+compare_cache_file_by_mtime (gconstpointer a,
+			     gconstpointer b)
+{
+	const CacheFile *file_a = a;
+	const CacheFile *file_b = b;
+
+	if (file_a->mtime < file_b->mtime)
+		return -1;
+	if (file_a->mtime > file_b->mtime)
+		return 1;
+	return 0;
+}
+
+
+/* Removes the least recently used images until the cache size is below
+ * the limit. */
+static void
+prune_cache (const char *directory)
+{
+	GDir       *dir;
+	const char *name;
+	GArray     *files;
+	goffset     total_size;
+	int         i;
+
+	dir = g_dir_open (directory, 0, NULL);
+	if (dir == NULL)
+		return;
+
+	files = g_array_new (FALSE, FALSE, sizeof (CacheFile));
+	total_size = 0;
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		CacheFile file;
+		GStatBuf  buf;
+
+		file.filename = g_build_filename (directory, name, NULL);
+		if (g_stat (file.filename, &buf) != 0) {
+			g_free (file.filename);
+			continue;
+		}
+		file.size = buf.st_size;
+		file.mtime = buf.st_mtime;
+		total_size += file.size;
+		g_array_append_val (files, file);
+	}
+	g_dir_close (dir);
+
+	g_array_sort (files, compare_cache_file_by_mtime);
+	for (i = 0; (i < files->len) && (total_size > MAX_CACHE_SIZE); i++) {
+		CacheFile *file = &g_array_index (files, CacheFile, i);
+
+		if (g_unlink (file->filename) == 0)
+			total_size -= file->size;
+	}
+
+	for (i = 0; i < files->len; i++)
+		g_free (g_array_index (files, CacheFile, i).filename);
+	g_array_free (files, TRUE);
+}
+
+
+static void
+store_image_thread (GTask        *task,
+		    gpointer      source_object,
+		    gpointer      task_data,
+		    GCancellable *cancellable)
+{
+	StoreData   *store_data = task_data;
+	int          width;
+	int          height;
+	uLong        pixels_size;
+	uLongf       data_length;
+	guchar      *buffer;
+	CacheHeader  header;
+	char        *directory;
+
+	width = cairo_image_surface_get_width (store_data->image);
+	height = cairo_image_surface_get_height (store_data->image);
+	if (cairo_image_surface_get_stride (store_data->image) != width * 4)
+		return;
+
+	pixels_size = (uLong) width * height * 4;
+	data_length = compressBound (pixels_size);
+	buffer = g_try_malloc (sizeof (CacheHeader) + data_length);
+	if (buffer == NULL)
+		return;
+
+	if (compress2 (buffer + sizeof (CacheHeader), &data_length, cairo_image_surface_get_data (store_data->image), pixels_size, Z_BEST_SPEED) != Z_OK) {
+		g_free (buffer);
+		return;
+	}
+
+	memset (&header, 0, sizeof (CacheHeader));
+	memcpy (header.magic, CACHE_MAGIC, sizeof (header.magic));
+	header.width = width;
+	header.height = height;
+	header.original_width = store_data->original_width;
+	header.original_height = store_data->original_height;
+	header.data_length = data_length;
+	memcpy (buffer, &header, sizeof (CacheHeader));
+
+	G_LOCK (raw_cache);
+
+	if (g_file_set_contents (store_data->filename, (char *) buffer, sizeof (CacheHeader) + data_length, NULL)) {
+		directory = g_path_get_dirname (store_data->filename);
+		prune_cache (directory);
+		g_free (directory);
+	}
+
+	G_UNLOCK (raw_cache);
+
+	g_free (buffer);
+}
+
+
+/* The image is compressed and saved in a thread, it must not be modified
+ * after this call. */
+void
+gth_raw_cache_store (GthFileData     *file_data,
+		     const char      *params,
+		     cairo_surface_t *image,
+		     int              original_width,
+		     int              original_height)
+{
+	char      *filename;
+	StoreData *store_data;
+	GTask     *task;
+
+	if ((image == NULL) || (cairo_image_surface_get_format (image) != CAIRO_FORMAT_ARGB32))
+		return;
+
+	filename = get_cache_filename (file_data, params);
+	if (filename == NULL)
+		return;
+
+	cairo_surface_flush (image);
+
+	store_data = g_new0 (StoreData, 1);
+	store_data->filename = filename;
+	store_data->image = cairo_surface_reference (image);
+	store_data->original_width = original_width;
+	store_data->original_height = original_height;
+
+	task = g_task_new (NULL, NULL, NULL, NULL);
+	g_task_set_task_data (task, store_data, (GDestroyNotify) store_data_free);
+	g_task_run_in_thread (task, store_image_thread);
+
+	g_object_unref (task);
+}
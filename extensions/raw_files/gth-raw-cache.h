@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTH_RAW_CACHE_H
+#define GTH_RAW_CACHE_H
+
+#include <glib.h>
+#include <cairo.h>
+#include <pix.h>
+
+G_BEGIN_DECLS
+
+/* The images developed from the RAW files, saved in the user cache and
+ * identified by the file, its modification time and size, and the LibRaw
+ * parameters used to develop it.  The least recently used images are
+ * removed when the cache is full. */
+
+cairo_surface_t *  gth_raw_cache_lookup  (GthFileData      *file_data,
+					  const char       *params,
+					  int              *original_width,
+					  int              *original_height);
+void               gth_raw_cache_store   (GthFileData      *file_data,
+					  const char       *params,
+					  cairo_surface_t  *image,
+					  int               original_width,
+					  int               original_height);
+
+G_END_DECLS
+
+#endif /* GTH_RAW_CACHE_H */
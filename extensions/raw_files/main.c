@@ -28,6 +28,7 @@
 #include <libraw.h>
 #include "main.h"
 #include "gth-metadata-provider-raw.h"
+#include "gth-raw-cache.h"
 
 
 typedef enum {
@@ -196,34 +197,10 @@ _libraw_progress_cb (void                 *callback_data,
 }
 
 
-static GthImage *
-_cairo_image_surface_create_from_raw (GInputStream  *istream,
-				      GthFileData   *file_data,
-				      int            requested_size,
-				      int           *original_width,
-				      int           *original_height,
-				      gboolean      *loaded_original,
-				      gpointer       user_data,
-				      GCancellable  *cancellable,
-				      GError       **error)
+static void
+_libraw_set_params (libraw_data_t *raw_data,
+		    gboolean       half_size)
 {
-	libraw_data_t *raw_data;
-	int            result;
-	void          *buffer = NULL;
-	size_t         size;
-	GthImage      *image = NULL;
-
-	raw_data = libraw_init (GTH_LIBRAW_INIT_OPTIONS);
-	if (raw_data == NULL) {
-		_libraw_set_gerror (error, errno);
-		goto fatal_error;
-	}
-
-	libraw_set_progress_handler (raw_data, _libraw_progress_cb, cancellable);
-
-	if (! _g_input_stream_read_all (istream, &buffer, &size, cancellable, error))
-		goto fatal_error;
-
 	raw_data->params.output_tiff = FALSE;
 	raw_data->params.use_camera_wb = TRUE;
 
@@ -236,154 +213,290 @@ _cairo_image_surface_create_from_raw (GInputStream  *istream,
 	raw_data->params.use_camera_matrix = TRUE;
 	raw_data->params.output_color = RAW_OUTPUT_COLOR_SRGB;
 	raw_data->params.output_bps = 8;
-	raw_data->params.half_size = (requested_size > 0);
+	raw_data->params.half_size = half_size;
+}
 
-	result = libraw_open_buffer (raw_data, buffer, size);
-	if (LIBRAW_FATAL_ERROR (result)) {
-		_libraw_set_gerror (error, result);
-		goto fatal_error;
+
+/* The parameters that change the developed image, used to identify the
+ * image in the cache. */
+static char *
+_libraw_get_cache_params (libraw_data_t *raw_data)
+{
+	return g_strdup_printf ("%s,%d,%d,%d,%d,%d,%d",
+				libraw_version (),
+				raw_data->params.use_camera_wb,
+				raw_data->params.highlight,
+				raw_data->params.use_camera_matrix,
+				raw_data->params.output_color,
+				raw_data->params.output_bps,
+				raw_data->params.half_size);
+}
+
+
+/* Reads the size of the developed image without unpacking the raw data. */
+static gboolean
+_libraw_get_original_size (void   *buffer,
+			   size_t  size,
+			   int    *original_width,
+			   int    *original_height)
+{
+	libraw_data_t *raw_data;
+	gboolean       success = FALSE;
+
+	raw_data = libraw_init (GTH_LIBRAW_INIT_OPTIONS);
+	if (raw_data == NULL)
+		return FALSE;
+
+	if (! LIBRAW_FATAL_ERROR (libraw_open_buffer (raw_data, buffer, size))
+	    && (libraw_adjust_sizes_info_only (raw_data) == LIBRAW_SUCCESS))
+	{
+		*original_width = raw_data->sizes.iwidth;
+		*original_height = raw_data->sizes.iheight;
+		success = TRUE;
 	}
 
+	libraw_close (raw_data);
 
-	if (requested_size > 0) {
+	return success;
+}
 
-		if (loaded_original != NULL)
-			*loaded_original = FALSE;
 
-		/* read the thumbnail */
+static GthImage *
+_libraw_read_thumbnail (libraw_data_t  *raw_data,
+			int             requested_size,
+			GCancellable   *cancellable,
+			GError        **error)
+{
+	GthImage *image = NULL;
+	int       result;
 
-		result = libraw_unpack_thumb (raw_data);
-		if (result != LIBRAW_SUCCESS) {
-			_libraw_set_gerror (error, result);
-			goto fatal_error;
-		}
+	result = libraw_unpack_thumb (raw_data);
+	if (result != LIBRAW_SUCCESS) {
+		_libraw_set_gerror (error, result);
+		return NULL;
+	}
 
-		switch (raw_data->thumbnail.tformat) {
-		case LIBRAW_THUMBNAIL_JPEG:
-			image = _libraw_read_jpeg_data (raw_data->thumbnail.thumb,
-							raw_data->thumbnail.tlength,
-							requested_size,
-							cancellable,
-							error);
-			break;
-		case LIBRAW_THUMBNAIL_BITMAP:
-			if ((raw_data->thumbnail.tcolors > 0) && (raw_data->thumbnail.tcolors <= 4)) {
-				image = _libraw_read_bitmap_data (raw_data->thumbnail.twidth,
-								  raw_data->thumbnail.theight,
-								  raw_data->thumbnail.tcolors,
-								  8,
-								  (guchar *) raw_data->thumbnail.thumb,
-								  raw_data->thumbnail.tlength);
-			}
-			else
-				g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unsupported data format");
-			break;
-		default:
-			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unsupported data format");
-			break;
+	switch (raw_data->thumbnail.tformat) {
+	case LIBRAW_THUMBNAIL_JPEG:
+		image = _libraw_read_jpeg_data (raw_data->thumbnail.thumb,
+						raw_data->thumbnail.tlength,
+						requested_size,
+						cancellable,
+						error);
+		break;
+	case LIBRAW_THUMBNAIL_BITMAP:
+		if ((raw_data->thumbnail.tcolors > 0) && (raw_data->thumbnail.tcolors <= 4)) {
+			image = _libraw_read_bitmap_data (raw_data->thumbnail.twidth,
+							  raw_data->thumbnail.theight,
+							  raw_data->thumbnail.tcolors,
+							  8,
+							  (guchar *) raw_data->thumbnail.thumb,
+							  raw_data->thumbnail.tlength);
 		}
+		else
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unsupported data format");
+		break;
+	default:
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unsupported data format");
+		break;
+	}
 
-		if ((image != NULL) && (_libraw_get_tranform (raw_data) != GTH_TRANSFORM_NONE)) {
-			cairo_surface_t *surface;
-			cairo_surface_t *rotated;
+	if ((image != NULL) && (_libraw_get_tranform (raw_data) != GTH_TRANSFORM_NONE)) {
+		cairo_surface_t *surface;
+		cairo_surface_t *rotated;
 
-			surface = gth_image_get_cairo_surface (image);
-			rotated = _cairo_image_surface_transform (surface, _libraw_get_tranform (raw_data));
-			gth_image_set_cairo_surface (image, rotated);
+		surface = gth_image_get_cairo_surface (image);
+		rotated = _cairo_image_surface_transform (surface, _libraw_get_tranform (raw_data));
+		gth_image_set_cairo_surface (image, rotated);
 
-			cairo_surface_destroy (rotated);
-			cairo_surface_destroy (surface);
-		}
+		cairo_surface_destroy (rotated);
+		cairo_surface_destroy (surface);
+	}
 
-		/* get the original size */
+	return image;
+}
 
-		if ((original_width != NULL) && (original_height != NULL)) {
-			libraw_close (raw_data);
 
-			raw_data = libraw_init (GTH_LIBRAW_INIT_OPTIONS);
-			if (raw_data == NULL)
-				goto fatal_error;
+/* Develops the raw data with the parameters of @raw_data.  A full size
+ * development is read from the cache when possible and saved in the cache
+ * otherwise, a half size development is fast enough to not be cached. */
+static GthImage *
+_libraw_develop (libraw_data_t  *raw_data,
+		 GthFileData    *file_data,
+		 int             original_width,
+		 int             original_height,
+		 GCancellable   *cancellable,
+		 GError        **error)
+{
+	gboolean                  use_cache;
+	char                     *params = NULL;
+	cairo_surface_t          *surface = NULL;
+	GthImage                 *image = NULL;
+	libraw_processed_image_t *processed_image;
+	int                       result;
+
+	use_cache = ! raw_data->params.half_size;
+	if (use_cache) {
+		params = _libraw_get_cache_params (raw_data);
+		surface = gth_raw_cache_lookup (file_data, params, NULL, NULL);
+	}
+	if (surface != NULL) {
+		image = gth_image_new_for_surface (surface);
+		cairo_surface_destroy (surface);
+		g_free (params);
+		return image;
+	}
 
-			result = libraw_open_buffer (raw_data, buffer, size);
-			if (LIBRAW_FATAL_ERROR (result))
-				goto fatal_error;
+	result = libraw_unpack (raw_data);
+	if (result != LIBRAW_SUCCESS) {
+		_libraw_set_gerror (error, result);
+		goto out;
+	}
 
-			result = libraw_unpack (raw_data);
-			if (result != LIBRAW_SUCCESS) {
-				_libraw_set_gerror (error, result);
-				goto fatal_error;
-			}
+	result = libraw_dcraw_process (raw_data);
+	if (result != LIBRAW_SUCCESS) {
+		_libraw_set_gerror (error, result);
+		goto out;
+	}
 
-			result = libraw_adjust_sizes_info_only (raw_data);
-			if (result != LIBRAW_SUCCESS) {
-				_libraw_set_gerror (error, result);
-				goto fatal_error;
-			}
+	processed_image = libraw_dcraw_make_mem_image (raw_data, &result);
+	if (result != LIBRAW_SUCCESS) {
+		_libraw_set_gerror (error, result);
+		goto out;
+	}
 
-			*original_width = raw_data->sizes.iwidth;
-			*original_height = raw_data->sizes.iheight;
-		}
-	} else {
-		/* read the image */
+	switch (processed_image->type) {
+	case LIBRAW_IMAGE_JPEG:
+		image = _libraw_read_jpeg_data (processed_image->data,
+						processed_image->data_size,
+						-1,
+						cancellable,
+						error);
+		break;
+	case LIBRAW_IMAGE_BITMAP:
+		image = _libraw_read_bitmap_data (processed_image->width,
+						  processed_image->height,
+						  processed_image->colors,
+						  processed_image->bits,
+						  processed_image->data,
+						  processed_image->data_size);
+		break;
+	default:
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unsupported data format");
+		break;
+	}
 
-		libraw_processed_image_t *processed_image;
+	libraw_dcraw_clear_mem (processed_image);
 
-		result = libraw_unpack (raw_data);
-		if (result != LIBRAW_SUCCESS) {
-			_libraw_set_gerror (error, result);
-			goto fatal_error;
-		}
+	if (use_cache && (image != NULL)) {
+		surface = gth_image_get_cairo_surface (image);
+		gth_raw_cache_store (file_data, params, surface, original_width, original_height);
+		cairo_surface_destroy (surface);
+	}
 
-		result = libraw_dcraw_process (raw_data);
-		if (result != LIBRAW_SUCCESS) {
-			_libraw_set_gerror (error, result);
-			goto fatal_error;
-		}
+out:
 
-		processed_image = libraw_dcraw_make_mem_image (raw_data, &result);
-		if (result != LIBRAW_SUCCESS) {
-			_libraw_set_gerror (error, result);
-			goto fatal_error;
-		}
+	g_free (params);
 
-		switch (processed_image->type) {
-		case LIBRAW_IMAGE_JPEG:
-			image = _libraw_read_jpeg_data (processed_image->data,
-							processed_image->data_size,
-							-1,
-							cancellable,
-							error);
-			break;
-		case LIBRAW_IMAGE_BITMAP:
-			image = _libraw_read_bitmap_data (processed_image->width,
-							  processed_image->height,
-							  processed_image->colors,
-							  processed_image->bits,
-							  processed_image->data,
-							  processed_image->data_size);
-			break;
-		default:
-			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unsupported data format");
-			break;
+	return image;
+}
+
+
+static GthImage *
+_cairo_image_surface_create_from_raw (GInputStream  *istream,
+				      GthFileData   *file_data,
+				      int            requested_size,
+				      int           *original_width,
+				      int           *original_height,
+				      gboolean      *loaded_original,
+				      gpointer       user_data,
+				      GCancellable  *cancellable,
+				      GError       **error)
+{
+	libraw_data_t *raw_data;
+	int            result;
+	void          *buffer = NULL;
+	size_t         size;
+	GthImage      *image = NULL;
+	int            width = -1;
+	int            height = -1;
+
+	raw_data = libraw_init (GTH_LIBRAW_INIT_OPTIONS);
+	if (raw_data == NULL) {
+		_libraw_set_gerror (error, errno);
+		goto out;
+	}
+
+	libraw_set_progress_handler (raw_data, _libraw_progress_cb, cancellable);
+	_libraw_set_params (raw_data, (requested_size > 0));
+
+	if (requested_size <= 0) {
+		char            *params;
+		cairo_surface_t *surface;
+
+		/* a developed image in the cache doesn't require to read the
+		 * file */
+
+		params = _libraw_get_cache_params (raw_data);
+		surface = gth_raw_cache_lookup (file_data, params, &width, &height);
+		g_free (params);
+
+		if (surface != NULL) {
+			image = gth_image_new_for_surface (surface);
+			cairo_surface_destroy (surface);
+			goto out;
 		}
+	}
 
-		libraw_dcraw_clear_mem (processed_image);
+	if (! _g_input_stream_read_all (istream, &buffer, &size, cancellable, error))
+		goto out;
 
-		/* get the original size */
+	result = libraw_open_buffer (raw_data, buffer, size);
+	if (LIBRAW_FATAL_ERROR (result)) {
+		_libraw_set_gerror (error, result);
+		goto out;
+	}
 
-		if ((original_width != NULL) && (original_height != NULL)) {
-			result = libraw_adjust_sizes_info_only (raw_data);
-			if (result != LIBRAW_SUCCESS) {
-				_libraw_set_gerror (error, result);
-				goto fatal_error;
-			}
+	_libraw_get_original_size (buffer, size, &width, &height);
 
-			*original_width = raw_data->sizes.iwidth;
-			*original_height = raw_data->sizes.iheight;
+	if (requested_size > 0) {
+		int     max_thumbnail_size;
+		GError *thumbnail_error = NULL;
+
+		if (loaded_original != NULL)
+			*loaded_original = FALSE;
+
+		/* a thumbnail uses the embedded preview only, as before.  A
+		 * bigger size uses the preview as well, unless it's at least
+		 * half of the original size: in that case the raw data is
+		 * developed at half size, which doesn't require to
+		 * interpolate the colors.  The viewer asks for the half size
+		 * and then for the original size as separate steps. */
+
+		max_thumbnail_size = gnome_desktop_thumbnail_size_to_size (GNOME_DESKTOP_THUMBNAIL_SIZE_XXLARGE);
+		if ((requested_size < MAX (width, height) / 2)
+		    || (requested_size <= max_thumbnail_size))
+		{
+			image = _libraw_read_thumbnail (raw_data, requested_size, cancellable, &thumbnail_error);
 		}
+
+		if ((image == NULL) && (requested_size > max_thumbnail_size))
+			image = _libraw_develop (raw_data, file_data, width, height, cancellable, (thumbnail_error == NULL) ? error : NULL);
+
+		if ((image == NULL) && (thumbnail_error != NULL))
+			g_propagate_error (error, thumbnail_error);
+		else
+			g_clear_error (&thumbnail_error);
 	}
+	else
+		image = _libraw_develop (raw_data, file_data, width, height, cancellable, error);
 
-	fatal_error:
+	out:
+
+	if ((image != NULL) && (original_width != NULL) && (original_height != NULL)) {
+		*original_width = width;
+		*original_height = height;
+	}
 
 	if (raw_data != NULL)
 		libraw_close (raw_data);
@@ -130,7 +130,10 @@ search_update_buffer_ready_cb (void     **buffer,
 		return;
 	}
 
+	/* search again without the index, to update it. */
+
 	task = gth_search_task_new (search_data->browser, search, search_data->file);
+	gth_search_task_set_use_index (GTH_SEARCH_TASK (task), FALSE);
 	gth_browser_exec_task (search_data->browser, task, GTH_TASK_FLAGS_FOREGROUND);
 
 	g_object_unref (task);
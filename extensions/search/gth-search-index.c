@@ -0,0 +1,1717 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <pix.h>
+#include "gth-search-index.h"
+
+
+#define INDEX_FORMAT_VERSION 2
+#define INDEX_DIR "search-index"
+#define INDEX_MAX_AGE (7 * 24 * 60 * 60) /* seconds */
+#define SAVE_DELAY 10 /* seconds */
+#define REFRESH_INTERVAL (10 * 60) /* seconds */
+#define CANCELLED_CHECK_INTERVAL 1000
+#define VALUES_TYPE "a{s(yv)}"
+#define ENTRIES_TYPE "a{s" VALUES_TYPE "}"
+#define FOLDERS_TYPE "a{sx}"
+#define ROOT_TYPE "(usbbx" FOLDERS_TYPE ENTRIES_TYPE ")"
+#define FOLDER_ATTRIBUTES "standard::type,standard::is-hidden,time::modified,time::modified-usec"
+#define INDEX_ATTRIBUTES \
+	"standard::type,standard::is-hidden,standard::name,standard::display-name," \
+	"standard::size,standard::content-type,standard::fast-content-type," \
+	"time::modified,time::modified-usec,time::created,time::created-usec," \
+	"general::tags,general::title,general::description,general::rating," \
+	"comment::note,comment::place,comment::categories," \
+	"Embedded::Photo::DateTimeOriginal,Embedded::Photo::CameraModel," \
+	"frame::width,frame::height"
+/* the gth::file attributes are computed from the standard attributes */
+#define SEARCHABLE_ATTRIBUTES INDEX_ATTRIBUTES ",gth::file::*"
+/* the attributes read without the metadata of the files */
+#define FILE_ATTRIBUTES "standard::*,time::*,gth::file::*"
+
+
+/* attributes with a posting list, from the tag to the files. */
+static const char *tag_attributes[] = {
+	"general::tags",
+	"comment::categories",
+	NULL
+};
+
+
+typedef struct {
+	char       *uri;
+	gboolean    recursive;
+	gboolean    show_hidden;
+	gint64      time;
+	char       *filename;
+	GVariant   *data;		/* the saved entries, until loaded */
+	GHashTable *folders;		/* folder uri -> modification time */
+	GHashTable *entries;		/* uri -> values */
+	GHashTable *tags;		/* tag key -> set of uris */
+	gboolean    dirty;
+} IndexRoot;
+
+
+struct _GthSearchIndex {
+	GMutex                 mutex;
+	char                  *directory;
+	GList                 *roots;
+	GFileAttributeMatcher *matcher;
+	guint                  save_id;
+	GList                 *refresh_queue;	/* SearchData items */
+	gboolean               refreshing;
+};
+
+
+struct _GthSearchIndexBuild {
+	GthSearchIndex *index;
+	IndexRoot      *root;
+};
+
+
+static char *
+get_tag_key (const char *tag)
+{
+	char *casefolded;
+	char *key;
+
+	casefolded = g_utf8_casefold (tag, -1);
+	key = g_utf8_collate_key (casefolded, -1);
+	g_free (casefolded);
+
+	return key;
+}
+
+
+static gboolean
+is_tag_attribute (const char *attribute)
+{
+	int i;
+
+	for (i = 0; tag_attributes[i] != NULL; i++)
+		if (g_strcmp0 (attribute, tag_attributes[i]) == 0)
+			return TRUE;
+
+	return FALSE;
+}
+
+
+/* Returns the keys of the tags contained in @values. */
+static GList *
+get_tag_keys (GVariant *values)
+{
+	GList *keys = NULL;
+	int    i;
+
+	for (i = 0; tag_attributes[i] != NULL; i++) {
+		GVariant  *value;
+		GFileInfo *info;
+		GObject   *object;
+		GList     *scan;
+
+		value = g_variant_lookup_value (values, tag_attributes[i], G_VARIANT_TYPE ("(yv)"));
+		if (value == NULL)
+			continue;
+
+		info = g_file_info_new ();
+		_g_file_info_set_attribute_from_variant (info, tag_attributes[i], value);
+		object = g_file_info_get_attribute_object (info, tag_attributes[i]);
+		if (GTH_IS_METADATA (object)) {
+			for (scan = gth_string_list_get_list (gth_metadata_get_string_list (GTH_METADATA (object))); scan; scan = scan->next)
+				keys = g_list_prepend (keys, get_tag_key (scan->data));
+		}
+
+		g_object_unref (info);
+		g_variant_unref (value);
+	}
+
+	return keys;
+}
+
+
+/* Returns the modification time of @info in microseconds, 0 if not
+ * available. */
+static gint64
+get_modification_time (GFileInfo *info)
+{
+	if (! g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+		return 0;
+
+	return ((gint64) g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC)
+		+ g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+
+/* -- IndexRoot -- */
+
+
+static IndexRoot *
+index_root_new (GthSearchIndex *index,
+		const char     *uri,
+		gboolean        recursive,
+		gboolean        show_hidden,
+		gint64          time)
+{
+	IndexRoot *root;
+	char      *name;
+
+	root = g_new0 (IndexRoot, 1);
+	root->uri = g_strdup (uri);
+	root->recursive = recursive;
+	root->show_hidden = show_hidden;
+	root->time = time;
+	name = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+	root->filename = g_build_filename (index->directory, name, NULL);
+	root->data = NULL;
+	root->folders = g_hash_table_new_full (g_str_hash,
+					       g_str_equal,
+					       g_free,
+					       g_free);
+	root->entries = g_hash_table_new_full (g_str_hash,
+					       g_str_equal,
+					       g_free,
+					       (GDestroyNotify) g_variant_unref);
+	root->tags = g_hash_table_new_full (g_str_hash,
+					    g_str_equal,
+					    g_free,
+					    (GDestroyNotify) g_hash_table_unref);
+	root->dirty = FALSE;
+
+	g_free (name);
+
+	return root;
+}
+
+
+static void
+index_root_free (IndexRoot *root)
+{
+	if (root->data != NULL)
+		g_variant_unref (root->data);
+	g_hash_table_unref (root->tags);
+	g_hash_table_unref (root->entries);
+	g_hash_table_unref (root->folders);
+	g_free (root->filename);
+	g_free (root->uri);
+	g_free (root);
+}
+
+
+static void
+index_root_add_tags (IndexRoot  *root,
+		     const char *uri,
+		     GVariant   *values)
+{
+	GList *keys;
+	GList *scan;
+
+	keys = get_tag_keys (values);
+	for (scan = keys; scan; scan = scan->next) {
+		GHashTable *uris;
+
+		uris = g_hash_table_lookup (root->tags, scan->data);
+		if (uris == NULL) {
+			uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+			g_hash_table_insert (root->tags, g_strdup (scan->data), uris);
+		}
+		g_hash_table_add (uris, g_strdup (uri));
+	}
+
+	_g_string_list_free (keys);
+}
+
+
+static void
+index_root_remove_tags (IndexRoot  *root,
+			const char *uri,
+			GVariant   *values)
+{
+	GList *keys;
+	GList *scan;
+
+	keys = get_tag_keys (values);
+	for (scan = keys; scan; scan = scan->next) {
+		GHashTable *uris;
+
+		uris = g_hash_table_lookup (root->tags, scan->data);
+		if (uris == NULL)
+			continue;
+
+		g_hash_table_remove (uris, uri);
+		if (g_hash_table_size (uris) == 0)
+			g_hash_table_remove (root->tags, scan->data);
+	}
+
+	_g_string_list_free (keys);
+}
+
+
+static void
+index_root_remove_entry (IndexRoot  *root,
+			 const char *uri)
+{
+	GVariant *values;
+
+	values = g_hash_table_lookup (root->entries, uri);
+	if (values == NULL)
+		return;
+
+	index_root_remove_tags (root, uri, values);
+	g_hash_table_remove (root->entries, uri);
+	root->dirty = TRUE;
+}
+
+
+/* Takes ownership of @values. */
+static void
+index_root_set_entry (IndexRoot  *root,
+		      const char *uri,
+		      GVariant   *values)
+{
+	index_root_remove_entry (root, uri);
+	g_hash_table_insert (root->entries, g_strdup (uri), values);
+	index_root_add_tags (root, uri, values);
+	root->dirty = TRUE;
+}
+
+
+static void
+index_root_set_folder (IndexRoot  *root,
+		       const char *uri,
+		       gint64      time)
+{
+	gint64 *value;
+
+	value = g_new (gint64, 1);
+	*value = time;
+	g_hash_table_insert (root->folders, g_strdup (uri), value);
+	root->dirty = TRUE;
+}
+
+
+/* Moves the saved entries to the hash table, the first time the root is
+ * used. */
+static void
+index_root_load (IndexRoot *root)
+{
+	GVariantIter  iter;
+	const char   *uri;
+	GVariant     *values;
+
+	if (root->data == NULL)
+		return;
+
+	g_variant_iter_init (&iter, root->data);
+	while (g_variant_iter_next (&iter, "{&s@" VALUES_TYPE "}", &uri, &values))
+		index_root_set_entry (root, uri, values);
+
+	g_variant_unref (root->data);
+	root->data = NULL;
+	root->dirty = FALSE;
+}
+
+
+static void
+index_root_save (IndexRoot *root)
+{
+	GVariantBuilder  folders_builder;
+	GVariantBuilder  builder;
+	GHashTableIter   iter;
+	gpointer         key;
+	gpointer         value;
+	GVariant        *variant;
+
+	root->dirty = FALSE;
+
+	g_variant_builder_init (&folders_builder, G_VARIANT_TYPE (FOLDERS_TYPE));
+	g_hash_table_iter_init (&iter, root->folders);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		g_variant_builder_add (&folders_builder, "{sx}", (char *) key, *((gint64 *) value));
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE (ENTRIES_TYPE));
+	g_hash_table_iter_init (&iter, root->entries);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		g_variant_builder_add (&builder, "{s@" VALUES_TYPE "}", (char *) key, (GVariant *) value);
+	variant = g_variant_ref_sink (g_variant_new ("(usbbx@" FOLDERS_TYPE "@" ENTRIES_TYPE ")",
+						     INDEX_FORMAT_VERSION,
+						     root->uri,
+						     root->recursive,
+						     root->show_hidden,
+						     root->time,
+						     g_variant_builder_end (&folders_builder),
+						     g_variant_builder_end (&builder)));
+
+	/* the index is only an optimization, errors are not fatal. */
+	g_file_set_contents (root->filename,
+			     g_variant_get_data (variant),
+			     g_variant_get_size (variant),
+			     NULL);
+
+	g_variant_unref (variant);
+}
+
+
+/* Reads the header of a saved root, the entries are loaded when needed. */
+static IndexRoot *
+index_root_read (GthSearchIndex *index,
+		 const char     *filename)
+{
+	IndexRoot   *root = NULL;
+	GMappedFile *mapped_file;
+	GBytes      *bytes;
+	GVariant    *variant;
+	guint32      version;
+	const char  *uri;
+	gboolean     recursive;
+	gboolean     show_hidden;
+	gint64       time;
+	GVariant    *folders;
+	GVariant    *entries;
+
+	mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+	if (mapped_file == NULL)
+		return NULL;
+
+	/* the entries keep a reference to the mapped data. */
+
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (ROOT_TYPE), bytes, FALSE));
+	g_variant_get (variant,
+		       "(u&sbbx@" FOLDERS_TYPE "@" ENTRIES_TYPE ")",
+		       &version,
+		       &uri,
+		       &recursive,
+		       &show_hidden,
+		       &time,
+		       &folders,
+		       &entries);
+
+	if (version == INDEX_FORMAT_VERSION) {
+		root = index_root_new (index, uri, recursive, show_hidden, time);
+		if (g_strcmp0 (root->filename, filename) == 0) {
+			GVariantIter  iter;
+			const char   *folder_uri;
+			gint64        folder_time;
+
+			g_variant_iter_init (&iter, folders);
+			while (g_variant_iter_next (&iter, "{&sx}", &folder_uri, &folder_time))
+				index_root_set_folder (root, folder_uri, folder_time);
+			root->data = g_variant_ref (entries);
+			root->dirty = FALSE;
+		}
+		else
+			g_clear_pointer (&root, index_root_free);
+	}
+
+	g_variant_unref (entries);
+	g_variant_unref (folders);
+	g_variant_unref (variant);
+	g_bytes_unref (bytes);
+	g_mapped_file_unref (mapped_file);
+
+	return root;
+}
+
+
+/* Whether @uri is inside the folder @folder_uri and, when the hidden files
+ * are not shown, not inside a hidden folder. */
+static gboolean
+uri_is_inside (const char *uri,
+	       const char *folder_uri,
+	       gboolean    recursive,
+	       gboolean    show_hidden)
+{
+	size_t      len;
+	const char *relative;
+	const char *last_slash;
+	const char *p;
+
+	len = strlen (folder_uri);
+	if (strncmp (uri, folder_uri, len) != 0)
+		return FALSE;
+
+	relative = uri + len;
+	if ((len == 0) || (folder_uri[len - 1] != '/')) {
+		if (*relative != '/')
+			return FALSE;
+		relative++;
+	}
+	if (*relative == '\0')
+		return FALSE;
+
+	last_slash = strrchr (relative, '/');
+	if (last_slash == NULL)
+		return TRUE;
+	if (! recursive)
+		return FALSE;
+	if (show_hidden)
+		return TRUE;
+
+	for (p = relative; p < last_slash; p++)
+		if ((*p == '.') && ((p == relative) || (*(p - 1) == '/')))
+			return FALSE;
+
+	return TRUE;
+}
+
+
+/* -- GthSearchIndex -- */
+
+
+static void
+index_load_roots (GthSearchIndex *index)
+{
+	GDir       *dir;
+	const char *name;
+
+	dir = g_dir_open (index->directory, 0, NULL);
+	if (dir == NULL)
+		return;
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		char      *filename;
+		IndexRoot *root;
+
+		filename = g_build_filename (index->directory, name, NULL);
+		root = index_root_read (index, filename);
+		if (root != NULL)
+			index->roots = g_list_prepend (index->roots, root);
+		else
+			g_unlink (filename);
+
+		g_free (filename);
+	}
+
+	g_dir_close (dir);
+}
+
+
+static void
+index_remove_root (GthSearchIndex *index,
+		   IndexRoot      *root)
+{
+	index->roots = g_list_remove (index->roots, root);
+	g_unlink (root->filename);
+	index_root_free (root);
+}
+
+
+static gboolean
+index_root_is_expired (IndexRoot *root)
+{
+	return (g_get_real_time () / G_USEC_PER_SEC) - root->time > INDEX_MAX_AGE;
+}
+
+
+/* Returns the root that contains all the files of the given folder. */
+static IndexRoot *
+index_get_root (GthSearchIndex *index,
+		const char     *uri,
+		gboolean        recursive,
+		gboolean        show_hidden)
+{
+	GList *scan;
+
+	for (scan = index->roots; scan; scan = scan->next) {
+		IndexRoot *root = scan->data;
+
+		if (root->show_hidden != show_hidden)
+			continue;
+		if (index_root_is_expired (root))
+			continue;
+
+		if (strcmp (root->uri, uri) == 0) {
+			if (root->recursive || ! recursive)
+				return root;
+		}
+		else if (root->recursive) {
+			char     *child_uri;
+			gboolean  inside;
+
+			/* a folder is inside the root if its children are. */
+
+			child_uri = g_strconcat (uri, "/", NULL);
+			inside = uri_is_inside (child_uri, root->uri, TRUE, show_hidden);
+			g_free (child_uri);
+
+			if (inside)
+				return root;
+		}
+	}
+
+	return NULL;
+}
+
+
+static gboolean
+save_roots_cb (gpointer user_data)
+{
+	GthSearchIndex *index = user_data;
+
+	gth_search_index_flush (index);
+
+	return FALSE;
+}
+
+
+static void
+index_queue_save (GthSearchIndex *index)
+{
+	if (index->save_id != 0)
+		return;
+	index->save_id = g_timeout_add_seconds (SAVE_DELAY, save_roots_cb, index);
+}
+
+
+static GVariant *
+index_get_values (GthSearchIndex *index,
+		  GFileInfo      *info)
+{
+	GVariantBuilder   builder;
+	char            **attributes;
+	int               i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE (VALUES_TYPE));
+	attributes = g_file_info_list_attributes (info, NULL);
+	for (i = 0; attributes[i] != NULL; i++) {
+		GVariant *value;
+
+		if (! g_file_attribute_matcher_matches (index->matcher, attributes[i]))
+			continue;
+
+		value = _g_file_info_attribute_to_variant (info, attributes[i]);
+		if (value != NULL)
+			g_variant_builder_add (&builder, "{s@(yv)}", attributes[i], value);
+	}
+	g_strfreev (attributes);
+
+	return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+
+/* -- monitor events -- */
+
+
+static void
+index_update_file (GthSearchIndex *index,
+		   GFile          *file,
+		   GFileInfo      *info)
+{
+	char     *uri;
+	GVariant *values;
+	GList    *scan;
+
+	if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR)
+		return;
+
+	uri = g_file_get_uri (file);
+	values = NULL;
+	for (scan = index->roots; scan; scan = scan->next) {
+		IndexRoot *root = scan->data;
+
+		if (! uri_is_inside (uri, root->uri, root->recursive, root->show_hidden))
+			continue;
+		if (! root->show_hidden && g_file_info_get_is_hidden (info))
+			continue;
+
+		if (values == NULL)
+			values = index_get_values (index, info);
+		index_root_load (root);
+		index_root_set_entry (root, uri, g_variant_ref (values));
+	}
+
+	if (values != NULL)
+		g_variant_unref (values);
+	g_free (uri);
+}
+
+
+static void
+update_files_ready_cb (GList    *files,
+		       GError   *error,
+		       gpointer  user_data)
+{
+	GthSearchIndex *index = user_data;
+	GList          *scan;
+
+	if (error != NULL)
+		return;
+
+	g_mutex_lock (&index->mutex);
+	for (scan = files; scan; scan = scan->next) {
+		GthFileData *file_data = scan->data;
+		index_update_file (index, file_data->file, file_data->info);
+	}
+	g_mutex_unlock (&index->mutex);
+
+	index_queue_save (index);
+}
+
+
+static gboolean
+index_contains_file (GthSearchIndex *index,
+		     GFile          *file)
+{
+	char     *uri;
+	gboolean  result = FALSE;
+	GList    *scan;
+
+	uri = g_file_get_uri (file);
+	for (scan = index->roots; ! result && scan; scan = scan->next) {
+		IndexRoot *root = scan->data;
+
+		if (uri_is_inside (uri, root->uri, root->recursive, root->show_hidden))
+			result = TRUE;
+	}
+	g_free (uri);
+
+	return result;
+}
+
+
+/* Removes @uri and, if it is a folder, the files it contains. */
+static void
+index_remove_uri (GthSearchIndex *index,
+		  const char     *uri)
+{
+	GList *scan;
+
+	for (scan = index->roots; scan; /* void */) {
+		IndexRoot      *root = scan->data;
+		GHashTableIter  iter;
+		gpointer        key;
+		GList          *removed;
+		GList          *scan_removed;
+
+		scan = scan->next;
+
+		if ((strcmp (uri, root->uri) == 0) || uri_is_inside (root->uri, uri, TRUE, TRUE)) {
+			index_remove_root (index, root);
+			continue;
+		}
+
+		if (! uri_is_inside (uri, root->uri, TRUE, TRUE))
+			continue;
+
+		index_root_load (root);
+		removed = NULL;
+		g_hash_table_iter_init (&iter, root->entries);
+		while (g_hash_table_iter_next (&iter, &key, NULL))
+			if ((strcmp (key, uri) == 0) || uri_is_inside (key, uri, TRUE, TRUE))
+				removed = g_list_prepend (removed, g_strdup (key));
+		for (scan_removed = removed; scan_removed; scan_removed = scan_removed->next)
+			index_root_remove_entry (root, scan_removed->data);
+		_g_string_list_free (removed);
+
+		removed = NULL;
+		g_hash_table_iter_init (&iter, root->folders);
+		while (g_hash_table_iter_next (&iter, &key, NULL))
+			if ((strcmp (key, uri) == 0) || uri_is_inside (key, uri, TRUE, TRUE))
+				removed = g_list_prepend (removed, g_strdup (key));
+		for (scan_removed = removed; scan_removed; scan_removed = scan_removed->next)
+			g_hash_table_remove (root->folders, scan_removed->data);
+		if (removed != NULL)
+			root->dirty = TRUE;
+		_g_string_list_free (removed);
+	}
+}
+
+
+static void
+monitor_folder_changed_cb (GthMonitor      *monitor,
+			   GFile           *parent,
+			   GList           *list,
+			   int              position,
+			   GthMonitorEvent  event,
+			   gpointer         user_data)
+{
+	GthSearchIndex *index = user_data;
+	GList          *files;
+	GList          *scan;
+
+	switch (event) {
+	case GTH_MONITOR_EVENT_CREATED:
+	case GTH_MONITOR_EVENT_CHANGED:
+		files = NULL;
+		g_mutex_lock (&index->mutex);
+		for (scan = list; scan; scan = scan->next) {
+			GFile *file = scan->data;
+
+			if (index_contains_file (index, file))
+				files = g_list_prepend (files, g_object_ref (file));
+		}
+		g_mutex_unlock (&index->mutex);
+
+		if (files != NULL)
+			_g_query_all_metadata_async (files,
+						     GTH_LIST_RECURSIVE,
+						     INDEX_ATTRIBUTES,
+						     NULL,
+						     update_files_ready_cb,
+						     index);
+
+		_g_object_list_unref (files);
+		break;
+
+	case GTH_MONITOR_EVENT_DELETED:
+		g_mutex_lock (&index->mutex);
+		for (scan = list; scan; scan = scan->next) {
+			char *uri = g_file_get_uri (G_FILE (scan->data));
+			index_remove_uri (index, uri);
+			g_free (uri);
+		}
+		g_mutex_unlock (&index->mutex);
+		index_queue_save (index);
+		break;
+
+	case GTH_MONITOR_EVENT_REMOVED:
+		break;
+	}
+}
+
+
+static void
+monitor_file_renamed_cb (GthMonitor *monitor,
+			 GFile      *file,
+			 GFile      *new_file,
+			 gpointer    user_data)
+{
+	GthSearchIndex *index = user_data;
+	char           *uri;
+	GList          *files;
+
+	/* the renamed file is removed and its new name is indexed again. */
+
+	uri = g_file_get_uri (file);
+	g_mutex_lock (&index->mutex);
+	index_remove_uri (index, uri);
+	g_mutex_unlock (&index->mutex);
+	g_free (uri);
+
+	files = g_list_prepend (NULL, new_file);
+	monitor_folder_changed_cb (monitor, NULL, files, -1, GTH_MONITOR_EVENT_CREATED, index);
+	g_list_free (files);
+
+	index_queue_save (index);
+}
+
+
+static void
+monitor_metadata_changed_cb (GthMonitor  *monitor,
+			     GthFileData *file_data,
+			     gpointer     user_data)
+{
+	GthSearchIndex *index = user_data;
+	char           *uri;
+	GList          *scan;
+
+	uri = g_file_get_uri (file_data->file);
+	g_mutex_lock (&index->mutex);
+	for (scan = index->roots; scan; scan = scan->next) {
+		IndexRoot       *root = scan->data;
+		GVariant        *old_values;
+		GVariant        *new_values;
+		GVariantBuilder  builder;
+		GVariantIter     iter;
+		const char      *attribute;
+		GVariant        *value;
+
+		if (! uri_is_inside (uri, root->uri, root->recursive, root->show_hidden))
+			continue;
+
+		index_root_load (root);
+		old_values = g_hash_table_lookup (root->entries, uri);
+		if (old_values == NULL)
+			continue;
+
+		/* the changed attributes replace the old ones. */
+
+		new_values = index_get_values (index, file_data->info);
+		g_variant_builder_init (&builder, G_VARIANT_TYPE (VALUES_TYPE));
+		g_variant_iter_init (&iter, new_values);
+		while (g_variant_iter_next (&iter, "{&s@(yv)}", &attribute, &value)) {
+			g_variant_builder_add (&builder, "{s@(yv)}", attribute, value);
+			g_variant_unref (value);
+		}
+		g_variant_iter_init (&iter, old_values);
+		while (g_variant_iter_next (&iter, "{&s@(yv)}", &attribute, &value)) {
+			if (! g_file_info_has_attribute (file_data->info, attribute))
+				g_variant_builder_add (&builder, "{s@(yv)}", attribute, value);
+			g_variant_unref (value);
+		}
+		index_root_set_entry (root, uri, g_variant_ref_sink (g_variant_builder_end (&builder)));
+
+		g_variant_unref (new_values);
+	}
+	g_mutex_unlock (&index->mutex);
+	g_free (uri);
+
+	index_queue_save (index);
+}
+
+
+static gboolean refresh_roots_cb (gpointer user_data);
+
+
+GthSearchIndex *
+gth_search_index_get_default (void)
+{
+	static GthSearchIndex *index = NULL;
+	GFile                 *directory;
+	GthMonitor            *monitor;
+
+	if (index != NULL)
+		return index;
+
+	index = g_new0 (GthSearchIndex, 1);
+	g_mutex_init (&index->mutex);
+	directory = gth_user_dir_get_dir_for_write (GTH_DIR_CACHE, PIX_DIR, INDEX_DIR, NULL);
+	index->directory = g_file_get_path (directory);
+	index->roots = NULL;
+	index->matcher = g_file_attribute_matcher_new (INDEX_ATTRIBUTES);
+	index->save_id = 0;
+	index->refresh_queue = NULL;
+	index->refreshing = FALSE;
+	index_load_roots (index);
+
+	monitor = gth_main_get_default_monitor ();
+	g_signal_connect (monitor,
+			  "folder-changed",
+			  G_CALLBACK (monitor_folder_changed_cb),
+			  index);
+	g_signal_connect (monitor,
+			  "file-renamed",
+			  G_CALLBACK (monitor_file_renamed_cb),
+			  index);
+	g_signal_connect (monitor,
+			  "metadata-changed",
+			  G_CALLBACK (monitor_metadata_changed_cb),
+			  index);
+
+	/* the files changed outside the application are not notified by the
+	 * monitor. */
+
+	g_timeout_add_seconds_full (G_PRIORITY_LOW,
+				    REFRESH_INTERVAL,
+				    refresh_roots_cb,
+				    index,
+				    NULL);
+
+	g_object_unref (directory);
+
+	return index;
+}
+
+
+const char *
+gth_search_index_get_attributes (void)
+{
+	return INDEX_ATTRIBUTES;
+}
+
+
+/* Whether all the attributes read by @test are in @attributes. */
+static gboolean
+test_attributes_match (GthTest    *test,
+		       const char *attributes)
+{
+	GFileAttributeMatcher  *matcher;
+	char                  **attributes_v;
+	gboolean                result;
+	int                     i;
+
+	matcher = g_file_attribute_matcher_new (attributes);
+	attributes_v = g_strsplit (gth_test_get_attributes (test), ",", -1);
+	result = TRUE;
+	for (i = 0; result && (attributes_v[i] != NULL); i++) {
+		char *attribute = g_strstrip (attributes_v[i]);
+
+		if ((attribute[0] != '\0') && ! g_file_attribute_matcher_matches (matcher, attribute))
+			result = FALSE;
+	}
+
+	g_strfreev (attributes_v);
+	g_file_attribute_matcher_unref (matcher);
+
+	return result;
+}
+
+
+gboolean
+gth_search_index_can_search (GthSearchIndex *index,
+			     GFile          *folder,
+			     gboolean        recursive,
+			     gboolean        show_hidden,
+			     GthTest        *test)
+{
+	char     *uri;
+	gboolean  result;
+
+	if (! test_attributes_match (test, SEARCHABLE_ATTRIBUTES))
+		return FALSE;
+
+	uri = g_file_get_uri (folder);
+	g_mutex_lock (&index->mutex);
+	result = index_get_root (index, uri, recursive, show_hidden) != NULL;
+	g_mutex_unlock (&index->mutex);
+	g_free (uri);
+
+	return result;
+}
+
+
+/* The attributes of the index are read from the metadata of the files,
+ * building the index while searching is worth only if @test reads the
+ * metadata as well. */
+gboolean
+gth_search_index_should_build (GthTest *test)
+{
+	return ! test_attributes_match (test, FILE_ATTRIBUTES);
+}
+
+
+/* -- gth_search_index_search_async -- */
+
+
+typedef struct {
+	char   *uri;
+	gint64  time;
+} FolderTime;
+
+
+static FolderTime *
+folder_time_new (const char *uri,
+		 gint64      time)
+{
+	FolderTime *folder_time;
+
+	folder_time = g_new (FolderTime, 1);
+	folder_time->uri = g_strdup (uri);
+	folder_time->time = time;
+
+	return folder_time;
+}
+
+
+static void
+folder_time_free (FolderTime *folder_time)
+{
+	g_free (folder_time->uri);
+	g_free (folder_time);
+}
+
+
+/* The same data is used to refresh a root in the background, without a
+ * test. */
+typedef struct {
+	GthSearchIndex *index;
+	char           *uri;
+	gboolean        recursive;
+	gboolean        show_hidden;
+	GthTest        *test;
+	GList          *changed_folders;	/* FolderTime items */
+	GList          *files_to_read;		/* GFile items */
+} SearchData;
+
+
+static SearchData *
+search_data_new (GthSearchIndex *index,
+		 const char     *uri,
+		 gboolean        recursive,
+		 gboolean        show_hidden,
+		 GthTest        *test)
+{
+	SearchData *search_data;
+
+	search_data = g_new0 (SearchData, 1);
+	search_data->index = index;
+	search_data->uri = g_strdup (uri);
+	search_data->recursive = recursive;
+	search_data->show_hidden = show_hidden;
+	search_data->test = _g_object_ref (test);
+	search_data->changed_folders = NULL;
+	search_data->files_to_read = NULL;
+
+	return search_data;
+}
+
+
+static void
+search_data_free (SearchData *search_data)
+{
+	g_list_free_full (search_data->changed_folders, (GDestroyNotify) folder_time_free);
+	_g_object_list_unref (search_data->files_to_read);
+	_g_object_unref (search_data->test);
+	g_free (search_data->uri);
+	g_free (search_data);
+}
+
+
+/* Returns a tag that all the files matching @test must have, if any. */
+static const char *
+get_required_tag (GthTest *test)
+{
+	const char *tag = NULL;
+
+	if (GTH_IS_TEST_CATEGORY (test)) {
+		GthTestOp   op;
+		gboolean    negative;
+		const char *value;
+
+		gth_test_category_get (GTH_TEST_CATEGORY (test), &op, &negative, &value);
+		if (((op == GTH_TEST_OP_CONTAINS) || (op == GTH_TEST_OP_CONTAINS_ONLY))
+		    && ! negative
+		    && (value != NULL)
+		    && is_tag_attribute (gth_test_get_attributes (test)))
+		{
+			tag = value;
+		}
+	}
+	else if (GTH_IS_TEST_CHAIN (test)
+		 && (gth_test_chain_get_match_type (GTH_TEST_CHAIN (test)) == GTH_MATCH_TYPE_ALL))
+	{
+		GList *tests;
+		GList *scan;
+
+		tests = gth_test_chain_get_tests (GTH_TEST_CHAIN (test));
+		for (scan = tests; (tag == NULL) && scan; scan = scan->next)
+			tag = get_required_tag (scan->data);
+		_g_object_list_unref (tests);
+	}
+
+	return tag;
+}
+
+
+typedef struct {
+	char     *uri;
+	GVariant *values;
+} Candidate;
+
+
+static void
+candidate_free (Candidate *candidate)
+{
+	g_variant_unref (candidate->values);
+	g_free (candidate->uri);
+	g_free (candidate);
+}
+
+
+/* Copies the entries that can match, to release the lock before testing
+ * them. */
+static GList *
+get_candidates (IndexRoot  *root,
+		SearchData *search_data)
+{
+	GList          *candidates = NULL;
+	const char     *tag;
+	GHashTable     *uris;
+	GHashTableIter  iter;
+	gpointer        key;
+
+	uris = root->entries;
+	tag = get_required_tag (search_data->test);
+	if (tag != NULL) {
+		char *tag_key;
+
+		tag_key = get_tag_key (tag);
+		uris = g_hash_table_lookup (root->tags, tag_key);
+		g_free (tag_key);
+
+		if (uris == NULL)
+			return NULL;
+	}
+
+	g_hash_table_iter_init (&iter, uris);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		Candidate *candidate;
+
+		if (! uri_is_inside (key, search_data->uri, search_data->recursive, search_data->show_hidden))
+			continue;
+
+		candidate = g_new (Candidate, 1);
+		candidate->uri = g_strdup (key);
+		candidate->values = g_variant_ref (g_hash_table_lookup (root->entries, key));
+		candidates = g_list_prepend (candidates, candidate);
+	}
+
+	return candidates;
+}
+
+
+static void
+search_thread (GTask        *task,
+	       gpointer      source_object,
+	       gpointer      task_data,
+	       GCancellable *cancellable)
+{
+	SearchData *search_data = task_data;
+	IndexRoot  *root;
+	GList      *candidates;
+	GList      *files;
+	GList      *scan;
+	int         n;
+
+	g_mutex_lock (&search_data->index->mutex);
+	root = index_get_root (search_data->index,
+			       search_data->uri,
+			       search_data->recursive,
+			       search_data->show_hidden);
+	if (root == NULL) {
+		g_mutex_unlock (&search_data->index->mutex);
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "The folder is not indexed");
+		return;
+	}
+	index_root_load (root);
+	candidates = get_candidates (root, search_data);
+	g_mutex_unlock (&search_data->index->mutex);
+
+	files = NULL;
+	for (scan = candidates, n = 0; scan; scan = scan->next, n++) {
+		Candidate   *candidate = scan->data;
+		GFile       *file;
+		GFileInfo   *info;
+		GVariantIter iter;
+		const char  *attribute;
+		GVariant    *value;
+		GthFileData *file_data;
+
+		if ((n % CANCELLED_CHECK_INTERVAL == 0) && g_cancellable_is_cancelled (cancellable))
+			break;
+
+		info = g_file_info_new ();
+		g_variant_iter_init (&iter, candidate->values);
+		while (g_variant_iter_next (&iter, "{&s@(yv)}", &attribute, &value)) {
+			_g_file_info_set_attribute_from_variant (info, attribute, value);
+			g_variant_unref (value);
+		}
+
+		file = g_file_new_for_uri (candidate->uri);
+		file_data = gth_file_data_new (file, info);
+		if (gth_test_match (search_data->test, file_data))
+			files = g_list_prepend (files, g_object_ref (file_data));
+
+		g_object_unref (file_data);
+		g_object_unref (file);
+		g_object_unref (info);
+	}
+	g_list_free_full (candidates, (GDestroyNotify) candidate_free);
+
+	if (g_task_return_error_if_cancelled (task)) {
+		_g_object_list_unref (files);
+		return;
+	}
+
+	g_task_return_pointer (task, g_list_reverse (files), (GDestroyNotify) _g_object_list_unref);
+}
+
+
+/* Compares the modification time of the indexed folders with the saved
+ * one, the changed folders are read again, the new sub-folders are read
+ * recursively. */
+static void
+check_folders_thread (GTask        *task,
+		      gpointer      source_object,
+		      gpointer      task_data,
+		      GCancellable *cancellable)
+{
+	GTask          *search_task = task_data;
+	SearchData     *search_data = g_task_get_task_data (search_task);
+	IndexRoot      *root;
+	gboolean        recursive_root;
+	GList          *folders;
+	GHashTable     *known_folders;
+	GHashTableIter  iter;
+	gpointer        key;
+	gpointer        value;
+	GList          *removed;
+	GList          *scan;
+
+	folders = NULL;
+	known_folders = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	recursive_root = FALSE;
+
+	g_mutex_lock (&search_data->index->mutex);
+	root = index_get_root (search_data->index,
+			       search_data->uri,
+			       search_data->recursive,
+			       search_data->show_hidden);
+	if (root != NULL) {
+		recursive_root = root->recursive;
+		g_hash_table_iter_init (&iter, root->folders);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			g_hash_table_add (known_folders, g_strdup (key));
+			if ((strcmp (key, search_data->uri) == 0)
+			    || uri_is_inside (key, search_data->uri, search_data->recursive, search_data->show_hidden))
+			{
+				folders = g_list_prepend (folders, folder_time_new (key, *((gint64 *) value)));
+			}
+		}
+	}
+	g_mutex_unlock (&search_data->index->mutex);
+
+	removed = NULL;
+	for (scan = folders; scan; scan = scan->next) {
+		FolderTime      *folder_time = scan->data;
+		GFile           *folder;
+		GFileInfo       *info;
+		GFileEnumerator *enumerator;
+		GFileInfo       *child_info;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			break;
+
+		folder = g_file_new_for_uri (folder_time->uri);
+		info = g_file_query_info (folder, FOLDER_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, cancellable, NULL);
+		if ((info == NULL) || (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY)) {
+			removed = g_list_prepend (removed, g_strdup (folder_time->uri));
+		}
+		else if ((folder_time->time == 0) || (get_modification_time (info) != folder_time->time)) {
+			enumerator = g_file_enumerate_children (folder,
+								"standard::name," FOLDER_ATTRIBUTES,
+								G_FILE_QUERY_INFO_NONE,
+								cancellable,
+								NULL);
+			if (enumerator != NULL) {
+				while ((child_info = g_file_enumerator_next_file (enumerator, cancellable, NULL)) != NULL) {
+					GFile *child;
+					char  *child_uri;
+
+					child = g_file_get_child (folder, g_file_info_get_name (child_info));
+					child_uri = g_file_get_uri (child);
+					if (! search_data->show_hidden && g_file_info_get_is_hidden (child_info)) {
+						/* void */
+					}
+					else if (g_file_info_get_file_type (child_info) == G_FILE_TYPE_REGULAR) {
+						search_data->files_to_read = g_list_prepend (search_data->files_to_read, g_object_ref (child));
+					}
+					else if ((g_file_info_get_file_type (child_info) == G_FILE_TYPE_DIRECTORY)
+						 && recursive_root
+						 && ! g_hash_table_contains (known_folders, child_uri))
+					{
+						search_data->files_to_read = g_list_prepend (search_data->files_to_read, g_object_ref (child));
+					}
+
+					g_free (child_uri);
+					g_object_unref (child);
+					g_object_unref (child_info);
+				}
+				g_object_unref (enumerator);
+
+				search_data->changed_folders = g_list_prepend (search_data->changed_folders,
+									       folder_time_new (folder_time->uri, get_modification_time (info)));
+			}
+		}
+
+		_g_object_unref (info);
+		g_object_unref (folder);
+	}
+	search_data->files_to_read = g_list_reverse (search_data->files_to_read);
+
+	if (removed != NULL) {
+		g_mutex_lock (&search_data->index->mutex);
+		for (scan = removed; scan; scan = scan->next)
+			index_remove_uri (search_data->index, scan->data);
+		g_mutex_unlock (&search_data->index->mutex);
+	}
+
+	_g_string_list_free (removed);
+	g_hash_table_unref (known_folders);
+	g_list_free_full (folders, (GDestroyNotify) folder_time_free);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+
+/* Replaces the files of the changed folders with @files. */
+static void
+index_update_folders (SearchData *search_data,
+		      GList      *files)
+{
+	GthSearchIndex *index = search_data->index;
+	IndexRoot      *root;
+	GHashTableIter  iter;
+	gpointer        key;
+	GList          *removed;
+	GList          *scan;
+
+	g_mutex_lock (&index->mutex);
+
+	root = index_get_root (index,
+			       search_data->uri,
+			       search_data->recursive,
+			       search_data->show_hidden);
+	if (root == NULL) {
+		g_mutex_unlock (&index->mutex);
+		return;
+	}
+
+	index_root_load (root);
+
+	removed = NULL;
+	g_hash_table_iter_init (&iter, root->entries);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		for (scan = search_data->changed_folders; scan; scan = scan->next) {
+			FolderTime *folder_time = scan->data;
+
+			if (uri_is_inside (key, folder_time->uri, FALSE, TRUE)) {
+				removed = g_list_prepend (removed, g_strdup (key));
+				break;
+			}
+		}
+	}
+	for (scan = removed; scan; scan = scan->next)
+		index_root_remove_entry (root, scan->data);
+	_g_string_list_free (removed);
+
+	for (scan = files; scan; scan = scan->next) {
+		GthFileData *file_data = scan->data;
+		char        *uri;
+
+		uri = g_file_get_uri (file_data->file);
+		if (g_file_info_get_file_type (file_data->info) == G_FILE_TYPE_REGULAR)
+			index_root_set_entry (root, uri, index_get_values (index, file_data->info));
+		else if (g_file_info_get_file_type (file_data->info) == G_FILE_TYPE_DIRECTORY)
+			index_root_set_folder (root, uri, get_modification_time (file_data->info));
+		g_free (uri);
+	}
+
+	for (scan = search_data->changed_folders; scan; scan = scan->next) {
+		FolderTime *folder_time = scan->data;
+		index_root_set_folder (root, folder_time->uri, folder_time->time);
+	}
+
+	g_mutex_unlock (&index->mutex);
+
+	index_queue_save (index);
+}
+
+
+/* Searches the updated index, or ends the refresh if there is no test. */
+static void
+index_task_complete (GTask *search_task)
+{
+	SearchData *search_data = g_task_get_task_data (search_task);
+
+	if (search_data->test != NULL)
+		g_task_run_in_thread (search_task, search_thread);
+	else
+		g_task_return_boolean (search_task, TRUE);
+}
+
+
+static void
+read_files_ready_cb (GList    *files,
+		     GError   *error,
+		     gpointer  user_data)
+{
+	GTask      *search_task = user_data;
+	SearchData *search_data = g_task_get_task_data (search_task);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_task_return_error (search_task, g_error_copy (error));
+		g_object_unref (search_task);
+		return;
+	}
+
+	/* if the files cannot be read the folders are checked again the
+	 * next time. */
+
+	if (error == NULL)
+		index_update_folders (search_data, files);
+
+	index_task_complete (search_task);
+	g_object_unref (search_task);
+}
+
+
+static void
+check_folders_ready_cb (GObject      *source_object,
+			GAsyncResult *result,
+			gpointer      user_data)
+{
+	GTask        *search_task = user_data;
+	SearchData   *search_data = g_task_get_task_data (search_task);
+	GthListFlags  flags;
+
+	if (g_task_return_error_if_cancelled (search_task))
+		return;
+
+	if (search_data->files_to_read == NULL) {
+		if (search_data->changed_folders != NULL)
+			index_update_folders (search_data, NULL);
+		index_task_complete (search_task);
+		return;
+	}
+
+	flags = GTH_LIST_RECURSIVE;
+	if (! search_data->show_hidden)
+		flags |= GTH_LIST_NO_HIDDEN_FILES;
+	_g_query_all_metadata_async (search_data->files_to_read,
+				     flags,
+				     INDEX_ATTRIBUTES,
+				     g_task_get_cancellable (search_task),
+				     read_files_ready_cb,
+				     g_object_ref (search_task));
+}
+
+
+/* Reads again the folders of the task root that changed, then completes
+ * @search_task. */
+static void
+index_check_folders (GTask *search_task)
+{
+	GTask *check_task;
+
+	check_task = g_task_new (NULL,
+				 g_task_get_cancellable (search_task),
+				 check_folders_ready_cb,
+				 search_task);
+	g_task_set_task_data (check_task, g_object_ref (search_task), g_object_unref);
+	g_task_run_in_thread (check_task, check_folders_thread);
+
+	g_object_unref (check_task);
+}
+
+
+void
+gth_search_index_search_async (GthSearchIndex      *index,
+			       GFile               *folder,
+			       gboolean             recursive,
+			       gboolean             show_hidden,
+			       GthTest             *test,
+			       GCancellable        *cancellable,
+			       GAsyncReadyCallback  callback,
+			       gpointer             user_data)
+{
+	char       *uri;
+	SearchData *search_data;
+	GTask      *task;
+
+	uri = g_file_get_uri (folder);
+	search_data = search_data_new (index, uri, recursive, show_hidden, test);
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_task_data (task, search_data, (GDestroyNotify) search_data_free);
+
+	/* the folders changed since they were indexed are read again before
+	 * searching. */
+
+	index_check_folders (task);
+
+	g_object_unref (task);
+	g_free (uri);
+}
+
+
+GList *
+gth_search_index_search_finish (GAsyncResult  *result,
+				GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+
+/* -- background refresh -- */
+
+
+static void refresh_next_root (GthSearchIndex *index);
+
+
+static void
+refresh_root_ready_cb (GObject      *source_object,
+		       GAsyncResult *result,
+		       gpointer      user_data)
+{
+	refresh_next_root ((GthSearchIndex *) user_data);
+}
+
+
+static void
+refresh_next_root (GthSearchIndex *index)
+{
+	SearchData *search_data;
+	GTask      *task;
+
+	if (index->refresh_queue == NULL) {
+		index->refreshing = FALSE;
+		return;
+	}
+
+	search_data = index->refresh_queue->data;
+	index->refresh_queue = g_list_delete_link (index->refresh_queue, index->refresh_queue);
+
+	task = g_task_new (NULL, NULL, refresh_root_ready_cb, index);
+	g_task_set_task_data (task, search_data, (GDestroyNotify) search_data_free);
+	index_check_folders (task);
+
+	g_object_unref (task);
+}
+
+
+/* The indexed roots are checked one at a time, as a search does, to read
+ * again the folders changed outside the application even if no search is
+ * done. */
+static gboolean
+refresh_roots_cb (gpointer user_data)
+{
+	GthSearchIndex *index = user_data;
+	GList          *scan;
+
+	if (index->refreshing)
+		return G_SOURCE_CONTINUE;
+
+	g_mutex_lock (&index->mutex);
+	for (scan = index->roots; scan; scan = scan->next) {
+		IndexRoot *root = scan->data;
+
+		if (index_root_is_expired (root))
+			continue;
+
+		index->refresh_queue = g_list_prepend (index->refresh_queue,
+						       search_data_new (index,
+									root->uri,
+									root->recursive,
+									root->show_hidden,
+									NULL));
+	}
+	g_mutex_unlock (&index->mutex);
+
+	index->refreshing = TRUE;
+	refresh_next_root (index);
+
+	return G_SOURCE_CONTINUE;
+}
+
+
+void
+gth_search_index_flush (GthSearchIndex *index)
+{
+	GList *scan;
+
+	if (index->save_id != 0) {
+		g_source_remove (index->save_id);
+		index->save_id = 0;
+	}
+
+	g_mutex_lock (&index->mutex);
+	for (scan = index->roots; scan; scan = scan->next) {
+		IndexRoot *root = scan->data;
+
+		if (root->dirty)
+			index_root_save (root);
+	}
+	g_mutex_unlock (&index->mutex);
+}
+
+
+/* -- GthSearchIndexBuild -- */
+
+
+GthSearchIndexBuild *
+gth_search_index_build_new (GthSearchIndex *index,
+			    GFile          *folder,
+			    gboolean        recursive,
+			    gboolean        show_hidden)
+{
+	GthSearchIndexBuild *build;
+	char                *uri;
+
+	uri = g_file_get_uri (folder);
+	build = g_new0 (GthSearchIndexBuild, 1);
+	build->index = index;
+	build->root = index_root_new (index,
+				      uri,
+				      recursive,
+				      show_hidden,
+				      g_get_real_time () / G_USEC_PER_SEC);
+
+	g_free (uri);
+
+	return build;
+}
+
+
+void
+gth_search_index_build_add (GthSearchIndexBuild *build,
+			    GFile               *file,
+			    GFileInfo           *info)
+{
+	char *uri;
+
+	uri = g_file_get_uri (file);
+	index_root_set_entry (build->root, uri, index_get_values (build->index, info));
+	g_free (uri);
+}
+
+
+void
+gth_search_index_build_add_folder (GthSearchIndexBuild *build,
+				   GFile               *folder,
+				   GFileInfo           *info)
+{
+	char *uri;
+
+	uri = g_file_get_uri (folder);
+	index_root_set_folder (build->root, uri, get_modification_time (info));
+	g_free (uri);
+}
+
+
+void
+gth_search_index_build_free (GthSearchIndexBuild *build,
+			     gboolean             commit)
+{
+	GthSearchIndex *index = build->index;
+	IndexRoot      *new_root = build->root;
+	GList          *scan;
+
+	if (! commit) {
+		index_root_free (new_root);
+		g_free (build);
+		return;
+	}
+
+	/* the new root replaces the roots it contains. */
+
+	g_mutex_lock (&index->mutex);
+	for (scan = index->roots; scan; /* void */) {
+		IndexRoot *root = scan->data;
+
+		scan = scan->next;
+
+		if ((root->show_hidden == new_root->show_hidden)
+		    && (new_root->recursive || ! root->recursive)
+		    && ((strcmp (root->uri, new_root->uri) == 0)
+			|| (new_root->recursive && uri_is_inside (root->uri, new_root->uri, TRUE, TRUE))))
+		{
+			index_remove_root (index, root);
+		}
+	}
+	index->roots = g_list_prepend (index->roots, new_root);
+	index_root_save (new_root);
+	g_mutex_unlock (&index->mutex);
+
+	g_free (build);
+}
@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTH_SEARCH_INDEX_H
+#define GTH_SEARCH_INDEX_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <pix.h>
+
+G_BEGIN_DECLS
+
+/* Persistent index of the attributes used by the common searches (names,
+ * sizes, dates, tags, comments, camera model and image size).  A folder
+ * is indexed the first time it is searched with a test that reads the
+ * metadata, the index is kept up to date with the events of the default
+ * monitor, the folders modified outside the application are read again
+ * periodically and before searching, and the index expires after some
+ * days. */
+
+typedef struct _GthSearchIndex      GthSearchIndex;
+typedef struct _GthSearchIndexBuild GthSearchIndexBuild;
+
+GthSearchIndex *      gth_search_index_get_default    (void);
+const char *          gth_search_index_get_attributes (void);
+gboolean              gth_search_index_should_build   (GthTest              *test);
+gboolean              gth_search_index_can_search     (GthSearchIndex       *index,
+						       GFile                *folder,
+						       gboolean              recursive,
+						       gboolean              show_hidden,
+						       GthTest              *test);
+void                  gth_search_index_search_async   (GthSearchIndex       *index,
+						       GFile                *folder,
+						       gboolean              recursive,
+						       gboolean              show_hidden,
+						       GthTest              *test,
+						       GCancellable         *cancellable,
+						       GAsyncReadyCallback   callback,
+						       gpointer              user_data);
+GList *               gth_search_index_search_finish  (GAsyncResult         *result,
+						       GError              **error);
+void                  gth_search_index_flush          (GthSearchIndex       *index);
+
+/* Index building, used while crawling a folder. */
+
+GthSearchIndexBuild * gth_search_index_build_new      (GthSearchIndex       *index,
+						       GFile                *folder,
+						       gboolean              recursive,
+						       gboolean              show_hidden);
+void                  gth_search_index_build_add      (GthSearchIndexBuild  *build,
+						       GFile                *file,
+						       GFileInfo            *info);
+void                  gth_search_index_build_add_folder
+						      (GthSearchIndexBuild  *build,
+						       GFile                *folder,
+						       GFileInfo            *info);
+void                  gth_search_index_build_free     (GthSearchIndexBuild  *build,
+						       gboolean              commit);
+
+G_END_DECLS
+
+#endif /* GTH_SEARCH_INDEX_H */
@@ -24,24 +24,27 @@
 #include <glib/gi18n.h>
 #include <pix.h>
 #include <extensions/catalogs/gth-catalog.h>
+#include "gth-search-index.h"
 #include "gth-search-source.h"
 #include "gth-search-task.h"
 
 
 struct _GthSearchTaskPrivate {
-	GthBrowser    *browser;
-	GthSearch     *search;
-	GthTestChain  *test;
-	GFile         *search_catalog;
-	gboolean       show_hidden_files;
-	gboolean       io_operation;
-	GError        *error;
-	gulong         location_ready_id;
-	GtkWidget     *dialog;
-	GthFileSource *file_source;
-	gsize          n_files;
-	GList         *current_location;
-	gulong         info_bar_response_id;
+	GthBrowser           *browser;
+	GthSearch            *search;
+	GthTestChain         *test;
+	GFile                *search_catalog;
+	gboolean              show_hidden_files;
+	gboolean              use_index;
+	GthSearchIndexBuild  *index_build;
+	gboolean              io_operation;
+	GError               *error;
+	gulong                location_ready_id;
+	GtkWidget            *dialog;
+	GthFileSource        *file_source;
+	gsize                 n_files;
+	GList                *current_location;
+	gulong                info_bar_response_id;
 };
 
 
@@ -66,6 +69,8 @@ gth_search_task_finalize (GObject *object)
 
 	task = GTH_SEARCH_TASK (object);
 
+	if (task->priv->index_build != NULL)
+		gth_search_index_build_free (task->priv->index_build, FALSE);
 	_g_object_unref (task->priv->file_source);
 	_g_object_unref (task->priv->search);
 	_g_object_unref (task->priv->test);
@@ -160,6 +165,11 @@ done_func (GObject  *object,
 {
 	GthSearchTask *task = user_data;
 
+	if (task->priv->index_build != NULL) {
+		gth_search_index_build_free (task->priv->index_build, error == NULL);
+		task->priv->index_build = NULL;
+	}
+
 	task->priv->error = NULL;
 	if (error != NULL) {
 		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
@@ -207,6 +217,9 @@ for_each_file_func (GFile     *file,
 	if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR)
 		return;
 
+	if (task->priv->index_build != NULL)
+		gth_search_index_build_add (task->priv->index_build, file, info);
+
 	file_data = gth_file_data_new (file, info);
 
 	if (gth_test_match (GTH_TEST (task->priv->test), file_data)
@@ -254,6 +267,9 @@ start_dir_func (GFile      *directory,
 	if (! file_is_visible (task, info))
 		return DIR_OP_SKIP;
 
+	if (task->priv->index_build != NULL)
+		gth_search_index_build_add_folder (task->priv->index_build, directory, info);
+
 	uri = g_file_get_parse_name (directory);
 	text = g_strdup_printf ("Searching in %s", uri);
 	gth_info_bar_set_primary_text (GTH_INFO_BAR (task->priv->dialog), text);
@@ -265,11 +281,57 @@ start_dir_func (GFile      *directory,
 }
 
 
+static void
+search_index_ready_cb (GObject      *source_object,
+		       GAsyncResult *result,
+		       gpointer      user_data)
+{
+	GthSearchTask *task = user_data;
+	GList         *files;
+	GError        *error = NULL;
+	GList         *file_list;
+	GList         *scan;
+
+	files = gth_search_index_search_finish (result, &error);
+	if (error != NULL) {
+		done_func (NULL, error, task);
+		return;
+	}
+
+	file_list = NULL;
+	for (scan = files; scan; scan = scan->next) {
+		GthFileData *file_data = scan->data;
+
+		if (gth_catalog_insert_file (GTH_CATALOG (task->priv->search), file_data->file, -1)) {
+			task->priv->n_files++;
+			file_list = g_list_prepend (file_list, file_data->file);
+		}
+	}
+	file_list = g_list_reverse (file_list);
+
+	if (file_list != NULL) {
+		update_secondary_text (task);
+		gth_monitor_folder_changed (gth_main_get_default_monitor (),
+					    task->priv->search_catalog,
+					    file_list,
+					    GTH_MONITOR_EVENT_CREATED);
+	}
+
+	g_list_free (file_list);
+	_g_object_list_unref (files);
+
+	done_func (NULL, NULL, task);
+}
+
+
 static void
 _gth_search_task_search_current_location (GthSearchTask *task)
 {
 	GthSearchSource *search_location;
 	GSettings       *settings;
+	GthSearchIndex  *index;
+	GFile           *folder;
+	gboolean         recursive;
 	GString         *attributes;
 	const char      *test_attributes;
 
@@ -283,7 +345,44 @@ _gth_search_task_search_current_location (GthSearchTask *task)
 	task->priv->show_hidden_files = g_settings_get_boolean (settings, PREF_BROWSER_SHOW_HIDDEN_FILES);
 
 	search_location = GTH_SEARCH_SOURCE (task->priv->current_location->data);
-	task->priv->file_source = gth_main_get_file_source (gth_search_source_get_folder (search_location));
+	folder = gth_search_source_get_folder (search_location);
+	recursive = gth_search_source_is_recursive (search_location);
+
+	/* use the index if the folder was already searched, otherwise
+	 * index the folder while searching, if the metadata is read
+	 * anyway. */
+
+	index = gth_search_index_get_default ();
+	if (task->priv->use_index
+	    && gth_search_index_can_search (index,
+					    folder,
+					    recursive,
+					    task->priv->show_hidden_files,
+					    GTH_TEST (task->priv->test)))
+	{
+		gth_info_bar_set_primary_text (GTH_INFO_BAR (task->priv->dialog), _("Searching…"));
+		task->priv->io_operation = TRUE;
+		gth_search_index_search_async (index,
+					       folder,
+					       recursive,
+					       task->priv->show_hidden_files,
+					       GTH_TEST (task->priv->test),
+					       gth_task_get_cancellable (GTH_TASK (task)),
+					       search_index_ready_cb,
+					       task);
+
+		g_object_unref (settings);
+		return;
+	}
+
+	if (gth_search_index_should_build (GTH_TEST (task->priv->test)))
+		task->priv->index_build = gth_search_index_build_new (index,
+								      folder,
+								      recursive,
+								      task->priv->show_hidden_files);
+
+	_g_object_unref (task->priv->file_source);
+	task->priv->file_source = gth_main_get_file_source (folder);
 	gth_file_source_set_cancellable (task->priv->file_source, gth_task_get_cancellable (GTH_TASK (task)));
 
 	attributes = g_string_new (g_settings_get_boolean (settings, PREF_BROWSER_FAST_FILE_TYPE) ? GFILE_STANDARD_ATTRIBUTES_WITH_FAST_CONTENT_TYPE : GFILE_STANDARD_ATTRIBUTES_WITH_CONTENT_TYPE);
@@ -292,11 +391,15 @@ _gth_search_task_search_current_location (GthSearchTask *task)
 		g_string_append (attributes, ",");
 		g_string_append (attributes, test_attributes);
 	}
+	if (task->priv->index_build != NULL) {
+		g_string_append (attributes, ",");
+		g_string_append (attributes, gth_search_index_get_attributes ());
+	}
 
 	task->priv->io_operation = TRUE;
 	gth_file_source_for_each_child (task->priv->file_source,
-					gth_search_source_get_folder (search_location),
-					gth_search_source_is_recursive (search_location),
+					folder,
+					recursive,
 					attributes->str,
 					start_dir_func,
 					for_each_file_func,
@@ -486,6 +589,8 @@ gth_search_task_init (GthSearchTask *task)
 	task->priv->test = NULL;
 	task->priv->search_catalog = NULL;
 	task->priv->show_hidden_files = FALSE;
+	task->priv->use_index = TRUE;
+	task->priv->index_build = NULL;
 	task->priv->io_operation = FALSE;
 	task->priv->error = NULL;
 	task->priv->location_ready_id = 0;
@@ -522,3 +627,11 @@ gth_search_task_get_catalog (GthSearchTask *task)
 	g_return_val_if_fail (GTH_IS_SEARCH_TASK (task), NULL);
 	return task->priv->search_catalog;
 }
+
+
+void
+gth_search_task_set_use_index (GthSearchTask *task,
+			       gboolean       use_index)
+{
+	task->priv->use_index = use_index;
+}
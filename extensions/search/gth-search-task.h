@@ -53,5 +53,8 @@ GthTask *   gth_search_task_new          (GthBrowser     *browser,
 					  GthSearch      *search,
 					  GFile          *search_catalog);
 GFile *     gth_search_task_get_catalog  (GthSearchTask  *task);
+void        gth_search_task_set_use_index
+					 (GthSearchTask  *task,
+					  gboolean        use_index);
 
 #endif /* GTH_SEARCH_TASK_H */
@@ -99,6 +99,7 @@ gth_metadata_provider_selections_class_init (GthMetadataProviderSelectionsClass
 	mp_class->can_write = gth_metadata_provider_selections_can_write;
 	mp_class->read = gth_metadata_provider_selections_read;
 	mp_class->write = gth_metadata_provider_selections_write;
+	mp_class->cacheable = FALSE;
 }
 
 
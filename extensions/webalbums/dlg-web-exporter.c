@@ -111,6 +111,7 @@ ok_clicked_cb (GtkWidget  *widget,
 
 	g_settings_set_boolean (data->settings, PREF_WEBALBUMS_COPY_IMAGES, gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (GET_WIDGET ("copy_images_checkbutton"))));
 	g_settings_set_boolean (data->settings, PREF_WEBALBUMS_RESIZE_IMAGES, gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (GET_WIDGET ("resize_images_checkbutton"))));
+	g_settings_set_boolean (data->settings, PREF_WEBALBUMS_INCREMENTAL, gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (GET_WIDGET ("incremental_checkbutton"))));
 
 	i_value = gtk_combo_box_get_active (GTK_COMBO_BOX (GET_WIDGET ("resize_images_combobox")));
 	g_settings_set_int (data->settings, PREF_WEBALBUMS_RESIZE_WIDTH, ImageSizeValues[i_value].width);
@@ -195,6 +196,8 @@ ok_clicked_cb (GtkWidget  *widget,
 					    g_settings_get_boolean (data->settings, PREF_WEBALBUMS_RESIZE_IMAGES),
 					    g_settings_get_int (data->settings, PREF_WEBALBUMS_RESIZE_WIDTH),
 					    g_settings_get_int (data->settings, PREF_WEBALBUMS_RESIZE_HEIGHT));
+	gth_web_exporter_set_incremental (GTH_WEB_EXPORTER (task),
+					  g_settings_get_boolean (data->settings, PREF_WEBALBUMS_INCREMENTAL));
 
 	s_value = g_settings_get_string (data->settings, PREF_WEBALBUMS_SORT_TYPE);
 	sort_type = gth_main_get_sort_type (s_value);
@@ -559,6 +562,8 @@ dlg_web_exporter (GthBrowser *browser,
 				      g_settings_get_boolean (data->settings, PREF_WEBALBUMS_COPY_IMAGES));
 	gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (GET_WIDGET ("resize_images_checkbutton")),
 				      g_settings_get_boolean (data->settings, PREF_WEBALBUMS_RESIZE_IMAGES));
+	gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (GET_WIDGET ("incremental_checkbutton")),
+				      g_settings_get_boolean (data->settings, PREF_WEBALBUMS_INCREMENTAL));
 	gtk_spin_button_set_value (GTK_SPIN_BUTTON (GET_WIDGET ("images_per_index_spinbutton")), g_settings_get_int (data->settings, PREF_WEBALBUMS_IMAGES_PER_INDEX));
 	gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (GET_WIDGET ("single_index_checkbutton")),
 				      g_settings_get_boolean (data->settings, PREF_WEBALBUMS_SINGLE_INDEX));
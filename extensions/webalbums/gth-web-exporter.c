@@ -67,14 +67,12 @@ extern GFileInputStream *yy_istream;
 typedef struct {
 	GthFileData *file_data;
 	char        *dest_filename;
-	GthImage    *image;
 	int          image_width, image_height;
-	GthImage    *thumb;
 	int          thumb_width, thumb_height;
-	GthImage    *preview;
 	int          preview_width, preview_height;
 	gboolean     caption_set;
 	gboolean     no_preview;
+	gboolean     reused;
 } ImageData;
 
 
@@ -148,6 +146,9 @@ struct _GthWebExporterPrivate {
 	GFile             *tmp_dir;
 	GthImageLoader    *iloader;
 	GList             *current_file;          /* Next file to be loaded. */
+	int                n_active_jobs;
+	int                requested_size;
+	GError            *pipeline_error;
 	int                n_images;              /* Used for the progress signal. */
 	int                n_pages;
 	int                image;
@@ -161,6 +162,11 @@ struct _GthWebExporterPrivate {
 	GError            *error;
 	gboolean           interrupted;
 	GDateTime         *timestamp;
+	gboolean           incremental;
+	GKeyFile          *manifest;
+	GKeyFile          *old_manifest;
+	gboolean           reuse_images;
+	int                next_file_idx;
 };
 
 
@@ -218,20 +224,18 @@ image_data_new (GthFileData *file_data,
 	idata->file_data = g_object_ref (file_data);
 	idata->dest_filename = g_strdup_printf ("%03d-%s", file_idx, g_file_info_get_name (file_data->info));
 
-	idata->image = NULL;
 	idata->image_width = 0;
 	idata->image_height = 0;
 
-	idata->thumb = NULL;
 	idata->thumb_width = 0;
 	idata->thumb_height = 0;
 
-	idata->preview = NULL;
 	idata->preview_width = 0;
 	idata->preview_height = 0;
 
 	idata->caption_set = FALSE;
 	idata->no_preview = FALSE;
+	idata->reused = FALSE;
 
 	return idata;
 }
@@ -240,9 +244,6 @@ image_data_new (GthFileData *file_data,
 static void
 image_data_free (ImageData *idata)
 {
-	_g_object_unref (idata->preview);
-	_g_object_unref (idata->thumb);
-	_g_object_unref (idata->image);
 	g_free (idata->dest_filename);
 	_g_object_unref (idata->file_data);
 	g_free (idata);
@@ -1720,6 +1721,504 @@ gth_parsed_doc_print (GthWebExporter      *self,
 }
 
 
+static const char *
+get_format_description (const char *mime_type)
+{
+	const char *description = NULL;
+	GSList     *formats;
+	GSList     *scan;
+
+	formats = gdk_pixbuf_get_formats ();
+	for (scan = formats; ! description && scan; scan = scan->next) {
+		GdkPixbufFormat  *format = scan->data;
+		char            **mime_types;
+		int               i;
+
+		mime_types = gdk_pixbuf_format_get_mime_types (format);
+		for (i = 0; ! description && mime_types[i] != NULL; i++)
+			if (g_strcmp0 (mime_types[i], mime_type) == 0)
+				description = gdk_pixbuf_format_get_description (format);
+	}
+
+	g_slist_free (formats);
+
+	return description;
+}
+
+
+/* Changes the file type and the dimensions info of a resized image. */
+static void
+image_data_set_resized_info (ImageData *idata)
+{
+	char *size;
+
+	gth_file_data_set_mime_type (idata->file_data, "image/jpeg");
+	g_file_info_set_attribute_string (idata->file_data->info, "general::format", get_format_description ("image/jpeg"));
+	g_file_info_set_attribute_int32 (idata->file_data->info, "image::width", idata->image_width);
+	g_file_info_set_attribute_int32 (idata->file_data->info, "image::height", idata->image_height);
+	g_file_info_set_attribute_int32 (idata->file_data->info, "frame::width", idata->image_width);
+	g_file_info_set_attribute_int32 (idata->file_data->info, "frame::height", idata->image_height);
+	size = g_strdup_printf (_("%d × %d"), idata->image_width, idata->image_height);
+	g_file_info_set_attribute_string (idata->file_data->info, "general::dimensions", size);
+
+	g_free (size);
+}
+
+
+/* -- manifest -- */
+
+
+/* The manifest saved in the album folder records the source of each image,
+ * the files created for it, the settings used to create them and the
+ * checksum of the html pages.  In incremental mode the manifest of the
+ * previous album is used to reuse the images whose source didn't change,
+ * to copy only the html pages that changed and to remove the files of the
+ * deleted images. */
+
+
+#define MANIFEST_FILE ".pix-album-manifest"
+#define MANIFEST_VERSION 1
+#define MANIFEST_ALBUM_GROUP "Album"
+#define MANIFEST_CHECKSUMS_GROUP "Checksums"
+
+
+static char *
+get_image_settings (GthWebExporter *self)
+{
+	return g_strdup_printf ("copy:%d;resize:%d,%dx%d;preview:%dx%d,%dx%d;thumbnail:%d,%dx%d;subfolders:%d,%s,%s,%s,%s",
+				self->priv->copy_images,
+				self->priv->resize_images,
+				self->priv->resize_max_width,
+				self->priv->resize_max_height,
+				self->priv->preview_max_width,
+				self->priv->preview_max_height,
+				self->priv->preview_min_width,
+				self->priv->preview_min_height,
+				self->priv->squared_thumbnails,
+				self->priv->thumb_width,
+				self->priv->thumb_height,
+				self->priv->use_subfolders,
+				self->priv->directories.previews,
+				self->priv->directories.thumbnails,
+				self->priv->directories.images,
+				self->priv->directories.html_images);
+}
+
+
+static char *
+get_manifest_group (GthFileData *file_data)
+{
+	char *uri;
+	char *group;
+
+	uri = g_file_get_uri (file_data->file);
+	group = g_uri_escape_string (uri, ":/", FALSE);
+
+	g_free (uri);
+
+	return group;
+}
+
+
+static gint64
+get_file_mtime (GthFileData *file_data)
+{
+	return (g_file_info_get_attribute_uint64 (file_data->info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC)
+		+ g_file_info_get_attribute_uint32 (file_data->info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+
+static void
+add_relative_path (GPtrArray *paths,
+		   GFile     *album_dir,
+		   GFile     *file)
+{
+	char *path;
+
+	path = g_file_get_relative_path (album_dir, file);
+	if (path != NULL)
+		g_ptr_array_add (paths, path);
+
+	g_object_unref (file);
+}
+
+
+/* Returns the files created for the image, relative to the album folder. */
+static char **
+get_image_outputs (GthWebExporter *self,
+		   ImageData      *idata)
+{
+	GFile     *album_dir = self->priv->target_dir;
+	GPtrArray *paths;
+
+	paths = g_ptr_array_new ();
+	add_relative_path (paths, album_dir, get_html_image_file (self, idata, album_dir));
+	add_relative_path (paths, album_dir, get_thumbnail_file (self, idata, album_dir));
+	if (! idata->no_preview)
+		add_relative_path (paths, album_dir, get_preview_file (self, idata, album_dir));
+	if (self->priv->copy_images)
+		add_relative_path (paths, album_dir, get_image_file (self, idata, album_dir));
+	g_ptr_array_add (paths, NULL);
+
+	return (char **) g_ptr_array_free (paths, FALSE);
+}
+
+
+static GFile *
+get_album_file_from_path (GthWebExporter *self,
+			  const char     *path)
+{
+	GFile *file;
+
+	/* ignore the files outside the album folder */
+
+	if (g_path_is_absolute (path) || (strstr (path, "..") != NULL))
+		return NULL;
+
+	file = g_file_resolve_relative_path (self->priv->target_dir, path);
+	if (! g_file_has_prefix (file, self->priv->target_dir)) {
+		g_object_unref (file);
+		return NULL;
+	}
+
+	return file;
+}
+
+
+static void
+manifest_load (GthWebExporter *self)
+{
+	GFile    *file;
+	char     *buffer;
+	gsize     buffer_size;
+	GKeyFile *manifest;
+	char     *settings;
+	char     *old_settings;
+
+	self->priv->manifest = g_key_file_new ();
+	self->priv->next_file_idx = 0;
+
+	if (! self->priv->incremental)
+		return;
+
+	file = g_file_get_child (self->priv->target_dir, MANIFEST_FILE);
+	if (! g_file_load_contents (file, NULL, &buffer, &buffer_size, NULL, NULL)) {
+		g_object_unref (file);
+		return;
+	}
+
+	manifest = g_key_file_new ();
+	if (g_key_file_load_from_data (manifest, buffer, buffer_size, G_KEY_FILE_NONE, NULL)
+	    && (g_key_file_get_integer (manifest, MANIFEST_ALBUM_GROUP, "Version", NULL) == MANIFEST_VERSION))
+	{
+		self->priv->old_manifest = manifest;
+		self->priv->next_file_idx = g_key_file_get_integer (manifest, MANIFEST_ALBUM_GROUP, "NextIndex", NULL);
+
+		settings = get_image_settings (self);
+		old_settings = g_key_file_get_string (manifest, MANIFEST_ALBUM_GROUP, "ImageSettings", NULL);
+		self->priv->reuse_images = (g_strcmp0 (settings, old_settings) == 0);
+
+		g_free (old_settings);
+		g_free (settings);
+	}
+	else
+		g_key_file_free (manifest);
+
+	g_free (buffer);
+	g_object_unref (file);
+}
+
+
+static gboolean
+get_manifest_size (GKeyFile   *manifest,
+		   const char *group,
+		   const char *key,
+		   int        *width,
+		   int        *height)
+{
+	int   *size;
+	gsize  length;
+
+	size = g_key_file_get_integer_list (manifest, group, key, &length, NULL);
+	if ((size == NULL) || (length != 2)) {
+		g_free (size);
+		return FALSE;
+	}
+
+	*width = size[0];
+	*height = size[1];
+	g_free (size);
+
+	return TRUE;
+}
+
+
+static gboolean
+manifest_files_exist (GthWebExporter  *self,
+		      char           **paths)
+{
+	gboolean exist = TRUE;
+	int      i;
+
+	for (i = 0; exist && (paths[i] != NULL); i++) {
+		GFile *file;
+
+		file = get_album_file_from_path (self, paths[i]);
+		exist = (file != NULL) && g_file_query_exists (file, NULL);
+
+		_g_object_unref (file);
+	}
+
+	return exist;
+}
+
+
+static char *
+manifest_get_dest_filename (GthWebExporter *self,
+			    GthFileData    *file_data)
+{
+	char *group;
+	char *dest_filename;
+
+	if (self->priv->old_manifest == NULL)
+		return NULL;
+
+	group = get_manifest_group (file_data);
+	dest_filename = g_key_file_get_string (self->priv->old_manifest, group, "DestFilename", NULL);
+
+	g_free (group);
+
+	return dest_filename;
+}
+
+
+/* Returns TRUE if the files created for the image in the previous album
+ * are still valid. */
+static gboolean
+manifest_restore_image (GthWebExporter *self,
+			ImageData      *idata)
+{
+	GKeyFile  *manifest = self->priv->old_manifest;
+	char      *group;
+	char     **paths;
+	gboolean   valid;
+
+	if ((manifest == NULL) || ! self->priv->reuse_images)
+		return FALSE;
+
+	group = get_manifest_group (idata->file_data);
+	valid = (g_key_file_get_int64 (manifest, group, "MTime", NULL) == get_file_mtime (idata->file_data))
+		&& (g_key_file_get_uint64 (manifest, group, "Size", NULL) == g_file_info_get_size (idata->file_data->info))
+		&& get_manifest_size (manifest, group, "ImageSize", &idata->image_width, &idata->image_height)
+		&& get_manifest_size (manifest, group, "PreviewSize", &idata->preview_width, &idata->preview_height)
+		&& get_manifest_size (manifest, group, "ThumbnailSize", &idata->thumb_width, &idata->thumb_height);
+
+	if (valid) {
+		idata->no_preview = g_key_file_get_boolean (manifest, group, "NoPreview", NULL);
+		paths = g_key_file_get_string_list (manifest, group, "Files", NULL, NULL);
+		valid = (paths != NULL) && manifest_files_exist (self, paths);
+		g_strfreev (paths);
+	}
+
+	if (valid && self->priv->copy_images && self->priv->resize_images)
+		image_data_set_resized_info (idata);
+
+	g_free (group);
+
+	return valid;
+}
+
+
+/* Records the checksum of an html page and, if the page didn't change,
+ * deletes it from the temporary folder to keep the page of the album. */
+static void
+manifest_add_html_file (GthWebExporter *self,
+			GFile          *file)
+{
+	char  *path;
+	char  *key;
+	char  *buffer;
+	gsize  buffer_size;
+	char  *checksum;
+	char  *old_checksum;
+
+	path = g_file_get_relative_path (self->priv->tmp_dir, file);
+	if (path == NULL)
+		return;
+
+	if (! g_file_load_contents (file, NULL, &buffer, &buffer_size, NULL, NULL)) {
+		g_free (path);
+		return;
+	}
+
+	key = g_uri_escape_string (path, "/", FALSE);
+	checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (guchar *) buffer, buffer_size);
+	g_key_file_set_string (self->priv->manifest, MANIFEST_CHECKSUMS_GROUP, key, checksum);
+
+	old_checksum = NULL;
+	if (self->priv->old_manifest != NULL)
+		old_checksum = g_key_file_get_string (self->priv->old_manifest, MANIFEST_CHECKSUMS_GROUP, key, NULL);
+	if (g_strcmp0 (checksum, old_checksum) == 0) {
+		GFile *album_file;
+
+		album_file = get_album_file_from_path (self, path);
+		if ((album_file != NULL) && g_file_query_exists (album_file, NULL))
+			g_file_delete (file, NULL, NULL);
+
+		_g_object_unref (album_file);
+	}
+
+	g_free (old_checksum);
+	g_free (checksum);
+	g_free (key);
+	g_free (buffer);
+	g_free (path);
+}
+
+
+static gboolean
+manifest_save (GthWebExporter  *self,
+	       GError         **error)
+{
+	GKeyFile  *manifest = self->priv->manifest;
+	char      *settings;
+	char      *theme;
+	GPtrArray *paths;
+	int        page;
+	GList     *scan;
+	char      *buffer;
+	gsize      buffer_size;
+	GFile     *file;
+	gboolean   result;
+
+	g_key_file_set_integer (manifest, MANIFEST_ALBUM_GROUP, "Version", MANIFEST_VERSION);
+	settings = get_image_settings (self);
+	g_key_file_set_string (manifest, MANIFEST_ALBUM_GROUP, "ImageSettings", settings);
+	theme = g_file_get_uri (self->priv->style_dir);
+	g_key_file_set_string (manifest, MANIFEST_ALBUM_GROUP, "Theme", theme);
+	g_key_file_set_integer (manifest, MANIFEST_ALBUM_GROUP, "NextIndex", self->priv->next_file_idx);
+
+	paths = g_ptr_array_new_with_free_func (g_free);
+	for (page = 0; page < self->priv->n_pages; page++)
+		add_relative_path (paths, self->priv->target_dir, get_html_index_file (self, page, self->priv->target_dir));
+	g_key_file_set_string_list (manifest, MANIFEST_ALBUM_GROUP, "Files", (const char * const *) paths->pdata, paths->len);
+	g_ptr_array_free (paths, TRUE);
+
+	for (scan = self->priv->file_list; scan; scan = scan->next) {
+		ImageData  *idata = scan->data;
+		char       *group;
+		char      **outputs;
+		int         size[2];
+
+		/* the images not loaded are created again the next time */
+
+		if ((idata->image_width <= 0) || (idata->thumb_width <= 0))
+			continue;
+
+		group = get_manifest_group (idata->file_data);
+		g_key_file_set_int64 (manifest, group, "MTime", get_file_mtime (idata->file_data));
+		g_key_file_set_uint64 (manifest, group, "Size", g_file_info_get_size (idata->file_data->info));
+		g_key_file_set_string (manifest, group, "DestFilename", idata->dest_filename);
+		size[0] = idata->image_width;
+		size[1] = idata->image_height;
+		g_key_file_set_integer_list (manifest, group, "ImageSize", size, 2);
+		size[0] = idata->preview_width;
+		size[1] = idata->preview_height;
+		g_key_file_set_integer_list (manifest, group, "PreviewSize", size, 2);
+		size[0] = idata->thumb_width;
+		size[1] = idata->thumb_height;
+		g_key_file_set_integer_list (manifest, group, "ThumbnailSize", size, 2);
+		g_key_file_set_boolean (manifest, group, "NoPreview", idata->no_preview);
+		outputs = get_image_outputs (self, idata);
+		g_key_file_set_string_list (manifest, group, "Files", (const char * const *) outputs, g_strv_length (outputs));
+
+		g_strfreev (outputs);
+		g_free (group);
+	}
+
+	buffer = g_key_file_to_data (manifest, &buffer_size, NULL);
+	file = g_file_get_child (self->priv->tmp_dir, MANIFEST_FILE);
+	result = _g_file_write (file,
+				FALSE,
+				G_FILE_CREATE_REPLACE_DESTINATION,
+				buffer,
+				buffer_size,
+				gth_task_get_cancellable (GTH_TASK (self)),
+				error);
+
+	g_object_unref (file);
+	g_free (buffer);
+	g_free (theme);
+	g_free (settings);
+
+	return result;
+}
+
+
+static GHashTable *
+get_manifest_files (GKeyFile *manifest)
+{
+	GHashTable  *files;
+	char       **groups;
+	int          i;
+
+	files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	groups = g_key_file_get_groups (manifest, NULL);
+	for (i = 0; groups[i] != NULL; i++) {
+		char **paths;
+		int    j;
+
+		paths = g_key_file_get_string_list (manifest, groups[i], "Files", NULL, NULL);
+		if (paths == NULL)
+			continue;
+
+		for (j = 0; paths[j] != NULL; j++)
+			g_hash_table_add (files, g_strdup (paths[j]));
+
+		g_strfreev (paths);
+	}
+
+	g_strfreev (groups);
+
+	return files;
+}
+
+
+/* Deletes the files of the previous album not created anymore, for
+ * example the files of the deleted images. */
+static void
+manifest_remove_obsolete_files (GthWebExporter *self)
+{
+	GHashTable     *old_files;
+	GHashTable     *new_files;
+	GHashTableIter  iter;
+	const char     *path;
+
+	if (self->priv->old_manifest == NULL)
+		return;
+
+	old_files = get_manifest_files (self->priv->old_manifest);
+	new_files = get_manifest_files (self->priv->manifest);
+
+	g_hash_table_iter_init (&iter, old_files);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &path, NULL)) {
+		GFile *file;
+
+		if (g_hash_table_contains (new_files, path))
+			continue;
+
+		file = get_album_file_from_path (self, path);
+		if (file != NULL) {
+			g_file_delete (file, NULL, NULL);
+			g_object_unref (file);
+		}
+	}
+
+	g_hash_table_destroy (new_files);
+	g_hash_table_destroy (old_files);
+}
+
+
 static void
 save_template (GthWebExporter   *self,
 	       GList            *document,
@@ -1864,7 +2363,11 @@ static void
 copy_to_destination_ready_cb (GError   *error,
 			      gpointer  user_data)
 {
-	cleanup_and_terminate (GTH_WEB_EXPORTER (user_data), error);
+	GthWebExporter *self = user_data;
+
+	if ((error == NULL) && self->priv->incremental)
+		manifest_remove_obsolete_files (self);
+	cleanup_and_terminate (self, error);
 }
 
 
@@ -1904,6 +2407,12 @@ save_other_files_ready_cb (GError   *error,
 	GFileInfo       *info;
 	GList           *files;
 
+	if ((error == NULL) && ! manifest_save (self, &error)) {
+		cleanup_and_terminate (self, error);
+		g_error_free (error);
+		return;
+	}
+
 	if (error != NULL) {
 		cleanup_and_terminate (self, error);
 		return;
@@ -1933,7 +2442,7 @@ save_other_files_ready_cb (GError   *error,
 					 self->priv->target_dir,
 					 FALSE,
 					 GTH_FILE_COPY_DEFAULT,
-					 GTH_OVERWRITE_RESPONSE_UNSPECIFIED,
+					 (self->priv->incremental ? GTH_OVERWRITE_RESPONSE_ALWAYS_YES : GTH_OVERWRITE_RESPONSE_UNSPECIFIED),
 					 G_PRIORITY_DEFAULT,
 					 gth_task_get_cancellable (GTH_TASK (self)),
 					 save_files_progress_cb,
@@ -2027,44 +2536,14 @@ save_other_files (GthWebExporter *self)
 }
 
 
-static gboolean save_thumbnail (gpointer data);
-
-
-static void
-save_next_thumbnail (GthWebExporter *self)
-{
-	self->priv->current_file = self->priv->current_file->next;
-	self->priv->image++;
-	self->priv->saving_timeout = g_idle_add (save_thumbnail, self);
-}
-
-
-static void
-save_thumbnail_ready_cb (GthFileData *file_data,
-		         GError      *error,
-			 gpointer     data)
-{
-	GthWebExporter *self = data;
-	ImageData      *image_data;
-
-	if (error != NULL) {
-		cleanup_and_terminate (self, error);
-		return;
-	}
-
-	image_data = self->priv->current_file->data;
-	g_object_unref (image_data->thumb);
-	image_data->thumb = NULL;
-
-	save_next_thumbnail (self);
-}
-
-
 static gboolean
-save_thumbnail (gpointer data)
+save_html_image (gpointer data)
 {
 	GthWebExporter *self = data;
 	ImageData      *image_data;
+	GFile          *file;
+	GFile          *relative_to;
+	GError         *error = NULL;
 
 	if (self->priv->saving_timeout != 0) {
 		g_source_remove (self->priv->saving_timeout);
@@ -2076,87 +2555,28 @@ save_thumbnail (gpointer data)
 		return FALSE;
 	}
 
+	gth_task_progress (GTH_TASK (self),
+			   _("Saving HTML pages: Images"),
+			   NULL,
+			   FALSE,
+			   (double) (self->priv->image + 1) / (self->priv->n_images + 1));
+
 	image_data = self->priv->current_file->data;
-	if (image_data->thumb != NULL) {
-		GFile       *destination;
-		GthFileData *file_data;
+	file = get_html_image_file (self, image_data, self->priv->tmp_dir);
+	relative_to = get_html_image_dir (self, self->priv->target_dir);
+	save_template (self, self->priv->image_template, GTH_TEMPLATE_TYPE_IMAGE, file, relative_to, &error);
+	if (error == NULL)
+		manifest_add_html_file (self, file);
 
-		gth_task_progress (GTH_TASK (self),
-				   _("Saving thumbnails"),
-				   NULL,
-				   FALSE,
-				   (double) (self->priv->image + 1) / (self->priv->n_images + 1));
-
-		destination = get_thumbnail_file (self, image_data, self->priv->tmp_dir);
-		file_data = gth_file_data_new (destination, NULL);
-		gth_image_save_to_file (image_data->thumb,
-					"image/jpeg",
-					file_data,
-					TRUE,
-					gth_task_get_cancellable (GTH_TASK (self)),
-					save_thumbnail_ready_cb,
-					self);
+	g_object_unref (file);
+	g_object_unref (relative_to);
 
-		g_object_unref (file_data);
-		g_object_unref (destination);
-	}
-	else
-		save_next_thumbnail (self);
+	/**/
 
-	return FALSE;
-}
-
-
-static void
-save_thumbnails (GthWebExporter *self)
-{
-	gth_task_progress (GTH_TASK (self), _("Saving thumbnails"), NULL, TRUE, 0);
-
-	self->priv->image = 0;
-	self->priv->current_file = self->priv->file_list;
-	self->priv->saving_timeout = g_idle_add (save_thumbnail, self);
-}
-
-
-static gboolean
-save_html_image (gpointer data)
-{
-	GthWebExporter *self = data;
-	ImageData      *image_data;
-	GFile          *file;
-	GFile          *relative_to;
-	GError         *error = NULL;
-
-	if (self->priv->saving_timeout != 0) {
-		g_source_remove (self->priv->saving_timeout);
-		self->priv->saving_timeout = 0;
-	}
-
-	if (self->priv->current_file == NULL) {
-		save_thumbnails (self);
-		return FALSE;
-	}
-
-	gth_task_progress (GTH_TASK (self),
-			   _("Saving HTML pages: Images"),
-			   NULL,
-			   FALSE,
-			   (double) (self->priv->image + 1) / (self->priv->n_images + 1));
-
-	image_data = self->priv->current_file->data;
-	file = get_html_image_file (self, image_data, self->priv->tmp_dir);
-	relative_to = get_html_image_dir (self, self->priv->target_dir);
-	save_template (self, self->priv->image_template, GTH_TEMPLATE_TYPE_IMAGE, file, relative_to, &error);
-
-	g_object_unref (file);
-	g_object_unref (relative_to);
-
-	/**/
-
-	if (error != NULL) {
-		cleanup_and_terminate (self, error);
-		return FALSE;
-	}
+	if (error != NULL) {
+		cleanup_and_terminate (self, error);
+		return FALSE;
+	}
 
 	self->priv->current_file = self->priv->current_file->next;
 	self->priv->image++;
@@ -2204,6 +2624,8 @@ save_html_index (gpointer data)
 	file = get_html_index_file (self, self->priv->page, self->priv->tmp_dir);
 	relative_to = get_html_index_dir (self, self->priv->page, self->priv->target_dir);
 	save_template (self, self->priv->index_template, GTH_TEMPLATE_TYPE_INDEX, file, relative_to, &error);
+	if (error == NULL)
+		manifest_add_html_file (self, file);
 
 	g_object_unref (file);
 	g_object_unref (relative_to);
@@ -2231,308 +2653,447 @@ save_html_files (GthWebExporter *self)
 }
 
 
-static void load_current_file (GthWebExporter *self);
+/* -- image pipeline -- */
 
 
-static void
-load_next_file (GthWebExporter *self)
-{
-	if (self->priv->interrupted) {
-		GError *error;
-
-		error = g_error_new_literal (GTH_TASK_ERROR, GTH_TASK_ERROR_CANCELLED, "");
-		cleanup_and_terminate (self, error);
-		g_error_free (error);
-
-		return;
-	}
+/* Each image is loaded at the largest size required by the album, then the
+ * resized image, the preview and the thumbnail are created in a cascade,
+ * each one from the smallest of the larger images, and saved in a worker
+ * thread.  Several images are processed at the same time and the scaled
+ * images are not kept in memory, only their size is used to create the
+ * html pages. */
 
-	if (self->priv->current_file != NULL) {
-		ImageData *image_data = self->priv->current_file->data;
 
-		if (image_data->preview != NULL) {
-			g_object_unref (image_data->preview);
-			image_data->preview = NULL;
-		}
+typedef struct {
+	GthWebExporter *exporter;
+	ImageData      *idata;
+	int             requested_size;
+	GthImage       *image;
+	int             original_width;
+	int             original_height;
+	gboolean        loaded_original;
+	gboolean        resize_image;
+	gboolean        copy_image;
+	int             image_width;
+	int             image_height;
+	int             preview_width;
+	int             preview_height;
+	int             thumb_width;
+	int             thumb_height;
+	gboolean        squared_thumbnail;
+	gboolean        no_preview;
+	GFile          *image_file;
+	GFile          *preview_file;
+	GFile          *thumbnail_file;
+} ImageJob;
+
+
+static ImageJob *
+image_job_new (GthWebExporter *exporter,
+	       ImageData      *idata)
+{
+	ImageJob *job;
+
+	job = g_new0 (ImageJob, 1);
+	job->exporter = exporter;
+	job->idata = idata;
+	job->image = NULL;
+	job->image_file = NULL;
+	job->preview_file = NULL;
+	job->thumbnail_file = NULL;
+
+	return job;
+}
 
-		if (image_data->image != NULL) {
-			g_object_unref (image_data->image);
-			image_data->image = NULL;
-		}
-	}
 
-	self->priv->image++;
-	self->priv->current_file = self->priv->current_file->next;
-	load_current_file (self);
+static void
+image_job_free (ImageJob *job)
+{
+	_g_object_unref (job->image);
+	_g_object_unref (job->image_file);
+	_g_object_unref (job->preview_file);
+	_g_object_unref (job->thumbnail_file);
+	g_free (job);
 }
 
 
-static gboolean
-load_next_file_cb (gpointer data)
+/* Returns the size required to create the resized image, the preview and the
+ * thumbnail, or -1 if the original image is required. */
+static int
+get_requested_size (GthWebExporter *self)
 {
-	GthWebExporter *self = data;
+	int size = 0;
 
-	if (self->priv->saving_timeout != 0) {
-		g_source_remove (self->priv->saving_timeout);
-		self->priv->saving_timeout = 0;
+	if (self->priv->copy_images && self->priv->resize_images) {
+		if ((self->priv->resize_max_width <= 0) || (self->priv->resize_max_height <= 0))
+			return -1;
+		size = MAX (size, MAX (self->priv->resize_max_width, self->priv->resize_max_height));
 	}
 
-	load_next_file (self);
+	if ((self->priv->preview_max_width <= 0) || (self->priv->preview_max_height <= 0))
+		return -1;
+	size = MAX (size, MAX (self->priv->preview_max_width, self->priv->preview_max_height));
 
-	return FALSE;
+	if ((self->priv->thumb_width <= 0) || (self->priv->thumb_height <= 0))
+		return -1;
+	size = MAX (size, MAX (self->priv->thumb_width, self->priv->thumb_height));
+
+	return size;
 }
 
 
 static void
-save_image_preview_ready_cb (GthFileData *file_data,
-			     GError      *error,
-			     gpointer     data)
+image_job_compute_sizes (ImageJob *job)
 {
-	GthWebExporter *self = data;
+	GthWebExporter *self = job->exporter;
+	int             w;
+	int             h;
 
-	if (error != NULL) {
-		cleanup_and_terminate (self, error);
-		return;
-	}
+	/* image */
+
+	job->resize_image = self->priv->copy_images && self->priv->resize_images;
+	job->copy_image = self->priv->copy_images && ! self->priv->resize_images;
+	job->image_width = job->original_width;
+	job->image_height = job->original_height;
+	if (job->resize_image)
+		scale_keeping_ratio (&job->image_width,
+				     &job->image_height,
+				     self->priv->resize_max_width,
+				     self->priv->resize_max_height,
+				     FALSE);
 
-	self->priv->saving_timeout = g_idle_add (load_next_file_cb, self);
+	/* preview */
+
+	w = job->original_width;
+	h = job->original_height;
+	if ((self->priv->preview_max_width > 0) && (self->priv->preview_max_height > 0))
+		scale_keeping_ratio_min (&w, &h,
+					 self->priv->preview_min_width,
+					 self->priv->preview_min_height,
+					 self->priv->preview_max_width,
+					 self->priv->preview_max_height,
+					 FALSE);
+	job->preview_width = w;
+	job->preview_height = h;
+	job->no_preview = ((job->preview_width == job->image_width)
+			   && (job->preview_height == job->image_height));
+
+	/* thumbnail, the size of a squared thumbnail is known after scaling */
+
+	w = job->original_width;
+	h = job->original_height;
+	job->squared_thumbnail = FALSE;
+	if ((self->priv->thumb_width > 0) && (self->priv->thumb_height > 0)) {
+		if (self->priv->squared_thumbnails)
+			job->squared_thumbnail = TRUE;
+		else
+			scale_keeping_ratio (&w, &h,
+					     self->priv->thumb_width,
+					     self->priv->thumb_height,
+					     FALSE);
+	}
+	job->thumb_width = w;
+	job->thumb_height = h;
 }
 
 
+/* Returns TRUE if the loaded image is too small to create the scaled
+ * images, for example a panorama with a minimum preview height. */
 static gboolean
-save_image_preview (gpointer data)
+image_job_requires_original (ImageJob *job)
 {
-	GthWebExporter *self = data;
-	ImageData      *image_data;
+	cairo_surface_t *surface;
+	int              width;
+	int              height;
+	gboolean         result;
 
-	if (self->priv->saving_timeout != 0) {
-		g_source_remove (self->priv->saving_timeout);
-		self->priv->saving_timeout = 0;
-	}
+	if (job->loaded_original || (job->requested_size == -1))
+		return FALSE;
 
-	image_data = self->priv->current_file->data;
-	if (! image_data->no_preview && (image_data->preview != NULL)) {
-		GFile       *destination;
-		GthFileData *file_data;
+	surface = gth_image_get_cairo_surface (job->image);
+	if (surface == NULL)
+		return FALSE;
 
-		gth_task_progress (GTH_TASK (self),
-				   _("Saving images"),
-				   g_file_info_get_display_name (image_data->file_data->info),
-				   FALSE,
-				   (double) (self->priv->image + 1) / (self->priv->n_images + 1));
-
-		destination = get_preview_file (self, image_data, self->priv->tmp_dir);
-		file_data = gth_file_data_new (destination, NULL);
-		gth_image_save_to_file (image_data->preview,
-					"image/jpeg",
-					file_data,
-					TRUE,
-					gth_task_get_cancellable (GTH_TASK (self)),
-					save_image_preview_ready_cb,
-					self);
+	width = cairo_image_surface_get_width (surface) + 1;
+	height = cairo_image_surface_get_height (surface) + 1;
+	result = FALSE;
 
-		g_object_unref (file_data);
-		g_object_unref (destination);
+	if (job->resize_image && ((job->image_width > width) || (job->image_height > height)))
+		result = TRUE;
+	if (! job->no_preview && ((job->preview_width > width) || (job->preview_height > height)))
+		result = TRUE;
+	if (job->squared_thumbnail) {
+		if (MIN (width, height) < job->exporter->priv->thumb_width)
+			result = TRUE;
 	}
-	else
-		self->priv->saving_timeout = g_idle_add (load_next_file_cb, self);
+	else if ((job->thumb_width > width) || (job->thumb_height > height))
+		result = TRUE;
 
-	return FALSE;
+	cairo_surface_destroy (surface);
+
+	return result;
 }
 
 
-static void
-save_resized_image_ready_cd (GthFileData *file_data,
-			     GError      *error,
-			     gpointer     data)
+/* Returns the smallest of the available images not smaller than
+ * width × height, or the first one. */
+static cairo_surface_t *
+get_cascade_source (cairo_surface_t **sources,
+		    int               n_sources,
+		    int               width,
+		    int               height)
 {
-	GthWebExporter *self = data;
+	cairo_surface_t *source;
+	int              i;
 
-	if (error != NULL) {
-		cleanup_and_terminate (self, error);
-		return;
+	source = sources[0];
+	for (i = 1; i < n_sources; i++) {
+		if (sources[i] == NULL)
+			continue;
+		if ((cairo_image_surface_get_width (sources[i]) < width)
+		    || (cairo_image_surface_get_height (sources[i]) < height))
+		{
+			continue;
+		}
+		if (cairo_image_surface_get_width (sources[i]) * cairo_image_surface_get_height (sources[i])
+		    < cairo_image_surface_get_width (source) * cairo_image_surface_get_height (source))
+		{
+			source = sources[i];
+		}
 	}
 
-	self->priv->saving_timeout = g_idle_add (save_image_preview, self);
+	return source;
 }
 
 
-static const char *
-get_format_description (const char *mime_type)
+static cairo_surface_t *
+scale_surface (cairo_surface_t *source,
+	       int              width,
+	       int              height)
 {
-	const char *description = NULL;
-	GSList     *formats;
-	GSList     *scan;
+	cairo_surface_t *scaled = NULL;
 
-	formats = gdk_pixbuf_get_formats ();
-	for (scan = formats; ! description && scan; scan = scan->next) {
-		GdkPixbufFormat  *format = scan->data;
-		char            **mime_types;
-		int               i;
-
-		mime_types = gdk_pixbuf_format_get_mime_types (format);
-		for (i = 0; ! description && mime_types[i] != NULL; i++)
-			if (g_strcmp0 (mime_types[i], mime_type) == 0)
-				description = gdk_pixbuf_format_get_description (format);
+	if ((cairo_image_surface_get_width (source) != width)
+	    || (cairo_image_surface_get_height (source) != height))
+	{
+		scaled = _cairo_image_surface_scale (source, width, height, SCALE_FILTER_BEST, NULL);
 	}
+	if (scaled == NULL)
+		scaled = cairo_surface_reference (source);
 
-	g_slist_free (formats);
-
-	return description;
+	return scaled;
 }
 
 
 static gboolean
-save_resized_image (gpointer data)
+save_surface_as_jpeg (cairo_surface_t  *surface,
+		      GFile            *file,
+		      GCancellable     *cancellable,
+		      GError          **error)
 {
-	GthWebExporter *self = data;
-	ImageData      *image_data;
+	GthImage    *image;
+	GthFileData *file_data;
+	char        *buffer;
+	gsize        buffer_size;
+	gboolean     result;
+
+	image = gth_image_new_for_surface (surface);
+	file_data = gth_file_data_new (file, NULL);
+	result = gth_image_save_to_buffer (image,
+					   "image/jpeg",
+					   file_data,
+					   &buffer,
+					   &buffer_size,
+					   cancellable,
+					   error);
+	if (result) {
+		result = _g_file_write (file,
+					FALSE,
+					G_FILE_CREATE_REPLACE_DESTINATION,
+					buffer,
+					buffer_size,
+					cancellable,
+					error);
+		g_free (buffer);
+	}
+
+	g_object_unref (file_data);
+	g_object_unref (image);
 
-	if (self->priv->saving_timeout != 0) {
-		g_source_remove (self->priv->saving_timeout);
-		self->priv->saving_timeout = 0;
-	}
+	return result;
+}
 
-	image_data = self->priv->current_file->data;
-	if (self->priv->copy_images && (image_data->image != NULL)) {
-		char        *filename_no_ext;
-		char        *size;
-		GFile       *destination;
-		GthFileData *file_data;
 
-		gth_task_progress (GTH_TASK (self),
-				   _("Saving images"),
-				   g_file_info_get_display_name (image_data->file_data->info),
-				   FALSE,
-				   (double) (self->priv->image + 1) / (self->priv->n_images + 1));
+static void
+process_image_thread (GTask        *task,
+		      gpointer      source_object,
+		      gpointer      task_data,
+		      GCancellable *cancellable)
+{
+	ImageJob        *job = task_data;
+	cairo_surface_t *sources[3];
+	cairo_surface_t *thumbnail;
+	GError          *error = NULL;
 
-		/* change the file extension to jpeg */
+	sources[0] = gth_image_get_cairo_surface (job->image);
+	sources[1] = NULL;
+	sources[2] = NULL;
 
-		filename_no_ext = _g_path_remove_extension (image_data->dest_filename);
-		g_free (image_data->dest_filename);
-		image_data->dest_filename = g_strconcat(filename_no_ext, ".jpeg", NULL);
-		g_free (filename_no_ext);
+	if (sources[0] == NULL) {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s", "Invalid image");
+		return;
+	}
 
-		/* change the file type */
+	/* resized image */
 
-		gth_file_data_set_mime_type (image_data->file_data, "image/jpeg");
-		g_file_info_set_attribute_string (image_data->file_data->info, "general::format", get_format_description ("image/jpeg"));
+	if (job->resize_image)
+		sources[1] = scale_surface (sources[0], job->image_width, job->image_height);
 
-		/* change the image dimensions info */
+	/* preview */
 
-		g_file_info_set_attribute_int32 (image_data->file_data->info, "image::width", image_data->image_width);
-		g_file_info_set_attribute_int32 (image_data->file_data->info, "image::height", image_data->image_height);
-		g_file_info_set_attribute_int32 (image_data->file_data->info, "frame::width", image_data->image_width);
-		g_file_info_set_attribute_int32 (image_data->file_data->info, "frame::height", image_data->image_height);
-		size = g_strdup_printf (_("%d × %d"), image_data->image_width, image_data->image_height);
-		g_file_info_set_attribute_string (image_data->file_data->info, "general::dimensions", size);
+	if (! job->no_preview && ! g_cancellable_is_cancelled (cancellable))
+		sources[2] = scale_surface (get_cascade_source (sources, 3, job->preview_width, job->preview_height),
+					    job->preview_width,
+					    job->preview_height);
 
-		/* save the pixbuf */
+	/* thumbnail */
 
-		destination = get_image_file (self, image_data, self->priv->tmp_dir);
-		file_data = gth_file_data_new (destination, NULL);
-		gth_image_save_to_file (image_data->image,
-					"image/jpeg",
-					file_data,
-					TRUE,
-					gth_task_get_cancellable (GTH_TASK (self)),
-					save_resized_image_ready_cd,
-					self);
+	if (job->squared_thumbnail) {
+		int size = job->exporter->priv->thumb_width;
 
-		g_object_unref (file_data);
-		g_object_unref (destination);
+		thumbnail = _cairo_image_surface_scale_squared (get_cascade_source (sources, 3, size, size),
+								size,
+								SCALE_FILTER_BEST,
+								NULL);
+		job->thumb_width = cairo_image_surface_get_width (thumbnail);
+		job->thumb_height = cairo_image_surface_get_height (thumbnail);
 	}
 	else
-		self->priv->saving_timeout = g_idle_add (save_image_preview, self);
+		thumbnail = scale_surface (get_cascade_source (sources, 3, job->thumb_width, job->thumb_height),
+					   job->thumb_width,
+					   job->thumb_height);
+
+	/* save the images */
+
+	if (job->resize_image)
+		save_surface_as_jpeg (sources[1], job->image_file, cancellable, &error);
+	else if (job->copy_image)
+		g_file_copy (job->idata->file_data->file,
+			     job->image_file,
+			     G_FILE_COPY_NONE,
+			     cancellable,
+			     NULL,
+			     NULL,
+			     &error);
+
+	if ((error == NULL) && (sources[2] != NULL))
+		save_surface_as_jpeg (sources[2], job->preview_file, cancellable, &error);
 
-	return FALSE;
+	if (error == NULL)
+		save_surface_as_jpeg (thumbnail, job->thumbnail_file, cancellable, &error);
+
+	cairo_surface_destroy (thumbnail);
+	if (sources[2] != NULL)
+		cairo_surface_destroy (sources[2]);
+	if (sources[1] != NULL)
+		cairo_surface_destroy (sources[1]);
+	cairo_surface_destroy (sources[0]);
+
+	/* the decoded image is not needed anymore */
+
+	_g_clear_object (&job->image);
+
+	if (error != NULL)
+		g_task_return_error (task, error);
+	else
+		g_task_return_boolean (task, TRUE);
 }
 
 
+static void image_jobs_continue (GthWebExporter *self);
+
+
 static void
-transformation_ready_cb (GError   *error,
-			 gpointer  user_data)
+image_job_done (ImageJob *job,
+		GError   *error)
 {
-	GthWebExporter *self = user_data;
+	GthWebExporter *self = job->exporter;
 
-	if (error != NULL) {
-		cleanup_and_terminate (self, error);
-		return;
-	}
+	if ((error != NULL) && (self->priv->pipeline_error == NULL))
+		self->priv->pipeline_error = g_error_copy (error);
+
+	gth_task_progress (GTH_TASK (self),
+			   _("Saving images"),
+			   g_file_info_get_display_name (job->idata->file_data->info),
+			   FALSE,
+			   (double) (self->priv->image + 1) / (self->priv->n_images + 1));
 
-	self->priv->saving_timeout = g_idle_add (save_image_preview, self);
+	self->priv->image++;
+	self->priv->n_active_jobs--;
+	image_job_free (job);
+
+	image_jobs_continue (self);
 }
 
 
-static gboolean
-copy_current_file (GthWebExporter *self)
+static void
+transformation_ready_cb (GError   *error,
+			 gpointer  user_data)
 {
-	ImageData  *image_data;
-	GFile      *destination;
-	GError     *error = NULL;
+	image_job_done ((ImageJob *) user_data, error);
+}
 
-	/* This function is used when "Copy originals to destination" is
-	   enabled, and resizing is NOT enabled. This allows us to use a
-	   lossless copy (and rotate). When resizing is enabled, a lossy
-	   save has to be used. */
 
-	if (self->priv->saving_timeout != 0) {
-		g_source_remove (self->priv->saving_timeout);
-		self->priv->saving_timeout = 0;
+static void
+image_processed_cb (GObject      *source_object,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	ImageJob       *job = user_data;
+	GthWebExporter *self = job->exporter;
+	ImageData      *idata = job->idata;
+	GError         *error = NULL;
+
+	if (! g_task_propagate_boolean (G_TASK (result), &error)) {
+		image_job_done (job, error);
+		g_error_free (error);
+		return;
 	}
 
-	gth_task_progress (GTH_TASK (self), _("Copying original images"), NULL, TRUE, 0);
+	idata->image_width = job->image_width;
+	idata->image_height = job->image_height;
+	idata->preview_width = job->preview_width;
+	idata->preview_height = job->preview_height;
+	idata->thumb_width = job->thumb_width;
+	idata->thumb_height = job->thumb_height;
+	idata->no_preview = job->no_preview;
 
-	image_data = self->priv->current_file->data;
-	destination = get_image_file (self, image_data, self->priv->tmp_dir);
-	if (g_file_copy (image_data->file_data->file,
-			 destination,
-			 G_FILE_COPY_NONE,
-			 gth_task_get_cancellable (GTH_TASK (self)),
-			 NULL,
-			 NULL,
-			 &error))
-	{
-		gboolean appling_tranformation = FALSE;
+	if (job->resize_image)
+		image_data_set_resized_info (idata);
 
-		if (gth_main_extension_is_active ("image_rotation")) {
-			GthFileData *file_data;
+	/* When "Copy originals to destination" is enabled and resizing is
+	 * not, the copy is rotated with a lossless transformation. */
 
-			file_data = gth_file_data_new (destination, image_data->file_data->info);
-			apply_transformation_async (file_data,
-						    GTH_TRANSFORM_NONE,
-						    JPEG_MCU_ACTION_TRIM,
-						    gth_task_get_cancellable (GTH_TASK (self)),
-						    transformation_ready_cb,
-						    self);
-			appling_tranformation = TRUE;
+	if (job->copy_image && gth_main_extension_is_active ("image_rotation")) {
+		GthFileData *file_data;
 
-			g_object_unref (file_data);
-		}
+		file_data = gth_file_data_new (job->image_file, idata->file_data->info);
+		apply_transformation_async (file_data,
+					    GTH_TRANSFORM_NONE,
+					    JPEG_MCU_ACTION_TRIM,
+					    gth_task_get_cancellable (GTH_TASK (self)),
+					    transformation_ready_cb,
+					    job);
 
-		if (! appling_tranformation)
-			self->priv->saving_timeout = g_idle_add (save_image_preview, self);
+		g_object_unref (file_data);
+		return;
 	}
-	else
-		cleanup_and_terminate (self, error);
-
-	g_object_unref (destination);
 
-	return FALSE;
+	image_job_done (job, NULL);
 }
 
 
-static int
-image_data_cmp (gconstpointer a,
-		gconstpointer b,
-		gpointer      user_data)
-{
-	GthWebExporter *self = user_data;
-	ImageData      *idata_a = (ImageData *) a;
-	ImageData      *idata_b = (ImageData *) b;
-
-	return self->priv->sort_type->cmp_func (idata_a->file_data, idata_b->file_data);
-}
+static void image_job_load (ImageJob *job, int requested_size);
 
 
 static void
@@ -2540,182 +3101,152 @@ image_loader_ready_cb (GObject      *source_object,
                        GAsyncResult *result,
                        gpointer      user_data)
 {
-	GthWebExporter  *self = user_data;
-	ImageData       *idata;
+	ImageJob        *job = user_data;
+	GthWebExporter  *self = job->exporter;
+	ImageData       *idata = job->idata;
 	GthImage        *image = NULL;
 	cairo_surface_t *surface;
+	int              original_width;
+	int              original_height;
+	gboolean         loaded_original;
+	GTask           *task;
 
 	if (! gth_image_loader_load_finish (GTH_IMAGE_LOADER (source_object),
 					    result,
 					    &image,
-					    NULL,
-					    NULL,
-					    NULL,
+					    &original_width,
+					    &original_height,
+					    &loaded_original,
 					    NULL))
 	{
-		load_next_file (self);
+		/* skip the images that cannot be loaded */
+		image_job_done (job, NULL);
 		return;
 	}
 
-	idata = (ImageData *) self->priv->current_file->data;
 	surface = gth_image_get_cairo_surface (image);
-
-	/* image */
-
-	idata->image = g_object_ref (image);
-	idata->image_width = cairo_image_surface_get_width (surface);
-	idata->image_height = cairo_image_surface_get_width (surface);
-
-	if (self->priv->copy_images && self->priv->resize_images) {
-		int w = cairo_image_surface_get_width (surface);
-		int h = cairo_image_surface_get_height (surface);
-
-		if (scale_keeping_ratio (&w, &h,
-				         self->priv->resize_max_width,
-				         self->priv->resize_max_height,
-				         FALSE))
-		{
-			cairo_surface_t *scaled;
-
-			scaled = _cairo_image_surface_scale (surface, w, h, SCALE_FILTER_BEST, NULL);
-			if (scaled != NULL) {
-				g_object_unref (idata->image);
-
-				idata->image = gth_image_new_for_surface (scaled);
-				idata->image_width = cairo_image_surface_get_width (scaled);
-				idata->image_height = cairo_image_surface_get_height (scaled);
-
-				cairo_surface_destroy (scaled);
-			}
-		}
+	if (surface == NULL) {
+		g_object_unref (image);
+		image_job_done (job, NULL);
+		return;
 	}
 
-	/* preview */
+	_g_object_unref (job->image);
+	job->image = image;
+	job->loaded_original = loaded_original || (original_width <= 0) || (original_height <= 0);
+	if (job->loaded_original) {
+		job->original_width = cairo_image_surface_get_width (surface);
+		job->original_height = cairo_image_surface_get_height (surface);
+	}
+	else {
+		job->original_width = original_width;
+		job->original_height = original_height;
+	}
+	cairo_surface_destroy (surface);
 
-	idata->preview = g_object_ref (image);
-	idata->preview_width = cairo_image_surface_get_width (surface);
-	idata->preview_height = cairo_image_surface_get_width (surface);
+	image_job_compute_sizes (job);
+	if (image_job_requires_original (job)) {
+		image_job_load (job, -1);
+		return;
+	}
 
-	if ((self->priv->preview_max_width > 0) && (self->priv->preview_max_height > 0)) {
-		int w = cairo_image_surface_get_width (surface);
-		int h = cairo_image_surface_get_height (surface);
+	if (job->resize_image) {
+		char *filename_no_ext;
 
-		if (scale_keeping_ratio_min (&w, &h,
-					     self->priv->preview_min_width,
-					     self->priv->preview_min_height,
-					     self->priv->preview_max_width,
-					     self->priv->preview_max_height,
-					     FALSE))
-		{
-			cairo_surface_t *scaled;
+		/* change the file extension to jpeg */
 
-			scaled = _cairo_image_surface_scale (surface, w, h, SCALE_FILTER_BEST, NULL);
-			if (scaled != NULL) {
-				g_object_unref (idata->preview);
+		filename_no_ext = _g_path_remove_extension (idata->dest_filename);
+		g_free (idata->dest_filename);
+		idata->dest_filename = g_strconcat (filename_no_ext, ".jpeg", NULL);
+		g_free (filename_no_ext);
+	}
 
-				idata->preview = gth_image_new_for_surface (scaled);
-				idata->preview_width = cairo_image_surface_get_width (scaled);
-				idata->preview_height = cairo_image_surface_get_height (scaled);
+	if (job->resize_image || job->copy_image)
+		job->image_file = get_image_file (self, idata, self->priv->tmp_dir);
+	idata->no_preview = job->no_preview;
+	job->preview_file = get_preview_file (self, idata, self->priv->tmp_dir);
+	job->thumbnail_file = get_thumbnail_file (self, idata, self->priv->tmp_dir);
 
-				cairo_surface_destroy (scaled);
-			}
-		}
-	}
+	task = g_task_new (NULL, gth_task_get_cancellable (GTH_TASK (self)), image_processed_cb, job);
+	g_task_set_task_data (task, job, NULL);
+	g_task_run_in_thread (task, process_image_thread);
 
-	idata->no_preview = ((idata->preview_width == idata->image_width)
-			     && (idata->preview_height == idata->image_height));
+	g_object_unref (task);
+}
 
-	if (idata->no_preview && (idata->preview != NULL)) {
-		g_object_unref (idata->preview);
-		idata->preview = NULL;
-	}
 
-	/* thumbnail. */
+static void
+image_job_load (ImageJob *job,
+		int       requested_size)
+{
+	job->requested_size = requested_size;
+	gth_image_loader_load (job->exporter->priv->iloader,
+			       job->idata->file_data,
+			       requested_size,
+			       G_PRIORITY_DEFAULT,
+			       gth_task_get_cancellable (GTH_TASK (job->exporter)),
+			       image_loader_ready_cb,
+			       job);
+}
 
-	idata->thumb = g_object_ref (image);
-	idata->thumb_width = cairo_image_surface_get_width (surface);
-	idata->thumb_height = cairo_image_surface_get_width (surface);
 
-	if ((self->priv->thumb_width > 0) && (self->priv->thumb_height > 0)) {
-		int w = cairo_image_surface_get_width (surface);
-		int h = cairo_image_surface_get_height (surface);
+static int
+image_data_cmp (gconstpointer a,
+		gconstpointer b,
+		gpointer      user_data)
+{
+	GthWebExporter *self = user_data;
+	ImageData      *idata_a = (ImageData *) a;
+	ImageData      *idata_b = (ImageData *) b;
 
-		if (self->priv->squared_thumbnails) {
-			cairo_surface_t *scaled;
+	return self->priv->sort_type->cmp_func (idata_a->file_data, idata_b->file_data);
+}
 
-			g_object_unref (idata->thumb);
 
-			scaled = _cairo_image_surface_scale_squared (surface, self->priv->thumb_width, SCALE_FILTER_BEST, NULL);
-			idata->thumb = gth_image_new_for_surface (scaled);
-			idata->thumb_width = cairo_image_surface_get_width (scaled);
-			idata->thumb_height = cairo_image_surface_get_height (scaled);
+static void
+image_jobs_continue (GthWebExporter *self)
+{
+	if (self->priv->interrupted && (self->priv->pipeline_error == NULL))
+		self->priv->pipeline_error = g_error_new_literal (GTH_TASK_ERROR, GTH_TASK_ERROR_CANCELLED, "");
 
-			cairo_surface_destroy (scaled);
-		}
-		else if (scale_keeping_ratio (&w, &h,
-					      self->priv->thumb_width,
-					      self->priv->thumb_height,
-					      FALSE))
-		{
-			cairo_surface_t *scaled;
+	/* current_file is the next file to load */
 
-			scaled = _cairo_image_surface_scale (surface, w, h, SCALE_FILTER_BEST, NULL);
-			if (scaled != NULL) {
-				g_object_unref (idata->thumb);
+	if (self->priv->pipeline_error == NULL) {
+		int max_jobs = _g_get_n_worker_threads ();
 
-				idata->thumb = gth_image_new_for_surface (scaled);
-				idata->thumb_width = cairo_image_surface_get_width (scaled);
-				idata->thumb_height = cairo_image_surface_get_height (scaled);
+		while ((self->priv->current_file != NULL) && (self->priv->n_active_jobs < max_jobs)) {
+			ImageData *idata = self->priv->current_file->data;
 
-				cairo_surface_destroy (scaled);
+			self->priv->current_file = self->priv->current_file->next;
+			if (idata->reused) {
+				self->priv->image++;
+				continue;
 			}
-		}
-	}
-
-	/* save the image */
 
-	if (self->priv->copy_images) {
-		if (self->priv->resize_images)
-			self->priv->saving_timeout = g_idle_add (save_resized_image, self);
-		else
-			copy_current_file (self);
+			self->priv->n_active_jobs++;
+			image_job_load (image_job_new (self, idata), self->priv->requested_size);
+		}
 	}
-	else
-		self->priv->saving_timeout = g_idle_add (save_image_preview, self);
 
-	cairo_surface_destroy (surface);
-	g_object_unref (image);
-}
+	if (self->priv->n_active_jobs > 0)
+		return;
 
+	if (self->priv->pipeline_error != NULL) {
+		GError *error = self->priv->pipeline_error;
 
-static void
-load_current_file (GthWebExporter *self)
-{
-	GthFileData *file_data;
-
-	if (self->priv->current_file == NULL) {
-		if ((self->priv->sort_type != NULL) && (self->priv->sort_type->cmp_func != NULL))
-			self->priv->file_list = g_list_sort_with_data (self->priv->file_list, image_data_cmp, self);
-		if (self->priv->sort_inverse)
-			self->priv->file_list = g_list_reverse (self->priv->file_list);
-		save_html_files (self);
+		self->priv->pipeline_error = NULL;
+		cleanup_and_terminate (self, error);
+		g_error_free (error);
 		return;
 	}
 
-	file_data = IMAGE_DATA (self->priv->current_file->data)->file_data;
-	gth_task_progress (GTH_TASK (self),
-			   _("Loading images"),
-			   g_file_info_get_display_name (file_data->info),
-			   FALSE,
-			   (double) (self->priv->image + 1) / (self->priv->n_images + 1));
+	/* all the images have been saved */
 
-	gth_image_loader_load (self->priv->iloader,
-			       file_data,
-			       -1,
-			       G_PRIORITY_DEFAULT,
-			       gth_task_get_cancellable (GTH_TASK (self)),
-			       image_loader_ready_cb,
-			       self);
+	if ((self->priv->sort_type != NULL) && (self->priv->sort_type->cmp_func != NULL))
+		self->priv->file_list = g_list_sort_with_data (self->priv->file_list, image_data_cmp, self);
+	if (self->priv->sort_inverse)
+		self->priv->file_list = g_list_reverse (self->priv->file_list);
+	save_html_files (self);
 }
 
 
@@ -2726,25 +3257,43 @@ file_list_info_ready_cb (GList    *files,
 {
 	GthWebExporter *self = user_data;
 	GList          *scan;
-	int             file_idx;
 
 	if (error != NULL) {
 		cleanup_and_terminate (self, error);
 		return;
 	}
 
-	file_idx = 0;
+	manifest_load (self);
 	for (scan = files; scan; scan = scan->next) {
 		GthFileData *file_data = scan->data;
-		self->priv->file_list = g_list_prepend (self->priv->file_list, image_data_new (file_data, file_idx++));
+		ImageData   *idata;
+		char        *dest_filename;
+
+		/* keep the name used in the previous album */
+
+		dest_filename = manifest_get_dest_filename (self, file_data);
+		idata = image_data_new (file_data, self->priv->next_file_idx);
+		if (dest_filename != NULL) {
+			g_free (idata->dest_filename);
+			idata->dest_filename = dest_filename;
+			idata->reused = manifest_restore_image (self, idata);
+		}
+		else
+			self->priv->next_file_idx++;
+
+		self->priv->file_list = g_list_prepend (self->priv->file_list, idata);
 	}
 	self->priv->file_list = g_list_reverse (self->priv->file_list);
 
-	/* load the thumbnails */
+	/* create the images */
+
+	gth_task_progress (GTH_TASK (self), _("Saving images"), NULL, TRUE, 0);
 
 	self->priv->image = 0;
+	self->priv->n_active_jobs = 0;
+	self->priv->requested_size = get_requested_size (self);
 	self->priv->current_file = self->priv->file_list;
-	load_current_file (self);
+	image_jobs_continue (self);
 }
 
 
@@ -3113,6 +3662,8 @@ gth_web_exporter_finalize (GObject *object)
 	g_free (self->priv->directories.theme_files);
 	g_free (self->priv->index_file);
 	_g_object_unref (self->priv->iloader);
+	if (self->priv->pipeline_error != NULL)
+		g_error_free (self->priv->pipeline_error);
 	g_free (self->priv->thumbnail_caption);
 	g_free (self->priv->image_attributes);
 	free_parsed_docs (self);
@@ -3124,6 +3675,10 @@ gth_web_exporter_finalize (GObject *object)
 	if (self->priv->timestamp != NULL)
 		g_date_time_unref (self->priv->timestamp);
 	_g_object_unref (self->priv->location);
+	if (self->priv->manifest != NULL)
+		g_key_file_free (self->priv->manifest);
+	if (self->priv->old_manifest != NULL)
+		g_key_file_free (self->priv->old_manifest);
 
 	G_OBJECT_CLASS (gth_web_exporter_parent_class)->finalize (object);
 }
@@ -3184,9 +3739,17 @@ gth_web_exporter_init (GthWebExporter *self)
 	self->priv->tmp_dir = NULL;
 	self->priv->interrupted = FALSE;
 	self->priv->iloader = gth_image_loader_new (NULL, NULL);
+	self->priv->n_active_jobs = 0;
+	self->priv->requested_size = -1;
+	self->priv->pipeline_error = NULL;
 	self->priv->error = NULL;
 	self->priv->timestamp = NULL;
 	self->priv->location = NULL;
+	self->priv->incremental = FALSE;
+	self->priv->manifest = NULL;
+	self->priv->old_manifest = NULL;
+	self->priv->reuse_images = FALSE;
+	self->priv->next_file_idx = 0;
 }
 
 
@@ -3299,6 +3862,16 @@ gth_web_exporter_set_copy_images (GthWebExporter *self,
 }
 
 
+void
+gth_web_exporter_set_incremental (GthWebExporter *self,
+				  gboolean        incremental)
+{
+	g_return_if_fail (GTH_IS_WEB_EXPORTER (self));
+
+	self->priv->incremental = incremental;
+}
+
+
 void
 gth_web_exporter_set_resize_images (GthWebExporter *self,
 				    gboolean        resize,
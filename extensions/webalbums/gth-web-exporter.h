@@ -67,6 +67,8 @@ void       gth_web_exporter_set_use_subfolders    (GthWebExporter   *self,
 						   gboolean          use_subfolders);
 void       gth_web_exporter_set_copy_images       (GthWebExporter   *self,
 						   gboolean          copy);
+void       gth_web_exporter_set_incremental       (GthWebExporter   *self,
+						   gboolean          incremental);
 void       gth_web_exporter_set_resize_images     (GthWebExporter   *self,
 						   gboolean          resize,
 						   int               max_width,
@@ -39,6 +39,7 @@ G_BEGIN_DECLS
 #define PREF_WEBALBUMS_RESIZE_IMAGES            "resize-images"
 #define PREF_WEBALBUMS_RESIZE_WIDTH             "resize-width"
 #define PREF_WEBALBUMS_RESIZE_HEIGHT            "resize-height"
+#define PREF_WEBALBUMS_INCREMENTAL              "incremental"
 #define PREF_WEBALBUMS_IMAGES_PER_INDEX         "images-per-index"
 #define PREF_WEBALBUMS_SINGLE_INDEX             "single-index"
 #define PREF_WEBALBUMS_COLUMNS                  "columns"
@@ -0,0 +1,545 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2012 The Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <cairo.h>
+#include "cairo-utils.h"
+#include "cairo-scale-kernels.h"
+
+
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__GNUC__)
+#define USE_X86_KERNELS
+#include <immintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define USE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+
+/* -- scale_weights_t --
+ *
+ * The filter weights of a scaling pass only depend on the destination
+ * line, so they are computed once per pass and stored as 16 bit fixed
+ * point values, this way the inner loops only use integer operations.
+ * The number of fractional bits is the largest value that allows the
+ * biggest weight to fit in 16 bits and the accumulators to fit in 32
+ * bits.
+ *
+ * */
+
+
+#define MAX_PRECISION_BITS 22
+#define MAX_FIXED_WEIGHT   32767
+
+
+scale_weights_t *
+scale_weights_new (ScaleWeightFunc weight_func,
+		   gpointer        user_data,
+		   double          filter_support,
+		   double          scale_factor,
+		   int             image_width,
+		   int             n_lines)
+{
+	scale_weights_t *scale_weights;
+	double           scale;
+	double           support;
+	double          *real_weights;
+	double           max_weight;
+	int              y;
+
+	scale = MAX (1.0 / scale_factor, 1.0);
+	support = scale * filter_support;
+	if (support < 0.5) {
+		support = 0.5;
+		scale = 1.0;
+	}
+	scale = 1.0 / scale;
+
+	scale_weights = g_new (scale_weights_t, 1);
+	scale_weights->n_lines = n_lines;
+	scale_weights->max_taps = 2.0 * support + 3.0;
+	scale_weights->start = g_new (int, n_lines);
+	scale_weights->n_taps = g_new (int, n_lines);
+	scale_weights->weights = g_new0 (gint16, (gsize) n_lines * scale_weights->max_taps);
+
+	/* compute the normalized weights */
+
+	real_weights = g_new (double, (gsize) n_lines * scale_weights->max_taps);
+	max_weight = 0.0;
+	for (y = 0; y < n_lines; y++) {
+		double    *weights;
+		double     bisect;
+		int        start;
+		int        stop;
+		double     density;
+		int        n;
+		int        i;
+
+		weights = real_weights + ((gsize) y * scale_weights->max_taps);
+		bisect = ((double) y + 0.5) / scale_factor;
+		start = bisect - support + 0.5;
+		start = MAX (start, 0);
+		stop = bisect + support + 0.5;
+		stop = MIN (stop, image_width);
+
+		density = 0.0;
+		for (n = 0; n < stop - start; n++) {
+			weights[n] = weight_func (scale * ((double) (start + n) - bisect + 0.5), user_data);
+			density += weights[n];
+		}
+
+		if ((density != 0.0) && (density != 1.0)) {
+			density = 1.0 / density;
+			for (i = 0; i < n; i++)
+				weights[i] *= density;
+		}
+
+		for (i = 0; i < n; i++)
+			max_weight = MAX (max_weight, fabs (weights[i]));
+
+		scale_weights->start[y] = start;
+		scale_weights->n_taps[y] = n;
+	}
+
+	/* choose the precision, leave some room for the rounding error
+	 * correction */
+
+	scale_weights->precision = MAX_PRECISION_BITS;
+	while ((scale_weights->precision > 1)
+	       && (max_weight * (1 << scale_weights->precision) + scale_weights->max_taps > MAX_FIXED_WEIGHT))
+	{
+		scale_weights->precision--;
+	}
+
+	/* convert to fixed point */
+
+	for (y = 0; y < n_lines; y++) {
+		double    *weights;
+		gint16    *fixed_weights;
+		int        n;
+		int        sum;
+		int        max_i;
+		int        i;
+
+		weights = real_weights + ((gsize) y * scale_weights->max_taps);
+		fixed_weights = scale_weights->weights + ((gsize) y * scale_weights->max_taps);
+		n = scale_weights->n_taps[y];
+		sum = 0;
+		max_i = 0;
+		for (i = 0; i < n; i++) {
+			fixed_weights[i] = (gint16) floor (weights[i] * (1 << scale_weights->precision) + 0.5);
+			sum += fixed_weights[i];
+			if (fixed_weights[i] > fixed_weights[max_i])
+				max_i = i;
+		}
+
+		/* make the weights sum exactly to one, otherwise uniform
+		 * areas could change color. */
+
+		if ((n > 0) && (sum != 0))
+			fixed_weights[max_i] += (1 << scale_weights->precision) - sum;
+	}
+
+	g_free (real_weights);
+
+	return scale_weights;
+}
+
+
+void
+scale_weights_free (scale_weights_t *scale_weights)
+{
+	g_free (scale_weights->weights);
+	g_free (scale_weights->n_taps);
+	g_free (scale_weights->start);
+	g_free (scale_weights);
+}
+
+
+/* -- line kernels --
+ *
+ * Compute a destination line: every destination pixel is the weighted sum
+ * of n adjacent pixels of a source row, the source row changes with every
+ * destination pixel, this way the result is transposed.
+ *
+ * */
+
+
+typedef void (*scale_line_func_t) (const guchar *p_src_row,
+				   int           src_rowstride,
+				   guchar       *p_dest_pixel,
+				   int           scaled_width,
+				   const gint16 *weights,
+				   int           n,
+				   int           precision);
+
+
+static void
+scale_line_generic (const guchar *p_src_row,
+		    int           src_rowstride,
+		    guchar       *p_dest_pixel,
+		    int           scaled_width,
+		    const gint16 *weights,
+		    int           n,
+		    int           precision)
+{
+	int x, i, temp;
+
+	for (x = 0; x < scaled_width; x++) {
+		const guchar *p_src_pixel;
+		gint32        r, g, b, a, w;
+
+		p_src_pixel = p_src_row;
+		r = g = b = a = 1 << (precision - 1);
+		for (i = 0; i < n; i++) {
+			w = weights[i];
+
+			r += w * p_src_pixel[CAIRO_RED];
+			g += w * p_src_pixel[CAIRO_GREEN];
+			b += w * p_src_pixel[CAIRO_BLUE];
+			a += w * p_src_pixel[CAIRO_ALPHA];
+
+			p_src_pixel += 4;
+		}
+
+		p_dest_pixel[CAIRO_RED] = CLAMP_PIXEL (r >> precision);
+		p_dest_pixel[CAIRO_GREEN] = CLAMP_PIXEL (g >> precision);
+		p_dest_pixel[CAIRO_BLUE] = CLAMP_PIXEL (b >> precision);
+		p_dest_pixel[CAIRO_ALPHA] = CLAMP_PIXEL (a >> precision);
+
+		p_dest_pixel += 4;
+		p_src_row += src_rowstride;
+	}
+}
+
+
+#ifdef USE_X86_KERNELS
+
+
+/* Two adjacent taps are interleaved channel by channel, this way
+ * _mm_madd_epi16 multiplies and adds them in a single operation. */
+
+
+#define PACK_WEIGHTS(w0, w1) ((gint32) (((guint32) (guint16) (w1) << 16) | (guint16) (w0)))
+
+
+__attribute__ ((target ("sse2")))
+inline static __m128i
+sse2_interleave_taps (__m128i pixels)
+{
+	pixels = _mm_unpacklo_epi8 (pixels, _mm_setzero_si128 ());
+	return _mm_unpacklo_epi16 (pixels, _mm_srli_si128 (pixels, 8));
+}
+
+
+__attribute__ ((target ("sse2")))
+inline static void
+sse2_store_pixel (guchar  *p_dest_pixel,
+		  __m128i  sum,
+		  int      precision)
+{
+	sum = _mm_sra_epi32 (sum, _mm_cvtsi32_si128 (precision));
+	sum = _mm_packs_epi32 (sum, sum);
+	sum = _mm_packus_epi16 (sum, sum);
+	*((guint32 *) p_dest_pixel) = (guint32) _mm_cvtsi128_si32 (sum);
+}
+
+
+__attribute__ ((target ("sse2")))
+static void
+scale_line_sse2 (const guchar *p_src_row,
+		 int           src_rowstride,
+		 guchar       *p_dest_pixel,
+		 int           scaled_width,
+		 const gint16 *weights,
+		 int           n,
+		 int           precision)
+{
+	int x, i;
+
+	for (x = 0; x < scaled_width; x++) {
+		const guchar *p_src_pixel;
+		__m128i       sum;
+
+		p_src_pixel = p_src_row;
+		sum = _mm_set1_epi32 (1 << (precision - 1));
+		for (i = 0; i + 1 < n; i += 2) {
+			__m128i pixels;
+			__m128i w;
+
+			pixels = sse2_interleave_taps (_mm_loadl_epi64 ((const __m128i *) p_src_pixel));
+			w = _mm_set1_epi32 (PACK_WEIGHTS (weights[i], weights[i + 1]));
+			sum = _mm_add_epi32 (sum, _mm_madd_epi16 (pixels, w));
+			p_src_pixel += 8;
+		}
+		if (i < n) {
+			__m128i pixels;
+
+			pixels = sse2_interleave_taps (_mm_cvtsi32_si128 (*((const gint32 *) p_src_pixel)));
+			sum = _mm_add_epi32 (sum, _mm_madd_epi16 (pixels, _mm_set1_epi32 (PACK_WEIGHTS (weights[i], 0))));
+		}
+		sse2_store_pixel (p_dest_pixel, sum, precision);
+
+		p_dest_pixel += 4;
+		p_src_row += src_rowstride;
+	}
+}
+
+
+__attribute__ ((target ("avx2")))
+static void
+scale_line_avx2 (const guchar *p_src_row,
+		 int           src_rowstride,
+		 guchar       *p_dest_pixel,
+		 int           scaled_width,
+		 const gint16 *weights,
+		 int           n,
+		 int           precision)
+{
+	int x, i;
+
+	for (x = 0; x < scaled_width; x++) {
+		const guchar *p_src_pixel;
+		__m256i       sum4;
+		__m128i       sum;
+
+		p_src_pixel = p_src_row;
+		sum4 = _mm256_setzero_si256 ();
+		for (i = 0; i + 3 < n; i += 4) {
+			__m256i pixels;
+			gint32  w01, w23;
+			__m256i w;
+
+			/* taps i and i+1 in the low lane, i+2 and i+3 in
+			 * the high lane. */
+			pixels = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) p_src_pixel));
+			pixels = _mm256_unpacklo_epi16 (pixels, _mm256_srli_si256 (pixels, 8));
+			w01 = PACK_WEIGHTS (weights[i], weights[i + 1]);
+			w23 = PACK_WEIGHTS (weights[i + 2], weights[i + 3]);
+			w = _mm256_set_epi32 (w23, w23, w23, w23, w01, w01, w01, w01);
+			sum4 = _mm256_add_epi32 (sum4, _mm256_madd_epi16 (pixels, w));
+			p_src_pixel += 16;
+		}
+
+		sum = _mm_add_epi32 (_mm256_castsi256_si128 (sum4), _mm256_extracti128_si256 (sum4, 1));
+		sum = _mm_add_epi32 (sum, _mm_set1_epi32 (1 << (precision - 1)));
+		for (/* void */; i + 1 < n; i += 2) {
+			__m128i pixels;
+			__m128i w;
+
+			pixels = sse2_interleave_taps (_mm_loadl_epi64 ((const __m128i *) p_src_pixel));
+			w = _mm_set1_epi32 (PACK_WEIGHTS (weights[i], weights[i + 1]));
+			sum = _mm_add_epi32 (sum, _mm_madd_epi16 (pixels, w));
+			p_src_pixel += 8;
+		}
+		if (i < n) {
+			__m128i pixels;
+
+			pixels = sse2_interleave_taps (_mm_cvtsi32_si128 (*((const gint32 *) p_src_pixel)));
+			sum = _mm_add_epi32 (sum, _mm_madd_epi16 (pixels, _mm_set1_epi32 (PACK_WEIGHTS (weights[i], 0))));
+		}
+		sse2_store_pixel (p_dest_pixel, sum, precision);
+
+		p_dest_pixel += 4;
+		p_src_row += src_rowstride;
+	}
+}
+
+
+#endif /* USE_X86_KERNELS */
+
+
+#ifdef USE_NEON_KERNELS
+
+
+static void
+scale_line_neon (const guchar *p_src_row,
+		 int           src_rowstride,
+		 guchar       *p_dest_pixel,
+		 int           scaled_width,
+		 const gint16 *weights,
+		 int           n,
+		 int           precision)
+{
+	int x, i;
+
+	for (x = 0; x < scaled_width; x++) {
+		const guchar *p_src_pixel;
+		int32x4_t     sum;
+		int16x4_t     result;
+
+		p_src_pixel = p_src_row;
+		sum = vdupq_n_s32 (1 << (precision - 1));
+		for (i = 0; i + 1 < n; i += 2) {
+			int16x8_t pixels;
+
+			pixels = vreinterpretq_s16_u16 (vmovl_u8 (vld1_u8 (p_src_pixel)));
+			sum = vmlal_n_s16 (sum, vget_low_s16 (pixels), weights[i]);
+			sum = vmlal_n_s16 (sum, vget_high_s16 (pixels), weights[i + 1]);
+			p_src_pixel += 8;
+		}
+		if (i < n) {
+			uint8x8_t pixel;
+
+			pixel = vreinterpret_u8_u32 (vld1_dup_u32 ((const guint32 *) p_src_pixel));
+			sum = vmlal_n_s16 (sum, vget_low_s16 (vreinterpretq_s16_u16 (vmovl_u8 (pixel))), weights[i]);
+		}
+
+		sum = vshlq_s32 (sum, vdupq_n_s32 (- precision));
+		result = vqmovn_s32 (sum);
+		vst1_lane_u32 ((guint32 *) p_dest_pixel,
+			       vreinterpret_u32_u8 (vqmovun_s16 (vcombine_s16 (result, result))),
+			       0);
+
+		p_dest_pixel += 4;
+		p_src_row += src_rowstride;
+	}
+}
+
+
+#endif /* USE_NEON_KERNELS */
+
+
+static scale_line_func_t
+get_kernel_func (ScaleKernel kernel)
+{
+	switch (kernel) {
+	case SCALE_KERNEL_GENERIC:
+		return scale_line_generic;
+#if defined (USE_X86_KERNELS)
+	case SCALE_KERNEL_SSE2:
+		__builtin_cpu_init ();
+		return __builtin_cpu_supports ("sse2") ? scale_line_sse2 : NULL;
+	case SCALE_KERNEL_AVX2:
+		__builtin_cpu_init ();
+		return __builtin_cpu_supports ("avx2") ? scale_line_avx2 : NULL;
+#elif defined (USE_NEON_KERNELS)
+	case SCALE_KERNEL_NEON:
+		return scale_line_neon;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+
+static scale_line_func_t
+get_scale_line_func (void)
+{
+	static scale_line_func_t scale_line_func = NULL;
+	static gsize             initialization = 0;
+
+	if (g_once_init_enter (&initialization)) {
+		ScaleKernel kernel;
+
+		/* the last supported kernel is the fastest one */
+
+		for (kernel = SCALE_KERNEL_GENERIC; kernel < SCALE_KERNEL_N; kernel++) {
+			scale_line_func_t func = get_kernel_func (kernel);
+			if (func != NULL)
+				scale_line_func = func;
+		}
+		g_once_init_leave (&initialization, 1);
+	}
+
+	return scale_line_func;
+}
+
+
+static void
+_scale_weights_apply (scale_weights_t   *scale_weights,
+		      scale_line_func_t  scale_line,
+		      const guchar      *p_src,
+		      int                src_rowstride,
+		      guchar            *p_dest,
+		      int                dest_rowstride,
+		      int                scaled_width,
+		      int                first_line,
+		      int                last_line)
+{
+	int y;
+
+	for (y = first_line; y < last_line; y++)
+		scale_line (p_src + (scale_weights->start[y] * 4),
+			    src_rowstride,
+			    p_dest + ((gsize) y * dest_rowstride),
+			    scaled_width,
+			    scale_weights->weights + ((gsize) y * scale_weights->max_taps),
+			    scale_weights->n_taps[y],
+			    scale_weights->precision);
+}
+
+
+void
+scale_weights_apply (scale_weights_t *scale_weights,
+		     const guchar    *p_src,
+		     int              src_rowstride,
+		     guchar          *p_dest,
+		     int              dest_rowstride,
+		     int              scaled_width,
+		     int              first_line,
+		     int              last_line)
+{
+	_scale_weights_apply (scale_weights,
+			      get_scale_line_func (),
+			      p_src,
+			      src_rowstride,
+			      p_dest,
+			      dest_rowstride,
+			      scaled_width,
+			      first_line,
+			      last_line);
+}
+
+
+gboolean
+scale_kernel_is_supported (ScaleKernel kernel)
+{
+	return get_kernel_func (kernel) != NULL;
+}
+
+
+/* Same as scale_weights_apply but with the given kernel, to compare the
+ * kernels with each other. */
+void
+scale_weights_apply_with_kernel (scale_weights_t *scale_weights,
+				 ScaleKernel      kernel,
+				 const guchar    *p_src,
+				 int              src_rowstride,
+				 guchar          *p_dest,
+				 int              dest_rowstride,
+				 int              scaled_width,
+				 int              first_line,
+				 int              last_line)
+{
+	g_return_if_fail (scale_kernel_is_supported (kernel));
+
+	_scale_weights_apply (scale_weights,
+			      get_kernel_func (kernel),
+			      p_src,
+			      src_rowstride,
+			      p_dest,
+			      dest_rowstride,
+			      scaled_width,
+			      first_line,
+			      last_line);
+}
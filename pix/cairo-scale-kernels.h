@@ -0,0 +1,83 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2012 The Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAIRO_SCALE_KERNELS_H
+#define CAIRO_SCALE_KERNELS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The implementations of the inner loop, from the slowest to the
+ * fastest. */
+typedef enum {
+	SCALE_KERNEL_GENERIC,
+	SCALE_KERNEL_SSE2,
+	SCALE_KERNEL_AVX2,
+	SCALE_KERNEL_NEON,
+	SCALE_KERNEL_N
+} ScaleKernel;
+
+typedef double (*ScaleWeightFunc) (double   distance,
+				   gpointer user_data);
+
+/* The filter weights of every destination line of a scaling pass, as 16
+ * bit fixed point values with 'precision' fractional bits.  Line y is the
+ * weighted sum of 'n_taps[y]' adjacent source pixels starting from
+ * 'start[y]'. */
+typedef struct {
+	int     n_lines;
+	int     max_taps;
+	int     precision;
+	int    *start;
+	int    *n_taps;
+	gint16 *weights;
+} scale_weights_t;
+
+scale_weights_t *  scale_weights_new               (ScaleWeightFunc  weight_func,
+						    gpointer         user_data,
+						    double           support,
+						    double           scale_factor,
+						    int              image_width,
+						    int              n_lines);
+void               scale_weights_free              (scale_weights_t *scale_weights);
+void               scale_weights_apply             (scale_weights_t *scale_weights,
+						    const guchar    *p_src,
+						    int              src_rowstride,
+						    guchar          *p_dest,
+						    int              dest_rowstride,
+						    int              scaled_width,
+						    int              first_line,
+						    int              last_line);
+gboolean           scale_kernel_is_supported       (ScaleKernel      kernel);
+void               scale_weights_apply_with_kernel (scale_weights_t *scale_weights,
+						    ScaleKernel      kernel,
+						    const guchar    *p_src,
+						    int              src_rowstride,
+						    guchar          *p_dest,
+						    int              dest_rowstride,
+						    int              scaled_width,
+						    int              first_line,
+						    int              last_line);
+
+G_END_DECLS
+
+#endif /* CAIRO_SCALE_KERNELS_H */
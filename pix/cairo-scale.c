@@ -25,6 +25,7 @@
 #include <cairo.h>
 #include "cairo-utils.h"
 #include "cairo-scale.h"
+#include "cairo-scale-kernels.h"
 #include "gfixed.h"
 #include "glib-utils.h"
 
@@ -33,15 +34,6 @@ typedef double ScaleReal;
 typedef ScaleReal (*weight_func_t) (ScaleReal distance);
 
 
-#ifdef HAVE_VECTOR_OPERATIONS
-
-
-typedef ScaleReal v4r __attribute__ ((vector_size(sizeof(ScaleReal) * 4)));
-
-
-#endif /* HAVE_VECTOR_OPERATIONS */
-
-
 /* -- _cairo_image_surface_scale_nearest -- */
 
 
@@ -279,9 +271,9 @@ typedef struct {
 	weight_func_t  weight_func;
 	ScaleReal      support;
 	GthAsyncTask  *task;
-	gulong         total_lines;
-	gulong         processed_lines;
-	gboolean       cancelled;
+	gint           total_lines;
+	gint           processed_lines;
+	gint           cancelled;
 } resize_filter_t;
 
 
@@ -338,157 +330,106 @@ resize_filter_get_weight (resize_filter_t *resize_filter,
 }
 
 
-static void
-resize_filter_destroy (resize_filter_t *resize_filter)
+static double
+resize_filter_weight_func (double   distance,
+			   gpointer user_data)
 {
-	g_free (resize_filter);
+	return resize_filter_get_weight ((resize_filter_t *) user_data, distance);
 }
 
 
 static void
-horizontal_scale_transpose (cairo_surface_t *image,
-			    cairo_surface_t *scaled,
-			    ScaleReal        scale_factor,
-			    resize_filter_t *resize_filter)
+resize_filter_destroy (resize_filter_t *resize_filter)
 {
-	ScaleReal  scale;
-	ScaleReal  support;
-	int        y;
-	int        image_width;
-	int        scaled_width;
-	int        scaled_height;
-	guchar    *p_src;
-	guchar    *p_dest;
-	int        src_rowstride;
-	int        dest_rowstride;
-	ScaleReal *weights;
-
-	if (resize_filter->cancelled)
-		return;
-
-	scale = MAX ((ScaleReal) 1.0 / scale_factor, 1.0);
-	support = scale * resize_filter_get_support (resize_filter);
-	if (support < 0.5) {
-		support = 0.5;
-		scale = 1.0;
-	}
-
-	image_width = cairo_image_surface_get_width (image);
-	scaled_width = cairo_image_surface_get_width (scaled);
-	scaled_height = cairo_image_surface_get_height (scaled);
-	p_src = _cairo_image_surface_flush_and_get_data (image);
-	p_dest = _cairo_image_surface_flush_and_get_data (scaled);
-	src_rowstride = cairo_image_surface_get_stride (image);
-	dest_rowstride = cairo_image_surface_get_stride (scaled);
-	weights = g_new (ScaleReal, 2.0 * support + 3.0);
-
-	scale = 1.0 / scale;
-	for (y = 0; y < scaled_height; y++) {
-		guchar    *p_src_row;
-		guchar    *p_dest_pixel;
-		ScaleReal  bisect;
-		int        start;
-		int        stop;
-		ScaleReal  density;
-		int        n;
-		int        x;
-		int        i;
-		int        temp;
-#ifdef HAVE_VECTOR_OPERATIONS
-		v4r        v_pixel, v_rgba;
-#endif /* HAVE_VECTOR_OPERATIONS */
-
-		if (resize_filter->task != NULL) {
-			double progress;
-
-			gth_async_task_get_data (resize_filter->task, NULL, &resize_filter->cancelled, NULL);
-			if (resize_filter->cancelled)
-				goto out;
-
-			progress = (double) resize_filter->processed_lines++ / resize_filter->total_lines;
-			gth_async_task_set_data (resize_filter->task, NULL, NULL, &progress);
-		}
-
-		bisect = ((ScaleReal) y + 0.5) / scale_factor;
-		start = bisect - support + 0.5;
-		start = MAX (start, 0);
-		stop = bisect + support + 0.5;
-		stop = MIN (stop, image_width);
-
-		density = 0.0;
-		for (n = 0; n < stop - start; n++) {
-			weights[n] = resize_filter_get_weight (resize_filter, scale * ((ScaleReal) (start + n) - bisect + 0.5));
-			density += weights[n];
-		}
+	g_free (resize_filter);
+}
 
-		/*
-		g_assert (n == stop - start);
-		g_assert (stop - start <= (2.0 * support) + 3);
-		*/
-
-		if ((density != 0.0) && (density != 1.0)) {
-			density = 1.0 / density;
-			for (i = 0; i < n; i++)
-				weights[i] *= density;
-		}
 
-		p_src_row = p_src + (start * 4);
-		p_dest_pixel = p_dest;
-		for (x = 0; x < scaled_width; x++) {
-			guchar *p_src_pixel;
+/* -- horizontal_scale_transpose -- */
 
-			p_src_pixel = p_src_row;
 
-#ifdef HAVE_VECTOR_OPERATIONS
+#define SCALE_BAND_LINES    16
+#define MIN_PARALLEL_PIXELS (256 * 1024) /* smaller passes are not worth the threads overhead */
 
-			v_rgba = (v4r) { 0.0, 0.0, 0.0, 0.0 };
-			for (i = 0; i < n; i++) {
-				v_pixel = (v4r) { p_src_pixel[0], p_src_pixel[1], p_src_pixel[2], p_src_pixel[3] };
-				v_rgba = v_rgba + (v_pixel * weights[i]);
-				p_src_pixel += 4;
-			}
-			v_rgba = v_rgba + 0.5;
 
-			p_dest_pixel[0] = CLAMP_PIXEL (v_rgba[0]);
-			p_dest_pixel[1] = CLAMP_PIXEL (v_rgba[1]);
-			p_dest_pixel[2] = CLAMP_PIXEL (v_rgba[2]);
-			p_dest_pixel[3] = CLAMP_PIXEL (v_rgba[3]);
+typedef struct {
+	cairo_surface_t *image;
+	cairo_surface_t *scaled;
+	resize_filter_t *resize_filter;
+	scale_weights_t *scale_weights;
+} scale_pass_t;
 
-#else /* ! HAVE_VECTOR_OPERATIONS */
 
-			ScaleReal r, g, b, a, w;
+static void
+scale_band (int      first_line,
+	    int      last_line,
+	    gpointer user_data)
+{
+	scale_pass_t    *pass = user_data;
+	resize_filter_t *resize_filter = pass->resize_filter;
 
-			r = g = b = a = 0.0;
-			for (i = 0; i < n; i++) {
-				w = weights[i];
+	if (g_atomic_int_get (&resize_filter->cancelled))
+		return;
 
-				r += w * p_src_pixel[CAIRO_RED];
-				g += w * p_src_pixel[CAIRO_GREEN];
-				b += w * p_src_pixel[CAIRO_BLUE];
-				a += w * p_src_pixel[CAIRO_ALPHA];
+	if (resize_filter->task != NULL) {
+		gboolean cancelled;
+		double   progress;
 
-				p_src_pixel += 4;
-			}
+		gth_async_task_get_data (resize_filter->task, NULL, &cancelled, NULL);
+		if (cancelled) {
+			g_atomic_int_set (&resize_filter->cancelled, TRUE);
+			return;
+		}
 
-			p_dest_pixel[CAIRO_RED] = CLAMP_PIXEL (r + 0.5);
-			p_dest_pixel[CAIRO_GREEN] = CLAMP_PIXEL (g + 0.5);
-			p_dest_pixel[CAIRO_BLUE] = CLAMP_PIXEL (b + 0.5);
-			p_dest_pixel[CAIRO_ALPHA] = CLAMP_PIXEL (a + 0.5);
+		progress = (double) g_atomic_int_add (&resize_filter->processed_lines, last_line - first_line) / resize_filter->total_lines;
+		gth_async_task_set_data (resize_filter->task, NULL, NULL, &progress);
+	}
 
-#endif /* HAVE_VECTOR_OPERATIONS */
+	scale_weights_apply (pass->scale_weights,
+			     cairo_image_surface_get_data (pass->image),
+			     cairo_image_surface_get_stride (pass->image),
+			     cairo_image_surface_get_data (pass->scaled),
+			     cairo_image_surface_get_stride (pass->scaled),
+			     cairo_image_surface_get_width (pass->scaled),
+			     first_line,
+			     last_line);
+}
 
-			p_dest_pixel += 4;
-			p_src_row += src_rowstride;
-		}
 
-		p_dest += dest_rowstride;
-	}
+static void
+horizontal_scale_transpose (cairo_surface_t *image,
+			    cairo_surface_t *scaled,
+			    ScaleReal        scale_factor,
+			    resize_filter_t *resize_filter)
+{
+	scale_pass_t pass;
+	int          n_lines;
+	int          band_lines;
 
-	out:
+	if (g_atomic_int_get (&resize_filter->cancelled))
+		return;
 
+	pass.image = image;
+	pass.scaled = scaled;
+	pass.resize_filter = resize_filter;
+	pass.scale_weights = scale_weights_new (resize_filter_weight_func,
+						resize_filter,
+						resize_filter_get_support (resize_filter),
+						scale_factor,
+						cairo_image_surface_get_width (image),
+						cairo_image_surface_get_height (scaled));
+
+	n_lines = cairo_image_surface_get_height (scaled);
+	band_lines = SCALE_BAND_LINES;
+	if ((gsize) n_lines * cairo_image_surface_get_width (scaled) < MIN_PARALLEL_PIXELS)
+		band_lines = n_lines;
+
+	_cairo_image_surface_flush_and_get_data (image);
+	_cairo_image_surface_flush_and_get_data (scaled);
+	_g_parallel_for_bands (n_lines, band_lines, scale_band, &pass);
 	cairo_surface_mark_dirty (scaled);
 
-	g_free (weights);
+	scale_weights_free (pass.scale_weights);
 }
 
 
@@ -520,14 +461,14 @@ _cairo_image_surface_scale (cairo_surface_t  *image,
 	scaled = _cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
 					      scaled_width,
 					      scaled_height);
+	if (scaled == NULL)
+		return NULL;
+
 	_cairo_image_surface_copy_metadata (image, scaled);
 	metadata = _cairo_image_surface_get_metadata (scaled);
 	if (metadata->original_width <= 0)
 		_cairo_metadata_set_original_size (metadata, src_width, src_height);
 
-	if (scaled == NULL)
-		return NULL;
-
 	if (g_once_init_enter (&coefficients_initialization)) {
 		initialize_coefficients (1.0, 0.0);
 		g_once_init_leave (&coefficients_initialization, 1);
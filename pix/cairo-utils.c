@@ -36,17 +36,6 @@ G_DEFINE_BOXED_TYPE (GthCairoSurface,
 const unsigned char cairo_channel[4] = { CAIRO_RED, CAIRO_GREEN, CAIRO_BLUE, CAIRO_ALPHA };
 
 
-static cairo_user_data_key_t surface_metadata_key;
-
-
-static void
-surface_metadata_free (void *data)
-{
-	cairo_surface_metadata_t *metadata = data;
-	g_free (metadata);
-}
-
-
 inline int
 _cairo_multiply_alpha (int color,
 		       int alpha)
@@ -101,43 +90,6 @@ _gdk_rgba_to_cairo_color_255 (GdkRGBA           *g_color,
 }
 
 
-void
-_cairo_metadata_set_has_alpha (cairo_surface_metadata_t	*metadata,
-			       gboolean                  has_alpha)
-{
-	g_return_if_fail (metadata != NULL);
-
-	metadata->valid_data |= _CAIRO_METADATA_FLAG_HAS_ALPHA;
-	metadata->has_alpha = has_alpha ? TRUE : FALSE;
-}
-
-
-void
-_cairo_metadata_set_original_size (cairo_surface_metadata_t *metadata,
-				   int                       width,
-				   int                       height)
-{
-	g_return_if_fail (metadata != NULL);
-
-	metadata->valid_data |= _CAIRO_METADATA_FLAG_ORIGINAL_SIZE;
-	metadata->original_width = width;
-	metadata->original_height = height;
-}
-
-
-void
-_cairo_metadata_set_thumbnail_size (cairo_surface_metadata_t *metadata,
-				    int                       width,
-				    int                       height)
-{
-	g_return_if_fail (metadata != NULL);
-
-	metadata->valid_data |= _CAIRO_METADATA_FLAG_THUMBNAIL_SIZE;
-	metadata->thumbnail.image_width = width;
-	metadata->thumbnail.image_height = height;
-}
-
-
 void
 _cairo_clear_surface (cairo_surface_t  **surface)
 {
@@ -151,154 +103,6 @@ _cairo_clear_surface (cairo_surface_t  **surface)
 }
 
 
-unsigned char *
-_cairo_image_surface_flush_and_get_data (cairo_surface_t *surface)
-{
-	g_return_val_if_fail (surface != NULL, NULL);
-
-	cairo_surface_flush (surface);
-	return cairo_image_surface_get_data (surface);
-}
-
-
-static void
-_cairo_surface_metadata_init (cairo_surface_metadata_t *metadata)
-{
-	g_return_if_fail (metadata != NULL);
-
-	metadata->valid_data = _CAIRO_METADATA_FLAG_NONE;
-	metadata->has_alpha = FALSE;
-	metadata->original_width = 0;
-	metadata->original_height = 0;
-	metadata->thumbnail.image_width = 0;
-	metadata->thumbnail.image_height = 0;
-}
-
-
-cairo_surface_metadata_t *
-_cairo_image_surface_get_metadata (cairo_surface_t *surface)
-{
-	cairo_surface_metadata_t *metadata;
-
-	g_return_val_if_fail (surface != NULL, NULL);
-
-	metadata = cairo_surface_get_user_data (surface, &surface_metadata_key);
-	if (metadata == NULL) {
-		metadata = g_new0 (cairo_surface_metadata_t, 1);
-		_cairo_surface_metadata_init (metadata);
-		cairo_surface_set_user_data (surface, &surface_metadata_key, metadata, surface_metadata_free);
-	}
-
-	return metadata;
-}
-
-
-void
-_cairo_image_surface_copy_metadata (cairo_surface_t *src,
-				    cairo_surface_t *dest)
-{
-	cairo_surface_metadata_t *src_metadata;
-	cairo_surface_metadata_t *dest_metadata;
-
-	g_return_if_fail (src != NULL);
-	g_return_if_fail (dest != NULL);
-
-	src_metadata = _cairo_image_surface_get_metadata (src);
-	dest_metadata = _cairo_image_surface_get_metadata (dest);
-
-	dest_metadata->valid_data = src_metadata->valid_data;
-	dest_metadata->has_alpha = src_metadata->has_alpha;
-	dest_metadata->original_width = src_metadata->original_width;
-	dest_metadata->original_height = src_metadata->original_height;
-	dest_metadata->thumbnail.image_width = src_metadata->thumbnail.image_width;
-	dest_metadata->thumbnail.image_height = src_metadata->thumbnail.image_height;
-
-}
-
-
-void
-_cairo_image_surface_clear_metadata (cairo_surface_t *surface)
-{
-	cairo_surface_metadata_t *metadata;
-
-	g_return_if_fail (surface != NULL);
-
-	metadata = _cairo_image_surface_get_metadata (surface);
-	_cairo_surface_metadata_init (metadata);
-}
-
-
-gboolean
-_cairo_image_surface_get_has_alpha (cairo_surface_t *surface)
-{
-	cairo_surface_metadata_t *metadata;
-	gboolean                  has_alpha;
-	int                       width;
-	int                       height;
-	int                       row_stride;
-	guchar                   *row;
-	int                       h, w;
-
-	if (surface == NULL)
-		return FALSE;
-
-	metadata = _cairo_image_surface_get_metadata (surface);
-	if ((metadata != NULL) && (metadata->valid_data & _CAIRO_METADATA_FLAG_HAS_ALPHA))
-		return metadata->has_alpha;
-
-	has_alpha = FALSE;
-	if (cairo_image_surface_get_format (surface) == CAIRO_FORMAT_ARGB32) {
-		/* search an alpha value lower than 255 */
-
-		width = cairo_image_surface_get_width (surface);
-		height = cairo_image_surface_get_height (surface);
-		row_stride = cairo_image_surface_get_stride (surface);
-		row = _cairo_image_surface_flush_and_get_data (surface);
-
-		for (h = 0; ! has_alpha && (h < height); h++) {
-			guchar *pixel = row;
-			for (w = 0; w < width; w++) {
-				if (pixel[CAIRO_ALPHA] < 255) {
-					has_alpha = TRUE;
-					break;
-				}
-				pixel += 4;
-			}
-			row += row_stride;
-		}
-	}
-	_cairo_metadata_set_has_alpha (metadata, has_alpha);
-
-	return has_alpha;
-}
-
-
-gboolean
-_cairo_image_surface_get_original_size (cairo_surface_t *surface,
-					int             *original_width,
-					int             *original_height)
-{
-	cairo_surface_metadata_t *metadata;
-
-	if (surface == NULL)
-		return FALSE;
-
-	metadata = cairo_surface_get_user_data (surface, &surface_metadata_key);
-	if (metadata == NULL)
-		return FALSE;
-
-	if ((metadata->valid_data & _CAIRO_METADATA_FLAG_ORIGINAL_SIZE) == 0)
-		return FALSE;
-
-	if (original_width)
-		*original_width = metadata->original_width;
-	if (original_height)
-		*original_height = metadata->original_height;
-
-	return TRUE;
-}
-
-
 cairo_surface_t *
 _cairo_image_surface_create (cairo_format_t format,
 			     int            width,
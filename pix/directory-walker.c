@@ -0,0 +1,558 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include "glib-utils.h"
+#include "directory-walker.h"
+
+
+#define N_FILES_PER_REQUEST 128
+#define N_FILES_PER_DISPATCH 1024
+
+
+/* The directories to visit are kept in a queue, the first @max_directories
+ * directories of the queue are read at the same time and their children are
+ * buffered.  The children are delivered only for the directory at the head
+ * of the queue, after start_dir_func has accepted it, so the callbacks see
+ * the same sequence of a sequential traversal: start_dir_func for a
+ * directory, then all its children, then the next directory.  A skipped
+ * directory is discarded together with the children read in advance, its
+ * sub-directories are never added to the queue because they would have been
+ * found while delivering its children. */
+
+
+typedef struct _WalkData WalkData;
+
+
+typedef struct {
+	WalkData        *walk;
+	GFile           *file;
+	GFileInfo       *info;
+	GFileEnumerator *enumerator;
+	GQueue          *batches;
+	gboolean         started;
+	gboolean         running;
+	gboolean         completed;
+	gboolean         discarded;
+	GError          *error;
+} WalkDir;
+
+
+struct _WalkData {
+	GFile                *base_directory;
+	gboolean              follow_links;
+	char                 *attributes;
+	int                   max_directories;
+	GCancellable         *cancellable;
+	StartDirCallback      start_dir_func;
+	ForEachChildCallback  for_each_file_func;
+	ReadyFunc             done_func;
+	gpointer              user_data;
+
+	/* private */
+
+	GHashTable           *already_visited;
+	GQueue               *to_visit;
+	gboolean              head_accepted;
+	int                   n_running;
+	guint                 deliver_id;
+	gboolean              finished;
+	GError               *error;
+};
+
+
+static WalkDir *
+walk_dir_new (WalkData  *walk,
+	      GFile     *file,
+	      GFileInfo *info)
+{
+	WalkDir *dir;
+
+	dir = g_new0 (WalkDir, 1);
+	dir->walk = walk;
+	dir->file = g_file_dup (file);
+	dir->info = g_file_info_dup (info);
+	dir->batches = g_queue_new ();
+
+	return dir;
+}
+
+
+static void
+walk_dir_free (WalkDir *dir)
+{
+	GList *files;
+
+	while ((files = g_queue_pop_head (dir->batches)) != NULL)
+		_g_object_list_unref (files);
+	g_queue_free (dir->batches);
+	_g_object_unref (dir->enumerator);
+	_g_object_unref (dir->info);
+	_g_object_unref (dir->file);
+	if (dir->error != NULL)
+		g_error_free (dir->error);
+	g_free (dir);
+}
+
+
+static void
+walk_data_free (WalkData *walk)
+{
+	g_object_unref (walk->base_directory);
+	g_free (walk->attributes);
+	_g_object_unref (walk->cancellable);
+	g_hash_table_destroy (walk->already_visited);
+	g_queue_free_full (walk->to_visit, (GDestroyNotify) walk_dir_free);
+	if (walk->error != NULL)
+		g_error_free (walk->error);
+	g_free (walk);
+}
+
+
+static void
+walk_done (WalkData *walk)
+{
+	if (walk->done_func != NULL)
+		walk->done_func (walk->error, walk->user_data);
+	walk_data_free (walk);
+}
+
+
+static void
+walk_check_done (WalkData *walk)
+{
+	if (walk->finished && (walk->n_running == 0) && (walk->deliver_id == 0))
+		walk_done (walk);
+}
+
+
+static void
+walk_dir_operation_started (WalkDir *dir)
+{
+	dir->running = TRUE;
+	dir->walk->n_running++;
+}
+
+
+static void
+walk_dir_operation_finished (WalkDir *dir)
+{
+	dir->running = FALSE;
+	dir->walk->n_running--;
+}
+
+
+/* Removes the directory from the traversal, if an operation is in progress
+ * the directory is freed when the operation terminates. */
+static void
+walk_dir_discard (WalkDir *dir)
+{
+	if (dir->running)
+		dir->discarded = TRUE;
+	else
+		walk_dir_free (dir);
+}
+
+
+static void walk_schedule_delivery (WalkData *walk);
+
+
+static void
+walk_dir_close_ready_cb (GObject      *source_object,
+			 GAsyncResult *result,
+			 gpointer      user_data)
+{
+	WalkDir  *dir = user_data;
+	WalkData *walk = dir->walk;
+	GError   *error = NULL;
+
+	if (! g_file_enumerator_close_finish (G_FILE_ENUMERATOR (source_object), result, &error)) {
+		if (dir->error == NULL)
+			dir->error = error;
+		else
+			g_error_free (error);
+	}
+	walk_dir_operation_finished (dir);
+
+	if (dir->discarded) {
+		walk_dir_free (dir);
+		walk_check_done (walk);
+		return;
+	}
+
+	dir->completed = TRUE;
+	walk_schedule_delivery (walk);
+}
+
+
+static void
+walk_dir_close (WalkDir *dir)
+{
+	walk_dir_operation_started (dir);
+	g_file_enumerator_close_async (dir->enumerator,
+				       G_PRIORITY_DEFAULT,
+				       NULL,
+				       walk_dir_close_ready_cb,
+				       dir);
+}
+
+
+static void walk_dir_next_files_ready_cb (GObject      *source_object,
+					  GAsyncResult *result,
+					  gpointer      user_data);
+
+
+static void
+walk_dir_read_next_files (WalkDir *dir)
+{
+	walk_dir_operation_started (dir);
+	g_file_enumerator_next_files_async (dir->enumerator,
+					    N_FILES_PER_REQUEST,
+					    G_PRIORITY_DEFAULT,
+					    dir->walk->cancellable,
+					    walk_dir_next_files_ready_cb,
+					    dir);
+}
+
+
+static void
+walk_dir_next_files_ready_cb (GObject      *source_object,
+			      GAsyncResult *result,
+			      gpointer      user_data)
+{
+	WalkDir  *dir = user_data;
+	WalkData *walk = dir->walk;
+	GList    *files;
+	GError   *error = NULL;
+
+	files = g_file_enumerator_next_files_finish (dir->enumerator, result, &error);
+	walk_dir_operation_finished (dir);
+
+	if (dir->discarded) {
+		_g_object_list_unref (files);
+		g_clear_error (&error);
+		walk_dir_close (dir);
+		return;
+	}
+
+	if (files == NULL) {
+		dir->error = error;
+		walk_dir_close (dir);
+		return;
+	}
+
+	g_queue_push_tail (dir->batches, files);
+	walk_dir_read_next_files (dir);
+	walk_schedule_delivery (walk);
+}
+
+
+static void
+walk_dir_enumerate_ready_cb (GObject      *source_object,
+			     GAsyncResult *result,
+			     gpointer      user_data)
+{
+	WalkDir  *dir = user_data;
+	WalkData *walk = dir->walk;
+	GError   *error = NULL;
+
+	dir->enumerator = g_file_enumerate_children_finish (G_FILE (source_object), result, &error);
+	walk_dir_operation_finished (dir);
+
+	if (dir->discarded) {
+		g_clear_error (&error);
+		if (dir->enumerator != NULL) {
+			walk_dir_close (dir);
+			return;
+		}
+		walk_dir_free (dir);
+		walk_check_done (walk);
+		return;
+	}
+
+	if (dir->enumerator == NULL) {
+		dir->error = error;
+		dir->completed = TRUE;
+		walk_schedule_delivery (walk);
+		return;
+	}
+
+	walk_dir_read_next_files (dir);
+}
+
+
+static void
+walk_start_directories (WalkData *walk)
+{
+	GList *scan;
+	int    n;
+
+	if (walk->finished)
+		return;
+
+	for (scan = walk->to_visit->head, n = 0;
+	     (scan != NULL) && (n < walk->max_directories);
+	     scan = scan->next, n++)
+	{
+		WalkDir *dir = scan->data;
+
+		if (dir->started)
+			continue;
+
+		dir->started = TRUE;
+		walk_dir_operation_started (dir);
+		g_file_enumerate_children_async (dir->file,
+						 walk->attributes,
+						 walk->follow_links ? G_FILE_QUERY_INFO_NONE : G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						 G_PRIORITY_DEFAULT,
+						 walk->cancellable,
+						 walk_dir_enumerate_ready_cb,
+						 dir);
+	}
+}
+
+
+static void
+walk_compute_child (WalkData  *walk,
+		    GFile     *file,
+		    GFileInfo *info)
+{
+	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+		char *id;
+
+		/* avoid to visit a directory more than ones */
+
+		id = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE));
+		if (id == NULL)
+			id = g_file_get_uri (file);
+
+		if (g_hash_table_lookup (walk->already_visited, id) == NULL) {
+			g_hash_table_insert (walk->already_visited, g_strdup (id), GINT_TO_POINTER (1));
+			g_queue_push_tail (walk->to_visit, walk_dir_new (walk, file, info));
+		}
+
+		g_free (id);
+	}
+
+	walk->for_each_file_func (file, info, walk->user_data);
+}
+
+
+/* Delivers the buffered children of the directory at the head of the
+ * queue, returns the number of delivered files, or -1 if the head cannot
+ * advance until more data is read. */
+static int
+walk_deliver_head (WalkData *walk)
+{
+	WalkDir *dir;
+	GList   *files;
+	GList   *scan;
+	int      n_files;
+
+	dir = g_queue_peek_head (walk->to_visit);
+	if (dir == NULL) {
+		walk->finished = TRUE;
+		return 0;
+	}
+
+	if (! walk->head_accepted) {
+		if (walk->start_dir_func != NULL) {
+			switch (walk->start_dir_func (dir->file, dir->info, &walk->error, walk->user_data)) {
+			case DIR_OP_SKIP:
+				walk_dir_discard (g_queue_pop_head (walk->to_visit));
+				return 0;
+			case DIR_OP_STOP:
+				walk->finished = TRUE;
+				return 0;
+			case DIR_OP_CONTINUE:
+				break;
+			}
+		}
+		walk->head_accepted = TRUE;
+	}
+
+	files = g_queue_pop_head (dir->batches);
+	if (files != NULL) {
+		n_files = 0;
+		for (scan = files; scan; scan = scan->next) {
+			GFileInfo *child_info = scan->data;
+			GFile     *child_file;
+
+			child_file = g_file_get_child (dir->file, g_file_info_get_name (child_info));
+			walk_compute_child (walk, child_file, child_info);
+			n_files++;
+
+			g_object_unref (child_file);
+		}
+		_g_object_list_unref (files);
+
+		return n_files;
+	}
+
+	if (! dir->completed)
+		return -1;
+
+	if (dir->error != NULL) {
+		if (walk->error == NULL) {
+			walk->error = dir->error;
+			dir->error = NULL;
+		}
+		walk->finished = TRUE;
+		return 0;
+	}
+
+	walk_dir_discard (g_queue_pop_head (walk->to_visit));
+	walk->head_accepted = FALSE;
+
+	return 0;
+}
+
+
+static gboolean
+walk_deliver_cb (gpointer user_data)
+{
+	WalkData *walk = user_data;
+	int       budget;
+
+	budget = N_FILES_PER_DISPATCH;
+	while ((budget > 0) && ! walk->finished) {
+		int n_files;
+
+		if (g_cancellable_is_cancelled (walk->cancellable)) {
+			if (walk->error == NULL)
+				g_cancellable_set_error_if_cancelled (walk->cancellable, &walk->error);
+			walk->finished = TRUE;
+			break;
+		}
+
+		n_files = walk_deliver_head (walk);
+		if (n_files < 0)
+			break;
+		budget -= n_files;
+	}
+
+	if (walk->finished) {
+		while (! g_queue_is_empty (walk->to_visit))
+			walk_dir_discard (g_queue_pop_head (walk->to_visit));
+		walk->deliver_id = 0;
+		walk_check_done (walk);
+		return G_SOURCE_REMOVE;
+	}
+
+	walk_start_directories (walk);
+
+	if (budget <= 0)
+		return G_SOURCE_CONTINUE;
+
+	walk->deliver_id = 0;
+
+	return G_SOURCE_REMOVE;
+}
+
+
+static void
+walk_schedule_delivery (WalkData *walk)
+{
+	if ((walk->deliver_id == 0) && ! walk->finished)
+		walk->deliver_id = g_idle_add (walk_deliver_cb, walk);
+}
+
+
+static void
+base_directory_info_ready_cb (GObject      *source_object,
+			      GAsyncResult *result,
+			      gpointer      user_data)
+{
+	WalkData  *walk = user_data;
+	GFileInfo *info;
+
+	info = g_file_query_info_finish (G_FILE (source_object), result, &walk->error);
+	if (info == NULL) {
+		walk->finished = TRUE;
+		walk_done (walk);
+		return;
+	}
+
+	g_queue_push_tail (walk->to_visit, walk_dir_new (walk, walk->base_directory, info));
+	walk_start_directories (walk);
+
+	g_object_unref (info);
+}
+
+
+/**
+ * _g_directory_walk_parallel:
+ * @directory: The directory to visit.
+ * @follow_links: Whether to dereference the symbolic links.
+ * @attributes: The GFileInfo attributes to read.
+ * @max_directories: The maximum number of directories read at the same
+ *   time.
+ * @cancellable: An optional @GCancellable object, used to cancel the process.
+ * @start_dir_func: the function called for each sub-directory, or %NULL if
+ *   not needed.
+ * @for_each_file_func: the function called for each file.  Can't be %NULL.
+ * @done_func: the function called at the end of the traversing process.
+ * @user_data: data to pass to the callbacks.
+ *
+ * Traverse the @directory recursively like _g_directory_foreach_child,
+ * reading the directories that follow the current one in advance.
+ */
+void
+_g_directory_walk_parallel (GFile                *directory,
+			    gboolean              follow_links,
+			    const char           *attributes,
+			    int                   max_directories,
+			    GCancellable         *cancellable,
+			    StartDirCallback      start_dir_func,
+			    ForEachChildCallback  for_each_file_func,
+			    ReadyFunc             done_func,
+			    gpointer              user_data)
+{
+	WalkData *walk;
+
+	g_return_if_fail (for_each_file_func != NULL);
+
+	walk = g_new0 (WalkData, 1);
+	walk->base_directory = g_file_dup (directory);
+	walk->follow_links = follow_links;
+	walk->attributes = g_strconcat (attributes, ",standard::name,standard::type,id::file", NULL);
+	walk->max_directories = MAX (max_directories, 1);
+	walk->cancellable = _g_object_ref (cancellable);
+	walk->start_dir_func = start_dir_func;
+	walk->for_each_file_func = for_each_file_func;
+	walk->done_func = done_func;
+	walk->user_data = user_data;
+	walk->already_visited = g_hash_table_new_full (g_str_hash,
+						       g_str_equal,
+						       g_free,
+						       NULL);
+	walk->to_visit = g_queue_new ();
+
+	g_file_query_info_async (walk->base_directory,
+				 walk->attributes,
+				 G_FILE_QUERY_INFO_NONE,
+				 G_PRIORITY_DEFAULT,
+				 walk->cancellable,
+				 base_directory_info_ready_cb,
+				 walk);
+}
@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include "gio-utils.h"
+
+G_BEGIN_DECLS
+
+/* Recursive traversal that reads up to @max_directories directories at the
+ * same time.  The callbacks are called in the same order, and with the same
+ * semantics, as a sequential breadth-first traversal. */
+
+void   _g_directory_walk_parallel  (GFile                *directory,
+				    gboolean              follow_links,
+				    const char           *attributes,
+				    int                   max_directories,
+				    GCancellable         *cancellable,
+				    StartDirCallback      start_dir_func,
+				    ForEachChildCallback  for_each_file_func,
+				    ReadyFunc             done_func,
+				    gpointer              user_data);
+
+G_END_DECLS
+
+#endif /* DIRECTORY_WALKER_H */
@@ -0,0 +1,487 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* copy_file_range */
+#endif
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_FICLONE
+#include <linux/fs.h>
+#endif
+#include <glib/gstdio.h>
+#include "file-copy.h"
+
+
+#define COPY_CHUNK_SIZE (8 * 1024 * 1024)
+#define PROGRESS_DELAY 100
+
+
+typedef struct {
+	GTask                 *task;
+	GFile                 *source;
+	GFile                 *destination;
+	GFileCopyFlags         flags;
+	int                    io_priority;
+	GCancellable          *cancellable;
+	GFileProgressCallback  progress_callback;
+	gpointer               progress_callback_data;
+	guint                  progress_id;
+	GMutex                 mutex;
+	goffset                copied_bytes;
+	goffset                total_bytes;
+} CopyData;
+
+
+static CopyData *
+copy_data_new (GTask                 *task,
+	       GFile                 *source,
+	       GFile                 *destination,
+	       GFileCopyFlags         flags,
+	       int                    io_priority,
+	       GCancellable          *cancellable,
+	       GFileProgressCallback  progress_callback,
+	       gpointer               progress_callback_data)
+{
+	CopyData *copy_data;
+
+	copy_data = g_new0 (CopyData, 1);
+	copy_data->task = task;
+	copy_data->source = g_object_ref (source);
+	copy_data->destination = g_object_ref (destination);
+	copy_data->flags = flags;
+	copy_data->io_priority = io_priority;
+	copy_data->cancellable = (cancellable != NULL) ? g_object_ref (cancellable) : NULL;
+	copy_data->progress_callback = progress_callback;
+	copy_data->progress_callback_data = progress_callback_data;
+	copy_data->progress_id = 0;
+	g_mutex_init (&copy_data->mutex);
+	copy_data->copied_bytes = 0;
+	copy_data->total_bytes = 0;
+
+	return copy_data;
+}
+
+
+static void
+copy_data_free (CopyData *copy_data)
+{
+	if (copy_data->progress_id != 0)
+		g_source_remove (copy_data->progress_id);
+	g_mutex_clear (&copy_data->mutex);
+	g_clear_object (&copy_data->cancellable);
+	g_object_unref (copy_data->destination);
+	g_object_unref (copy_data->source);
+	g_object_unref (copy_data->task);
+	g_free (copy_data);
+}
+
+
+static void
+copy_data_set_progress (CopyData *copy_data,
+			goffset   copied_bytes,
+			goffset   total_bytes)
+{
+	g_mutex_lock (&copy_data->mutex);
+	copy_data->copied_bytes = copied_bytes;
+	copy_data->total_bytes = total_bytes;
+	g_mutex_unlock (&copy_data->mutex);
+}
+
+
+static void
+set_error_from_errno (GError **error,
+		      int      errsv)
+{
+	g_set_error_literal (error,
+			     G_IO_ERROR,
+			     g_io_error_from_errno (errsv),
+			     g_strerror (errsv));
+}
+
+
+static void
+set_not_supported_error (GError **error)
+{
+	g_set_error_literal (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_NOT_SUPPORTED,
+			     "Fast copy not supported");
+}
+
+
+/* -- copy_file_content -- */
+
+
+static gboolean
+copy_file_content (CopyData      *copy_data,
+		   int            source_fd,
+		   int            destination_fd,
+		   goffset        size,
+		   GCancellable  *cancellable,
+		   GError       **error)
+{
+#ifdef HAVE_FICLONE
+
+	/* share the data blocks, on btrfs, xfs and the other copy-on-write
+	 * file systems. */
+
+	if (ioctl (destination_fd, FICLONE, source_fd) == 0) {
+		copy_data_set_progress (copy_data, size, size);
+		return TRUE;
+	}
+
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+
+	{
+		goffset copied_bytes = 0;
+
+		for (;;) {
+			ssize_t n;
+
+			if (g_cancellable_set_error_if_cancelled (cancellable, error))
+				return FALSE;
+
+			n = copy_file_range (source_fd, NULL, destination_fd, NULL, COPY_CHUNK_SIZE, 0);
+			if (n < 0) {
+				int errsv = errno;
+
+				if (errsv == EINTR)
+					continue;
+
+				/* the kernel or the file systems don't
+				 * support the operation, use GIO. */
+
+				if ((copied_bytes == 0)
+				    && ((errsv == ENOSYS)
+					|| (errsv == EXDEV)
+					|| (errsv == EINVAL)
+					|| (errsv == EOPNOTSUPP)
+					|| (errsv == EBADF)))
+				{
+					set_not_supported_error (error);
+				}
+				else
+					set_error_from_errno (error, errsv);
+
+				return FALSE;
+			}
+
+			if (n == 0) {
+				/* some virtual file systems report an empty
+				 * file, read it with GIO. */
+
+				if ((copied_bytes == 0) && (size > 0)) {
+					set_not_supported_error (error);
+					return FALSE;
+				}
+				break;
+			}
+
+			copied_bytes += n;
+			copy_data_set_progress (copy_data, copied_bytes, MAX (size, copied_bytes));
+		}
+
+		return TRUE;
+	}
+
+#else
+
+	set_not_supported_error (error);
+	return FALSE;
+
+#endif
+}
+
+
+/* -- copy_local_file -- */
+
+
+static gboolean
+copy_local_file (CopyData      *copy_data,
+		 GCancellable  *cancellable,
+		 GError       **error)
+{
+	char        *source_path;
+	char        *destination_path;
+	char        *tmp_path = NULL;
+	int          source_fd = -1;
+	int          destination_fd = -1;
+	gboolean     created = FALSE;
+	gboolean     result = FALSE;
+	struct stat  source_stat;
+
+	source_path = g_file_get_path (copy_data->source);
+	destination_path = g_file_get_path (copy_data->destination);
+
+	source_fd = g_open (source_path, O_RDONLY | O_CLOEXEC, 0);
+	if (source_fd < 0) {
+		set_error_from_errno (error, errno);
+		goto out;
+	}
+
+	if (fstat (source_fd, &source_stat) != 0) {
+		set_error_from_errno (error, errno);
+		goto out;
+	}
+
+	if (! S_ISREG (source_stat.st_mode)) {
+		set_not_supported_error (error);
+		goto out;
+	}
+
+	if (copy_data->flags & G_FILE_COPY_OVERWRITE) {
+		char *parent;
+		char *name;
+
+		/* as GIO does, write a temporary file and replace the
+		 * destination only when the copy is complete. */
+
+		parent = g_path_get_dirname (destination_path);
+		name = g_path_get_basename (destination_path);
+		tmp_path = g_strdup_printf ("%s/.%s.XXXXXX", parent, name);
+		destination_fd = g_mkstemp_full (tmp_path, O_WRONLY | O_CLOEXEC, 0600);
+
+		g_free (name);
+		g_free (parent);
+	}
+	else
+		destination_fd = g_open (destination_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, source_stat.st_mode & 0777);
+
+	if (destination_fd < 0) {
+		set_error_from_errno (error, errno);
+		goto out;
+	}
+	created = TRUE;
+
+	copy_data_set_progress (copy_data, 0, source_stat.st_size);
+	if (! copy_file_content (copy_data, source_fd, destination_fd, source_stat.st_size, cancellable, error))
+		goto out;
+
+	if (! g_close (destination_fd, error)) {
+		destination_fd = -1;
+		goto out;
+	}
+	destination_fd = -1;
+
+	if ((tmp_path != NULL) && (g_rename (tmp_path, destination_path) != 0)) {
+		set_error_from_errno (error, errno);
+		goto out;
+	}
+
+	/* the permissions and, with G_FILE_COPY_ALL_METADATA, the other
+	 * attributes, errors are ignored as in g_file_copy. */
+
+	g_file_copy_attributes (copy_data->source,
+				copy_data->destination,
+				copy_data->flags & ~G_FILE_COPY_OVERWRITE,
+				cancellable,
+				NULL);
+
+	result = TRUE;
+
+out:
+
+	if (destination_fd >= 0)
+		g_close (destination_fd, NULL);
+	if (source_fd >= 0)
+		g_close (source_fd, NULL);
+	if (! result && created)
+		g_unlink ((tmp_path != NULL) ? tmp_path : destination_path);
+
+	g_free (tmp_path);
+	g_free (destination_path);
+	g_free (source_path);
+
+	return result;
+}
+
+
+/* -- _g_file_copy_fast_async -- */
+
+
+static void
+copy_file_thread (GTask        *task,
+		  gpointer      source_object,
+		  gpointer      task_data,
+		  GCancellable *cancellable)
+{
+	CopyData *copy_data = task_data;
+	GError   *error = NULL;
+
+	if (copy_local_file (copy_data, cancellable, &error))
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, error);
+}
+
+
+static gboolean
+copy_progress_cb (gpointer user_data)
+{
+	CopyData *copy_data = user_data;
+	goffset   copied_bytes;
+	goffset   total_bytes;
+
+	g_mutex_lock (&copy_data->mutex);
+	copied_bytes = copy_data->copied_bytes;
+	total_bytes = copy_data->total_bytes;
+	g_mutex_unlock (&copy_data->mutex);
+
+	copy_data->progress_callback (copied_bytes, total_bytes, copy_data->progress_callback_data);
+
+	return G_SOURCE_CONTINUE;
+}
+
+
+static void
+gio_copy_ready_cb (GObject      *source_object,
+		   GAsyncResult *result,
+		   gpointer      user_data)
+{
+	CopyData *copy_data = user_data;
+	GError   *error = NULL;
+
+	if (g_file_copy_finish (G_FILE (source_object), result, &error))
+		g_task_return_boolean (copy_data->task, TRUE);
+	else
+		g_task_return_error (copy_data->task, error);
+
+	copy_data_free (copy_data);
+}
+
+
+static void
+copy_with_gio (CopyData *copy_data)
+{
+	g_file_copy_async (copy_data->source,
+			   copy_data->destination,
+			   copy_data->flags,
+			   copy_data->io_priority,
+			   copy_data->cancellable,
+			   copy_data->progress_callback,
+			   copy_data->progress_callback_data,
+			   gio_copy_ready_cb,
+			   copy_data);
+}
+
+
+static void
+copy_thread_ready_cb (GObject      *source_object,
+		      GAsyncResult *result,
+		      gpointer      user_data)
+{
+	CopyData *copy_data = user_data;
+	GError   *error = NULL;
+
+	if (copy_data->progress_id != 0) {
+		g_source_remove (copy_data->progress_id);
+		copy_data->progress_id = 0;
+	}
+
+	if (! g_task_propagate_boolean (G_TASK (result), &error)) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+			g_error_free (error);
+			copy_with_gio (copy_data);
+			return;
+		}
+
+		g_task_return_error (copy_data->task, error);
+		copy_data_free (copy_data);
+		return;
+	}
+
+	if (copy_data->progress_callback != NULL)
+		copy_progress_cb (copy_data);
+
+	g_task_return_boolean (copy_data->task, TRUE);
+	copy_data_free (copy_data);
+}
+
+
+static gboolean
+can_copy_in_thread (GFile          *source,
+		    GFile          *destination,
+		    GFileCopyFlags  flags)
+{
+	if (flags & (G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_BACKUP))
+		return FALSE;
+
+	return g_file_is_native (source) && g_file_is_native (destination);
+}
+
+
+void
+_g_file_copy_fast_async (GFile                 *source,
+			 GFile                 *destination,
+			 GFileCopyFlags         flags,
+			 int                    io_priority,
+			 GCancellable          *cancellable,
+			 GFileProgressCallback  progress_callback,
+			 gpointer               progress_callback_data,
+			 GAsyncReadyCallback    callback,
+			 gpointer               user_data)
+{
+	CopyData *copy_data;
+	GTask    *thread_task;
+
+	copy_data = copy_data_new (g_task_new (source, cancellable, callback, user_data),
+				   source,
+				   destination,
+				   flags,
+				   io_priority,
+				   cancellable,
+				   progress_callback,
+				   progress_callback_data);
+
+	if (! can_copy_in_thread (source, destination, flags)) {
+		copy_with_gio (copy_data);
+		return;
+	}
+
+	if (progress_callback != NULL)
+		copy_data->progress_id = g_timeout_add (PROGRESS_DELAY, copy_progress_cb, copy_data);
+
+	thread_task = g_task_new (NULL, cancellable, copy_thread_ready_cb, copy_data);
+	g_task_set_task_data (thread_task, copy_data, NULL);
+	g_task_set_priority (thread_task, io_priority);
+	g_task_run_in_thread (thread_task, copy_file_thread);
+
+	g_object_unref (thread_task);
+}
+
+
+gboolean
+_g_file_copy_fast_finish (GFile         *source,
+			  GAsyncResult  *result,
+			  GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, source), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
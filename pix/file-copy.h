@@ -0,0 +1,50 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Same as g_file_copy_async, local regular files are cloned with a reflink
+ * when the file system supports it, or copied in the kernel with
+ * copy_file_range, in a worker thread.  Falls back to g_file_copy_async
+ * otherwise. */
+
+void      _g_file_copy_fast_async   (GFile                  *source,
+				     GFile                  *destination,
+				     GFileCopyFlags          flags,
+				     int                     io_priority,
+				     GCancellable           *cancellable,
+				     GFileProgressCallback   progress_callback,
+				     gpointer                progress_callback_data,
+				     GAsyncReadyCallback     callback,
+				     gpointer                user_data);
+gboolean  _g_file_copy_fast_finish  (GFile                  *source,
+				     GAsyncResult           *result,
+				     GError                **error);
+
+G_END_DECLS
+
+#endif /* FILE_COPY_H */
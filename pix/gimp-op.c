@@ -20,9 +20,15 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include "gimp-op.h"
 
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
 guchar add_alpha_table[256][256];
 static GOnce  gimp_op_init_once = G_ONCE_INIT;
 
@@ -55,3 +61,121 @@ gimp_op_init (void)
 {
 	g_once (&gimp_op_init_once, init_tables, NULL);
 }
+
+
+/* -- gimp_op_normal_row -- */
+
+
+static void
+normal_row_generic (guchar       *image_row,
+		    const guchar *layer_row,
+		    const guchar *alpha_row,
+		    int           n_pixels)
+{
+	int    i;
+	guchar a;
+	int    temp;
+
+	for (i = 0; i < n_pixels; i++) {
+		a = alpha_row[i];
+		if (a != 0) {
+			image_row[CAIRO_RED] = GIMP_OP_NORMAL (layer_row[CAIRO_RED], image_row[CAIRO_RED], a);
+			image_row[CAIRO_GREEN] = GIMP_OP_NORMAL (layer_row[CAIRO_GREEN], image_row[CAIRO_GREEN], a);
+			image_row[CAIRO_BLUE] = GIMP_OP_NORMAL (layer_row[CAIRO_BLUE], image_row[CAIRO_BLUE], a);
+			image_row[CAIRO_ALPHA] = GIMP_OP_NORMAL (255, image_row[CAIRO_ALPHA], a);
+		}
+
+		image_row += 4;
+		layer_row += 4;
+	}
+}
+
+
+#ifdef __SSE2__
+
+
+/* v * a / 255 rounded to the nearest integer, the same values of
+ * add_alpha_table. */
+inline static __m128i
+sse2_add_alpha (__m128i v,
+		__m128i a)
+{
+	__m128i t;
+
+	t = _mm_add_epi16 (_mm_mullo_epi16 (v, a), _mm_set1_epi16 (128));
+	return _mm_srli_epi16 (_mm_add_epi16 (t, _mm_srli_epi16 (t, 8)), 8);
+}
+
+
+inline static __m128i
+sse2_normal (__m128i layer,
+	     __m128i image,
+	     __m128i alpha)
+{
+	return _mm_add_epi16 (sse2_add_alpha (layer, alpha),
+			      sse2_add_alpha (image, _mm_sub_epi16 (_mm_set1_epi16 (255), alpha)));
+}
+
+
+/* Four pixels at a time, the alpha of the layer is used for all the
+ * channels and the alpha channel of the layer is replaced with 255. */
+static void
+normal_row_sse2 (guchar       *image_row,
+		 const guchar *layer_row,
+		 const guchar *alpha_row,
+		 int           n_pixels)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i opaque = _mm_set1_epi32 ((int) 0xff000000);
+	int           i;
+
+	for (i = 0; i + 3 < n_pixels; i += 4) {
+		__m128i layer;
+		__m128i image;
+		__m128i alpha;
+		__m128i lo;
+		__m128i hi;
+		guint32 alpha4;
+
+		memcpy (&alpha4, alpha_row + i, sizeof (alpha4));
+		if (alpha4 != 0) {
+			layer = _mm_or_si128 (_mm_loadu_si128 ((const __m128i *) layer_row), opaque);
+			image = _mm_loadu_si128 ((const __m128i *) image_row);
+			alpha = _mm_cvtsi32_si128 ((int) alpha4);
+			alpha = _mm_unpacklo_epi8 (alpha, alpha);
+			alpha = _mm_unpacklo_epi16 (alpha, alpha);
+
+			lo = sse2_normal (_mm_unpacklo_epi8 (layer, zero),
+					  _mm_unpacklo_epi8 (image, zero),
+					  _mm_unpacklo_epi8 (alpha, zero));
+			hi = sse2_normal (_mm_unpackhi_epi8 (layer, zero),
+					  _mm_unpackhi_epi8 (image, zero),
+					  _mm_unpackhi_epi8 (alpha, zero));
+			_mm_storeu_si128 ((__m128i *) image_row, _mm_packus_epi16 (lo, hi));
+		}
+
+		image_row += 16;
+		layer_row += 16;
+	}
+
+	normal_row_generic (image_row, layer_row, alpha_row + i, n_pixels - i);
+}
+
+
+#endif /* __SSE2__ */
+
+
+/* Paints a row of the layer over a row of the image with the NORMAL mode,
+ * alpha_row contains the opacity of each pixel of the layer. */
+void
+gimp_op_normal_row (guchar       *image_row,
+		    const guchar *layer_row,
+		    const guchar *alpha_row,
+		    int           n_pixels)
+{
+#ifdef __SSE2__
+	normal_row_sse2 (image_row, layer_row, alpha_row, n_pixels);
+#else
+	normal_row_generic (image_row, layer_row, alpha_row, n_pixels);
+#endif
+}
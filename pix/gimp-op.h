@@ -53,6 +53,10 @@
 
 extern guchar add_alpha_table[256][256];
 
-void gimp_op_init (void);
+void gimp_op_init       (void);
+void gimp_op_normal_row (guchar       *image_row,
+			 const guchar *layer_row,
+			 const guchar *alpha_row,
+			 int           n_pixels);
 
 #endif /* GIMP_OP_H */
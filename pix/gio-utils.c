@@ -23,6 +23,8 @@
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
+#include "directory-walker.h"
+#include "file-copy.h"
 #include "gth-file-data.h"
 #include "gth-file-source.h"
 #include "gth-file-source-vfs.h"
@@ -30,11 +32,13 @@
 #include "gth-main.h"
 #include "gth-metadata-provider.h"
 #include "gth-overwrite-dialog.h"
+#include "gth-preferences.h"
 #include "glib-utils.h"
 #include "gio-utils.h"
 
 
 #define N_FILES_PER_REQUEST 128
+#define N_DIRECTORIES_IN_FLIGHT 8
 
 
 /* -- _g_directory_foreach_child -- */
@@ -453,6 +457,8 @@ directory_info_ready_cb (GObject      *source_object,
  * directory is traversed recursively; if @follow_links is TRUE, symbolic
  * links are dereferenced, otherwise they are returned as links.
  * Each callback uses the same @user_data additional parameter.
+ * Recursive traversals that don't require the metadata providers read
+ * more directories at the same time, see _g_directory_walk_parallel.
  */
 void
 _g_directory_foreach_child (GFile                *directory,
@@ -469,6 +475,19 @@ _g_directory_foreach_child (GFile                *directory,
 
 	g_return_if_fail (for_each_file_func != NULL);
 
+	if (recursive && (attributes != NULL) && _g_file_attributes_matches_all (attributes, GIO_ATTRIBUTES)) {
+		_g_directory_walk_parallel (directory,
+					    follow_links,
+					    attributes,
+					    N_DIRECTORIES_IN_FLIGHT,
+					    cancellable,
+					    start_dir_func,
+					    for_each_file_func,
+					    done_func,
+					    user_data);
+		return;
+	}
+
 	fec = g_new0 (ForEachChildData, 1);
 
 	fec->base_directory = g_file_dup (directory);
@@ -768,14 +787,65 @@ _g_file_list_query_info_async (GList             *file_list,
 /* -- _g_copy_file_async -- */
 
 
+/* State shared by the files copied at the same time: the overwrite dialog
+ * is shown for one file at a time and its response is used by the
+ * following files, the progress is the sum of the copied bytes. */
+typedef struct {
+	int                   ref;
+	GthOverwriteResponse  default_response;
+	goffset               tot_size;
+	goffset               copied_size;
+	gboolean              dialog_visible;
+	GQueue               *waiting_for_dialog;  /* CopyFileData queue */
+} CopyShared;
+
+
+static CopyShared *
+copy_shared_new (GthOverwriteResponse default_response,
+		 goffset              tot_size)
+{
+	CopyShared *shared;
+
+	shared = g_new0 (CopyShared, 1);
+	shared->ref = 1;
+	shared->default_response = default_response;
+	shared->tot_size = tot_size;
+	shared->copied_size = 0;
+	shared->dialog_visible = FALSE;
+	shared->waiting_for_dialog = g_queue_new ();
+
+	return shared;
+}
+
+
+static CopyShared *
+copy_shared_ref (CopyShared *shared)
+{
+	shared->ref++;
+	return shared;
+}
+
+
+static void
+copy_shared_unref (CopyShared *shared)
+{
+	shared->ref--;
+	if (shared->ref > 0)
+		return;
+
+	g_queue_free (shared->waiting_for_dialog);
+	g_free (shared);
+}
+
+
 typedef struct {
 	GthFileData          *source;
 	GFile                *destination;
 	gboolean              move;
 	GthFileCopyFlags      flags;
 	int                   io_priority;
-	goffset               tot_size;
-	goffset               copied_size;
+	CopyShared           *shared;
+	goffset               current_size;
 	gsize                 tot_files;
 	GCancellable         *cancellable;
 	ProgressCallback      progress_callback;
@@ -788,8 +858,8 @@ typedef struct {
 
 	GFile                *current_destination;
 	char                 *message;
-	GthOverwriteResponse  default_response;
 	gboolean              duplicating_file;
+	GError               *pending_error;
 
 	GList                *source_sidecars;  /* GFile list */
 	GList                *destination_sidecars;  /* GFile list */
@@ -801,6 +871,12 @@ typedef struct {
 static void
 copy_file_data_free (CopyFileData *copy_file_data)
 {
+	/* the file is done, count all of its bytes even if it was skipped */
+	copy_file_data->shared->copied_size += g_file_info_get_size (copy_file_data->source->info) - copy_file_data->current_size;
+	copy_shared_unref (copy_file_data->shared);
+
+	if (copy_file_data->pending_error != NULL)
+		g_error_free (copy_file_data->pending_error);
 	g_object_unref (copy_file_data->source);
 	g_object_unref (copy_file_data->destination);
 	_g_object_unref (copy_file_data->cancellable);
@@ -822,7 +898,7 @@ copy_file__delete_source (CopyFileData *copy_file_data)
 	if (copy_file_data->move && ! copy_file_data->move_succeed)
 		g_file_delete (copy_file_data->source->file, copy_file_data->cancellable, &error);
 
-	copy_file_data->ready_callback (copy_file_data->default_response, copy_file_data->source_sidecars, error, copy_file_data->user_data);
+	copy_file_data->ready_callback (copy_file_data->shared->default_response, copy_file_data->source_sidecars, error, copy_file_data->user_data);
 	copy_file_data_free (copy_file_data);
 }
 
@@ -916,6 +992,38 @@ copy_file__copy_sidecars (CopyFileData *copy_file_data)
 static void _g_copy_file_to_destination (CopyFileData   *copy_file_data,
 					 GFile          *destination,
 					 GFileCopyFlags  flags);
+static void copy_file__handle_error (CopyFileData *copy_file_data,
+				     GError       *error);
+
+
+static void
+copy_file__resume_waiting_file (gpointer user_data)
+{
+	CopyShared   *shared = user_data;
+	CopyFileData *copy_file_data;
+
+	copy_file_data = g_queue_pop_head (shared->waiting_for_dialog);
+	if (copy_file_data != NULL) {
+		GError *error;
+
+		error = copy_file_data->pending_error;
+		copy_file_data->pending_error = NULL;
+		copy_file__handle_error (copy_file_data, error);
+	}
+
+	copy_shared_unref (shared);
+}
+
+
+static void
+copy_file__overwrite_dialog_closed (CopyFileData *copy_file_data)
+{
+	CopyShared *shared = copy_file_data->shared;
+
+	shared->dialog_visible = FALSE;
+	if (! g_queue_is_empty (shared->waiting_for_dialog))
+		call_when_idle (copy_file__resume_waiting_file, copy_shared_ref (shared));
+}
 
 
 static void
@@ -926,16 +1034,17 @@ copy_file__overwrite_dialog_response_cb (GtkDialog *dialog,
 	CopyFileData *copy_file_data = user_data;
 
 	if (response_id != GTK_RESPONSE_OK)
-		copy_file_data->default_response = GTH_OVERWRITE_RESPONSE_CANCEL;
+		copy_file_data->shared->default_response = GTH_OVERWRITE_RESPONSE_CANCEL;
 	else
-		copy_file_data->default_response = gth_overwrite_dialog_get_response (GTH_OVERWRITE_DIALOG (dialog));
+		copy_file_data->shared->default_response = gth_overwrite_dialog_get_response (GTH_OVERWRITE_DIALOG (dialog));
 
 	gtk_widget_hide (GTK_WIDGET (dialog));
+	copy_file__overwrite_dialog_closed (copy_file_data);
 
 	if (copy_file_data->dialog_callback != NULL)
 		copy_file_data->dialog_callback (FALSE, NULL, copy_file_data->dialog_callback_data);
 
-	switch (copy_file_data->default_response) {
+	switch (copy_file_data->shared->default_response) {
 	case GTH_OVERWRITE_RESPONSE_NO:
 	case GTH_OVERWRITE_RESPONSE_ALWAYS_NO:
 	case GTH_OVERWRITE_RESPONSE_UNSPECIFIED:
@@ -943,11 +1052,11 @@ copy_file__overwrite_dialog_response_cb (GtkDialog *dialog,
 		{
 			GError *error = NULL;
 
-			if (copy_file_data->default_response == GTH_OVERWRITE_RESPONSE_CANCEL)
+			if (copy_file_data->shared->default_response == GTH_OVERWRITE_RESPONSE_CANCEL)
 				error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "");
 			else
 				error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_EXISTS, "");
-			copy_file_data->ready_callback (copy_file_data->default_response, NULL, error, copy_file_data->user_data);
+			copy_file_data->ready_callback (copy_file_data->shared->default_response, NULL, error, copy_file_data->user_data);
 			copy_file_data_free (copy_file_data);
 			return;
 		}
@@ -993,13 +1102,33 @@ copy_file__handle_error (CopyFileData *copy_file_data,
 
 			g_object_unref (new_destination);
 		}
-		else if (copy_file_data->default_response != GTH_OVERWRITE_RESPONSE_ALWAYS_NO) {
+		else if (copy_file_data->shared->default_response == GTH_OVERWRITE_RESPONSE_CANCEL) {
+
+			/* the user cancelled the operation in the dialog of
+			 * another file */
+
+			g_error_free (error);
+			error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "");
+			copy_file_data->ready_callback (copy_file_data->shared->default_response, NULL, error, copy_file_data->user_data);
+			copy_file_data_free (copy_file_data);
+		}
+		else if (copy_file_data->shared->dialog_visible
+			 && (copy_file_data->shared->default_response != GTH_OVERWRITE_RESPONSE_ALWAYS_NO))
+		{
+			/* wait for the response to the dialog of another
+			 * file */
+
+			copy_file_data->pending_error = error;
+			g_queue_push_tail (copy_file_data->shared->waiting_for_dialog, copy_file_data);
+		}
+		else if (copy_file_data->shared->default_response != GTH_OVERWRITE_RESPONSE_ALWAYS_NO) {
 			GtkWidget *dialog;
 
+			copy_file_data->shared->dialog_visible = TRUE;
 			dialog = gth_overwrite_dialog_new (copy_file_data->source->file,
 							   NULL,
 							   copy_file_data->current_destination,
-							   copy_file_data->default_response,
+							   copy_file_data->shared->default_response,
 							   copy_file_data->tot_files == 1);
 
 			if (copy_file_data->dialog_callback != NULL)
@@ -1012,12 +1141,12 @@ copy_file__handle_error (CopyFileData *copy_file_data,
 			gtk_widget_show (dialog);
 		}
 		else {
-			copy_file_data->ready_callback (copy_file_data->default_response, NULL, error, copy_file_data->user_data);
+			copy_file_data->ready_callback (copy_file_data->shared->default_response, NULL, error, copy_file_data->user_data);
 			copy_file_data_free (copy_file_data);
 		}
 	}
 	else {
-		copy_file_data->ready_callback (copy_file_data->default_response, NULL, error, copy_file_data->user_data);
+		copy_file_data->ready_callback (copy_file_data->shared->default_response, NULL, error, copy_file_data->user_data);
 		copy_file_data_free (copy_file_data);
 	}
 }
@@ -1031,7 +1160,7 @@ copy_file_ready_cb (GObject      *source_object,
 	CopyFileData *copy_file_data = user_data;
 	GError       *error = NULL;
 
-	if (! g_file_copy_finish (G_FILE (source_object), result, &error)) {
+	if (! _g_file_copy_fast_finish (G_FILE (source_object), result, &error)) {
 		copy_file__handle_error (copy_file_data, error);
 		return;
 	}
@@ -1050,11 +1179,14 @@ copy_file_progress_cb (goffset  current_num_bytes,
 	char         *s2;
 	char         *details;
 
+	copy_file_data->shared->copied_size += current_num_bytes - copy_file_data->current_size;
+	copy_file_data->current_size = current_num_bytes;
+
 	if (copy_file_data->progress_callback == NULL)
 		return;
 
-	s1 = g_format_size (copy_file_data->copied_size + current_num_bytes);
-	s2 = g_format_size (copy_file_data->tot_size);
+	s1 = g_format_size (copy_file_data->shared->copied_size);
+	s2 = g_format_size (copy_file_data->shared->tot_size);
 	/* For translators: This is a progress size indicator, for example: 230.4 MB of 512.8 MB */
 	details = g_strdup_printf (_("%s of %s"), s1, s2);
 
@@ -1062,7 +1194,7 @@ copy_file_progress_cb (goffset  current_num_bytes,
 					   copy_file_data->message,
 					   details,
 					   FALSE,
-					   (double) (copy_file_data->copied_size + current_num_bytes) / copy_file_data->tot_size,
+					   (double) copy_file_data->shared->copied_size / copy_file_data->shared->tot_size,
 					   copy_file_data->progress_callback_data);
 
 	g_free (details);
@@ -1076,7 +1208,7 @@ _g_copy_file_to_destination_call_ready_callback (gpointer user_data)
 {
 	CopyFileData *copy_file_data = user_data;
 
-	copy_file_data->ready_callback (copy_file_data->default_response, NULL, NULL, copy_file_data->user_data);
+	copy_file_data->ready_callback (copy_file_data->shared->default_response, NULL, NULL, copy_file_data->user_data);
 	copy_file_data_free (copy_file_data);
 }
 
@@ -1094,7 +1226,7 @@ make_directory_ready_cb (GObject      *source_object,
 		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
 			g_clear_error (&error);
 
-	copy_file_data->ready_callback (copy_file_data->default_response, NULL, error, copy_file_data->user_data);
+	copy_file_data->ready_callback (copy_file_data->shared->default_response, NULL, error, copy_file_data->user_data);
 	copy_file_data_free (copy_file_data);
 }
 
@@ -1104,7 +1236,7 @@ _g_copy_file_to_destination (CopyFileData   *copy_file_data,
 			     GFile          *destination,
 			     GFileCopyFlags  flags)
 {
-	if (copy_file_data->default_response == GTH_OVERWRITE_RESPONSE_ALWAYS_YES)
+	if (copy_file_data->shared->default_response == GTH_OVERWRITE_RESPONSE_ALWAYS_YES)
 		flags |= G_FILE_COPY_OVERWRITE;
 	if (copy_file_data->flags & GTH_FILE_COPY_ALL_METADATA)
 		flags |= G_FILE_COPY_ALL_METADATA;
@@ -1116,7 +1248,7 @@ _g_copy_file_to_destination (CopyFileData   *copy_file_data,
 		GFile *old_destination;
 
 		if ((copy_file_data->move
-		    || (copy_file_data->default_response == GTH_OVERWRITE_RESPONSE_ALWAYS_YES)
+		    || (copy_file_data->shared->default_response == GTH_OVERWRITE_RESPONSE_ALWAYS_YES)
 		    || ! (copy_file_data->flags & GTH_FILE_COPY_RENAME_SAME_FILE)))
 		{
 			call_when_idle (_g_copy_file_to_destination_call_ready_callback, copy_file_data);
@@ -1191,15 +1323,15 @@ _g_copy_file_to_destination (CopyFileData   *copy_file_data,
 			}
 		}
 
-		g_file_copy_async (copy_file_data->source->file,
-				   copy_file_data->current_destination,
-				   flags,
-				   copy_file_data->io_priority,
-				   copy_file_data->cancellable,
-				   copy_file_progress_cb,
-				   copy_file_data,
-				   copy_file_ready_cb,
-				   copy_file_data);
+		_g_file_copy_fast_async (copy_file_data->source->file,
+					 copy_file_data->current_destination,
+					 flags,
+					 copy_file_data->io_priority,
+					 copy_file_data->cancellable,
+					 copy_file_progress_cb,
+					 copy_file_data,
+					 copy_file_ready_cb,
+					 copy_file_data);
 		break;
 	}
 }
@@ -1210,10 +1342,8 @@ _g_copy_file_async_private (GthFileData           *source,
 			    GFile                 *destination,
 			    gboolean               move,
 			    GthFileCopyFlags       flags,
-			    GthOverwriteResponse   default_response,
+			    CopyShared            *shared,
 			    int                    io_priority,
-			    goffset                tot_size,
-			    goffset                copied_size,
 			    gsize                  tot_files,
 			    GCancellable          *cancellable,
 			    ProgressCallback       progress_callback,
@@ -1234,8 +1364,8 @@ _g_copy_file_async_private (GthFileData           *source,
 	copy_file_data->move = move;
 	copy_file_data->flags = flags;
 	copy_file_data->io_priority = io_priority;
-	copy_file_data->tot_size = tot_size;
-	copy_file_data->copied_size = copied_size;
+	copy_file_data->shared = copy_shared_ref (shared);
+	copy_file_data->current_size = 0;
 	copy_file_data->tot_files = tot_files;
 	copy_file_data->cancellable = _g_object_ref (cancellable);
 	copy_file_data->progress_callback = progress_callback;
@@ -1244,7 +1374,6 @@ _g_copy_file_async_private (GthFileData           *source,
 	copy_file_data->dialog_callback_data = dialog_callback_data;
 	copy_file_data->ready_callback = ready_callback;
 	copy_file_data->user_data = user_data;
-	copy_file_data->default_response = default_response;
 	copy_file_data->move_succeed = FALSE;
 
 	_g_copy_file_to_destination (copy_file_data, copy_file_data->destination, G_FILE_COPY_NONE);
@@ -1266,14 +1395,15 @@ _gth_file_data_copy_async (GthFileData           *source,
 			   CopyReadyCallback      ready_callback,
 			   gpointer               user_data)
 {
+	CopyShared *shared;
+
+	shared = copy_shared_new (default_response, g_file_info_get_size (source->info));
 	_g_copy_file_async_private (source,
 				    destination,
 				    move,
 				    flags,
-				    default_response,
+				    shared,
 				    io_priority,
-				    g_file_info_get_size (source->info),
-				    0,
 				    1,
 				    cancellable,
 				    progress_callback,
@@ -1282,6 +1412,8 @@ _gth_file_data_copy_async (GthFileData           *source,
 				    dialog_callback_data,
 				    ready_callback,
 				    user_data);
+
+	copy_shared_unref (shared);
 }
 
 
@@ -1304,12 +1436,18 @@ typedef struct {
 	GList                *current_source_sidecar;
 	GList                *current_destination_sidecar;
 
-	goffset               tot_size;
-	goffset               copied_size;
+	CopyShared           *shared;
 	gsize                 tot_files;
 
+	int                   max_files_in_flight;
+	int                   n_files_in_flight;
+	gboolean              directory_in_flight;
+	GHashTable           *files_in_flight;
+	GHashTable           *related_files;  /* GFile -> GPtrArray of GFile */
+	gboolean              starting_files;
+	GError               *error;
+
 	char                 *message;
-	GthOverwriteResponse  default_response;
 
 	gboolean              move;
 	GthFileCopyFlags      flags;
@@ -1327,6 +1465,9 @@ typedef struct {
 static void
 copy_data_free (CopyData *copy_data)
 {
+	g_hash_table_destroy (copy_data->related_files);
+	g_hash_table_destroy (copy_data->files_in_flight);
+	copy_shared_unref (copy_data->shared);
 	g_free (copy_data->message);
 	_g_object_list_unref (copy_data->destination_sidecars);
 	_g_object_list_unref (copy_data->source_sidecars);
@@ -1351,30 +1492,32 @@ copy_data__done (CopyData *copy_data,
 }
 
 
-static void copy_data__copy_current_file (CopyData *copy_data);
-
+/* A file of the list being copied. */
+typedef struct {
+	CopyData    *copy_data;
+	GthFileData *source;
+} CopyJob;
 
-static void
-copy_data__copy_next_file (CopyData *copy_data)
-{
-	GthFileData *source = (GthFileData *) copy_data->current->data;
 
-	copy_data->copied_size += g_file_info_get_size (source->info);
-	copy_data->current = copy_data->current->next;
-	copy_data__copy_current_file (copy_data);
-}
+static void copy_data__copy_next_files (CopyData *copy_data);
 
 
 static void
-copy_data__copy_current_file_ready_cb (GthOverwriteResponse  response,
-				       GList                *other_files,
-				       GError               *error,
-			 	       gpointer              user_data)
+copy_data__copy_file_ready_cb (GthOverwriteResponse  response,
+			       GList                *other_files,
+			       GError               *error,
+			       gpointer              user_data)
 {
-	CopyData    *copy_data = user_data;
-	GthFileData *source = (GthFileData *) copy_data->current->data;
+	CopyJob     *job = user_data;
+	CopyData    *copy_data = job->copy_data;
+	GthFileData *source = job->source;
 	GList       *scan;
 
+	copy_data->n_files_in_flight--;
+	g_hash_table_remove (copy_data->files_in_flight, source->file);
+	if (g_file_info_get_file_type (source->info) == G_FILE_TYPE_DIRECTORY)
+		copy_data->directory_in_flight = FALSE;
+
 	if (error == NULL) {
 		/* save the correctly copied directories in order to delete
 		 * them after moving their content. */
@@ -1384,18 +1527,27 @@ copy_data__copy_current_file_ready_cb (GthOverwriteResponse  response,
 		}
 	}
 	else if ((response == GTH_OVERWRITE_RESPONSE_ALWAYS_NO) || ! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
-		copy_data__done (copy_data, error);
-		return;
+		/* stop at the first error, the files already in flight are
+		 * completed. */
+		if (copy_data->error == NULL)
+			copy_data->error = error;
+		else
+			g_error_free (error);
+		error = NULL;
 	}
 
-	g_hash_table_insert (copy_data->copied_files, g_file_dup (source->file), GINT_TO_POINTER (1));
-	for (scan = other_files; scan != NULL; scan = scan->next) {
-		GFile *other_file = G_FILE (scan->data);
-		g_hash_table_insert (copy_data->copied_files, g_file_dup (other_file), GINT_TO_POINTER (1));
+	if (copy_data->error == NULL) {
+		g_hash_table_insert (copy_data->copied_files, g_file_dup (source->file), GINT_TO_POINTER (1));
+		for (scan = other_files; scan != NULL; scan = scan->next) {
+			GFile *other_file = G_FILE (scan->data);
+			g_hash_table_insert (copy_data->copied_files, g_file_dup (other_file), GINT_TO_POINTER (1));
+		}
 	}
 
-	copy_data->default_response = response;
-	copy_data__copy_next_file (copy_data);
+	g_object_unref (job->source);
+	g_free (job);
+
+	copy_data__copy_next_files (copy_data);
 }
 
 
@@ -1427,25 +1579,46 @@ copy_data__delete_source_directories (CopyData *copy_data)
 }
 
 
-static void
-copy_data__copy_current_file (CopyData *copy_data)
+static gboolean
+copy_data__can_copy_file (CopyData    *copy_data,
+			  GthFileData *source)
 {
-	GthFileData *source;
-	gboolean     explicitly_requested;
-	GFile       *destination;
+	GPtrArray *related;
+	guint      i;
 
-	if (copy_data->current == NULL) {
-		copy_data__delete_source_directories (copy_data);
-		return;
+	/* the content of a directory is copied after the directory */
+
+	if (copy_data->directory_in_flight)
+		return FALSE;
+	if ((g_file_info_get_file_type (source->info) == G_FILE_TYPE_DIRECTORY) && (copy_data->n_files_in_flight > 0))
+		return FALSE;
+
+	/* a file and its sidecars are not copied at the same time */
+
+	related = g_hash_table_lookup (copy_data->related_files, source->file);
+	if (related != NULL) {
+		for (i = 0; i < related->len; i++)
+			if (g_hash_table_lookup (copy_data->files_in_flight, g_ptr_array_index (related, i)) != NULL)
+				return FALSE;
 	}
 
-	source = GTH_FILE_DATA (copy_data->current->data);
+	return TRUE;
+}
+
+
+static void
+copy_data__copy_file (CopyData    *copy_data,
+		      GthFileData *source)
+{
+	gboolean  explicitly_requested;
+	GFile    *destination;
+	CopyJob  *job;
 
 	/* Ignore already copied files.  These are sidecar files already copied
 	 * with _g_copy_file_async_private */
 
 	if (g_hash_table_lookup (copy_data->copied_files, source->file) != NULL) {
-		call_when_idle ((DataFunc) copy_data__copy_next_file, copy_data);
+		copy_data->shared->copied_size += g_file_info_get_size (source->info);
 		return;
 	}
 
@@ -1456,7 +1629,7 @@ copy_data__copy_current_file (CopyData *copy_data)
 	explicitly_requested = (g_hash_table_lookup (copy_data->source_hash, source->file) != NULL);
 	if (! explicitly_requested) {
 		if (! g_file_query_exists (source->file, copy_data->cancellable)) {
-			call_when_idle ((DataFunc) copy_data__copy_next_file, copy_data);
+			copy_data->shared->copied_size += g_file_info_get_size (source->info);
 			return;
 		}
 	}
@@ -1468,27 +1641,120 @@ copy_data__copy_current_file (CopyData *copy_data)
 	}
 	destination = _g_file_get_destination (source->file, copy_data->source_base, copy_data->destination);
 
+	copy_data->n_files_in_flight++;
+	g_hash_table_insert (copy_data->files_in_flight, g_object_ref (source->file), GINT_TO_POINTER (1));
+	if (g_file_info_get_file_type (source->info) == G_FILE_TYPE_DIRECTORY)
+		copy_data->directory_in_flight = TRUE;
+
+	job = g_new0 (CopyJob, 1);
+	job->copy_data = copy_data;
+	job->source = g_object_ref (source);
 	_g_copy_file_async_private (source,
 				    destination,
 				    copy_data->move,
 				    copy_data->flags,
-				    copy_data->default_response,
+				    copy_data->shared,
 				    copy_data->io_priority,
-				    copy_data->tot_size,
-				    copy_data->copied_size,
 				    copy_data->tot_files,
 				    copy_data->cancellable,
 				    copy_data->progress_callback,
 				    copy_data->progress_callback_data,
 				    copy_data->dialog_callback,
 				    copy_data->dialog_callback_data,
-				    copy_data__copy_current_file_ready_cb,
-				    copy_data);
+				    copy_data__copy_file_ready_cb,
+				    job);
 
 	g_object_unref (destination);
 }
 
 
+static void
+copy_data__copy_next_files (CopyData *copy_data)
+{
+	/* a file can be completed while it's started, the loop below starts
+	 * the following files. */
+
+	if (copy_data->starting_files)
+		return;
+
+	copy_data->starting_files = TRUE;
+	while ((copy_data->error == NULL)
+	       && (copy_data->current != NULL)
+	       && (copy_data->n_files_in_flight < copy_data->max_files_in_flight))
+	{
+		GthFileData *source = GTH_FILE_DATA (copy_data->current->data);
+
+		if (! copy_data__can_copy_file (copy_data, source))
+			break;
+
+		copy_data->current = copy_data->current->next;
+		copy_data__copy_file (copy_data, source);
+	}
+	copy_data->starting_files = FALSE;
+
+	if (copy_data->n_files_in_flight > 0)
+		return;
+
+	if (copy_data->error != NULL)
+		copy_data__done (copy_data, copy_data->error);
+	else if (copy_data->current == NULL)
+		copy_data__delete_source_directories (copy_data);
+}
+
+
+static void
+copy_data__add_related_file (CopyData *copy_data,
+			     GFile    *file,
+			     GFile    *related_file)
+{
+	GPtrArray *related;
+
+	related = g_hash_table_lookup (copy_data->related_files, file);
+	if (related == NULL) {
+		related = g_ptr_array_new_with_free_func (g_object_unref);
+		g_hash_table_insert (copy_data->related_files, g_object_ref (file), related);
+	}
+	g_ptr_array_add (related, g_object_ref (related_file));
+}
+
+
+/* Links the files of the list with their sidecars in the list. */
+static void
+copy_data__find_related_files (CopyData *copy_data)
+{
+	GHashTable *listed;
+	GList      *scan;
+
+	if ((copy_data->flags & GTH_FILE_COPY_ALL_METADATA) == 0)
+		return;
+
+	listed = g_hash_table_new ((GHashFunc) g_file_hash, (GEqualFunc) g_file_equal);
+	for (scan = copy_data->files; scan; scan = scan->next)
+		g_hash_table_insert (listed, GTH_FILE_DATA (scan->data)->file, GINT_TO_POINTER (1));
+
+	for (scan = copy_data->files; scan; scan = scan->next) {
+		GthFileData *file_data = GTH_FILE_DATA (scan->data);
+		GList       *sidecars = NULL;
+		GList       *scan_sidecar;
+
+		gth_hook_invoke ("add-sidecars", file_data->file, &sidecars);
+		for (scan_sidecar = sidecars; scan_sidecar; scan_sidecar = scan_sidecar->next) {
+			GFile *sidecar = scan_sidecar->data;
+
+			if (g_hash_table_lookup (listed, sidecar) == NULL)
+				continue;
+
+			copy_data__add_related_file (copy_data, file_data->file, sidecar);
+			copy_data__add_related_file (copy_data, sidecar, file_data->file);
+		}
+
+		_g_object_list_unref (sidecars);
+	}
+
+	g_hash_table_destroy (listed);
+}
+
+
 static void
 copy_files__sources_info_ready_cb (GList    *files,
 			           GError   *error,
@@ -1503,18 +1769,19 @@ copy_files__sources_info_ready_cb (GList    *files,
 	}
 
 	copy_data->files = _g_object_list_ref (files);
-	copy_data->tot_size = 0;
+	copy_data->shared->tot_size = 0;
 	copy_data->tot_files = 0;
 	for (scan = copy_data->files; scan; scan = scan->next) {
 		GthFileData *file_data = GTH_FILE_DATA (scan->data);
 
-		copy_data->tot_size += g_file_info_get_size (file_data->info);
+		copy_data->shared->tot_size += g_file_info_get_size (file_data->info);
 		copy_data->tot_files += 1;
 	}
+	copy_data__find_related_files (copy_data);
 
-	copy_data->copied_size = 0;
+	copy_data->shared->copied_size = 0;
 	copy_data->current = copy_data->files;
-	copy_data__copy_current_file (copy_data);
+	copy_data__copy_next_files (copy_data);
 }
 
 
@@ -1533,8 +1800,9 @@ _g_file_list_copy_async (GList                *sources, /* GFile list */
 			 ReadyFunc             done_callback,
 			 gpointer              user_data)
 {
-	CopyData *copy_data;
-	GList    *scan;
+	CopyData  *copy_data;
+	GList     *scan;
+	GSettings *settings;
 
 	copy_data = g_new0 (CopyData, 1);
 	copy_data->destination = g_object_ref (destination);
@@ -1548,9 +1816,16 @@ _g_file_list_copy_async (GList                *sources, /* GFile list */
 	copy_data->dialog_callback_data = dialog_callback_data;
 	copy_data->done_callback = done_callback;
 	copy_data->user_data = user_data;
-	copy_data->default_response = default_response;
+	copy_data->shared = copy_shared_new (default_response, 0);
 	copy_data->copied_files = g_hash_table_new_full ((GHashFunc) g_file_hash, (GEqualFunc) g_file_equal, (GDestroyNotify) g_object_unref, NULL);
 
+	copy_data->files_in_flight = g_hash_table_new_full ((GHashFunc) g_file_hash, (GEqualFunc) g_file_equal, (GDestroyNotify) g_object_unref, NULL);
+	copy_data->related_files = g_hash_table_new_full ((GHashFunc) g_file_hash, (GEqualFunc) g_file_equal, (GDestroyNotify) g_object_unref, (GDestroyNotify) g_ptr_array_unref);
+
+	settings = g_settings_new (PIX_GENERAL_SCHEMA);
+	copy_data->max_files_in_flight = MAX (1, g_settings_get_int (settings, PREF_GENERAL_PARALLEL_COPIES));
+	g_object_unref (settings);
+
 	/* save the explicitly requested files */
 	copy_data->source_hash = g_hash_table_new_full ((GHashFunc) g_file_hash, (GEqualFunc) g_file_equal, (GDestroyNotify) g_object_unref, NULL);
 	for (scan = sources; scan; scan = scan->next)
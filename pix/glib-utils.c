@@ -185,6 +185,161 @@ call_when_idle (DataFunc  func,
 }
 
 
+/* -- _g_parallel_for_bands -- */
+
+
+int
+_g_get_n_worker_threads (void)
+{
+	return MAX ((int) g_get_num_processors (), 1);
+}
+
+
+typedef struct {
+	int       ref;
+	int       n_items;
+	int       band_size;
+	int       n_bands;
+	gint      next_band;
+	gint      n_done;
+	BandFunc  func;
+	gpointer  user_data;
+	GMutex    mutex;
+	GCond     cond;
+} ParallelBandsData;
+
+
+/* set while a thread is running the bands of a _g_parallel_for_bands
+ * call, a nested call from the same thread runs inline. */
+static GPrivate running_bands = G_PRIVATE_INIT (NULL);
+
+
+static void
+parallel_bands_data_unref (ParallelBandsData *data)
+{
+	if (! g_atomic_int_dec_and_test (&data->ref))
+		return;
+
+	g_cond_clear (&data->cond);
+	g_mutex_clear (&data->mutex);
+	g_free (data);
+}
+
+
+static void
+parallel_bands_run (ParallelBandsData *data)
+{
+	gpointer running;
+
+	running = g_private_get (&running_bands);
+	g_private_set (&running_bands, GINT_TO_POINTER (TRUE));
+
+	for (;;) {
+		int band;
+		int first;
+
+		band = g_atomic_int_add (&data->next_band, 1);
+		if (band >= data->n_bands)
+			break;
+
+		first = band * data->band_size;
+		data->func (first, MIN (first + data->band_size, data->n_items), data->user_data);
+
+		if (g_atomic_int_add (&data->n_done, 1) + 1 == data->n_bands) {
+			g_mutex_lock (&data->mutex);
+			g_cond_signal (&data->cond);
+			g_mutex_unlock (&data->mutex);
+		}
+	}
+
+	g_private_set (&running_bands, running);
+}
+
+
+static void
+parallel_bands_pool_func (gpointer job,
+			  gpointer user_data)
+{
+	parallel_bands_run (job);
+	parallel_bands_data_unref (job);
+}
+
+
+static GThreadPool *
+get_parallel_bands_pool (void)
+{
+	static GThreadPool *pool = NULL;
+	static gsize        initialization = 0;
+
+	if (g_once_init_enter (&initialization)) {
+		pool = g_thread_pool_new (parallel_bands_pool_func,
+					  NULL,
+					  MAX (_g_get_n_worker_threads () - 1, 1),
+					  FALSE,
+					  NULL);
+		g_once_init_leave (&initialization, 1);
+	}
+
+	return pool;
+}
+
+
+/* Splits the [0, n_items) range in bands of band_size items and runs func
+ * on every band.  The bands are shared between the calling thread and a
+ * process-wide pool of worker threads, one for each processor, the
+ * function returns when all the bands have been processed.  A call made
+ * from inside a band runs all its bands in the calling thread, this way
+ * nested calls don't multiply the threads or wait for each other. */
+void
+_g_parallel_for_bands (int       n_items,
+		       int       band_size,
+		       BandFunc  func,
+		       gpointer  user_data)
+{
+	ParallelBandsData *data;
+	int                n_threads;
+	GThreadPool       *pool;
+	int                i;
+
+	if (n_items <= 0)
+		return;
+
+	data = g_new (ParallelBandsData, 1);
+	data->ref = 1;
+	data->n_items = n_items;
+	data->band_size = MAX (band_size, 1);
+	data->n_bands = (n_items + data->band_size - 1) / data->band_size;
+	data->next_band = 0;
+	data->n_done = 0;
+	data->func = func;
+	data->user_data = user_data;
+	g_mutex_init (&data->mutex);
+	g_cond_init (&data->cond);
+
+	n_threads = MIN (_g_get_n_worker_threads (), data->n_bands);
+	if (g_private_get (&running_bands) != NULL)
+		n_threads = 1;
+
+	pool = (n_threads > 1) ? get_parallel_bands_pool () : NULL;
+	for (i = 0; i < n_threads - 1; i++) {
+		g_atomic_int_inc (&data->ref);
+		g_thread_pool_push (pool, data, NULL);
+	}
+
+	parallel_bands_run (data);
+
+	/* wait for the bands taken by the workers, the workers that start
+	 * later find no band left and only release the data. */
+
+	g_mutex_lock (&data->mutex);
+	while (g_atomic_int_get (&data->n_done) < data->n_bands)
+		g_cond_wait (&data->cond, &data->mutex);
+	g_mutex_unlock (&data->mutex);
+
+	parallel_bands_data_unref (data);
+}
+
+
 typedef struct {
 	gpointer       object;
 	ReadyCallback  ready_func;
@@ -152,6 +152,18 @@ void		ready_with_error		(ReadyFunc	  ready_func,
 						 gpointer	  user_data,
 						 GError	 *error);
 
+/* worker threads */
+
+typedef void (*BandFunc) (int      first,
+			  int      last,
+			  gpointer user_data);
+
+int		_g_get_n_worker_threads		(void);
+void		_g_parallel_for_bands		(int		  n_items,
+						 int		  band_size,
+						 BandFunc	  func,
+						 gpointer	  user_data);
+
 /* debug */
 
 void		debug				(const char	 *file,
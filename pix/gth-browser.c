@@ -78,6 +78,9 @@
 #define HISTORY_FILE "history.xbel"
 #define OVERLAY_MARGIN 10
 #define AUTO_OPEN_FOLDER_DELAY 500
+#define STREAM_FLUSH_DELAY 200
+#define METADATA_BATCH_MIN 64
+#define METADATA_BATCH_MAX 1024
 
 
 enum {
@@ -171,6 +174,7 @@ struct _GthBrowserPrivate {
 	gboolean           close_with_task;
 	GList             *load_data_queue;
 	gpointer           last_folder_to_open;
+	gpointer           metadata_loader;
 	GList             *load_file_data_queue;
 	guint              load_file_timeout;
 	guint              load_metadata_timeout;
@@ -953,6 +957,255 @@ _gth_browser_update_statusbar_list_info (GthBrowser *browser)
 }
 
 
+/* -- metadata loader -- */
+
+
+/* Reads the metadata of the files of the current location in the
+ * background, after the files have been added to the list.  The visible
+ * files are read first. */
+
+
+typedef struct {
+	GthBrowser   *browser;
+	char         *attributes;
+	GHashTable   *pending;
+	GQueue       *queue;
+	GCancellable *cancellable;
+	gboolean      running;
+	int           n_loaded;
+} MetadataLoader;
+
+
+typedef struct {
+	MetadataLoader *loader;
+	GList          *files;
+	GList          *copies;
+} MetadataBatch;
+
+
+static MetadataLoader *
+metadata_loader_new (GthBrowser *browser,
+		     const char *attributes)
+{
+	MetadataLoader *loader;
+
+	loader = g_new0 (MetadataLoader, 1);
+	loader->browser = browser;
+	loader->attributes = g_strdup (attributes);
+	loader->pending = g_hash_table_new_full (g_file_hash,
+						 (GEqualFunc) g_file_equal,
+						 NULL,
+						 g_object_unref);
+	loader->queue = g_queue_new ();
+	loader->cancellable = g_cancellable_new ();
+	loader->running = FALSE;
+	loader->n_loaded = 0;
+
+	return loader;
+}
+
+
+static void
+metadata_loader_free (MetadataLoader *loader)
+{
+	g_free (loader->attributes);
+	g_hash_table_destroy (loader->pending);
+	g_queue_free_full (loader->queue, g_object_unref);
+	g_object_unref (loader->cancellable);
+	g_free (loader);
+}
+
+
+static void
+metadata_batch_free (MetadataBatch *batch)
+{
+	_g_object_list_unref (batch->files);
+	_g_object_list_unref (batch->copies);
+	g_free (batch);
+}
+
+
+static gboolean
+metadata_loader_take (MetadataLoader  *loader,
+		      GFile           *file,
+		      GList          **files)
+{
+	GthFileData *file_data;
+
+	file_data = g_hash_table_lookup (loader->pending, file);
+	if (file_data == NULL)
+		return FALSE;
+
+	*files = g_list_prepend (*files, g_object_ref (file_data));
+	g_hash_table_remove (loader->pending, file_data->file);
+
+	return TRUE;
+}
+
+
+static void metadata_loader_next (MetadataLoader *loader);
+
+
+static void
+metadata_batch_ready_cb (GObject      *source_object,
+			 GAsyncResult *result,
+			 gpointer      user_data)
+{
+	MetadataBatch  *batch = user_data;
+	MetadataLoader *loader = batch->loader;
+	GError         *error = NULL;
+
+	loader->running = FALSE;
+	_g_query_metadata_finish (result, &error);
+
+	if (loader->browser == NULL) {
+		/* the loader was stopped */
+		g_clear_error (&error);
+		metadata_batch_free (batch);
+		metadata_loader_free (loader);
+		return;
+	}
+
+	if (error == NULL) {
+		GList *scan_file;
+		GList *scan_copy;
+
+		/* the metadata was read in a copy of the file data to avoid
+		 * changing the list from another thread. */
+
+		for (scan_file = batch->files, scan_copy = batch->copies;
+		     (scan_file != NULL) && (scan_copy != NULL);
+		     scan_file = scan_file->next, scan_copy = scan_copy->next)
+		{
+			GthFileData *file_data = scan_file->data;
+			GthFileData *copy = scan_copy->data;
+
+			_g_file_info_update (file_data->info, copy->info);
+		}
+		loader->n_loaded += g_list_length (batch->files);
+		gth_file_list_update_metadata (GTH_FILE_LIST (loader->browser->priv->file_list), batch->files);
+	}
+	else
+		g_error_free (error);
+
+	metadata_batch_free (batch);
+	metadata_loader_next (loader);
+}
+
+
+static void
+metadata_loader_next (MetadataLoader *loader)
+{
+	GthBrowser    *browser = loader->browser;
+	int            batch_size;
+	int            n_files;
+	GList         *files;
+	GthFileStore  *file_store;
+	GtkWidget     *view;
+	int            first;
+	int            last;
+	int            i;
+	MetadataBatch *batch;
+	GList         *scan;
+
+	if (loader->running || (g_hash_table_size (loader->pending) == 0))
+		return;
+
+	/* use small batches at first to update the visible files as soon as
+	 * possible, and larger batches later to reduce the number of updates
+	 * of the list. */
+
+	batch_size = CLAMP (loader->n_loaded / 2, METADATA_BATCH_MIN, METADATA_BATCH_MAX);
+	n_files = 0;
+	files = NULL;
+
+	/* the visible files first... */
+
+	file_store = gth_file_list_get_model (GTH_FILE_LIST (browser->priv->file_list));
+	view = gth_file_list_get_view (GTH_FILE_LIST (browser->priv->file_list));
+	first = gth_file_view_get_first_visible (GTH_FILE_VIEW (view));
+	last = gth_file_view_get_last_visible (GTH_FILE_VIEW (view));
+	for (i = MAX (first, 0); (i <= last) && (n_files < batch_size); i++) {
+		GtkTreeIter  iter;
+		GthFileData *file_data;
+
+		if (! gth_file_store_get_nth_visible (file_store, i, &iter))
+			break;
+
+		file_data = gth_file_store_get_file (file_store, &iter);
+		if (metadata_loader_take (loader, file_data->file, &files))
+			n_files++;
+	}
+
+	/* ...then the others, in loading order. */
+
+	while ((n_files < batch_size) && ! g_queue_is_empty (loader->queue)) {
+		GthFileData *file_data;
+
+		file_data = g_queue_pop_head (loader->queue);
+		if (metadata_loader_take (loader, file_data->file, &files))
+			n_files++;
+		g_object_unref (file_data);
+	}
+
+	if (files == NULL)
+		return;
+
+	batch = g_new0 (MetadataBatch, 1);
+	batch->loader = loader;
+	batch->files = g_list_reverse (files);
+	for (scan = batch->files; scan; scan = scan->next)
+		batch->copies = g_list_prepend (batch->copies, gth_file_data_dup ((GthFileData *) scan->data));
+	batch->copies = g_list_reverse (batch->copies);
+
+	loader->running = TRUE;
+	_g_query_metadata_async (batch->copies,
+				 loader->attributes,
+				 loader->cancellable,
+				 metadata_batch_ready_cb,
+				 batch);
+}
+
+
+static void
+metadata_loader_add_files (MetadataLoader *loader,
+			   GList          *files)
+{
+	GList *scan;
+
+	for (scan = files; scan; scan = scan->next) {
+		GthFileData *file_data = scan->data;
+
+		if (g_file_info_get_file_type (file_data->info) != G_FILE_TYPE_REGULAR)
+			continue;
+		if (g_hash_table_contains (loader->pending, file_data->file))
+			continue;
+
+		g_hash_table_insert (loader->pending, file_data->file, g_object_ref (file_data));
+		g_queue_push_tail (loader->queue, g_object_ref (file_data));
+	}
+
+	metadata_loader_next (loader);
+}
+
+
+static void
+_gth_browser_stop_metadata_loader (GthBrowser *browser)
+{
+	MetadataLoader *loader = browser->priv->metadata_loader;
+
+	if (loader == NULL)
+		return;
+
+	browser->priv->metadata_loader = NULL;
+	loader->browser = NULL;
+	if (loader->running)
+		g_cancellable_cancel (loader->cancellable); /* freed in metadata_batch_ready_cb */
+	else
+		metadata_loader_free (loader);
+}
+
+
 typedef struct {
 	GthBrowser    *browser;
 	GthFileData   *requested_folder;
@@ -966,6 +1219,12 @@ typedef struct {
 	GFile         *entry_point;
 	GthFileSource *file_source;
 	GCancellable  *cancellable;
+	GList         *stream_files;
+	GList         *stream_batch;
+	int            n_stream_batch;
+	int            n_streamed;
+	gboolean       stream_started;
+	guint          stream_flush_id;
 } LoadData;
 
 
@@ -1037,6 +1296,10 @@ load_data_free (LoadData *data)
 	_g_object_list_unref (data->list);
 	_g_object_unref (data->entry_point);
 	g_object_unref (data->cancellable);
+	if (data->stream_flush_id != 0)
+		g_source_remove (data->stream_flush_id);
+	_g_object_list_unref (data->stream_files);
+	_g_object_list_unref (data->stream_batch);
 	g_free (data);
 }
 
@@ -1342,6 +1605,29 @@ _gth_browser_set_sort_order (GthBrowser      *browser,
 
 
 static void _gth_browser_load_ready_cb (GthFileSource *file_source, GList *files, GError *error, gpointer user_data);
+static DirOp stream__start_dir_func (GFile *directory, GFileInfo *info, GError **error, gpointer user_data);
+static void stream__for_each_file_func (GFile *file, GFileInfo *info, gpointer user_data);
+static void stream__done_func (GObject *object, GError *error, gpointer user_data);
+
+
+/* The files can be shown while the folder is being read only if the
+ * filter doesn't require the metadata, otherwise the files are shown after
+ * reading the metadata of all of them. */
+static gboolean
+_gth_browser_can_stream_folder (GthBrowser *browser,
+				const char *attributes)
+{
+	GthTest    *filter;
+	const char *filter_attributes;
+	gboolean    can_stream;
+
+	filter = _gth_browser_get_file_filter (browser);
+	filter_attributes = (filter != NULL) ? gth_test_get_attributes (filter) : NULL;
+	can_stream = (filter_attributes == NULL) || _g_file_attributes_matches_all (filter_attributes, attributes);
+	_g_object_unref (filter);
+
+	return can_stream;
+}
 
 
 static void
@@ -1351,15 +1637,30 @@ requested_folder_attributes_ready_cb (GObject  *file_source,
 {
 	LoadData   *load_data = user_data;
 	GthBrowser *browser = load_data->browser;
+	const char *attributes;
 
 	if (error != NULL) {
 		load_data_error (load_data, error);
 		return;
 	}
 
+	attributes = _gth_browser_get_fast_file_type (browser, load_data->requested_folder->file) ? GFILE_STANDARD_ATTRIBUTES_WITH_FAST_CONTENT_TYPE : GFILE_STANDARD_ATTRIBUTES_WITH_CONTENT_TYPE;
+
+	if (_gth_browser_can_stream_folder (browser, attributes)) {
+		gth_file_source_for_each_child (load_data->file_source,
+						load_data->requested_folder->file,
+						FALSE,
+						attributes,
+						stream__start_dir_func,
+						stream__for_each_file_func,
+						stream__done_func,
+						load_data);
+		return;
+	}
+
 	gth_file_source_list (load_data->file_source,
 			      load_data->requested_folder->file,
-			      _gth_browser_get_fast_file_type (browser, load_data->requested_folder->file) ? GFILE_STANDARD_ATTRIBUTES_WITH_FAST_CONTENT_TYPE : GFILE_STANDARD_ATTRIBUTES_WITH_CONTENT_TYPE,
+			      attributes,
 			      _gth_browser_load_ready_cb,
 			      load_data);
 }
@@ -1453,6 +1754,150 @@ static gboolean _gth_browser_make_file_visible (GthBrowser  *browser,
 						GthFileData *file_data);
 
 
+/* Switches the current location to the loaded folder and shows its files,
+ * path is the position of the folder in the folder tree. */
+static void
+load_data_set_location (LoadData    *load_data,
+			GtkTreePath *path,
+			GList       *files)
+{
+	GthBrowser *browser = load_data->browser;
+	GthTest    *filter;
+
+	_gth_browser_stop_metadata_loader (browser);
+
+	if ((browser->priv->location_source != NULL)
+		&& (browser->priv->monitor_location != NULL))
+	{
+		gth_file_source_monitor_directory (browser->priv->location_source,
+						   browser->priv->monitor_location,
+						   FALSE);
+		_g_clear_object (&browser->priv->monitor_location);
+	}
+
+	_g_object_unref (browser->priv->location_source);
+	browser->priv->location_source = g_object_ref (load_data->file_source);
+
+	browser->priv->recalc_location_free_space = TRUE;
+
+	switch (load_data->action) {
+	case GTH_ACTION_GO_TO:
+	case GTH_ACTION_TREE_OPEN:
+		_gth_browser_set_location (browser, load_data->requested_folder);
+		if (browser->priv->location != NULL)
+			_gth_browser_history_add (browser, browser->priv->location->file);
+		_gth_browser_history_menu (browser);
+		break;
+	case GTH_ACTION_GO_BACK:
+	case GTH_ACTION_GO_FORWARD:
+		_gth_browser_set_location (browser, load_data->requested_folder);
+		_gth_browser_history_menu (browser);
+		break;
+	default:
+		break;
+	}
+
+	if (path != NULL) {
+		GList    *entry_points;
+		GList    *scan;
+		gboolean  is_entry_point = FALSE;
+
+		/* Collapse everything else after loading an entry point. */
+
+		entry_points = gth_main_get_all_entry_points ();
+		for (scan = entry_points; scan; scan = scan->next) {
+			GthFileData *file_data = scan->data;
+
+			if (g_file_equal (file_data->file, load_data->requested_folder->file)) {
+				gth_folder_tree_collapse_all (GTH_FOLDER_TREE (browser->priv->folder_tree));
+				is_entry_point = TRUE;
+				break;
+			}
+		}
+
+		gtk_tree_view_expand_row (GTK_TREE_VIEW (browser->priv->folder_tree), path, FALSE);
+		gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (browser->priv->folder_tree),
+					      path,
+					      NULL,
+					      is_entry_point,
+					      0.0,
+					      0.0);
+		gth_folder_tree_select_path (GTH_FOLDER_TREE (browser->priv->folder_tree), path);
+
+		_g_object_list_unref (entry_points);
+	}
+
+	filter = _gth_browser_get_file_filter (browser);
+	gth_file_list_set_filter (GTH_FILE_LIST (browser->priv->file_list), filter);
+	gth_file_list_set_files (GTH_FILE_LIST (browser->priv->file_list), files);
+	g_object_unref (filter);
+
+	if (gth_window_get_current_page (GTH_WINDOW (browser)) == GTH_BROWSER_PAGE_BROWSER)
+		gth_file_list_focus (GTH_FILE_LIST (browser->priv->file_list));
+}
+
+
+/* Called when all the files of the new location have been loaded. */
+static void
+load_data_location_ready (LoadData *load_data)
+{
+	GthBrowser *browser = load_data->browser;
+
+	if (load_data->file_to_select != NULL)
+		gth_file_list_make_file_visible (GTH_FILE_LIST (browser->priv->file_list), load_data->file_to_select);
+	else if ((load_data->selected != NULL) || (load_data->vscroll > 0))
+		gth_file_list_restore_state (GTH_FILE_LIST (browser->priv->file_list), load_data->selected, load_data->vscroll);
+
+	_gth_browser_update_statusbar_list_info (browser);
+
+	g_assert (browser->priv->location_source != NULL);
+
+	if (browser->priv->monitor_location != NULL)
+		g_object_unref (browser->priv->monitor_location);
+	browser->priv->monitor_location = g_file_dup (browser->priv->location->file);
+	gth_file_source_monitor_directory (browser->priv->location_source,
+					   browser->priv->monitor_location,
+					   TRUE);
+
+	if (browser->priv->current_file != NULL) {
+		_gth_browser_update_current_file_position (browser);
+		gth_browser_update_title (browser);
+		gth_browser_update_statusbar_file_info (browser);
+		if (gth_window_get_current_page (GTH_WINDOW (browser)) == GTH_BROWSER_PAGE_VIEWER) {
+			_gth_browser_make_file_visible (browser, browser->priv->current_file);
+			if (browser->priv->viewer_page != NULL) {
+				gth_viewer_page_update_info (browser->priv->viewer_page, browser->priv->current_file);
+				gth_viewer_page_focus (browser->priv->viewer_page);
+			}
+		}
+	}
+
+	gth_browser_update_title (browser);
+	gth_browser_update_extra_widget (browser);
+
+	/* moving the "gth-browser-load-location-after" after the
+	 * LOCATION_READY signal emition can brake the extensions */
+
+	gth_hook_invoke ("gth-browser-load-location-after", browser, browser->priv->location);
+
+	g_signal_emit (G_OBJECT (browser),
+		       gth_browser_signals[LOCATION_READY],
+		       0,
+		       load_data->requested_folder->file,
+		       FALSE);
+
+	if (StartSlideshow) {
+		StartSlideshow = FALSE;
+		gth_hook_invoke ("slideshow", browser);
+	}
+
+	if (StartInFullscreen) {
+		StartInFullscreen = FALSE;
+		gth_browser_fullscreen (browser);
+	}
+}
+
+
 static void
 load_data_continue (LoadData *load_data,
 		    GList    *loaded_files)
@@ -1462,7 +1907,6 @@ load_data_continue (LoadData *load_data,
 	GFile       *loaded_folder;
 	gboolean     loaded_requested_folder;
 	GtkTreePath *path;
-	gboolean     changed_current_location;
 
 	if (! load_data_is_still_relevant (load_data)) {
 		load_data_cancelled (load_data);
@@ -1489,137 +1933,185 @@ load_data_continue (LoadData *load_data,
 
 	load_data_done (load_data, NULL);
 
-	changed_current_location = gth_action_changes_folder (load_data->action);
-	if (changed_current_location) {
-		GthTest *filter;
+	if (gth_action_changes_folder (load_data->action)) {
+		load_data_set_location (load_data, path, files);
+		load_data_location_ready (load_data);
+	}
 
-		if ((browser->priv->location_source != NULL)
-			&& (browser->priv->monitor_location != NULL))
-		{
-			gth_file_source_monitor_directory (browser->priv->location_source,
-							   browser->priv->monitor_location,
-							   FALSE);
-			_g_clear_object (&browser->priv->monitor_location);
-		}
+	gth_browser_update_sensitivity (browser);
 
-		_g_object_unref (browser->priv->location_source);
-		browser->priv->location_source = g_object_ref (load_data->file_source);
+	if (path != NULL)
+		gtk_tree_path_free (path);
+	_g_object_list_unref (files);
+	load_data_free (load_data);
+}
 
-		browser->priv->recalc_location_free_space = TRUE;
 
-		switch (load_data->action) {
-		case GTH_ACTION_GO_TO:
-		case GTH_ACTION_TREE_OPEN:
-			_gth_browser_set_location (browser, load_data->requested_folder);
-			if (browser->priv->location != NULL)
-				_gth_browser_history_add (browser, browser->priv->location->file);
-			_gth_browser_history_menu (browser);
-			break;
-		case GTH_ACTION_GO_BACK:
-		case GTH_ACTION_GO_FORWARD:
-			_gth_browser_set_location (browser, load_data->requested_folder);
-			_gth_browser_history_menu (browser);
-			break;
-		default:
-			break;
-		}
+/* -- folder streaming -- */
 
-		if (path != NULL) {
-			GList    *entry_points;
-			GList    *scan;
-			gboolean  is_entry_point = FALSE;
 
-			/* Collapse everything else after loading an entry point. */
+/* The files of the requested folder are added to the file list while the
+ * folder is being read, the first batch as soon as possible, the following
+ * ones when their number is a fraction of the files already shown, to keep
+ * the cost of sorting and filtering the list proportional to the number of
+ * files.  The metadata is read in the background by the metadata loader. */
 
-			entry_points = gth_main_get_all_entry_points ();
-			for (scan = entry_points; scan; scan = scan->next) {
-				GthFileData *file_data = scan->data;
 
-				if (g_file_equal (file_data->file, load_data->requested_folder->file)) {
-					gth_folder_tree_collapse_all (GTH_FOLDER_TREE (browser->priv->folder_tree));
-					is_entry_point = TRUE;
-					break;
-				}
-			}
+static void
+load_data_stream_flush (LoadData *load_data)
+{
+	GthBrowser *browser = load_data->browser;
+	GList      *files;
 
-			gtk_tree_view_expand_row (GTK_TREE_VIEW (browser->priv->folder_tree), path, FALSE);
-			gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (browser->priv->folder_tree),
-						      path,
-						      NULL,
-						      is_entry_point,
-						      0.0,
-						      0.0);
-			gth_folder_tree_select_path (GTH_FOLDER_TREE (browser->priv->folder_tree), path);
+	if (load_data->stream_batch == NULL)
+		return;
 
-			_g_object_list_unref (entry_points);
-		}
+	files = _gth_browser_get_visible_files (browser, load_data->stream_batch);
+	_g_object_list_unref (load_data->stream_batch);
+	load_data->stream_batch = NULL;
+	load_data->n_streamed += load_data->n_stream_batch;
+	load_data->n_stream_batch = 0;
 
-		filter = _gth_browser_get_file_filter (browser);
-		gth_file_list_set_filter (GTH_FILE_LIST (browser->priv->file_list), filter);
-		gth_file_list_set_files (GTH_FILE_LIST (browser->priv->file_list), files);
-		g_object_unref (filter);
+	if (! load_data->stream_started) {
+		GtkTreePath *path;
 
-		if (gth_window_get_current_page (GTH_WINDOW (browser)) == GTH_BROWSER_PAGE_BROWSER)
-			gth_file_list_focus (GTH_FILE_LIST (browser->priv->file_list));
+		load_data->stream_started = TRUE;
+		path = gth_folder_tree_get_path (GTH_FOLDER_TREE (browser->priv->folder_tree), load_data->requested_folder->file);
+		load_data_set_location (load_data, path, files);
+		browser->priv->metadata_loader = metadata_loader_new (browser, _gth_browser_get_list_attributes (browser, TRUE));
 
-		if (load_data->file_to_select != NULL)
-			gth_file_list_make_file_visible (GTH_FILE_LIST (browser->priv->file_list), load_data->file_to_select);
-		else if ((load_data->selected != NULL) || (load_data->vscroll > 0))
-			gth_file_list_restore_state (GTH_FILE_LIST (browser->priv->file_list), load_data->selected, load_data->vscroll);
+		if (path != NULL)
+			gtk_tree_path_free (path);
+	}
+	else
+		gth_file_list_add_files (GTH_FILE_LIST (browser->priv->file_list), files, -1);
 
-		_gth_browser_update_statusbar_list_info (browser);
+	if (browser->priv->metadata_loader != NULL)
+		metadata_loader_add_files (browser->priv->metadata_loader, files);
 
-		g_assert (browser->priv->location_source != NULL);
+	_g_object_list_unref (files);
+}
 
-		if (browser->priv->monitor_location != NULL)
-			g_object_unref (browser->priv->monitor_location);
-		browser->priv->monitor_location = g_file_dup (browser->priv->location->file);
-		gth_file_source_monitor_directory (browser->priv->location_source,
-						   browser->priv->monitor_location,
-						   TRUE);
 
-		if (browser->priv->current_file != NULL) {
-			_gth_browser_update_current_file_position (browser);
-			gth_browser_update_title (browser);
-			gth_browser_update_statusbar_file_info (browser);
-			if (gth_window_get_current_page (GTH_WINDOW (browser)) == GTH_BROWSER_PAGE_VIEWER) {
-				_gth_browser_make_file_visible (browser, browser->priv->current_file);
-				if (browser->priv->viewer_page != NULL) {
-					gth_viewer_page_update_info (browser->priv->viewer_page, browser->priv->current_file);
-					gth_viewer_page_focus (browser->priv->viewer_page);
-				}
-			}
-		}
+static gboolean
+stream_flush_cb (gpointer user_data)
+{
+	LoadData *load_data = user_data;
 
-		gth_browser_update_title (browser);
-		gth_browser_update_extra_widget (browser);
+	load_data->stream_flush_id = 0;
 
-		/* moving the "gth-browser-load-location-after" after the
-		 * LOCATION_READY signal emition can brake the extensions */
+	if (! load_data_is_still_relevant (load_data)
+	    || g_cancellable_is_cancelled (load_data->cancellable))
+	{
+		return FALSE;
+	}
 
-		gth_hook_invoke ("gth-browser-load-location-after", browser, browser->priv->location);
+	if (load_data->stream_started && (load_data->n_stream_batch < load_data->n_streamed / 4)) {
+		load_data->stream_flush_id = g_timeout_add (STREAM_FLUSH_DELAY, stream_flush_cb, load_data);
+		return FALSE;
+	}
 
-		g_signal_emit (G_OBJECT (browser),
-			       gth_browser_signals[LOCATION_READY],
-			       0,
-			       load_data->requested_folder->file,
-			       FALSE);
+	load_data_stream_flush (load_data);
 
-		if (StartSlideshow) {
-			StartSlideshow = FALSE;
-			gth_hook_invoke ("slideshow", browser);
-		}
+	return FALSE;
+}
+
+
+static DirOp
+stream__start_dir_func (GFile       *directory,
+			GFileInfo   *info,
+			GError     **error,
+			gpointer     user_data)
+{
+	return DIR_OP_CONTINUE;
+}
+
+
+static void
+stream__for_each_file_func (GFile     *file,
+			    GFileInfo *info,
+			    gpointer   user_data)
+{
+	LoadData    *load_data = user_data;
+	GthFileData *file_data;
+
+	if (! load_data_is_still_relevant (load_data)
+	    || g_cancellable_is_cancelled (load_data->cancellable))
+	{
+		gth_file_source_cancel (load_data->file_source);
+		return;
+	}
+
+	switch (g_file_info_get_file_type (info)) {
+	case G_FILE_TYPE_REGULAR:
+	case G_FILE_TYPE_DIRECTORY:
+		break;
+	default:
+		return;
+	}
+
+	file_data = gth_file_data_new (file, info);
+	load_data->stream_files = g_list_prepend (load_data->stream_files, g_object_ref (file_data));
+	load_data->stream_batch = g_list_prepend (load_data->stream_batch, file_data);
+	load_data->n_stream_batch++;
+
+	if (load_data->stream_flush_id == 0)
+		load_data->stream_flush_id = g_timeout_add (load_data->stream_started ? STREAM_FLUSH_DELAY : 0,
+							    stream_flush_cb,
+							    load_data);
+}
+
+
+static void
+stream__done_func (GObject  *object,
+		   GError   *error,
+		   gpointer  user_data)
+{
+	LoadData   *load_data = user_data;
+	GthBrowser *browser = load_data->browser;
+	GList      *files;
+
+	if (load_data->stream_flush_id != 0) {
+		g_source_remove (load_data->stream_flush_id);
+		load_data->stream_flush_id = 0;
+	}
+
+	if ((error == NULL) && ! load_data_is_still_relevant (load_data))
+		error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "");
 
-		if (StartInFullscreen) {
-			StartInFullscreen = FALSE;
-			gth_browser_fullscreen (browser);
+	if (error != NULL) {
+		if (load_data->stream_started) {
+			/* the location has already changed, keep the files
+			 * loaded so far. */
+			load_data_done (load_data, error);
+			load_data_free (load_data);
 		}
+		else
+			load_data_error (load_data, error);
+		return;
 	}
 
+	load_data_stream_flush (load_data);
+
+	load_data->stream_files = g_list_reverse (load_data->stream_files);
+	files = _gth_browser_get_visible_files (browser, load_data->stream_files);
+	gth_folder_tree_set_children (GTH_FOLDER_TREE (browser->priv->folder_tree), load_data->requested_folder->file, files);
+	load_data_done (load_data, NULL);
+
+	if (! load_data->stream_started) {
+		GtkTreePath *path;
+
+		/* empty folder */
+
+		path = gth_folder_tree_get_path (GTH_FOLDER_TREE (browser->priv->folder_tree), load_data->requested_folder->file);
+		load_data_set_location (load_data, path, NULL);
+
+		if (path != NULL)
+			gtk_tree_path_free (path);
+	}
+	load_data_location_ready (load_data);
 	gth_browser_update_sensitivity (browser);
 
-	if (path != NULL)
-		gtk_tree_path_free (path);
 	_g_object_list_unref (files);
 	load_data_free (load_data);
 }
@@ -2695,6 +3187,7 @@ gth_browser_finalize (GObject *object)
 {
 	GthBrowser *browser = GTH_BROWSER (object);
 
+	_gth_browser_stop_metadata_loader (browser);
 	g_list_free (browser->priv->fixed_viewer_controls);
 	g_hash_table_destroy (browser->priv->menu_managers);
 	browser_state_free (&browser->priv->state);
@@ -4291,6 +4784,16 @@ pref_scroll_action_changed (GSettings  *settings,
 }
 
 
+static void
+pref_image_cache_size_changed (GSettings  *settings,
+			       const char *key,
+			       gpointer    user_data)
+{
+	GthBrowser *browser = user_data;
+	gth_image_preloader_set_max_cache_size (browser->priv->image_preloader, (gsize) MAX (g_settings_get_int (settings, key), 0) * 1024 * 1024);
+}
+
+
 static gboolean
 _gth_browser_realize (GtkWidget *browser,
 		      gpointer  *data)
@@ -4444,6 +4947,7 @@ gth_browser_init (GthBrowser *browser)
 	GtkWidget      *scrolled_window;
 	char           *sort_type;
 	char           *caption;
+	GSettings      *settings;
 	int             i;
 
 	g_object_set (browser,
@@ -4457,6 +4961,9 @@ gth_browser_init (GthBrowser *browser)
 	browser->priv->viewer_pages = NULL;
 	browser->priv->viewer_page = NULL;
 	browser->priv->image_preloader = gth_image_preloader_new ();
+	settings = g_settings_new (PIX_BROWSER_SCHEMA);
+	gth_image_preloader_set_max_cache_size (browser->priv->image_preloader, (gsize) MAX (g_settings_get_int (settings, PREF_BROWSER_IMAGE_CACHE_SIZE), 0) * 1024 * 1024);
+	g_object_unref (settings);
 	browser->priv->progress_dialog = NULL;
 	browser->priv->named_dialogs = g_hash_table_new (g_str_hash, g_str_equal);
 	browser->priv->location = NULL;
@@ -4483,6 +4990,7 @@ gth_browser_init (GthBrowser *browser)
 	browser->priv->close_with_task = FALSE;
 	browser->priv->load_data_queue = NULL;
 	browser->priv->last_folder_to_open = NULL;
+	browser->priv->metadata_loader = NULL;
 	browser->priv->load_file_data_queue = NULL;
 	browser->priv->load_file_timeout = 0;
 	browser->priv->load_metadata_timeout = 0;
@@ -5304,6 +5812,10 @@ gth_browser_init (GthBrowser *browser)
 			  "changed::" PREF_VIEWER_SCROLL_ACTION,
 			  G_CALLBACK (pref_scroll_action_changed),
 			  browser);
+	g_signal_connect (browser->priv->browser_settings,
+			  "changed::" PREF_BROWSER_IMAGE_CACHE_SIZE,
+			  G_CALLBACK (pref_image_cache_size_changed),
+			  browser);
 
 	browser->priv->constructed = TRUE;
 }
@@ -6982,6 +7494,8 @@ _gth_browser_cancel (GthBrowser *browser,
 		browser->priv->load_metadata_timeout = 0;
 	}
 
+	_gth_browser_stop_metadata_loader (browser);
+
 	for (scan = browser->priv->load_data_queue; scan; scan = scan->next) {
 		LoadData *data = scan->data;
 
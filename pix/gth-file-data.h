@@ -25,6 +25,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include <gio/gio.h>
+#include "gth-sort-key.h"
 #include "gth-string-list.h"
 
 G_BEGIN_DECLS
@@ -55,12 +56,16 @@ struct _GthFileDataClass {
 
 typedef int  (*GthFileDataCompFunc) (GthFileData *a, GthFileData *b);
 typedef void (*GthFileDataFunc)     (GthFileData *a, GError *error, gpointer data);
+typedef void (*GthFileDataKeyFunc)  (GthFileData *file_data, GthSortKey *key);
 
+/* key_func is optional, it must set a key with the same order of
+ * cmp_func. */
 typedef struct {
 	const char          *name;
 	const char          *display_name;
 	const char          *required_attributes;
 	GthFileDataCompFunc  cmp_func;
+	GthFileDataKeyFunc   key_func;
 } GthFileDataSort;
 
 GType         gth_file_data_get_type                (void);
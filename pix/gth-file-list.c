@@ -37,7 +37,7 @@
 #define RESTART_LOADING_THUMBS_DELAY 1500
 #define N_VIEWAHEAD 500
 #define N_CREATEAHEAD 50000
-#define MAX_THUMBNAIL_LOADERS 4
+#define N_JOBS_PER_WORKER 2
 #define NO_FILE_MSG (N_("No file"))
 #define _FILE_VIEW "file-view"
 #define _EMPTY_VIEW "empty-view"
@@ -62,6 +62,7 @@ typedef enum {
 	GTH_FILE_LIST_OP_TYPE_ADD_FILES,
 	GTH_FILE_LIST_OP_TYPE_UPDATE_FILES,
 	GTH_FILE_LIST_OP_TYPE_UPDATE_EMBLEMS,
+	GTH_FILE_LIST_OP_TYPE_UPDATE_METADATA,
 	GTH_FILE_LIST_OP_TYPE_DELETE_FILES,
 	GTH_FILE_LIST_OP_TYPE_SET_FILTER,
 	GTH_FILE_LIST_OP_TYPE_SET_SORT_FUNC,
@@ -142,6 +143,8 @@ struct _GthFileListPrivate {
 	ThumbnailerState  thumbnailer_state;
 	int               max_loaders;
 	int               started_loaders;
+	GTimer           *thumbs_timer;
+	int               thumbs_done;
 	gboolean          allow_empty_view;
 };
 
@@ -183,6 +186,7 @@ gth_file_list_op_free (GthFileListOp *op)
 	case GTH_FILE_LIST_OP_TYPE_ADD_FILES:
 	case GTH_FILE_LIST_OP_TYPE_UPDATE_FILES:
 	case GTH_FILE_LIST_OP_TYPE_UPDATE_EMBLEMS:
+	case GTH_FILE_LIST_OP_TYPE_UPDATE_METADATA:
 		_g_object_list_unref (op->file_list);
 		break;
 	case GTH_FILE_LIST_OP_TYPE_DELETE_FILES:
@@ -273,6 +277,7 @@ gth_file_list_finalize (GObject *object)
 
 	_gth_file_list_clear_queue (file_list);
 	_g_object_unref (file_list->priv->thumb_loader);
+	g_timer_destroy (file_list->priv->thumbs_timer);
 	if (file_list->priv->icon_cache != NULL)
 		gth_icon_cache_free (file_list->priv->icon_cache);
 	g_object_unref (file_list->priv->settings);
@@ -358,8 +363,10 @@ gth_file_list_class_init (GthFileListClass *class)
 static int
 _get_max_loaders (void)
 {
-	int n = (int) g_get_num_processors () - 2;
-	return CLAMP (n, 1, MAX_THUMBNAIL_LOADERS);
+	/* keep more jobs than workers, to give the thumbnailer pipeline
+	 * something to read ahead. */
+
+	return _g_get_n_worker_threads () * N_JOBS_PER_WORKER;
 }
 
 
@@ -390,6 +397,8 @@ gth_file_list_init (GthFileList *file_list)
 	file_list->priv->thumbnailer_state.phase = THUMBNAILER_PHASE_INITIALIZE;
 	file_list->priv->started_loaders = 0;
 	file_list->priv->max_loaders = _get_max_loaders ();
+	file_list->priv->thumbs_timer = g_timer_new ();
+	file_list->priv->thumbs_done = 0;
 	file_list->priv->allow_empty_view = TRUE;
 }
 
@@ -438,6 +447,18 @@ static void
 _gth_file_list_thumbs_completed (GthFileList *file_list)
 {
 	file_list->priv->loading_thumbs = FALSE;
+
+	if (file_list->priv->thumbs_done > 0) {
+		double elapsed;
+
+		elapsed = g_timer_elapsed (file_list->priv->thumbs_timer, NULL);
+		debug (DEBUG_INFO,
+		       "%d thumbnails in %.2fs: %.1f thumbnails per second",
+		       file_list->priv->thumbs_done,
+		       elapsed,
+		       (elapsed > 0) ? file_list->priv->thumbs_done / elapsed : 0.0);
+		file_list->priv->thumbs_done = 0;
+	}
 }
 
 
@@ -484,6 +505,41 @@ thumbnail_job_cancel (ThumbnailJob *job)
 }
 
 
+static void
+_gth_file_list_update_jobs_priority (GthFileList *file_list)
+{
+	GthFileStore *file_store;
+	int           first_visible;
+	int           last_visible;
+	GList        *scan;
+
+	/* give priority to the thumbnails still visible after scrolling */
+
+	file_store = gth_file_list_get_model (file_list);
+	first_visible = gth_file_view_get_first_visible (GTH_FILE_VIEW (file_list->priv->view));
+	last_visible = gth_file_view_get_last_visible (GTH_FILE_VIEW (file_list->priv->view));
+
+	for (scan = file_list->priv->jobs; scan; scan = scan->next) {
+		ThumbnailJob *job = scan->data;
+		GtkTreeIter   iter;
+		gboolean      visible = FALSE;
+
+		if ((first_visible >= 0) && gth_file_store_find (file_store, job->file_data->file, &iter)) {
+			GtkTreePath *path;
+			int          pos;
+
+			path = gtk_tree_model_get_path (GTK_TREE_MODEL (file_store), &iter);
+			pos = gtk_tree_path_get_indices (path)[0];
+			visible = (pos >= first_visible) && (pos <= last_visible);
+
+			gtk_tree_path_free (path);
+		}
+
+		gth_thumb_loader_set_priority (job->loader, visible ? G_PRIORITY_DEFAULT : G_PRIORITY_LOW);
+	}
+}
+
+
 /* --- */
 
 
@@ -493,6 +549,7 @@ vadj_changed_cb (GtkAdjustment *adjustment,
 {
 	GthFileList *file_list = user_data;
 
+	_gth_file_list_update_jobs_priority (file_list);
 	file_list->priv->thumbnailer_state.phase = THUMBNAILER_PHASE_INITIALIZE;
 	start_update_next_thumb (GTH_FILE_LIST (user_data));
 
@@ -1004,6 +1061,43 @@ gth_file_list_update_emblems (GthFileList *file_list,
 }
 
 
+static void
+gfl_update_metadata (GthFileList *file_list,
+		     GList       *files)
+{
+	GthFileStore *file_store;
+	GList        *scan;
+
+	file_store = gth_file_list_get_model (file_list);
+	for (scan = files; scan; scan = scan->next) {
+		GthFileData *file_data = scan->data;
+		GtkTreeIter  iter;
+
+		if (gth_file_store_find (file_store, file_data->file, &iter))
+			gth_file_store_queue_set (file_store,
+						  &iter,
+						  GTH_FILE_STORE_FILE_DATA_COLUMN, file_data,
+						  -1);
+	}
+	gth_file_store_exec_set (file_store);
+}
+
+
+/* Unlike gth_file_list_update_files the thumbnails are not reloaded, use
+ * this when only the attributes read by the metadata providers changed:
+ * the sort order, the filter and the captions are updated. */
+void
+gth_file_list_update_metadata (GthFileList *file_list,
+			       GList       *files /* GthFileData */)
+{
+	GthFileListOp *op;
+
+	op = gth_file_list_op_new (GTH_FILE_LIST_OP_TYPE_UPDATE_METADATA);
+	op->file_list = _g_object_list_ref (files);
+	_gth_file_list_queue_op (file_list, op);
+}
+
+
 static void
 gfl_rename_file (GthFileList *file_list,
 		 GFile       *file,
@@ -1408,6 +1502,9 @@ thumbnail_job_ready_cb (GObject      *source_object,
 		cairo_surface_destroy (icon_image);
 	}
 
+	if (success)
+		file_list->priv->thumbs_done++;
+
 	cairo_surface_destroy (image);
 	thumbnail_job_free (job);
 
@@ -1778,6 +1875,8 @@ _gth_file_list_update_next_thumb (GthFileList *file_list)
 	job->loader = gth_thumb_loader_copy (file_list->priv->thumb_loader);
 	job->cancellable = g_cancellable_new ();
 	job->update_in_view = file_list->priv->thumbnailer_state.completed < N_VIEWAHEAD;
+	gth_thumb_loader_set_priority (job->loader,
+				       (file_list->priv->thumbnailer_state.phase == THUMBNAILER_PHASE_UPDATE_VISIBLE) ? G_PRIORITY_DEFAULT : G_PRIORITY_LOW);
 	gtk_tree_model_get (GTK_TREE_MODEL (gth_file_list_get_model (file_list)),
 			    &file_list->priv->thumbnailer_state.current,
 			    GTH_FILE_STORE_FILE_DATA_COLUMN, &job->file_data,
@@ -1820,6 +1919,9 @@ _gth_file_list_update_next_thumb (GthFileList *file_list)
 				    -1);
 	}
 
+	if ((file_list->priv->thumbs_done == 0) && (file_list->priv->started_loaders == 0))
+		g_timer_start (file_list->priv->thumbs_timer);
+
 	file_list->priv->jobs = g_list_prepend (file_list->priv->jobs, job);
 	file_list->priv->started_loaders++;
 	job->idle_id = g_idle_add (_gth_file_list_update_thumb, job);
@@ -1866,6 +1968,9 @@ _gth_file_list_exec_next_op (GthFileList *file_list)
 	case GTH_FILE_LIST_OP_TYPE_UPDATE_EMBLEMS:
 		gfl_update_emblems (file_list, op->file_list);
 		break;
+	case GTH_FILE_LIST_OP_TYPE_UPDATE_METADATA:
+		gfl_update_metadata (file_list, op->file_list);
+		break;
 	case GTH_FILE_LIST_OP_TYPE_ENABLE_THUMBS:
 		gfl_enable_thumbs (file_list, op->ival);
 		exec_next_op = FALSE;
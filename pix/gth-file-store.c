@@ -20,11 +20,13 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include "cairo-utils.h"
 #include "glib-utils.h"
 #include "gth-enum-types.h"
 #include "gth-file-store.h"
+#include "gth-main.h"
 #include "gth-marshal.h"
 #include "gth-string-list.h"
 
@@ -74,6 +76,7 @@ struct _GthFileStorePrivate {
 	GList               *queue;
 	GHashTable          *file_queue;
 	GthFileDataCompFunc  cmp_func;
+	GthFileDataKeyFunc   key_func;
 	gboolean             inverse_sort : 1;
 	gboolean             update_filter : 1;
 };
@@ -304,6 +307,7 @@ gth_file_store_init (GthFileStore *file_store)
 							      (GDestroyNotify) g_object_unref,
 							      NULL);
 	file_store->priv->cmp_func = NULL;
+	file_store->priv->key_func = NULL;
 	file_store->priv->inverse_sort = FALSE;
 	file_store->priv->update_filter = FALSE;
 
@@ -762,6 +766,82 @@ _gth_file_store_sort (GthFileStore *file_store,
 }
 
 
+/* Sorts the rows with the keys of the sort type, computed once per row,
+ * instead of calling the comparison function for every pair of rows. */
+static void
+_gth_file_store_sort_rows_by_key (GthFileStore  *file_store,
+				  GthFileRow   **rows,
+				  int            n_sorted,
+				  int            n_rows)
+{
+	GthSortKey *keys;
+	int         i;
+
+	keys = g_new0 (GthSortKey, n_rows);
+	for (i = 0; i < n_rows; i++) {
+		file_store->priv->key_func (rows[i]->file_data, keys + i);
+		keys[i].item = rows[i];
+	}
+
+	gth_sort_keys_sort (keys, n_rows, n_sorted, file_store->priv->inverse_sort);
+
+	for (i = 0; i < n_rows; i++)
+		rows[i] = keys[i].item;
+
+	gth_sort_keys_free (keys, n_rows);
+}
+
+
+/* Sorts the first n_rows elements of rows.  When the first n_sorted rows
+ * are already sorted, only the other rows are sorted and then merged with
+ * them, this way adding a batch of files to a large folder doesn't require
+ * to sort the whole list again. */
+static void
+_gth_file_store_sort_rows (GthFileStore  *file_store,
+			   GthFileRow   **rows,
+			   int            n_sorted,
+			   int            n_rows)
+{
+	GthFileRow **merged;
+	int          i, j, k;
+
+	if ((file_store->priv->cmp_func != NULL) && (file_store->priv->key_func != NULL)) {
+		_gth_file_store_sort_rows_by_key (file_store, rows, n_sorted, n_rows);
+		return;
+	}
+
+	if ((file_store->priv->cmp_func == NULL) || (n_sorted <= 0)) {
+		_gth_file_store_sort (file_store, rows, n_rows);
+		return;
+	}
+
+	for (i = 0; i < n_sorted - 1; i++) {
+		if (compare_row_func (rows + i, rows + i + 1, file_store) > 0) {
+			_gth_file_store_sort (file_store, rows, n_rows);
+			return;
+		}
+	}
+
+	if (n_sorted >= n_rows)
+		return;
+
+	_gth_file_store_sort (file_store, rows + n_sorted, n_rows - n_sorted);
+
+	/* the merge is stable, the old rows come first when equal. */
+
+	merged = g_new (GthFileRow *, n_rows);
+	for (i = 0, j = n_sorted, k = 0; k < n_rows; k++) {
+		if ((j >= n_rows) || ((i < n_sorted) && (compare_row_func (rows + i, rows + j, file_store) <= 0)))
+			merged[k] = rows[i++];
+		else
+			merged[k] = rows[j++];
+	}
+	memcpy (rows, merged, sizeof (GthFileRow *) * n_rows);
+
+	g_free (merged);
+}
+
+
 static void
 _gth_file_store_compact_rows (GthFileStore *file_store)
 {
@@ -873,11 +953,7 @@ g_print ("UPDATE VISIBILITY\n");
 
 	/* sort */
 
-	g_qsort_with_data (all_rows,
-			   all_rows_n,
-			   (gsize) sizeof (GthFileRow *),
-			   (file_store->priv->cmp_func != NULL) ? compare_row_func : compare_by_pos,
-			   file_store);
+	_gth_file_store_sort_rows (file_store, all_rows, file_store->priv->tot_rows, all_rows_n);
 
 	/* filter */
 
@@ -1065,41 +1141,71 @@ g_print ("\n");
 			   compare_by_pos,
 			   NULL);
 
+	g_assert (file_store->priv->num_rows == old_rows_n);
+
+	/* add the new files: they are appended after the visible rows, with a
+	 * row-inserted signal each, and then moved to their position with a
+	 * single rows-reordered signal.  Inserting each row at its position
+	 * would shift all the following rows every time, which is quadratic
+	 * when a large folder is loaded in batches. */
+
 	g_free (file_store->priv->rows);
 	file_store->priv->rows = g_new (GthFileRow *, new_rows_n);
-	for (i = 0; i < old_rows_n; i++)
+	for (i = 0; i < old_rows_n; i++) {
 		file_store->priv->rows[i] = old_rows[i];
+		file_store->priv->rows[i]->pos = i;
+	}
 
-	g_assert (file_store->priv->num_rows == old_rows_n);
-
-	/* add the new files */
+	if (new_rows_n > old_rows_n) {
+		int      *new_order;
+		gboolean  order_changed;
 
-	for (i = 0; i < new_rows_n; i++) {
-		GtkTreePath *path;
-		GtkTreeIter  iter;
-
-		if ((i < file_store->priv->num_rows) && (new_rows[i]->file_data == file_store->priv->rows[i]->file_data))
-			continue;
+		new_order = g_new (int, new_rows_n);
+		order_changed = FALSE;
+		for (i = 0, j = 0, k = old_rows_n; i < new_rows_n; i++) {
+			GtkTreePath *path;
+			GtkTreeIter  iter;
+
+			if ((j < old_rows_n) && (new_rows[i]->file_data == old_rows[j]->file_data)) {
+				new_order[i] = j++;
+				if (new_order[i] != i)
+					order_changed = TRUE;
+				continue;
+			}
 
 #ifdef DEBUG_FILE_STORE
 g_print ("  INSERT: %d\n", i);
 #endif
 
-		/* add the file to the visible rows */
+			new_order[i] = k;
+			if (k != i)
+				order_changed = TRUE;
+
+			file_store->priv->rows[k] = new_rows[i];
+			file_store->priv->rows[k]->pos = k;
+			file_store->priv->num_rows++;
 
-		for (k = file_store->priv->num_rows; k > i; k--) {
-			file_store->priv->rows[k] = file_store->priv->rows[k - 1];
-			file_store->priv->rows[k]->pos++;
+			path = gtk_tree_path_new ();
+			gtk_tree_path_append_index (path, k);
+			gth_file_store_get_iter (GTK_TREE_MODEL (file_store), &iter, path);
+			gtk_tree_model_row_inserted (GTK_TREE_MODEL (file_store), path, &iter);
+			gtk_tree_path_free (path);
+
+			k++;
 		}
-		file_store->priv->rows[i] = new_rows[i];
-		file_store->priv->rows[i]->pos = i;
-		file_store->priv->num_rows++;
 
-		path = gtk_tree_path_new ();
-		gtk_tree_path_append_index (path, i);
-		gth_file_store_get_iter (GTK_TREE_MODEL (file_store), &iter, path);
-		gtk_tree_model_row_inserted (GTK_TREE_MODEL (file_store), path, &iter);
-		gtk_tree_path_free (path);
+		if (order_changed) {
+			for (i = 0; i < new_rows_n; i++) {
+				file_store->priv->rows[i] = new_rows[i];
+				file_store->priv->rows[i]->pos = i;
+			}
+			gtk_tree_model_rows_reordered (GTK_TREE_MODEL (file_store),
+						       NULL,
+						       NULL,
+						       new_order);
+		}
+
+		g_free (new_order);
 	}
 
 	g_signal_emit (file_store, gth_file_store_signals[VISIBILITY_CHANGED], 0);
@@ -1133,7 +1239,7 @@ _gth_file_store_reorder (GthFileStore *file_store)
 	int *new_order;
 	int  i, j;
 
-	_gth_file_store_sort (file_store, file_store->priv->all_rows, file_store->priv->tot_rows);
+	_gth_file_store_sort_rows (file_store, file_store->priv->all_rows, 0, file_store->priv->tot_rows);
 
 	/* compute the new position for each row */
 
@@ -1163,8 +1269,26 @@ _gth_file_store_set_sort_func (GthFileStore        *file_store,
 			       GthFileDataCompFunc  cmp_func,
 			       gboolean             inverse_sort)
 {
+	GList *sort_types;
+	GList *scan;
+
 	file_store->priv->cmp_func = cmp_func;
+	file_store->priv->key_func = NULL;
 	file_store->priv->inverse_sort = inverse_sort;
+
+	if (cmp_func == NULL)
+		return;
+
+	sort_types = gth_main_get_all_sort_types ();
+	for (scan = sort_types; scan; scan = scan->next) {
+		GthFileDataSort *sort_type = scan->data;
+
+		if (sort_type->cmp_func == cmp_func) {
+			file_store->priv->key_func = sort_type->key_func;
+			break;
+		}
+	}
+	g_list_free (sort_types);
 }
 
 void
@@ -23,6 +23,7 @@
 #include <math.h>
 #include <string.h>
 #include "cairo-utils.h"
+#include "glib-utils.h"
 #include "gth-histogram.h"
 
 
@@ -136,22 +137,102 @@ gth_histogram_changed (GthHistogram *self)
 }
 
 
-void
-gth_histogram_calculate_for_image (GthHistogram    *self,
-				   cairo_surface_t *image)
+/* -- gth_histogram_calculate_for_image -- */
+
+
+#define HISTOGRAM_BAND_LINES 64
+#define PREVIEW_MAX_PIXELS (1024 * 1024)
+
+
+typedef struct {
+	guchar   *data;
+	int       rowstride;
+	int       width;
+	int       step;
+	gboolean  has_alpha;
+	int     **values;
+	GMutex    mutex;
+} HistogramData;
+
+
+static void
+histogram_band (int      first,
+		int      last,
+		gpointer user_data)
 {
-	int    **values;
-	int     *values_max;
-	int      width, height, has_alpha;
-	int      rowstride;
-	guchar  *line, *pixel;
-	int      i, j, value, temp;
-	guchar   red, green, blue, alpha;
+	HistogramData *data = user_data;
+	int            values[GTH_HISTOGRAM_N_CHANNELS][256];
+	int            pixel_step;
+	guchar        *line;
+	guchar        *pixel;
+	int            i, j, c, value, temp;
+	guchar         red, green, blue, alpha;
+
+	/* collect the values in a private histogram, merged with the others
+	 * at the end of the band. */
+
+	memset (values, 0, sizeof (values));
+	pixel_step = data->step * 4;
+	line = data->data + ((gsize) first * data->step * data->rowstride);
+
+	for (i = first; i < last; i++) {
+		pixel = line;
 
-	g_return_if_fail (GTH_IS_HISTOGRAM (self));
+		if (data->has_alpha) {
+			for (j = 0; j < data->width; j += data->step) {
+				CAIRO_GET_RGBA (pixel, red, green, blue, alpha);
+
+				values[GTH_HISTOGRAM_CHANNEL_RED][red] += 1;
+				values[GTH_HISTOGRAM_CHANNEL_GREEN][green] += 1;
+				values[GTH_HISTOGRAM_CHANNEL_BLUE][blue] += 1;
+				values[GTH_HISTOGRAM_CHANNEL_ALPHA][alpha] += 1;
+
+				value = MAX (MAX (red, green), blue);
+				values[GTH_HISTOGRAM_CHANNEL_VALUE][value] += 1;
+
+				pixel += pixel_step;
+			}
+		}
+		else {
+			for (j = 0; j < data->width; j += data->step) {
+				red = pixel[CAIRO_RED];
+				green = pixel[CAIRO_GREEN];
+				blue = pixel[CAIRO_BLUE];
+
+				values[GTH_HISTOGRAM_CHANNEL_RED][red] += 1;
+				values[GTH_HISTOGRAM_CHANNEL_GREEN][green] += 1;
+				values[GTH_HISTOGRAM_CHANNEL_BLUE][blue] += 1;
+
+				value = MAX (MAX (red, green), blue);
+				values[GTH_HISTOGRAM_CHANNEL_VALUE][value] += 1;
+
+				pixel += pixel_step;
+			}
+		}
+
+		line += (gsize) data->step * data->rowstride;
+	}
 
-	values = self->priv->values;
-	values_max = self->priv->values_max;
+	g_mutex_lock (&data->mutex);
+	for (c = 0; c < GTH_HISTOGRAM_N_CHANNELS; c++)
+		for (j = 0; j < 256; j++)
+			data->values[c][j] += values[c][j];
+	g_mutex_unlock (&data->mutex);
+}
+
+
+static void
+histogram_calculate (GthHistogram    *self,
+		     cairo_surface_t *image,
+		     gboolean         preview)
+{
+	HistogramData  data;
+	int            height;
+	int            n_lines;
+	int            n_columns;
+	int            c, v;
+
+	g_return_if_fail (GTH_IS_HISTOGRAM (self));
 
 	if (image == NULL) {
 		self->priv->n_channels = 0;
@@ -160,67 +241,67 @@ gth_histogram_calculate_for_image (GthHistogram    *self,
 		return;
 	}
 
-	has_alpha  = _cairo_image_surface_get_has_alpha (image);
-	rowstride  = cairo_image_surface_get_stride (image);
-	line       = _cairo_image_surface_flush_and_get_data (image);
-	width      = cairo_image_surface_get_width (image);
-	height     = cairo_image_surface_get_height (image);
+	data.has_alpha = _cairo_image_surface_get_has_alpha (image);
+	data.rowstride = cairo_image_surface_get_stride (image);
+	data.data = _cairo_image_surface_flush_and_get_data (image);
+	data.width = cairo_image_surface_get_width (image);
+	data.values = self->priv->values;
+	height = cairo_image_surface_get_height (image);
 
-	self->priv->n_pixels = width * height;
-	self->priv->n_channels = (has_alpha ? 4 : 3) + 1;
-	histogram_reset_values (self);
+	/* in preview mode only a regular grid of pixels is used, enough for
+	 * the shape of the histogram. */
 
-	for (i = 0; i < height; i++) {
-		pixel = line;
+	data.step = 1;
+	if (preview && ((double) data.width * height > PREVIEW_MAX_PIXELS))
+		data.step = (int) ceil (sqrt ((double) data.width * height / PREVIEW_MAX_PIXELS));
 
-		for (j = 0; j < width; j++) {
-			CAIRO_GET_RGBA (pixel, red, green, blue, alpha);
+	n_lines = (height + data.step - 1) / data.step;
+	n_columns = (data.width + data.step - 1) / data.step;
 
-			/* count values for each RGB channel */
+	self->priv->n_pixels = n_columns * n_lines;
+	self->priv->n_channels = (data.has_alpha ? 4 : 3) + 1;
+	histogram_reset_values (self);
 
-			values[GTH_HISTOGRAM_CHANNEL_RED][red] += 1;
-			values[GTH_HISTOGRAM_CHANNEL_GREEN][green] += 1;
-			values[GTH_HISTOGRAM_CHANNEL_BLUE][blue] += 1;
-			if (has_alpha)
-				values[GTH_HISTOGRAM_CHANNEL_ALPHA][alpha] += 1;
+	g_mutex_init (&data.mutex);
+	_g_parallel_for_bands (n_lines, HISTOGRAM_BAND_LINES, histogram_band, &data);
+	g_mutex_clear (&data.mutex);
 
-			/* count value for Value channel */
+	/* the maximum count and the range of each channel */
 
-			value = MAX (MAX (red, green), blue);
-			values[GTH_HISTOGRAM_CHANNEL_VALUE][value] += 1;
+	for (c = 0; c < self->priv->n_channels; c++) {
+		int *values = self->priv->values[c];
 
-			/* min and max pixel values */
+		for (v = 0; v < 256; v++)
+			self->priv->values_max[c] = MAX (self->priv->values_max[c], values[v]);
 
-			self->priv->min_value[GTH_HISTOGRAM_CHANNEL_VALUE] = MIN (self->priv->min_value[GTH_HISTOGRAM_CHANNEL_VALUE], value);
-			self->priv->min_value[GTH_HISTOGRAM_CHANNEL_RED] = MIN (self->priv->min_value[GTH_HISTOGRAM_CHANNEL_RED], red);
-			self->priv->min_value[GTH_HISTOGRAM_CHANNEL_GREEN] = MIN (self->priv->min_value[GTH_HISTOGRAM_CHANNEL_GREEN], green);
-			self->priv->min_value[GTH_HISTOGRAM_CHANNEL_BLUE] = MIN (self->priv->min_value[GTH_HISTOGRAM_CHANNEL_BLUE], blue);
-			if (has_alpha)
-				self->priv->min_value[GTH_HISTOGRAM_CHANNEL_ALPHA] = MIN (self->priv->min_value[GTH_HISTOGRAM_CHANNEL_ALPHA], alpha);
+		for (v = 0; (v < 255) && (values[v] == 0); v++)
+			/* void */;
+		self->priv->min_value[c] = v;
 
-			self->priv->max_value[GTH_HISTOGRAM_CHANNEL_VALUE] = MAX (self->priv->max_value[GTH_HISTOGRAM_CHANNEL_VALUE], value);
-			self->priv->max_value[GTH_HISTOGRAM_CHANNEL_RED] = MAX (self->priv->max_value[GTH_HISTOGRAM_CHANNEL_RED], red);
-			self->priv->max_value[GTH_HISTOGRAM_CHANNEL_GREEN] = MAX (self->priv->max_value[GTH_HISTOGRAM_CHANNEL_GREEN], green);
-			self->priv->max_value[GTH_HISTOGRAM_CHANNEL_BLUE] = MAX (self->priv->max_value[GTH_HISTOGRAM_CHANNEL_BLUE], blue);
-			if (has_alpha)
-				self->priv->max_value[GTH_HISTOGRAM_CHANNEL_ALPHA] = MAX (self->priv->max_value[GTH_HISTOGRAM_CHANNEL_ALPHA], alpha);
+		for (v = 255; (v > 0) && (values[v] == 0); v--)
+			/* void */;
+		self->priv->max_value[c] = v;
+	}
 
-			/* track min and max value for each channel */
+	gth_histogram_changed (self);
+}
 
-			values_max[GTH_HISTOGRAM_CHANNEL_VALUE] = MAX (values_max[GTH_HISTOGRAM_CHANNEL_VALUE], values[GTH_HISTOGRAM_CHANNEL_VALUE][value]);
-			values_max[GTH_HISTOGRAM_CHANNEL_RED] = MAX (values_max[GTH_HISTOGRAM_CHANNEL_RED], values[GTH_HISTOGRAM_CHANNEL_RED][red]);
-			values_max[GTH_HISTOGRAM_CHANNEL_GREEN] = MAX (values_max[GTH_HISTOGRAM_CHANNEL_GREEN], values[GTH_HISTOGRAM_CHANNEL_GREEN][green]);
-			values_max[GTH_HISTOGRAM_CHANNEL_BLUE] = MAX (values_max[GTH_HISTOGRAM_CHANNEL_BLUE], values[GTH_HISTOGRAM_CHANNEL_BLUE][blue]);
-			if (has_alpha)
-				values_max[GTH_HISTOGRAM_CHANNEL_ALPHA] = MAX (values_max[GTH_HISTOGRAM_CHANNEL_ALPHA], values[GTH_HISTOGRAM_CHANNEL_ALPHA][alpha]);
 
-			pixel += 4;
-		}
+void
+gth_histogram_calculate_for_image (GthHistogram    *self,
+				   cairo_surface_t *image)
+{
+	histogram_calculate (self, image, FALSE);
+}
 
-		line += rowstride;
-	}
 
-	gth_histogram_changed (self);
+/* Faster version that reads only a subset of the pixels of large images,
+ * for interactive previews. */
+void
+gth_histogram_calculate_for_image_preview (GthHistogram    *self,
+					   cairo_surface_t *image)
+{
+	histogram_calculate (self, image, TRUE);
 }
 
 
@@ -66,6 +66,9 @@ GType          gth_histogram_get_type             (void) G_GNUC_CONST;
 GthHistogram * gth_histogram_new                  (void);
 void           gth_histogram_calculate_for_image  (GthHistogram        *self,
 						   cairo_surface_t     *image);
+void           gth_histogram_calculate_for_image_preview
+						  (GthHistogram        *self,
+						   cairo_surface_t     *image);
 double         gth_histogram_get_count            (GthHistogram        *self,
 						   int                  start,
 						   int                  end);
@@ -20,11 +20,20 @@
  */
 
 #include <config.h>
+#include "cairo-utils.h"
 #include "glib-utils.h"
 #include "gth-image-history.h"
+#include "gth-preferences.h"
+#include "gth-surface-history.h"
+#include "gth-user-dir.h"
 
 
-#define MAX_UNDO_HISTORY_LEN 5
+/* The steps are kept by a GthSurfaceHistory, as compressed tile
+ * differences, the images that cannot be saved as tiles are kept as they
+ * are. */
+
+
+#define MEGABYTE (1024 * 1024)
 
 
 /* GthImageData */
@@ -82,6 +91,108 @@ gth_image_data_list_free (GList *list)
 }
 
 
+/* StepData */
+
+
+typedef struct {
+	int                       requested_size;
+	gboolean                  unsaved;
+	GthImage                 *image;       /* set when the image cannot be saved as tiles */
+	GthICCProfile            *icc_profile;
+	cairo_surface_metadata_t  metadata;
+} StepData;
+
+
+/* Returns the surface of @image when it can be saved as tiles, the images
+ * that load their pixels on demand or are animated are kept as they are. */
+static cairo_surface_t *
+get_tiled_surface (GthImage *image)
+{
+	cairo_surface_t *surface;
+	cairo_format_t   format;
+
+	if (gth_image_get_is_animation (image)
+	    || gth_image_get_is_zoomable (image)
+	    || gth_image_get_can_load_region (image))
+	{
+		return NULL;
+	}
+
+	surface = gth_image_get_cairo_surface (image);
+	if (surface == NULL)
+		return NULL;
+
+	if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+		cairo_surface_destroy (surface);
+		return NULL;
+	}
+
+	format = cairo_image_surface_get_format (surface);
+	if ((format != CAIRO_FORMAT_ARGB32) && (format != CAIRO_FORMAT_RGB24)) {
+		cairo_surface_destroy (surface);
+		return NULL;
+	}
+
+	return surface;
+}
+
+
+static StepData *
+step_data_new (GthImageData    *idata,
+	       cairo_surface_t *surface)
+{
+	StepData *step_data;
+
+	step_data = g_new0 (StepData, 1);
+	step_data->requested_size = idata->requested_size;
+	step_data->unsaved = idata->unsaved;
+	if (surface != NULL) {
+		step_data->icc_profile = _g_object_ref (gth_image_get_icc_profile (idata->image));
+		step_data->metadata = *_cairo_image_surface_get_metadata (surface);
+	}
+	else
+		step_data->image = g_object_ref (idata->image);
+
+	return step_data;
+}
+
+
+static void
+step_data_free (StepData *step_data)
+{
+	_g_object_unref (step_data->image);
+	_g_object_unref (step_data->icc_profile);
+	g_free (step_data);
+}
+
+
+/* Returns the image of a step, @surface is the surface restored by the
+ * GthSurfaceHistory. */
+static GthImageData *
+step_data_get_image_data (StepData        *step_data,
+			  cairo_surface_t *surface)
+{
+	GthImage     *image;
+	GthImageData *idata;
+
+	if (step_data->image != NULL) {
+		image = g_object_ref (step_data->image);
+	}
+	else if (surface != NULL) {
+		*_cairo_image_surface_get_metadata (surface) = step_data->metadata;
+		image = gth_image_new_for_surface (surface);
+		gth_image_set_icc_profile (image, step_data->icc_profile);
+	}
+	else
+		return NULL;
+
+	idata = gth_image_data_new (image, step_data->requested_size, step_data->unsaved);
+	g_object_unref (image);
+
+	return idata;
+}
+
+
 /* GthImageHistory */
 
 
@@ -95,8 +206,8 @@ static guint gth_image_history_signals[LAST_SIGNAL] = { 0 };
 
 
 struct _GthImageHistoryPrivate {
-	GList *undo_history;  /* GthImageData items */
-	GList *redo_history;  /* GthImageData items */
+	GthImageData      *current;
+	GthSurfaceHistory *steps;
 };
 
 
@@ -115,6 +226,7 @@ gth_image_history_finalize (GObject *object)
 	history = GTH_IMAGE_HISTORY (object);
 
 	gth_image_history_clear (history);
+	gth_surface_history_free (history->priv->steps);
 
 	G_OBJECT_CLASS (gth_image_history_parent_class)->finalize (object);
 }
@@ -142,9 +254,21 @@ gth_image_history_class_init (GthImageHistoryClass *class)
 static void
 gth_image_history_init (GthImageHistory *history)
 {
+	GSettings *settings;
+	GFile     *directory;
+
 	history->priv = gth_image_history_get_instance_private (history);
-	history->priv->undo_history = NULL;
-	history->priv->redo_history = NULL;
+	history->priv->current = NULL;
+
+	settings = g_settings_new (PIX_GENERAL_SCHEMA);
+	directory = gth_user_dir_get_dir_for_write (GTH_DIR_CACHE, PIX_DIR, NULL);
+	history->priv->steps = gth_surface_history_new ((gsize) MAX (g_settings_get_int (settings, PREF_GENERAL_IMAGE_HISTORY_MEMORY), 0) * MEGABYTE,
+							(gsize) MAX (g_settings_get_int (settings, PREF_GENERAL_IMAGE_HISTORY_DISK), 0) * MEGABYTE,
+							directory,
+							(GDestroyNotify) step_data_free);
+
+	_g_object_unref (directory);
+	g_object_unref (settings);
 }
 
 
@@ -155,82 +279,32 @@ gth_image_history_new (void)
 }
 
 
-static GthImageData*
-remove_first_image (GList **list)
-{
-	GList        *head;
-	GthImageData *idata;
-
-	if (*list == NULL)
-		return NULL;
-
-	head = *list;
-	*list = g_list_remove_link (*list, head);
-	idata = head->data;
-	g_list_free (head);
-
-	return idata;
-}
-
-
-static GList*
-add_image_to_list (GList           *list,
-		   GthImage	   *image,
-		   int              requested_size,
-		   gboolean         unsaved)
-{
-	if (g_list_length (list) > MAX_UNDO_HISTORY_LEN) {
-		GList *last;
-
-		last = g_list_nth (list, MAX_UNDO_HISTORY_LEN - 1);
-		if (last->prev != NULL) {
-			last->prev->next = NULL;
-			gth_image_data_list_free (last);
-		}
-	}
-
-	if (image == NULL)
-		return list;
-
-	return g_list_prepend (list, gth_image_data_new (image, requested_size, unsaved));
-}
-
-
-static void
-add_image_to_undo_history (GthImageHistory *history,
-			   GthImage        *image,
-			   int              requested_size,
-		   	   gboolean         unsaved)
-{
-	history->priv->undo_history = add_image_to_list (history->priv->undo_history,
-							 image,
-							 requested_size,
-							 unsaved);
-}
-
-
-static void
-add_image_to_redo_history (GthImageHistory *history,
-			   GthImage        *image,
-			   int              requested_size,
-	   		   gboolean         unsaved)
-{
-	history->priv->redo_history = add_image_to_list (history->priv->redo_history,
-							 image,
-							 requested_size,
-							 unsaved);
-}
-
-
 void
 gth_image_history_add_image (GthImageHistory *history,
 			     GthImage        *image,
 			     int              requested_size,
 			     gboolean         unsaved)
 {
-	add_image_to_undo_history (history, image, requested_size, unsaved);
-	gth_image_data_list_free (history->priv->redo_history);
-	history->priv->redo_history = NULL;
+	if (image != NULL) {
+		GthImageData    *idata;
+		cairo_surface_t *surface;
+
+		idata = gth_image_data_new (image, requested_size, unsaved);
+		surface = get_tiled_surface (image);
+		gth_surface_history_add (history->priv->steps,
+					 surface,
+					 step_data_new (idata, surface),
+					 (surface == NULL) ? gth_image_get_memory_size (image) : 0);
+
+		if (history->priv->current != NULL)
+			gth_image_data_unref (history->priv->current);
+		history->priv->current = idata;
+
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+	}
+	else
+		gth_surface_history_add (history->priv->steps, NULL, NULL, 0);
 
 	g_signal_emit (G_OBJECT (history),
 		       gth_image_history_signals[CHANGED],
@@ -253,68 +327,82 @@ gth_image_history_add_surface (GthImageHistory *history,
 }
 
 
-GthImageData *
-gth_image_history_undo (GthImageHistory *history)
+static GthImageData *
+_gth_image_history_set_current (GthImageHistory *history,
+				StepData        *step_data,
+				cairo_surface_t *surface)
 {
 	GthImageData *idata;
 
-	if ((history->priv->undo_history == NULL) || (history->priv->undo_history->next == NULL))
-		return NULL;
+	idata = (step_data != NULL) ? step_data_get_image_data (step_data, surface) : NULL;
+	if (idata != NULL) {
+		if (history->priv->current != NULL)
+			gth_image_data_unref (history->priv->current);
+		history->priv->current = idata;
+	}
 
-	idata = remove_first_image (&(history->priv->undo_history));
-	add_image_to_redo_history (history, idata->image, idata->requested_size, idata->unsaved);
-	gth_image_data_unref (idata);
+	if (surface != NULL)
+		cairo_surface_destroy (surface);
 
 	g_signal_emit (G_OBJECT (history),
 		       gth_image_history_signals[CHANGED],
 		       0);
 
-	return (GthImageData *) history->priv->undo_history->data;
+	return idata;
 }
 
 
 GthImageData *
-gth_image_history_redo (GthImageHistory *history)
+gth_image_history_undo (GthImageHistory *history)
 {
-	GthImageData *idata;
+	StepData        *step_data;
+	cairo_surface_t *surface;
 
-	if (history->priv->redo_history == NULL)
+	if (! gth_image_history_can_undo (history))
 		return NULL;
 
-	idata = remove_first_image (&(history->priv->redo_history));
-	add_image_to_undo_history (history, idata->image, idata->requested_size, idata->unsaved);
-	gth_image_data_unref (idata);
+	step_data = gth_surface_history_undo (history->priv->steps, &surface);
+	return _gth_image_history_set_current (history, step_data, surface);
+}
 
-	g_signal_emit (G_OBJECT (history),
-		       gth_image_history_signals[CHANGED],
-		       0);
 
-	return (GthImageData *) history->priv->undo_history->data;
+GthImageData *
+gth_image_history_redo (GthImageHistory *history)
+{
+	StepData        *step_data;
+	cairo_surface_t *surface;
+
+	if (! gth_image_history_can_redo (history))
+		return NULL;
+
+	step_data = gth_surface_history_redo (history->priv->steps, &surface);
+	return _gth_image_history_set_current (history, step_data, surface);
 }
 
 
 void
 gth_image_history_clear (GthImageHistory *history)
 {
-	gth_image_data_list_free (history->priv->undo_history);
-	history->priv->undo_history = NULL;
+	gth_surface_history_clear (history->priv->steps);
 
-	gth_image_data_list_free (history->priv->redo_history);
-	history->priv->redo_history = NULL;
+	if (history->priv->current != NULL) {
+		gth_image_data_unref (history->priv->current);
+		history->priv->current = NULL;
+	}
 }
 
 
 gboolean
 gth_image_history_can_undo (GthImageHistory *history)
 {
-	return (history->priv->undo_history != NULL) && (history->priv->undo_history->next != NULL);
+	return (history->priv->current != NULL) && gth_surface_history_can_undo (history->priv->steps);
 }
 
 
 gboolean
 gth_image_history_can_redo (GthImageHistory *history)
 {
-	return history->priv->redo_history != NULL;
+	return (history->priv->current != NULL) && gth_surface_history_can_redo (history->priv->steps);
 }
 
 
@@ -322,15 +410,36 @@ GthImageData *
 gth_image_history_revert (GthImageHistory *history)
 {
 	GthImageData *last_saved = NULL;
-	GList        *scan;
+	int           saved_step = -1;
+	int           n_steps;
+	int           i;
 
-	for (scan = history->priv->undo_history; scan; scan = scan->next) {
-		GthImageData *idata = scan->data;
+	if ((history->priv->current != NULL) && ! history->priv->current->unsaved)
+		last_saved = gth_image_data_ref (history->priv->current);
 
-		if (idata->unsaved)
-			continue;
+	n_steps = gth_surface_history_get_n_undo (history->priv->steps);
+	for (i = 0; i < n_steps; i++) {
+		StepData *step_data = gth_surface_history_get_undo (history->priv->steps, i, NULL);
 
-		last_saved = gth_image_data_ref (idata);
+		if ((step_data != NULL) && ! step_data->unsaved)
+			saved_step = i;
+	}
+
+	if (saved_step >= 0) {
+		StepData        *step_data;
+		cairo_surface_t *surface;
+		GthImageData    *idata;
+
+		step_data = gth_surface_history_get_undo (history->priv->steps, saved_step, &surface);
+		idata = (step_data != NULL) ? step_data_get_image_data (step_data, surface) : NULL;
+		if (idata != NULL) {
+			if (last_saved != NULL)
+				gth_image_data_unref (last_saved);
+			last_saved = idata;
+		}
+
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
 	}
 
 	gth_image_history_clear (history);
@@ -342,8 +451,5 @@ gth_image_history_revert (GthImageHistory *history)
 GthImageData *
 gth_image_history_get_last (GthImageHistory *history)
 {
-	if (history->priv->undo_history == NULL)
-		return NULL;
-	else
-		return (GthImageData *) history->priv->undo_history->data;
+	return history->priv->current;
 }
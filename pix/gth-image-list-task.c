@@ -28,23 +28,57 @@
 #include "gth-image-list-task.h"
 #include "gth-image-loader.h"
 #include "gth-image-saver.h"
+#include "gth-preferences.h"
 #include "gtk-utils.h"
 
 
+/* The images are processed in a pipeline: while an image is transformed in
+ * a thread, the following ones are read and decoded and the previous ones
+ * are encoded and written.  The jobs are committed in the order of the file
+ * list, so the overwrite dialog, the progress and the error reported are the
+ * same as when the images are processed one at a time.  If the overwrite
+ * dialog can be shown, the files are also written in the order of the
+ * list. */
+
+
+typedef enum {
+	IMAGE_JOB_RUNNING,
+	IMAGE_JOB_WAITING,	/* an earlier job uses the same file */
+	IMAGE_JOB_EXISTS,	/* the destination exists, see the overwrite mode */
+	IMAGE_JOB_ASKING,	/* the overwrite dialog is visible */
+	IMAGE_JOB_DONE,
+	IMAGE_JOB_ERROR
+} ImageJobState;
+
+
+typedef struct {
+	GthImageListTask *self;
+	GthFileData      *source;
+	GFile            *destination;
+	GthFileData      *file_data;
+	GthFileData      *destination_file_data;
+	GthTask          *image_task;
+	GthImage         *image;
+	ImageJobState     state;
+	gboolean          running;
+	gboolean          replace;
+	gboolean          saved;
+	GError           *error;
+} ImageJob;
+
+
 struct _GthImageListTaskPrivate {
 	GthBrowser           *browser;
 	GList                *file_list;
 	GthTask              *task;
-	gulong                task_completed;
-	gulong                task_progress;
-	gulong                task_dialog;
-	GList                *current;
+	GList                *next;
+	GQueue               *jobs;
+	guint                 max_jobs;
+	gboolean              completed;
+	GCancellable         *cancellable;
 	int                   n_current;
 	int                   n_files;
-	GthImage             *original_image;
-	GthImage             *new_image;
 	GFile                *destination_folder;
-	GthFileData          *destination_file_data;
 	GthOverwriteMode      overwrite_mode;
 	GthOverwriteResponse  overwrite_response;
 	char                 *mime_type;
@@ -57,6 +91,9 @@ G_DEFINE_TYPE_WITH_CODE (GthImageListTask,
 			 G_ADD_PRIVATE (GthImageListTask))
 
 
+static void image_job_free (ImageJob *job);
+
+
 static void
 gth_image_list_task_finalize (GObject *object)
 {
@@ -64,36 +101,269 @@ gth_image_list_task_finalize (GObject *object)
 
 	self = GTH_IMAGE_LIST_TASK (object);
 
+	g_queue_free_full (self->priv->jobs, (GDestroyNotify) image_job_free);
+	_g_object_unref (self->priv->cancellable);
 	g_free (self->priv->mime_type);
 	_g_object_unref (self->priv->destination_folder);
-	_g_object_unref (self->priv->original_image);
-	_g_object_unref (self->priv->new_image);
-	g_signal_handler_disconnect (self->priv->task, self->priv->task_completed);
-	g_signal_handler_disconnect (self->priv->task, self->priv->task_progress);
-	g_signal_handler_disconnect (self->priv->task, self->priv->task_dialog);
 	g_object_unref (self->priv->task);
 	_g_object_list_unref (self->priv->file_list);
-	_g_object_unref (self->priv->destination_file_data);
 
 	G_OBJECT_CLASS (gth_image_list_task_parent_class)->finalize (object);
 }
 
 
-static void process_current_file (GthImageListTask *self);
+/* -- ImageJob -- */
+
+
+static GFile *
+get_destination_file (GthImageListTask *self,
+		      GthFileData      *source)
+{
+	char  *display_name;
+	GFile *parent;
+	GFile *destination;
+
+	if (self->priv->mime_type != NULL) {
+		char          *no_ext;
+		GthImageSaver *saver;
+
+		no_ext = _g_path_remove_extension (g_file_info_get_display_name (source->info));
+		saver = gth_main_get_image_saver (self->priv->mime_type);
+		g_return_val_if_fail (saver != NULL, NULL);
+
+		display_name = g_strconcat (no_ext, ".", gth_image_saver_get_default_ext (saver), NULL);
+
+		g_object_unref (saver);
+		g_free (no_ext);
+	}
+	else
+		display_name = g_strdup (g_file_info_get_display_name (source->info));
+
+	if (self->priv->destination_folder != NULL)
+		parent = g_object_ref (self->priv->destination_folder);
+	else
+		parent = g_file_get_parent (source->file);
+	destination = g_file_get_child_for_display_name (parent, display_name, NULL);
+
+	g_object_unref (parent);
+	g_free (display_name);
+
+	return destination;
+}
+
+
+static ImageJob *
+image_job_new (GthImageListTask *self,
+	       GthFileData      *source)
+{
+	ImageJob *job;
+
+	job = g_new0 (ImageJob, 1);
+	job->self = g_object_ref (self);
+	job->source = g_object_ref (source);
+	job->destination = get_destination_file (self, source);
+	job->file_data = NULL;
+	job->destination_file_data = NULL;
+	job->image_task = NULL;
+	job->image = NULL;
+	job->state = IMAGE_JOB_RUNNING;
+	job->running = FALSE;
+	job->replace = FALSE;
+	job->saved = FALSE;
+	job->error = NULL;
+
+	return job;
+}
 
 
 static void
-process_next_file (GthImageListTask *self)
+image_job_free (ImageJob *job)
 {
-	self->priv->n_current++;
-	self->priv->current = self->priv->current->next;
-	process_current_file (self);
+	if (job->image_task != NULL) {
+		g_signal_handlers_disconnect_by_data (job->image_task, job);
+		g_object_unref (job->image_task);
+	}
+	_g_object_unref (job->image);
+	_g_object_unref (job->destination_file_data);
+	_g_object_unref (job->file_data);
+	_g_object_unref (job->destination);
+	g_object_unref (job->source);
+	g_clear_error (&job->error);
+	g_object_unref (job->self);
+	g_free (job);
+}
+
+
+static void
+image_job_set_destination (ImageJob *job,
+			   GFile    *destination)
+{
+	_g_object_unref (job->destination);
+	job->destination = g_object_ref (destination);
+	if (job->destination_file_data != NULL)
+		gth_file_data_set_file (job->destination_file_data, destination);
+}
+
+
+/* Frees the job and returns TRUE if the list task completed while an
+ * operation of the job was running. */
+static gboolean
+image_job_abandoned (ImageJob *job)
+{
+	job->running = FALSE;
+	if (! job->self->priv->completed)
+		return FALSE;
+
+	image_job_free (job);
+
+	return TRUE;
+}
+
+
+/* -- process_queue -- */
+
+
+static void process_queue (GthImageListTask *self);
+
+
+static void
+image_list_task_complete (GthImageListTask *self,
+			  GError           *error)
+{
+	ImageJob *job;
+
+	g_object_ref (self);
+	self->priv->completed = TRUE;
+	if (error != NULL)
+		g_cancellable_cancel (self->priv->cancellable);
+
+	/* the running jobs are freed when their operation returns */
+
+	while ((job = g_queue_pop_head (self->priv->jobs)) != NULL)
+		if (! job->running)
+			image_job_free (job);
+
+	gth_task_completed (GTH_TASK (self), error);
+	g_object_unref (self);
 }
 
 
-static void image_task_save_current_image (GthImageListTask *self,
-					   GFile            *file,
-					   gboolean          replace);
+static void
+image_job_failed (ImageJob *job,
+		  GError   *error)
+{
+	job->state = IMAGE_JOB_ERROR;
+	job->error = error;
+	process_queue (job->self);
+}
+
+
+/* Whether @file is read or written by a job that precedes @job in the list
+ * and that is not committed yet.  If @job is NULL all the jobs are
+ * checked. */
+static gboolean
+file_used_by_previous_jobs (GthImageListTask *self,
+			    ImageJob         *job,
+			    GFile            *file)
+{
+	GList *scan;
+
+	for (scan = self->priv->jobs->head; scan && (scan->data != job); scan = scan->next) {
+		ImageJob *previous = scan->data;
+
+		if (previous->state == IMAGE_JOB_DONE)
+			continue;
+		if (g_file_equal (previous->destination, file) || g_file_equal (previous->source->file, file))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+/* Whether all the jobs that precede @job in the list are committed or
+ * only wait to be committed. */
+static gboolean
+previous_jobs_done (GthImageListTask *self,
+		    ImageJob         *job)
+{
+	GList *scan;
+
+	for (scan = self->priv->jobs->head; scan && (scan->data != job); scan = scan->next) {
+		ImageJob *previous = scan->data;
+
+		if (previous->state != IMAGE_JOB_DONE)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static void
+image_job_saved_cb (GthFileData *file_data,
+		    GError      *error,
+		    gpointer     user_data)
+{
+	ImageJob *job = user_data;
+
+	if (image_job_abandoned (job))
+		return;
+
+	if (error != NULL) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+			job->state = IMAGE_JOB_EXISTS;
+			process_queue (job->self);
+		}
+		else
+			image_job_failed (job, g_error_copy (error));
+		return;
+	}
+
+	/* the image is not needed anymore, free the memory before the job
+	 * is committed. */
+
+	_g_clear_object (&job->image);
+	job->saved = TRUE;
+	job->state = IMAGE_JOB_DONE;
+	process_queue (job->self);
+}
+
+
+static void
+image_job_save (ImageJob *job,
+		gboolean  replace)
+{
+	GthImageListTask *self = job->self;
+
+	job->replace = replace;
+	if (file_used_by_previous_jobs (self, job, job->destination)) {
+		job->state = IMAGE_JOB_WAITING;
+		return;
+	}
+
+	/* when the overwrite dialog can be shown, write the files in the
+	 * order of the list: the dialog of a previous file can cancel the
+	 * task or change the overwrite mode. */
+
+	if ((self->priv->overwrite_mode != GTH_OVERWRITE_SKIP)
+	    && (self->priv->overwrite_mode != GTH_OVERWRITE_OVERWRITE)
+	    && ! previous_jobs_done (self, job))
+	{
+		job->state = IMAGE_JOB_WAITING;
+		return;
+	}
+
+	job->state = IMAGE_JOB_RUNNING;
+	job->running = TRUE;
+	gth_image_save_to_file (job->image,
+				gth_file_data_get_mime_type (job->destination_file_data),
+				job->destination_file_data,
+				replace,
+				self->priv->cancellable,
+				image_job_saved_cb,
+				job);
+}
 
 
 static void
@@ -102,8 +372,12 @@ overwrite_dialog_response_cb (GtkDialog *dialog,
                               gpointer   user_data)
 {
 	GthImageListTask *self = user_data;
+	ImageJob         *job;
 	gboolean          close_overwrite_dialog = TRUE;
 
+	job = g_queue_peek_head (self->priv->jobs);
+	g_return_if_fail ((job != NULL) && (job->state == IMAGE_JOB_ASKING));
+
 	if (response_id != GTK_RESPONSE_OK)
 		self->priv->overwrite_response = GTH_OVERWRITE_RESPONSE_CANCEL;
 	else
@@ -118,14 +392,15 @@ overwrite_dialog_response_cb (GtkDialog *dialog,
 	case GTH_OVERWRITE_RESPONSE_UNSPECIFIED:
 		if (self->priv->overwrite_response == GTH_OVERWRITE_RESPONSE_ALWAYS_NO)
 			self->priv->overwrite_mode = GTH_OVERWRITE_SKIP;
-		process_next_file (self);
+		job->state = IMAGE_JOB_DONE;
+		process_queue (self);
 		break;
 
 	case GTH_OVERWRITE_RESPONSE_YES:
 	case GTH_OVERWRITE_RESPONSE_ALWAYS_YES:
 		if (self->priv->overwrite_response == GTH_OVERWRITE_RESPONSE_ALWAYS_YES)
 			self->priv->overwrite_mode = GTH_OVERWRITE_OVERWRITE;
-		image_task_save_current_image (self, NULL, TRUE);
+		image_job_save (job, TRUE);
 		break;
 
 	case GTH_OVERWRITE_RESPONSE_RENAME:
@@ -137,7 +412,7 @@ overwrite_dialog_response_cb (GtkDialog *dialog,
 			if (self->priv->destination_folder != NULL)
 				parent = g_object_ref (self->priv->destination_folder);
 			else
-				parent = g_file_get_parent (self->priv->destination_file_data->file);
+				parent = g_file_get_parent (job->destination);
 
 			new_destination = g_file_get_child_for_display_name (parent, gth_overwrite_dialog_get_filename (GTH_OVERWRITE_DIALOG (dialog)), &error);
 			if (new_destination == NULL) {
@@ -147,10 +422,12 @@ overwrite_dialog_response_cb (GtkDialog *dialog,
 				gth_task_dialog (GTH_TASK (self), TRUE, GTK_WIDGET (dialog));
 				close_overwrite_dialog = FALSE;
 			}
-			else
-				image_task_save_current_image (self, new_destination, FALSE);
+			else {
+				image_job_set_destination (job, new_destination);
+				image_job_save (job, FALSE);
+			}
 
-			g_object_unref (new_destination);
+			_g_object_unref (new_destination);
 			g_object_unref (parent);
 		}
 		break;
@@ -160,7 +437,8 @@ overwrite_dialog_response_cb (GtkDialog *dialog,
 			GError *error;
 
 			error = g_error_new_literal (GTH_TASK_ERROR, GTH_TASK_ERROR_CANCELLED, "");
-			gth_task_completed (GTH_TASK (self), error);
+			image_list_task_complete (self, error);
+			g_error_free (error);
 		}
 		break;
 	}
@@ -171,62 +449,153 @@ overwrite_dialog_response_cb (GtkDialog *dialog,
 
 
 static void
-image_saved_cb (GthFileData *file_data,
-		GError      *error,
-		gpointer     user_data)
+image_job_ask_overwrite (ImageJob *job)
 {
-	GthImageListTask *self = user_data;
-	GFile             *parent;
-	GList             *file_list;
+	GthImageListTask *self = job->self;
+	GtkWidget        *dialog;
+
+	job->state = IMAGE_JOB_ASKING;
+	dialog = gth_overwrite_dialog_new (NULL,
+					   job->image,
+					   job->destination,
+					   GTH_OVERWRITE_RESPONSE_YES,
+					   (self->priv->n_files == 1));
+	gth_task_dialog (GTH_TASK (self), TRUE, dialog);
+
+	g_signal_connect (dialog,
+			  "response",
+			  G_CALLBACK (overwrite_dialog_response_cb),
+			  self);
+	gtk_widget_show (dialog);
+}
 
-	if (error != NULL) {
-		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+
+static void
+image_job_committed (ImageJob *job)
+{
+	GthImageListTask *self = job->self;
+
+	if (job->saved) {
+		GFile *parent;
+		GList *file_list;
+
+		parent = g_file_get_parent (job->destination);
+		file_list = g_list_append (NULL, job->destination);
+		gth_monitor_folder_changed (gth_main_get_default_monitor (),
+					    parent,
+					    file_list,
+					    GTH_MONITOR_EVENT_CHANGED);
+
+		g_list_free (file_list);
+		g_object_unref (parent);
+	}
+
+	self->priv->n_current++;
+	gth_task_progress (GTH_TASK (self),
+			   NULL,
+			   NULL,
+			   FALSE,
+			   ((double) self->priv->n_current + 1) / (self->priv->n_files + 1));
+}
+
+
+static void image_job_start (ImageJob *job);
+
+
+static void
+start_next_jobs (GthImageListTask *self)
+{
+	while ((self->priv->next != NULL)
+	       && (g_queue_get_length (self->priv->jobs) < self->priv->max_jobs))
+	{
+		GthFileData *source = self->priv->next->data;
+		ImageJob    *job;
+
+		/* do not read a file before a previous job writes it */
+
+		if (file_used_by_previous_jobs (self, NULL, source->file))
+			break;
+
+		job = image_job_new (self, source);
+		g_queue_push_tail (self->priv->jobs, job);
+		self->priv->next = self->priv->next->next;
+		image_job_start (job);
+	}
+}
+
+
+static void
+process_queue (GthImageListTask *self)
+{
+	ImageJob *job;
+	GList    *scan;
+
+	if (self->priv->completed)
+		return;
+
+	/* commit the jobs in the order of the file list */
+
+	while ((job = g_queue_peek_head (self->priv->jobs)) != NULL) {
+		if (job->state == IMAGE_JOB_DONE) {
+			g_queue_pop_head (self->priv->jobs);
+			image_job_committed (job);
+			image_job_free (job);
+			continue;
+		}
+
+		if (job->state == IMAGE_JOB_ERROR) {
+			GError *error;
+
+			error = job->error;
+			job->error = NULL;
+			image_list_task_complete (self, error);
+			g_error_free (error);
+			return;
+		}
+
+		if (job->state == IMAGE_JOB_EXISTS) {
 			if (self->priv->overwrite_mode == GTH_OVERWRITE_SKIP) {
-				process_next_file (self);
-			}
-			else  {
-				GtkWidget *dialog;
-
-				dialog = gth_overwrite_dialog_new (NULL,
-								   self->priv->new_image,
-								   self->priv->destination_file_data->file,
-								   GTH_OVERWRITE_RESPONSE_YES,
-								   (self->priv->n_files == 1));
-				gth_task_dialog (GTH_TASK (self), TRUE, dialog);
-
-				g_signal_connect (dialog,
-						  "response",
-						  G_CALLBACK (overwrite_dialog_response_cb),
-						  self);
-				gtk_widget_show (dialog);
+				job->state = IMAGE_JOB_DONE;
+				continue;
 			}
+
+			if (self->priv->overwrite_mode == GTH_OVERWRITE_OVERWRITE)
+				image_job_save (job, TRUE);
+			else
+				image_job_ask_overwrite (job);
 		}
-		else
-			gth_task_completed (GTH_TASK (self), error);
-		return;
+
+		break;
 	}
 
-	parent = g_file_get_parent (file_data->file);
-	file_list = g_list_append (NULL, file_data->file);
-	gth_monitor_folder_changed (gth_main_get_default_monitor (),
-				    parent,
-				    file_list,
-				    GTH_MONITOR_EVENT_CHANGED);
+	for (scan = self->priv->jobs->head; scan; scan = scan->next) {
+		job = scan->data;
+		if (job->state == IMAGE_JOB_WAITING)
+			image_job_save (job, job->replace);
+	}
 
-	g_list_free (file_list);
-	g_object_unref (parent);
+	start_next_jobs (self);
 
-	process_next_file (self);
+	if (g_queue_is_empty (self->priv->jobs)) {
+		if (self->priv->destination_folder != NULL)
+			gth_browser_go_to (self->priv->browser, self->priv->destination_folder, NULL);
+		image_list_task_complete (self, NULL);
+	}
 }
 
 
+/* -- image_job_start -- */
+
+
 static void
 image_task_dialog_cb (GthTask   *task,
 		      gboolean   opened,
 		      GtkWidget *dialog,
 		      gpointer   user_data)
 {
-	gth_task_dialog (GTH_TASK (user_data), opened, dialog);
+	ImageJob *job = user_data;
+
+	gth_task_dialog (GTH_TASK (job->self), opened, dialog);
 }
 
 
@@ -238,9 +607,10 @@ image_task_progress_cb (GthTask    *task,
 		        double      fraction,
 		        gpointer    user_data)
 {
-	GthImageListTask *self = user_data;
-	double             total_fraction;
-	double             file_fraction;
+	ImageJob         *job = user_data;
+	GthImageListTask *self = job->self;
+	double            total_fraction;
+	double            file_fraction;
 
 	total_fraction =  ((double) self->priv->n_current + 1) / (self->priv->n_files + 1);
 	if (pulse)
@@ -248,10 +618,8 @@ image_task_progress_cb (GthTask    *task,
 	else
 		file_fraction = fraction;
 
-	if (details == NULL) {
-		GthFileData *source_file_data = self->priv->current->data;
-		details = g_file_info_get_display_name (source_file_data->info);
-	}
+	if (details == NULL)
+		details = g_file_info_get_display_name (job->source->info);
 
 	gth_task_progress (GTH_TASK (self),
 			   description,
@@ -262,98 +630,110 @@ image_task_progress_cb (GthTask    *task,
 
 
 static void
-image_task_save_current_image (GthImageListTask *self,
-			       GFile            *file,
-			       gboolean          replace)
+image_task_completed_cb (GthTask  *task,
+			 GError   *error,
+			 gpointer  user_data)
 {
-	GthImage *destination;
+	ImageJob         *job = user_data;
+	GthImageListTask *self = job->self;
+	GthImage         *destination;
+
+	if (image_job_abandoned (job))
+		return;
+
+	if (g_error_matches (error, GTH_TASK_ERROR, GTH_TASK_ERROR_SKIP_TO_NEXT_FILE)) {
+		job->state = IMAGE_JOB_DONE;
+		process_queue (self);
+		return;
+	}
 
-	if (file != NULL)
-		gth_file_data_set_file (self->priv->destination_file_data, file);
+	if (error != NULL) {
+		image_job_failed (job, g_error_copy (error));
+		return;
+	}
 
-	destination = gth_image_task_get_destination (GTH_IMAGE_TASK (self->priv->task));
+	destination = gth_image_task_get_destination (GTH_IMAGE_TASK (job->image_task));
 	if (destination == NULL) {
-		process_next_file (self);
+		job->state = IMAGE_JOB_DONE;
+		process_queue (self);
 		return;
 	}
 
-	/* add a reference before unref-ing new_image because dest and
-	 * new_image can be the same object. */
+	job->image = g_object_ref (destination);
+	gth_image_task_set_source (GTH_IMAGE_TASK (job->image_task), NULL);
+	gth_image_task_set_destination (GTH_IMAGE_TASK (job->image_task), NULL);
 
-	g_object_ref (destination);
-	_g_object_unref (self->priv->new_image);
-	self->priv->new_image = destination;
+	job->destination_file_data = gth_file_data_dup (job->file_data);
+	gth_file_data_set_file (job->destination_file_data, job->destination);
+	if (self->priv->mime_type != NULL)
+		gth_file_data_set_mime_type (job->destination_file_data, self->priv->mime_type);
 
-	gth_image_save_to_file (self->priv->new_image,
-				gth_file_data_get_mime_type (self->priv->destination_file_data),
-				self->priv->destination_file_data,
-				replace,
-				gth_task_get_cancellable (GTH_TASK (self)),
-				image_saved_cb,
-				self);
+	image_job_save (job, (self->priv->overwrite_mode == GTH_OVERWRITE_OVERWRITE));
 }
 
 
 static void
-set_current_destination_file (GthImageListTask *self)
+decode_image_thread (GTask        *task,
+		     gpointer      source_object,
+		     gpointer      task_data,
+		     GCancellable *cancellable)
 {
-	char  *display_name;
-	GFile *parent;
-	GFile *destination;
+	GInputStream *istream;
+	GthImage     *image;
+	GError       *error = NULL;
 
-	_g_object_unref (self->priv->destination_file_data);
-	self->priv->destination_file_data = g_object_ref (self->priv->current->data);
+	istream = g_memory_input_stream_new_from_bytes ((GBytes *) task_data);
+	image = gth_image_new_from_stream (istream, -1, NULL, NULL, cancellable, &error);
 
-	if (self->priv->mime_type != NULL) {
-		char          *no_ext;
-		GthImageSaver *saver;
-
-		no_ext = _g_path_remove_extension (g_file_info_get_display_name (self->priv->destination_file_data->info));
-		saver = gth_main_get_image_saver (self->priv->mime_type);
-		g_return_if_fail (saver != NULL);
-
-		display_name = g_strconcat (no_ext, ".", gth_image_saver_get_default_ext (saver), NULL);
-		gth_file_data_set_mime_type (self->priv->destination_file_data, self->priv->mime_type);
-
-		g_object_unref (saver);
-		g_free (no_ext);
-	}
-	else
-		display_name = g_strdup (g_file_info_get_display_name (self->priv->destination_file_data->info));
+	g_object_unref (istream);
 
-	if (self->priv->destination_folder != NULL)
-		parent = g_object_ref (self->priv->destination_folder);
+	if (image != NULL)
+		g_task_return_pointer (task, image, g_object_unref);
 	else
-		parent = g_file_get_parent (self->priv->destination_file_data->file);
-	destination = g_file_get_child_for_display_name (parent, display_name, NULL);
-
-	gth_file_data_set_file (self->priv->destination_file_data, destination);
-
-	g_object_unref (destination);
-	g_object_unref (parent);
-	g_free (display_name);
+		g_task_return_error (task, error);
 }
 
 
 static void
-image_task_completed_cb (GthTask  *task,
-			 GError   *error,
-			 gpointer  user_data)
+image_decoded_cb (GObject      *source_object,
+		  GAsyncResult *result,
+		  gpointer      user_data)
 {
-	GthImageListTask *self = user_data;
-
-	if (g_error_matches (error, GTH_TASK_ERROR, GTH_TASK_ERROR_SKIP_TO_NEXT_FILE)) {
-		process_next_file (self);
+	ImageJob         *job = user_data;
+	GthImageListTask *self = job->self;
+	GthImage         *image;
+	GError           *error = NULL;
+
+	image = g_task_propagate_pointer (G_TASK (result), &error);
+	if (image_job_abandoned (job)) {
+		_g_object_unref (image);
+		g_clear_error (&error);
 		return;
 	}
 
-	if (error != NULL) {
-		gth_task_completed (GTH_TASK (self), error);
+	if (image == NULL) {
+		image_job_failed (job, error);
 		return;
 	}
 
-	set_current_destination_file (self);
-	image_task_save_current_image (self, NULL, (self->priv->overwrite_mode == GTH_OVERWRITE_OVERWRITE));
+	job->image_task = gth_image_task_copy (GTH_IMAGE_TASK (self->priv->task));
+	g_signal_connect (job->image_task,
+			  "completed",
+			  G_CALLBACK (image_task_completed_cb),
+			  job);
+	g_signal_connect (job->image_task,
+			  "progress",
+			  G_CALLBACK (image_task_progress_cb),
+			  job);
+	g_signal_connect (job->image_task,
+			  "dialog",
+			  G_CALLBACK (image_task_dialog_cb),
+			  job);
+	gth_image_task_set_source (GTH_IMAGE_TASK (job->image_task), image);
+	g_object_unref (image);
+
+	job->running = TRUE;
+	gth_task_exec (job->image_task, self->priv->cancellable);
 }
 
 
@@ -363,26 +743,26 @@ file_buffer_ready_cb (void     **buffer,
 		      GError    *error,
 		      gpointer   user_data)
 {
-	GthImageListTask *self = user_data;
-	GInputStream     *istream;
+	ImageJob *job = user_data;
+	GTask    *task;
+
+	if (image_job_abandoned (job))
+		return;
 
 	if (error != NULL) {
-		gth_task_completed (GTH_TASK (self), error);
+		image_job_failed (job, g_error_copy (error));
 		return;
 	}
 
-	istream = g_memory_input_stream_new_from_data (*buffer, count, NULL);
-	self->priv->original_image = gth_image_new_from_stream (istream, -1, NULL, NULL, gth_task_get_cancellable (GTH_TASK (self)), &error);
+	/* decode the image in a thread, the buffer is owned by the task. */
 
-	g_object_unref (istream);
+	job->running = TRUE;
+	task = g_task_new (NULL, job->self->priv->cancellable, image_decoded_cb, job);
+	g_task_set_task_data (task, g_bytes_new_take (*buffer, count), (GDestroyNotify) g_bytes_unref);
+	*buffer = NULL;
+	g_task_run_in_thread (task, decode_image_thread);
 
-	if (self->priv->original_image == NULL) {
-		gth_task_completed (GTH_TASK (self), error);
-		return;
-	}
-
-	gth_image_task_set_source (GTH_IMAGE_TASK (self->priv->task), self->priv->original_image);
-	gth_task_exec (self->priv->task, gth_task_get_cancellable (GTH_TASK (self)));
+	g_object_unref (task);
 }
 
 
@@ -391,60 +771,40 @@ file_info_ready_cb (GList    *files,
 		    GError   *error,
 		    gpointer  user_data)
 {
-	GthImageListTask *self = user_data;
-	GthFileData       *updated_file_data;
-	GthFileData       *source_file_data;
+	ImageJob *job = user_data;
+
+	if (image_job_abandoned (job))
+		return;
 
 	if (error != NULL) {
-		gth_task_completed (GTH_TASK (self), error);
+		image_job_failed (job, g_error_copy (error));
 		return;
 	}
 
-	source_file_data = self->priv->current->data;
-	updated_file_data = (GthFileData*) files->data;
-	g_file_info_copy_into (updated_file_data->info, source_file_data->info);
-
-	_g_file_load_async (source_file_data->file,
+	job->file_data = g_object_ref (files->data);
+	job->running = TRUE;
+	_g_file_load_async (job->source->file,
 			    G_PRIORITY_DEFAULT,
-			    gth_task_get_cancellable (GTH_TASK (self)),
+			    job->self->priv->cancellable,
 			    file_buffer_ready_cb,
-			    self);
+			    job);
 }
 
 
 static void
-process_current_file (GthImageListTask *self)
+image_job_start (ImageJob *job)
 {
-	GthFileData *source_file_data;
-	GList       *source_singleton;
-
-	if (self->priv->current == NULL) {
-		if (self->priv->destination_folder != NULL)
-			gth_browser_go_to (self->priv->browser, self->priv->destination_folder, NULL);
-		gth_task_completed (GTH_TASK (self), NULL);
-		return;
-	}
-
-	_g_object_unref (self->priv->original_image);
-	self->priv->original_image = NULL;
-
-	_g_object_unref (self->priv->new_image);
-	self->priv->new_image = NULL;
-
-	gth_task_progress (GTH_TASK (self),
-			   NULL,
-			   NULL,
-			   FALSE,
-			   ((double) self->priv->n_current + 1) / (self->priv->n_files + 1));
+	GList *source_singleton;
 
-	source_file_data = self->priv->current->data;
-	source_singleton = g_list_append (NULL, g_object_ref (source_file_data->file));
+	job->state = IMAGE_JOB_RUNNING;
+	job->running = TRUE;
+	source_singleton = g_list_append (NULL, g_object_ref (job->source->file));
 	_g_query_all_metadata_async (source_singleton,
 				     GTH_LIST_DEFAULT,
 				     "*",
-				     gth_task_get_cancellable (GTH_TASK (self)),
+				     job->self->priv->cancellable,
 				     file_info_ready_cb,
-				     self);
+				     job);
 
 	_g_object_list_unref (source_singleton);
 }
@@ -454,15 +814,41 @@ static void
 gth_image_list_task_exec (GthTask *task)
 {
 	GthImageListTask *self;
+	GSettings        *settings;
+	int               max_jobs;
 
 	g_return_if_fail (GTH_IS_IMAGE_LIST_TASK (task));
 
 	self = GTH_IMAGE_LIST_TASK (task);
 
-	self->priv->current = self->priv->file_list;
+	settings = g_settings_new (PIX_GENERAL_SCHEMA);
+	max_jobs = g_settings_get_int (settings, PREF_GENERAL_IMAGE_TASKS_IN_FLIGHT);
+	g_object_unref (settings);
+
+	self->priv->max_jobs = (max_jobs > 0) ? max_jobs : _g_get_n_worker_threads ();
+	self->priv->completed = FALSE;
+	self->priv->next = self->priv->file_list;
 	self->priv->n_current = 0;
 	self->priv->n_files = g_list_length (self->priv->file_list);
-	process_current_file (self);
+	_g_object_unref (self->priv->cancellable);
+	self->priv->cancellable = g_cancellable_new ();
+
+	gth_task_progress (GTH_TASK (self),
+			   NULL,
+			   NULL,
+			   FALSE,
+			   1.0 / (self->priv->n_files + 1));
+	process_queue (self);
+}
+
+
+static void
+gth_image_list_task_cancelled (GthTask *task)
+{
+	GthImageListTask *self = GTH_IMAGE_LIST_TASK (task);
+
+	if (self->priv->cancellable != NULL)
+		g_cancellable_cancel (self->priv->cancellable);
 }
 
 
@@ -477,6 +863,7 @@ gth_image_list_task_class_init (GthImageListTaskClass *klass)
 
 	task_class = GTH_TASK_CLASS (klass);
 	task_class->exec = gth_image_list_task_exec;
+	task_class->cancelled = gth_image_list_task_cancelled;
 }
 
 
@@ -484,8 +871,10 @@ static void
 gth_image_list_task_init (GthImageListTask *self)
 {
 	self->priv = gth_image_list_task_get_instance_private (self);
-	self->priv->original_image = NULL;
-	self->priv->new_image = NULL;
+	self->priv->jobs = g_queue_new ();
+	self->priv->max_jobs = 1;
+	self->priv->completed = FALSE;
+	self->priv->cancellable = NULL;
 	self->priv->destination_folder = NULL;
 	self->priv->overwrite_response = GTH_OVERWRITE_RESPONSE_UNSPECIFIED;
 	self->priv->mime_type = NULL;
@@ -506,18 +895,6 @@ gth_image_list_task_new (GthBrowser    *browser,
 	self->priv->browser = browser;
 	self->priv->file_list = _g_object_list_ref (file_list);
 	self->priv->task = GTH_TASK (g_object_ref (task));
-	self->priv->task_completed = g_signal_connect (self->priv->task,
-						       "completed",
-						       G_CALLBACK (image_task_completed_cb),
-						       self);
-	self->priv->task_progress = g_signal_connect (self->priv->task,
-						      "progress",
-						      G_CALLBACK (image_task_progress_cb),
-						      self);
-	self->priv->task_dialog = g_signal_connect (self->priv->task,
-						    "dialog",
-						    G_CALLBACK (image_task_dialog_cb),
-						    self);
 
 	return (GthTask *) self;
 }
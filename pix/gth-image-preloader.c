@@ -35,7 +35,8 @@
 #undef DEBUG_PRELOADER
 #undef RESIZE_TO_REQUESTED_SIZE
 #define LOAD_NEXT_FILE_DELAY 100
-#define CACHE_MAX_SIZE 10
+#define DEFAULT_MAX_CACHE_SIZE (512 * 1024 * 1024)
+#define MIN_CACHE_DATA_SIZE 1024
 
 
 enum {
@@ -54,6 +55,7 @@ typedef struct {
 	int			 requested_size;
 	gboolean		 loaded_original;
 	GError			*error;
+	gsize			 size;
 } CacheData;
 
 
@@ -78,9 +80,15 @@ struct _GthImagePreloaderPrivate {
 	LoadRequest		*current_request;
 	LoadRequest             *last_request;
 	GthImageLoader		*loader;
-	GQueue			*cache;
+	GQueue			*cache;			/* CacheData, most recently used first */
+	GHashTable		*cache_index;		/* CacheData -> link in cache */
+	gsize			 cache_size;
+	gsize			 max_cache_size;
 	guint                    load_next_id;
 	GthICCProfile           *out_profile;
+#if GLIB_CHECK_VERSION(2, 64, 0)
+	GMemoryMonitor		*memory_monitor;
+#endif
 };
 
 
@@ -107,6 +115,7 @@ cache_data_new (void)
 	cache_data->requested_size = -1;
 	cache_data->error = NULL;
 	cache_data->loaded_original = FALSE;
+	cache_data->size = 0;
 
 	return cache_data;
 }
@@ -135,6 +144,39 @@ cache_data_unref (CacheData *cache_data)
 }
 
 
+/* CacheData hash and equality functions, used by the cache index: two
+ * entries are equal if they refer to the same file at the same size. */
+
+
+static guint
+cache_data_hash (gconstpointer key)
+{
+	const CacheData *cache_data = key;
+	guint            hash;
+
+	hash = (cache_data->file_data != GTH_MODIFIED_IMAGE) ? g_file_hash (cache_data->file_data->file) : 0;
+
+	return hash ^ (guint) cache_data->requested_size;
+}
+
+
+static gboolean
+cache_data_equal (gconstpointer a,
+		  gconstpointer b)
+{
+	const CacheData *cache_data_a = a;
+	const CacheData *cache_data_b = b;
+
+	if (cache_data_a->requested_size != cache_data_b->requested_size)
+		return FALSE;
+
+	if ((cache_data_a->file_data == GTH_MODIFIED_IMAGE) || (cache_data_b->file_data == GTH_MODIFIED_IMAGE))
+		return cache_data_a->file_data == cache_data_b->file_data;
+
+	return g_file_equal (cache_data_a->file_data->file, cache_data_b->file_data->file);
+}
+
+
 static inline gboolean
 cache_data_file_matches (CacheData   *cache_data,
 			 GthFileData *file_data)
@@ -270,8 +312,15 @@ gth_image_preloader_finalize (GObject *object)
 	}
 	g_list_free (self->priv->requests);
 
+#if GLIB_CHECK_VERSION(2, 64, 0)
+	if (self->priv->memory_monitor != NULL) {
+		g_signal_handlers_disconnect_by_data (self->priv->memory_monitor, self);
+		g_object_unref (self->priv->memory_monitor);
+	}
+#endif
 	g_object_unref (self->priv->loader);
 	_g_object_unref (self->priv->out_profile);
+	g_hash_table_destroy (self->priv->cache_index);
 	g_queue_free_full (self->priv->cache, (GDestroyNotify) cache_data_unref);
 
 	G_OBJECT_CLASS (gth_image_preloader_parent_class)->finalize (object);
@@ -288,6 +337,39 @@ gth_image_preloader_class_init (GthImagePreloaderClass *class)
 }
 
 
+static void _gth_image_preloader_shrink_cache (GthImagePreloader *self,
+					       gsize              max_size);
+
+
+#if GLIB_CHECK_VERSION(2, 64, 0)
+
+
+static void
+low_memory_warning_cb (GMemoryMonitor             *monitor,
+		       GMemoryMonitorWarningLevel  level,
+		       gpointer                    user_data)
+{
+	GthImagePreloader *self = user_data;
+	gsize              max_size;
+
+	if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL)
+		max_size = 0;
+	else if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM)
+		max_size = self->priv->max_cache_size / 4;
+	else
+		max_size = self->priv->max_cache_size / 2;
+
+#ifdef DEBUG_PRELOADER
+	g_print ("low memory warning (level %d): shrink the cache to %" G_GSIZE_FORMAT " bytes\n", level, max_size);
+#endif
+
+	_gth_image_preloader_shrink_cache (self, max_size);
+}
+
+
+#endif
+
+
 static void
 gth_image_preloader_init (GthImagePreloader *self)
 {
@@ -297,8 +379,19 @@ gth_image_preloader_init (GthImagePreloader *self)
 	self->priv->last_request = NULL;
 	self->priv->loader = gth_image_loader_new (NULL, NULL);
 	self->priv->cache = g_queue_new ();
+	self->priv->cache_index = g_hash_table_new (cache_data_hash, cache_data_equal);
+	self->priv->cache_size = 0;
+	self->priv->max_cache_size = DEFAULT_MAX_CACHE_SIZE;
 	self->priv->load_next_id = 0;
 	self->priv->out_profile = NULL;
+#if GLIB_CHECK_VERSION(2, 64, 0)
+	self->priv->memory_monitor = g_memory_monitor_dup_default ();
+	if (self->priv->memory_monitor != NULL)
+		g_signal_connect (self->priv->memory_monitor,
+				  "low-memory-warning",
+				  G_CALLBACK (low_memory_warning_cb),
+				  self);
+#endif
 }
 
 
@@ -321,7 +414,124 @@ gth_image_preloader_set_out_profile (GthImagePreloader *self,
 }
 
 
-/* -- gth_image_preloader_load -- */
+void
+gth_image_preloader_set_max_cache_size (GthImagePreloader *self,
+					gsize              max_size)
+{
+	g_return_if_fail (GTH_IS_IMAGE_PRELOADER (self));
+
+	self->priv->max_cache_size = max_size;
+	_gth_image_preloader_shrink_cache (self, self->priv->max_cache_size);
+}
+
+
+/* -- cache -- */
+
+
+static void
+_gth_image_preloader_remove_from_cache (GthImagePreloader *self,
+					GList             *link)
+{
+	CacheData *cache_data = link->data;
+
+	g_hash_table_remove (self->priv->cache_index, cache_data);
+	g_queue_delete_link (self->priv->cache, link);
+	self->priv->cache_size -= cache_data->size;
+	cache_data_unref (cache_data);
+}
+
+
+static gboolean
+_gth_image_preloader_has_scaled_copy (GthImagePreloader *self,
+				      CacheData         *original)
+{
+	GList *scan;
+
+	for (scan = self->priv->cache->head; scan; scan = scan->next) {
+		CacheData *cache_data = scan->data;
+
+		if ((cache_data != original)
+		    && (cache_data->requested_size != GTH_ORIGINAL_SIZE)
+		    && (cache_data->image != NULL)
+		    && cache_data_file_matches (cache_data, original->file_data))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+
+static void
+_gth_image_preloader_evict (GthImagePreloader *self,
+			    gsize              max_size,
+			    gboolean           only_originals)
+{
+	GList *scan;
+
+	/* the most recently used image and the modified image are never
+	 * removed. */
+
+	scan = self->priv->cache->tail;
+	while ((scan != NULL) && (scan != self->priv->cache->head) && (self->priv->cache_size > max_size)) {
+		GList     *prev = scan->prev;
+		CacheData *cache_data = scan->data;
+
+		if ((cache_data->file_data != GTH_MODIFIED_IMAGE)
+		    && (! only_originals
+			|| ((cache_data->requested_size == GTH_ORIGINAL_SIZE)
+			    && _gth_image_preloader_has_scaled_copy (self, cache_data))))
+		{
+#ifdef DEBUG_PRELOADER
+			g_print ("evict %s @%d [%" G_GSIZE_FORMAT "]\n",
+				 g_file_get_uri (cache_data->file_data->file),
+				 cache_data->requested_size,
+				 cache_data->size);
+#endif
+			_gth_image_preloader_remove_from_cache (self, scan);
+		}
+
+		scan = prev;
+	}
+}
+
+
+static void
+_gth_image_preloader_shrink_cache (GthImagePreloader *self,
+				   gsize              max_size)
+{
+	if (self->priv->cache_size <= max_size)
+		return;
+
+	/* drop the original images that have a scaled copy first, then the
+	 * least recently used images. */
+
+	_gth_image_preloader_evict (self, max_size, TRUE);
+	_gth_image_preloader_evict (self, max_size, FALSE);
+}
+
+
+static void
+_gth_image_preloader_add_to_cache (GthImagePreloader *self,
+				   CacheData         *cache_data)
+{
+	GList *link;
+
+	link = g_hash_table_lookup (self->priv->cache_index, cache_data);
+	if (link != NULL)
+		_gth_image_preloader_remove_from_cache (self, link);
+
+	cache_data->size = MIN_CACHE_DATA_SIZE;
+	if (cache_data->image != NULL)
+		cache_data->size += gth_image_get_memory_size (cache_data->image);
+
+	g_queue_push_head (self->priv->cache, cache_data);
+	g_hash_table_insert (self->priv->cache_index, cache_data, self->priv->cache->head);
+	self->priv->cache_size += cache_data->size;
+
+	_gth_image_preloader_shrink_cache (self, self->priv->max_cache_size);
+}
 
 
 static CacheData *
@@ -329,15 +539,28 @@ _gth_image_preloader_lookup_same_size (GthImagePreloader	*self,
 				       GthFileData		*requested_file,
 				       int			 requested_size)
 {
-	GList *scan;
+	CacheData  key;
+	GList     *link;
 
-	for (scan = self->priv->cache->head; scan; scan = scan->next) {
-		CacheData *cache_data = scan->data;
-		if (cache_data_is_valid_for_request (cache_data, requested_file, requested_size))
-			return cache_data;
+	key.file_data = requested_file;
+	key.requested_size = requested_size;
+	link = g_hash_table_lookup (self->priv->cache_index, &key);
+
+	if ((link != NULL) && ! cache_data_is_valid_for_request (link->data, requested_file, requested_size)) {
+		/* the file was modified after it was loaded */
+		_gth_image_preloader_remove_from_cache (self, link);
+		link = NULL;
 	}
 
-	return NULL;
+	if (link == NULL)
+		return NULL;
+
+	/* move to the front of the queue */
+
+	g_queue_unlink (self->priv->cache, link);
+	g_queue_push_head_link (self->priv->cache, link);
+
+	return link->data;
 }
 
 
@@ -438,6 +661,8 @@ _gth_image_preloader_request_completed (GthImagePreloader *self,
 						cache_data->requested_size,
 						w,
 						h);
+				g_print (" --> cache: %" G_GSIZE_FORMAT " bytes\n",
+						self->priv->cache_size);
 			}
 #endif
 
@@ -482,18 +707,6 @@ static void
 _gth_image_preloader_start_last_request (GthImagePreloader *self);
 
 
-static void
-_gth_image_preloader_add_to_cache (GthImagePreloader *self,
-				   CacheData         *cache_data)
-{
-	while (g_queue_get_length (self->priv->cache) >= CACHE_MAX_SIZE) {
-		CacheData *oldest = g_queue_pop_tail (self->priv->cache);
-		cache_data_unref (oldest);
-	}
-	g_queue_push_head (self->priv->cache, cache_data);
-}
-
-
 typedef struct {
 	LoadRequest *request;
 	gboolean     resize_to_requested_size;
@@ -959,7 +1172,7 @@ gth_image_preloader_set_modified_image (GthImagePreloader *self,
 
 		cache_data = scan->data;
 		if (cache_data->file_data == GTH_MODIFIED_IMAGE)
-			g_queue_delete_link (self->priv->cache, scan);
+			_gth_image_preloader_remove_from_cache (self, scan);
 		scan = next;
 	}
 
@@ -982,22 +1195,24 @@ gth_image_preloader_set_modified_image (GthImagePreloader *self,
 cairo_surface_t *
 gth_image_preloader_get_modified_image (GthImagePreloader *self)
 {
-	GList *scan;
-
-	for (scan = self->priv->cache->head; scan; scan = scan->next) {
-		CacheData *cache_data = scan->data;
+	CacheData  key;
+	GList     *link;
 
-		if ((cache_data->file_data == GTH_MODIFIED_IMAGE) && (cache_data->requested_size == -1))
-			return gth_image_get_cairo_surface (cache_data->image);
-	}
+	key.file_data = GTH_MODIFIED_IMAGE;
+	key.requested_size = -1;
+	link = g_hash_table_lookup (self->priv->cache_index, &key);
+	if (link == NULL)
+		return NULL;
 
-	return NULL;
+	return gth_image_get_cairo_surface (((CacheData *) link->data)->image);
 }
 
 
 void
 gth_image_preloader_clear_cache (GthImagePreloader *self)
 {
+	g_hash_table_remove_all (self->priv->cache_index);
 	g_queue_free_full (self->priv->cache, (GDestroyNotify) cache_data_unref);
 	self->priv->cache = g_queue_new ();
+	self->priv->cache_size = 0;
 }
@@ -94,6 +94,41 @@ gth_image_task_new (const char         *description,
 }
 
 
+/* Returns a new task with the functions, the data and the description of
+ * @self.  The user data is shared and remains owned by @self, so the thread
+ * function must not modify it if the tasks run at the same time. */
+GthTask *
+gth_image_task_copy (GthImageTask *self)
+{
+	GthAsyncInitFunc    before_func;
+	GthAsyncThreadFunc  exec_func;
+	GthAsyncReadyFunc   after_func;
+	gpointer            user_data;
+	char               *description;
+	GthTask            *task;
+
+	g_return_val_if_fail (GTH_IS_IMAGE_TASK (self), NULL);
+
+	g_object_get (self,
+		      "before-thread", &before_func,
+		      "thread-func", &exec_func,
+		      "after-thread", &after_func,
+		      "user-data", &user_data,
+		      "description", &description,
+		      NULL);
+	task = gth_image_task_new (description,
+				   before_func,
+				   exec_func,
+				   after_func,
+				   user_data,
+				   NULL);
+
+	g_free (description);
+
+	return task;
+}
+
+
 void
 gth_image_task_set_source (GthImageTask *self,
 			   GthImage     *source)
@@ -55,6 +55,7 @@ GthTask *		gth_image_task_new				(const char		*description,
 									 GthAsyncReadyFunc	 after_func,
 									 gpointer		 user_data,
 									 GDestroyNotify		 user_data_destroy_func);
+GthTask *		gth_image_task_copy				(GthImageTask		*self);
 void			gth_image_task_set_source			(GthImageTask		*self,
 								 	 GthImage		*source);
 void			gth_image_task_set_source_surface		(GthImageTask		*self,
@@ -0,0 +1,270 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include "cairo-scale.h"
+#include "cairo-utils.h"
+#include "glib-utils.h"
+#include "gth-image-tile-cache.h"
+
+
+#define TILE_SIZE 256
+#define MAX_TILES 160
+#define MAX_LEVELS 16
+#define TILE_KEY(x, y) GUINT_TO_POINTER (((guint) (y) << 16) | (guint) (x))
+
+
+struct _GthImageTileCache {
+	GPtrArray      *levels;         /* levels[i] is the image scaled by 1/2^i */
+	GHashTable     *tiles;
+	double          zoom;
+	cairo_filter_t  filter;
+	int             level;
+	int             zoomed_width;
+	int             zoomed_height;
+};
+
+
+GthImageTileCache *
+gth_image_tile_cache_new (void)
+{
+	GthImageTileCache *cache;
+
+	cache = g_new0 (GthImageTileCache, 1);
+	cache->levels = g_ptr_array_new_with_free_func ((GDestroyNotify) cairo_surface_destroy);
+	cache->tiles = g_hash_table_new_full (g_direct_hash,
+					      g_direct_equal,
+					      NULL,
+					      (GDestroyNotify) cairo_surface_destroy);
+	cache->zoom = 0.0;
+
+	return cache;
+}
+
+
+void
+gth_image_tile_cache_free (GthImageTileCache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	g_hash_table_unref (cache->tiles);
+	g_ptr_array_unref (cache->levels);
+	g_free (cache);
+}
+
+
+static void
+_gth_image_tile_cache_clear_tiles (GthImageTileCache *cache)
+{
+	g_hash_table_remove_all (cache->tiles);
+	cache->zoom = 0.0;
+}
+
+
+void
+gth_image_tile_cache_reset (GthImageTileCache *cache)
+{
+	_gth_image_tile_cache_clear_tiles (cache);
+	g_ptr_array_set_size (cache->levels, 0);
+}
+
+
+/* Returns the requested level, or the smallest available if the image cannot
+ * be reduced further. */
+static cairo_surface_t *
+_gth_image_tile_cache_get_level (GthImageTileCache *cache,
+				 int                level)
+{
+	while ((int) cache->levels->len <= level) {
+		cairo_surface_t *prev;
+		cairo_surface_t *scaled;
+		int              width;
+		int              height;
+
+		prev = g_ptr_array_index (cache->levels, cache->levels->len - 1);
+		width = cairo_image_surface_get_width (prev);
+		height = cairo_image_surface_get_height (prev);
+		if ((width <= 1) && (height <= 1))
+			break;
+
+		scaled = _cairo_image_surface_scale_fast (prev, MAX ((width + 1) / 2, 1), MAX ((height + 1) / 2, 1));
+		if (scaled == NULL)
+			break;
+		g_ptr_array_add (cache->levels, scaled);
+	}
+
+	return g_ptr_array_index (cache->levels, MIN (level, cache->levels->len - 1));
+}
+
+
+static cairo_surface_t *
+_gth_image_tile_cache_render_tile (GthImageTileCache *cache,
+				   int                tile_x,
+				   int                tile_y)
+{
+	cairo_surface_t *image;
+	cairo_surface_t *level_image;
+	int              width;
+	int              height;
+	cairo_surface_t *tile;
+	cairo_t         *cr;
+
+	width = MIN (TILE_SIZE, cache->zoomed_width - tile_x * TILE_SIZE);
+	height = MIN (TILE_SIZE, cache->zoomed_height - tile_y * TILE_SIZE);
+	tile = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	if (cairo_surface_status (tile) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy (tile);
+		return NULL;
+	}
+
+	image = g_ptr_array_index (cache->levels, 0);
+	level_image = _gth_image_tile_cache_get_level (cache, cache->level);
+
+	cr = cairo_create (tile);
+	cairo_translate (cr, - tile_x * TILE_SIZE, - tile_y * TILE_SIZE);
+	cairo_scale (cr,
+		     cache->zoom * cairo_image_surface_get_width (image) / cairo_image_surface_get_width (level_image),
+		     cache->zoom * cairo_image_surface_get_height (image) / cairo_image_surface_get_height (level_image));
+	cairo_set_source_surface (cr, level_image, 0, 0);
+	cairo_pattern_set_filter (cairo_get_source (cr), cache->filter);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	return tile;
+}
+
+
+typedef struct {
+	int x1;
+	int y1;
+	int x2;
+	int y2;
+} TileRange;
+
+
+static gboolean
+tile_is_outside_range (gpointer key,
+		       gpointer value,
+		       gpointer user_data)
+{
+	TileRange *range = user_data;
+	int        x;
+	int        y;
+
+	x = GPOINTER_TO_UINT (key) & 0xffff;
+	y = GPOINTER_TO_UINT (key) >> 16;
+
+	return (x < range->x1) || (x > range->x2) || (y < range->y1) || (y > range->y2);
+}
+
+
+/* Paints the @surface scaled by @zoom, the coordinates have the same meaning
+ * as in gth_image_viewer_paint. */
+void
+gth_image_tile_cache_paint (GthImageTileCache *cache,
+			    cairo_t           *cr,
+			    cairo_surface_t   *surface,
+			    double             zoom,
+			    cairo_filter_t     filter,
+			    int                src_x,
+			    int                src_y,
+			    int                dest_x,
+			    int                dest_y,
+			    int                width,
+			    int                height)
+{
+	TileRange range;
+	int       x1, y1, x2, y2;
+	int       tile_x, tile_y;
+
+	g_return_if_fail (cache != NULL);
+	g_return_if_fail (surface != NULL);
+
+	if ((cache->levels->len == 0) || (g_ptr_array_index (cache->levels, 0) != surface)) {
+		gth_image_tile_cache_reset (cache);
+		g_ptr_array_add (cache->levels, cairo_surface_reference (surface));
+	}
+
+	if ((zoom != cache->zoom) || (filter != cache->filter)) {
+		_gth_image_tile_cache_clear_tiles (cache);
+		cache->zoom = zoom;
+		cache->filter = filter;
+		cache->level = (zoom < 1.0) ? MIN ((int) floor (log2 (1.0 / zoom)), MAX_LEVELS) : 0;
+		cache->zoomed_width = (int) round (cairo_image_surface_get_width (surface) * zoom);
+		cache->zoomed_height = (int) round (cairo_image_surface_get_height (surface) * zoom);
+	}
+
+	x1 = MAX (src_x, 0);
+	y1 = MAX (src_y, 0);
+	x2 = MIN (src_x + width, cache->zoomed_width);
+	y2 = MIN (src_y + height, cache->zoomed_height);
+	if ((x1 >= x2) || (y1 >= y2))
+		return;
+
+	range.x1 = x1 / TILE_SIZE;
+	range.y1 = y1 / TILE_SIZE;
+	range.x2 = (x2 - 1) / TILE_SIZE;
+	range.y2 = (y2 - 1) / TILE_SIZE;
+
+	cairo_save (cr);
+	cairo_rectangle (cr, dest_x, dest_y, width, height);
+	cairo_clip (cr);
+
+	for (tile_y = range.y1; tile_y <= range.y2; tile_y++) {
+		for (tile_x = range.x1; tile_x <= range.x2; tile_x++) {
+			cairo_surface_t *tile;
+			int              x;
+			int              y;
+
+			tile = g_hash_table_lookup (cache->tiles, TILE_KEY (tile_x, tile_y));
+			if (tile == NULL) {
+				tile = _gth_image_tile_cache_render_tile (cache, tile_x, tile_y);
+				if (tile == NULL)
+					continue;
+				g_hash_table_insert (cache->tiles, TILE_KEY (tile_x, tile_y), tile);
+			}
+
+			x = dest_x - src_x + tile_x * TILE_SIZE;
+			y = dest_y - src_y + tile_y * TILE_SIZE;
+			cairo_set_source_surface (cr, tile, x, y);
+			cairo_rectangle (cr,
+					 x,
+					 y,
+					 cairo_image_surface_get_width (tile),
+					 cairo_image_surface_get_height (tile));
+			cairo_fill (cr);
+		}
+	}
+
+	cairo_restore (cr);
+
+	/* keep the tiles around the painted area only */
+
+	if (g_hash_table_size (cache->tiles) > MAX_TILES) {
+		range.x1 -= 1;
+		range.y1 -= 1;
+		range.x2 += 1;
+		range.y2 += 1;
+		g_hash_table_foreach_remove (cache->tiles, tile_is_outside_range, &range);
+	}
+}
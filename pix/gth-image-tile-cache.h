@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTH_IMAGE_TILE_CACHE_H
+#define GTH_IMAGE_TILE_CACHE_H
+
+#include <glib.h>
+#include <cairo.h>
+
+G_BEGIN_DECLS
+
+/* Cache of the image tiles painted at the current zoom level.  When zooming
+ * out the tiles are rendered from a pyramid of images, each one half the
+ * size of the previous one, generated when required. */
+
+typedef struct _GthImageTileCache GthImageTileCache;
+
+GthImageTileCache *  gth_image_tile_cache_new    (void);
+void                 gth_image_tile_cache_free   (GthImageTileCache *cache);
+void                 gth_image_tile_cache_reset  (GthImageTileCache *cache);
+void                 gth_image_tile_cache_paint  (GthImageTileCache *cache,
+						  cairo_t           *cr,
+						  cairo_surface_t   *surface,
+						  double             zoom,
+						  cairo_filter_t     filter,
+						  int                src_x,
+						  int                src_y,
+						  int                dest_x,
+						  int                dest_y,
+						  int                width,
+						  int                height);
+
+G_END_DECLS
+
+#endif /* GTH_IMAGE_TILE_CACHE_H */
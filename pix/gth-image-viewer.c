@@ -28,6 +28,7 @@
 #include "cairo-utils.h"
 #include "gth-enum-types.h"
 #include "gth-image-dragger.h"
+#include "gth-image-tile-cache.h"
 #include "gth-image-viewer.h"
 #include "gth-marshal.h"
 #include "gtk-utils.h"
@@ -42,6 +43,9 @@
 #define STEP_INCREMENT  20.0  /* Scroll increment. */
 #define GRAY_VALUE 0.2
 #define CHECKED_PATTERN_SIZE 20
+#define REGION_UPDATE_DELAY 100 /* Delay before loading the visible region of
+				 * the image, in milliseconds. */
+#define REGION_MARGIN 0.25      /* Fraction of the visible area loaded around it. */
 
 
 enum {
@@ -112,6 +116,15 @@ struct _GthImageViewerPrivate {
 	gboolean                reset_scrollbars;
 	GthTransparencyStyle    transparency_style;
 	GList                  *painters;
+	GthImageTileCache      *tile_cache;
+
+	cairo_surface_t        *region_surface;     /* Visible region of the image
+						     * at the current zoom, for
+						     * images loaded scaled. */
+	cairo_rectangle_int_t   region_area;        /* In original image coordinates. */
+	double                  region_zoom;
+	GCancellable           *region_cancellable;
+	guint                   region_id;
 };
 
 
@@ -138,6 +151,201 @@ painter_data_free (PainterData *painter_data)
 }
 
 
+/* -- region loading -- */
+
+
+static void
+_gth_image_viewer_cancel_region_update (GthImageViewer *self)
+{
+	if (self->priv->region_id != 0) {
+		g_source_remove (self->priv->region_id);
+		self->priv->region_id = 0;
+	}
+
+	if (self->priv->region_cancellable != NULL) {
+		g_cancellable_cancel (self->priv->region_cancellable);
+		_g_clear_object (&self->priv->region_cancellable);
+	}
+}
+
+
+static void
+_gth_image_viewer_clear_region (GthImageViewer *self)
+{
+	_gth_image_viewer_cancel_region_update (self);
+	_cairo_clear_surface (&self->priv->region_surface);
+	self->priv->region_zoom = 0.0;
+}
+
+
+/* Returns the zoom level required to show the image at the current zoom,
+ * or 0.0 if the loaded image has enough pixels. */
+static double
+_gth_image_viewer_get_region_zoom (GthImageViewer *self)
+{
+	cairo_surface_t *image;
+	double           required_zoom;
+
+	if (! gth_image_get_can_load_region (self->priv->image))
+		return 0.0;
+
+	image = gth_image_viewer_get_current_image (self);
+	if ((image == NULL) || (self->priv->original_width <= 0))
+		return 0.0;
+
+	required_zoom = MIN (self->priv->zoom_level * gtk_widget_get_scale_factor (GTK_WIDGET (self)), 1.0);
+	if (required_zoom <= (double) cairo_image_surface_get_width (image) / self->priv->original_width)
+		return 0.0;
+
+	return required_zoom;
+}
+
+
+/* Returns the visible area in original image coordinates. */
+static void
+_gth_image_viewer_get_visible_region (GthImageViewer        *self,
+				      double                 margin,
+				      cairo_rectangle_int_t *region)
+{
+	double x1, y1, x2, y2;
+	double dx, dy;
+
+	x1 = (self->visible_area.x - self->image_area.x) / self->priv->zoom_level;
+	y1 = (self->visible_area.y - self->image_area.y) / self->priv->zoom_level;
+	x2 = x1 + self->visible_area.width / self->priv->zoom_level;
+	y2 = y1 + self->visible_area.height / self->priv->zoom_level;
+
+	dx = (x2 - x1) * margin;
+	dy = (y2 - y1) * margin;
+	x1 = MAX (floor (x1 - dx), 0);
+	y1 = MAX (floor (y1 - dy), 0);
+	x2 = MIN (ceil (x2 + dx), self->priv->original_width);
+	y2 = MIN (ceil (y2 + dy), self->priv->original_height);
+
+	region->x = x1;
+	region->y = y1;
+	region->width = MAX (x2 - x1, 0);
+	region->height = MAX (y2 - y1, 0);
+}
+
+
+static gboolean
+_gth_image_viewer_region_is_loaded (GthImageViewer *self,
+				    double          zoom)
+{
+	cairo_rectangle_int_t visible_region;
+
+	if ((self->priv->region_surface == NULL) || (self->priv->region_zoom < zoom))
+		return FALSE;
+
+	_gth_image_viewer_get_visible_region (self, 0.0, &visible_region);
+
+	return (visible_region.x >= self->priv->region_area.x)
+		&& (visible_region.y >= self->priv->region_area.y)
+		&& (visible_region.x + visible_region.width <= self->priv->region_area.x + self->priv->region_area.width)
+		&& (visible_region.y + visible_region.height <= self->priv->region_area.y + self->priv->region_area.height);
+}
+
+
+typedef struct {
+	GthImageViewer *viewer;
+	GCancellable   *cancellable;
+	double          zoom;
+} RegionData;
+
+
+static void
+region_data_free (RegionData *region_data)
+{
+	g_object_unref (region_data->cancellable);
+	g_object_unref (region_data->viewer);
+	g_free (region_data);
+}
+
+
+static void
+load_region_ready_cb (GObject      *source_object,
+		      GAsyncResult *result,
+		      gpointer      user_data)
+{
+	RegionData            *region_data = user_data;
+	GthImageViewer        *self = region_data->viewer;
+	cairo_surface_t       *surface;
+	cairo_rectangle_int_t  loaded_region;
+
+	surface = gth_image_load_region_finish (result, &loaded_region, NULL);
+
+	if (self->priv->region_cancellable == region_data->cancellable)
+		_g_clear_object (&self->priv->region_cancellable);
+
+	if (surface == NULL) {
+		region_data_free (region_data);
+		return;
+	}
+
+	_cairo_clear_surface (&self->priv->region_surface);
+	self->priv->region_surface = surface;
+	self->priv->region_area = loaded_region;
+	self->priv->region_zoom = region_data->zoom;
+	gtk_widget_queue_draw (GTK_WIDGET (self));
+
+	region_data_free (region_data);
+}
+
+
+static gboolean
+update_region_cb (gpointer user_data)
+{
+	GthImageViewer        *self = user_data;
+	double                 zoom;
+	cairo_rectangle_int_t  region;
+	RegionData            *region_data;
+
+	self->priv->region_id = 0;
+
+	zoom = _gth_image_viewer_get_region_zoom (self);
+	if (zoom == 0.0) {
+		_gth_image_viewer_clear_region (self);
+		return FALSE;
+	}
+
+	if (_gth_image_viewer_region_is_loaded (self, zoom))
+		return FALSE;
+
+	_gth_image_viewer_get_visible_region (self, REGION_MARGIN, &region);
+	if ((region.width == 0) || (region.height == 0))
+		return FALSE;
+
+	_gth_image_viewer_cancel_region_update (self);
+	self->priv->region_cancellable = g_cancellable_new ();
+
+	region_data = g_new0 (RegionData, 1);
+	region_data->viewer = g_object_ref (self);
+	region_data->cancellable = g_object_ref (self->priv->region_cancellable);
+	region_data->zoom = zoom;
+	gth_image_load_region_async (self->priv->image,
+				     &region,
+				     zoom,
+				     self->priv->region_cancellable,
+				     load_region_ready_cb,
+				     region_data);
+
+	return FALSE;
+}
+
+
+static void
+_gth_image_viewer_queue_region_update (GthImageViewer *self)
+{
+	if (! gth_image_get_can_load_region (self->priv->image))
+		return;
+
+	if (self->priv->region_id != 0)
+		g_source_remove (self->priv->region_id);
+	self->priv->region_id = g_timeout_add (REGION_UPDATE_DELAY, update_region_cb, self);
+}
+
+
 static void
 gth_image_viewer_finalize (GObject *object)
 {
@@ -150,6 +358,8 @@ gth_image_viewer_finalize (GObject *object)
 	if (self->priv->anim_id != 0)
 		g_source_remove (self->priv->anim_id);
 
+	_gth_image_viewer_clear_region (self);
+
 	if (self->priv->cursor != NULL)
 		g_object_unref (self->priv->cursor);
 
@@ -168,6 +378,7 @@ gth_image_viewer_finalize (GObject *object)
 
 	g_list_foreach (self->priv->painters, (GFunc) painter_data_free, NULL);
 	_g_object_unref (self->priv->tool);
+	gth_image_tile_cache_free (self->priv->tile_cache);
 
 	_g_clear_object (&self->priv->image);
 	_g_clear_object (&self->priv->animation);
@@ -367,6 +578,8 @@ set_zoom (GthImageViewer *self,
 		g_signal_emit (G_OBJECT (self), gth_image_viewer_signals[ZOOM_CHANGED], 0);
 	else
 		self->priv->skip_zoom_change = FALSE;
+
+	_gth_image_viewer_queue_region_update (self);
 }
 
 
@@ -708,6 +921,7 @@ gth_image_viewer_size_allocate (GtkWidget     *widget,
 	_gth_image_viewer_configure_vadjustment (self);
 	_gth_image_viewer_update_image_area (self);
 	gth_image_viewer_tool_size_allocate (self->priv->tool, allocation);
+	_gth_image_viewer_queue_region_update (self);
 }
 
 
@@ -914,6 +1128,8 @@ scroll_to (GthImageViewer *self,
 
 	window = gtk_widget_get_window (GTK_WIDGET (self));
 	gdk_window_scroll (window, -delta_x, -delta_y);
+
+	_gth_image_viewer_queue_region_update (self);
 }
 
 
@@ -1541,6 +1757,12 @@ gth_image_viewer_init (GthImageViewer *self)
 
 	self->priv->reset_scrollbars = TRUE;
 	self->priv->transparency_style = GTH_TRANSPARENCY_STYLE_CHECKERED;
+	self->priv->tile_cache = gth_image_tile_cache_new ();
+
+	self->priv->region_surface = NULL;
+	self->priv->region_zoom = 0.0;
+	self->priv->region_cancellable = NULL;
+	self->priv->region_id = 0;
 
 	gth_image_viewer_set_tool (self, NULL);
 
@@ -1694,6 +1916,8 @@ _set_animation (GthImageViewer     *self,
 {
 	g_return_if_fail (self != NULL);
 
+	_gth_image_viewer_clear_region (self);
+	gth_image_tile_cache_reset (self->priv->tile_cache);
 	_cairo_clear_surface (&self->priv->surface);
 	_cairo_clear_surface (&self->priv->iter_surface);
 	_g_clear_object (&self->priv->animation);
@@ -1731,6 +1955,9 @@ _set_surface (GthImageViewer  *self,
 	      int              original_height,
 	      gboolean         better_quality)
 {
+	_gth_image_viewer_clear_region (self);
+	gth_image_tile_cache_reset (self->priv->tile_cache);
+
 	if (self->priv->surface != surface) {
 		_cairo_clear_surface (&self->priv->surface);
 		self->priv->surface = cairo_surface_reference (surface);
@@ -1842,6 +2069,8 @@ gth_image_viewer_set_void (GthImageViewer *self)
 {
 	g_return_if_fail (self != NULL);
 
+	_gth_image_viewer_clear_region (self);
+	gth_image_tile_cache_reset (self->priv->tile_cache);
 	_cairo_clear_surface (&self->priv->surface);
 	_cairo_clear_surface (&self->priv->iter_surface);
 	_g_clear_object (&self->priv->animation);
@@ -2588,13 +2817,61 @@ gth_image_viewer_paint (GthImageViewer  *self,
 
 	cairo_rectangle (cr, 0, 0, self->visible_area.width, self->visible_area.height);
 	cairo_clip (cr);
-	cairo_scale (cr, zoom_level, zoom_level);
-	cairo_set_source_surface (cr, surface, dest_dx - src_dx, dest_dy - src_dy);
-	cairo_pattern_set_filter (cairo_get_source (cr), filter);
-	cairo_rectangle (cr, dest_dx, dest_dy, dwidth, dheight);
-	cairo_fill (cr);
+
+	if ((zoom_level != 1.0)
+	    && ! self->priv->is_animation
+	    && (surface == gth_image_viewer_get_current_image (self)))
+	{
+		/* reuse the tiles already scaled */
+
+		gth_image_tile_cache_paint (self->priv->tile_cache,
+					    cr,
+					    surface,
+					    zoom_level,
+					    filter,
+					    src_x,
+					    src_y,
+					    dest_x,
+					    dest_y,
+					    width,
+					    height);
+	}
+	else {
+		cairo_scale (cr, zoom_level, zoom_level);
+		cairo_set_source_surface (cr, surface, dest_dx - src_dx, dest_dy - src_dy);
+		cairo_pattern_set_filter (cairo_get_source (cr), filter);
+		cairo_rectangle (cr, dest_dx, dest_dy, dwidth, dheight);
+		cairo_fill (cr);
+	}
 
   	cairo_restore (cr);
+
+	/* paint the region loaded at a higher resolution over the image */
+
+	if ((self->priv->region_surface != NULL) && (surface == gth_image_viewer_get_current_image (self))) {
+		cairo_rectangle_int_t *area = &self->priv->region_area;
+		double                 region_zoom_x;
+		double                 region_zoom_y;
+
+		region_zoom_x = self->priv->zoom_level * area->width / cairo_image_surface_get_width (self->priv->region_surface);
+		region_zoom_y = self->priv->zoom_level * area->height / cairo_image_surface_get_height (self->priv->region_surface);
+
+		cairo_save (cr);
+
+		cairo_rectangle (cr, 0, 0, self->visible_area.width, self->visible_area.height);
+		cairo_clip (cr);
+		cairo_rectangle (cr, dest_x, dest_y, width, height);
+		cairo_clip (cr);
+		cairo_translate (cr,
+				 dest_x - src_x + area->x * self->priv->zoom_level,
+				 dest_y - src_y + area->y * self->priv->zoom_level);
+		cairo_scale (cr, region_zoom_x, region_zoom_y);
+		cairo_set_source_surface (cr, self->priv->region_surface, 0, 0);
+		cairo_pattern_set_filter (cairo_get_source (cr), filter);
+		cairo_paint (cr);
+
+		cairo_restore (cr);
+	}
 }
 
 
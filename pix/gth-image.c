@@ -45,6 +45,7 @@ struct _GthImagePrivate {
 		GdkPixbufAnimation *pixbuf_animation;
 	} data;
 	GthICCProfile *icc_data;
+	GthICCProfile *out_profile;
 };
 
 
@@ -84,6 +85,8 @@ _gth_image_free_icc_profile (GthImage *self)
 {
 	_g_object_unref (self->priv->icc_data);
 	self->priv->icc_data = NULL;
+	_g_object_unref (self->priv->out_profile);
+	self->priv->out_profile = NULL;
 }
 
 
@@ -118,6 +121,26 @@ base_set_zoom (GthImage *image,
 }
 
 
+static gboolean
+base_get_can_load_region (GthImage *image)
+{
+	return FALSE;
+}
+
+
+static cairo_surface_t *
+base_load_region (GthImage               *image,
+		  cairo_rectangle_int_t  *region,
+		  double                  zoom,
+		  cairo_rectangle_int_t  *loaded_region,
+		  GCancellable           *cancellable,
+		  GError                **error)
+{
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "");
+	return NULL;
+}
+
+
 static void
 gth_image_class_init (GthImageClass *klass)
 {
@@ -128,6 +151,8 @@ gth_image_class_init (GthImageClass *klass)
 
 	klass->get_is_zoomable = base_get_is_zoomable;
 	klass->set_zoom = base_set_zoom;
+	klass->get_can_load_region = base_get_can_load_region;
+	klass->load_region = base_load_region;
 }
 
 
@@ -138,6 +163,7 @@ gth_image_init (GthImage *self)
 	self->priv->format = GTH_IMAGE_FORMAT_CAIRO_SURFACE;
 	self->priv->data.surface = NULL;
 	self->priv->icc_data = NULL;
+	self->priv->out_profile = NULL;
 }
 
 
@@ -296,6 +322,36 @@ gth_image_get_original_size (GthImage *image,
 }
 
 
+/* Returns an estimate of the memory used by the pixels of the image. */
+gsize
+gth_image_get_memory_size (GthImage *image)
+{
+	gsize size = 0;
+
+	switch (image->priv->format) {
+	case GTH_IMAGE_FORMAT_CAIRO_SURFACE:
+		if (image->priv->data.surface != NULL)
+			size = (gsize) cairo_image_surface_get_stride (image->priv->data.surface) * cairo_image_surface_get_height (image->priv->data.surface);
+		break;
+
+	case GTH_IMAGE_FORMAT_GDK_PIXBUF:
+		if (image->priv->data.pixbuf != NULL)
+			size = gdk_pixbuf_get_byte_length (image->priv->data.pixbuf);
+		break;
+
+	case GTH_IMAGE_FORMAT_GDK_PIXBUF_ANIMATION:
+		if (image->priv->data.pixbuf_animation != NULL)
+			size = (gsize) gdk_pixbuf_animation_get_width (image->priv->data.pixbuf_animation) * gdk_pixbuf_animation_get_height (image->priv->data.pixbuf_animation) * 4;
+		break;
+
+	default:
+		break;
+	}
+
+	return size;
+}
+
+
 gboolean
 gth_image_get_is_zoomable (GthImage *self)
 {
@@ -465,30 +521,16 @@ gth_image_get_icc_profile (GthImage *image)
 /* -- gth_image_apply_icc_profile -- */
 
 
-void
-gth_image_apply_icc_profile (GthImage      *image,
-			     GthICCProfile *out_profile,
-			     GCancellable  *cancellable)
-{
 #if HAVE_LCMS2
 
-	cairo_surface_t *surface;
-	GthICCTransform *transform;
-
-	g_return_if_fail (image != NULL);
 
-	if (out_profile == NULL)
-		return;
-
-	if (image->priv->icc_data == NULL)
-		return;
-
-	if (image->priv->format != GTH_IMAGE_FORMAT_CAIRO_SURFACE)
-		return;
-
-	surface = gth_image_get_cairo_surface (image);
-	if (surface == NULL)
-		return;
+static void
+_gth_image_transform_surface (GthImage        *image,
+			      cairo_surface_t *surface,
+			      GthICCProfile   *out_profile,
+			      GCancellable    *cancellable)
+{
+	GthICCTransform *transform;
 
 	transform = gth_color_manager_get_transform (gth_main_get_default_color_manager (),
 			      	      	      	     image->priv->icc_data,
@@ -515,11 +557,47 @@ gth_image_apply_icc_profile (GthImage      *image,
 			surface_row += row_stride;
 		}
 		cairo_surface_mark_dirty (surface);
-
-		cairo_surface_destroy (surface);
 	}
 
 	_g_object_unref (transform);
+}
+
+
+#endif
+
+
+void
+gth_image_apply_icc_profile (GthImage      *image,
+			     GthICCProfile *out_profile,
+			     GCancellable  *cancellable)
+{
+#if HAVE_LCMS2
+
+	cairo_surface_t *surface;
+
+	g_return_if_fail (image != NULL);
+
+	if (out_profile == NULL)
+		return;
+
+	if (image->priv->icc_data == NULL)
+		return;
+
+	if (image->priv->format != GTH_IMAGE_FORMAT_CAIRO_SURFACE)
+		return;
+
+	surface = gth_image_get_cairo_surface (image);
+	if (surface == NULL)
+		return;
+
+	_gth_image_transform_surface (image, surface, out_profile, cancellable);
+	cairo_surface_destroy (surface);
+
+	/* remember the profile to transform the regions loaded later */
+
+	_g_object_ref (out_profile);
+	_g_object_unref (image->priv->out_profile);
+	image->priv->out_profile = out_profile;
 
 #endif
 }
@@ -595,3 +673,156 @@ gth_image_apply_icc_profile_finish (GAsyncResult  *result,
 {
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
+
+
+/* -- gth_image_load_region -- */
+
+
+/* Images that are too big to be kept in memory at full resolution can be
+ * loaded scaled and provide the regions required at higher zoom levels. */
+gboolean
+gth_image_get_can_load_region (GthImage *image)
+{
+	if (image == NULL)
+		return FALSE;
+	else
+		return GTH_IMAGE_GET_CLASS (image)->get_can_load_region (image);
+}
+
+
+/* @region is expressed in original image coordinates.  Returns a surface
+ * with the pixels of @region scaled by @zoom, at least.  The returned
+ * surface can cover a bigger area, the covered area is returned in
+ * @loaded_region, in original image coordinates as well.  Can be called
+ * from any thread. */
+cairo_surface_t *
+gth_image_load_region (GthImage               *image,
+		       cairo_rectangle_int_t  *region,
+		       double                  zoom,
+		       cairo_rectangle_int_t  *loaded_region,
+		       GCancellable           *cancellable,
+		       GError                **error)
+{
+	cairo_surface_t *surface;
+
+	g_return_val_if_fail (image != NULL, NULL);
+	g_return_val_if_fail (region != NULL, NULL);
+	g_return_val_if_fail (loaded_region != NULL, NULL);
+
+	surface = GTH_IMAGE_GET_CLASS (image)->load_region (image,
+							    region,
+							    zoom,
+							    loaded_region,
+							    cancellable,
+							    error);
+
+#if HAVE_LCMS2
+	if ((surface != NULL)
+	    && (image->priv->icc_data != NULL)
+	    && (image->priv->out_profile != NULL))
+	{
+		_gth_image_transform_surface (image, surface, image->priv->out_profile, cancellable);
+	}
+#endif
+
+	return surface;
+}
+
+
+typedef struct {
+	GthImage              *image;
+	cairo_rectangle_int_t  region;
+	double                 zoom;
+	cairo_rectangle_int_t  loaded_region;
+} LoadRegionData;
+
+
+static void
+load_region_data_free (gpointer user_data)
+{
+	LoadRegionData *lrd = user_data;
+
+	g_object_unref (lrd->image);
+	g_free (lrd);
+}
+
+
+static void
+_gth_image_load_region_thread (GTask        *task,
+			       gpointer      source_object,
+			       gpointer      task_data,
+			       GCancellable *cancellable)
+{
+	LoadRegionData  *lrd;
+	cairo_surface_t *surface;
+	GError          *error = NULL;
+
+	lrd = g_task_get_task_data (task);
+	surface = gth_image_load_region (lrd->image,
+					 &lrd->region,
+					 lrd->zoom,
+					 &lrd->loaded_region,
+					 cancellable,
+					 &error);
+
+	if ((surface != NULL) && (cancellable != NULL) && g_cancellable_is_cancelled (cancellable)) {
+		cairo_surface_destroy (surface);
+		surface = NULL;
+		error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "");
+	}
+
+	if (surface == NULL) {
+		if (error == NULL)
+			error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED, "");
+		g_task_return_error (task, error);
+		return;
+	}
+
+	g_task_return_pointer (task, surface, (GDestroyNotify) cairo_surface_destroy);
+}
+
+
+void
+gth_image_load_region_async (GthImage              *image,
+			     cairo_rectangle_int_t *region,
+			     double                 zoom,
+			     GCancellable          *cancellable,
+			     GAsyncReadyCallback    callback,
+			     gpointer               user_data)
+{
+	GTask          *task;
+	LoadRegionData *lrd;
+
+	g_return_if_fail (image != NULL);
+	g_return_if_fail (region != NULL);
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+
+	lrd = g_new0 (LoadRegionData, 1);
+	lrd->image = g_object_ref (image);
+	lrd->region = *region;
+	lrd->zoom = zoom;
+	g_task_set_task_data (task, lrd, load_region_data_free);
+	g_task_run_in_thread (task, _gth_image_load_region_thread);
+
+	g_object_unref (task);
+}
+
+
+cairo_surface_t *
+gth_image_load_region_finish (GAsyncResult           *result,
+			      cairo_rectangle_int_t  *loaded_region,
+			      GError                **error)
+{
+	cairo_surface_t *surface;
+
+	surface = g_task_propagate_pointer (G_TASK (result), error);
+	if ((surface != NULL) && (loaded_region != NULL)) {
+		LoadRegionData *lrd;
+
+		lrd = g_task_get_task_data (G_TASK (result));
+		*loaded_region = lrd->loaded_region;
+	}
+
+	return surface;
+}
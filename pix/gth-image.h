@@ -65,6 +65,15 @@ struct _GthImageClass
 				       double    zoom,
 				       int      *original_width,
 				       int      *original_height);
+	gboolean  (*get_can_load_region)
+				      (GthImage *image);
+	cairo_surface_t *
+		  (*load_region)      (GthImage               *image,
+				       cairo_rectangle_int_t  *region,
+				       double                  zoom,
+				       cairo_rectangle_int_t  *loaded_region,
+				       GCancellable           *cancellable,
+				       GError                **error);
 };
 
 
@@ -90,6 +99,7 @@ cairo_surface_t *     gth_image_get_cairo_surface           (GthImage
 gboolean              gth_image_get_original_size	    (GthImage           *image,
 							     int                *width,
 							     int                *height);
+gsize                 gth_image_get_memory_size             (GthImage           *image);
 gboolean              gth_image_get_is_zoomable             (GthImage           *image);
 gboolean              gth_image_get_is_null                 (GthImage           *image);
 gboolean              gth_image_set_zoom                    (GthImage           *image,
@@ -116,6 +126,22 @@ void		      gth_image_apply_icc_profile_async     (GthImage           *image,
 							     gpointer            user_data);
 gboolean	      gth_image_apply_icc_profile_finish    (GAsyncResult       *result,
 							     GError            **error);
+gboolean              gth_image_get_can_load_region         (GthImage           *image);
+cairo_surface_t *     gth_image_load_region                 (GthImage           *image,
+							     cairo_rectangle_int_t *region,
+							     double              zoom,
+							     cairo_rectangle_int_t *loaded_region,
+							     GCancellable       *cancellable,
+							     GError            **error);
+void                  gth_image_load_region_async           (GthImage           *image,
+							     cairo_rectangle_int_t *region,
+							     double              zoom,
+							     GCancellable       *cancellable,
+							     GAsyncReadyCallback callback,
+							     gpointer            user_data);
+cairo_surface_t *     gth_image_load_region_finish          (GAsyncResult       *result,
+							     cairo_rectangle_int_t *loaded_region,
+							     GError            **error);
 
 G_END_DECLS
 
@@ -40,29 +40,39 @@ gth_file_data_cmp_filename (GthFileData *a,
 }
 
 
+static void
+gth_file_data_key_filename (GthFileData *file_data,
+			    GthSortKey  *key)
+{
+	key->name = gth_file_data_get_filename_sort_key (file_data);
+}
+
+
+static void
+gth_file_data_key_uri (GthFileData *file_data,
+		       GthSortKey  *key)
+{
+	gth_sort_key_set_path (key,
+			       g_file_get_uri (file_data->file),
+			       gth_file_data_get_filename_sort_key (file_data));
+}
+
+
+/* The files are ordered by folder and then by name, as the sort key. */
 static int
 gth_file_data_cmp_uri (GthFileData *a,
 		       GthFileData *b)
 {
-	GFile *parent_a;
-	GFile *parent_b;
-	int    result;
-
-	parent_a = g_file_get_parent (a->file);
-	parent_b = g_file_get_parent (b->file);
-	if (! g_file_equal (parent_a, parent_b)) {
-		char *uri_a;
-		char *uri_b;
-
-		uri_a = g_file_get_uri (a->file);
-		uri_b = g_file_get_uri (b->file);
-		result = strcmp (uri_a, uri_b);
-
-		g_free (uri_b);
-		g_free (uri_a);
-	}
-	else
-		result = gth_file_data_cmp_filename (a, b);
+	GthSortKey key_a = { 0 };
+	GthSortKey key_b = { 0 };
+	int        result;
+
+	gth_file_data_key_uri (a, &key_a);
+	gth_file_data_key_uri (b, &key_b);
+	result = gth_sort_key_compare (&key_a, &key_b);
+
+	g_free (key_b.data);
+	g_free (key_a.data);
 
 	return result;
 }
@@ -86,6 +96,14 @@ gth_file_data_cmp_filesize (GthFileData *a,
 }
 
 
+static void
+gth_file_data_key_filesize (GthFileData *file_data,
+			    GthSortKey  *key)
+{
+	key->number = g_file_info_get_size (file_data->info);
+}
+
+
 static int
 gth_file_data_cmp_modified_time (GthFileData *a,
 			         GthFileData *b)
@@ -104,6 +122,18 @@ gth_file_data_cmp_modified_time (GthFileData *a,
 }
 
 
+static void
+gth_file_data_key_modified_time (GthFileData *file_data,
+				 GthSortKey  *key)
+{
+	GTimeVal *t;
+
+	t = gth_file_data_get_modification_time (file_data);
+	key->number = ((gint64) t->tv_sec * G_USEC_PER_SEC) + t->tv_usec;
+	key->name = gth_file_data_get_filename_sort_key (file_data);
+}
+
+
 static int
 gth_general_data_cmp_dimensions (GthFileData *a,
 				 GthFileData *b)
@@ -126,6 +156,21 @@ gth_general_data_cmp_dimensions (GthFileData *a,
 	return result;
 }
 
+
+static void
+gth_general_data_key_dimensions (GthFileData *file_data,
+				 GthSortKey  *key)
+{
+	int width;
+	int height;
+
+	width = g_file_info_get_attribute_int32 (file_data->info, "frame::width");
+	height = g_file_info_get_attribute_int32 (file_data->info, "frame::height");
+	key->number = (gint64) width * height;
+	key->name = gth_file_data_get_filename_sort_key (file_data);
+}
+
+
 static int
 gth_general_data_cmp_aspect_ratio (GthFileData *a,
 				   GthFileData *b)
@@ -162,14 +207,33 @@ gth_general_data_cmp_aspect_ratio (GthFileData *a,
 }
 
 
+static void
+gth_general_data_key_aspect_ratio (GthFileData *file_data,
+				   GthSortKey  *key)
+{
+	int   width;
+	int   height;
+	float ratio;
+
+	width = g_file_info_get_attribute_int32 (file_data->info, "frame::width");
+	height = g_file_info_get_attribute_int32 (file_data->info, "frame::height");
+	if (height == 0)
+		height = 1;
+	ratio = (float) width / (float) height;
+
+	key->number = gth_sort_key_number_from_double (ratio);
+	key->name = gth_file_data_get_filename_sort_key (file_data);
+}
+
+
 GthFileDataSort default_sort_types[] = {
-	{ "file::name", N_("file name"), "standard::display-name", gth_file_data_cmp_filename },
-	{ "file::path", N_("file path"), "standard::display-name", gth_file_data_cmp_uri },
-	{ "file::size", N_("file size"), "standard::size", gth_file_data_cmp_filesize },
-	{ "file::mtime", N_("file modified date"), "time::modified,time::modified-usec", gth_file_data_cmp_modified_time },
-	{ "general::unsorted", N_("no sorting"), "", NULL },
-	{ "general::dimensions", N_("dimensions"), "frame::width,frame::height", gth_general_data_cmp_dimensions },
-	{ "frame::aspect-ratio", N_("aspect ratio"), "frame::width,frame::height", gth_general_data_cmp_aspect_ratio },
+	{ "file::name", N_("file name"), "standard::display-name", gth_file_data_cmp_filename, gth_file_data_key_filename },
+	{ "file::path", N_("file path"), "standard::display-name", gth_file_data_cmp_uri, gth_file_data_key_uri },
+	{ "file::size", N_("file size"), "standard::size", gth_file_data_cmp_filesize, gth_file_data_key_filesize },
+	{ "file::mtime", N_("file modified date"), "time::modified,time::modified-usec", gth_file_data_cmp_modified_time, gth_file_data_key_modified_time },
+	{ "general::unsorted", N_("no sorting"), "", NULL, NULL },
+	{ "general::dimensions", N_("dimensions"), "frame::width,frame::height", gth_general_data_cmp_dimensions, gth_general_data_key_dimensions },
+	{ "frame::aspect-ratio", N_("aspect ratio"), "frame::width,frame::height", gth_general_data_cmp_aspect_ratio, gth_general_data_key_aspect_ratio },
 };
 
 
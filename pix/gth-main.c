@@ -115,6 +115,8 @@ struct _GthMainPrivate {
 	GthFilterFile       *filters;
 	GthTagsFile         *tags;
 	GthMonitor          *monitor;
+	GthMetadataCache    *metadata_cache;
+	GthThumbnailPack    *thumbnail_pack;
 	GthExtensionManager *extension_manager;
 	GthColorManager     *color_manager;
 	XAppDarkModeManager *dark_mode_manager;
@@ -157,6 +159,14 @@ gth_main_finalize (GObject *object)
 	if (gth_main->priv->bookmarks != NULL)
 		g_bookmark_file_free (gth_main->priv->bookmarks);
 
+	if (gth_main->priv->metadata_cache != NULL) {
+		g_signal_handlers_disconnect_by_data (gth_main->priv->monitor, gth_main->priv->metadata_cache);
+		gth_metadata_cache_free (gth_main->priv->metadata_cache);
+	}
+	if (gth_main->priv->thumbnail_pack != NULL) {
+		g_signal_handlers_disconnect_by_data (gth_main->priv->monitor, gth_main->priv->thumbnail_pack);
+		gth_thumbnail_pack_free (gth_main->priv->thumbnail_pack);
+	}
 	_g_object_unref (gth_main->priv->monitor);
 	_g_object_unref (gth_main->priv->extension_manager);
 	_g_object_unref (gth_main->priv->color_manager);
@@ -203,6 +213,8 @@ gth_main_init (GthMain *main)
 	main->priv->filters = NULL;
 	main->priv->tags = NULL;
 	main->priv->monitor = NULL;
+	main->priv->metadata_cache = NULL;
+	main->priv->thumbnail_pack = NULL;
 	main->priv->extension_manager = gth_extension_manager_new ();
 	main->priv->color_manager = NULL;
 
@@ -1339,6 +1351,166 @@ gth_main_get_default_monitor (void)
 }
 
 
+/* -- gth_main_get_default_metadata_cache -- */
+
+
+static void
+metadata_cache_folder_changed_cb (GthMonitor      *monitor,
+				  GFile           *parent,
+				  GList           *list,
+				  int              position,
+				  GthMonitorEvent  event,
+				  gpointer         user_data)
+{
+	GthMetadataCache *cache = user_data;
+	GList            *scan;
+
+	for (scan = list; scan; scan = scan->next)
+		gth_metadata_cache_invalidate_async (cache, G_FILE (scan->data));
+}
+
+
+static void
+metadata_cache_file_renamed_cb (GthMonitor *monitor,
+				GFile      *file,
+				GFile      *new_file,
+				gpointer    user_data)
+{
+	GthMetadataCache *cache = user_data;
+
+	gth_metadata_cache_invalidate_async (cache, file);
+	gth_metadata_cache_invalidate_async (cache, new_file);
+}
+
+
+static void
+metadata_cache_metadata_changed_cb (GthMonitor  *monitor,
+				    GthFileData *file_data,
+				    gpointer     user_data)
+{
+	GthMetadataCache *cache = user_data;
+
+	gth_metadata_cache_invalidate_async (cache, file_data->file);
+}
+
+
+static void
+_gth_main_create_metadata_cache (void)
+{
+	GFile      *directory;
+	GthMonitor *monitor;
+
+	if (Main->priv->metadata_cache != NULL)
+		return;
+
+	directory = gth_user_dir_get_dir_for_write (GTH_DIR_CACHE, PIX_DIR, METADATA_CACHE_DIR, NULL);
+	Main->priv->metadata_cache = gth_metadata_cache_new (directory);
+
+	monitor = gth_main_get_default_monitor ();
+	g_signal_connect (monitor,
+			  "folder-changed",
+			  G_CALLBACK (metadata_cache_folder_changed_cb),
+			  Main->priv->metadata_cache);
+	g_signal_connect (monitor,
+			  "file-renamed",
+			  G_CALLBACK (metadata_cache_file_renamed_cb),
+			  Main->priv->metadata_cache);
+	g_signal_connect (monitor,
+			  "metadata-changed",
+			  G_CALLBACK (metadata_cache_metadata_changed_cb),
+			  Main->priv->metadata_cache);
+
+	g_object_unref (directory);
+}
+
+
+/* Returns NULL if the cache is not active, that is before the extensions
+ * are activated. */
+GthMetadataCache *
+gth_main_get_default_metadata_cache (void)
+{
+	return Main->priv->metadata_cache;
+}
+
+
+/* -- gth_main_get_default_thumbnail_pack -- */
+
+
+static void
+thumbnail_pack_folder_changed_cb (GthMonitor      *monitor,
+				  GFile           *parent,
+				  GList           *list,
+				  int              position,
+				  GthMonitorEvent  event,
+				  gpointer         user_data)
+{
+	GthThumbnailPack *pack = user_data;
+	GList            *scan;
+
+	if ((event != GTH_MONITOR_EVENT_DELETED) && (event != GTH_MONITOR_EVENT_CHANGED))
+		return;
+
+	for (scan = list; scan; scan = scan->next)
+		gth_thumbnail_pack_invalidate (pack, G_FILE (scan->data));
+}
+
+
+static void
+thumbnail_pack_file_renamed_cb (GthMonitor *monitor,
+				GFile      *file,
+				GFile      *new_file,
+				gpointer    user_data)
+{
+	GthThumbnailPack *pack = user_data;
+
+	gth_thumbnail_pack_invalidate (pack, file);
+	gth_thumbnail_pack_invalidate (pack, new_file);
+}
+
+
+static void
+_gth_main_create_thumbnail_pack (void)
+{
+	GSettings  *settings;
+	GFile      *directory;
+	GthMonitor *monitor;
+
+	if (Main->priv->thumbnail_pack != NULL)
+		return;
+
+	settings = g_settings_new (PIX_BROWSER_SCHEMA);
+	if (! g_settings_get_boolean (settings, PREF_BROWSER_PACKED_THUMBNAILS)) {
+		g_object_unref (settings);
+		return;
+	}
+
+	directory = gth_user_dir_get_dir_for_write (GTH_DIR_CACHE, PIX_DIR, THUMBNAIL_PACK_DIR, NULL);
+	Main->priv->thumbnail_pack = gth_thumbnail_pack_new (directory);
+
+	monitor = gth_main_get_default_monitor ();
+	g_signal_connect (monitor,
+			  "folder-changed",
+			  G_CALLBACK (thumbnail_pack_folder_changed_cb),
+			  Main->priv->thumbnail_pack);
+	g_signal_connect (monitor,
+			  "file-renamed",
+			  G_CALLBACK (thumbnail_pack_file_renamed_cb),
+			  Main->priv->thumbnail_pack);
+
+	g_object_unref (directory);
+	g_object_unref (settings);
+}
+
+
+/* Returns NULL if the packed thumbnails are disabled, or before the
+ * extensions are activated. */
+GthThumbnailPack *
+gth_main_get_default_thumbnail_pack (void)
+{
+	return Main->priv->thumbnail_pack;
+}
+
+
 GthExtensionManager *
 gth_main_get_default_extension_manager (void)
 {
@@ -1452,6 +1624,9 @@ gth_main_activate_extensions (void)
 	_g_string_list_free (ordered_extensions);
 	g_strfreev (actived_extensions);
 	g_strfreev (user_actived_extensions);
+
+	_gth_main_create_metadata_cache ();
+	_gth_main_create_thumbnail_pack ();
 }
 
 
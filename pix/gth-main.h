@@ -33,6 +33,8 @@
 #include "gth-hook.h"
 #include "gth-image.h"
 #include "gth-image-saver.h"
+#include "gth-metadata-cache.h"
+#include "gth-thumbnail-pack.h"
 #include "gth-metadata-provider.h"
 #include "gth-monitor.h"
 #include "gth-shortcut.h"
@@ -126,6 +128,8 @@ GthTagsFile *          gth_main_get_default_tag_file          (void);
 char **                gth_main_get_all_tags                  (void);
 void                   gth_main_tags_changed                  (void);
 GthMonitor *           gth_main_get_default_monitor           (void);
+GthMetadataCache *     gth_main_get_default_metadata_cache    (void);
+GthThumbnailPack *     gth_main_get_default_thumbnail_pack    (void);
 GthExtensionManager *  gth_main_get_default_extension_manager (void);
 GthColorManager *      gth_main_get_default_color_manager     (void);
 void                   gth_main_register_default_hooks        (void);
@@ -0,0 +1,1211 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "glib-utils.h"
+#include "gth-metadata.h"
+#include "gth-metadata-cache.h"
+#include "gth-string-list.h"
+
+
+#define CACHE_FORMAT_VERSION 2
+#define MAX_LOADED_FOLDERS 16
+#define SAVE_DELAY (5 * G_USEC_PER_SEC)
+#define VALUES_TYPE "a{s(yv)}"
+#define ENTRY_TYPE "(xtxbas" VALUES_TYPE ")"
+#define ENTRIES_TYPE "a{s" ENTRY_TYPE "}"
+#define FOLDER_TYPE "(uxs" ENTRIES_TYPE ")"
+#define METADATA_TYPE "(msmsmsmsmsbas)"
+
+
+/* Attributes in these namespaces describe the file itself or the state of
+ * the application, they are not produced by the metadata providers. */
+static const char *volatile_namespaces[] = {
+	"standard::",
+	"etag::",
+	"id::",
+	"access::",
+	"mountable::",
+	"time::",
+	"unix::",
+	"dos::",
+	"owner::",
+	"thumbnail::",
+	"preview::",
+	"filesystem::",
+	"gvfs::",
+	"selinux::",
+	"trash::",
+	"recent::",
+	"xattr::",
+	"xattr-sys::",
+	"metadata::",
+	"gth::",
+	"pix::",
+	NULL
+};
+
+
+/* The sidecars of a file are checked again only when the folder changes:
+ * sidecars_checked is the folder generation of the last check. */
+typedef struct {
+	gint64     mtime;
+	guint64    size;
+	gint64     sidecars_mtime;
+	guint      sidecars_checked;
+	char     **attributes_mask_v;
+	GVariant  *values;
+} CacheEntry;
+
+
+/* The generation changes when the modification time of the folder
+ * changes, that is when a sidecar can have been added, removed or
+ * replaced. */
+typedef struct {
+	char       *uri;
+	char       *filename;
+	GHashTable *entries;
+	gint64      mtime;
+	guint       generation;
+	gboolean    dirty;
+	gint64      last_save;
+} CacheFolder;
+
+
+struct _GthMetadataCache {
+	GMutex       mutex;
+	char        *directory;
+	GHashTable  *folders;
+	GQueue      *folders_lru;
+	GThreadPool *invalidate_pool;
+	GHashTable  *pending;		/* uri -> number of pending invalidations */
+	guint        hits;
+	guint        misses;
+};
+
+
+static CacheEntry *
+cache_entry_new (gint64     mtime,
+		 guint64    size,
+		 gint64     sidecars_mtime,
+		 guint      sidecars_checked,
+		 char     **attributes_mask_v,
+		 GVariant  *values)
+{
+	CacheEntry *entry;
+
+	entry = g_new0 (CacheEntry, 1);
+	entry->mtime = mtime;
+	entry->size = size;
+	entry->sidecars_mtime = sidecars_mtime;
+	entry->sidecars_checked = sidecars_checked;
+	entry->attributes_mask_v = attributes_mask_v;
+	entry->values = values;
+
+	return entry;
+}
+
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_strfreev (entry->attributes_mask_v);
+	g_variant_unref (entry->values);
+	g_free (entry);
+}
+
+
+static gboolean
+cache_entry_is_valid (CacheEntry *entry,
+		      gint64      mtime,
+		      guint64     size)
+{
+	return (entry->mtime == mtime) && (entry->size == size);
+}
+
+
+static gboolean
+cache_entry_covers (CacheEntry  *entry,
+		    char       **attributes_mask_v)
+{
+	int i;
+
+	for (i = 0; attributes_mask_v[i] != NULL; i++) {
+		if (attributes_mask_v[i][0] == '\0')
+			continue;
+		if (! _g_strv_contains (entry->attributes_mask_v, attributes_mask_v[i]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* -- serialization -- */
+
+
+static gboolean
+utf8_validate_or_null (const char *value)
+{
+	return (value == NULL) || g_utf8_validate (value, -1, NULL);
+}
+
+
+static gboolean
+attribute_is_cacheable (const char *attribute)
+{
+	int i;
+
+	for (i = 0; volatile_namespaces[i] != NULL; i++) {
+		if (g_str_has_prefix (attribute, volatile_namespaces[i]))
+			return FALSE;
+	}
+
+	return g_utf8_validate (attribute, -1, NULL);
+}
+
+
+static GVariant *
+string_list_to_variant (GList *list)
+{
+	GVariantBuilder  builder;
+	GList           *scan;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+	for (scan = list; scan; scan = scan->next) {
+		if (! g_utf8_validate (scan->data, -1, NULL)) {
+			g_variant_builder_clear (&builder);
+			return NULL;
+		}
+		g_variant_builder_add (&builder, "s", scan->data);
+	}
+
+	return g_variant_builder_end (&builder);
+}
+
+
+static GVariant *
+metadata_to_variant (GthMetadata *metadata)
+{
+	char      *id;
+	char      *description;
+	char      *raw;
+	char      *formatted;
+	char      *value_type;
+	gboolean   has_list;
+	GVariant  *list;
+	GVariant  *variant;
+
+	g_object_get (metadata,
+		      "id", &id,
+		      "description", &description,
+		      "raw", &raw,
+		      "formatted", &formatted,
+		      "value-type", &value_type,
+		      NULL);
+
+	has_list = (gth_metadata_get_data_type (metadata) == GTH_METADATA_TYPE_STRING_LIST);
+	if (has_list)
+		list = string_list_to_variant (gth_string_list_get_list (gth_metadata_get_string_list (metadata)));
+	else
+		list = g_variant_new_strv (NULL, 0);
+
+	variant = NULL;
+	if ((list != NULL)
+	    && utf8_validate_or_null (id)
+	    && utf8_validate_or_null (description)
+	    && utf8_validate_or_null (raw)
+	    && utf8_validate_or_null (formatted)
+	    && utf8_validate_or_null (value_type))
+	{
+		variant = g_variant_new ("(msmsmsmsmsb@as)",
+					 id,
+					 description,
+					 raw,
+					 formatted,
+					 value_type,
+					 has_list,
+					 list);
+	}
+	else if (list != NULL)
+		g_variant_unref (g_variant_ref_sink (list));
+
+	g_free (id);
+	g_free (description);
+	g_free (raw);
+	g_free (formatted);
+	g_free (value_type);
+
+	return variant;
+}
+
+
+static GthMetadata *
+metadata_from_variant (GVariant *variant)
+{
+	const char  *id;
+	const char  *description;
+	const char  *raw;
+	const char  *formatted;
+	const char  *value_type;
+	gboolean     has_list;
+	GVariant    *list_variant;
+	GthMetadata *metadata;
+
+	g_variant_get (variant,
+		       "(m&sm&sm&sm&sm&sb@as)",
+		       &id,
+		       &description,
+		       &raw,
+		       &formatted,
+		       &value_type,
+		       &has_list,
+		       &list_variant);
+
+	metadata = g_object_new (GTH_TYPE_METADATA,
+				 "id", id,
+				 "description", description,
+				 "raw", raw,
+				 "formatted", formatted,
+				 "value-type", value_type,
+				 NULL);
+
+	if (has_list) {
+		GList         *list = NULL;
+		GVariantIter   iter;
+		const char    *value;
+		GthStringList *string_list;
+
+		g_variant_iter_init (&iter, list_variant);
+		while (g_variant_iter_next (&iter, "&s", &value))
+			list = g_list_prepend (list, (char *) value);
+		list = g_list_reverse (list);
+
+		string_list = gth_string_list_new (list);
+		g_object_set (metadata, "string-list", string_list, NULL);
+
+		g_object_unref (string_list);
+		g_list_free (list);
+	}
+
+	g_variant_unref (list_variant);
+
+	return metadata;
+}
+
+
+GVariant *
+_g_file_info_attribute_to_variant (GFileInfo  *info,
+				   const char *attribute)
+{
+	GFileAttributeType  type;
+	GVariant           *value;
+	const char         *string;
+	char              **stringv;
+	GObject            *object;
+	int                 i;
+
+	value = NULL;
+	type = g_file_info_get_attribute_type (info, attribute);
+	switch (type) {
+	case G_FILE_ATTRIBUTE_TYPE_STRING:
+		string = g_file_info_get_attribute_string (info, attribute);
+		if ((string != NULL) && g_utf8_validate (string, -1, NULL))
+			value = g_variant_new_string (string);
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_BYTE_STRING:
+		string = g_file_info_get_attribute_byte_string (info, attribute);
+		if (string != NULL)
+			value = g_variant_new_bytestring (string);
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_BOOLEAN:
+		value = g_variant_new_boolean (g_file_info_get_attribute_boolean (info, attribute));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_UINT32:
+		value = g_variant_new_uint32 (g_file_info_get_attribute_uint32 (info, attribute));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_INT32:
+		value = g_variant_new_int32 (g_file_info_get_attribute_int32 (info, attribute));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_UINT64:
+		value = g_variant_new_uint64 (g_file_info_get_attribute_uint64 (info, attribute));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_INT64:
+		value = g_variant_new_int64 (g_file_info_get_attribute_int64 (info, attribute));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_STRINGV:
+		stringv = g_file_info_get_attribute_stringv (info, attribute);
+		if (stringv == NULL)
+			break;
+		for (i = 0; stringv[i] != NULL; i++)
+			if (! g_utf8_validate (stringv[i], -1, NULL))
+				break;
+		if (stringv[i] == NULL)
+			value = g_variant_new_strv ((const char * const *) stringv, -1);
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_OBJECT:
+		object = g_file_info_get_attribute_object (info, attribute);
+		if (GTH_IS_METADATA (object))
+			value = metadata_to_variant (GTH_METADATA (object));
+		else if (GTH_IS_STRING_LIST (object))
+			value = string_list_to_variant (gth_string_list_get_list (GTH_STRING_LIST (object)));
+		break;
+
+	default:
+		break;
+	}
+
+	if (value == NULL)
+		return NULL;
+
+	return g_variant_new ("(yv)", (guchar) type, value);
+}
+
+
+void
+_g_file_info_set_attribute_from_variant (GFileInfo  *info,
+					 const char *attribute,
+					 GVariant   *variant)
+{
+	guchar    type;
+	GVariant *value;
+
+	g_variant_get (variant, "(yv)", &type, &value);
+
+	switch (type) {
+	case G_FILE_ATTRIBUTE_TYPE_STRING:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+			g_file_info_set_attribute_string (info, attribute, g_variant_get_string (value, NULL));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_BYTE_STRING:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING))
+			g_file_info_set_attribute_byte_string (info, attribute, g_variant_get_bytestring (value));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_BOOLEAN:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+			g_file_info_set_attribute_boolean (info, attribute, g_variant_get_boolean (value));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_UINT32:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32))
+			g_file_info_set_attribute_uint32 (info, attribute, g_variant_get_uint32 (value));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_INT32:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT32))
+			g_file_info_set_attribute_int32 (info, attribute, g_variant_get_int32 (value));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_UINT64:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT64))
+			g_file_info_set_attribute_uint64 (info, attribute, g_variant_get_uint64 (value));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_INT64:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT64))
+			g_file_info_set_attribute_int64 (info, attribute, g_variant_get_int64 (value));
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_STRINGV:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY)) {
+			char **stringv;
+
+			stringv = g_variant_dup_strv (value, NULL);
+			g_file_info_set_attribute_stringv (info, attribute, stringv);
+			g_strfreev (stringv);
+		}
+		break;
+
+	case G_FILE_ATTRIBUTE_TYPE_OBJECT:
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE (METADATA_TYPE))) {
+			GthMetadata *metadata;
+
+			metadata = metadata_from_variant (value);
+			g_file_info_set_attribute_object (info, attribute, G_OBJECT (metadata));
+			g_object_unref (metadata);
+		}
+		else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY)) {
+			GList         *list = NULL;
+			GVariantIter   iter;
+			const char    *string;
+			GthStringList *string_list;
+
+			g_variant_iter_init (&iter, value);
+			while (g_variant_iter_next (&iter, "&s", &string))
+				list = g_list_prepend (list, (char *) string);
+			list = g_list_reverse (list);
+
+			string_list = gth_string_list_new (list);
+			g_file_info_set_attribute_object (info, attribute, G_OBJECT (string_list));
+
+			g_object_unref (string_list);
+			g_list_free (list);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	g_variant_unref (value);
+}
+
+
+/* Returns the cacheable attributes of @info, or NULL if one of them cannot
+ * be saved, in which case the file is not cached at all. */
+static GVariant *
+info_to_variant (GFileInfo *info)
+{
+	GVariantBuilder   builder;
+	char            **attributes;
+	gboolean          valid;
+	int               i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE (VALUES_TYPE));
+	attributes = g_file_info_list_attributes (info, NULL);
+	valid = TRUE;
+	for (i = 0; valid && (attributes[i] != NULL); i++) {
+		GVariant *value;
+
+		if (! attribute_is_cacheable (attributes[i]))
+			continue;
+
+		value = _g_file_info_attribute_to_variant (info, attributes[i]);
+		if (value != NULL)
+			g_variant_builder_add (&builder, "{s@(yv)}", attributes[i], value);
+		else
+			valid = FALSE;
+	}
+	g_strfreev (attributes);
+
+	if (! valid) {
+		g_variant_builder_clear (&builder);
+		return NULL;
+	}
+
+	return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+
+static void
+restore_info_from_variant (GFileInfo *info,
+			   GVariant  *values)
+{
+	GVariantIter  iter;
+	const char   *attribute;
+	GVariant     *value;
+
+	g_variant_iter_init (&iter, values);
+	while (g_variant_iter_next (&iter, "{&s@(yv)}", &attribute, &value)) {
+		_g_file_info_set_attribute_from_variant (info, attribute, value);
+		g_variant_unref (value);
+	}
+}
+
+
+/* Adds to @values the attributes of @old_values it doesn't already have. */
+static GVariant *
+merge_values (GVariant *values,
+	      GVariant *old_values)
+{
+	GHashTable      *attributes;
+	GVariantBuilder  builder;
+	GVariantIter     iter;
+	const char      *attribute;
+	GVariant        *value;
+
+	attributes = g_hash_table_new (g_str_hash, g_str_equal);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE (VALUES_TYPE));
+
+	g_variant_iter_init (&iter, values);
+	while (g_variant_iter_next (&iter, "{&s@(yv)}", &attribute, &value)) {
+		g_hash_table_add (attributes, (gpointer) attribute);
+		g_variant_builder_add (&builder, "{s@(yv)}", attribute, value);
+		g_variant_unref (value);
+	}
+
+	g_variant_iter_init (&iter, old_values);
+	while (g_variant_iter_next (&iter, "{&s@(yv)}", &attribute, &value)) {
+		if (! g_hash_table_contains (attributes, attribute))
+			g_variant_builder_add (&builder, "{s@(yv)}", attribute, value);
+		g_variant_unref (value);
+	}
+
+	g_hash_table_unref (attributes);
+
+	return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+
+static char **
+merge_attributes_mask (char **mask_v,
+		       char **old_mask_v)
+{
+	GPtrArray *array;
+	int        i;
+
+	array = g_ptr_array_new ();
+	for (i = 0; (old_mask_v != NULL) && (old_mask_v[i] != NULL); i++)
+		g_ptr_array_add (array, g_strdup (old_mask_v[i]));
+	for (i = 0; mask_v[i] != NULL; i++) {
+		if ((mask_v[i][0] != '\0') && ((old_mask_v == NULL) || ! _g_strv_contains (old_mask_v, mask_v[i])))
+			g_ptr_array_add (array, g_strdup (mask_v[i]));
+	}
+	g_ptr_array_add (array, NULL);
+
+	return (char **) g_ptr_array_free (array, FALSE);
+}
+
+
+/* -- CacheFolder -- */
+
+
+static CacheFolder *
+cache_folder_new (GthMetadataCache *cache,
+		  const char       *uri)
+{
+	CacheFolder *folder;
+	char        *name;
+
+	folder = g_new0 (CacheFolder, 1);
+	folder->uri = g_strdup (uri);
+	name = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+	folder->filename = g_build_filename (cache->directory, name, NULL);
+	folder->entries = g_hash_table_new_full (g_str_hash,
+						 g_str_equal,
+						 g_free,
+						 (GDestroyNotify) cache_entry_free);
+	folder->mtime = 0;
+	folder->generation = 1;
+	folder->dirty = FALSE;
+	folder->last_save = 0;
+
+	g_free (name);
+
+	return folder;
+}
+
+
+static void
+cache_folder_free (CacheFolder *folder)
+{
+	g_hash_table_unref (folder->entries);
+	g_free (folder->filename);
+	g_free (folder->uri);
+	g_free (folder);
+}
+
+
+static void
+cache_folder_load (CacheFolder *folder)
+{
+	GMappedFile *mapped_file;
+	GBytes      *bytes;
+	GVariant    *variant;
+	guint32      version;
+	gint64       folder_mtime;
+	const char  *uri;
+	GVariant    *entries;
+
+	mapped_file = g_mapped_file_new (folder->filename, FALSE, NULL);
+	if (mapped_file == NULL)
+		return;
+
+	/* the entries keep a reference to the mapped data. */
+
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (FOLDER_TYPE), bytes, FALSE));
+	g_variant_get (variant, "(ux&s@" ENTRIES_TYPE ")", &version, &folder_mtime, &uri, &entries);
+
+	if ((version == CACHE_FORMAT_VERSION) && (g_strcmp0 (uri, folder->uri) == 0)) {
+		GVariantIter   iter;
+		const char    *name;
+		gint64         mtime;
+		guint64        size;
+		gint64         sidecars_mtime;
+		gboolean       sidecars_checked;
+		char         **attributes_mask_v;
+		GVariant      *values;
+
+		folder->mtime = folder_mtime;
+		g_variant_iter_init (&iter, entries);
+		while (g_variant_iter_next (&iter,
+					    "{&s(xtxb^as@" VALUES_TYPE ")}",
+					    &name,
+					    &mtime,
+					    &size,
+					    &sidecars_mtime,
+					    &sidecars_checked,
+					    &attributes_mask_v,
+					    &values))
+		{
+			g_hash_table_insert (folder->entries,
+					     g_strdup (name),
+					     cache_entry_new (mtime,
+							      size,
+							      sidecars_mtime,
+							      sidecars_checked ? folder->generation : 0,
+							      attributes_mask_v,
+							      values));
+		}
+	}
+
+	g_variant_unref (entries);
+	g_variant_unref (variant);
+	g_bytes_unref (bytes);
+	g_mapped_file_unref (mapped_file);
+}
+
+
+static void
+cache_folder_save (CacheFolder *folder)
+{
+	GVariantBuilder  builder;
+	GHashTableIter   iter;
+	gpointer         key;
+	gpointer         value;
+	GVariant        *variant;
+
+	folder->dirty = FALSE;
+	folder->last_save = g_get_monotonic_time ();
+
+	if (g_hash_table_size (folder->entries) == 0) {
+		g_unlink (folder->filename);
+		return;
+	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE (ENTRIES_TYPE));
+	g_hash_table_iter_init (&iter, folder->entries);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		CacheEntry *entry = value;
+
+		g_variant_builder_add (&builder,
+				       "{s(xtxb^as@" VALUES_TYPE ")}",
+				       (char *) key,
+				       entry->mtime,
+				       entry->size,
+				       entry->sidecars_mtime,
+				       (entry->sidecars_checked == folder->generation),
+				       entry->attributes_mask_v,
+				       entry->values);
+	}
+	variant = g_variant_ref_sink (g_variant_new ("(uxs@" ENTRIES_TYPE ")",
+						     CACHE_FORMAT_VERSION,
+						     folder->mtime,
+						     folder->uri,
+						     g_variant_builder_end (&builder)));
+
+	/* the cache is only an optimization, errors are not fatal. */
+	g_file_set_contents (folder->filename,
+			     g_variant_get_data (variant),
+			     g_variant_get_size (variant),
+			     NULL);
+
+	g_variant_unref (variant);
+}
+
+
+/* -- GthMetadataCache -- */
+
+
+static void invalidate_pool_func (gpointer data,
+				  gpointer user_data);
+
+
+GthMetadataCache *
+gth_metadata_cache_new (GFile *directory)
+{
+	GthMetadataCache *cache;
+
+	cache = g_new0 (GthMetadataCache, 1);
+	g_mutex_init (&cache->mutex);
+	cache->directory = g_file_get_path (directory);
+	cache->folders = g_hash_table_new_full (g_str_hash,
+						g_str_equal,
+						NULL,
+						(GDestroyNotify) cache_folder_free);
+	cache->folders_lru = g_queue_new ();
+	cache->invalidate_pool = g_thread_pool_new (invalidate_pool_func, cache, 1, FALSE, NULL);
+	cache->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	cache->hits = 0;
+	cache->misses = 0;
+
+	return cache;
+}
+
+
+void
+gth_metadata_cache_free (GthMetadataCache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	/* wait for the pending invalidations */
+	g_thread_pool_free (cache->invalidate_pool, FALSE, TRUE);
+
+	gth_metadata_cache_flush (cache, TRUE);
+
+	g_hash_table_unref (cache->pending);
+	g_queue_free (cache->folders_lru);
+	g_hash_table_unref (cache->folders);
+	g_free (cache->directory);
+	g_mutex_clear (&cache->mutex);
+	g_free (cache);
+}
+
+
+static gboolean
+get_file_stamp (GFileInfo *info,
+		gint64    *mtime,
+		guint64   *size)
+{
+	if (! g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)
+	    || ! g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+	{
+		return FALSE;
+	}
+
+	*mtime = (g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC)
+		 + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	*size = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+
+	return TRUE;
+}
+
+
+/* Returns the modification time of the folder that contains @file, or 0
+ * if it cannot be read. */
+static gint64
+get_folder_mtime (GFile *file)
+{
+	GFile     *parent;
+	GFileInfo *info;
+	gint64     mtime;
+	guint64    size;
+
+	parent = g_file_get_parent (file);
+	if (parent == NULL)
+		return 0;
+
+	info = g_file_query_info (parent,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL,
+				  NULL);
+	if ((info == NULL) || ! get_file_stamp (info, &mtime, &size))
+		mtime = 0;
+
+	_g_object_unref (info);
+	g_object_unref (parent);
+
+	return mtime;
+}
+
+
+static gboolean
+split_file_uri (GFile  *file,
+		char  **folder_uri,
+		char  **name)
+{
+	char *uri;
+	char *separator;
+
+	uri = g_file_get_uri (file);
+	separator = strrchr (uri, '/');
+	if ((separator == NULL) || (separator[1] == '\0')) {
+		g_free (uri);
+		return FALSE;
+	}
+
+	*folder_uri = g_strndup (uri, separator - uri);
+	*name = g_strdup (separator + 1);
+
+	g_free (uri);
+
+	return TRUE;
+}
+
+
+/* Must be called with the mutex locked. */
+static CacheFolder *
+get_folder (GthMetadataCache *cache,
+	    const char       *uri)
+{
+	CacheFolder *folder;
+
+	folder = g_hash_table_lookup (cache->folders, uri);
+	if (folder != NULL) {
+		if (cache->folders_lru->head->data != folder) {
+			g_queue_remove (cache->folders_lru, folder);
+			g_queue_push_head (cache->folders_lru, folder);
+		}
+		return folder;
+	}
+
+	while (g_queue_get_length (cache->folders_lru) >= MAX_LOADED_FOLDERS) {
+		CacheFolder *old_folder;
+
+		old_folder = g_queue_pop_tail (cache->folders_lru);
+		if (old_folder->dirty)
+			cache_folder_save (old_folder);
+		g_hash_table_remove (cache->folders, old_folder->uri);
+	}
+
+	folder = cache_folder_new (cache, uri);
+	cache_folder_load (folder);
+	g_hash_table_insert (cache->folders, folder->uri, folder);
+	g_queue_push_head (cache->folders_lru, folder);
+
+	return folder;
+}
+
+
+/* Must be called with the mutex locked. */
+static void
+cache_folder_set_mtime (CacheFolder *folder,
+			gint64       mtime)
+{
+	if (folder->mtime == mtime)
+		return;
+
+	folder->mtime = mtime;
+	folder->generation++;
+	folder->dirty = TRUE;
+}
+
+
+/* Must be called with the mutex locked. */
+static gboolean
+is_pending (GthMetadataCache *cache,
+	    GFile            *file,
+	    const char       *folder_uri)
+{
+	char     *uri;
+	gboolean  pending;
+
+	if (g_hash_table_size (cache->pending) == 0)
+		return FALSE;
+
+	uri = g_file_get_uri (file);
+	pending = g_hash_table_contains (cache->pending, uri) || g_hash_table_contains (cache->pending, folder_uri);
+	g_free (uri);
+
+	return pending;
+}
+
+
+/* The sidecars of the file are checked with @sidecars_func only if the
+ * folder changed after the last check. */
+gboolean
+gth_metadata_cache_lookup (GthMetadataCache              *cache,
+			   GFile                         *file,
+			   GFileInfo                     *info,
+			   GthMetadataCacheSidecarsFunc   sidecars_func,
+			   char                         **attributes_mask_v)
+{
+	gint64       mtime;
+	guint64      size;
+	gint64       folder_mtime;
+	char        *folder_uri;
+	char        *name;
+	CacheFolder *folder;
+	CacheEntry  *entry;
+	GVariant    *values;
+	guint        generation;
+	gint64       sidecars_mtime;
+	gboolean     sidecars_valid;
+
+	if (! get_file_stamp (info, &mtime, &size))
+		return FALSE;
+	if (! split_file_uri (file, &folder_uri, &name))
+		return FALSE;
+
+	folder_mtime = get_folder_mtime (file);
+
+	g_mutex_lock (&cache->mutex);
+
+	values = NULL;
+	entry = NULL;
+	folder = get_folder (cache, folder_uri);
+	cache_folder_set_mtime (folder, folder_mtime);
+	generation = folder->generation;
+	if (! is_pending (cache, file, folder_uri)) {
+		entry = g_hash_table_lookup (folder->entries, name);
+		if ((entry != NULL)
+		    && (! cache_entry_is_valid (entry, mtime, size) || ! cache_entry_covers (entry, attributes_mask_v)))
+		{
+			entry = NULL;
+		}
+	}
+
+	if ((entry != NULL) && (entry->sidecars_checked == generation))
+		values = g_variant_ref (entry->values);
+
+	if ((entry != NULL) && (values == NULL)) {
+		sidecars_mtime = entry->sidecars_mtime;
+
+		/* read the sidecars without locking the cache, the entry
+		 * can change in the meantime. */
+
+		g_mutex_unlock (&cache->mutex);
+		sidecars_valid = (sidecars_func (file) == sidecars_mtime);
+		g_mutex_lock (&cache->mutex);
+
+		folder = g_hash_table_lookup (cache->folders, folder_uri);
+		entry = (folder != NULL) ? g_hash_table_lookup (folder->entries, name) : NULL;
+		if (sidecars_valid
+		    && (entry != NULL)
+		    && (entry->sidecars_mtime == sidecars_mtime)
+		    && cache_entry_is_valid (entry, mtime, size)
+		    && cache_entry_covers (entry, attributes_mask_v))
+		{
+			if ((folder->generation == generation) && (entry->sidecars_checked != generation)) {
+				entry->sidecars_checked = generation;
+				folder->dirty = TRUE;
+			}
+			values = g_variant_ref (entry->values);
+		}
+	}
+
+	if (values != NULL)
+		cache->hits++;
+	else
+		cache->misses++;
+
+	g_mutex_unlock (&cache->mutex);
+
+	if (values != NULL) {
+		restore_info_from_variant (info, values);
+		g_variant_unref (values);
+	}
+
+	g_free (name);
+	g_free (folder_uri);
+
+	return (values != NULL);
+}
+
+
+void
+gth_metadata_cache_store (GthMetadataCache  *cache,
+			  GFile             *file,
+			  GFileInfo         *info,
+			  gint64             sidecars_mtime,
+			  char             **attributes_mask_v)
+{
+	gint64        mtime;
+	guint64       size;
+	char         *folder_uri;
+	char         *name;
+	GVariant     *values;
+	CacheFolder  *folder;
+	CacheEntry   *old_entry;
+	char        **mask_v;
+
+	if (! get_file_stamp (info, &mtime, &size))
+		return;
+	if (! split_file_uri (file, &folder_uri, &name))
+		return;
+
+	values = info_to_variant (info);
+	if (values == NULL) {
+		g_free (name);
+		g_free (folder_uri);
+		return;
+	}
+
+	g_mutex_lock (&cache->mutex);
+
+	folder = get_folder (cache, folder_uri);
+	old_entry = g_hash_table_lookup (folder->entries, name);
+	if ((old_entry != NULL)
+	    && cache_entry_is_valid (old_entry, mtime, size)
+	    && (old_entry->sidecars_mtime == sidecars_mtime))
+	{
+		GVariant *merged_values;
+
+		/* keep the attributes read by a previous query with a
+		 * different mask. */
+
+		merged_values = merge_values (values, old_entry->values);
+		g_variant_unref (values);
+		values = merged_values;
+
+		mask_v = merge_attributes_mask (attributes_mask_v, old_entry->attributes_mask_v);
+	}
+	else
+		mask_v = merge_attributes_mask (attributes_mask_v, NULL);
+
+	/* the sidecars were read after the lookup that set the folder
+	 * generation. */
+
+	g_hash_table_insert (folder->entries,
+			     name,
+			     cache_entry_new (mtime, size, sidecars_mtime, folder->generation, mask_v, values));
+	folder->dirty = TRUE;
+
+	g_mutex_unlock (&cache->mutex);
+
+	g_free (folder_uri);
+}
+
+
+void
+gth_metadata_cache_invalidate (GthMetadataCache *cache,
+			       GFile            *file)
+{
+	char        *uri;
+	CacheFolder *folder;
+	char        *folder_uri;
+	char        *name;
+
+	g_mutex_lock (&cache->mutex);
+
+	/* the file can be a folder as well */
+
+	uri = g_file_get_uri (file);
+	folder = g_hash_table_lookup (cache->folders, uri);
+	if (folder != NULL) {
+		g_hash_table_remove_all (folder->entries);
+		folder->dirty = TRUE;
+	}
+	else {
+		char *checksum;
+		char *filename;
+
+		checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+		filename = g_build_filename (cache->directory, checksum, NULL);
+		g_unlink (filename);
+
+		g_free (filename);
+		g_free (checksum);
+	}
+
+	if (split_file_uri (file, &folder_uri, &name)) {
+		folder = get_folder (cache, folder_uri);
+
+		/* a file without an entry can be a sidecar modified in
+		 * place, check the sidecars of the folder again. */
+
+		if (! g_hash_table_remove (folder->entries, name))
+			folder->generation++;
+		folder->dirty = TRUE;
+
+		g_free (name);
+		g_free (folder_uri);
+	}
+
+	g_free (uri);
+
+	g_mutex_unlock (&cache->mutex);
+}
+
+
+static void
+invalidate_pool_func (gpointer data,
+		      gpointer user_data)
+{
+	GFile            *file = data;
+	GthMetadataCache *cache = user_data;
+	char             *uri;
+	guint             n;
+
+	gth_metadata_cache_invalidate (cache, file);
+
+	uri = g_file_get_uri (file);
+	g_mutex_lock (&cache->mutex);
+	n = GPOINTER_TO_UINT (g_hash_table_lookup (cache->pending, uri));
+	if (n > 1)
+		g_hash_table_insert (cache->pending, g_strdup (uri), GUINT_TO_POINTER (n - 1));
+	else
+		g_hash_table_remove (cache->pending, uri);
+	g_mutex_unlock (&cache->mutex);
+
+	g_free (uri);
+	g_object_unref (file);
+}
+
+
+/* Same as gth_metadata_cache_invalidate but the cache files are read and
+ * deleted in a worker thread, for the main thread.  The file is not found
+ * in the cache from now on. */
+void
+gth_metadata_cache_invalidate_async (GthMetadataCache *cache,
+				     GFile            *file)
+{
+	char  *uri;
+	guint  n;
+
+	uri = g_file_get_uri (file);
+	g_mutex_lock (&cache->mutex);
+	n = GPOINTER_TO_UINT (g_hash_table_lookup (cache->pending, uri));
+	g_hash_table_insert (cache->pending, uri, GUINT_TO_POINTER (n + 1));
+	g_mutex_unlock (&cache->mutex);
+
+	g_thread_pool_push (cache->invalidate_pool, g_object_ref (file), NULL);
+}
+
+
+void
+gth_metadata_cache_flush (GthMetadataCache *cache,
+			  gboolean          force)
+{
+	gint64  now;
+	GList  *scan;
+
+	g_mutex_lock (&cache->mutex);
+
+	now = g_get_monotonic_time ();
+	for (scan = cache->folders_lru->head; scan; scan = scan->next) {
+		CacheFolder *folder = scan->data;
+
+		if (folder->dirty && (force || (now - folder->last_save >= SAVE_DELAY)))
+			cache_folder_save (folder);
+	}
+
+	g_mutex_unlock (&cache->mutex);
+}
+
+
+void
+gth_metadata_cache_get_stats (GthMetadataCache *cache,
+			      guint            *hits,
+			      guint            *misses)
+{
+	g_mutex_lock (&cache->mutex);
+	if (hits != NULL)
+		*hits = cache->hits;
+	if (misses != NULL)
+		*misses = cache->misses;
+	g_mutex_unlock (&cache->mutex);
+}
@@ -0,0 +1,76 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTH_METADATA_CACHE_H
+#define GTH_METADATA_CACHE_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Persistent cache of the attributes produced by the metadata providers.
+ * Entries are grouped by folder, one cache file per folder, and are valid
+ * as long as the modification time and size of the file and the
+ * modification time of its sidecars do not change.  The sidecars are
+ * checked again only after the folder is modified or invalidated. */
+
+typedef struct _GthMetadataCache GthMetadataCache;
+
+/* Returns a value that changes when a sidecar of @file changes. */
+typedef gint64 (*GthMetadataCacheSidecarsFunc) (GFile *file);
+
+GthMetadataCache *  gth_metadata_cache_new              (GFile                         *directory);
+void                gth_metadata_cache_free             (GthMetadataCache              *cache);
+gboolean            gth_metadata_cache_lookup           (GthMetadataCache              *cache,
+							 GFile                         *file,
+							 GFileInfo                     *info,
+							 GthMetadataCacheSidecarsFunc   sidecars_func,
+							 char                         **attributes_mask_v);
+void                gth_metadata_cache_store            (GthMetadataCache              *cache,
+							 GFile                         *file,
+							 GFileInfo                     *info,
+							 gint64                         sidecars_mtime,
+							 char                         **attributes_mask_v);
+void                gth_metadata_cache_invalidate       (GthMetadataCache              *cache,
+							 GFile                         *file);
+void                gth_metadata_cache_invalidate_async (GthMetadataCache              *cache,
+							 GFile                         *file);
+void                gth_metadata_cache_flush            (GthMetadataCache              *cache,
+							 gboolean                       force);
+void                gth_metadata_cache_get_stats        (GthMetadataCache              *cache,
+							 guint                         *hits,
+							 guint                         *misses);
+
+/* Serialization of a single attribute, as a (yv) variant, for other
+ * persistent stores. */
+
+GVariant *          _g_file_info_attribute_to_variant
+							(GFileInfo                     *info,
+							 const char                    *attribute);
+void                _g_file_info_set_attribute_from_variant
+							(GFileInfo                     *info,
+							 const char                    *attribute,
+							 GVariant                      *variant);
+
+G_END_DECLS
+
+#endif /* GTH_METADATA_CACHE_H */
@@ -82,6 +82,7 @@ gth_metadata_provider_file_class_init (GthMetadataProviderFileClass *klass)
 {
 	GTH_METADATA_PROVIDER_CLASS (klass)->can_read = gth_metadata_provider_file_can_read;
 	GTH_METADATA_PROVIDER_CLASS (klass)->read = gth_metadata_provider_file_read;
+	GTH_METADATA_PROVIDER_CLASS (klass)->cacheable = FALSE;
 }
 
 static void
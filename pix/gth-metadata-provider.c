@@ -23,10 +23,12 @@
 #include "glib-utils.h"
 #include "gth-file-data.h"
 #include "gth-main.h"
+#include "gth-metadata-cache.h"
 #include "gth-metadata-provider.h"
 
 
 #define CHECK_THREAD_RATE 5
+#define MIN_FILES_PER_WORKER 4
 
 
 G_DEFINE_TYPE (GthMetadataProvider, gth_metadata_provider, G_TYPE_OBJECT)
@@ -79,6 +81,7 @@ gth_metadata_provider_class_init (GthMetadataProviderClass * klass)
 	GTH_METADATA_PROVIDER_CLASS (klass)->can_write = gth_metadata_provider_real_can_write;
 	GTH_METADATA_PROVIDER_CLASS (klass)->read = gth_metadata_provider_real_read;
 	GTH_METADATA_PROVIDER_CLASS (klass)->write = gth_metadata_provider_real_write;
+	GTH_METADATA_PROVIDER_CLASS (klass)->cacheable = TRUE;
 }
 
 
@@ -108,6 +111,13 @@ gth_metadata_provider_can_write (GthMetadataProvider  *self,
 }
 
 
+gboolean
+gth_metadata_provider_is_cacheable (GthMetadataProvider *self)
+{
+	return GTH_METADATA_PROVIDER_GET_CLASS (self)->cacheable;
+}
+
+
 void
 gth_metadata_provider_read (GthMetadataProvider *self,
 			    GthFileData         *file_data,
@@ -136,6 +146,7 @@ typedef struct {
 	GList   *files;
 	char   *attributes;
 	char  **attributes_v;
+	char  **attributes_mask_v;
 } QueryMetadataData;
 
 
@@ -144,6 +155,7 @@ query_metadata_data_free (gpointer user_data)
 {
 	QueryMetadataData *qmd = user_data;
 
+	g_strfreev (qmd->attributes_mask_v);
 	g_strfreev (qmd->attributes_v);
 	g_free (qmd->attributes);
 	_g_object_list_unref (qmd->files);
@@ -151,76 +163,227 @@ query_metadata_data_free (gpointer user_data)
 }
 
 
-static void
-_g_query_metadata_async_thread (GTask        *task,
-				gpointer      source_object,
-				gpointer      task_data,
-				GCancellable *cancellable)
+/* The cached metadata is valid only if the sidecar files did not change as
+ * well, this returns a value that changes when any of them is modified,
+ * created or deleted.  The cache calls it only when the folder changed. */
+static gint64
+get_sidecars_mtime (GFile *file)
 {
-	QueryMetadataData  *qmd;
-	GList              *providers;
-	GList              *scan;
-	GError             *error = NULL;
+	GList  *sidecars = NULL;
+	GList  *scan;
+	gint64  mtime;
+
+	gth_hook_invoke ("add-sidecars", file, &sidecars);
+
+	mtime = 0;
+	for (scan = sidecars; scan; scan = scan->next) {
+		GFileInfo *info;
+
+		info = g_file_query_info (G_FILE (scan->data),
+					  G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+					  G_FILE_QUERY_INFO_NONE,
+					  NULL,
+					  NULL);
+		if (info != NULL) {
+			mtime += (g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC)
+				 + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+			g_object_unref (info);
+		}
+	}
 
-	performance (DEBUG_INFO, "_g_query_metadata_async_thread start");
+	_g_object_list_unref (sidecars);
+
+	return mtime;
+}
 
-	qmd = g_task_get_task_data (task);
+
+static GList *
+create_metadata_providers (void)
+{
+	GList *providers;
+	GList *scan;
 
 	providers = NULL;
 	for (scan = gth_main_get_all_metadata_providers (); scan; scan = scan->next)
 		providers = g_list_prepend (providers, g_object_new (G_OBJECT_TYPE (scan->data), NULL));
-	providers = g_list_reverse (providers);
 
-	for (scan = qmd->files; scan; scan = scan->next) {
-		GthFileData *file_data = scan->data;
-		GList       *scan_providers;
+	return g_list_reverse (providers);
+}
 
-		if ((cancellable != NULL) && g_cancellable_is_cancelled (cancellable)) {
-			error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "");
-			break;
-		}
 
-#if WEBP_IS_UNKNOWN_TO_GLIB || JXL_IS_UNKNOWN_TO_GLIB
-		if (_g_file_attributes_matches_any_v (G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
-						      G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE,
-						      qmd->attributes_v))
-		{
-			char *uri;
-			char *ext;
+typedef struct {
+	QueryMetadataData  *qmd;
+	GthMetadataCache   *cache;
+	GCancellable       *cancellable;
+	GthFileData       **files;
+	int                 n_files;
+	gint                next_file;
+	gint                n_cached;
+	gint                cancelled;
+} QueryMetadataJob;
+
 
-			uri = g_file_get_uri (file_data->file);
-			ext = _g_uri_get_extension (uri);
+static void
+query_metadata_for_file (QueryMetadataJob *job,
+			 GList            *providers,
+			 GthFileData      *file_data)
+{
+	QueryMetadataData *qmd = job->qmd;
+	gboolean           use_cache;
+	gboolean           from_cache;
+	gint64             sidecars_mtime;
+	GList             *scan_providers;
+
+#if WEBP_IS_UNKNOWN_TO_GLIB || JXL_IS_UNKNOWN_TO_GLIB
+	if (_g_file_attributes_matches_any_v (G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
+					      G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE,
+					      qmd->attributes_v))
+	{
+		char *uri;
+		char *ext;
+
+		uri = g_file_get_uri (file_data->file);
+		ext = _g_uri_get_extension (uri);
 #if WEBP_IS_UNKNOWN_TO_GLIB
-			if (g_strcmp0 (ext, ".webp") == 0)
-				gth_file_data_set_mime_type (file_data, "image/webp");
+		if (g_strcmp0 (ext, ".webp") == 0)
+			gth_file_data_set_mime_type (file_data, "image/webp");
 #endif
 #if JXL_IS_UNKNOWN_TO_GLIB
-			if (g_strcmp0 (ext, ".jxl") == 0)
-				gth_file_data_set_mime_type (file_data, "image/jxl");
+		if (g_strcmp0 (ext, ".jxl") == 0)
+			gth_file_data_set_mime_type (file_data, "image/jxl");
 #endif
 
-			g_free (ext);
-			g_free (uri);
-		}
+		g_free (ext);
+		g_free (uri);
+	}
 #endif
 
-		for (scan_providers = providers; scan_providers; scan_providers = scan_providers->next) {
-			GthMetadataProvider *metadata_provider = scan_providers->data;
+	use_cache = (job->cache != NULL) && g_file_is_native (file_data->file);
+	from_cache = FALSE;
+	sidecars_mtime = 0;
+	if (use_cache) {
+		from_cache = gth_metadata_cache_lookup (job->cache,
+							file_data->file,
+							file_data->info,
+							get_sidecars_mtime,
+							qmd->attributes_mask_v);
+		if (from_cache)
+			g_atomic_int_inc (&job->n_cached);
+		else
+			sidecars_mtime = get_sidecars_mtime (file_data->file);
+	}
+
+	for (scan_providers = providers; scan_providers; scan_providers = scan_providers->next) {
+		GthMetadataProvider *metadata_provider = scan_providers->data;
 
-			if (gth_metadata_provider_can_read (metadata_provider,
-							    file_data,
-							    gth_file_data_get_mime_type (file_data),
-							    qmd->attributes_v))
-			{
-				gth_metadata_provider_read (metadata_provider, file_data, qmd->attributes, cancellable);
-			}
+		if (from_cache && gth_metadata_provider_is_cacheable (metadata_provider))
+			continue;
+
+		if (gth_metadata_provider_can_read (metadata_provider,
+						    file_data,
+						    gth_file_data_get_mime_type (file_data),
+						    qmd->attributes_v))
+		{
+			gth_metadata_provider_read (metadata_provider, file_data, qmd->attributes, job->cancellable);
 		}
 	}
 
+	/* do not save the metadata if the reading was interrupted. */
+
+	if (use_cache
+	    && ! from_cache
+	    && ! g_cancellable_is_cancelled (job->cancellable))
+	{
+		gth_metadata_cache_store (job->cache,
+					  file_data->file,
+					  file_data->info,
+					  sidecars_mtime,
+					  qmd->attributes_mask_v);
+	}
+}
+
+
+/* Each worker uses its own provider instances, and takes the next file from
+ * the shared list until all the files are read.  The files are modified in
+ * place so the order of the list is preserved. */
+static void
+query_metadata_worker (int      first,
+		       int      last,
+		       gpointer user_data)
+{
+	QueryMetadataJob *job = user_data;
+	GList            *providers;
+
+	providers = create_metadata_providers ();
+
+	for (;;) {
+		int i;
+
+		if (g_cancellable_is_cancelled (job->cancellable)) {
+			g_atomic_int_set (&job->cancelled, 1);
+			break;
+		}
+
+		i = g_atomic_int_add (&job->next_file, 1);
+		if (i >= job->n_files)
+			break;
+
+		query_metadata_for_file (job, providers, job->files[i]);
+	}
+
 	_g_object_list_unref (providers);
+}
+
+
+static void
+_g_query_metadata_async_thread (GTask        *task,
+				gpointer      source_object,
+				gpointer      task_data,
+				GCancellable *cancellable)
+{
+	QueryMetadataData  *qmd;
+	QueryMetadataJob    job;
+	GList              *scan;
+	int                 i;
+	int                 n_workers;
+	GError             *error = NULL;
+
+	performance (DEBUG_INFO, "_g_query_metadata_async_thread start");
+
+	qmd = g_task_get_task_data (task);
+
+	job.qmd = qmd;
+	job.cache = gth_main_get_default_metadata_cache ();
+	job.cancellable = cancellable;
+	job.n_files = g_list_length (qmd->files);
+	job.files = g_new (GthFileData *, MAX (job.n_files, 1));
+	for (i = 0, scan = qmd->files; scan; scan = scan->next)
+		job.files[i++] = scan->data;
+	job.next_file = 0;
+	job.n_cached = 0;
+	job.cancelled = 0;
+
+	/* read the files in parallel when there are enough of them, each band
+	 * is a worker of the shared pool, the current thread is one of them. */
+
+	n_workers = CLAMP (job.n_files / MIN_FILES_PER_WORKER, 1, _g_get_n_worker_threads ());
+	_g_parallel_for_bands (n_workers, 1, query_metadata_worker, &job);
+
+	if (job.cancelled)
+		error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "");
+
+	if (job.cache != NULL)
+		gth_metadata_cache_flush (job.cache, FALSE);
+
+	if (job.n_cached > 0)
+		debug (DEBUG_INFO, "metadata cache: %d of %d files", job.n_cached, job.n_files);
+
+	g_free (job.files);
 
 	performance (DEBUG_INFO, "_g_query_metadata_async_thread before read-metadata-ready");
 
+	/* invoked once for the whole list, after all the workers are done. */
+
 	if (error == NULL)
 		gth_hook_invoke ("read-metadata-ready", qmd->files, qmd->attributes);
 
@@ -247,6 +410,7 @@ _g_query_metadata_async (GList               *files,       /* GthFileData * list
 	qmd->files = _g_object_list_ref (files);
 	qmd->attributes = g_strdup (attributes);
 	qmd->attributes_v = gth_main_get_metadata_attributes (attributes);
+	qmd->attributes_mask_v = g_strsplit ((attributes != NULL) ? attributes : "", ",", -1);
 
 	task = g_task_new (NULL, cancellable, callback, user_data);
 	g_task_set_task_data (task, qmd, query_metadata_data_free);
@@ -301,16 +465,14 @@ _g_write_metadata_async_thread (GTask        *task,
 				GCancellable *cancellable)
 {
 	WriteMetadataData  *wmd;
+	GthMetadataCache   *cache;
 	GList              *providers;
 	GList              *scan;
 	GError             *error = NULL;
 
 	wmd = g_task_get_task_data (task);
-
-	providers = NULL;
-	for (scan = gth_main_get_all_metadata_providers (); scan; scan = scan->next)
-		providers = g_list_prepend (providers, g_object_new (G_OBJECT_TYPE (scan->data), NULL));
-	providers = g_list_reverse (providers);
+	cache = gth_main_get_default_metadata_cache ();
+	providers = create_metadata_providers ();
 
 	for (scan = wmd->files; scan; scan = scan->next) {
 		GthFileData *file_data = scan->data;
@@ -327,6 +489,9 @@ _g_write_metadata_async_thread (GTask        *task,
 			if (gth_metadata_provider_can_write (metadata_provider, gth_file_data_get_mime_type (file_data), wmd->attributes_v))
 				gth_metadata_provider_write (metadata_provider, wmd->flags, file_data, wmd->attributes, cancellable);
 		}
+
+		if (cache != NULL)
+			gth_metadata_cache_invalidate (cache, file_data->file);
 	}
 
 	_g_object_list_unref (providers);
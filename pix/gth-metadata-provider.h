@@ -50,6 +50,12 @@ struct _GthMetadataProvider {
 
 struct _GthMetadataProviderClass {
 	GObjectClass parent_class;
+
+	/* whether the attributes read by the provider can be saved in the
+	 * metadata cache, FALSE for the attributes that depend on the
+	 * application state. */
+	gboolean    cacheable;
+
 	gboolean  (*can_read)		(GthMetadataProvider    *self,
 					 GthFileData            *file_data,
 					 const char             *mime_type,
@@ -76,6 +82,7 @@ gboolean   gth_metadata_provider_can_read	(GthMetadataProvider    *self,
 gboolean   gth_metadata_provider_can_write	(GthMetadataProvider    *self,
 						 const char             *mime_type,
 						 char                  **attribute_v);
+gboolean   gth_metadata_provider_is_cacheable	(GthMetadataProvider    *self);
 void       gth_metadata_provider_read		(GthMetadataProvider    *self,
 						 GthFileData            *file_data,
 						 const char             *attributes,
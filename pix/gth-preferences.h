@@ -43,6 +43,10 @@ G_BEGIN_DECLS
 
 #define PREF_GENERAL_ACTIVE_EXTENSIONS        "active-extensions"
 #define PREF_GENERAL_STORE_METADATA_IN_FILES  "store-metadata-in-files"
+#define PREF_GENERAL_PARALLEL_COPIES          "parallel-copies"
+#define PREF_GENERAL_IMAGE_TASKS_IN_FLIGHT    "image-tasks-in-flight"
+#define PREF_GENERAL_IMAGE_HISTORY_MEMORY     "image-history-memory"
+#define PREF_GENERAL_IMAGE_HISTORY_DISK       "image-history-disk"
 
 /* keys: dada migration */
 
@@ -58,6 +62,7 @@ G_BEGIN_DECLS
 #define PREF_BROWSER_SHOW_HIDDEN_FILES        "show-hidden-files"
 #define PREF_BROWSER_FAST_FILE_TYPE           "fast-file-type"
 #define PREF_BROWSER_SAVE_THUMBNAILS          "save-thumbnails"
+#define PREF_BROWSER_PACKED_THUMBNAILS        "packed-thumbnails"
 #define PREF_BROWSER_THUMBNAIL_SIZE           "thumbnail-size"
 #define PREF_BROWSER_THUMBNAIL_LIMIT          "thumbnail-limit"
 #define PREF_BROWSER_THUMBNAIL_CAPTION        "thumbnail-caption"
@@ -82,6 +87,7 @@ G_BEGIN_DECLS
 #define PREF_FULLSCREEN_SIDEBAR		      "fullscreen-sidebar"
 #define PREF_VIEWER_SCROLL_ACTION             "scroll-action"
 #define PREF_BROWSER_FAVORITE_PROPERTIES      "favorite-properties"
+#define PREF_BROWSER_IMAGE_CACHE_SIZE         "image-cache-size"
 
 /* keys: add to catalog */
 
@@ -0,0 +1,296 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "gth-sort-key.h"
+
+
+/* below this size the radix sort is slower than a comparison sort. */
+#define MIN_KEYS_FOR_RADIX_SORT 64
+
+
+static int
+compare_strings (const char *a,
+		 const char *b)
+{
+	if (a == b)
+		return 0;
+	if (a == NULL)
+		return -1;
+	if (b == NULL)
+		return 1;
+	return strcmp (a, b);
+}
+
+
+static int
+compare_key_strings (const GthSortKey *a,
+		     const GthSortKey *b)
+{
+	int result;
+
+	result = compare_strings (a->text, b->text);
+	if (result == 0)
+		result = compare_strings (a->name, b->name);
+
+	return result;
+}
+
+
+int
+gth_sort_key_compare (const GthSortKey *a,
+		      const GthSortKey *b)
+{
+	if (a->number < b->number)
+		return -1;
+	if (a->number > b->number)
+		return 1;
+	return compare_key_strings (a, b);
+}
+
+
+/* Sets the key of a file ordered by folder and then by name: the folders
+ * are compared without the file names, so that the files of a folder are
+ * not mixed with the ones of its sub-folders.  @uri is the uri of the file
+ * and is freed with the key, @name is the sort key of the file name. */
+void
+gth_sort_key_set_path (GthSortKey *key,
+		       char       *uri,
+		       const char *name)
+{
+	char *separator;
+
+	key->data = uri;
+	separator = strrchr (key->data, '/');
+	if (separator != NULL)
+		*separator = '\0';
+	key->text = key->data;
+	key->name = name;
+}
+
+
+/* Returns a number with the same order of @value. */
+gint64
+gth_sort_key_number_from_double (double value)
+{
+	union {
+		double d;
+		gint64 i;
+	} u;
+
+	u.d = value;
+
+	/* the negative values are stored as sign and magnitude. */
+
+	if (u.i < 0)
+		u.i = G_MININT64 - u.i - 1;
+
+	return u.i;
+}
+
+
+static int
+compare_keys_func (gconstpointer a,
+		   gconstpointer b,
+		   gpointer      user_data)
+{
+	int result;
+
+	result = gth_sort_key_compare (a, b);
+	if (GPOINTER_TO_INT (user_data))
+		result = -result;
+
+	return result;
+}
+
+
+static int
+compare_key_strings_func (gconstpointer a,
+			  gconstpointer b,
+			  gpointer      user_data)
+{
+	int result;
+
+	result = compare_key_strings (a, b);
+	if (GPOINTER_TO_INT (user_data))
+		result = -result;
+
+	return result;
+}
+
+
+static inline guint
+get_radix (gint64   number,
+	   int      shift,
+	   gboolean inverse)
+{
+	guint64 value;
+
+	value = ((guint64) number) ^ G_GUINT64_CONSTANT (0x8000000000000000);
+	if (inverse)
+		value = ~value;
+
+	return (value >> shift) & 0xff;
+}
+
+
+/* A least significant digit radix sort of the numbers, stable as the
+ * comparison sort. */
+static void
+radix_sort (GthSortKey *keys,
+	    int         n_keys,
+	    gboolean    inverse)
+{
+	GthSortKey *buffer;
+	GthSortKey *src;
+	GthSortKey *dest;
+	guint       counts[256];
+	int         shift;
+	int         i;
+
+	buffer = g_new (GthSortKey, n_keys);
+	src = keys;
+	dest = buffer;
+	for (shift = 0; shift < 64; shift += 8) {
+		GthSortKey *tmp;
+		guint       offset;
+
+		memset (counts, 0, sizeof (counts));
+		for (i = 0; i < n_keys; i++)
+			counts[get_radix (src[i].number, shift, inverse)]++;
+
+		/* skip the digits that are equal for all the keys, for
+		 * example the high bytes of small numbers. */
+
+		if (counts[get_radix (src[0].number, shift, inverse)] == n_keys)
+			continue;
+
+		offset = 0;
+		for (i = 0; i < 256; i++) {
+			guint count = counts[i];
+
+			counts[i] = offset;
+			offset += count;
+		}
+
+		for (i = 0; i < n_keys; i++)
+			dest[counts[get_radix (src[i].number, shift, inverse)]++] = src[i];
+
+		tmp = src;
+		src = dest;
+		dest = tmp;
+	}
+
+	if (src != keys)
+		memcpy (keys, src, sizeof (GthSortKey) * n_keys);
+
+	g_free (buffer);
+}
+
+
+static void
+sort_keys (GthSortKey *keys,
+	   int         n_keys,
+	   gboolean    inverse)
+{
+	gboolean has_strings;
+	int      i, j;
+
+	if (n_keys < MIN_KEYS_FOR_RADIX_SORT) {
+		g_qsort_with_data (keys, n_keys, sizeof (GthSortKey), compare_keys_func, GINT_TO_POINTER (inverse));
+		return;
+	}
+
+	radix_sort (keys, n_keys, inverse);
+
+	has_strings = FALSE;
+	for (i = 0; ! has_strings && (i < n_keys); i++)
+		has_strings = (keys[i].text != NULL) || (keys[i].name != NULL);
+	if (! has_strings)
+		return;
+
+	/* sort the keys with the same number by text and name */
+
+	for (i = 0; i < n_keys; i = j) {
+		for (j = i + 1; (j < n_keys) && (keys[j].number == keys[i].number); j++)
+			/* void */;
+		if (j - i > 1)
+			g_qsort_with_data (keys + i, j - i, sizeof (GthSortKey), compare_key_strings_func, GINT_TO_POINTER (inverse));
+	}
+}
+
+
+/* Sorts the keys, the sort is stable.  When the first @n_sorted keys are
+ * already sorted, only the other keys are sorted and then merged with
+ * them, the old keys come first when equal. */
+void
+gth_sort_keys_sort (GthSortKey *keys,
+		    int         n_keys,
+		    int         n_sorted,
+		    gboolean    inverse)
+{
+	GthSortKey *merged;
+	int         i, j, k;
+
+	for (i = 0; i < n_sorted - 1; i++) {
+		if (compare_keys_func (keys + i, keys + i + 1, GINT_TO_POINTER (inverse)) > 0) {
+			n_sorted = 0;
+			break;
+		}
+	}
+
+	if (n_sorted <= 0) {
+		sort_keys (keys, n_keys, inverse);
+		return;
+	}
+
+	if (n_sorted >= n_keys)
+		return;
+
+	sort_keys (keys + n_sorted, n_keys - n_sorted, inverse);
+
+	merged = g_new (GthSortKey, n_keys);
+	for (i = 0, j = n_sorted, k = 0; k < n_keys; k++) {
+		if ((j >= n_keys) || ((i < n_sorted) && (compare_keys_func (keys + i, keys + j, GINT_TO_POINTER (inverse)) <= 0)))
+			merged[k] = keys[i++];
+		else
+			merged[k] = keys[j++];
+	}
+	memcpy (keys, merged, sizeof (GthSortKey) * n_keys);
+
+	g_free (merged);
+}
+
+
+void
+gth_sort_keys_free (GthSortKey *keys,
+		    int         n_keys)
+{
+	int i;
+
+	if (keys == NULL)
+		return;
+
+	for (i = 0; i < n_keys; i++)
+		g_free (keys[i].data);
+	g_free (keys);
+}
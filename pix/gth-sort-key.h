@@ -0,0 +1,58 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTH_SORT_KEY_H
+#define GTH_SORT_KEY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A key computed once per element to sort a list without calling the
+ * comparison function of the sort type for every pair of elements: the
+ * numbers are compared first, then the texts and then the names, both with
+ * strcmp.  NULL strings come first.  @data is freed with the key, the
+ * strings can point to it. */
+
+typedef struct {
+	gint64       number;
+	const char  *text;
+	const char  *name;
+	char        *data;
+	gpointer     item;
+} GthSortKey;
+
+int      gth_sort_key_compare              (const GthSortKey *a,
+					    const GthSortKey *b);
+void     gth_sort_key_set_path             (GthSortKey       *key,
+					    char             *uri,
+					    const char       *name);
+gint64   gth_sort_key_number_from_double   (double            value);
+void     gth_sort_keys_sort                (GthSortKey       *keys,
+					    int               n_keys,
+					    int               n_sorted,
+					    gboolean          inverse);
+void     gth_sort_keys_free                (GthSortKey       *keys,
+					    int               n_keys);
+
+G_END_DECLS
+
+#endif /* GTH_SORT_KEY_H */
@@ -0,0 +1,1060 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2006-2009 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <zlib.h>
+#include "glib-utils.h"
+#include "gth-surface-history.h"
+
+
+/* The current surface is kept as it is, the other steps are saved as the
+ * tiles that differ from the next step in the direction of the current
+ * surface, compressed with the fastest zlib level.  A step is saved whole
+ * (a keyframe) when the size changes, when most of the tiles changed, and
+ * every KEYFRAME_INTERVAL steps, so that a revert doesn't have to go
+ * through all the history.  When the steps use more memory than allowed
+ * the farthest ones from the current surface are moved to a file, the
+ * space of the removed steps is used again, and the steps are dropped when
+ * the file would grow over its limit. */
+
+
+#define TILE_SIZE		64
+#define KEYFRAME_INTERVAL	16
+#define MAX_FILE_ATTEMPTS	10
+
+
+/* Step */
+
+
+typedef struct {
+	gpointer         user_data;
+	gsize            user_data_size;  /* memory used by user_data */
+	cairo_surface_t *surface;         /* set when the surface cannot be saved as tiles */
+	gboolean         tiled;
+	cairo_format_t   format;
+	int              width;
+	int              height;
+	int              columns;
+	int              rows;
+	gboolean         keyframe;
+	guint8          *changed;         /* the tiles saved in the step, NULL for the keyframes */
+	gsize           *offsets;         /* start of each compressed row of tiles, rows + 1 items */
+	gsize            size;
+	guchar          *data;            /* NULL when the step is saved in the file */
+	goffset          file_offset;
+} Step;
+
+
+static guchar *
+get_surface_data (cairo_surface_t *surface)
+{
+	cairo_surface_flush (surface);
+	return cairo_image_surface_get_data (surface);
+}
+
+
+static cairo_surface_t *
+create_surface (cairo_format_t format,
+		int            width,
+		int            height)
+{
+	cairo_surface_t *surface;
+
+	surface = cairo_image_surface_create (format, width, height);
+	if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy (surface);
+		return NULL;
+	}
+
+	return surface;
+}
+
+
+/* Returns TRUE if @surface can be saved as tiles. */
+static gboolean
+surface_is_tileable (cairo_surface_t *surface)
+{
+	cairo_format_t format;
+
+	if ((surface == NULL) || (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE))
+		return FALSE;
+
+	format = cairo_image_surface_get_format (surface);
+	return (format == CAIRO_FORMAT_ARGB32) || (format == CAIRO_FORMAT_RGB24);
+}
+
+
+static gboolean
+step_is_complete (Step *step)
+{
+	return ! step->tiled || step->keyframe;
+}
+
+
+static gboolean
+step_has_tile (Step *step,
+	       int   column,
+	       int   row)
+{
+	return (step->changed == NULL) || step->changed[(row * step->columns) + column];
+}
+
+
+static gsize
+step_get_row_size (Step *step,
+		   int   row)
+{
+	gsize size = 0;
+	int   height;
+	int   column;
+
+	height = MIN (TILE_SIZE, step->height - (row * TILE_SIZE));
+	for (column = 0; column < step->columns; column++)
+		if (step_has_tile (step, column, row))
+			size += (gsize) MIN (TILE_SIZE, step->width - (column * TILE_SIZE)) * height * 4;
+
+	return size;
+}
+
+
+/* Copies the tiles of @row saved in the step from the surface data to
+ * @buffer, or the other way around if @to_buffer is FALSE. */
+static void
+step_copy_row (Step     *step,
+	       int       row,
+	       guchar   *surface_data,
+	       int       stride,
+	       guchar   *buffer,
+	       gboolean  to_buffer)
+{
+	int y1, y2;
+	int column;
+	int y;
+
+	y1 = row * TILE_SIZE;
+	y2 = MIN (y1 + TILE_SIZE, step->height);
+	for (column = 0; column < step->columns; column++) {
+		int    x;
+		gsize  size;
+
+		if (! step_has_tile (step, column, row))
+			continue;
+
+		x = column * TILE_SIZE;
+		size = (gsize) MIN (TILE_SIZE, step->width - x) * 4;
+		for (y = y1; y < y2; y++) {
+			guchar *p = surface_data + ((gsize) y * stride) + (x * 4);
+
+			if (to_buffer)
+				memcpy (buffer, p, size);
+			else
+				memcpy (p, buffer, size);
+			buffer += size;
+		}
+	}
+}
+
+
+typedef struct {
+	Step    *step;
+	guchar  *data;
+	int      stride;
+	guchar  *next_data;
+	int      next_stride;
+	guchar **chunks;
+	gsize   *chunk_sizes;
+	int      failed;
+} EncodeData;
+
+
+static void
+find_changed_tiles_cb (int      first,
+		       int      last,
+		       gpointer user_data)
+{
+	EncodeData *encode_data = user_data;
+	Step       *step = encode_data->step;
+	int         row;
+
+	for (row = first; row < last; row++) {
+		int y1, y2;
+		int column;
+
+		y1 = row * TILE_SIZE;
+		y2 = MIN (y1 + TILE_SIZE, step->height);
+		for (column = 0; column < step->columns; column++) {
+			int       x;
+			gsize     size;
+			gboolean  changed;
+			int       y;
+
+			x = column * TILE_SIZE;
+			size = (gsize) MIN (TILE_SIZE, step->width - x) * 4;
+			changed = FALSE;
+			for (y = y1; ! changed && (y < y2); y++)
+				changed = memcmp (encode_data->data + ((gsize) y * encode_data->stride) + (x * 4),
+						  encode_data->next_data + ((gsize) y * encode_data->next_stride) + (x * 4),
+						  size) != 0;
+			step->changed[(row * step->columns) + column] = changed;
+		}
+	}
+}
+
+
+static void
+compress_rows_cb (int      first,
+		  int      last,
+		  gpointer user_data)
+{
+	EncodeData *encode_data = user_data;
+	Step       *step = encode_data->step;
+	int         row;
+
+	for (row = first; row < last; row++) {
+		gsize   row_size;
+		guchar *buffer;
+		uLongf  size;
+
+		row_size = step_get_row_size (step, row);
+		if (row_size == 0)
+			continue;
+
+		buffer = g_malloc (row_size);
+		step_copy_row (step, row, encode_data->data, encode_data->stride, buffer, TRUE);
+
+		size = compressBound (row_size);
+		encode_data->chunks[row] = g_malloc (size);
+		if (compress2 (encode_data->chunks[row], &size, buffer, row_size, Z_BEST_SPEED) == Z_OK)
+			encode_data->chunk_sizes[row] = size;
+		else
+			g_atomic_int_set (&encode_data->failed, TRUE);
+
+		g_free (buffer);
+	}
+}
+
+
+/* Saves the tiles of @surface that differ from @next, or all of them if
+ * @next is NULL.  @n_deltas is the number of steps after this one that are
+ * not keyframes. */
+static gboolean
+step_encode (Step            *step,
+	     cairo_surface_t *surface,
+	     cairo_surface_t *next,
+	     int              n_deltas)
+{
+	EncodeData encode_data;
+	int        n_tiles;
+	int        row;
+
+	step->format = cairo_image_surface_get_format (surface);
+	step->width = cairo_image_surface_get_width (surface);
+	step->height = cairo_image_surface_get_height (surface);
+	if ((step->width == 0) || (step->height == 0))
+		return FALSE;
+
+	step->columns = (step->width + TILE_SIZE - 1) / TILE_SIZE;
+	step->rows = (step->height + TILE_SIZE - 1) / TILE_SIZE;
+	step->keyframe = TRUE;
+	n_tiles = step->columns * step->rows;
+
+	encode_data.step = step;
+	encode_data.data = get_surface_data (surface);
+	encode_data.stride = cairo_image_surface_get_stride (surface);
+
+	if ((next != NULL)
+	    && (n_deltas < KEYFRAME_INTERVAL - 1)
+	    && (cairo_image_surface_get_format (next) == step->format)
+	    && (cairo_image_surface_get_width (next) == step->width)
+	    && (cairo_image_surface_get_height (next) == step->height))
+	{
+		int n_changed;
+		int i;
+
+		encode_data.next_data = get_surface_data (next);
+		encode_data.next_stride = cairo_image_surface_get_stride (next);
+		step->changed = g_new (guint8, n_tiles);
+		_g_parallel_for_bands (step->rows, 1, find_changed_tiles_cb, &encode_data);
+
+		n_changed = 0;
+		for (i = 0; i < n_tiles; i++)
+			n_changed += step->changed[i];
+
+		/* save the whole image if most of it changed */
+
+		if (n_changed * 2 <= n_tiles)
+			step->keyframe = FALSE;
+		else
+			g_clear_pointer (&step->changed, g_free);
+	}
+
+	encode_data.chunks = g_new0 (guchar *, step->rows);
+	encode_data.chunk_sizes = g_new0 (gsize, step->rows);
+	encode_data.failed = FALSE;
+	_g_parallel_for_bands (step->rows, 1, compress_rows_cb, &encode_data);
+
+	step->offsets = g_new (gsize, step->rows + 1);
+	step->offsets[0] = 0;
+	for (row = 0; row < step->rows; row++)
+		step->offsets[row + 1] = step->offsets[row] + encode_data.chunk_sizes[row];
+	step->size = step->offsets[step->rows];
+
+	if (! encode_data.failed) {
+		step->data = g_malloc (MAX (step->size, 1));
+		for (row = 0; row < step->rows; row++)
+			if (encode_data.chunks[row] != NULL)
+				memcpy (step->data + step->offsets[row], encode_data.chunks[row], encode_data.chunk_sizes[row]);
+	}
+
+	for (row = 0; row < step->rows; row++)
+		g_free (encode_data.chunks[row]);
+	g_free (encode_data.chunks);
+	g_free (encode_data.chunk_sizes);
+
+	if (encode_data.failed) {
+		g_clear_pointer (&step->changed, g_free);
+		g_clear_pointer (&step->offsets, g_free);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static Step *
+step_new (cairo_surface_t *surface,
+	  gpointer         user_data,
+	  gsize            user_data_size,
+	  cairo_surface_t *next,
+	  int              n_deltas)
+{
+	Step *step;
+
+	step = g_new0 (Step, 1);
+	step->user_data = user_data;
+	step->user_data_size = user_data_size;
+	step->file_offset = -1;
+
+	if (surface_is_tileable (surface) && step_encode (step, surface, surface_is_tileable (next) ? next : NULL, n_deltas))
+		step->tiled = TRUE;
+	else if (surface != NULL)
+		step->surface = cairo_surface_reference (surface);
+
+	return step;
+}
+
+
+static void
+step_free (Step           *step,
+	   GDestroyNotify  data_free)
+{
+	if ((step->user_data != NULL) && (data_free != NULL))
+		data_free (step->user_data);
+	if (step->surface != NULL)
+		cairo_surface_destroy (step->surface);
+	g_free (step->changed);
+	g_free (step->offsets);
+	g_free (step->data);
+	g_free (step);
+}
+
+
+static gsize
+step_get_memory_size (Step *step)
+{
+	gsize size;
+
+	size = step->user_data_size;
+	if (step->surface != NULL)
+		size += (gsize) cairo_image_surface_get_stride (step->surface) * cairo_image_surface_get_height (step->surface);
+	if (step->data != NULL)
+		size += step->size;
+
+	return size;
+}
+
+
+static gsize
+step_get_file_size (Step *step)
+{
+	return (step->tiled && (step->data == NULL)) ? step->size : 0;
+}
+
+
+typedef struct {
+	Step   *step;
+	guchar *data;
+	guchar *surface_data;
+	int     stride;
+	int     failed;
+} DecodeData;
+
+
+static void
+decompress_rows_cb (int      first,
+		    int      last,
+		    gpointer user_data)
+{
+	DecodeData *decode_data = user_data;
+	Step       *step = decode_data->step;
+	int         row;
+
+	for (row = first; row < last; row++) {
+		gsize   row_size;
+		guchar *buffer;
+		uLongf  size;
+
+		row_size = step_get_row_size (step, row);
+		if (row_size == 0)
+			continue;
+
+		buffer = g_malloc (row_size);
+		size = row_size;
+		if ((uncompress (buffer, &size, decode_data->data + step->offsets[row], step->offsets[row + 1] - step->offsets[row]) == Z_OK)
+		    && (size == row_size))
+		{
+			step_copy_row (step, row, decode_data->surface_data, decode_data->stride, buffer, FALSE);
+		}
+		else
+			g_atomic_int_set (&decode_data->failed, TRUE);
+
+		g_free (buffer);
+	}
+}
+
+
+/* GthSurfaceHistory */
+
+
+typedef struct {
+	goffset offset;
+	gsize   size;
+} Extent;
+
+
+struct _GthSurfaceHistory {
+	cairo_surface_t *current;
+	gpointer         current_data;
+	gsize            current_data_size;
+	GDestroyNotify   data_free;
+	GQueue           undo_steps;       /* Step items, the head is the closest to the current surface */
+	GQueue           redo_steps;       /* Step items, the head is the closest to the current surface */
+	gsize            memory_size;
+	gsize            max_memory_size;
+	GFile           *directory;
+	GFileIOStream   *file_stream;      /* the steps that don't fit in memory */
+	GList           *free_extents;     /* Extent items, the unused parts of the file, sorted by offset */
+	goffset          file_end;
+	gsize            file_size;
+	gsize            max_file_size;
+};
+
+
+GthSurfaceHistory *
+gth_surface_history_new (gsize           max_memory_size,
+			 gsize           max_file_size,
+			 GFile          *directory,
+			 GDestroyNotify  data_free)
+{
+	GthSurfaceHistory *history;
+
+	history = g_new0 (GthSurfaceHistory, 1);
+	history->current = NULL;
+	history->current_data = NULL;
+	history->data_free = data_free;
+	g_queue_init (&history->undo_steps);
+	g_queue_init (&history->redo_steps);
+	history->memory_size = 0;
+	history->max_memory_size = max_memory_size;
+	history->directory = (directory != NULL) ? g_object_ref (directory) : NULL;
+	history->file_stream = NULL;
+	history->free_extents = NULL;
+	history->file_end = 0;
+	history->file_size = 0;
+	history->max_file_size = max_file_size;
+
+	return history;
+}
+
+
+void
+gth_surface_history_free (GthSurfaceHistory *history)
+{
+	if (history == NULL)
+		return;
+
+	gth_surface_history_clear (history);
+	g_clear_object (&history->directory);
+	g_free (history);
+}
+
+
+/* -- file extents -- */
+
+
+/* Returns the offset of @size free bytes in the file, the space of the
+ * removed steps is used first, the file never grows over max_file_size. */
+static goffset
+_gth_surface_history_alloc_extent (GthSurfaceHistory *history,
+				   gsize              size)
+{
+	GList   *scan;
+	goffset  offset;
+
+	for (scan = history->free_extents; scan; scan = scan->next) {
+		Extent *extent = scan->data;
+
+		if (extent->size < size)
+			continue;
+
+		offset = extent->offset;
+		extent->offset += size;
+		extent->size -= size;
+		if (extent->size == 0) {
+			history->free_extents = g_list_delete_link (history->free_extents, scan);
+			g_free (extent);
+		}
+
+		return offset;
+	}
+
+	if (history->file_end + size > history->max_file_size)
+		return -1;
+
+	offset = history->file_end;
+	history->file_end += size;
+
+	return offset;
+}
+
+
+static void
+_gth_surface_history_free_extent (GthSurfaceHistory *history,
+				  goffset            offset,
+				  gsize              size)
+{
+	GList  *scan;
+	GList  *prev;
+	Extent *extent;
+
+	if (size == 0)
+		return;
+
+	prev = NULL;
+	for (scan = history->free_extents; scan && (((Extent *) scan->data)->offset < offset); scan = scan->next)
+		prev = scan;
+
+	if ((prev != NULL) && (((Extent *) prev->data)->offset + ((Extent *) prev->data)->size == offset)) {
+		extent = prev->data;
+		extent->size += size;
+	}
+	else {
+		extent = g_new (Extent, 1);
+		extent->offset = offset;
+		extent->size = size;
+		history->free_extents = g_list_insert_before (history->free_extents, scan, extent);
+		prev = g_list_find (history->free_extents, extent);
+	}
+
+	/* merge with the following extent */
+
+	if ((prev->next != NULL) && (extent->offset + extent->size == ((Extent *) prev->next->data)->offset)) {
+		Extent *next = prev->next->data;
+
+		extent->size += next->size;
+		history->free_extents = g_list_delete_link (history->free_extents, prev->next);
+		g_free (next);
+	}
+
+	/* give the space at the end of the file back */
+
+	if (extent->offset + extent->size == history->file_end) {
+		history->file_end = extent->offset;
+		history->free_extents = g_list_delete_link (history->free_extents, prev);
+		g_free (extent);
+
+		if ((history->file_stream != NULL) && g_seekable_can_truncate (G_SEEKABLE (history->file_stream)))
+			g_seekable_truncate (G_SEEKABLE (history->file_stream), history->file_end, NULL, NULL);
+	}
+}
+
+
+/* -- steps -- */
+
+
+static void
+_gth_surface_history_remove_step (GthSurfaceHistory *history,
+				  Step              *step)
+{
+	history->memory_size -= step_get_memory_size (step);
+	history->file_size -= step_get_file_size (step);
+	if (step_get_file_size (step) > 0)
+		_gth_surface_history_free_extent (history, step->file_offset, step->size);
+
+	step_free (step, history->data_free);
+}
+
+
+static void
+_gth_surface_history_clear_steps (GthSurfaceHistory *history,
+				  GQueue            *steps)
+{
+	Step *step;
+
+	while ((step = g_queue_pop_head (steps)) != NULL)
+		_gth_surface_history_remove_step (history, step);
+}
+
+
+/* Creates the file in the directory of the history, the file is deleted
+ * at once, the data is removed when the stream is closed. */
+static GFileIOStream *
+_gth_surface_history_create_file (GthSurfaceHistory *history)
+{
+	GFileIOStream *stream = NULL;
+	int            i;
+
+	if (history->directory == NULL)
+		return NULL;
+
+	for (i = 0; (stream == NULL) && (i < MAX_FILE_ATTEMPTS); i++) {
+		char   *random;
+		char   *name;
+		GFile  *file;
+		GError *error = NULL;
+
+		random = _g_str_random (8);
+		name = g_strconcat ("history-", random, NULL);
+		file = g_file_get_child (history->directory, name);
+		stream = g_file_create_readwrite (file, G_FILE_CREATE_PRIVATE, NULL, &error);
+		if (stream != NULL)
+			g_file_delete (file, NULL, NULL);
+
+		g_object_unref (file);
+		g_free (name);
+		g_free (random);
+
+		if ((error != NULL) && ! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+			g_error_free (error);
+			break;
+		}
+		g_clear_error (&error);
+	}
+
+	return stream;
+}
+
+
+static gboolean
+_gth_surface_history_save_step_to_file (GthSurfaceHistory *history,
+					Step              *step)
+{
+	goffset offset;
+
+	if (step->data == NULL)
+		return FALSE;
+
+	if (history->file_size + step->size > history->max_file_size)
+		return FALSE;
+
+	if (history->file_stream == NULL) {
+		history->file_stream = _gth_surface_history_create_file (history);
+		if (history->file_stream == NULL)
+			return FALSE;
+	}
+
+	offset = _gth_surface_history_alloc_extent (history, step->size);
+	if (offset < 0)
+		return FALSE;
+
+	if (! g_seekable_seek (G_SEEKABLE (history->file_stream), offset, G_SEEK_SET, NULL, NULL)
+	    || ! g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (history->file_stream)),
+					    step->data,
+					    step->size,
+					    NULL,
+					    NULL,
+					    NULL))
+	{
+		_gth_surface_history_free_extent (history, offset, step->size);
+		return FALSE;
+	}
+
+	history->memory_size -= step->size;
+	history->file_size += step->size;
+	step->file_offset = offset;
+	g_clear_pointer (&step->data, g_free);
+
+	return TRUE;
+}
+
+
+static guchar *
+_gth_surface_history_read_step_from_file (GthSurfaceHistory *history,
+					  Step              *step)
+{
+	guchar *data;
+	gsize   bytes_read;
+
+	if (history->file_stream == NULL)
+		return NULL;
+
+	data = g_malloc (MAX (step->size, 1));
+	if (! g_seekable_seek (G_SEEKABLE (history->file_stream), step->file_offset, G_SEEK_SET, NULL, NULL)
+	    || ! g_input_stream_read_all (g_io_stream_get_input_stream (G_IO_STREAM (history->file_stream)),
+					  data,
+					  step->size,
+					  &bytes_read,
+					  NULL,
+					  NULL)
+	    || (bytes_read != step->size))
+	{
+		g_free (data);
+		return NULL;
+	}
+
+	return data;
+}
+
+
+/* Sets @surface to the surface of @step, or to NULL if the step has no
+ * surface.  @next is the surface that comes after @step, in the direction
+ * of the current surface.  Returns FALSE if the step cannot be decoded. */
+static gboolean
+_gth_surface_history_decode_step (GthSurfaceHistory  *history,
+				  Step               *step,
+				  cairo_surface_t    *next,
+				  cairo_surface_t   **surface)
+{
+	DecodeData decode_data;
+
+	*surface = NULL;
+
+	if (! step->tiled) {
+		if (step->surface != NULL)
+			*surface = cairo_surface_reference (step->surface);
+		return TRUE;
+	}
+
+	if (step->keyframe) {
+		*surface = create_surface (step->format, step->width, step->height);
+	}
+	else {
+		if (! surface_is_tileable (next)
+		    || (cairo_image_surface_get_format (next) != step->format)
+		    || (cairo_image_surface_get_width (next) != step->width)
+		    || (cairo_image_surface_get_height (next) != step->height))
+		{
+			return FALSE;
+		}
+
+		*surface = create_surface (step->format, step->width, step->height);
+		if (*surface != NULL)
+			memcpy (get_surface_data (*surface),
+				get_surface_data (next),
+				(gsize) cairo_image_surface_get_stride (next) * step->height);
+	}
+	if (*surface == NULL)
+		return FALSE;
+
+	decode_data.step = step;
+	decode_data.data = (step->data != NULL) ? step->data : _gth_surface_history_read_step_from_file (history, step);
+	decode_data.surface_data = get_surface_data (*surface);
+	decode_data.stride = cairo_image_surface_get_stride (*surface);
+	decode_data.failed = (decode_data.data == NULL);
+	if (! decode_data.failed)
+		_g_parallel_for_bands (step->rows, 1, decompress_rows_cb, &decode_data);
+	cairo_surface_mark_dirty (*surface);
+
+	if (decode_data.data != step->data)
+		g_free (decode_data.data);
+
+	if (decode_data.failed) {
+		g_clear_pointer (surface, cairo_surface_destroy);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* Moves the steps farthest from the current surface to the file, and
+ * drops them when the file is full as well. */
+static void
+_gth_surface_history_reduce_size (GthSurfaceHistory *history)
+{
+	while ((history->memory_size > history->max_memory_size) || (history->file_size > history->max_file_size)) {
+		Step  *step = NULL;
+		GList *scan;
+
+		if (history->memory_size > history->max_memory_size) {
+			for (scan = history->undo_steps.tail; (step == NULL) && scan; scan = scan->prev)
+				if (((Step *) scan->data)->data != NULL)
+					step = scan->data;
+			for (scan = history->redo_steps.tail; (step == NULL) && scan; scan = scan->prev)
+				if (((Step *) scan->data)->data != NULL)
+					step = scan->data;
+
+			if ((step != NULL) && _gth_surface_history_save_step_to_file (history, step))
+				continue;
+		}
+
+		if (! g_queue_is_empty (&history->undo_steps))
+			step = g_queue_pop_tail (&history->undo_steps);
+		else if (! g_queue_is_empty (&history->redo_steps))
+			step = g_queue_pop_tail (&history->redo_steps);
+		else
+			break;
+		_gth_surface_history_remove_step (history, step);
+	}
+}
+
+
+/* Saves the current surface as the first step of @steps, and makes
+ * @surface the current one. */
+static void
+_gth_surface_history_set_current (GthSurfaceHistory *history,
+				  GQueue            *steps,
+				  cairo_surface_t   *surface,
+				  gpointer           data,
+				  gsize              data_size)
+{
+	if (history->current_data != NULL) {
+		int    n_deltas;
+		GList *scan;
+		Step  *step;
+
+		n_deltas = 0;
+		for (scan = steps->head; scan && ! step_is_complete (scan->data); scan = scan->next)
+			n_deltas++;
+
+		step = step_new (history->current, history->current_data, history->current_data_size, surface, n_deltas);
+		g_queue_push_head (steps, step);
+		history->memory_size += step_get_memory_size (step);
+
+		if (history->current != NULL)
+			cairo_surface_destroy (history->current);
+	}
+
+	history->current = (surface != NULL) ? cairo_surface_reference (surface) : NULL;
+	history->current_data = data;
+	history->current_data_size = data_size;
+	_gth_surface_history_reduce_size (history);
+}
+
+
+/* Makes @surface the current one and removes the redo steps, the history
+ * takes ownership of @data.  If @data is NULL only the redo steps are
+ * removed. */
+void
+gth_surface_history_add (GthSurfaceHistory *history,
+			 cairo_surface_t   *surface,
+			 gpointer           data,
+			 gsize              data_size)
+{
+	_gth_surface_history_clear_steps (history, &history->redo_steps);
+	if (data != NULL)
+		_gth_surface_history_set_current (history, &history->undo_steps, surface, data, data_size);
+}
+
+
+/* Makes the first step of @from the current one, the current surface
+ * becomes the first step of @to. */
+static gpointer
+_gth_surface_history_move (GthSurfaceHistory  *history,
+			   GQueue             *from,
+			   GQueue             *to,
+			   cairo_surface_t   **surface)
+{
+	Step            *step;
+	cairo_surface_t *step_surface;
+	gpointer         data = NULL;
+	gsize            data_size;
+
+	step = g_queue_pop_head (from);
+	if (_gth_surface_history_decode_step (history, step, history->current, &step_surface)) {
+		data = step->user_data;
+		data_size = step->user_data_size;
+		step->user_data = NULL;
+	}
+	_gth_surface_history_remove_step (history, step);
+
+	if (data != NULL)
+		_gth_surface_history_set_current (history, to, step_surface, data, data_size);
+	else /* the other steps cannot be restored without this one */
+		_gth_surface_history_clear_steps (history, from);
+
+	if (surface != NULL)
+		*surface = step_surface;
+	else if (step_surface != NULL)
+		cairo_surface_destroy (step_surface);
+
+	return data;
+}
+
+
+/* Returns the data of the new current step, and sets @surface to its
+ * surface, or returns NULL if the step cannot be restored. */
+gpointer
+gth_surface_history_undo (GthSurfaceHistory  *history,
+			  cairo_surface_t   **surface)
+{
+	if (surface != NULL)
+		*surface = NULL;
+
+	if (! gth_surface_history_can_undo (history))
+		return NULL;
+
+	return _gth_surface_history_move (history,
+					  &history->undo_steps,
+					  &history->redo_steps,
+					  surface);
+}
+
+
+gpointer
+gth_surface_history_redo (GthSurfaceHistory  *history,
+			  cairo_surface_t   **surface)
+{
+	if (surface != NULL)
+		*surface = NULL;
+
+	if (! gth_surface_history_can_redo (history))
+		return NULL;
+
+	return _gth_surface_history_move (history,
+					  &history->redo_steps,
+					  &history->undo_steps,
+					  surface);
+}
+
+
+gboolean
+gth_surface_history_can_undo (GthSurfaceHistory *history)
+{
+	return (history->current_data != NULL) && ! g_queue_is_empty (&history->undo_steps);
+}
+
+
+gboolean
+gth_surface_history_can_redo (GthSurfaceHistory *history)
+{
+	return (history->current_data != NULL) && ! g_queue_is_empty (&history->redo_steps);
+}
+
+
+int
+gth_surface_history_get_n_undo (GthSurfaceHistory *history)
+{
+	return (history->current_data != NULL) ? g_queue_get_length (&history->undo_steps) : 0;
+}
+
+
+/* Returns the data of the undo step @n, 0 is the closest to the current
+ * surface, and sets @surface to its surface, decoded starting from the
+ * closest keyframe.  Nothing is decoded if @surface is NULL.  The history
+ * doesn't change. */
+gpointer
+gth_surface_history_get_undo (GthSurfaceHistory  *history,
+			      int                 n,
+			      cairo_surface_t   **surface)
+{
+	GList           *link;
+	GList           *scan;
+	cairo_surface_t *step_surface;
+
+	if (surface != NULL)
+		*surface = NULL;
+
+	if ((n < 0) || (n >= gth_surface_history_get_n_undo (history)))
+		return NULL;
+
+	link = g_queue_peek_nth_link (&history->undo_steps, n);
+	if (surface == NULL)
+		return ((Step *) link->data)->user_data;
+
+	for (scan = link; scan && ! step_is_complete (scan->data); scan = scan->prev)
+		/* void */;
+
+	if (scan != NULL) {
+		step_surface = NULL;
+	}
+	else {
+		step_surface = (history->current != NULL) ? cairo_surface_reference (history->current) : NULL;
+		scan = history->undo_steps.head;
+	}
+
+	while (TRUE) {
+		cairo_surface_t *next = step_surface;
+		gboolean         decoded;
+
+		decoded = _gth_surface_history_decode_step (history, scan->data, next, &step_surface);
+		if (next != NULL)
+			cairo_surface_destroy (next);
+
+		if (! decoded)
+			return NULL;
+
+		if (scan == link)
+			break;
+		scan = scan->next;
+	}
+
+	*surface = step_surface;
+
+	return ((Step *) link->data)->user_data;
+}
+
+
+void
+gth_surface_history_clear (GthSurfaceHistory *history)
+{
+	_gth_surface_history_clear_steps (history, &history->undo_steps);
+	_gth_surface_history_clear_steps (history, &history->redo_steps);
+	g_clear_object (&history->file_stream);
+	g_list_free_full (history->free_extents, g_free);
+	history->free_extents = NULL;
+	history->file_end = 0;
+
+	if (history->current != NULL) {
+		cairo_surface_destroy (history->current);
+		history->current = NULL;
+	}
+	if ((history->current_data != NULL) && (history->data_free != NULL))
+		history->data_free (history->current_data);
+	history->current_data = NULL;
+	history->current_data_size = 0;
+}
+
+
+void
+gth_surface_history_get_stats (GthSurfaceHistory *history,
+			       gsize             *memory_size,
+			       gsize             *file_size,
+			       goffset           *file_end)
+{
+	if (memory_size != NULL)
+		*memory_size = history->memory_size;
+	if (file_size != NULL)
+		*file_size = history->file_size;
+	if (file_end != NULL)
+		*file_end = history->file_end;
+}
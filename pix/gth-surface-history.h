@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2006-2009 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTH_SURFACE_HISTORY_H
+#define GTH_SURFACE_HISTORY_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <cairo.h>
+
+G_BEGIN_DECLS
+
+/* The undo and redo steps of an image.  Each step has some data, owned by
+ * the history, and a surface, or no surface when the image cannot be saved
+ * as tiles; in that case the data keeps the whole image and @data_size is
+ * the memory it uses.  The surfaces are saved as compressed tiles, the
+ * steps that don't fit in @max_memory_size are moved to a file in
+ * @directory, and dropped when the file would grow over @max_file_size. */
+
+typedef struct _GthSurfaceHistory GthSurfaceHistory;
+
+GthSurfaceHistory * gth_surface_history_new        (gsize               max_memory_size,
+						    gsize               max_file_size,
+						    GFile              *directory,
+						    GDestroyNotify      data_free);
+void                gth_surface_history_free       (GthSurfaceHistory  *history);
+void                gth_surface_history_add        (GthSurfaceHistory  *history,
+						    cairo_surface_t    *surface,
+						    gpointer            data,
+						    gsize               data_size);
+gpointer            gth_surface_history_undo       (GthSurfaceHistory  *history,
+						    cairo_surface_t   **surface);
+gpointer            gth_surface_history_redo       (GthSurfaceHistory  *history,
+						    cairo_surface_t   **surface);
+gboolean            gth_surface_history_can_undo   (GthSurfaceHistory  *history);
+gboolean            gth_surface_history_can_redo   (GthSurfaceHistory  *history);
+int                 gth_surface_history_get_n_undo (GthSurfaceHistory  *history);
+gpointer            gth_surface_history_get_undo   (GthSurfaceHistory  *history,
+						    int                 n,
+						    cairo_surface_t   **surface);
+void                gth_surface_history_clear      (GthSurfaceHistory  *history);
+void                gth_surface_history_get_stats  (GthSurfaceHistory  *history,
+						    gsize              *memory_size,
+						    gsize              *file_size,
+						    goffset            *file_end);
+
+G_END_DECLS
+
+#endif /* GTH_SURFACE_HISTORY_H */
@@ -281,6 +281,13 @@ gth_test_aspect_ratio_real_match (GthTest     *test,
 }
 
 
+static GthTestCost
+gth_test_aspect_ratio_real_get_cost (GthTest *test)
+{
+	return GTH_TEST_COST_LOW;
+}
+
+
 static DomElement*
 gth_test_aspect_ratio_real_create_element (DomDomizable *base,
 					   DomDocument  *doc)
@@ -417,6 +424,7 @@ gth_test_aspect_ratio_class_init (GthTestAspectRatioClass *class)
 	test_class->update_from_control = gth_test_aspect_ratio_real_update_from_control;
 	test_class->focus_control = gth_test_aspect_ratio_real_focus_control;
 	test_class->match = gth_test_aspect_ratio_real_match;
+	test_class->get_cost = gth_test_aspect_ratio_real_get_cost;
 }
 
 
@@ -332,6 +332,13 @@ gth_test_category_real_match (GthTest     *test,
 }
 
 
+static GthTestCost
+gth_test_category_real_get_cost (GthTest *test)
+{
+	return GTH_TEST_COST_HIGH;
+}
+
+
 static DomElement*
 gth_test_category_real_create_element (DomDomizable *base,
 				       DomDocument  *doc)
@@ -470,6 +477,7 @@ gth_test_category_class_init (GthTestCategoryClass *class)
 	test_class->update_from_control = gth_test_category_real_update_from_control;
 	test_class->focus_control = gth_test_category_real_focus_control;
 	test_class->match = gth_test_category_real_match;
+	test_class->get_cost = gth_test_category_real_get_cost;
 }
 
 
@@ -516,3 +524,18 @@ gth_test_category_set (GthTestCategory *self,
 	self->priv->negative = negative;
 	gth_test_category_set_category (self, value);
 }
+
+
+void
+gth_test_category_get (GthTestCategory  *self,
+		       GthTestOp        *op,
+		       gboolean         *negative,
+		       const char      **value)
+{
+	if (op != NULL)
+		*op = self->priv->op;
+	if (negative != NULL)
+		*negative = self->priv->negative;
+	if (value != NULL)
+		*value = self->priv->category;
+}
@@ -52,5 +52,9 @@ void   gth_test_category_set       (GthTestCategory *self,
 				    GthTestOp        op,
 				    gboolean         negative,
 				    const char      *value);
+void   gth_test_category_get       (GthTestCategory *self,
+				    GthTestOp       *op,
+				    gboolean        *negative,
+				    const char     **value);
 
 #endif /* GTH_TEST_CATEGORY_H */
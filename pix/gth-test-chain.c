@@ -31,6 +31,7 @@
 struct _GthTestChainPrivate {
 	GthMatchType  match_type;
 	GList        *tests;
+	GList        *sorted_tests;	/* the tests in evaluation order */
 	GString      *attributes;
 };
 
@@ -60,6 +61,7 @@ gth_test_chain_finalize (GObject *object)
 
 	test = GTH_TEST_CHAIN (object);
 
+	g_list_free (test->priv->sorted_tests);
 	_g_object_list_unref (test->priv->tests);
 	if (test->priv->attributes != NULL)
 		g_string_free (test->priv->attributes, TRUE);
@@ -68,6 +70,14 @@ gth_test_chain_finalize (GObject *object)
 }
 
 
+static int
+compare_test_cost (gconstpointer a,
+		   gconstpointer b)
+{
+	return gth_test_get_cost ((GthTest *) a) - gth_test_get_cost ((GthTest *) b);
+}
+
+
 static GthMatch
 gth_test_chain_match (GthTest     *test,
 		      GthFileData *file)
@@ -81,8 +91,14 @@ gth_test_chain_match (GthTest     *test,
 	if (chain->priv->match_type == GTH_MATCH_TYPE_NONE)
 		return GTH_MATCH_YES;
 
+	/* the result doesn't depend on the order of the tests, evaluate the
+	 * cheaper tests first to stop as soon as possible. */
+
+	if ((chain->priv->sorted_tests == NULL) && (chain->priv->tests != NULL))
+		chain->priv->sorted_tests = g_list_sort (g_list_copy (chain->priv->tests), compare_test_cost);
+
 	match = (chain->priv->match_type == GTH_MATCH_TYPE_ALL) ? GTH_MATCH_YES : GTH_MATCH_NO;
-	for (scan = chain->priv->tests; scan; scan = scan->next) {
+	for (scan = chain->priv->sorted_tests; scan; scan = scan->next) {
 		GthTest *test = scan->data;
 
 		if (gth_test_match (test, file)) {
@@ -128,6 +144,20 @@ gth_test_chain_get_attributes (GthTest *test)
 }
 
 
+static GthTestCost
+gth_test_chain_get_cost (GthTest *test)
+{
+	GthTestChain *chain = GTH_TEST_CHAIN (test);
+	GthTestCost   cost = GTH_TEST_COST_LOW;
+	GList        *scan;
+
+	for (scan = chain->priv->tests; scan; scan = scan->next)
+		cost = MAX (cost, gth_test_get_cost (scan->data));
+
+	return cost;
+}
+
+
 static void
 gth_test_chain_class_init (GthTestChainClass *class)
 {
@@ -140,6 +170,7 @@ gth_test_chain_class_init (GthTestChainClass *class)
 	test_class = (GthTestClass *) class;
 	test_class->match = gth_test_chain_match;
 	test_class->get_attributes = gth_test_chain_get_attributes;
+	test_class->get_cost = gth_test_chain_get_cost;
 }
 
 
@@ -244,6 +275,7 @@ gth_test_chain_init (GthTestChain *test)
 	test->priv = gth_test_chain_get_instance_private (test);
 	test->priv->match_type = GTH_MATCH_TYPE_NONE;
 	test->priv->tests = NULL;
+	test->priv->sorted_tests = NULL;
 	test->priv->attributes = NULL;
 }
 
@@ -289,6 +321,8 @@ gth_test_chain_clear_tests (GthTestChain *chain)
 {
 	if (chain->priv->tests == NULL)
 		return;
+	g_list_free (chain->priv->sorted_tests);
+	chain->priv->sorted_tests = NULL;
 	_g_object_list_unref (chain->priv->tests);
 	chain->priv->tests = NULL;
 	g_object_set (chain, "attributes", "", NULL);
@@ -306,6 +340,8 @@ gth_test_chain_add_test (GthTestChain *chain,
 
 	g_object_set (test, "visible", TRUE, NULL);
 	chain->priv->tests = g_list_append (chain->priv->tests, g_object_ref (test));
+	g_list_free (chain->priv->sorted_tests);
+	chain->priv->sorted_tests = NULL;
 
 	old_attributes = gth_test_get_attributes (GTH_TEST (chain));
 	test_attributes = gth_test_get_attributes (test);
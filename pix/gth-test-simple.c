@@ -36,6 +36,9 @@
 #include "gth-time-selector.h"
 
 
+#define STRING_BUFFER_SIZE 256
+
+
 typedef struct {
 	char      *name;
 	GthTestOp  op;
@@ -112,6 +115,9 @@ struct _GthTestSimplePrivate {
 	gint64           max_int;
 	double           max_double;
 	GPatternSpec    *pattern;
+	char            *casefolded;
+	char            *collate_key;
+	gboolean         ascii;
 	gboolean         has_focus;
 	GtkWidget       *text_entry;
 	GtkWidget       *text_op_combo_box;
@@ -141,6 +147,21 @@ G_DEFINE_TYPE_WITH_CODE (GthTestSimple,
 						gth_test_simple_gth_duplicable_interface_init))
 
 
+static void
+_gth_test_simple_free_compiled_data (GthTestSimple *test)
+{
+	if (test->priv->pattern != NULL) {
+		g_pattern_spec_free (test->priv->pattern);
+		test->priv->pattern = NULL;
+	}
+	g_free (test->priv->casefolded);
+	test->priv->casefolded = NULL;
+	g_free (test->priv->collate_key);
+	test->priv->collate_key = NULL;
+	test->priv->ascii = FALSE;
+}
+
+
 static void
 _gth_test_simple_free_data (GthTestSimple *test)
 {
@@ -160,10 +181,7 @@ _gth_test_simple_free_data (GthTestSimple *test)
 		break;
 	}
 
-	if (test->priv->pattern != NULL) {
-		g_pattern_spec_free (test->priv->pattern);
-		test->priv->pattern = NULL;
-	}
+	_gth_test_simple_free_compiled_data (test);
 }
 
 
@@ -175,8 +193,6 @@ gth_test_simple_finalize (GObject *object)
 	test = GTH_TEST_SIMPLE (object);
 
 	_gth_test_simple_free_data (test);
-	if (test->priv->pattern != NULL)
-		g_pattern_spec_free (test->priv->pattern);
 
 	G_OBJECT_CLASS (gth_test_simple_parent_class)->finalize (object);
 }
@@ -621,57 +637,116 @@ gth_test_simple_real_create_control (GthTest *test)
 }
 
 
+/* Prepares the test value for the string comparisons, once when the value
+ * changes instead of once for each file.  This is done here and not in
+ * test_string because the tests can be evaluated in a worker thread. */
+static void
+_gth_test_simple_compile (GthTestSimple *test)
+{
+	_gth_test_simple_free_compiled_data (test);
+
+	if (test->priv->data.s == NULL)
+		return;
+
+	test->priv->casefolded = g_utf8_casefold (test->priv->data.s, -1);
+	test->priv->collate_key = g_utf8_collate_key (test->priv->casefolded, -1);
+	test->priv->ascii = g_str_is_ascii (test->priv->casefolded);
+	test->priv->pattern = g_pattern_spec_new (test->priv->data.s);
+}
+
+
+/* Returns the casefolded @value, the ASCII strings are converted in @buffer
+ * without allocating memory. */
+static char *
+_gth_test_simple_casefold_value (const char *value,
+				 char       *buffer,
+				 gsize       buffer_size)
+{
+	gsize i;
+
+	for (i = 0; value[i] != '\0'; i++) {
+		if ((i == buffer_size - 1) || ((guchar) value[i] >= 0x80))
+			return g_utf8_casefold (value, -1);
+		buffer[i] = g_ascii_tolower (value[i]);
+	}
+	buffer[i] = '\0';
+
+	return buffer;
+}
+
+
+/* The ASCII strings are compared byte by byte, the collation key is only
+ * created for the other strings. */
+static int
+_gth_test_simple_collate (GthTestSimple *test,
+			  const char    *value,
+			  gboolean       ascii)
+{
+	char *key;
+	int   result;
+
+	result = strcmp (value, test->priv->casefolded);
+	if ((result == 0) || (ascii && test->priv->ascii))
+		return result;
+
+	key = g_utf8_collate_key (value, -1);
+	result = strcmp (key, test->priv->collate_key);
+	g_free (key);
+
+	return result;
+}
+
+
 static gboolean
 test_string (GthTestSimple *test,
 	     char          *value)
 {
 	gboolean  result = FALSE;
-	char     *value1;
-	char     *value2;
+	char      buffer[STRING_BUFFER_SIZE];
+	char     *casefolded;
+	gboolean  ascii;
 
 	if ((test->priv->data.s == NULL) || (value == NULL))
 		return FALSE;
 
-	value1 = g_utf8_casefold (test->priv->data.s, -1);
-	value2 = g_utf8_casefold (value, -1);
+	casefolded = _gth_test_simple_casefold_value (value, buffer, sizeof (buffer));
+	ascii = (casefolded == buffer);
 
 	switch (test->priv->op) {
 	case GTH_TEST_OP_EQUAL:
-		result = g_utf8_collate (value2, value1) == 0;
+		result = _gth_test_simple_collate (test, casefolded, ascii) == 0;
 		break;
 
 	case GTH_TEST_OP_LOWER:
-		result = g_utf8_collate (value2, value1) < 0;
+		result = _gth_test_simple_collate (test, casefolded, ascii) < 0;
 		break;
 
 	case GTH_TEST_OP_GREATER:
-		result = g_utf8_collate (value2, value1) > 0;
+		result = _gth_test_simple_collate (test, casefolded, ascii) > 0;
 		break;
 
 	case GTH_TEST_OP_CONTAINS:
-		result = g_strstr_len (value2, -1, value1) != NULL;
+		result = strstr (casefolded, test->priv->casefolded) != NULL;
 		break;
 
 	case GTH_TEST_OP_STARTS_WITH:
-		result = g_str_has_prefix (value2, value1);
+		result = g_str_has_prefix (casefolded, test->priv->casefolded);
 		break;
 
 	case GTH_TEST_OP_ENDS_WITH:
-		result = g_str_has_suffix (value2, value1);
+		result = g_str_has_suffix (casefolded, test->priv->casefolded);
 		break;
 
 	case GTH_TEST_OP_MATCHES:
-		if (test->priv->pattern == NULL)
-			test->priv->pattern = g_pattern_spec_new (test->priv->data.s);
-		result = g_pattern_match_string (test->priv->pattern, value2);
+		result = g_pattern_match_string (test->priv->pattern, casefolded);
 		break;
 
 	default:
 		break;
 	}
 
-	g_free (value2);
-	g_free (value1);
+	if (casefolded != buffer)
+		g_free (casefolded);
 
 	return result;
 }
@@ -884,6 +959,24 @@ gth_test_simple_real_match (GthTest   *test,
 }
 
 
+static GthTestCost
+gth_test_simple_real_get_cost (GthTest *test)
+{
+	switch (GTH_TEST_SIMPLE (test)->priv->data_type) {
+	case GTH_TEST_DATA_TYPE_STRING:
+		return GTH_TEST_COST_HIGH;
+
+	case GTH_TEST_DATA_TYPE_DATE:
+		return GTH_TEST_COST_MEDIUM;
+
+	default:
+		break;
+	}
+
+	return GTH_TEST_COST_LOW;
+}
+
+
 static DomElement*
 gth_test_simple_real_create_element (DomDomizable *base,
 				     DomDocument  *doc)
@@ -1270,6 +1363,7 @@ gth_test_simple_set_property (GObject      *object,
 	case PROP_DATA_AS_STRING:
 		_gth_test_simple_free_data (test);
 		test->priv->data.s = g_value_dup_string (value);
+		_gth_test_simple_compile (test);
 		break;
 
 	case PROP_DATA_AS_INT:
@@ -1396,6 +1490,7 @@ gth_test_simple_class_init (GthTestSimpleClass *class)
 	test_class->update_from_control = gth_test_simple_real_update_from_control;
 	test_class->focus_control = gth_test_simple_real_focus_control;
 	test_class->match = gth_test_simple_real_match;
+	test_class->get_cost = gth_test_simple_real_get_cost;
 
 	/* properties */
 
@@ -1518,6 +1613,9 @@ gth_test_simple_init (GthTestSimple *test)
 	test->priv->max_int = 0;
 	test->priv->max_double = 0;
 	test->priv->pattern = NULL;
+	test->priv->casefolded = NULL;
+	test->priv->collate_key = NULL;
+	test->priv->ascii = FALSE;
 	test->priv->has_focus = FALSE;
 	test->priv->text_entry = NULL;
 	test->priv->text_op_combo_box = NULL;
@@ -1536,6 +1634,7 @@ gth_test_simple_set_data_as_string (GthTestSimple *test,
 	_gth_test_simple_free_data (test);
 	test->priv->data_type = GTH_TEST_DATA_TYPE_STRING;
 	test->priv->data.s = g_strdup (s);
+	_gth_test_simple_compile (test);
 }
 
 
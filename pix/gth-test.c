@@ -178,6 +178,13 @@ base_get_next (GthTest *self)
 }
 
 
+static GthTestCost
+base_get_cost (GthTest *self)
+{
+	return GTH_TEST_COST_MEDIUM;
+}
+
+
 static GObject *
 gth_test_real_duplicate (GthDuplicable *duplicable)
 {
@@ -280,6 +287,7 @@ gth_test_class_init (GthTestClass *klass)
 	klass->match = base_match;
 	klass->set_file_list = base_set_file_list;
 	klass->get_next = base_get_next;
+	klass->get_cost = base_get_cost;
 
 	/* properties */
 
@@ -429,3 +437,10 @@ gth_test_get_next (GthTest *self)
 {
 	return GTH_TEST_GET_CLASS (self)->get_next (self);
 }
+
+
+GthTestCost
+gth_test_get_cost (GthTest *self)
+{
+	return GTH_TEST_GET_CLASS (self)->get_cost (self);
+}
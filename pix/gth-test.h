@@ -62,6 +62,14 @@ typedef enum {
 	GTH_TEST_OP_AFTER
 } GthTestOp;
 
+/* Relative cost of gth_test_match, used to evaluate the cheaper tests
+ * first. */
+typedef enum {
+	GTH_TEST_COST_LOW = 0,		/* numbers and file types */
+	GTH_TEST_COST_MEDIUM,		/* dates */
+	GTH_TEST_COST_HIGH		/* strings and lists of strings */
+} GthTestCost;
+
 struct _GthTest {
 	GObject __parent;
 	GthTestPrivate *priv;
@@ -92,6 +100,7 @@ struct _GthTestClass {
 	void          (*set_file_list)        (GthTest     *test,
 					       GList       *files);
 	GthFileData * (*get_next)             (GthTest     *test);
+	GthTestCost   (*get_cost)             (GthTest     *test);
 };
 
 GQuark        gth_test_error_quark         (void);
@@ -112,6 +121,7 @@ GthMatch      gth_test_match               (GthTest      *test,
 void          gth_test_set_file_list       (GthTest      *test,
 					    GList        *files);
 GthFileData * gth_test_get_next            (GthTest      *test);
+GthTestCost   gth_test_get_cost            (GthTest      *test);
 
 G_END_DECLS
 
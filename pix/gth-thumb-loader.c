@@ -25,6 +25,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #define GDK_PIXBUF_ENABLE_BACKEND
 #include <gtk/gtk.h>
@@ -57,7 +58,8 @@ enum {
 
 struct _GthThumbLoaderPrivate {
 	GthImageLoader   *iloader;
-	GthImageLoader   *tloader;
+	GthImageLoaderFunc
+			  loader_func;
 	guint             use_cache : 1;
 	guint             save_thumbnails : 1;
 	int               requested_size;
@@ -70,6 +72,7 @@ struct _GthThumbLoaderPrivate {
 			  thumb_size;
 	GnomeDesktopThumbnailFactory
 			 *thumb_factory;
+	int               priority;
 };
 
 
@@ -86,7 +89,6 @@ gth_thumb_loader_finalize (GObject *object)
 
 	self = GTH_THUMB_LOADER (object);
 	_g_object_unref (self->priv->iloader);
-	_g_object_unref (self->priv->tloader);
 	_g_object_unref (self->priv->thumb_factory);
 
 	G_OBJECT_CLASS (gth_thumb_loader_parent_class)->finalize (object);
@@ -108,7 +110,7 @@ gth_thumb_loader_init (GthThumbLoader *self)
 {
 	self->priv = gth_thumb_loader_get_instance_private (self);
 	self->priv->iloader = NULL;
-	self->priv->tloader = NULL;
+	self->priv->loader_func = NULL;
 	self->priv->use_cache = TRUE;
 	self->priv->save_thumbnails = TRUE;
 	self->priv->requested_size = 0;
@@ -116,6 +118,7 @@ gth_thumb_loader_init (GthThumbLoader *self)
 	self->priv->max_file_size = 0;
 	self->priv->thumb_size = GNOME_DESKTOP_THUMBNAIL_SIZE_NORMAL;
 	self->priv->thumb_factory = NULL;
+	self->priv->priority = G_PRIORITY_LOW;
 }
 
 
@@ -239,7 +242,7 @@ gth_thumb_loader_construct (GthThumbLoader *self,
 {
 	if (requested_size > 0)
 		gth_thumb_loader_set_requested_size (self, requested_size);
-	self->priv->tloader = gth_image_loader_new (generate_thumbnail, self);
+	self->priv->loader_func = generate_thumbnail;
 	self->priv->iloader = gth_image_loader_new (load_cached_thumbnail, NULL);
 }
 
@@ -268,10 +271,11 @@ gth_thumb_loader_copy (GthThumbLoader *self)
 	loader->priv->thumb_size = self->priv->thumb_size;
 	loader->priv->thumb_factory = _g_object_ref (self->priv->thumb_factory);
 
-	gth_thumb_loader_set_loader_func (loader, gth_image_loader_get_loader_func (self->priv->tloader));
+	gth_thumb_loader_set_loader_func (loader, self->priv->loader_func);
 	gth_thumb_loader_set_use_cache (loader, self->priv->use_cache);
 	gth_thumb_loader_set_save_thumbnails (loader, self->priv->save_thumbnails);
 	gth_thumb_loader_set_max_file_size (loader, self->priv->max_file_size);
+	loader->priv->priority = self->priv->priority;
 
 	return loader;
 }
@@ -281,9 +285,7 @@ void
 gth_thumb_loader_set_loader_func (GthThumbLoader     *self,
 				  GthImageLoaderFunc  loader_func)
 {
-	gth_image_loader_set_loader_func (self->priv->tloader,
-					  (loader_func != NULL) ? loader_func : generate_thumbnail,
-					  self);
+	self->priv->loader_func = (loader_func != NULL) ? loader_func : generate_thumbnail;
 }
 
 
@@ -339,6 +341,16 @@ gth_thumb_loader_set_max_file_size (GthThumbLoader *self,
 }
 
 
+
+typedef enum {
+	PIPELINE_STAGE_LOOKUP,
+	PIPELINE_STAGE_READ_AHEAD,
+	PIPELINE_STAGE_DECODE,
+	PIPELINE_STAGE_SCALE,
+	PIPELINE_STAGE_SAVE
+} PipelineStage;
+
+
 typedef struct {
 	GthThumbLoader     *thumb_loader;
 	GthFileData        *file_data;
@@ -351,6 +363,13 @@ typedef struct {
 	guint               thumbnailer_timeout;
 	guint               cancellable_watch;
 	gboolean            script_cancelled;
+	PipelineStage       stage;
+	guint64             serial;
+	cairo_surface_t    *image;
+	cairo_surface_t    *cache_image;
+	gboolean            pack_only;
+	int                 original_width;
+	int                 original_height;
 } LoadData;
 
 
@@ -363,6 +382,8 @@ load_data_new (GthFileData *file_data,
 	load_data = g_new0 (LoadData, 1);
 	load_data->file_data = g_object_ref (file_data);
 	load_data->requested_size = requested_size;
+	load_data->original_width = -1;
+	load_data->original_height = -1;
 
 	return load_data;
 }
@@ -376,6 +397,10 @@ load_data_unref (LoadData *load_data)
 	_g_object_unref (load_data->task);
 	_g_object_unref (load_data->cancellable);
 	g_free (load_data->thumbnailer_tmpfile);
+	if (load_data->image != NULL)
+		cairo_surface_destroy (load_data->image);
+	if (load_data->cache_image != NULL)
+		cairo_surface_destroy (load_data->cache_image);
 	g_free (load_data);
 }
 
@@ -395,10 +420,9 @@ load_result_unref (LoadResult *load_result)
 }
 
 
-static void
-original_image_ready_cb (GObject      *source_object,
-		         GAsyncResult *res,
-		         gpointer      user_data);
+static void pipeline_push (LoadData      *load_data,
+			   PipelineStage  stage);
+static void load_from_thumbnail_files (LoadData *load_data);
 
 
 static int
@@ -450,48 +474,18 @@ _cairo_image_surface_scale_for_thumbnail (cairo_surface_t *image,
 }
 
 
+/* Returns a thumbnail read from the cache, scaled if the user wants a
+ * different size.  Takes ownership of @surface. */
 static void
-cache_image_ready_cb (GObject      *source_object,
-		      GAsyncResult *res,
-		      gpointer      user_data)
+return_cached_thumbnail (GthThumbLoader  *self,
+			 GTask           *task,
+			 GthFileData     *file_data,
+			 cairo_surface_t *surface)
 {
-	LoadData        *load_data = user_data;
-	GthThumbLoader  *self = load_data->thumb_loader;
-	GthImage        *image = NULL;
-	cairo_surface_t *surface;
-	int              width;
-	int              height;
-	gboolean         modified;
-	LoadResult      *load_result;
-
-	if (! gth_image_loader_load_finish (GTH_IMAGE_LOADER (source_object),
-					    res,
-					    &image,
-					    NULL,
-					    NULL,
-					    NULL,
-					    NULL))
-	{
-		/* error loading the thumbnail from the cache, try to generate
-		 * the thumbnail loading the original image. */
-
-		gth_image_loader_load (self->priv->tloader,
-				       load_data->file_data,
-				       load_data->requested_size,
-				       G_PRIORITY_LOW,
-				       load_data->cancellable,
-				       original_image_ready_cb,
-				       load_data);
-
-		return;
-	}
-
-	/* Thumbnail correctly loaded from the cache. Scale if the user wants
-	 * a different size. */
-
-	surface = gth_image_get_cairo_surface (image);
-
-	g_return_if_fail (surface != NULL);
+	int         width;
+	int         height;
+	gboolean    modified;
+	LoadResult *load_result;
 
 	width = cairo_image_surface_get_width (surface);
 	height = cairo_image_surface_get_height (surface);
@@ -506,12 +500,9 @@ cache_image_ready_cb (GObject      *source_object,
 	}
 
 	load_result = g_new0 (LoadResult, 1);
-	load_result->file_data = g_object_ref (load_data->file_data);
+	load_result->file_data = g_object_ref (file_data);
 	load_result->image = surface;
-	g_task_return_pointer (load_data->task, load_result, (GDestroyNotify) load_result_unref);
-
-	load_data_unref (load_data);
-	g_object_unref (image);
+	g_task_return_pointer (task, load_result, (GDestroyNotify) load_result_unref);
 }
 
 
@@ -539,16 +530,94 @@ is_a_cache_file (const char *uri)
 }
 
 
+/* Saves the thumbnail in the pack of the folder as well, @image must have
+ * the size of the cache. */
+static void
+_gth_thumb_loader_save_to_pack (GthThumbLoader  *self,
+				GthFileData     *file_data,
+				cairo_surface_t *image)
+{
+	GthThumbnailPack         *pack;
+	char                     *uri;
+	cairo_surface_metadata_t *metadata;
+
+	pack = gth_main_get_default_thumbnail_pack ();
+	if ((pack == NULL) || (image == NULL))
+		return;
+
+	uri = g_file_get_uri (file_data->file);
+	if (! is_a_cache_file (uri)) {
+		metadata = _cairo_image_surface_get_metadata (image);
+		gth_thumbnail_pack_store (pack,
+					  file_data->file,
+					  file_data->info,
+					  self->priv->cache_max_size,
+					  image,
+					  metadata->thumbnail.image_width,
+					  metadata->thumbnail.image_height);
+	}
+
+	g_free (uri);
+}
+
+
+static void
+cache_image_ready_cb (GObject      *source_object,
+		      GAsyncResult *res,
+		      gpointer      user_data)
+{
+	LoadData        *load_data = user_data;
+	GthThumbLoader  *self = load_data->thumb_loader;
+	GthImage        *image = NULL;
+	cairo_surface_t *surface;
+
+	if (! gth_image_loader_load_finish (GTH_IMAGE_LOADER (source_object),
+					    res,
+					    &image,
+					    NULL,
+					    NULL,
+					    NULL,
+					    NULL))
+	{
+		/* error loading the thumbnail from the cache, try to generate
+		 * the thumbnail loading the original image. */
+
+		pipeline_push (load_data, PIPELINE_STAGE_READ_AHEAD);
+		return;
+	}
+
+	/* Thumbnail correctly loaded from the cache. Scale if the user wants
+	 * a different size. */
+
+	surface = gth_image_get_cairo_surface (image);
+
+	g_return_if_fail (surface != NULL);
+
+	/* move the thumbnail in the pack, to avoid reading the png file the
+	 * next time, the pack is written by the pipeline. */
+
+	if (self->priv->save_thumbnails) {
+		load_data->cache_image = cairo_surface_reference (surface);
+		load_data->pack_only = TRUE;
+	}
+
+	return_cached_thumbnail (self, load_data->task, load_data->file_data, surface);
+
+	if (load_data->cache_image != NULL)
+		pipeline_push (load_data, PIPELINE_STAGE_SAVE);
+	else
+		load_data_unref (load_data);
+	g_object_unref (image);
+}
+
+
 static gboolean
 _gth_thumb_loader_save_to_cache (GthThumbLoader  *self,
 				 GthFileData     *file_data,
-				 cairo_surface_t *image,
-				 int              original_width,
-				 int              original_height)
+				 cairo_surface_t *image)
 {
-	char                     *uri;
-	cairo_surface_metadata_t *metadata;
-	GdkPixbuf                *pixbuf;
+	char      *uri;
+	GdkPixbuf *pixbuf;
 
 	if ((self == NULL) || (image == NULL))
 		return FALSE;
@@ -563,14 +632,11 @@ _gth_thumb_loader_save_to_cache (GthThumbLoader  *self,
 		return FALSE;
 	}
 
-	if ((original_width > 0) && (original_height > 0)) {
-		metadata = _cairo_image_surface_get_metadata (image);
-		metadata->thumbnail.image_width = original_width;
-		metadata->thumbnail.image_height = original_height;
-	}
 	pixbuf = _gdk_pixbuf_new_from_cairo_surface (image);
-	if (pixbuf == NULL)
+	if (pixbuf == NULL) {
+		g_free (uri);
 		return FALSE;
+	}
 
 	gnome_desktop_thumbnail_factory_save_thumbnail (self->priv->thumb_factory,
 							pixbuf,
@@ -578,75 +644,12 @@ _gth_thumb_loader_save_to_cache (GthThumbLoader  *self,
 							gth_file_data_get_mtime (file_data));
 
 	g_object_unref (pixbuf);
+	g_free (uri);
 
 	return TRUE;
 }
 
 
-static void
-original_image_loaded_correctly (GthThumbLoader *self,
-				 LoadData        *load_data,
-				 cairo_surface_t *image,
-				 int              original_width,
-				 int              original_height)
-{
-	cairo_surface_t *local_image;
-	int              width;
-	int              height;
-	gboolean         modified;
-	LoadResult      *load_result;
-
-	local_image = cairo_surface_reference (image);
-
-	width = cairo_image_surface_get_width (local_image);
-	height = cairo_image_surface_get_height (local_image);
-
-	if (self->priv->save_thumbnails) {
-		gboolean modified;
-
-		/* Thumbnails are always saved in the cache max size, then
-		 * scaled a second time if the user requested a different
-		 * size. */
-
-		modified = scale_keeping_ratio (&width,
-						&height,
-						self->priv->cache_max_size,
-						self->priv->cache_max_size,
-						FALSE);
-		if (modified) {
-			cairo_surface_t *tmp = local_image;
-			local_image = _cairo_image_surface_scale_for_thumbnail (tmp, width, height);
-			cairo_surface_destroy (tmp);
-		}
-
-		_gth_thumb_loader_save_to_cache (self,
-						 load_data->file_data,
-						 local_image,
-						 original_width,
-						 original_height);
-	}
-
-	/* Scale if the user wants a different size. */
-
-	modified = normalize_thumb (&width,
-				    &height,
-				    self->priv->requested_size,
-				    self->priv->cache_max_size);
-	if (modified) {
-		cairo_surface_t *tmp = local_image;
-		local_image = _cairo_image_surface_scale_for_thumbnail (tmp, width, height);
-		cairo_surface_destroy (tmp);
-	}
-
-	load_result = g_new0 (LoadResult, 1);
-	load_result->file_data = g_object_ref (load_data->file_data);
-	load_result->image = cairo_surface_reference (local_image);
-	g_task_return_pointer (load_data->task, load_result, (GDestroyNotify) load_result_unref);
-
-	cairo_surface_destroy (local_image);
-}
-
-
 static void
 failed_to_load_original_image (GthThumbLoader *self,
 			       LoadData       *load_data)
@@ -658,7 +661,6 @@ failed_to_load_original_image (GthThumbLoader *self,
 								 uri,
 								 gth_file_data_get_mtime (load_data->file_data));
 	g_task_return_error (load_data->task, g_error_new_literal (GTH_ERROR, 0, "failed to generate the thumbnail"));
-
 	g_free (uri);
 }
 
@@ -741,18 +743,17 @@ watch_thumbnailer_cb (GPid     pid,
 									     &load_data->thumbnailer_tmpfile);
 
 	if (pixbuf != NULL) {
-		cairo_surface_t *surface;
-
-		surface = _cairo_image_surface_create_from_pixbuf (pixbuf);
-		original_image_loaded_correctly (self, load_data, surface, 0, 0);
+		load_data->image = _cairo_image_surface_create_from_pixbuf (pixbuf);
+		load_data->original_width = 0;
+		load_data->original_height = 0;
+		pipeline_push (load_data, PIPELINE_STAGE_SCALE);
 
-		cairo_surface_destroy (surface);
 		g_object_unref (pixbuf);
 	}
-	else
+	else {
 		failed_to_load_original_image (self, load_data);
-
-	load_data_unref (load_data);
+		load_data_unref (load_data);
+	}
 }
 
 
@@ -791,73 +792,374 @@ load_with_system_thumbnailer (GthThumbLoader *self,
 }
 
 
+static gboolean
+load_with_system_thumbnailer_cb (gpointer user_data)
+{
+	LoadData *load_data = user_data;
+
+	load_with_system_thumbnailer (load_data->thumb_loader, load_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+/* -- thumbnail pipeline --
+ *
+ * Thumbnails are looked up in the pack, then generated in stages:
+ * read-ahead, decode, scale and save.
+ * Every stage is a work item in a queue shared by one worker thread per
+ * processor, when a stage terminates the next one is queued again, so the
+ * workers can alternate between different images.  The queue is sorted by
+ * the loader priority, then by stage, to complete the images already
+ * started before decoding new ones. */
+
+
+static GMutex     pipeline_mutex;
+static GCond      pipeline_cond;
+static GSequence *pipeline_queue = NULL;
+static int        pipeline_workers = 0;
+static int        pipeline_idle_workers = 0;
+static guint64    pipeline_serial = 0;
+
+
+static int
+pipeline_stage_rank (PipelineStage stage)
+{
+	/* read-ahead requests are cheap and useful only if issued as soon
+	 * as possible, a lookup returns the thumbnail directly. */
+
+	if (stage == PIPELINE_STAGE_LOOKUP)
+		return PIPELINE_STAGE_SAVE + 2;
+	if (stage == PIPELINE_STAGE_READ_AHEAD)
+		return PIPELINE_STAGE_SAVE + 1;
+
+	return stage;
+}
+
+
+static int
+pipeline_compare_func (gconstpointer a,
+		       gconstpointer b,
+		       gpointer      user_data)
+{
+	const LoadData *load_data_a = a;
+	const LoadData *load_data_b = b;
+	int             priority_a;
+	int             priority_b;
+	int             rank_a;
+	int             rank_b;
+
+	priority_a = load_data_a->thumb_loader->priv->priority;
+	priority_b = load_data_b->thumb_loader->priv->priority;
+	if (priority_a != priority_b)
+		return (priority_a < priority_b) ? -1 : 1;
+
+	rank_a = pipeline_stage_rank (load_data_a->stage);
+	rank_b = pipeline_stage_rank (load_data_b->stage);
+	if (rank_a != rank_b)
+		return (rank_a > rank_b) ? -1 : 1;
+
+	if (load_data_a->serial != load_data_b->serial)
+		return (load_data_a->serial < load_data_b->serial) ? -1 : 1;
+
+	return 0;
+}
+
+
+static gboolean
+load_from_thumbnail_files_cb (gpointer user_data)
+{
+	load_from_thumbnail_files ((LoadData *) user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+
 static void
-original_image_ready_cb (GObject      *source_object,
-		         GAsyncResult *res,
-		         gpointer      user_data)
+pipeline_lookup (LoadData *load_data)
 {
-	LoadData        *load_data = user_data;
 	GthThumbLoader  *self = load_data->thumb_loader;
-	GthImage        *image = NULL;
+	cairo_surface_t *image;
 	int              original_width;
 	int              original_height;
-	cairo_surface_t *surface = NULL;
-	GError          *error = NULL;
 
-	if (! gth_image_loader_load_finish (GTH_IMAGE_LOADER (source_object),
-					    res,
-					    &image,
-					    &original_width,
-					    &original_height,
-					    NULL,
-					    &error))
-	{
-		/* error loading the original image, try with the system
-		 * thumbnailer */
+	image = gth_thumbnail_pack_lookup (gth_main_get_default_thumbnail_pack (),
+					   load_data->file_data->file,
+					   load_data->file_data->info,
+					   self->priv->cache_max_size,
+					   &original_width,
+					   &original_height);
+	if (image == NULL) {
+		/* the thumbnail files are read from the main loop. */
 
-		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-			g_task_return_error (load_data->task, error);
-			load_data_unref (load_data);
-			return;
+		g_idle_add (load_from_thumbnail_files_cb, load_data);
+		return;
+	}
+
+	if ((original_width > 0) && (original_height > 0))
+		_cairo_metadata_set_thumbnail_size (_cairo_image_surface_get_metadata (image),
+						    original_width,
+						    original_height);
+	return_cached_thumbnail (self, load_data->task, load_data->file_data, image);
+	load_data_unref (load_data);
+}
+
+
+static void
+pipeline_read_ahead (LoadData *load_data)
+{
+#ifdef POSIX_FADV_WILLNEED
+	char *filename;
+
+	/* ask the kernel to start reading the file while the workers are
+	 * busy with the previous images. */
+
+	filename = g_file_get_path (load_data->file_data->file);
+	if (filename != NULL) {
+		int fd;
+
+		fd = g_open (filename, O_RDONLY, 0);
+		if (fd >= 0) {
+			posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+			close (fd);
 		}
 
-		g_clear_error (&error);
-		load_with_system_thumbnailer (self, load_data);
+		g_free (filename);
+	}
+#endif
+
+	pipeline_push (load_data, PIPELINE_STAGE_DECODE);
+}
+
+
+static void
+pipeline_decode (LoadData *load_data)
+{
+	GthThumbLoader *self = load_data->thumb_loader;
+	GInputStream   *istream;
+	GthImage       *image = NULL;
+	gboolean        loaded_original = TRUE;
+
+	istream = (GInputStream *) g_file_read (load_data->file_data->file, load_data->cancellable, NULL);
+	if (istream != NULL) {
+		image = self->priv->loader_func (istream,
+						 load_data->file_data,
+						 load_data->requested_size,
+						 &load_data->original_width,
+						 &load_data->original_height,
+						 &loaded_original,
+						 self,
+						 load_data->cancellable,
+						 NULL);
+		g_object_unref (istream);
+	}
+
+	if ((image != NULL) && ! gth_image_get_is_null (image))
+		load_data->image = gth_image_get_cairo_surface (image);
+	_g_object_unref (image);
+
+	if (g_task_return_error_if_cancelled (load_data->task)) {
+		load_data_unref (load_data);
 		return;
 	}
 
-	surface = gth_image_get_cairo_surface (image);
-	if (surface == NULL) {
-		g_object_unref (image);
-		load_with_system_thumbnailer (self, load_data);
+	if (load_data->image == NULL) {
+		/* error loading the original image, try with the system
+		 * thumbnailer, from the main loop. */
+
+		g_idle_add (load_with_system_thumbnailer_cb, load_data);
 		return;
 	}
 
-	original_image_loaded_correctly (self,
-					 load_data,
-					 surface,
-					 original_width,
-					 original_height);
+	pipeline_push (load_data, PIPELINE_STAGE_SCALE);
+}
 
-	cairo_surface_destroy (surface);
-	g_object_unref (image);
+
+static void
+pipeline_scale (LoadData *load_data)
+{
+	GthThumbLoader  *self = load_data->thumb_loader;
+	cairo_surface_t *image;
+	int              width;
+	int              height;
+	LoadResult      *load_result;
+
+	image = cairo_surface_reference (load_data->image);
+
+	width = cairo_image_surface_get_width (image);
+	height = cairo_image_surface_get_height (image);
+
+	if (self->priv->save_thumbnails) {
+		cairo_surface_metadata_t *metadata;
+
+		/* Thumbnails are always saved in the cache max size, then
+		 * scaled a second time if the user requested a different
+		 * size. */
+
+		if (scale_keeping_ratio (&width,
+					 &height,
+					 self->priv->cache_max_size,
+					 self->priv->cache_max_size,
+					 FALSE))
+		{
+			cairo_surface_t *tmp = image;
+			image = _cairo_image_surface_scale_for_thumbnail (tmp, width, height);
+			cairo_surface_destroy (tmp);
+		}
+
+		if ((load_data->original_width > 0) && (load_data->original_height > 0)) {
+			metadata = _cairo_image_surface_get_metadata (image);
+			metadata->thumbnail.image_width = load_data->original_width;
+			metadata->thumbnail.image_height = load_data->original_height;
+		}
+
+		load_data->cache_image = cairo_surface_reference (image);
+	}
+
+	/* Scale if the user wants a different size. */
+
+	if (normalize_thumb (&width,
+			     &height,
+			     self->priv->requested_size,
+			     self->priv->cache_max_size))
+	{
+		cairo_surface_t *tmp = image;
+		image = _cairo_image_surface_scale_for_thumbnail (tmp, width, height);
+		cairo_surface_destroy (tmp);
+	}
+
+	/* the thumbnail is returned before saving it to the cache, to show
+	 * it as soon as possible. */
+
+	load_result = g_new0 (LoadResult, 1);
+	load_result->file_data = g_object_ref (load_data->file_data);
+	load_result->image = image;
+	g_task_return_pointer (load_data->task, load_result, (GDestroyNotify) load_result_unref);
+
+	if (load_data->cache_image != NULL)
+		pipeline_push (load_data, PIPELINE_STAGE_SAVE);
+	else
+		load_data_unref (load_data);
+}
+
+
+static void
+pipeline_save (LoadData *load_data)
+{
+	if (! load_data->pack_only)
+		_gth_thumb_loader_save_to_cache (load_data->thumb_loader,
+						 load_data->file_data,
+						 load_data->cache_image);
+	_gth_thumb_loader_save_to_pack (load_data->thumb_loader,
+					load_data->file_data,
+					load_data->cache_image);
 	load_data_unref (load_data);
 }
 
 
+static gpointer
+pipeline_worker (gpointer user_data)
+{
+	for (;;) {
+		GSequenceIter *iter;
+		LoadData      *load_data;
+
+		g_mutex_lock (&pipeline_mutex);
+		while (g_sequence_is_empty (pipeline_queue)) {
+			pipeline_idle_workers++;
+			g_cond_wait (&pipeline_cond, &pipeline_mutex);
+			pipeline_idle_workers--;
+		}
+		iter = g_sequence_get_begin_iter (pipeline_queue);
+		load_data = g_sequence_get (iter);
+		g_sequence_remove (iter);
+		g_mutex_unlock (&pipeline_mutex);
+
+		/* the thumbnail is already returned when saving */
+
+		if ((load_data->stage != PIPELINE_STAGE_SAVE)
+		    && g_task_return_error_if_cancelled (load_data->task))
+		{
+			load_data_unref (load_data);
+			continue;
+		}
+
+		switch (load_data->stage) {
+		case PIPELINE_STAGE_LOOKUP:
+			pipeline_lookup (load_data);
+			break;
+		case PIPELINE_STAGE_READ_AHEAD:
+			pipeline_read_ahead (load_data);
+			break;
+		case PIPELINE_STAGE_DECODE:
+			pipeline_decode (load_data);
+			break;
+		case PIPELINE_STAGE_SCALE:
+			pipeline_scale (load_data);
+			break;
+		case PIPELINE_STAGE_SAVE:
+			pipeline_save (load_data);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void
+pipeline_push (LoadData      *load_data,
+	       PipelineStage  stage)
+{
+	g_mutex_lock (&pipeline_mutex);
+
+	if (pipeline_queue == NULL)
+		pipeline_queue = g_sequence_new (NULL);
+
+	load_data->stage = stage;
+	if ((stage == PIPELINE_STAGE_LOOKUP) || (stage == PIPELINE_STAGE_READ_AHEAD))
+		load_data->serial = pipeline_serial++;
+	g_sequence_insert_sorted (pipeline_queue, load_data, pipeline_compare_func, NULL);
+
+	if (pipeline_idle_workers > 0)
+		g_cond_signal (&pipeline_cond);
+	else if (pipeline_workers < _g_get_n_worker_threads ()) {
+		pipeline_workers++;
+		g_thread_unref (g_thread_new ("thumbnailer", pipeline_worker, NULL));
+	}
+
+	g_mutex_unlock (&pipeline_mutex);
+}
+
+
+/* Thumbnails of loaders with a higher priority (a lower value, as for the
+ * GLib priorities) are generated first.  The priority can be changed while
+ * a thumbnail is being generated, the default is G_PRIORITY_LOW. */
 void
-gth_thumb_loader_load (GthThumbLoader      *self,
-		       GthFileData         *file_data,
-		       GCancellable        *cancellable,
-		       GAsyncReadyCallback  callback,
-		       gpointer             user_data)
+gth_thumb_loader_set_priority (GthThumbLoader *self,
+			       int             priority)
 {
-	GTask    *task;
-	char     *cache_path;
-	char     *uri;
-	LoadData *load_data;
+	g_return_if_fail (self != NULL);
+
+	g_mutex_lock (&pipeline_mutex);
+	if (self->priv->priority != priority) {
+		self->priv->priority = priority;
+		if (pipeline_queue != NULL)
+			g_sequence_sort (pipeline_queue, pipeline_compare_func, NULL);
+	}
+	g_mutex_unlock (&pipeline_mutex);
+}
 
-	task = g_task_new (G_OBJECT (self), cancellable, callback, user_data);
+
+/* Loads the thumbnail from the freedesktop cache or generates it, called
+ * in the main thread. */
+static void
+load_from_thumbnail_files (LoadData *load_data)
+{
+	GthThumbLoader *self = load_data->thumb_loader;
+	GthFileData    *file_data = load_data->file_data;
+	char           *cache_path;
+	char           *uri;
 
 	cache_path = NULL;
 
@@ -872,10 +1174,10 @@ gth_thumb_loader_load (GthThumbLoader      *self,
 		mtime = gth_file_data_get_mtime (file_data);
 
 		if (gnome_desktop_thumbnail_factory_has_valid_failed_thumbnail (self->priv->thumb_factory, uri, mtime)) {
-			g_task_return_error (task, g_error_new_literal (GTH_ERROR, 0, "found a failed thumbnail"));
+			g_task_return_error (load_data->task, g_error_new_literal (GTH_ERROR, 0, "found a failed thumbnail"));
 
 			g_free (uri);
-			g_object_unref (task);
+			load_data_unref (load_data);
 
 			return;
 		}
@@ -889,16 +1191,11 @@ gth_thumb_loader_load (GthThumbLoader      *self,
 	    && (self->priv->max_file_size > 0)
 	    && (g_file_info_get_size (file_data->info) > self->priv->max_file_size))
 	{
-		g_task_return_error (task, g_error_new_literal (GTH_ERROR, 0, "file too big to generate the thumbnail"));
-		g_object_unref (task);
+		g_task_return_error (load_data->task, g_error_new_literal (GTH_ERROR, 0, "file too big to generate the thumbnail"));
+		load_data_unref (load_data);
 		return;
 	}
 
-	load_data = load_data_new (file_data, self->priv->requested_size);
-	load_data->thumb_loader = g_object_ref (self);
-	load_data->cancellable = _g_object_ref (cancellable);
-	load_data->task = task;
-
 	if (cache_path != NULL) {
 		GFile       *cache_file;
 		GthFileData *cache_file_data;
@@ -919,13 +1216,39 @@ gth_thumb_loader_load (GthThumbLoader      *self,
 		g_free (cache_path);
 	}
 	else
-		gth_image_loader_load (self->priv->tloader,
-				       file_data,
-				       self->priv->requested_size,
-				       G_PRIORITY_LOW,
-				       load_data->cancellable,
-				       original_image_ready_cb,
-				       load_data);
+		pipeline_push (load_data, PIPELINE_STAGE_READ_AHEAD);
+}
+
+
+void
+gth_thumb_loader_load (GthThumbLoader      *self,
+		       GthFileData         *file_data,
+		       GCancellable        *cancellable,
+		       GAsyncReadyCallback  callback,
+		       gpointer             user_data)
+{
+	LoadData *load_data;
+	char     *uri;
+
+	load_data = load_data_new (file_data, self->priv->requested_size);
+	load_data->thumb_loader = g_object_ref (self);
+	load_data->cancellable = _g_object_ref (cancellable);
+	load_data->task = g_task_new (G_OBJECT (self), cancellable, callback, user_data);
+
+	/* the pack doesn't require a system call for each file, try it
+	 * before the thumbnail files, in a worker thread. */
+
+	uri = g_file_get_uri (file_data->file);
+	if (self->priv->use_cache
+	    && ! is_a_cache_file (uri)
+	    && (gth_main_get_default_thumbnail_pack () != NULL))
+	{
+		pipeline_push (load_data, PIPELINE_STAGE_LOOKUP);
+	}
+	else
+		load_from_thumbnail_files (load_data);
+
+	g_free (uri);
 }
 
 
@@ -66,6 +66,8 @@ void              gth_thumb_loader_set_save_thumbnails  (GthThumbLoader       *s
 					                 gboolean              save);
 void              gth_thumb_loader_set_max_file_size    (GthThumbLoader       *self,
 					                 goffset               size);
+void              gth_thumb_loader_set_priority         (GthThumbLoader       *self,
+					                 int                   priority);
 void              gth_thumb_loader_load                 (GthThumbLoader       *self,
 						         GthFileData          *file_data,
 						         GCancellable         *cancellable,
@@ -0,0 +1,1052 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include <zlib.h>
+#include "gth-thumbnail-pack.h"
+
+
+#define PACK_MAGIC "PIXTHPAK"
+#define PACK_FORMAT_VERSION 1
+#define MAX_LOADED_FOLDERS 16
+#define MAX_THUMBNAIL_SIZE 4096
+#define MIN_GARBAGE_TO_COMPACT (1024 * 1024)
+#define RECORD_ALIGNMENT 8
+#define MAX_OPEN_ATTEMPTS 3
+
+
+/* A pack is a header followed by a sequence of records, new thumbnails are
+ * appended to the file, so that saving a thumbnail doesn't require to
+ * rewrite the whole pack.  A record for a file replaces the previous
+ * records for the same file, a record with the REMOVED flag deletes it.
+ * When the space used by the replaced records is more than the space used
+ * by the valid ones the pack is rewritten by gth_thumbnail_pack_flush.
+ * The numbers are saved in the host byte order, a pack created on a
+ * different architecture is discarded because the version doesn't match.
+ *
+ * The pack can be shared by more processes: the records are appended with
+ * an exclusive lock on the file, after reading the records appended by the
+ * other processes, and the file is never truncated, a pack is rewritten in
+ * a new file that replaces the old one.  The index in memory keeps the
+ * position of the records, the data is read from the mapped file. */
+
+
+typedef enum {
+	RECORD_FLAG_NONE = 0,
+	RECORD_FLAG_REMOVED = 1 << 0,
+	RECORD_FLAG_COMPRESSED = 1 << 1
+} RecordFlags;
+
+
+typedef struct {
+	char    magic[8];
+	guint32 version;
+	guint32 thumbnail_size;
+} PackHeader;
+
+
+typedef struct {
+	guint32 record_length;
+	guint32 flags;
+	gint64  mtime;
+	guint64 file_size;
+	guint32 name_length;
+	guint32 data_length;
+	guint32 width;
+	guint32 height;
+	gint32  original_width;
+	gint32  original_height;
+} PackRecord;
+
+
+typedef struct {
+	gsize   offset;
+	gsize   length;
+	gint64  mtime;
+	guint64 file_size;
+} RecordEntry;
+
+
+typedef struct {
+	char        *key;
+	char        *uri;
+	int          thumbnail_size;
+	char        *filename;
+	GHashTable  *records;		/* name -> RecordEntry */
+	GMappedFile *mapped_file;
+	dev_t        device;
+	ino_t        inode;
+	gsize        valid_length;
+	gsize        garbage;
+} PackFolder;
+
+
+struct _GthThumbnailPack {
+	GMutex      mutex;
+	char       *directory;
+	GHashTable *folders;
+	GQueue     *folders_lru;
+	guint       hits;
+	guint       misses;
+};
+
+
+static gsize
+record_get_aligned_length (gsize length)
+{
+	return (length + RECORD_ALIGNMENT - 1) & ~((gsize) RECORD_ALIGNMENT - 1);
+}
+
+
+static const char *
+record_get_name (const PackRecord *record)
+{
+	return ((const char *) record) + sizeof (PackRecord);
+}
+
+
+static const guchar *
+record_get_data (const PackRecord *record)
+{
+	return ((const guchar *) record) + sizeof (PackRecord) + record->name_length;
+}
+
+
+static gboolean
+record_is_valid (const PackRecord *record,
+		 gsize             available)
+{
+	if ((available < sizeof (PackRecord))
+	    || (record->record_length > available)
+	    || (record->record_length % RECORD_ALIGNMENT != 0)
+	    || (record->name_length == 0)
+	    || (record->record_length < sizeof (PackRecord) + (gsize) record->name_length + record->data_length)
+	    || (record->width > MAX_THUMBNAIL_SIZE)
+	    || (record->height > MAX_THUMBNAIL_SIZE))
+	{
+		return FALSE;
+	}
+
+	if ((record->flags & RECORD_FLAG_REMOVED) == 0) {
+		if ((record->width == 0) || (record->height == 0))
+			return FALSE;
+		if (((record->flags & RECORD_FLAG_COMPRESSED) == 0)
+		    && (record->data_length != record->width * record->height * 4))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+
+/* Returns a new record for the name and the pixels of @image, converted
+ * to premultiplied ARGB without padding. */
+static GBytes *
+record_new_for_image (const char      *name,
+		      gint64           mtime,
+		      guint64          file_size,
+		      cairo_surface_t *image,
+		      int              original_width,
+		      int              original_height)
+{
+	cairo_format_t  format;
+	int             width;
+	int             height;
+	int             stride;
+	guchar         *pixels;
+	gsize           pixels_size;
+	guchar         *compressed;
+	uLongf          compressed_size;
+	const guchar   *data;
+	gsize           data_length;
+	guint32         flags;
+	gsize           name_length;
+	gsize           record_length;
+	guchar         *buffer;
+	PackRecord     *record;
+	int             y;
+
+	format = cairo_image_surface_get_format (image);
+	if ((format != CAIRO_FORMAT_ARGB32) && (format != CAIRO_FORMAT_RGB24))
+		return NULL;
+
+	width = cairo_image_surface_get_width (image);
+	height = cairo_image_surface_get_height (image);
+	if ((width <= 0) || (height <= 0) || (width > MAX_THUMBNAIL_SIZE) || (height > MAX_THUMBNAIL_SIZE))
+		return NULL;
+
+	cairo_surface_flush (image);
+	stride = cairo_image_surface_get_stride (image);
+	pixels_size = (gsize) width * height * 4;
+	pixels = g_malloc (pixels_size);
+	for (y = 0; y < height; y++) {
+		guint32 *row = (guint32 *) (pixels + ((gsize) y * width * 4));
+		int      x;
+
+		memcpy (row, cairo_image_surface_get_data (image) + ((gsize) y * stride), (gsize) width * 4);
+
+		/* the alpha byte is undefined in the RGB24 format */
+
+		if (format == CAIRO_FORMAT_RGB24)
+			for (x = 0; x < width; x++)
+				row[x] |= 0xff000000;
+	}
+
+	compressed_size = compressBound (pixels_size);
+	compressed = g_malloc (compressed_size);
+	if ((compress2 (compressed, &compressed_size, pixels, pixels_size, Z_BEST_SPEED) == Z_OK)
+	    && (compressed_size < pixels_size))
+	{
+		data = compressed;
+		data_length = compressed_size;
+		flags = RECORD_FLAG_COMPRESSED;
+	}
+	else {
+		data = pixels;
+		data_length = pixels_size;
+		flags = RECORD_FLAG_NONE;
+	}
+
+	name_length = strlen (name);
+	record_length = record_get_aligned_length (sizeof (PackRecord) + name_length + data_length);
+	buffer = g_malloc0 (record_length);
+
+	record = (PackRecord *) buffer;
+	record->record_length = record_length;
+	record->flags = flags;
+	record->mtime = mtime;
+	record->file_size = file_size;
+	record->name_length = name_length;
+	record->data_length = data_length;
+	record->width = width;
+	record->height = height;
+	record->original_width = original_width;
+	record->original_height = original_height;
+	memcpy (buffer + sizeof (PackRecord), name, name_length);
+	memcpy (buffer + sizeof (PackRecord) + name_length, data, data_length);
+
+	g_free (compressed);
+	g_free (pixels);
+
+	return g_bytes_new_take (buffer, record_length);
+}
+
+
+static GBytes *
+record_new_for_removed_file (const char *name)
+{
+	gsize       name_length;
+	gsize       record_length;
+	guchar     *buffer;
+	PackRecord *record;
+
+	name_length = strlen (name);
+	record_length = record_get_aligned_length (sizeof (PackRecord) + name_length);
+	buffer = g_malloc0 (record_length);
+
+	record = (PackRecord *) buffer;
+	record->record_length = record_length;
+	record->flags = RECORD_FLAG_REMOVED;
+	record->name_length = name_length;
+	memcpy (buffer + sizeof (PackRecord), name, name_length);
+
+	return g_bytes_new_take (buffer, record_length);
+}
+
+
+static cairo_surface_t *
+record_to_surface (const PackRecord *record)
+{
+	cairo_surface_t *image;
+	guchar          *surface_data;
+	int              stride;
+	guchar          *pixels;
+	uLongf           pixels_size;
+	gboolean         valid;
+	int              y;
+
+	image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, record->width, record->height);
+	if (cairo_surface_status (image) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy (image);
+		return NULL;
+	}
+
+	cairo_surface_flush (image);
+	surface_data = cairo_image_surface_get_data (image);
+	stride = cairo_image_surface_get_stride (image);
+	pixels_size = (uLongf) record->width * record->height * 4;
+
+	/* decompress in the surface directly if the rows are not padded */
+
+	if (stride == (int) record->width * 4)
+		pixels = surface_data;
+	else
+		pixels = g_malloc (pixels_size);
+
+	if (record->flags & RECORD_FLAG_COMPRESSED) {
+		uLongf size = pixels_size;
+
+		valid = (uncompress (pixels, &size, record_get_data (record), record->data_length) == Z_OK)
+			&& (size == pixels_size);
+	}
+	else {
+		memcpy (pixels, record_get_data (record), pixels_size);
+		valid = TRUE;
+	}
+
+	if (pixels != surface_data) {
+		if (valid)
+			for (y = 0; y < (int) record->height; y++)
+				memcpy (surface_data + ((gsize) y * stride),
+					pixels + ((gsize) y * record->width * 4),
+					(gsize) record->width * 4);
+		g_free (pixels);
+	}
+
+	if (! valid) {
+		cairo_surface_destroy (image);
+		return NULL;
+	}
+
+	cairo_surface_mark_dirty (image);
+
+	return image;
+}
+
+
+/* -- PackFolder -- */
+
+
+static char *
+get_folder_key (const char *uri,
+		int         thumbnail_size)
+{
+	return g_strdup_printf ("%d:%s", thumbnail_size, uri);
+}
+
+
+static PackFolder *
+pack_folder_new (GthThumbnailPack *pack,
+		 const char       *uri,
+		 int               thumbnail_size)
+{
+	PackFolder *folder;
+	char       *checksum;
+	char       *name;
+
+	folder = g_new0 (PackFolder, 1);
+	folder->key = get_folder_key (uri, thumbnail_size);
+	folder->uri = g_strdup (uri);
+	folder->thumbnail_size = thumbnail_size;
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+	name = g_strdup_printf ("%s-%d", checksum, thumbnail_size);
+	folder->filename = g_build_filename (pack->directory, name, NULL);
+	folder->records = g_hash_table_new_full (g_str_hash,
+						 g_str_equal,
+						 g_free,
+						 g_free);
+	folder->mapped_file = NULL;
+	folder->device = 0;
+	folder->inode = 0;
+	folder->valid_length = 0;
+	folder->garbage = 0;
+
+	g_free (name);
+	g_free (checksum);
+
+	return folder;
+}
+
+
+static void
+pack_folder_reset (PackFolder *folder)
+{
+	g_hash_table_remove_all (folder->records);
+	g_clear_pointer (&folder->mapped_file, g_mapped_file_unref);
+	folder->device = 0;
+	folder->inode = 0;
+	folder->valid_length = 0;
+	folder->garbage = 0;
+}
+
+
+static void
+pack_folder_free (PackFolder *folder)
+{
+	pack_folder_reset (folder);
+	g_hash_table_unref (folder->records);
+	g_free (folder->filename);
+	g_free (folder->uri);
+	g_free (folder->key);
+	g_free (folder);
+}
+
+
+/* Updates the index with a record read from the file or appended to it. */
+static void
+pack_folder_add_record (PackFolder       *folder,
+			const PackRecord *record,
+			gsize             offset)
+{
+	char        *name;
+	RecordEntry *entry;
+
+	name = g_strndup (record_get_name (record), record->name_length);
+
+	entry = g_hash_table_lookup (folder->records, name);
+	if (entry != NULL)
+		folder->garbage += entry->length;
+
+	if (record->flags & RECORD_FLAG_REMOVED) {
+		folder->garbage += record->record_length;
+		g_hash_table_remove (folder->records, name);
+		g_free (name);
+		return;
+	}
+
+	entry = g_new (RecordEntry, 1);
+	entry->offset = offset;
+	entry->length = record->record_length;
+	entry->mtime = record->mtime;
+	entry->file_size = record->file_size;
+	g_hash_table_insert (folder->records, name, entry);
+}
+
+
+/* Adds the valid records from @offset, returns the end of the last one. */
+static gsize
+pack_folder_scan (PackFolder   *folder,
+		  const guchar *data,
+		  gsize         size,
+		  gsize         offset)
+{
+	while (record_is_valid ((const PackRecord *) (data + offset), size - offset)) {
+		const PackRecord *record = (const PackRecord *) (data + offset);
+
+		pack_folder_add_record (folder, record, offset);
+		offset += record->record_length;
+	}
+
+	return offset;
+}
+
+
+/* Maps the file opened with @fd, which must be locked, and reads the
+ * records added by the other processes.  If the file was replaced all the
+ * records are read again. */
+static void
+pack_folder_sync (PackFolder *folder,
+		  int         fd)
+{
+	struct stat       file_stat;
+	GMappedFile      *mapped_file;
+	const guchar     *data;
+	gsize             size;
+	const PackHeader *header;
+	gboolean          same_file;
+
+	if (fstat (fd, &file_stat) != 0) {
+		pack_folder_reset (folder);
+		return;
+	}
+
+	same_file = (folder->mapped_file != NULL)
+		    && (file_stat.st_dev == folder->device)
+		    && (file_stat.st_ino == folder->inode);
+	if (same_file && ((gsize) file_stat.st_size == g_mapped_file_get_length (folder->mapped_file)))
+		return;
+
+	mapped_file = g_mapped_file_new_from_fd (fd, FALSE, NULL);
+	if (mapped_file == NULL) {
+		pack_folder_reset (folder);
+		return;
+	}
+
+	data = (const guchar *) g_mapped_file_get_contents (mapped_file);
+	size = g_mapped_file_get_length (mapped_file);
+
+	if (same_file
+	    && (folder->valid_length >= sizeof (PackHeader))
+	    && (size >= folder->valid_length))
+	{
+		folder->valid_length = pack_folder_scan (folder, data, size, folder->valid_length);
+	}
+	else {
+		pack_folder_reset (folder);
+
+		header = (const PackHeader *) data;
+		if ((size >= sizeof (PackHeader))
+		    && (memcmp (header->magic, PACK_MAGIC, sizeof (header->magic)) == 0)
+		    && (header->version == PACK_FORMAT_VERSION)
+		    && (header->thumbnail_size == (guint32) folder->thumbnail_size))
+		{
+			folder->valid_length = pack_folder_scan (folder, data, size, sizeof (PackHeader));
+		}
+	}
+
+	g_clear_pointer (&folder->mapped_file, g_mapped_file_unref);
+	folder->mapped_file = mapped_file;
+	folder->device = file_stat.st_dev;
+	folder->inode = file_stat.st_ino;
+}
+
+
+/* Opens the pack and locks it with @operation, returns -1 on error. */
+static int
+pack_folder_open_locked (PackFolder *folder,
+			 int         flags,
+			 int         operation)
+{
+	int i;
+
+	for (i = 0; i < MAX_OPEN_ATTEMPTS; i++) {
+		int         fd;
+		struct stat fd_stat;
+		GStatBuf    path_stat;
+
+		fd = g_open (folder->filename, flags, 0600);
+		if (fd < 0)
+			return -1;
+
+		if (flock (fd, operation) != 0) {
+			close (fd);
+			return -1;
+		}
+
+		/* another process can replace the file while waiting for the
+		 * lock. */
+
+		if ((fstat (fd, &fd_stat) == 0)
+		    && (g_stat (folder->filename, &path_stat) == 0)
+		    && (fd_stat.st_dev == path_stat.st_dev)
+		    && (fd_stat.st_ino == path_stat.st_ino))
+		{
+			return fd;
+		}
+
+		close (fd);
+	}
+
+	return -1;
+}
+
+
+/* The mapped file keeps the lock of the file descriptor used to map it,
+ * the lock must be released explicitly. */
+static void
+pack_folder_close_locked (int fd)
+{
+	flock (fd, LOCK_UN);
+	close (fd);
+}
+
+
+/* Reads the records added to the file after it was mapped. */
+static void
+pack_folder_update (PackFolder *folder)
+{
+	int fd;
+
+	fd = pack_folder_open_locked (folder, O_RDONLY, LOCK_SH);
+	if (fd < 0) {
+		pack_folder_reset (folder);
+		return;
+	}
+
+	pack_folder_sync (folder, fd);
+	pack_folder_close_locked (fd);
+}
+
+
+static gboolean
+write_all (int           fd,
+	   const guchar *data,
+	   gsize         size)
+{
+	while (size > 0) {
+		gssize written;
+
+		written = write (fd, data, size);
+		if (written < 0)
+			return FALSE;
+		data += written;
+		size -= written;
+	}
+
+	return TRUE;
+}
+
+
+static gboolean
+write_header (PackFolder *folder,
+	      int         fd)
+{
+	PackHeader header;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, PACK_MAGIC, sizeof (header.magic));
+	header.version = PACK_FORMAT_VERSION;
+	header.thumbnail_size = folder->thumbnail_size;
+
+	return write_all (fd, (guchar *) &header, sizeof (header));
+}
+
+
+/* Writes the valid records in a new file that replaces the pack, must be
+ * called with the pack locked and synchronized with the index. */
+static void
+pack_folder_rewrite (PackFolder *folder)
+{
+	char           *tmp_filename;
+	int             fd;
+	const guchar   *data;
+	GHashTableIter  iter;
+	gpointer        value;
+	gboolean        success;
+
+	tmp_filename = g_strconcat (folder->filename, ".tmp", NULL);
+	fd = g_open (tmp_filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		g_free (tmp_filename);
+		return;
+	}
+
+	data = (folder->mapped_file != NULL) ? (const guchar *) g_mapped_file_get_contents (folder->mapped_file) : NULL;
+	success = write_header (folder, fd);
+	g_hash_table_iter_init (&iter, folder->records);
+	while (success && g_hash_table_iter_next (&iter, NULL, &value)) {
+		RecordEntry *entry = value;
+		success = write_all (fd, data + entry->offset, entry->length);
+	}
+
+	if (success && (g_rename (tmp_filename, folder->filename) == 0))
+		pack_folder_sync (folder, fd);
+	else
+		g_unlink (tmp_filename);
+
+	close (fd);
+	g_free (tmp_filename);
+}
+
+
+/* The pack is only an optimization, errors are not fatal. */
+static void
+pack_folder_append (PackFolder *folder,
+		    GBytes     *bytes)
+{
+	int           fd;
+	const guchar *data;
+	gsize         size;
+	gsize         file_length;
+
+	fd = pack_folder_open_locked (folder, O_RDWR | O_CREAT, LOCK_EX);
+	if (fd < 0)
+		return;
+
+	pack_folder_sync (folder, fd);
+
+	/* a partially written record or a pack with a different version
+	 * cannot be removed without truncating the file, which can be mapped
+	 * by another process, the pack is replaced. */
+
+	file_length = (folder->mapped_file != NULL) ? g_mapped_file_get_length (folder->mapped_file) : 0;
+	if (file_length == 0) {
+		if (! write_header (folder, fd)) {
+			pack_folder_close_locked (fd);
+			return;
+		}
+		folder->valid_length = sizeof (PackHeader);
+	}
+	else if (folder->valid_length != file_length) {
+		pack_folder_rewrite (folder);
+		pack_folder_close_locked (fd);
+
+		fd = pack_folder_open_locked (folder, O_RDWR, LOCK_EX);
+		if (fd < 0)
+			return;
+
+		pack_folder_sync (folder, fd);
+		if ((folder->mapped_file == NULL) || (folder->valid_length != g_mapped_file_get_length (folder->mapped_file))) {
+			pack_folder_close_locked (fd);
+			return;
+		}
+	}
+
+	data = g_bytes_get_data (bytes, &size);
+	if ((lseek (fd, folder->valid_length, SEEK_SET) == (off_t) folder->valid_length)
+	    && write_all (fd, data, size))
+	{
+		pack_folder_add_record (folder, (const PackRecord *) data, folder->valid_length);
+		folder->valid_length += size;
+	}
+
+	pack_folder_close_locked (fd);
+}
+
+
+static void
+pack_folder_compact (PackFolder *folder)
+{
+	int fd;
+
+	fd = pack_folder_open_locked (folder, O_RDWR, LOCK_EX);
+	if (fd < 0)
+		return;
+
+	pack_folder_sync (folder, fd);
+	if (g_hash_table_size (folder->records) == 0) {
+		g_unlink (folder->filename);
+		pack_folder_reset (folder);
+	}
+	else
+		pack_folder_rewrite (folder);
+
+	pack_folder_close_locked (fd);
+}
+
+
+static gboolean
+pack_folder_needs_compaction (PackFolder *folder)
+{
+	return (folder->garbage >= MIN_GARBAGE_TO_COMPACT)
+		&& (folder->garbage > folder->valid_length - folder->garbage);
+}
+
+
+/* -- GthThumbnailPack -- */
+
+
+GthThumbnailPack *
+gth_thumbnail_pack_new (GFile *directory)
+{
+	GthThumbnailPack *pack;
+
+	pack = g_new0 (GthThumbnailPack, 1);
+	g_mutex_init (&pack->mutex);
+	pack->directory = g_file_get_path (directory);
+	pack->folders = g_hash_table_new_full (g_str_hash,
+					       g_str_equal,
+					       NULL,
+					       (GDestroyNotify) pack_folder_free);
+	pack->folders_lru = g_queue_new ();
+	pack->hits = 0;
+	pack->misses = 0;
+
+	return pack;
+}
+
+
+void
+gth_thumbnail_pack_free (GthThumbnailPack *pack)
+{
+	if (pack == NULL)
+		return;
+
+	gth_thumbnail_pack_flush (pack, TRUE);
+
+	g_queue_free (pack->folders_lru);
+	g_hash_table_unref (pack->folders);
+	g_free (pack->directory);
+	g_mutex_clear (&pack->mutex);
+	g_free (pack);
+}
+
+
+static gboolean
+get_file_stamp (GFileInfo *info,
+		gint64    *mtime,
+		guint64   *size)
+{
+	if ((info == NULL)
+	    || ! g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)
+	    || ! g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+	{
+		return FALSE;
+	}
+
+	*mtime = (g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC)
+		 + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	*size = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+
+	return TRUE;
+}
+
+
+static gboolean
+split_file_uri (GFile  *file,
+		char  **folder_uri,
+		char  **name)
+{
+	char *uri;
+	char *separator;
+
+	uri = g_file_get_uri (file);
+	separator = strrchr (uri, '/');
+	if ((separator == NULL) || (separator[1] == '\0')) {
+		g_free (uri);
+		return FALSE;
+	}
+
+	*folder_uri = g_strndup (uri, separator - uri);
+	*name = g_strdup (separator + 1);
+
+	g_free (uri);
+
+	return TRUE;
+}
+
+
+/* Must be called with the mutex locked. */
+static PackFolder *
+get_folder (GthThumbnailPack *pack,
+	    const char       *uri,
+	    int               thumbnail_size)
+{
+	char       *key;
+	PackFolder *folder;
+
+	key = get_folder_key (uri, thumbnail_size);
+	folder = g_hash_table_lookup (pack->folders, key);
+	g_free (key);
+
+	if (folder != NULL) {
+		if (pack->folders_lru->head->data != folder) {
+			g_queue_remove (pack->folders_lru, folder);
+			g_queue_push_head (pack->folders_lru, folder);
+		}
+		return folder;
+	}
+
+	while (g_queue_get_length (pack->folders_lru) >= MAX_LOADED_FOLDERS) {
+		PackFolder *old_folder;
+
+		old_folder = g_queue_pop_tail (pack->folders_lru);
+		if (pack_folder_needs_compaction (old_folder))
+			pack_folder_compact (old_folder);
+		g_hash_table_remove (pack->folders, old_folder->key);
+	}
+
+	folder = pack_folder_new (pack, uri, thumbnail_size);
+	pack_folder_update (folder);
+	g_hash_table_insert (pack->folders, folder->key, folder);
+	g_queue_push_head (pack->folders_lru, folder);
+
+	return folder;
+}
+
+
+cairo_surface_t *
+gth_thumbnail_pack_lookup (GthThumbnailPack *pack,
+			   GFile            *file,
+			   GFileInfo        *info,
+			   int               thumbnail_size,
+			   int              *original_width,
+			   int              *original_height)
+{
+	gint64            mtime;
+	guint64           size;
+	char             *folder_uri;
+	char             *name;
+	PackFolder       *folder;
+	RecordEntry      *entry;
+	GMappedFile      *mapped_file;
+	gsize             offset;
+	const PackRecord *record;
+	cairo_surface_t  *image;
+
+	if (! get_file_stamp (info, &mtime, &size))
+		return NULL;
+	if (! split_file_uri (file, &folder_uri, &name))
+		return NULL;
+
+	g_mutex_lock (&pack->mutex);
+
+	folder = get_folder (pack, folder_uri, thumbnail_size);
+	entry = g_hash_table_lookup (folder->records, name);
+	if ((entry != NULL) && ((entry->mtime != mtime) || (entry->file_size != size)))
+		entry = NULL;
+
+	/* the record was appended after mapping the file */
+
+	if ((entry != NULL)
+	    && ((folder->mapped_file == NULL)
+		|| (entry->offset + entry->length > g_mapped_file_get_length (folder->mapped_file))))
+	{
+		pack_folder_update (folder);
+		entry = g_hash_table_lookup (folder->records, name);
+		if ((entry != NULL)
+		    && ((entry->mtime != mtime)
+			|| (entry->file_size != size)
+			|| (folder->mapped_file == NULL)
+			|| (entry->offset + entry->length > g_mapped_file_get_length (folder->mapped_file))))
+		{
+			entry = NULL;
+		}
+	}
+
+	mapped_file = NULL;
+	offset = 0;
+	if (entry != NULL) {
+		mapped_file = g_mapped_file_ref (folder->mapped_file);
+		offset = entry->offset;
+	}
+
+	g_mutex_unlock (&pack->mutex);
+
+	image = NULL;
+	if (mapped_file != NULL) {
+		record = (const PackRecord *) (g_mapped_file_get_contents (mapped_file) + offset);
+		image = record_to_surface (record);
+		if (original_width != NULL)
+			*original_width = record->original_width;
+		if (original_height != NULL)
+			*original_height = record->original_height;
+
+		g_mapped_file_unref (mapped_file);
+	}
+
+	g_mutex_lock (&pack->mutex);
+	if (image != NULL)
+		pack->hits++;
+	else
+		pack->misses++;
+	g_mutex_unlock (&pack->mutex);
+
+	g_free (name);
+	g_free (folder_uri);
+
+	return image;
+}
+
+
+void
+gth_thumbnail_pack_store (GthThumbnailPack *pack,
+			  GFile            *file,
+			  GFileInfo        *info,
+			  int               thumbnail_size,
+			  cairo_surface_t  *image,
+			  int               original_width,
+			  int               original_height)
+{
+	gint64   mtime;
+	guint64  size;
+	char    *folder_uri;
+	char    *name;
+	GBytes  *bytes;
+
+	if (! get_file_stamp (info, &mtime, &size))
+		return;
+	if (! split_file_uri (file, &folder_uri, &name))
+		return;
+
+	bytes = record_new_for_image (name, mtime, size, image, original_width, original_height);
+	if (bytes != NULL) {
+		g_mutex_lock (&pack->mutex);
+		pack_folder_append (get_folder (pack, folder_uri, thumbnail_size), bytes);
+		g_mutex_unlock (&pack->mutex);
+		g_bytes_unref (bytes);
+	}
+
+	g_free (name);
+	g_free (folder_uri);
+}
+
+
+void
+gth_thumbnail_pack_invalidate (GthThumbnailPack *pack,
+			       GFile            *file)
+{
+	char           *folder_uri;
+	char           *name;
+	GHashTableIter  iter;
+	gpointer        value;
+
+	if (! split_file_uri (file, &folder_uri, &name))
+		return;
+
+	/* only the loaded packs are updated, the thumbnails saved in the
+	 * other packs are validated when read. */
+
+	g_mutex_lock (&pack->mutex);
+
+	g_hash_table_iter_init (&iter, pack->folders);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		PackFolder *folder = value;
+
+		if ((g_strcmp0 (folder->uri, folder_uri) == 0)
+		    && g_hash_table_contains (folder->records, name))
+		{
+			GBytes *bytes;
+
+			bytes = record_new_for_removed_file (name);
+			pack_folder_append (folder, bytes);
+			g_bytes_unref (bytes);
+		}
+	}
+
+	g_mutex_unlock (&pack->mutex);
+
+	g_free (name);
+	g_free (folder_uri);
+}
+
+
+/* Rewrites the packs with too many replaced thumbnails, if @force is FALSE
+ * only the packs not used recently are compacted. */
+void
+gth_thumbnail_pack_flush (GthThumbnailPack *pack,
+			  gboolean          force)
+{
+	GList *scan;
+
+	g_mutex_lock (&pack->mutex);
+
+	for (scan = pack->folders_lru->head; scan; scan = scan->next) {
+		PackFolder *folder = scan->data;
+
+		if ((force || (scan != pack->folders_lru->head)) && pack_folder_needs_compaction (folder))
+			pack_folder_compact (folder);
+	}
+
+	g_mutex_unlock (&pack->mutex);
+}
+
+
+void
+gth_thumbnail_pack_get_stats (GthThumbnailPack *pack,
+			      guint            *hits,
+			      guint            *misses)
+{
+	g_mutex_lock (&pack->mutex);
+	if (hits != NULL)
+		*hits = pack->hits;
+	if (misses != NULL)
+		*misses = pack->misses;
+	g_mutex_unlock (&pack->mutex);
+}
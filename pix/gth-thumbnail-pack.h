@@ -0,0 +1,63 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTH_THUMBNAIL_PACK_H
+#define GTH_THUMBNAIL_PACK_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <cairo.h>
+
+G_BEGIN_DECLS
+
+/* Thumbnails of the files of a folder, all of the same size, saved in a
+ * single memory-mapped file.  The thumbnails are kept as premultiplied
+ * ARGB data, compressed with the fastest zlib level, and are valid as long
+ * as the modification time and the size of the file do not change. */
+
+typedef struct _GthThumbnailPack GthThumbnailPack;
+
+GthThumbnailPack *  gth_thumbnail_pack_new         (GFile             *directory);
+void                gth_thumbnail_pack_free        (GthThumbnailPack  *pack);
+cairo_surface_t *   gth_thumbnail_pack_lookup      (GthThumbnailPack  *pack,
+						    GFile             *file,
+						    GFileInfo         *info,
+						    int                thumbnail_size,
+						    int               *original_width,
+						    int               *original_height);
+void                gth_thumbnail_pack_store       (GthThumbnailPack  *pack,
+						    GFile             *file,
+						    GFileInfo         *info,
+						    int                thumbnail_size,
+						    cairo_surface_t   *image,
+						    int                original_width,
+						    int                original_height);
+void                gth_thumbnail_pack_invalidate  (GthThumbnailPack  *pack,
+						    GFile             *file);
+void                gth_thumbnail_pack_flush       (GthThumbnailPack  *pack,
+						    gboolean           force);
+void                gth_thumbnail_pack_get_stats   (GthThumbnailPack  *pack,
+						    guint             *hits,
+						    guint             *misses);
+
+G_END_DECLS
+
+#endif /* GTH_THUMBNAIL_PACK_H */
@@ -0,0 +1,290 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include "glib-utils.h"
+#include "cairo-scale-kernels.h"
+
+
+static double
+triangle_weight (double   distance,
+		 gpointer user_data)
+{
+	distance = fabs (distance);
+	return (distance < 1.0) ? 1.0 - distance : 0.0;
+}
+
+
+static double
+sinc (double x)
+{
+	return (x == 0.0) ? 1.0 : sin (G_PI * x) / (G_PI * x);
+}
+
+
+static double
+lanczos3_weight (double   distance,
+		 gpointer user_data)
+{
+	distance = fabs (distance);
+	return (distance < 3.0) ? sinc (distance) * sinc (distance / 3.0) : 0.0;
+}
+
+
+/* The double precision version of a scale_weights_apply pass, as the
+ * scaler computed it before the fixed point weights. */
+static void
+reference_scale_pass (const guchar    *p_src,
+		      int              src_width,
+		      int              src_height,
+		      guchar          *p_dest,
+		      int              n_lines,
+		      ScaleWeightFunc  weight_func,
+		      double           filter_support,
+		      double           scale_factor)
+{
+	double  scale;
+	double  support;
+	double *weights;
+	int     y;
+
+	scale = MAX (1.0 / scale_factor, 1.0);
+	support = scale * filter_support;
+	if (support < 0.5) {
+		support = 0.5;
+		scale = 1.0;
+	}
+	scale = 1.0 / scale;
+
+	weights = g_new (double, (int) (2.0 * support + 3.0));
+	for (y = 0; y < n_lines; y++) {
+		double bisect;
+		int    start;
+		int    stop;
+		double density;
+		int    n;
+		int    x;
+		int    c;
+
+		bisect = ((double) y + 0.5) / scale_factor;
+		start = MAX ((int) (bisect - support + 0.5), 0);
+		stop = MIN ((int) (bisect + support + 0.5), src_width);
+
+		density = 0.0;
+		for (n = 0; n < stop - start; n++) {
+			weights[n] = weight_func (scale * ((double) (start + n) - bisect + 0.5), NULL);
+			density += weights[n];
+		}
+		if (density != 0.0)
+			for (n = 0; n < stop - start; n++)
+				weights[n] /= density;
+
+		for (x = 0; x < src_height; x++) {
+			for (c = 0; c < 4; c++) {
+				double value = 0.0;
+
+				for (n = 0; n < stop - start; n++)
+					value += weights[n] * p_src[((gsize) x * src_width + start + n) * 4 + c];
+				p_dest[((gsize) y * src_height + x) * 4 + c] = CLAMP (floor (value + 0.5), 0, 255);
+			}
+		}
+	}
+
+	g_free (weights);
+}
+
+
+typedef struct {
+	scale_weights_t *scale_weights;
+	const guchar    *p_src;
+	int              src_width;
+	int              src_height;
+	guchar          *p_dest;
+} ScalePassData;
+
+
+static void
+scale_pass_band_cb (int      first,
+		    int      last,
+		    gpointer user_data)
+{
+	ScalePassData *data = user_data;
+
+	scale_weights_apply (data->scale_weights,
+			     data->p_src,
+			     data->src_width * 4,
+			     data->p_dest,
+			     data->src_height * 4,
+			     data->src_height,
+			     first,
+			     last);
+}
+
+
+static const char *
+get_kernel_name (ScaleKernel kernel)
+{
+	switch (kernel) {
+	case SCALE_KERNEL_GENERIC:
+		return "generic";
+	case SCALE_KERNEL_SSE2:
+		return "sse2";
+	case SCALE_KERNEL_AVX2:
+		return "avx2";
+	case SCALE_KERNEL_NEON:
+		return "neon";
+	default:
+		return NULL;
+	}
+}
+
+
+static void
+test_scale_kernels (void)
+{
+	const int src_width = 173;
+	const int src_height = 61;
+	const int scaled_widths[] = { 17, 43, 86, 131, 172, 174, 260, 519 };
+	struct {
+		ScaleWeightFunc func;
+		double          support;
+	} filters[] = {
+		{ triangle_weight, 1.0 },
+		{ lanczos3_weight, 3.0 }
+	};
+	guchar      *p_src;
+	GRand       *rand;
+	ScaleKernel  kernel;
+	int          i, f, w;
+
+	rand = g_rand_new_with_seed (1);
+	p_src = g_new (guchar, src_width * src_height * 4);
+	for (i = 0; i < src_width * src_height * 4; i++)
+		p_src[i] = g_rand_int_range (rand, 0, 256);
+
+	for (kernel = SCALE_KERNEL_GENERIC; kernel < SCALE_KERNEL_N; kernel++) {
+		if (! scale_kernel_is_supported (kernel)) {
+			g_test_message ("%s kernel: not available", get_kernel_name (kernel));
+			continue;
+		}
+		g_test_message ("%s kernel", get_kernel_name (kernel));
+
+		for (f = 0; f < G_N_ELEMENTS (filters); f++) {
+			for (w = 0; w < G_N_ELEMENTS (scaled_widths); w++) {
+				int              n_lines = scaled_widths[w];
+				double           scale_factor = (double) n_lines / src_width;
+				gsize            size = (gsize) n_lines * src_height * 4;
+				scale_weights_t *scale_weights;
+				guchar          *p_expected;
+				guchar          *p_generic;
+				guchar          *p_scaled;
+
+				scale_weights = scale_weights_new (filters[f].func, NULL, filters[f].support, scale_factor, src_width, n_lines);
+
+				p_expected = g_new (guchar, size);
+				reference_scale_pass (p_src, src_width, src_height, p_expected, n_lines, filters[f].func, filters[f].support, scale_factor);
+
+				p_scaled = g_new (guchar, size);
+				scale_weights_apply_with_kernel (scale_weights, kernel, p_src, src_width * 4, p_scaled, src_height * 4, src_height, 0, n_lines);
+
+				/* the fixed point weights are within 1 of the
+				 * double precision result */
+
+				for (i = 0; i < size; i++)
+					g_assert_cmpint (ABS ((int) p_scaled[i] - (int) p_expected[i]), <=, 1);
+
+				/* the vector kernels only use integer
+				 * operations, they give the same result of the
+				 * generic one */
+
+				p_generic = g_new (guchar, size);
+				scale_weights_apply_with_kernel (scale_weights, SCALE_KERNEL_GENERIC, p_src, src_width * 4, p_generic, src_height * 4, src_height, 0, n_lines);
+				g_assert_cmpmem (p_scaled, size, p_generic, size);
+
+				g_free (p_generic);
+				g_free (p_scaled);
+				g_free (p_expected);
+				scale_weights_free (scale_weights);
+			}
+		}
+	}
+
+	g_free (p_src);
+	g_rand_free (rand);
+}
+
+
+static void
+test_scale_bands (void)
+{
+	const int        src_width = 173;
+	const int        src_height = 61;
+	const int        n_lines = 86;
+	gsize            size = (gsize) n_lines * src_height * 4;
+	scale_weights_t *scale_weights;
+	ScalePassData    data;
+	guchar          *p_src;
+	guchar          *p_serial;
+	guchar          *p_parallel;
+	GRand           *rand;
+	int              i;
+
+	rand = g_rand_new_with_seed (2);
+	p_src = g_new (guchar, src_width * src_height * 4);
+	for (i = 0; i < src_width * src_height * 4; i++)
+		p_src[i] = g_rand_int_range (rand, 0, 256);
+
+	scale_weights = scale_weights_new (lanczos3_weight, NULL, 3.0, (double) n_lines / src_width, src_width, n_lines);
+
+	p_serial = g_new (guchar, size);
+	scale_weights_apply (scale_weights, p_src, src_width * 4, p_serial, src_height * 4, src_height, 0, n_lines);
+
+	/* the bands don't change the result */
+
+	p_parallel = g_new (guchar, size);
+	data.scale_weights = scale_weights;
+	data.p_src = p_src;
+	data.src_width = src_width;
+	data.src_height = src_height;
+	data.p_dest = p_parallel;
+	_g_parallel_for_bands (n_lines, 3, scale_pass_band_cb, &data);
+	g_assert_cmpmem (p_parallel, size, p_serial, size);
+
+	g_free (p_parallel);
+	g_free (p_serial);
+	scale_weights_free (scale_weights);
+	g_free (p_src);
+	g_rand_free (rand);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/cairo-scale-kernels/kernels", test_scale_kernels);
+	g_test_add_func ("/cairo-scale-kernels/bands", test_scale_bands);
+
+	return g_test_run ();
+}
@@ -0,0 +1,386 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "glib-utils.h"
+#include "directory-walker.h"
+
+
+#define SKIPPED_DIRECTORY "skip"
+
+
+typedef struct {
+	GMainLoop    *loop;
+	GCancellable *cancellable;
+	GChecksum    *sequence;
+	int           stop_after;
+	int           cancel_after;
+	int           n_files;
+	int           n_dirs;
+	int           n_started;
+	GError       *error;
+} WalkTest;
+
+
+static void
+create_file (const char *path)
+{
+	int fd;
+
+	fd = g_creat (path, 0644);
+	g_assert_cmpint (fd, >=, 0);
+	g_close (fd, NULL);
+}
+
+
+static void
+create_directory (const char *path,
+		  int         n_files)
+{
+	int i;
+
+	g_assert_cmpint (g_mkdir (path, 0755), ==, 0);
+	for (i = 0; i < n_files; i++) {
+		char *filename;
+		char *name;
+
+		name = g_strdup_printf ("image-%05d.jpeg", i);
+		filename = g_build_filename (path, name, NULL);
+		create_file (filename);
+
+		g_free (filename);
+		g_free (name);
+	}
+}
+
+
+/* Creates @n_top directories with @n_sub sub-directories each, every
+ * sub-directory contains @n_files files.  A directory that the tests skip
+ * is added as well. */
+static char *
+create_tree (int n_top,
+	     int n_sub,
+	     int n_files)
+{
+	char *root;
+	char *path;
+	int   i, j;
+
+	root = g_dir_make_tmp ("pix-directory-walker-XXXXXX", NULL);
+	g_assert_nonnull (root);
+
+	for (i = 0; i < n_top; i++) {
+		char *top;
+
+		path = g_strdup_printf ("dir-%03d", i);
+		top = g_build_filename (root, path, NULL);
+		create_directory (top, 0);
+		g_free (path);
+
+		for (j = 0; j < n_sub; j++) {
+			char *name;
+
+			name = g_strdup_printf ("sub-%03d", j);
+			path = g_build_filename (top, name, NULL);
+			create_directory (path, n_files);
+
+			g_free (path);
+			g_free (name);
+		}
+
+		g_free (top);
+	}
+
+	path = g_build_filename (root, SKIPPED_DIRECTORY, NULL);
+	create_directory (path, n_files);
+	g_free (path);
+
+	path = g_build_filename (root, SKIPPED_DIRECTORY, "sub", NULL);
+	create_directory (path, n_files);
+	g_free (path);
+
+	return root;
+}
+
+
+static void
+remove_tree (const char *path)
+{
+	GDir       *dir;
+	const char *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		char *filename;
+
+		filename = g_build_filename (path, name, NULL);
+		if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+			remove_tree (filename);
+		else
+			g_unlink (filename);
+		g_free (filename);
+	}
+	g_dir_close (dir);
+	g_rmdir (path);
+}
+
+
+static DirOp
+start_dir_cb (GFile      *directory,
+	      GFileInfo  *info,
+	      GError    **error,
+	      gpointer    user_data)
+{
+	WalkTest   *test = user_data;
+	const char *name;
+	char       *uri;
+
+	name = g_file_info_get_name (info);
+	if (g_strcmp0 (name, SKIPPED_DIRECTORY) == 0)
+		return DIR_OP_SKIP;
+	if ((test->stop_after > 0) && (test->n_started == test->stop_after))
+		return DIR_OP_STOP;
+
+	test->n_started++;
+
+	uri = g_file_get_uri (directory);
+	g_checksum_update (test->sequence, (guchar *) "start:", -1);
+	g_checksum_update (test->sequence, (guchar *) uri, -1);
+	g_free (uri);
+
+	return DIR_OP_CONTINUE;
+}
+
+
+static void
+for_each_file_cb (GFile     *file,
+		  GFileInfo *info,
+		  gpointer   user_data)
+{
+	WalkTest *test = user_data;
+	char     *uri;
+
+	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+		test->n_dirs++;
+	else
+		test->n_files++;
+
+	uri = g_file_get_uri (file);
+	g_checksum_update (test->sequence, (guchar *) uri, -1);
+	g_free (uri);
+
+	if ((test->cancel_after > 0) && (test->n_files + test->n_dirs == test->cancel_after))
+		g_cancellable_cancel (test->cancellable);
+}
+
+
+static void
+done_cb (GError   *error,
+	 gpointer  user_data)
+{
+	WalkTest *test = user_data;
+
+	if (error != NULL)
+		test->error = g_error_copy (error);
+	g_main_loop_quit (test->loop);
+}
+
+
+static WalkTest *
+walk_test_new (void)
+{
+	WalkTest *test;
+
+	test = g_new0 (WalkTest, 1);
+	test->loop = g_main_loop_new (NULL, FALSE);
+	test->cancellable = g_cancellable_new ();
+	test->sequence = g_checksum_new (G_CHECKSUM_SHA1);
+
+	return test;
+}
+
+
+static void
+walk_test_free (WalkTest *test)
+{
+	g_main_loop_unref (test->loop);
+	g_object_unref (test->cancellable);
+	g_checksum_free (test->sequence);
+	g_clear_error (&test->error);
+	g_free (test);
+}
+
+
+static void
+walk_test_run (WalkTest   *test,
+	       const char *path,
+	       int         max_directories)
+{
+	GFile *directory;
+
+	directory = g_file_new_for_path (path);
+	_g_directory_walk_parallel (directory,
+				    FALSE,
+				    "standard::name,standard::type",
+				    max_directories,
+				    test->cancellable,
+				    start_dir_cb,
+				    for_each_file_cb,
+				    done_cb,
+				    test);
+	g_main_loop_run (test->loop);
+
+	g_object_unref (directory);
+}
+
+
+static void
+test_directory_walker_sequence (void)
+{
+	char     *root;
+	WalkTest *sequential;
+	WalkTest *parallel;
+
+	root = create_tree (4, 5, 300);
+
+	sequential = walk_test_new ();
+	walk_test_run (sequential, root, 1);
+	g_assert_no_error (sequential->error);
+
+	/* the skipped directory is reported but not visited */
+
+	g_assert_cmpint (sequential->n_dirs, ==, 4 + 4 * 5 + 1);
+	g_assert_cmpint (sequential->n_files, ==, 4 * 5 * 300);
+	g_assert_cmpint (sequential->n_started, ==, 1 + 4 + 4 * 5);
+
+	/* reading the directories in advance doesn't change the order of
+	 * the callbacks */
+
+	parallel = walk_test_new ();
+	walk_test_run (parallel, root, 8);
+	g_assert_no_error (parallel->error);
+	g_assert_cmpint (parallel->n_dirs, ==, sequential->n_dirs);
+	g_assert_cmpint (parallel->n_files, ==, sequential->n_files);
+	g_assert_cmpint (parallel->n_started, ==, sequential->n_started);
+	g_assert_cmpstr (g_checksum_get_string (parallel->sequence), ==, g_checksum_get_string (sequential->sequence));
+
+	walk_test_free (parallel);
+	walk_test_free (sequential);
+	remove_tree (root);
+	g_free (root);
+}
+
+
+static void
+test_directory_walker_stop (void)
+{
+	char     *root;
+	WalkTest *test;
+
+	root = create_tree (4, 5, 10);
+
+	/* stop after the base directory and the first top directory, only
+	 * their children are delivered */
+
+	test = walk_test_new ();
+	test->stop_after = 2;
+	walk_test_run (test, root, 8);
+	g_assert_no_error (test->error);
+	g_assert_cmpint (test->n_started, ==, 2);
+	g_assert_cmpint (test->n_dirs, ==, 4 + 1 + 5);
+	g_assert_cmpint (test->n_files, ==, 0);
+	walk_test_free (test);
+
+	test = walk_test_new ();
+	test->cancel_after = 20;
+	walk_test_run (test, root, 8);
+	g_assert_error (test->error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert_cmpint (test->n_files + test->n_dirs, <=, 20 + 128);
+	walk_test_free (test);
+
+	remove_tree (root);
+	g_free (root);
+}
+
+
+static void
+test_directory_walker_benchmark (void)
+{
+	char     *root;
+	int       n_top;
+	int       n_sub;
+	int       n_files;
+	GTimer   *timer;
+	WalkTest *test;
+	double    sequential_time;
+	double    parallel_time;
+
+	/* 1M files in 1000 directories with the -m perf option */
+
+	n_top = 10;
+	n_sub = g_test_perf () ? 100 : 10;
+	n_files = g_test_perf () ? 1000 : 20;
+	root = create_tree (n_top, n_sub, n_files);
+	timer = g_timer_new ();
+
+	test = walk_test_new ();
+	g_timer_start (timer);
+	walk_test_run (test, root, 1);
+	sequential_time = g_timer_elapsed (timer, NULL);
+	g_assert_no_error (test->error);
+	g_assert_cmpint (test->n_files, ==, n_top * n_sub * n_files);
+	walk_test_free (test);
+
+	test = walk_test_new ();
+	g_timer_start (timer);
+	walk_test_run (test, root, 8);
+	parallel_time = g_timer_elapsed (timer, NULL);
+	g_assert_no_error (test->error);
+	g_assert_cmpint (test->n_files, ==, n_top * n_sub * n_files);
+	walk_test_free (test);
+
+	g_test_message ("%d files: one directory at a time %.3fs, 8 directories at a time %.3fs",
+			n_top * n_sub * n_files,
+			sequential_time,
+			parallel_time);
+	if (g_test_perf ())
+		g_test_maximized_result (n_top * n_sub * n_files / parallel_time, "files per second");
+
+	g_timer_destroy (timer);
+	remove_tree (root);
+	g_free (root);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/directory-walker/sequence", test_directory_walker_sequence);
+	g_test_add_func ("/directory-walker/stop", test_directory_walker_stop);
+	g_test_add_func ("/directory-walker/benchmark", test_directory_walker_benchmark);
+
+	return g_test_run ();
+}
@@ -0,0 +1,349 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "file-copy.h"
+
+
+#define SMALL_FILE_SIZE (256 * 1024)
+#define LARGE_FILE_SIZE (20 * 1024 * 1024 + 123)
+
+
+typedef struct {
+	GMainLoop *loop;
+	gboolean   result;
+	GError    *error;
+	int        n_running;
+	goffset    last_progress;
+} CopyTest;
+
+
+static char *
+create_file (const char *directory,
+	     const char *name,
+	     gsize       size,
+	     guint32     seed)
+{
+	char    *filename;
+	guint32 *buffer;
+	GRand   *rand;
+	gsize    i;
+
+	buffer = g_malloc (size + sizeof (guint32));
+	rand = g_rand_new_with_seed (seed);
+	for (i = 0; i < size / sizeof (guint32) + 1; i++)
+		buffer[i] = g_rand_int (rand);
+	filename = g_build_filename (directory, name, NULL);
+	g_assert_true (g_file_set_contents (filename, (char *) buffer, size, NULL));
+
+	g_rand_free (rand);
+	g_free (buffer);
+
+	return filename;
+}
+
+
+static void
+assert_equal_files (const char *filename1,
+		    const char *filename2)
+{
+	char  *contents1;
+	gsize  size1;
+	char  *contents2;
+	gsize  size2;
+
+	g_assert_true (g_file_get_contents (filename1, &contents1, &size1, NULL));
+	g_assert_true (g_file_get_contents (filename2, &contents2, &size2, NULL));
+	g_assert_cmpmem (contents1, size1, contents2, size2);
+
+	g_free (contents2);
+	g_free (contents1);
+}
+
+
+static void
+remove_directory (char *path)
+{
+	GDir       *dir;
+	const char *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		char *filename;
+
+		filename = g_build_filename (path, name, NULL);
+		g_unlink (filename);
+		g_free (filename);
+	}
+	g_dir_close (dir);
+	g_rmdir (path);
+	g_free (path);
+}
+
+
+static void
+progress_cb (goffset  current_num_bytes,
+	     goffset  total_num_bytes,
+	     gpointer user_data)
+{
+	CopyTest *test = user_data;
+
+	g_assert_cmpint (current_num_bytes, >=, test->last_progress);
+	test->last_progress = current_num_bytes;
+}
+
+
+static void
+fast_copy_ready_cb (GObject      *source_object,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	CopyTest *test = user_data;
+
+	g_clear_error (&test->error);
+	test->result = _g_file_copy_fast_finish (G_FILE (source_object), result, &test->error);
+	test->n_running--;
+	if (test->n_running == 0)
+		g_main_loop_quit (test->loop);
+}
+
+
+static void
+gio_copy_ready_cb (GObject      *source_object,
+		   GAsyncResult *result,
+		   gpointer      user_data)
+{
+	CopyTest *test = user_data;
+
+	g_clear_error (&test->error);
+	test->result = g_file_copy_finish (G_FILE (source_object), result, &test->error);
+	test->n_running--;
+	if (test->n_running == 0)
+		g_main_loop_quit (test->loop);
+}
+
+
+static gboolean
+copy_file (CopyTest       *test,
+	   const char     *source_path,
+	   const char     *destination_path,
+	   GFileCopyFlags  flags)
+{
+	GFile *source;
+	GFile *destination;
+
+	source = g_file_new_for_path (source_path);
+	destination = g_file_new_for_path (destination_path);
+	test->n_running = 1;
+	test->last_progress = 0;
+	_g_file_copy_fast_async (source,
+				 destination,
+				 flags,
+				 G_PRIORITY_DEFAULT,
+				 NULL,
+				 progress_cb,
+				 test,
+				 fast_copy_ready_cb,
+				 test);
+	g_main_loop_run (test->loop);
+
+	g_object_unref (destination);
+	g_object_unref (source);
+
+	return test->result;
+}
+
+
+static void
+test_file_copy_semantics (void)
+{
+	char      *directory;
+	char      *source1;
+	char      *source2;
+	char      *destination;
+	char      *missing;
+	CopyTest   test = { 0 };
+	GStatBuf   source_stat;
+	GStatBuf   destination_stat;
+	GFile     *file;
+	GFileInfo *info;
+
+	directory = g_dir_make_tmp ("pix-file-copy-XXXXXX", NULL);
+	g_assert_nonnull (directory);
+	test.loop = g_main_loop_new (NULL, FALSE);
+
+	source1 = create_file (directory, "source1", LARGE_FILE_SIZE, 1);
+	source2 = create_file (directory, "source2", SMALL_FILE_SIZE, 2);
+	destination = g_build_filename (directory, "destination", NULL);
+	missing = g_build_filename (directory, "missing", NULL);
+
+	/* the content and the modification time are copied */
+
+	file = g_file_new_for_path (source1);
+	info = g_file_info_new ();
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, 1500000000);
+	g_assert_true (g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, NULL));
+	g_object_unref (info);
+	g_object_unref (file);
+
+	g_assert_true (copy_file (&test, source1, destination, G_FILE_COPY_ALL_METADATA));
+	g_assert_no_error (test.error);
+	assert_equal_files (source1, destination);
+	g_assert_cmpint (g_stat (source1, &source_stat), ==, 0);
+	g_assert_cmpint (g_stat (destination, &destination_stat), ==, 0);
+	g_assert_cmpint (destination_stat.st_mtime, ==, source_stat.st_mtime);
+	g_assert_cmpint (destination_stat.st_mode, ==, source_stat.st_mode);
+
+	/* existing files are not overwritten without G_FILE_COPY_OVERWRITE */
+
+	g_assert_false (copy_file (&test, source2, destination, G_FILE_COPY_NONE));
+	g_assert_error (test.error, G_IO_ERROR, G_IO_ERROR_EXISTS);
+	assert_equal_files (source1, destination);
+
+	g_assert_true (copy_file (&test, source2, destination, G_FILE_COPY_OVERWRITE));
+	g_assert_no_error (test.error);
+	assert_equal_files (source2, destination);
+
+	/* errors */
+
+	g_assert_false (copy_file (&test, missing, destination, G_FILE_COPY_OVERWRITE));
+	g_assert_error (test.error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+	assert_equal_files (source2, destination);
+
+	/* directories are copied by GIO */
+
+	g_assert_false (copy_file (&test, directory, missing, G_FILE_COPY_NONE));
+	g_assert_error (test.error, G_IO_ERROR, G_IO_ERROR_WOULD_RECURSE);
+
+	g_clear_error (&test.error);
+	g_main_loop_unref (test.loop);
+	g_free (missing);
+	g_free (destination);
+	g_free (source2);
+	g_free (source1);
+	remove_directory (directory);
+}
+
+
+static double
+copy_files (char       **sources,
+	    int          n_files,
+	    const char  *directory,
+	    int          max_in_flight,
+	    gboolean     use_gio)
+{
+	CopyTest  test = { 0 };
+	GTimer   *timer;
+	double    elapsed;
+	int       i;
+
+	test.loop = g_main_loop_new (NULL, FALSE);
+	timer = g_timer_new ();
+
+	for (i = 0; i < n_files; i += max_in_flight) {
+		int j;
+
+		test.n_running = MIN (max_in_flight, n_files - i);
+		for (j = i; j < i + test.n_running; j++) {
+			GFile *source;
+			GFile *destination;
+			char  *name;
+
+			source = g_file_new_for_path (sources[j]);
+			name = g_strdup_printf ("%s/copy-%05d", directory, j);
+			destination = g_file_new_for_path (name);
+			if (use_gio)
+				g_file_copy_async (source, destination, G_FILE_COPY_OVERWRITE, G_PRIORITY_DEFAULT, NULL, NULL, NULL, gio_copy_ready_cb, &test);
+			else
+				_g_file_copy_fast_async (source, destination, G_FILE_COPY_OVERWRITE, G_PRIORITY_DEFAULT, NULL, NULL, NULL, fast_copy_ready_cb, &test);
+
+			g_object_unref (destination);
+			g_free (name);
+			g_object_unref (source);
+		}
+		g_main_loop_run (test.loop);
+		g_assert_no_error (test.error);
+	}
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_timer_destroy (timer);
+	g_main_loop_unref (test.loop);
+
+	return elapsed;
+}
+
+
+static void
+test_file_copy_benchmark (void)
+{
+	char    *directory;
+	char   **sources;
+	int      n_files;
+	gsize    file_size;
+	double   gio_time;
+	double   fast_time;
+	int      i;
+
+	/* 2000 files of 4MB with the -m perf option */
+
+	n_files = g_test_perf () ? 2000 : 100;
+	file_size = g_test_perf () ? 4 * 1024 * 1024 : SMALL_FILE_SIZE;
+
+	directory = g_dir_make_tmp ("pix-file-copy-XXXXXX", NULL);
+	g_assert_nonnull (directory);
+	sources = g_new0 (char *, n_files + 1);
+	for (i = 0; i < n_files; i++) {
+		char *name;
+
+		name = g_strdup_printf ("source-%05d", i);
+		sources[i] = create_file (directory, name, file_size, i);
+		g_free (name);
+	}
+
+	gio_time = copy_files (sources, n_files, directory, 1, TRUE);
+	fast_time = copy_files (sources, n_files, directory, 4, FALSE);
+
+	g_test_message ("%d files of %" G_GSIZE_FORMAT " bytes: g_file_copy_async %.3fs, fast copy with 4 files at a time %.3fs",
+			n_files,
+			file_size,
+			gio_time,
+			fast_time);
+	if (g_test_perf ())
+		g_test_maximized_result ((double) n_files * file_size / fast_time / (1024 * 1024), "MB per second");
+
+	g_strfreev (sources);
+	remove_directory (directory);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/file-copy/semantics", test_file_copy_semantics);
+	g_test_add_func ("/file-copy/benchmark", test_file_copy_benchmark);
+
+	return g_test_run ();
+}
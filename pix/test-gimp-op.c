@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "gimp-op.h"
+
+
+static void
+fill_random (guchar *data,
+	     int     size,
+	     GRand  *rand)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		data[i] = g_rand_int_range (rand, 0, 256);
+}
+
+
+/* The reference implementation, a pixel at a time with the lookup
+ * table. */
+static void
+normal_row_with_table (guchar       *image_row,
+		       const guchar *layer_row,
+		       const guchar *alpha_row,
+		       int           n_pixels)
+{
+	int    i;
+	guchar a;
+	int    temp;
+
+	for (i = 0; i < n_pixels; i++) {
+		a = alpha_row[i];
+		if (a != 0) {
+			image_row[CAIRO_RED] = GIMP_OP_NORMAL (layer_row[CAIRO_RED], image_row[CAIRO_RED], a);
+			image_row[CAIRO_GREEN] = GIMP_OP_NORMAL (layer_row[CAIRO_GREEN], image_row[CAIRO_GREEN], a);
+			image_row[CAIRO_BLUE] = GIMP_OP_NORMAL (layer_row[CAIRO_BLUE], image_row[CAIRO_BLUE], a);
+			image_row[CAIRO_ALPHA] = GIMP_OP_NORMAL (255, image_row[CAIRO_ALPHA], a);
+		}
+		image_row += 4;
+		layer_row += 4;
+	}
+}
+
+
+static void
+test_gimp_op_normal_row (void)
+{
+	GRand  *rand;
+	guchar  image[4 * 67];
+	guchar  expected[4 * 67];
+	guchar  layer[4 * 67];
+	guchar  alpha[67];
+	int     n_pixels;
+	int     i;
+
+	gimp_op_init ();
+	rand = g_rand_new_with_seed (1);
+
+	for (i = 0; i < 1000; i++) {
+		n_pixels = g_rand_int_range (rand, 0, G_N_ELEMENTS (alpha) + 1);
+		fill_random (image, sizeof (image), rand);
+		fill_random (layer, sizeof (layer), rand);
+		fill_random (alpha, sizeof (alpha), rand);
+
+		/* fully transparent and fully opaque pixels as well */
+
+		alpha[g_rand_int_range (rand, 0, G_N_ELEMENTS (alpha))] = 0;
+		alpha[g_rand_int_range (rand, 0, G_N_ELEMENTS (alpha))] = 255;
+
+		memcpy (expected, image, sizeof (image));
+		normal_row_with_table (expected, layer, alpha, n_pixels);
+		gimp_op_normal_row (image, layer, alpha, n_pixels);
+		g_assert_cmpmem (image, sizeof (image), expected, sizeof (expected));
+	}
+
+	g_rand_free (rand);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/gimp-op/normal-row", test_gimp_op_normal_row);
+
+	return g_test_run ();
+}
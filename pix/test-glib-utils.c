@@ -1203,6 +1203,106 @@ test_g_uri_remove_extension_all (void)
 }
 
 
+typedef struct {
+	int  n_items;
+	int  band_size;
+	int *count;
+	int *values;
+	int  errors;
+} BandsTestData;
+
+
+static void
+count_items_cb (int      first,
+		int      last,
+		gpointer user_data)
+{
+	BandsTestData *data = user_data;
+	int            i;
+
+	if ((first % data->band_size != 0) || (last != MIN (first + data->band_size, data->n_items)))
+		g_atomic_int_inc (&data->errors);
+
+	for (i = first; i < last; i++) {
+		g_atomic_int_inc (&data->count[i]);
+		data->values[i] = (i * 7919) % 65521;
+	}
+}
+
+
+static void
+check_bands (int n_items,
+	     int band_size)
+{
+	BandsTestData data;
+	int           i;
+
+	data.n_items = n_items;
+	data.band_size = band_size;
+	data.count = g_new0 (int, n_items);
+	data.values = g_new0 (int, n_items);
+	data.errors = 0;
+
+	_g_parallel_for_bands (n_items, band_size, count_items_cb, &data);
+
+	g_assert_cmpint (data.errors, ==, 0);
+	for (i = 0; i < n_items; i++) {
+		g_assert_cmpint (data.count[i], ==, 1);
+		g_assert_cmpint (data.values[i], ==, (i * 7919) % 65521);
+	}
+
+	g_free (data.values);
+	g_free (data.count);
+}
+
+
+static void
+nested_bands_cb (int      first,
+		 int      last,
+		 gpointer user_data)
+{
+	int i;
+
+	for (i = first; i < last; i++)
+		check_bands (100 + i, 7);
+}
+
+
+static gpointer
+concurrent_bands_thread (gpointer user_data)
+{
+	_g_parallel_for_bands (16, 1, nested_bands_cb, NULL);
+	return NULL;
+}
+
+
+static void
+test_g_parallel_for_bands (void)
+{
+	GThread *threads[4];
+	int      i;
+
+	check_bands (1, 1);
+	check_bands (1, 16);
+	check_bands (1000, 1);
+	check_bands (1000, 7);
+	check_bands (1000, 999);
+	check_bands (1000, 1000);
+	check_bands (1000, 2000);
+	check_bands (12345, 16);
+
+	/* a call from inside a band, and calls from several threads at the
+	 * same time */
+
+	_g_parallel_for_bands (16, 1, nested_bands_cb, NULL);
+
+	for (i = 0; i < G_N_ELEMENTS (threads); i++)
+		threads[i] = g_thread_new ("test", concurrent_bands_thread, NULL);
+	for (i = 0; i < G_N_ELEMENTS (threads); i++)
+		g_thread_join (threads[i]);
+}
+
+
 int
 main (int   argc,
       char *argv[])
@@ -1253,6 +1353,7 @@ main (int   argc,
 	g_test_add_func ("/glib-utils/_g_file_get_display_name", test_g_file_get_display_name_all);
 	g_test_add_func ("/glib-utils/_g_rand_string", test_g_rand_string);
 	g_test_add_func ("/glib-utils/regex", test_regexp);
+	g_test_add_func ("/glib-utils/_g_parallel_for_bands", test_g_parallel_for_bands);
 
 	return g_test_run ();
 }
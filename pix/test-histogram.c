@@ -0,0 +1,237 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "cairo-utils.h"
+#include "gth-histogram.h"
+
+
+static cairo_surface_t *
+create_random_image (int       width,
+		     int       height,
+		     gboolean  opaque,
+		     GRand    *rand)
+{
+	cairo_surface_t *image;
+	guchar          *data;
+	int              stride;
+	int              x, y;
+
+	image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	data = cairo_image_surface_get_data (image);
+	stride = cairo_image_surface_get_stride (image);
+	for (y = 0; y < height; y++) {
+		guint32 *pixel = (guint32 *) (data + ((gsize) y * stride));
+
+		for (x = 0; x < width; x++) {
+			guint32 value = g_rand_int (rand);
+
+			if (opaque) {
+				value |= 0xff000000;
+			}
+			else {
+				guint32 alpha = (value >> 24) | 1;
+				guint32 red = ((value >> 16) & 0xff) * alpha / 255;
+				guint32 green = ((value >> 8) & 0xff) * alpha / 255;
+				guint32 blue = (value & 0xff) * alpha / 255;
+
+				value = CAIRO_RGBA_TO_UINT32 (red, green, blue, alpha);
+			}
+			*pixel++ = value;
+		}
+	}
+	cairo_surface_mark_dirty (image);
+
+	return image;
+}
+
+
+/* The reference implementation, every pixel in a single thread. */
+static void
+histogram_with_loop (cairo_surface_t *image,
+		     gboolean         has_alpha,
+		     int              values[GTH_HISTOGRAM_N_CHANNELS][256])
+{
+	guchar *data;
+	int     stride;
+	int     width, height;
+	int     x, y;
+	int     temp;
+
+	memset (values, 0, sizeof (int) * GTH_HISTOGRAM_N_CHANNELS * 256);
+	data = cairo_image_surface_get_data (image);
+	stride = cairo_image_surface_get_stride (image);
+	width = cairo_image_surface_get_width (image);
+	height = cairo_image_surface_get_height (image);
+	for (y = 0; y < height; y++) {
+		guchar *pixel = data + ((gsize) y * stride);
+
+		for (x = 0; x < width; x++) {
+			guchar red, green, blue, alpha;
+
+			if (has_alpha) {
+				CAIRO_GET_RGBA (pixel, red, green, blue, alpha);
+				values[GTH_HISTOGRAM_CHANNEL_ALPHA][alpha] += 1;
+			}
+			else
+				CAIRO_GET_RGB (pixel, red, green, blue);
+
+			values[GTH_HISTOGRAM_CHANNEL_RED][red] += 1;
+			values[GTH_HISTOGRAM_CHANNEL_GREEN][green] += 1;
+			values[GTH_HISTOGRAM_CHANNEL_BLUE][blue] += 1;
+			values[GTH_HISTOGRAM_CHANNEL_VALUE][MAX (MAX (red, green), blue)] += 1;
+
+			pixel += 4;
+		}
+	}
+}
+
+
+static void
+assert_histogram (GthHistogram    *histogram,
+		  cairo_surface_t *image,
+		  gboolean         has_alpha)
+{
+	int values[GTH_HISTOGRAM_N_CHANNELS][256];
+	int n_channels;
+	int c, v;
+
+	histogram_with_loop (image, has_alpha, values);
+
+	n_channels = has_alpha ? GTH_HISTOGRAM_N_CHANNELS : GTH_HISTOGRAM_N_CHANNELS - 1;
+	g_assert_cmpint (gth_histogram_get_nchannels (histogram), ==, n_channels - 1);
+	g_assert_cmpint (gth_histogram_get_n_pixels (histogram), ==, cairo_image_surface_get_width (image) * cairo_image_surface_get_height (image));
+	for (c = 0; c < n_channels; c++) {
+		int max = 0;
+
+		for (v = 0; v < 256; v++) {
+			g_assert_cmpint ((int) gth_histogram_get_value (histogram, c, v), ==, values[c][v]);
+			max = MAX (max, values[c][v]);
+		}
+		g_assert_cmpint ((int) gth_histogram_get_channel_max (histogram, c), ==, max);
+	}
+}
+
+
+static void
+test_histogram_calculate (void)
+{
+	GRand           *rand;
+	GthHistogram    *histogram;
+	cairo_surface_t *image;
+	int              total;
+	int              v;
+
+	rand = g_rand_new_with_seed (6);
+	histogram = gth_histogram_new ();
+
+	/* more than a band of rows, not a multiple of the band size */
+
+	image = create_random_image (517, 301, TRUE, rand);
+	gth_histogram_calculate_for_image (histogram, image);
+	assert_histogram (histogram, image, FALSE);
+	cairo_surface_destroy (image);
+
+	image = create_random_image (517, 301, FALSE, rand);
+	gth_histogram_calculate_for_image (histogram, image);
+	assert_histogram (histogram, image, TRUE);
+	cairo_surface_destroy (image);
+
+	/* the preview reads a grid of pixels of the large images */
+
+	image = create_random_image (2000, 1500, TRUE, rand);
+	gth_histogram_calculate_for_image_preview (histogram, image);
+	g_assert_cmpint (gth_histogram_get_n_pixels (histogram), <, 2000 * 1500);
+	g_assert_cmpint (gth_histogram_get_n_pixels (histogram), >=, 1024 * 1024 / 4);
+	total = 0;
+	for (v = 0; v < 256; v++)
+		total += (int) gth_histogram_get_value (histogram, GTH_HISTOGRAM_CHANNEL_VALUE, v);
+	g_assert_cmpint (total, ==, gth_histogram_get_n_pixels (histogram));
+	cairo_surface_destroy (image);
+
+	g_object_unref (histogram);
+	g_rand_free (rand);
+}
+
+
+static void
+test_histogram_benchmark (void)
+{
+	GRand           *rand;
+	GthHistogram    *histogram;
+	cairo_surface_t *image;
+	int              values[GTH_HISTOGRAM_N_CHANNELS][256];
+	int              width;
+	int              height;
+	GTimer          *timer;
+	double           loop_time;
+	double           parallel_time;
+	double           preview_time;
+
+	/* a 50 megapixel photo */
+
+	rand = g_rand_new_with_seed (50);
+	width = g_test_perf () ? 8660 : 1000;
+	height = g_test_perf () ? 5774 : 500;
+	image = create_random_image (width, height, TRUE, rand);
+	histogram = gth_histogram_new ();
+	timer = g_timer_new ();
+
+	g_timer_start (timer);
+	histogram_with_loop (image, FALSE, values);
+	loop_time = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	gth_histogram_calculate_for_image (histogram, image);
+	parallel_time = g_timer_elapsed (timer, NULL);
+	assert_histogram (histogram, image, FALSE);
+
+	g_timer_start (timer);
+	gth_histogram_calculate_for_image_preview (histogram, image);
+	preview_time = g_timer_elapsed (timer, NULL);
+
+	g_test_message ("%d pixels: loop %.3fs, gth_histogram_calculate_for_image %.3fs, preview %.3fs",
+			width * height,
+			loop_time,
+			parallel_time,
+			preview_time);
+	if (g_test_perf ())
+		g_test_maximized_result ((double) width * height / parallel_time, "pixels per second");
+
+	g_timer_destroy (timer);
+	g_object_unref (histogram);
+	cairo_surface_destroy (image);
+	g_rand_free (rand);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/histogram/calculate", test_histogram_calculate);
+	g_test_add_func ("/histogram/benchmark", test_histogram_benchmark);
+
+	return g_test_run ();
+}
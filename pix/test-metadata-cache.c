@@ -0,0 +1,431 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib/gstdio.h>
+#include <time.h>
+#include <utime.h>
+#include "glib-utils.h"
+#include "gth-metadata.h"
+#include "gth-metadata-cache.h"
+#include "gth-string-list.h"
+
+
+#define FILE_MTIME 1500000000
+#define FILE_SIZE  123456
+
+
+static gint64 sidecars_stamp = 0;
+static int    sidecars_calls = 0;
+
+
+static gint64
+get_sidecars_stamp (GFile *file)
+{
+	sidecars_calls++;
+	return sidecars_stamp;
+}
+
+
+static char *
+create_cache_dir (void)
+{
+	char *path;
+
+	path = g_dir_make_tmp ("pix-metadata-cache-XXXXXX", NULL);
+	g_assert_nonnull (path);
+
+	return path;
+}
+
+
+static void
+remove_cache_dir (char *path)
+{
+	GDir       *dir;
+	const char *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		char *filename;
+
+		filename = g_build_filename (path, name, NULL);
+		g_unlink (filename);
+		g_free (filename);
+	}
+	g_dir_close (dir);
+	g_rmdir (path);
+	g_free (path);
+}
+
+
+static GFile *
+get_test_file (int n)
+{
+	char  *path;
+	GFile *file;
+
+	path = g_strdup_printf ("/pix-test/folder/image-%05d.jpeg", n);
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	return file;
+}
+
+
+static GFileInfo *
+create_file_info (guint64 mtime)
+{
+	GFileInfo *info;
+
+	info = g_file_info_new ();
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
+	g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, 0);
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE, FILE_SIZE);
+
+	return info;
+}
+
+
+static void
+add_metadata (GFileInfo *info,
+	      int        n)
+{
+	GthMetadata   *metadata;
+	GthStringList *string_list;
+	char          *raw;
+	char          *formatted;
+	GList         *tags;
+
+	raw = g_strdup_printf ("2019:08:%02d 10:00:00", (n % 28) + 1);
+	formatted = g_strdup_printf ("%02d August 2019, 10:00:00", (n % 28) + 1);
+	metadata = g_object_new (GTH_TYPE_METADATA,
+				 "id", "Exif::Photo::DateTimeOriginal",
+				 "raw", raw,
+				 "formatted", formatted,
+				 "value-type", "Ascii",
+				 NULL);
+	g_file_info_set_attribute_object (info, "Exif::Photo::DateTimeOriginal", G_OBJECT (metadata));
+	g_object_unref (metadata);
+
+	tags = g_list_append (NULL, "sea");
+	tags = g_list_append (tags, "holidays");
+	string_list = gth_string_list_new (tags);
+	metadata = gth_metadata_new_for_string_list (string_list);
+	g_file_info_set_attribute_object (info, "general::tags", G_OBJECT (metadata));
+	g_object_unref (metadata);
+	g_object_unref (string_list);
+	g_list_free (tags);
+
+	g_file_info_set_attribute_string (info, "general::title", "Beach");
+	g_file_info_set_attribute_int32 (info, "image::width", 6000 + n);
+	g_file_info_set_attribute_boolean (info, "comment::no-comment-file", TRUE);
+	g_file_info_set_attribute_string (info, "gth::file::display-size", "123 kB");
+
+	g_free (formatted);
+	g_free (raw);
+}
+
+
+static void
+check_metadata (GFileInfo *info,
+		int        n)
+{
+	GObject       *object;
+	GthStringList *string_list;
+	GList         *list;
+	char          *raw;
+
+	object = g_file_info_get_attribute_object (info, "Exif::Photo::DateTimeOriginal");
+	g_assert_true (GTH_IS_METADATA (object));
+	raw = g_strdup_printf ("2019:08:%02d 10:00:00", (n % 28) + 1);
+	g_assert_cmpstr (gth_metadata_get_raw (GTH_METADATA (object)), ==, raw);
+	g_assert_cmpstr (gth_metadata_get_id (GTH_METADATA (object)), ==, "Exif::Photo::DateTimeOriginal");
+	g_assert_cmpstr (gth_metadata_get_value_type (GTH_METADATA (object)), ==, "Ascii");
+	g_assert_cmpint (gth_metadata_get_data_type (GTH_METADATA (object)), ==, GTH_METADATA_TYPE_STRING);
+	g_free (raw);
+
+	object = g_file_info_get_attribute_object (info, "general::tags");
+	g_assert_true (GTH_IS_METADATA (object));
+	g_assert_cmpint (gth_metadata_get_data_type (GTH_METADATA (object)), ==, GTH_METADATA_TYPE_STRING_LIST);
+	string_list = gth_metadata_get_string_list (GTH_METADATA (object));
+	list = gth_string_list_get_list (string_list);
+	g_assert_cmpint (g_list_length (list), ==, 2);
+	g_assert_cmpstr (list->data, ==, "sea");
+	g_assert_cmpstr (list->next->data, ==, "holidays");
+
+	g_assert_cmpstr (g_file_info_get_attribute_string (info, "general::title"), ==, "Beach");
+	g_assert_cmpint (g_file_info_get_attribute_int32 (info, "image::width"), ==, 6000 + n);
+	g_assert_true (g_file_info_get_attribute_boolean (info, "comment::no-comment-file"));
+}
+
+
+static void
+test_metadata_cache_round_trip (void)
+{
+	char              *path;
+	GFile             *directory;
+	GthMetadataCache  *cache;
+	GFile             *file;
+	GFileInfo         *info;
+	char             **mask_v;
+	char             **other_mask_v;
+
+	path = create_cache_dir ();
+	directory = g_file_new_for_path (path);
+	file = get_test_file (1);
+	mask_v = g_strsplit ("Exif::Photo::DateTimeOriginal,general::*", ",", -1);
+	other_mask_v = g_strsplit ("Exif::Image::Model", ",", -1);
+
+	cache = gth_metadata_cache_new (directory);
+	info = create_file_info (FILE_MTIME);
+	g_assert_false (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	add_metadata (info, 1);
+	gth_metadata_cache_store (cache, file, info, 0, mask_v);
+	g_object_unref (info);
+	gth_metadata_cache_free (cache);
+
+	/* read the data saved on disk */
+
+	cache = gth_metadata_cache_new (directory);
+
+	info = create_file_info (FILE_MTIME);
+	g_assert_true (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	check_metadata (info, 1);
+	g_assert_false (g_file_info_has_attribute (info, "gth::file::display-size"));
+	g_object_unref (info);
+
+	/* the entry is not valid if the file changed */
+
+	info = create_file_info (FILE_MTIME + 1);
+	g_assert_false (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	g_object_unref (info);
+
+	/* the entry is not valid for attributes not read before */
+
+	info = create_file_info (FILE_MTIME);
+	g_assert_false (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, other_mask_v));
+	g_file_info_set_attribute_string (info, "Exif::Image::Model", "Camera");
+	gth_metadata_cache_store (cache, file, info, 0, other_mask_v);
+	g_object_unref (info);
+
+	info = create_file_info (FILE_MTIME);
+	g_assert_true (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	check_metadata (info, 1);
+	g_assert_cmpstr (g_file_info_get_attribute_string (info, "Exif::Image::Model"), ==, "Camera");
+	g_object_unref (info);
+
+	/* invalidation */
+
+	gth_metadata_cache_invalidate (cache, file);
+	info = create_file_info (FILE_MTIME);
+	g_assert_false (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	add_metadata (info, 1);
+	gth_metadata_cache_store (cache, file, info, 0, mask_v);
+	g_object_unref (info);
+
+	/* the file is not found while the invalidation is pending, the cache
+	 * waits for the pending invalidations when freed. */
+
+	gth_metadata_cache_invalidate_async (cache, file);
+	info = create_file_info (FILE_MTIME);
+	g_assert_false (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	g_object_unref (info);
+
+	gth_metadata_cache_free (cache);
+
+	/* the sidecars were never checked: the folder doesn't exist */
+
+	g_assert_cmpint (sidecars_calls, ==, 0);
+
+	g_strfreev (other_mask_v);
+	g_strfreev (mask_v);
+	g_object_unref (file);
+	g_object_unref (directory);
+	remove_cache_dir (path);
+}
+
+
+static void
+test_metadata_cache_sidecars (void)
+{
+	char              *path;
+	GFile             *directory;
+	char              *folder_path;
+	char              *filename;
+	GFile             *file;
+	char              *sidecar;
+	GthMetadataCache  *cache;
+	GFileInfo         *info;
+	char             **mask_v;
+	struct utimbuf     times;
+
+	path = create_cache_dir ();
+	directory = g_file_new_for_path (path);
+	folder_path = create_cache_dir ();
+	filename = g_build_filename (folder_path, "image.jpeg", NULL);
+	g_assert_true (g_file_set_contents (filename, "", 0, NULL));
+	file = g_file_new_for_path (filename);
+	sidecar = g_build_filename (folder_path, "image.xmp", NULL);
+	mask_v = g_strsplit ("general::*", ",", -1);
+
+	/* move the folder time back, a new file changes it to the current
+	 * time. */
+
+	times.actime = times.modtime = time (NULL) - 60;
+	g_assert_cmpint (g_utime (folder_path, &times), ==, 0);
+
+	sidecars_stamp = 0;
+	sidecars_calls = 0;
+	cache = gth_metadata_cache_new (directory);
+
+	info = create_file_info (FILE_MTIME);
+	g_assert_false (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	g_file_info_set_attribute_string (info, "general::title", "Beach");
+	gth_metadata_cache_store (cache, file, info, sidecars_stamp, mask_v);
+	g_object_unref (info);
+
+	/* the folder didn't change: the sidecars are not checked */
+
+	info = create_file_info (FILE_MTIME);
+	g_assert_true (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	g_assert_cmpstr (g_file_info_get_attribute_string (info, "general::title"), ==, "Beach");
+	g_object_unref (info);
+	g_assert_cmpint (sidecars_calls, ==, 0);
+
+	/* a sidecar is created: the folder changed and the entry is not
+	 * valid anymore */
+
+	g_assert_true (g_file_set_contents (sidecar, "", 0, NULL));
+	sidecars_stamp = 1;
+
+	info = create_file_info (FILE_MTIME);
+	g_assert_false (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+	g_object_unref (info);
+	g_assert_cmpint (sidecars_calls, ==, 1);
+
+	gth_metadata_cache_free (cache);
+
+	g_strfreev (mask_v);
+	g_free (sidecar);
+	g_object_unref (file);
+	g_free (filename);
+	remove_cache_dir (folder_path);
+	g_object_unref (directory);
+	remove_cache_dir (path);
+}
+
+
+static void
+test_metadata_cache_folder_open (void)
+{
+	char              *path;
+	GFile             *directory;
+	GthMetadataCache  *cache;
+	char             **mask_v;
+	int                n_files;
+	GTimer            *timer;
+	double             cold_time;
+	double             warm_time;
+	guint              hits;
+	guint              misses;
+	int                i;
+
+	path = create_cache_dir ();
+	directory = g_file_new_for_path (path);
+	mask_v = g_strsplit ("Exif::Photo::DateTimeOriginal,general::*", ",", -1);
+	n_files = g_test_perf () ? 20000 : 1000;
+	timer = g_timer_new ();
+
+	/* cold open: every lookup fails and the metadata is stored */
+
+	cache = gth_metadata_cache_new (directory);
+	g_timer_start (timer);
+	for (i = 0; i < n_files; i++) {
+		GFile     *file;
+		GFileInfo *info;
+
+		file = get_test_file (i);
+		info = create_file_info (FILE_MTIME);
+		if (! gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v)) {
+			add_metadata (info, i);
+			gth_metadata_cache_store (cache, file, info, 0, mask_v);
+		}
+
+		g_object_unref (info);
+		g_object_unref (file);
+	}
+	gth_metadata_cache_free (cache);
+	cold_time = g_timer_elapsed (timer, NULL);
+
+	/* warm open: the metadata is read from the cache */
+
+	cache = gth_metadata_cache_new (directory);
+	g_timer_start (timer);
+	for (i = 0; i < n_files; i++) {
+		GFile     *file;
+		GFileInfo *info;
+
+		file = get_test_file (i);
+		info = create_file_info (FILE_MTIME);
+		g_assert_true (gth_metadata_cache_lookup (cache, file, info, get_sidecars_stamp, mask_v));
+		if (i % 100 == 0)
+			check_metadata (info, i);
+
+		g_object_unref (info);
+		g_object_unref (file);
+	}
+	warm_time = g_timer_elapsed (timer, NULL);
+
+	gth_metadata_cache_get_stats (cache, &hits, &misses);
+	g_assert_cmpint (hits, ==, n_files);
+	g_assert_cmpint (misses, ==, 0);
+	gth_metadata_cache_free (cache);
+
+	/* the time of the cold open doesn't include the time needed by the
+	 * metadata providers to read the files. */
+
+	g_test_message ("%d files: cold open %.3fs (without the metadata providers), warm open %.3fs",
+			n_files,
+			cold_time,
+			warm_time);
+	if (g_test_perf ())
+		g_test_maximized_result (n_files / warm_time, "files per second from the cache");
+
+	g_timer_destroy (timer);
+	g_strfreev (mask_v);
+	g_object_unref (directory);
+	remove_cache_dir (path);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/metadata-cache/round-trip", test_metadata_cache_round_trip);
+	g_test_add_func ("/metadata-cache/sidecars", test_metadata_cache_sidecars);
+	g_test_add_func ("/metadata-cache/folder-open", test_metadata_cache_folder_open);
+
+	return g_test_run ();
+}
@@ -0,0 +1,290 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "gth-sort-key.h"
+
+
+static const char *names[] = { NULL, "a", "b", "ba", "c", "d" };
+
+
+static GthSortKey *
+create_keys (int    n_keys,
+	     int    max_number,
+	     GRand *rand)
+{
+	GthSortKey *keys;
+	int         i;
+
+	keys = g_new0 (GthSortKey, n_keys);
+	for (i = 0; i < n_keys; i++) {
+		keys[i].number = g_rand_int_range (rand, -max_number, max_number + 1);
+		keys[i].text = names[g_rand_int_range (rand, 0, G_N_ELEMENTS (names))];
+		keys[i].name = names[g_rand_int_range (rand, 0, G_N_ELEMENTS (names))];
+		keys[i].item = GINT_TO_POINTER (i);
+	}
+
+	return keys;
+}
+
+
+static int
+compare_keys_func (gconstpointer a,
+		   gconstpointer b,
+		   gpointer      user_data)
+{
+	int result;
+
+	result = gth_sort_key_compare (a, b);
+	if (GPOINTER_TO_INT (user_data))
+		result = -result;
+
+	return result;
+}
+
+
+static void
+assert_sorted_as_reference (GthSortKey *keys,
+			    int         n_keys,
+			    int         n_sorted,
+			    gboolean    inverse)
+{
+	GthSortKey *reference;
+	int         i;
+
+	/* g_qsort_with_data is stable, as the sort with the keys */
+
+	reference = g_new (GthSortKey, n_keys);
+	memcpy (reference, keys, sizeof (GthSortKey) * n_keys);
+	g_qsort_with_data (reference, n_keys, sizeof (GthSortKey), compare_keys_func, GINT_TO_POINTER (inverse));
+
+	gth_sort_keys_sort (keys, n_keys, n_sorted, inverse);
+	for (i = 0; i < n_keys; i++)
+		g_assert_true (keys[i].item == reference[i].item);
+
+	g_free (reference);
+}
+
+
+static void
+test_sort_key_order (void)
+{
+	GRand *rand;
+	int    sizes[] = { 0, 1, 10, 63, 64, 1000, 20000 };
+	int    i;
+
+	rand = g_rand_new_with_seed (42);
+	for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+		GthSortKey *keys;
+
+		/* many equal numbers */
+
+		keys = create_keys (sizes[i], 10, rand);
+		assert_sorted_as_reference (keys, sizes[i], 0, FALSE);
+		g_free (keys);
+
+		keys = create_keys (sizes[i], 10, rand);
+		assert_sorted_as_reference (keys, sizes[i], 0, TRUE);
+		g_free (keys);
+
+		/* large numbers */
+
+		keys = create_keys (sizes[i], G_MAXINT32 - 1, rand);
+		assert_sorted_as_reference (keys, sizes[i], 0, FALSE);
+		g_free (keys);
+
+		keys = create_keys (sizes[i], G_MAXINT32 - 1, rand);
+		assert_sorted_as_reference (keys, sizes[i], 0, TRUE);
+		g_free (keys);
+	}
+	g_rand_free (rand);
+}
+
+
+static void
+test_sort_key_merge (void)
+{
+	GRand      *rand;
+	GthSortKey *keys;
+	int         n_keys;
+	int         n_sorted;
+	int         i;
+
+	rand = g_rand_new_with_seed (7);
+	n_keys = 5000;
+	n_sorted = 4000;
+
+	/* the old keys come first when equal */
+
+	keys = create_keys (n_keys, 100, rand);
+	g_qsort_with_data (keys, n_sorted, sizeof (GthSortKey), compare_keys_func, GINT_TO_POINTER (FALSE));
+	assert_sorted_as_reference (keys, n_keys, n_sorted, FALSE);
+	g_free (keys);
+
+	keys = create_keys (n_keys, 100, rand);
+	g_qsort_with_data (keys, n_sorted, sizeof (GthSortKey), compare_keys_func, GINT_TO_POINTER (TRUE));
+	assert_sorted_as_reference (keys, n_keys, n_sorted, TRUE);
+	g_free (keys);
+
+	/* the first keys are not sorted, all the keys are sorted */
+
+	keys = create_keys (n_keys, 100, rand);
+	for (i = 0; i < n_sorted; i++)
+		keys[i].number = n_sorted - i;
+	assert_sorted_as_reference (keys, n_keys, n_sorted, FALSE);
+	g_free (keys);
+
+	g_rand_free (rand);
+}
+
+
+static void
+test_sort_key_double (void)
+{
+	double values[] = { -G_MAXDOUBLE, -1e10, -2.5, -1.0, -1e-10, 0.0, 1e-10, 0.5, 1.0, 4.0 / 3.0, 1e10, G_MAXDOUBLE };
+	int    i;
+
+	for (i = 0; i < G_N_ELEMENTS (values) - 1; i++)
+		g_assert_cmpint (gth_sort_key_number_from_double (values[i]), <, gth_sort_key_number_from_double (values[i + 1]));
+}
+
+
+/* The files of a folder come before the ones of its sub-folders, even if
+ * the uris of the files interleave. */
+static void
+test_sort_key_path (void)
+{
+	const char *uris[] = {
+		"file:///home/user/b/c.jpeg",
+		"file:///home/user/z.jpeg",
+		"file:///home/user/b.jpeg",
+		"file:///home/user/b-c/a.jpeg",
+		"file:///home/user/a.jpeg",
+		"file:///home/user/b/a.jpeg",
+		"file:///home/user/b/c/a.jpeg",
+		"file:///home/user-b/a.jpeg",
+	};
+	const char *sorted[] = {
+		"file:///home/user/a.jpeg",
+		"file:///home/user/b.jpeg",
+		"file:///home/user/z.jpeg",
+		"file:///home/user-b/a.jpeg",
+		"file:///home/user/b/a.jpeg",
+		"file:///home/user/b/c.jpeg",
+		"file:///home/user/b-c/a.jpeg",
+		"file:///home/user/b/c/a.jpeg",
+	};
+	GthSortKey *keys;
+	int         n_keys;
+	int         i;
+
+	n_keys = G_N_ELEMENTS (uris);
+	keys = g_new0 (GthSortKey, n_keys);
+	for (i = 0; i < n_keys; i++) {
+		gth_sort_key_set_path (&keys[i], g_strdup (uris[i]), strrchr (uris[i], '/') + 1);
+		keys[i].item = (gpointer) uris[i];
+	}
+
+	assert_sorted_as_reference (keys, n_keys, 0, FALSE);
+	for (i = 0; i < n_keys; i++)
+		g_assert_cmpstr (keys[i].item, ==, sorted[i]);
+
+	gth_sort_keys_free (keys, n_keys);
+}
+
+
+/* Compares the keys of a list of files sorted by date and name, the names
+ * are collation keys as the file name sort keys. */
+static void
+test_sort_key_benchmark (void)
+{
+	int          n_keys;
+	GRand       *rand;
+	char       **collate_keys;
+	GthSortKey  *keys;
+	GthSortKey  *reference;
+	GTimer      *timer;
+	double       qsort_time;
+	double       keys_time;
+	int          i;
+
+	n_keys = g_test_perf () ? 1000000 : 100000;
+	rand = g_rand_new_with_seed (1);
+	collate_keys = g_new (char *, n_keys);
+	keys = g_new0 (GthSortKey, n_keys);
+	for (i = 0; i < n_keys; i++) {
+		char *name;
+
+		name = g_strdup_printf ("IMG_%05d.jpeg", g_rand_int_range (rand, 0, 100000));
+		collate_keys[i] = g_utf8_collate_key_for_filename (name, -1);
+		keys[i].number = (gint64) 1500000000 * G_USEC_PER_SEC + (gint64) g_rand_int_range (rand, 0, 3600 * 24 * 365) * G_USEC_PER_SEC;
+		keys[i].name = collate_keys[i];
+		keys[i].item = GINT_TO_POINTER (i);
+
+		g_free (name);
+	}
+	reference = g_new (GthSortKey, n_keys);
+	memcpy (reference, keys, sizeof (GthSortKey) * n_keys);
+	timer = g_timer_new ();
+
+	g_timer_start (timer);
+	g_qsort_with_data (reference, n_keys, sizeof (GthSortKey), compare_keys_func, GINT_TO_POINTER (FALSE));
+	qsort_time = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	gth_sort_keys_sort (keys, n_keys, 0, FALSE);
+	keys_time = g_timer_elapsed (timer, NULL);
+
+	for (i = 0; i < n_keys; i++)
+		g_assert_true (keys[i].item == reference[i].item);
+
+	g_test_message ("%d keys: comparison sort %.3fs, radix sort %.3fs",
+			n_keys,
+			qsort_time,
+			keys_time);
+	if (g_test_perf ())
+		g_test_minimized_result (keys_time, "sorting %d keys", n_keys);
+
+	g_timer_destroy (timer);
+	g_free (reference);
+	g_free (keys);
+	for (i = 0; i < n_keys; i++)
+		g_free (collate_keys[i]);
+	g_free (collate_keys);
+	g_rand_free (rand);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/sort-key/order", test_sort_key_order);
+	g_test_add_func ("/sort-key/merge", test_sort_key_merge);
+	g_test_add_func ("/sort-key/double", test_sort_key_double);
+	g_test_add_func ("/sort-key/path", test_sort_key_path);
+	g_test_add_func ("/sort-key/benchmark", test_sort_key_benchmark);
+
+	return g_test_run ();
+}
@@ -0,0 +1,422 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2006-2009 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "gth-surface-history.h"
+
+
+#define IMAGE_WIDTH  320
+#define IMAGE_HEIGHT 240
+
+
+typedef struct {
+	int      index;
+	gboolean unsaved;
+} TestStep;
+
+
+static TestStep *
+test_step_new (int      index,
+	       gboolean unsaved)
+{
+	TestStep *step;
+
+	step = g_new (TestStep, 1);
+	step->index = index;
+	step->unsaved = unsaved;
+
+	return step;
+}
+
+
+static cairo_surface_t *
+create_random_image (int    width,
+		     int    height,
+		     GRand *rand)
+{
+	cairo_surface_t *surface;
+	guchar          *data;
+	gsize            size;
+	gsize            i;
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	data = cairo_image_surface_get_data (surface);
+	size = (gsize) cairo_image_surface_get_stride (surface) * height;
+	for (i = 0; i < size; i++)
+		data[i] = g_rand_int_range (rand, 0, 256);
+	cairo_surface_mark_dirty (surface);
+
+	return surface;
+}
+
+
+/* Returns a copy of @surface with a few random rectangles changed, most of
+ * the tiles stay the same. */
+static cairo_surface_t *
+edit_image (cairo_surface_t *surface,
+	    GRand           *rand)
+{
+	cairo_surface_t *edited;
+	int              width;
+	int              height;
+	int              stride;
+	guchar          *data;
+	int              n;
+
+	width = cairo_image_surface_get_width (surface);
+	height = cairo_image_surface_get_height (surface);
+	edited = cairo_image_surface_create (cairo_image_surface_get_format (surface), width, height);
+	stride = cairo_image_surface_get_stride (edited);
+	data = cairo_image_surface_get_data (edited);
+	cairo_surface_flush (surface);
+	memcpy (data, cairo_image_surface_get_data (surface), (gsize) stride * height);
+
+	for (n = 0; n < 3; n++) {
+		int x1, y1, x2, y2;
+		int x, y;
+
+		x1 = g_rand_int_range (rand, 0, width);
+		y1 = g_rand_int_range (rand, 0, height);
+		x2 = x1 + g_rand_int_range (rand, 1, 40);
+		y2 = y1 + g_rand_int_range (rand, 1, 40);
+		x2 = MIN (x2, width);
+		y2 = MIN (y2, height);
+		for (y = y1; y < y2; y++)
+			for (x = x1 * 4; x < x2 * 4; x++)
+				data[(gsize) y * stride + x] = g_rand_int_range (rand, 0, 256);
+	}
+	cairo_surface_mark_dirty (edited);
+
+	return edited;
+}
+
+
+static void
+assert_same_image (cairo_surface_t *surface,
+		   cairo_surface_t *expected)
+{
+	int y;
+
+	g_assert_nonnull (surface);
+	g_assert_cmpint (cairo_image_surface_get_format (surface), ==, cairo_image_surface_get_format (expected));
+	g_assert_cmpint (cairo_image_surface_get_width (surface), ==, cairo_image_surface_get_width (expected));
+	g_assert_cmpint (cairo_image_surface_get_height (surface), ==, cairo_image_surface_get_height (expected));
+
+	cairo_surface_flush (surface);
+	cairo_surface_flush (expected);
+	for (y = 0; y < cairo_image_surface_get_height (expected); y++)
+		g_assert_cmpmem (cairo_image_surface_get_data (surface) + ((gsize) y * cairo_image_surface_get_stride (surface)),
+				 cairo_image_surface_get_width (expected) * 4,
+				 cairo_image_surface_get_data (expected) + ((gsize) y * cairo_image_surface_get_stride (expected)),
+				 cairo_image_surface_get_width (expected) * 4);
+}
+
+
+/* Adds the image @index of @images, a few edits, a size change, an image
+ * where everything changed, and an image that is not saved as tiles. */
+static void
+add_test_image (GthSurfaceHistory *history,
+		GPtrArray         *images,
+		GRand             *rand,
+		gboolean           unsaved)
+{
+	cairo_surface_t *image;
+	int              index;
+
+	index = images->len;
+	if (index == 0)
+		image = create_random_image (IMAGE_WIDTH, IMAGE_HEIGHT, rand);
+	else if (index % 23 == 0)
+		image = create_random_image (IMAGE_WIDTH - (index % 7) * 10, IMAGE_HEIGHT, rand);
+	else if (index % 11 == 0)
+		image = create_random_image (cairo_image_surface_get_width (g_ptr_array_index (images, index - 1)),
+					     cairo_image_surface_get_height (g_ptr_array_index (images, index - 1)),
+					     rand);
+	else
+		image = edit_image (g_ptr_array_index (images, index - 1), rand);
+	g_ptr_array_add (images, image);
+
+	if (index % 29 == 28) /* kept as it is, like an animation */
+		gth_surface_history_add (history, NULL, test_step_new (index, unsaved), 1024);
+	else
+		gth_surface_history_add (history, image, test_step_new (index, unsaved), 0);
+}
+
+
+static void
+assert_step (TestStep        *step,
+	     cairo_surface_t *surface,
+	     GPtrArray       *images,
+	     int              index)
+{
+	g_assert_nonnull (step);
+	g_assert_cmpint (step->index, ==, index);
+	if (index % 29 == 28)
+		g_assert_null (surface);
+	else
+		assert_same_image (surface, g_ptr_array_index (images, index));
+}
+
+
+static void
+assert_directory_is_empty (const char *path)
+{
+	GDir *dir;
+
+	/* the file of the history is deleted as soon as it is created */
+
+	dir = g_dir_open (path, 0, NULL);
+	g_assert_nonnull (dir);
+	g_assert_null (g_dir_read_name (dir));
+	g_dir_close (dir);
+}
+
+
+static void
+test_surface_history_spill (void)
+{
+	char              *path;
+	GFile             *directory;
+	GthSurfaceHistory *history;
+	GPtrArray         *images;
+	GRand             *rand;
+	gsize              memory_size;
+	gsize              file_size;
+	goffset            file_end;
+	int                n_images = 60;
+	int                last;
+	int                n_undo;
+	int                n;
+
+	path = g_dir_make_tmp ("pix-surface-history-XXXXXX", NULL);
+	g_assert_nonnull (path);
+	directory = g_file_new_for_path (path);
+
+	/* a memory budget smaller than a single image */
+
+	history = gth_surface_history_new (64 * 1024, 64 * 1024 * 1024, directory, g_free);
+	images = g_ptr_array_new_with_free_func ((GDestroyNotify) cairo_surface_destroy);
+	rand = g_rand_new_with_seed (25);
+
+	for (n = 0; n < n_images; n++)
+		add_test_image (history, images, rand, (n != 5));
+
+	gth_surface_history_get_stats (history, &memory_size, &file_size, &file_end);
+	g_assert_cmpuint (memory_size, <=, 64 * 1024);
+	g_assert_cmpuint (file_size, >, 0);
+	g_assert_cmpint (file_end, >=, file_size);
+	assert_directory_is_empty (path);
+
+	/* every step, decoded from the closest keyframe */
+
+	last = n_images - 1;
+	n_undo = gth_surface_history_get_n_undo (history);
+	g_assert_cmpint (n_undo, ==, last);
+	for (n = 0; n < n_undo; n++) {
+		cairo_surface_t *surface = NULL;
+		TestStep        *step;
+
+		step = gth_surface_history_get_undo (history, n, &surface);
+		assert_step (step, surface, images, last - 1 - n);
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+	}
+
+	/* undo everything, redo everything, following the delta chain in
+	 * both directions */
+
+	for (n = last - 1; n >= 0; n--) {
+		cairo_surface_t *surface = NULL;
+		TestStep        *step;
+
+		step = gth_surface_history_undo (history, &surface);
+		assert_step (step, surface, images, n);
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+	}
+	g_assert_false (gth_surface_history_can_undo (history));
+
+	for (n = 1; n <= last; n++) {
+		cairo_surface_t *surface = NULL;
+		TestStep        *step;
+
+		step = gth_surface_history_redo (history, &surface);
+		assert_step (step, surface, images, n);
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+	}
+	g_assert_false (gth_surface_history_can_redo (history));
+
+	/* undo some steps and add a new image, the redo steps are removed */
+
+	for (n = 0; n < 10; n++) {
+		cairo_surface_t *surface = NULL;
+
+		g_assert_nonnull (gth_surface_history_undo (history, &surface));
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+	}
+	g_ptr_array_set_size (images, n_images - 10);
+	add_test_image (history, images, rand, TRUE);
+	g_assert_false (gth_surface_history_can_redo (history));
+
+	/* revert: restore the oldest saved step */
+
+	n_undo = gth_surface_history_get_n_undo (history);
+	for (n = n_undo - 1; n >= 0; n--) {
+		TestStep *step = gth_surface_history_get_undo (history, n, NULL);
+
+		if (! step->unsaved) {
+			cairo_surface_t *surface = NULL;
+
+			step = gth_surface_history_get_undo (history, n, &surface);
+			assert_step (step, surface, images, 5);
+			if (surface != NULL)
+				cairo_surface_destroy (surface);
+			break;
+		}
+	}
+	g_assert_cmpint (n, >=, 0);
+
+	gth_surface_history_clear (history);
+	gth_surface_history_get_stats (history, &memory_size, &file_size, &file_end);
+	g_assert_cmpuint (memory_size, ==, 0);
+	g_assert_cmpuint (file_size, ==, 0);
+	g_assert_cmpint (file_end, ==, 0);
+
+	g_rand_free (rand);
+	g_ptr_array_unref (images);
+	gth_surface_history_free (history);
+	g_object_unref (directory);
+	g_rmdir (path);
+	g_free (path);
+}
+
+
+static void
+test_surface_history_file_limit (void)
+{
+	const gsize        max_memory_size = 4 * 1024;
+	const gsize        max_file_size = 1024 * 1024;
+	char              *path;
+	GFile             *directory;
+	GthSurfaceHistory *history;
+	GPtrArray         *images;
+	GRand             *rand;
+	gsize              memory_size;
+	gsize              file_size;
+	goffset            file_end;
+	int                current;
+	int                n;
+
+	path = g_dir_make_tmp ("pix-surface-history-XXXXXX", NULL);
+	g_assert_nonnull (path);
+	directory = g_file_new_for_path (path);
+
+	/* almost everything goes to the file, which can keep only a few
+	 * keyframes */
+
+	history = gth_surface_history_new (max_memory_size, max_file_size, directory, g_free);
+	images = g_ptr_array_new_with_free_func ((GDestroyNotify) cairo_surface_destroy);
+	rand = g_rand_new_with_seed (1024);
+
+	current = -1;
+	for (n = 0; n < 400; n++) {
+		cairo_surface_t *surface = NULL;
+		TestStep        *step = NULL;
+
+		switch (g_rand_int_range (rand, 0, 4)) {
+		case 0:
+			if (gth_surface_history_can_undo (history)) {
+				step = gth_surface_history_undo (history, &surface);
+				g_assert_nonnull (step);
+			}
+			break;
+		case 1:
+			if (gth_surface_history_can_redo (history)) {
+				step = gth_surface_history_redo (history, &surface);
+				g_assert_nonnull (step);
+			}
+			break;
+		default:
+			if (current >= 0)
+				g_ptr_array_set_size (images, current + 1);
+			add_test_image (history, images, rand, TRUE);
+			current = images->len - 1;
+			break;
+		}
+
+		if (step != NULL) {
+			assert_step (step, surface, images, step->index);
+			current = step->index;
+		}
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+
+		/* the space of the removed steps is used again */
+
+		gth_surface_history_get_stats (history, &memory_size, &file_size, &file_end);
+		g_assert_cmpuint (memory_size, <=, max_memory_size);
+		g_assert_cmpint (file_end, <=, max_file_size);
+		g_assert_cmpint (file_size, <=, file_end);
+	}
+
+	/* the steps that are left are still right */
+
+	n = 0;
+	while (gth_surface_history_can_undo (history)) {
+		cairo_surface_t *surface = NULL;
+		TestStep        *step;
+
+		step = gth_surface_history_undo (history, &surface);
+		g_assert_nonnull (step);
+		g_assert_cmpint (step->index, <, current);
+		assert_step (step, surface, images, step->index);
+		current = step->index;
+		if (surface != NULL)
+			cairo_surface_destroy (surface);
+		n++;
+	}
+	g_assert_cmpint (n, >, 0);
+
+	g_rand_free (rand);
+	g_ptr_array_unref (images);
+	gth_surface_history_free (history);
+	assert_directory_is_empty (path);
+	g_object_unref (directory);
+	g_rmdir (path);
+	g_free (path);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/surface-history/spill", test_surface_history_spill);
+	g_test_add_func ("/surface-history/file-limit", test_surface_history_file_limit);
+
+	return g_test_run ();
+}
@@ -0,0 +1,740 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  Pix
+ *
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <png.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include "gth-thumbnail-pack.h"
+
+
+#define THUMBNAIL_SIZE 128
+
+
+/* The files of a folder, the packs and a freedesktop thumbnail cache, all
+ * in a temporary folder. */
+typedef struct {
+	char       *path;
+	GFile      *pack_directory;
+	char       *thumbnails;
+	int         n_files;
+	GFile     **files;
+	GFileInfo **infos;
+} TestFolder;
+
+
+static GFileInfo *
+query_file_info (GFile *file)
+{
+	GFileInfo *info;
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL,
+				  NULL);
+	g_assert_nonnull (info);
+
+	return info;
+}
+
+
+static TestFolder *
+test_folder_new (int n_files)
+{
+	TestFolder *folder;
+	char       *images;
+	char       *packs;
+	int         i;
+
+	folder = g_new0 (TestFolder, 1);
+	folder->path = g_dir_make_tmp ("pix-thumbnail-pack-XXXXXX", NULL);
+	g_assert_nonnull (folder->path);
+
+	images = g_build_filename (folder->path, "images", NULL);
+	packs = g_build_filename (folder->path, "packs", NULL);
+	folder->thumbnails = g_build_filename (folder->path, "thumbnails", "normal", NULL);
+	g_assert_cmpint (g_mkdir (images, 0700), ==, 0);
+	g_assert_cmpint (g_mkdir (packs, 0700), ==, 0);
+	g_assert_cmpint (g_mkdir_with_parents (folder->thumbnails, 0700), ==, 0);
+	folder->pack_directory = g_file_new_for_path (packs);
+
+	folder->n_files = n_files;
+	folder->files = g_new (GFile *, n_files);
+	folder->infos = g_new (GFileInfo *, n_files);
+	for (i = 0; i < n_files; i++) {
+		char *name;
+		char *filename;
+
+		name = g_strdup_printf ("image-%05d.jpeg", i);
+		filename = g_build_filename (images, name, NULL);
+		g_assert_true (g_file_set_contents (filename, name, -1, NULL));
+		folder->files[i] = g_file_new_for_path (filename);
+		folder->infos[i] = query_file_info (folder->files[i]);
+
+		g_free (filename);
+		g_free (name);
+	}
+
+	g_free (packs);
+	g_free (images);
+
+	return folder;
+}
+
+
+static void
+remove_directory (const char *path)
+{
+	GDir       *dir;
+	const char *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	g_assert_nonnull (dir);
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		char *filename;
+
+		filename = g_build_filename (path, name, NULL);
+		if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+			remove_directory (filename);
+		else
+			g_unlink (filename);
+		g_free (filename);
+	}
+	g_dir_close (dir);
+	g_rmdir (path);
+}
+
+
+static void
+test_folder_free (TestFolder *folder)
+{
+	int i;
+
+	for (i = 0; i < folder->n_files; i++) {
+		g_object_unref (folder->infos[i]);
+		g_object_unref (folder->files[i]);
+	}
+	g_free (folder->infos);
+	g_free (folder->files);
+	g_object_unref (folder->pack_directory);
+	remove_directory (folder->path);
+	g_free (folder->thumbnails);
+	g_free (folder->path);
+	g_free (folder);
+}
+
+
+/* Removes the data of the files in @path from the page cache, so that the
+ * next read comes from the disk. */
+static void
+drop_cached_data (const char *path)
+{
+	GDir       *dir;
+	const char *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	g_assert_nonnull (dir);
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		char *filename;
+		int   fd;
+
+		filename = g_build_filename (path, name, NULL);
+		if (g_file_test (filename, G_FILE_TEST_IS_DIR)) {
+			drop_cached_data (filename);
+		}
+		else if ((fd = g_open (filename, O_RDONLY, 0)) >= 0) {
+			fsync (fd);
+			posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+			close (fd);
+		}
+		g_free (filename);
+	}
+	g_dir_close (dir);
+}
+
+
+/* -- freedesktop thumbnails -- */
+
+
+/* The path of the thumbnail of @file in the freedesktop cache, as
+ * gnome_desktop_thumbnail_factory_lookup builds it. */
+static char *
+get_freedesktop_thumbnail_path (TestFolder *folder,
+				GFile      *file)
+{
+	char *uri;
+	char *md5;
+	char *name;
+	char *path;
+
+	uri = g_file_get_uri (file);
+	md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+	name = g_strconcat (md5, ".png", NULL);
+	path = g_build_filename (folder->thumbnails, name, NULL);
+
+	g_free (name);
+	g_free (md5);
+	g_free (uri);
+
+	return path;
+}
+
+
+/* Saves the thumbnail as gnome_desktop_thumbnail_factory_save_thumbnail
+ * does. */
+static void
+save_freedesktop_thumbnail (TestFolder      *folder,
+			    int              n,
+			    cairo_surface_t *image)
+{
+	GdkPixbuf *pixbuf;
+	char      *uri;
+	char      *mtime;
+	char      *path;
+
+	pixbuf = gdk_pixbuf_get_from_surface (image,
+					      0,
+					      0,
+					      cairo_image_surface_get_width (image),
+					      cairo_image_surface_get_height (image));
+	uri = g_file_get_uri (folder->files[n]);
+	mtime = g_strdup_printf ("%" G_GUINT64_FORMAT, g_file_info_get_attribute_uint64 (folder->infos[n], G_FILE_ATTRIBUTE_TIME_MODIFIED));
+	path = get_freedesktop_thumbnail_path (folder, folder->files[n]);
+	g_assert_true (gdk_pixbuf_save (pixbuf,
+					path,
+					"png", NULL,
+					"tEXt::Thumb::URI", uri,
+					"tEXt::Thumb::MTime", mtime,
+					"tEXt::Software", "GNOME::ThumbnailFactory",
+					NULL));
+
+	g_free (path);
+	g_free (mtime);
+	g_free (uri);
+	g_object_unref (pixbuf);
+}
+
+
+/* Reads the text chunks of the png to check the uri and the modification
+ * time, as gnome_desktop_thumbnail_is_valid does. */
+static gboolean
+freedesktop_thumbnail_is_valid (const char *path,
+				const char *uri,
+				time_t      mtime)
+{
+	FILE        *f;
+	png_structp  png_ptr;
+	png_infop    info_ptr;
+	png_textp    text_ptr;
+	int          num_texts;
+	gboolean     valid_uri;
+	gboolean     valid_mtime;
+
+	f = g_fopen (path, "rb");
+	if (f == NULL)
+		return FALSE;
+
+	png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	info_ptr = png_create_info_struct (png_ptr);
+	if (setjmp (png_jmpbuf (png_ptr))) {
+		png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+		fclose (f);
+		return FALSE;
+	}
+
+	valid_uri = FALSE;
+	valid_mtime = FALSE;
+	png_init_io (png_ptr, f);
+	png_read_info (png_ptr, info_ptr);
+	if (png_get_text (png_ptr, info_ptr, &text_ptr, &num_texts)) {
+		int i;
+
+		for (i = 0; i < num_texts; i++) {
+			if (strcmp (text_ptr[i].key, "Thumb::URI") == 0)
+				valid_uri = (strcmp (text_ptr[i].text, uri) == 0);
+			else if (strcmp (text_ptr[i].key, "Thumb::MTime") == 0)
+				valid_mtime = (mtime == atol (text_ptr[i].text));
+		}
+	}
+
+	png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+	fclose (f);
+
+	return valid_uri && valid_mtime;
+}
+
+
+/* Loads the png as an ARGB32 surface, with the transformations of the png
+ * loader. */
+static cairo_surface_t *
+load_png (const char *path)
+{
+	FILE             *f;
+	png_structp       png_ptr;
+	png_infop         info_ptr;
+	png_uint_32       width, height;
+	png_uint_32       x, y;
+	int               bit_depth, color_type, interlace_type;
+	cairo_surface_t  *image;
+	guchar           *data;
+	int               stride;
+	png_bytep        *row_pointers;
+
+	f = g_fopen (path, "rb");
+	g_assert_nonnull (f);
+	png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	info_ptr = png_create_info_struct (png_ptr);
+	if (setjmp (png_jmpbuf (png_ptr)))
+		g_assert_not_reached ();
+
+	png_init_io (png_ptr, f);
+	png_read_info (png_ptr, info_ptr);
+	png_get_IHDR (png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, &interlace_type, NULL, NULL);
+	png_set_strip_16 (png_ptr);
+	png_set_packing (png_ptr);
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb (png_ptr);
+	if ((color_type == PNG_COLOR_TYPE_GRAY) && (bit_depth < 8))
+		png_set_expand_gray_1_2_4_to_8 (png_ptr);
+	if (png_get_valid (png_ptr, info_ptr, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha (png_ptr);
+	png_set_filler (png_ptr, 0xff, PNG_FILLER_AFTER);
+	if ((color_type == PNG_COLOR_TYPE_GRAY) || (color_type == PNG_COLOR_TYPE_GRAY_ALPHA))
+		png_set_gray_to_rgb (png_ptr);
+	if (interlace_type != PNG_INTERLACE_NONE)
+		png_set_interlace_handling (png_ptr);
+	png_read_update_info (png_ptr, info_ptr);
+
+	image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	data = cairo_image_surface_get_data (image);
+	stride = cairo_image_surface_get_stride (image);
+	row_pointers = g_new (png_bytep, height);
+	for (y = 0; y < height; y++)
+		row_pointers[y] = data + (y * stride);
+	png_read_image (png_ptr, row_pointers);
+	png_read_end (png_ptr, NULL);
+
+	/* RGBA to premultiplied ARGB */
+
+	for (y = 0; y < height; y++) {
+		guchar  *p = row_pointers[y];
+		guint32 *pixel = (guint32 *) row_pointers[y];
+
+		for (x = 0; x < width; x++) {
+			guint32 a = p[3];
+			guint32 r = (p[0] * a + 127) / 255;
+			guint32 g = (p[1] * a + 127) / 255;
+			guint32 b = (p[2] * a + 127) / 255;
+
+			*pixel++ = (a << 24) | (r << 16) | (g << 8) | b;
+			p += 4;
+		}
+	}
+	cairo_surface_mark_dirty (image);
+
+	g_free (row_pointers);
+	png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+	fclose (f);
+
+	return image;
+}
+
+
+/* Returns the thumbnail of @file from the freedesktop cache, or NULL if
+ * it's missing or the file changed, as gth_thumb_loader does with
+ * gnome_desktop_thumbnail_factory_lookup and load_cached_thumbnail. */
+static cairo_surface_t *
+load_freedesktop_thumbnail (TestFolder *folder,
+			    GFile      *file,
+			    GFileInfo  *info)
+{
+	cairo_surface_t *image = NULL;
+	char            *uri;
+	char            *path;
+
+	uri = g_file_get_uri (file);
+	path = get_freedesktop_thumbnail_path (folder, file);
+	if (freedesktop_thumbnail_is_valid (path, uri, (time_t) g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)))
+		image = load_png (path);
+
+	g_free (path);
+	g_free (uri);
+
+	return image;
+}
+
+
+/* A thumbnail with a gradient and some noise, to compress about as a
+ * photo would. */
+static cairo_surface_t *
+create_thumbnail (int n)
+{
+	cairo_surface_t *image;
+	guchar          *data;
+	int              stride;
+	GRand           *rand;
+	int              x, y;
+
+	image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, THUMBNAIL_SIZE, THUMBNAIL_SIZE * 3 / 4);
+	data = cairo_image_surface_get_data (image);
+	stride = cairo_image_surface_get_stride (image);
+	rand = g_rand_new_with_seed (n);
+	for (y = 0; y < cairo_image_surface_get_height (image); y++) {
+		guint32 *row = (guint32 *) (data + (y * stride));
+
+		for (x = 0; x < cairo_image_surface_get_width (image); x++) {
+			guint32 r = (x * 2 + n) & 0xff;
+			guint32 g = (y * 2) & 0xff;
+			guint32 b = g_rand_int_range (rand, 0, 32);
+
+			row[x] = 0xff000000 | (r << 16) | (g << 8) | b;
+		}
+	}
+	cairo_surface_mark_dirty (image);
+	g_rand_free (rand);
+
+	return image;
+}
+
+
+static void
+assert_equal_images (cairo_surface_t *image1,
+		     cairo_surface_t *image2)
+{
+	int y;
+
+	g_assert_cmpint (cairo_image_surface_get_width (image1), ==, cairo_image_surface_get_width (image2));
+	g_assert_cmpint (cairo_image_surface_get_height (image1), ==, cairo_image_surface_get_height (image2));
+	for (y = 0; y < cairo_image_surface_get_height (image1); y++)
+		g_assert_cmpmem (cairo_image_surface_get_data (image1) + (y * cairo_image_surface_get_stride (image1)),
+				 cairo_image_surface_get_width (image1) * 4,
+				 cairo_image_surface_get_data (image2) + (y * cairo_image_surface_get_stride (image2)),
+				 cairo_image_surface_get_width (image2) * 4);
+}
+
+
+static void
+test_thumbnail_pack_round_trip (void)
+{
+	TestFolder       *folder;
+	GthThumbnailPack *pack;
+	GFile            *file;
+	GFileInfo        *info;
+	cairo_surface_t  *thumbnail;
+	cairo_surface_t  *image;
+	int               original_width;
+	int               original_height;
+
+	folder = test_folder_new (1);
+	file = folder->files[0];
+	info = folder->infos[0];
+	thumbnail = create_thumbnail (1);
+
+	pack = gth_thumbnail_pack_new (folder->pack_directory);
+	g_assert_null (gth_thumbnail_pack_lookup (pack, file, info, THUMBNAIL_SIZE, NULL, NULL));
+	gth_thumbnail_pack_store (pack, file, info, THUMBNAIL_SIZE, thumbnail, 4000, 3000);
+	gth_thumbnail_pack_free (pack);
+
+	/* read the data saved on disk */
+
+	pack = gth_thumbnail_pack_new (folder->pack_directory);
+	image = gth_thumbnail_pack_lookup (pack, file, info, THUMBNAIL_SIZE, &original_width, &original_height);
+	g_assert_nonnull (image);
+	assert_equal_images (image, thumbnail);
+	g_assert_cmpint (original_width, ==, 4000);
+	g_assert_cmpint (original_height, ==, 3000);
+	cairo_surface_destroy (image);
+
+	/* each thumbnail size has its own pack */
+
+	g_assert_null (gth_thumbnail_pack_lookup (pack, file, info, THUMBNAIL_SIZE * 2, NULL, NULL));
+
+	/* the thumbnail is not valid if the file changed */
+
+	info = g_file_info_dup (folder->infos[0]);
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) + 1);
+	g_assert_null (gth_thumbnail_pack_lookup (pack, file, info, THUMBNAIL_SIZE, NULL, NULL));
+	g_object_unref (info);
+
+	info = g_file_info_dup (folder->infos[0]);
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE, g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE) + 1);
+	g_assert_null (gth_thumbnail_pack_lookup (pack, file, info, THUMBNAIL_SIZE, NULL, NULL));
+	g_object_unref (info);
+
+	/* invalidation, saved on disk as well */
+
+	info = folder->infos[0];
+	gth_thumbnail_pack_invalidate (pack, file);
+	g_assert_null (gth_thumbnail_pack_lookup (pack, file, info, THUMBNAIL_SIZE, NULL, NULL));
+	gth_thumbnail_pack_free (pack);
+
+	pack = gth_thumbnail_pack_new (folder->pack_directory);
+	g_assert_null (gth_thumbnail_pack_lookup (pack, file, info, THUMBNAIL_SIZE, NULL, NULL));
+	gth_thumbnail_pack_free (pack);
+
+	cairo_surface_destroy (thumbnail);
+	test_folder_free (folder);
+}
+
+
+/* Returns the filename of the only pack of the folder. */
+static char *
+get_pack_filename (TestFolder *folder)
+{
+	char       *path;
+	GDir       *dir;
+	const char *name;
+	char       *filename;
+
+	path = g_file_get_path (folder->pack_directory);
+	dir = g_dir_open (path, 0, NULL);
+	g_assert_nonnull (dir);
+	name = g_dir_read_name (dir);
+	g_assert_nonnull (name);
+	filename = g_build_filename (path, name, NULL);
+	g_assert_null (g_dir_read_name (dir));
+	g_dir_close (dir);
+	g_free (path);
+
+	return filename;
+}
+
+
+/* Two packs on the same directory, as two processes do. */
+static void
+test_thumbnail_pack_shared (void)
+{
+	TestFolder       *folder;
+	GthThumbnailPack *pack1;
+	GthThumbnailPack *pack2;
+	GthThumbnailPack *pack3;
+	cairo_surface_t  *thumbnails[3];
+	cairo_surface_t  *image;
+	char             *filename;
+	int               fd;
+	int               i;
+
+	folder = test_folder_new (3);
+	for (i = 0; i < 3; i++)
+		thumbnails[i] = create_thumbnail (i);
+
+	/* the records appended by the other pack are not overwritten */
+
+	pack1 = gth_thumbnail_pack_new (folder->pack_directory);
+	pack2 = gth_thumbnail_pack_new (folder->pack_directory);
+	gth_thumbnail_pack_store (pack1, folder->files[0], folder->infos[0], THUMBNAIL_SIZE, thumbnails[0], 4000, 3000);
+	gth_thumbnail_pack_store (pack2, folder->files[1], folder->infos[1], THUMBNAIL_SIZE, thumbnails[1], 4000, 3000);
+
+	image = gth_thumbnail_pack_lookup (pack1, folder->files[0], folder->infos[0], THUMBNAIL_SIZE, NULL, NULL);
+	g_assert_nonnull (image);
+	assert_equal_images (image, thumbnails[0]);
+	cairo_surface_destroy (image);
+
+	/* a partially written record is not truncated, the pack is
+	 * replaced by the next writer. */
+
+	filename = get_pack_filename (folder);
+	fd = g_open (filename, O_WRONLY | O_APPEND, 0);
+	g_assert_cmpint (fd, >=, 0);
+	g_assert_cmpint (write (fd, "partial", 7), ==, 7);
+	close (fd);
+
+	gth_thumbnail_pack_store (pack1, folder->files[2], folder->infos[2], THUMBNAIL_SIZE, thumbnails[2], 4000, 3000);
+
+	/* the second pack reads the records again from the new file */
+
+	image = gth_thumbnail_pack_lookup (pack2, folder->files[1], folder->infos[1], THUMBNAIL_SIZE, NULL, NULL);
+	g_assert_nonnull (image);
+	assert_equal_images (image, thumbnails[1]);
+	cairo_surface_destroy (image);
+
+	gth_thumbnail_pack_free (pack2);
+	gth_thumbnail_pack_free (pack1);
+
+	pack3 = gth_thumbnail_pack_new (folder->pack_directory);
+	for (i = 0; i < 3; i++) {
+		image = gth_thumbnail_pack_lookup (pack3, folder->files[i], folder->infos[i], THUMBNAIL_SIZE, NULL, NULL);
+		g_assert_nonnull (image);
+		assert_equal_images (image, thumbnails[i]);
+		cairo_surface_destroy (image);
+	}
+	gth_thumbnail_pack_free (pack3);
+
+	g_free (filename);
+	for (i = 0; i < 3; i++)
+		cairo_surface_destroy (thumbnails[i]);
+	test_folder_free (folder);
+}
+
+
+/* Reads the thumbnails of the folder from the pack, returns the time it
+ * took. */
+static double
+read_pack (TestFolder        *folder,
+	   GthThumbnailPack **pack,
+	   cairo_surface_t  **thumbnails,
+	   GTimer            *timer)
+{
+	int i;
+
+	g_timer_start (timer);
+	if (*pack == NULL)
+		*pack = gth_thumbnail_pack_new (folder->pack_directory);
+	for (i = 0; i < folder->n_files; i++) {
+		cairo_surface_t *image;
+
+		image = gth_thumbnail_pack_lookup (*pack, folder->files[i], folder->infos[i], THUMBNAIL_SIZE, NULL, NULL);
+		g_assert_nonnull (image);
+		if (i % 100 == 0)
+			assert_equal_images (image, thumbnails[i]);
+		cairo_surface_destroy (image);
+	}
+
+	return g_timer_elapsed (timer, NULL);
+}
+
+
+/* Reads the thumbnails of the folder from the freedesktop cache, returns
+ * the time it took. */
+static double
+read_freedesktop_cache (TestFolder       *folder,
+			cairo_surface_t **thumbnails,
+			GTimer           *timer)
+{
+	int i;
+
+	g_timer_start (timer);
+	for (i = 0; i < folder->n_files; i++) {
+		cairo_surface_t *image;
+
+		image = load_freedesktop_thumbnail (folder, folder->files[i], folder->infos[i]);
+		g_assert_nonnull (image);
+		if (i % 100 == 0)
+			assert_equal_images (image, thumbnails[i]);
+		cairo_surface_destroy (image);
+	}
+
+	return g_timer_elapsed (timer, NULL);
+}
+
+
+static void
+test_thumbnail_pack_folder_open (void)
+{
+	TestFolder        *folder;
+	GthThumbnailPack  *pack;
+	cairo_surface_t  **thumbnails;
+	int                n_files;
+	GTimer            *timer;
+	double             pack_store_time;
+	double             pack_cold_time;
+	double             pack_warm_time;
+	double             png_store_time;
+	double             png_cold_time;
+	double             png_warm_time;
+	guint              hits;
+	guint              misses;
+	GFileInfo         *info;
+	int                i;
+
+	n_files = g_test_perf () ? 20000 : 500;
+	folder = test_folder_new (n_files);
+	timer = g_timer_new ();
+
+	thumbnails = g_new (cairo_surface_t *, n_files);
+	for (i = 0; i < n_files; i++)
+		thumbnails[i] = create_thumbnail (i);
+
+	/* the same thumbnails in a pack and in the freedesktop cache */
+
+	g_timer_start (timer);
+	pack = gth_thumbnail_pack_new (folder->pack_directory);
+	for (i = 0; i < n_files; i++)
+		gth_thumbnail_pack_store (pack, folder->files[i], folder->infos[i], THUMBNAIL_SIZE, thumbnails[i], 4000, 3000);
+	gth_thumbnail_pack_free (pack);
+	pack_store_time = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (i = 0; i < n_files; i++)
+		save_freedesktop_thumbnail (folder, i, thumbnails[i]);
+	png_store_time = g_timer_elapsed (timer, NULL);
+
+	/* the freedesktop cache checks the modification time as well */
+
+	info = g_file_info_dup (folder->infos[0]);
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) + 1);
+	g_assert_null (load_freedesktop_thumbnail (folder, folder->files[0], info));
+	g_object_unref (info);
+
+	/* cold open: nothing in the page cache, then the same folder again */
+
+	drop_cached_data (folder->path);
+	pack = NULL;
+	pack_cold_time = read_pack (folder, &pack, thumbnails, timer);
+	pack_warm_time = read_pack (folder, &pack, thumbnails, timer);
+
+	gth_thumbnail_pack_get_stats (pack, &hits, &misses);
+	g_assert_cmpint (hits, ==, n_files * 2);
+	g_assert_cmpint (misses, ==, 0);
+	gth_thumbnail_pack_free (pack);
+
+	drop_cached_data (folder->path);
+	png_cold_time = read_freedesktop_cache (folder, thumbnails, timer);
+	png_warm_time = read_freedesktop_cache (folder, thumbnails, timer);
+
+	g_test_message ("%d thumbnails: pack store %.3fs, cold %.3fs, warm %.3fs; freedesktop store %.3fs, cold %.3fs, warm %.3fs",
+			n_files,
+			pack_store_time,
+			pack_cold_time,
+			pack_warm_time,
+			png_store_time,
+			png_cold_time,
+			png_warm_time);
+	if (g_test_perf ())
+		g_test_maximized_result (png_cold_time / pack_cold_time, "cold folder open, pack speedup over the freedesktop cache");
+
+	for (i = 0; i < n_files; i++)
+		cairo_surface_destroy (thumbnails[i]);
+	g_free (thumbnails);
+	g_timer_destroy (timer);
+	test_folder_free (folder);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/thumbnail-pack/round-trip", test_thumbnail_pack_round_trip);
+	g_test_add_func ("/thumbnail-pack/shared", test_thumbnail_pack_shared);
+	g_test_add_func ("/thumbnail-pack/folder-open", test_thumbnail_pack_folder_open);
+
+	return g_test_run ();
+}
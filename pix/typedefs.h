@@ -32,6 +32,8 @@ G_BEGIN_DECLS
 #define TAGS_FILE      "tags.xml"
 #define FILE_CACHE     "cache"
 #define SHORTCUTS_FILE "shortcuts.xml"
+#define METADATA_CACHE_DIR "metadata"
+#define THUMBNAIL_PACK_DIR "thumbnails"
 
 
 typedef enum {